@@ -176,12 +176,45 @@ typedef struct t_bt_device_descriptor {
 } tBT_device_descriptor;
 typedef tBT_device_descriptor* pBT_device_descriptor;
 
+typedef struct t_bt_stats_timer {
+    unsigned count;
+    unsigned max;
+    unsigned long long total;
+} tBT_stats_timer;
+
+typedef struct t_bt_stats {
+    unsigned cycles;                    // timers in CPU cycles if 1, in us if 0
+    tBT_stats_timer rx_deframe;         // transport RX entry -> bytes deframed
+    tBT_stats_timer hci_process;
+    tBT_stats_timer device_manager_process;
+    tBT_stats_timer logical_process;
+    tBT_stats_timer command_round_trip; // HCI command sent -> credit returned
+    unsigned command_queue_high;        // queue high-water marks
+    unsigned device_event_queue_high;
+    unsigned link_event_queue_high;
+    unsigned rx_data_queue_high;
+    unsigned tx_data_queue_high;        // deepest ACL link queue
+    unsigned hid_event_queue_high;      // deepest of all HID devices
+    unsigned queue_overflows;           // HCI queues, enqueued while full
+    unsigned queue_drops;               // HCI queues, larger than a slot
+    unsigned rx_overruns;               // UART RX FIFO overruns
+    unsigned rx_discarded;              // bytes skipped by the deframer
+    unsigned rx_dropped;                // packets the deframer dropped
+    unsigned pool_failures;             // packet pool exhausted
+    unsigned rx_reassembly_dropped;     // partial ACL PDUs dropped
+    unsigned rx_reassembly_timeouts;    // of these timed out
+} tBT_stats;
+typedef tBT_stats* pBT_stats;
+
 extern void* BT_Init(void*);
 extern pBT_device_map BT_Listen(void*, unsigned);
 extern pBT_device_map BT_Check(void*);
 extern void BT_Free(pBT_device_map);
 extern u8* BT_Find(pBT_device_map);
 extern bool BT_GetEvent(void*, void*, unsigned *);
+extern void BT_SetCoalescing(void*, bool);
+extern unsigned BT_GetLatency(char*, unsigned);
+extern bool BT_GetStats(void*, pBT_stats);
 #ifdef __cplusplus
 }
 #endif
@@ -44,6 +44,7 @@
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/btdevicemanager.h>
 #include <stdlib.h>
+#include <string.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -51,11 +52,8 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-// HCI Commands
+// Op codes
 
-class CBTHCICommand
-{
-	u16	OpCode;
 #define OGF_LINK_CONTROL		(1 << 10)
 	#define OP_CODE_INQUIRY						(OGF_LINK_CONTROL | 0x001)
 	#define OP_CODE_INQUIRY_CANCEL				(OGF_LINK_CONTROL | 0x002)
@@ -86,346 +84,315 @@ class CBTHCICommand
 	#define OP_CODE_WRITE_LOCAL_NAME		(OGF_HCI_CONTROL_BASEBAND | 0x013)
 	#define OP_CODE_WRITE_SCAN_ENABLE		(OGF_HCI_CONTROL_BASEBAND | 0x01A)
 	#define OP_CODE_WRITE_CLASS_OF_DEVICE	(OGF_HCI_CONTROL_BASEBAND | 0x024)
+	#define OP_CODE_SET_CONTROLLER_TO_HOST_FLOW_CONTROL	(OGF_HCI_CONTROL_BASEBAND | 0x031)
+	#define OP_CODE_HOST_BUFFER_SIZE		(OGF_HCI_CONTROL_BASEBAND | 0x033)
+	#define OP_CODE_HOST_NUMBER_OF_COMPLETED_PACKETS	(OGF_HCI_CONTROL_BASEBAND | 0x035)
 #define OGF_INFORMATIONAL_COMMANDS	(4 << 10)
+	#define OP_CODE_READ_BUFFER_SIZE		(OGF_INFORMATIONAL_COMMANDS | 0x005)
 	#define OP_CODE_READ_BD_ADDR			(OGF_INFORMATIONAL_COMMANDS | 0x009)
 #define OGF_VENDOR_COMMANDS		(0x3F << 10)
 	#define OP_CODE_DOWNLOAD_MINIDRIVER	(OGF_VENDOR_COMMANDS | 0x02E)
 	#define OP_CODE_WRITE_RAM		(OGF_VENDOR_COMMANDS | 0x04C)
 	#define OP_CODE_LAUNCH_RAM		(OGF_VENDOR_COMMANDS | 0x04E)
 
-	protected:
-	u8	ParameterTotalLength;
-
-	public:
-	CBTHCICommand(u16 nOpCode);
-}
-PACKED;
-
-#define PARAM_TOTAL_LEN(cmd)		(sizeof (cmd) - sizeof (CBTHCICommand))
+// Parameter values
 
-class CBTHCIReadStoredLinkKeyCommand : public CBTHCICommand
-{
-	u8	BDAddr[BT_BD_ADDR_SIZE];
-	u8	ReadAllFlag;
 #define RETURN_LINK_KEY_FOR_SPECIFIED_BD_ADDR		0x00
 #define RETURN_ALL_STORED_LINK_KEYS					0x01
 
-	public:
-	CBTHCIReadStoredLinkKeyCommand();
-	CBTHCIReadStoredLinkKeyCommand(u8* sBDAddr);
-}
-PACKED;
-
-class CBTHCIWriteStoredLinkKeyCommand : public CBTHCICommand
-{
-	u8	NumKeysToWrite;
-	u8	BDAddr[BT_BD_ADDR_SIZE];
-	u8	LinkKey[BT_MAX_LINK_KEY_SIZE];
-
-	public:
-	CBTHCIWriteStoredLinkKeyCommand();
-	CBTHCIWriteStoredLinkKeyCommand(u8* sBDAddr, u8* sLinkKey);
-}
-PACKED;
-
-class CBTHCIWriteLocalNameCommand : public CBTHCICommand
-{
-	u8	LocalName[BT_NAME_SIZE];
-
-	public:
-	CBTHCIWriteLocalNameCommand();
-	CBTHCIWriteLocalNameCommand(u8* sLocalName);
-}
-PACKED;
-
-class CBTHCIWriteScanEnableCommand : public CBTHCICommand
-{
-	u8	ScanEnable;
 #define SCAN_ENABLE_NONE		0x00
 #define SCAN_ENABLE_INQUIRY_ENABLED	0x01
 #define SCAN_ENABLE_PAGE_ENABLED	0x02
 #define SCAN_ENABLE_BOTH_ENABLED	0x03
 
-	public:
-	CBTHCIWriteScanEnableCommand();
-	CBTHCIWriteScanEnableCommand(u8 nScanEnable);
-}
-PACKED;
-
-class CBTHCIWriteClassOfDeviceCommand : public CBTHCICommand
-{
-	TBTCOD	ClassOfDevice;
-
-	public:
-	CBTHCIWriteClassOfDeviceCommand();
-	CBTHCIWriteClassOfDeviceCommand(TBTCOD sClassOfDevice);
-}
-PACKED;
+#define FLOW_CONTROL_OFF		0x00
+#define FLOW_CONTROL_ACL		0x01		// controller to host
 
-// Vencor Specific Commands
-
-class CBTHCIBcmVendorCommand : public CBTHCICommand
-{
-	u8	Data[255];
-
-	public:
-	CBTHCIBcmVendorCommand(u16 nOpCode, u8 nLength, u8* pData, unsigned *);
-}
-PACKED;
-
-// Link Control Commands
-
-class CBTHCIInquiryCommand : public CBTHCICommand
-{
-	u8	LAP[BT_CLASS_SIZE];
-#define INQUIRY_LAP_GIAC		0x9E8B33	// General Inquiry Access Code
-#define INQUIRY_LAP_LIAC		0x9E8B00	// Limited Inquiry Access Code
-	u8	InquiryLength;
-#define INQUIRY_LENGTH_MIN		0x01		// 1.28s
-#define INQUIRY_LENGTH_MAX		0x30		// 61.44s
-#define INQUIRY_LENGTH(secs)		(((secs) * 100 + 64) / 128)
-	u8	NumResponses;
-#define INQUIRY_NUM_RESPONSES_UNLIMITED	0x00
-
-	public:
-	CBTHCIInquiryCommand();
-	CBTHCIInquiryCommand(u8 nInquiryLength);
-}
-PACKED;
-
-class CBTHCIPeriodicInquiryModeCommand : public CBTHCICommand
-{
-	u16	MaxPeriodLength;
-	u16	MinPeriodLength;
-	u8	LAP[BT_CLASS_SIZE];
 #define INQUIRY_LAP_GIAC		0x9E8B33	// General Inquiry Access Code
 #define INQUIRY_LAP_LIAC		0x9E8B00	// Limited Inquiry Access Code
-	u8	InquiryLength;
 #define INQUIRY_LENGTH_MIN		0x01		// 1.28s
 #define INQUIRY_LENGTH_MAX		0x30		// 61.44s
 #define INQUIRY_LENGTH(secs)		(((secs) * 100 + 64) / 128)
-	u8	NumResponses;
 #define INQUIRY_NUM_RESPONSES_UNLIMITED	0x00
 
-	public:
-	CBTHCIPeriodicInquiryModeCommand();
-	CBTHCIPeriodicInquiryModeCommand(u8 nInquiryLength);
-}
-PACKED;
-
-class CBTHCICreateConnectionCommand : public CBTHCICommand
-{
-	u8	BDAddr[BT_BD_ADDR_SIZE];
-	u16	PacketType;
 #define PACKET_TYPE_DM1						0x0008
 #define PACKET_TYPE_DH1						0x0010
 #define PACKET_TYPE_DM3						0x0400
 #define PACKET_TYPE_DH3						0x0800
 #define PACKET_TYPE_DM5						0x4000
 #define PACKET_TYPE_DH5						0x8000
-	u8	PageScanRepetitionMode;
+
 #define PAGE_SCAN_REPETITION_R0		0x00
 #define PAGE_SCAN_REPETITION_R1		0x01
 #define PAGE_SCAN_REPETITION_R2		0x02
-	u8	PageScanMode;
+
 #define MANDATORY_PAGE_SCAN_MODE	0x00
 #define PAGE_SCAN_MODE_I					0x01
 #define PAGE_SCAN_MODE_II					0x02
 #define PAGE_SCAN_MODE_III				0x03
-	u16	ClockOffset;
+
 #define CLOCK_OFFSET_INVALID			0					// bit 15 is not set
 #define CLOCK_OFFSET_VALID				0x8000		// bit 15 is set
-	u8	AllowRoleSwitch;
+
 #define DISALLOW_ROLE_SWITCH			0x00
 #define ALLOW_ROLE_SWITCH					0x01
 
-	public:
-	CBTHCICreateConnectionCommand();
-	CBTHCICreateConnectionCommand(u8* sBDAddr, u8 nPageScanRepetitionMode);
-}
-PACKED;
-
-class CBTHCIDisconnectCommand : public CBTHCICommand
-{
-	u16	ConnectionHandle;
-	u8	Reason;
-
-	public:
-	CBTHCIDisconnectCommand();
-	CBTHCIDisconnectCommand(u16 nConnectionHandle, u8 nReason);
-}
-PACKED;
-
-class CBTHCIAcceptConnectionRequestCommand : public CBTHCICommand
-{
-	u8	BDAddr[BT_BD_ADDR_SIZE];
-	u8	Role;
 #define ROLE_MASTER	0x00
 #define ROLE_SLAVE	0x01
 
-	public:
-	CBTHCIAcceptConnectionRequestCommand();
-	CBTHCIAcceptConnectionRequestCommand(u8* sBDAddr, u8 nRole);
-}
-PACKED;
-
-class CBTHCIRejectConnectionRequestCommand : public CBTHCICommand
-{
-	u8	BDAddr[BT_BD_ADDR_SIZE];
-	u8	Reason;
+// Command encoder
+//
+// A command is described by its op code and the layout of its parameters.
+// Encode writes it in the HCI byte order byte by byte, straight into the
+// buffer it is sent from. The layout is resolved at compile time, there
+// is no packed object to build and copy, nor unaligned access to one.
 
-	public:
-	CBTHCIRejectConnectionRequestCommand();
-	CBTHCIRejectConnectionRequestCommand(u8* sBDAddr, u8 nReason);
-}
-PACKED;
+#define BT_HCI_COMMAND_HEADER_SIZE	3		// op code, parameter total length
 
-class CBTHCILinkKeyRequestReplyCommand : public CBTHCICommand
+struct TBTHCIField8
 {
-	u8	BDAddr[BT_BD_ADDR_SIZE];
-	u8	LinkKey[BT_MAX_LINK_KEY_SIZE];
+	typedef u8 TValue;
+	static constexpr unsigned Size = 1;
+	static void Put (u8 *p, u8 nValue)		{ p[0] = nValue; }
+};
 
-	public:
-	CBTHCILinkKeyRequestReplyCommand();
-	CBTHCILinkKeyRequestReplyCommand(u8* sBDAddr, u8* sLinkKey);
-}
-PACKED;
-
-class CBTHCILinkKeyRequestNegativeReplyCommand : public CBTHCICommand
+struct TBTHCIField16
 {
-	u8	BDAddr[BT_BD_ADDR_SIZE];
-
-	public:
-	CBTHCILinkKeyRequestNegativeReplyCommand();
-	CBTHCILinkKeyRequestNegativeReplyCommand(u8* nBDAddr);
-}
-PACKED;
+	typedef u16 TValue;
+	static constexpr unsigned Size = 2;
+	static void Put (u8 *p, u16 nValue)		{ p[0] = nValue & 0xFF;
+							  p[1] = nValue >> 8; }
+};
 
-class CBTHCIPINCodeRequestReplyCommand : public CBTHCICommand
+struct TBTHCIField24
 {
-	u8	BDAddr[BT_BD_ADDR_SIZE];
-	u8	PINCodeLength;
-	u8	PINCode[BT_MAX_PIN_CODE_SIZE];
-
-	public:
-	CBTHCIPINCodeRequestReplyCommand();
-	CBTHCIPINCodeRequestReplyCommand(u8* sBDAddr, u8 nLength, u8* sPINCode);
-}
-PACKED;
-
-class CBTHCIPINCodeRequestNegativeReplyCommand : public CBTHCICommand
+	typedef u32 TValue;
+	static constexpr unsigned Size = 3;
+	static void Put (u8 *p, u32 nValue)		{ p[0] = nValue & 0xFF;
+							  p[1] = nValue >> 8 & 0xFF;
+							  p[2] = nValue >> 16 & 0xFF; }
+};
+
+// copied as it is, e.g. an address or a key
+template <unsigned N>
+struct TBTHCIFieldBytes
 {
-	u8	BDAddr[BT_BD_ADDR_SIZE];
-
-	public:
-	CBTHCIPINCodeRequestNegativeReplyCommand();
-	CBTHCIPINCodeRequestNegativeReplyCommand(u8* sBDAddr);
-}
-PACKED;
-
-class CBTHCIAuthenticationRequestedCommand : public CBTHCICommand
+	typedef const void *TValue;
+	static constexpr unsigned Size = N;
+	static void Put (u8 *p, const void *pValue)	{ memcpy (p, pValue, N); }
+};
+
+typedef TBTHCIFieldBytes<BT_BD_ADDR_SIZE>	TBTHCIFieldBDAddr;
+typedef TBTHCIFieldBytes<BT_MAX_LINK_KEY_SIZE>	TBTHCIFieldLinkKey;
+typedef TBTHCIFieldBytes<BT_MAX_PIN_CODE_SIZE>	TBTHCIFieldPINCode;	// zero padded
+typedef TBTHCIFieldBytes<BT_NAME_SIZE>		TBTHCIFieldName;
+typedef TBTHCIFieldBytes<sizeof (TBTCOD)>	TBTHCIFieldCOD;
+
+template <typename... TFields>
+struct TBTHCIFieldList;
+
+template <>
+struct TBTHCIFieldList<>
 {
-	u16	ConnectionHandle;
+	static constexpr unsigned Size = 0;
+	static void Put (u8 *)				{ }
+};
 
-	public:
-	CBTHCIAuthenticationRequestedCommand();
-	CBTHCIAuthenticationRequestedCommand(u16 nConnectionHandle);
-}
-PACKED;
-
-class CBTHCIRemoteNameRequestCommand : public CBTHCICommand
+template <typename TField, typename... TRest>
+struct TBTHCIFieldList<TField, TRest...>
 {
-	u8	BDAddr[BT_BD_ADDR_SIZE];
-	u8	PageScanRepetitionMode;
-//#define PAGE_SCAN_REPETITION_R0		0x00
-//#define PAGE_SCAN_REPETITION_R1		0x01
-//#define PAGE_SCAN_REPETITION_R2		0x02
-	u8	Reserved;				// set to 0
-	u16	ClockOffset;
-//#define CLOCK_OFFSET_INVALID		0		// bit 15 is not set
-
-	public:
-	CBTHCIRemoteNameRequestCommand();
-	CBTHCIRemoteNameRequestCommand(u8* sBDAddr, u8 nPageScanRepetitionMode);
-}
-PACKED;
-
-class CBTHCIReadRemoteSupportedFeaturesCommand : public CBTHCICommand
+	static constexpr unsigned Size = TField::Size + TBTHCIFieldList<TRest...>::Size;
+
+	static void Put (u8 *p, typename TField::TValue Value,
+			 typename TRest::TValue... Rest)
+	{
+		TField::Put (p, Value);
+		TBTHCIFieldList<TRest...>::Put (p + TField::Size, Rest...);
+	}
+};
+
+template <u16 nOpCode, typename... TFields>
+struct TBTHCICommand
 {
-	u16	ConnectionHandle;
+	static constexpr u16 OpCode = nOpCode;
+	static constexpr unsigned ParameterLength = TBTHCIFieldList<TFields...>::Size;
+	static constexpr unsigned Length = BT_HCI_COMMAND_HEADER_SIZE + ParameterLength;
+
+	// pBuffer must hold Length bytes, returns Length
+	static unsigned Encode (u8 *pBuffer, typename TFields::TValue... Values)
+	{
+		pBuffer[0] = nOpCode & 0xFF;
+		pBuffer[1] = nOpCode >> 8;
+		pBuffer[2] = ParameterLength;
+		TBTHCIFieldList<TFields...>::Put (pBuffer + BT_HCI_COMMAND_HEADER_SIZE,
+						  Values...);
+		return Length;
+	}
+
+	static_assert (ParameterLength <= 255, "HCI command parameters too long");
+};
+
+static_assert (sizeof (TBTCOD) == 3, "class of device must be 3 bytes");
 
-	public:
-	CBTHCIReadRemoteSupportedFeaturesCommand();
-	CBTHCIReadRemoteSupportedFeaturesCommand(u16 nConnectionHandle);
-}
-PACKED;
+// HCI Commands
 
-class CBTHCIReadRemoteVersionInformationCommand : public CBTHCICommand
-{
-	u16	ConnectionHandle;
+typedef TBTHCICommand<OP_CODE_RESET>			TBTHCIResetCommand;
+typedef TBTHCICommand<OP_CODE_READ_BD_ADDR>		TBTHCIReadBDAddrCommand;
+typedef TBTHCICommand<OP_CODE_READ_BUFFER_SIZE>		TBTHCIReadBufferSizeCommand;
 
-	public:
-	CBTHCIReadRemoteVersionInformationCommand();
-	CBTHCIReadRemoteVersionInformationCommand(u16 nConnectionHandle);
-}
-PACKED;
+typedef TBTHCICommand<OP_CODE_READ_STORED_LINK_KEY,
+		      TBTHCIFieldBDAddr,
+		      TBTHCIField8>				// ReadAllFlag
+	TBTHCIReadStoredLinkKeyCommand;
 
-class CBTHCILPHoldModeCommand : public CBTHCICommand
-{
-	u16	ConnectionHandle;
-	u16	HoldModeMaxInterval;
-	u16	HoldModeMinInterval;
+typedef TBTHCICommand<OP_CODE_WRITE_STORED_LINK_KEY,
+		      TBTHCIField8,				// NumKeysToWrite
+		      TBTHCIFieldBDAddr,
+		      TBTHCIFieldLinkKey>
+	TBTHCIWriteStoredLinkKeyCommand;
 
-	public:
-	CBTHCILPHoldModeCommand();
-	CBTHCILPHoldModeCommand(u16, u16, u16);
-}
-PACKED;
+typedef TBTHCICommand<OP_CODE_WRITE_LOCAL_NAME,
+		      TBTHCIFieldName>
+	TBTHCIWriteLocalNameCommand;
 
-class CBTHCILPSniffModeCommand : public CBTHCICommand
-{
-	u16	ConnectionHandle;
-	u16	SniffMaxInterval;
-	u16	SniffMinInterval;
-	u16	SniffAttempt;
-	u16	SniffTimeout;
-
-	public:
-	CBTHCILPSniffModeCommand();
-	CBTHCILPSniffModeCommand(u16, u16, u16, u16, u16);
-}
-PACKED;
-
-class CBTHCILPExitSniffModeCommand : public CBTHCICommand
-{
-	u16	ConnectionHandle;
+typedef TBTHCICommand<OP_CODE_WRITE_SCAN_ENABLE,
+		      TBTHCIField8>				// ScanEnable
+	TBTHCIWriteScanEnableCommand;
 
-	public:
-	CBTHCILPExitSniffModeCommand();
-	CBTHCILPExitSniffModeCommand(u16);
-}
-PACKED;
+typedef TBTHCICommand<OP_CODE_WRITE_CLASS_OF_DEVICE,
+		      TBTHCIFieldCOD>
+	TBTHCIWriteClassOfDeviceCommand;
 
-class CBTHCILPParkModeCommand : public CBTHCICommand
-{
-	u16	ConnectionHandle;
-	u16	BeaconMaxInterval;
-	u16	BeaconMinInterval;
+typedef TBTHCICommand<OP_CODE_HOST_BUFFER_SIZE,
+		      TBTHCIField16,				// HostACLDataPacketLength
+		      TBTHCIField8,				// HostSynchronousDataPacketLength
+		      TBTHCIField16,				// HostTotalNumACLDataPackets
+		      TBTHCIField16>				// HostTotalNumSynchronousDataPackets
+	TBTHCIHostBufferSizeCommand;
 
-	public:
-	CBTHCILPParkModeCommand();
-	CBTHCILPParkModeCommand(u16, u16, u16);
-}
-PACKED;
+typedef TBTHCICommand<OP_CODE_SET_CONTROLLER_TO_HOST_FLOW_CONTROL,
+		      TBTHCIField8>				// FlowControlEnable
+	TBTHCISetControllerToHostFlowControlCommand;
 
-class CBTHCILPExitParkModeCommand : public CBTHCICommand
-{
-	u16	ConnectionHandle;
+// sent without a command slot and not answered, one handle at a time
+typedef TBTHCICommand<OP_CODE_HOST_NUMBER_OF_COMPLETED_PACKETS,
+		      TBTHCIField8,				// NumberOfHandles
+		      TBTHCIField16,				// ConnectionHandle
+		      TBTHCIField16>				// HostNumOfCompletedPackets
+	TBTHCIHostNumberOfCompletedPacketsCommand;
+
+// Vendor Specific Commands
+
+typedef TBTHCICommand<OP_CODE_DOWNLOAD_MINIDRIVER>	TBTHCIDownloadMinidriverCommand;
+
+// Link Control Commands
 
-	public:
-	CBTHCILPExitParkModeCommand();
-	CBTHCILPExitParkModeCommand(u16);
-}
-PACKED;
+typedef TBTHCICommand<OP_CODE_INQUIRY,
+		      TBTHCIField24,				// LAP
+		      TBTHCIField8,				// InquiryLength
+		      TBTHCIField8>				// NumResponses
+	TBTHCIInquiryCommand;
+
+typedef TBTHCICommand<OP_CODE_INQUIRY_CANCEL>		TBTHCIInquiryCancelCommand;
+
+typedef TBTHCICommand<OP_CODE_PERIODIC_INQUIRY_MODE,
+		      TBTHCIField16,				// MaxPeriodLength
+		      TBTHCIField16,				// MinPeriodLength
+		      TBTHCIField24,				// LAP
+		      TBTHCIField8,				// InquiryLength
+		      TBTHCIField8>				// NumResponses
+	TBTHCIPeriodicInquiryModeCommand;
+
+typedef TBTHCICommand<OP_CODE_CREATE_CONNECTION,
+		      TBTHCIFieldBDAddr,
+		      TBTHCIField16,				// PacketType
+		      TBTHCIField8,				// PageScanRepetitionMode
+		      TBTHCIField8,				// PageScanMode
+		      TBTHCIField16,				// ClockOffset
+		      TBTHCIField8>				// AllowRoleSwitch
+	TBTHCICreateConnectionCommand;
+
+typedef TBTHCICommand<OP_CODE_DISCONNECT,
+		      TBTHCIField16,				// ConnectionHandle
+		      TBTHCIField8>				// Reason
+	TBTHCIDisconnectCommand;
+
+typedef TBTHCICommand<OP_CODE_ACCEPT_CONNECTION_REQUEST,
+		      TBTHCIFieldBDAddr,
+		      TBTHCIField8>				// Role
+	TBTHCIAcceptConnectionRequestCommand;
+
+typedef TBTHCICommand<OP_CODE_REJECT_CONNECTION_REQUEST,
+		      TBTHCIFieldBDAddr,
+		      TBTHCIField8>				// Reason
+	TBTHCIRejectConnectionRequestCommand;
+
+typedef TBTHCICommand<OP_CODE_LINK_KEY_REQUEST_REPLY,
+		      TBTHCIFieldBDAddr,
+		      TBTHCIFieldLinkKey>
+	TBTHCILinkKeyRequestReplyCommand;
+
+typedef TBTHCICommand<OP_CODE_LINK_KEY_REQUEST_NEGATIVE_REPLY,
+		      TBTHCIFieldBDAddr>
+	TBTHCILinkKeyRequestNegativeReplyCommand;
+
+typedef TBTHCICommand<OP_CODE_PIN_CODE_REQUEST_REPLY,
+		      TBTHCIFieldBDAddr,
+		      TBTHCIField8,				// PINCodeLength
+		      TBTHCIFieldPINCode>
+	TBTHCIPINCodeRequestReplyCommand;
+
+typedef TBTHCICommand<OP_CODE_PIN_CODE_REQUEST_NEGATIVE_REPLY,
+		      TBTHCIFieldBDAddr>
+	TBTHCIPINCodeRequestNegativeReplyCommand;
+
+typedef TBTHCICommand<OP_CODE_AUTHENTICATION_REQUESTED,
+		      TBTHCIField16>				// ConnectionHandle
+	TBTHCIAuthenticationRequestedCommand;
+
+typedef TBTHCICommand<OP_CODE_REMOTE_NAME_REQUEST,
+		      TBTHCIFieldBDAddr,
+		      TBTHCIField8,				// PageScanRepetitionMode
+		      TBTHCIField8,				// Reserved, 0
+		      TBTHCIField16>				// ClockOffset
+	TBTHCIRemoteNameRequestCommand;
+
+typedef TBTHCICommand<OP_CODE_READ_REMOTE_SUPPORTED_FEATURES,
+		      TBTHCIField16>				// ConnectionHandle
+	TBTHCIReadRemoteSupportedFeaturesCommand;
+
+typedef TBTHCICommand<OP_CODE_READ_REMOTE_VERSION_INFORMATION,
+		      TBTHCIField16>				// ConnectionHandle
+	TBTHCIReadRemoteVersionInformationCommand;
+
+// Link Policy Commands
+
+typedef TBTHCICommand<OP_CODE_HOLD_MODE,
+		      TBTHCIField16,				// ConnectionHandle
+		      TBTHCIField16,				// HoldModeMaxInterval
+		      TBTHCIField16>				// HoldModeMinInterval
+	TBTHCILPHoldModeCommand;
+
+typedef TBTHCICommand<OP_CODE_SNIFF_MODE,
+		      TBTHCIField16,				// ConnectionHandle
+		      TBTHCIField16,				// SniffMaxInterval
+		      TBTHCIField16,				// SniffMinInterval
+		      TBTHCIField16,				// SniffAttempt
+		      TBTHCIField16>				// SniffTimeout
+	TBTHCILPSniffModeCommand;
+
+typedef TBTHCICommand<OP_CODE_EXIT_SNIFF_MODE,
+		      TBTHCIField16>				// ConnectionHandle
+	TBTHCILPExitSniffModeCommand;
+
+typedef TBTHCICommand<OP_CODE_PARK_MODE,
+		      TBTHCIField16,				// ConnectionHandle
+		      TBTHCIField16,				// BeaconMaxInterval
+		      TBTHCIField16>				// BeaconMinInterval
+	TBTHCILPParkModeCommand;
+
+typedef TBTHCICommand<OP_CODE_EXIT_PARK_MODE,
+		      TBTHCIField16>				// ConnectionHandle
+	TBTHCILPExitParkModeCommand;
 
 #endif
@@ -13,7 +13,7 @@
 ** Company:        Ariana Communications OPC Private Limited
 ** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
 **
-** Description:    Raspberry Pi BareMetal Bluetooth Pointer Array Header
+** Description:    Raspberry Pi BareMetal Bluetooth L2CAP Frame Check Sequence Header
 **
 ** Dependencies:
 ** 
@@ -35,31 +35,18 @@
 ** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
 ** 
 *******************************************************************************/
-#ifndef _bt_ptrarray_h
-#define _bt_ptrarray_h
+#ifndef _bt_crc_h
+#define _bt_crc_h
 
-class CPtrArray					// dynamic array of pointers
+#include <types.h>
+
+// CRC-16 of the L2CAP FCS: polynomial x^16 + x^15 + x^2 + 1, processed
+// LSB first, initial value 0, no final inversion
+class CBTCRC16
 {
 public:
-	CPtrArray (unsigned nInitialSize = 100, unsigned nSizeIncrement = 100);
-	~CPtrArray (void);
-
-	unsigned GetCount (void) const;			// get number of elements in the array
-
-	void *&operator[] (unsigned nIndex);		// get element for index
-	void *operator[] (unsigned  nIndex) const;
-
-	unsigned Append (void *pPtr);			// append element to end of array
-	unsigned Delete (void *pPtr);			// delete element from array
-	bool Find (void *pPtr);			// delete element from array
-
-	void RemoveLast (void);				// remove last element
-
-private:
-	unsigned  m_nReservedSize;
-	unsigned  m_nSizeIncrement;
-	unsigned  m_nUsedCount;
-	void	**m_ppArray;
+	// nCRC is 0 for a new frame, or the result over the preceding part
+	static u16 Update (u16 nCRC, const void *pData, unsigned nLength);
 };
 
 #endif
@@ -84,6 +84,7 @@ public:
 	bool IsJoystick (void);
 	bool IsComputer (void);
 	bool IsConnecting (void);
+	bool IsConnected (void);
 
 	// Get params
 	const u8 *GetBDAddress (void) const;
@@ -41,14 +41,20 @@
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/btqueue.h>
 #include <bluetooth/btlayer.h>
+#include <bluetooth/btfirmwareloader.h>
 #include <types.h>
 
+#define BT_LINK_KEY_REQUESTS	8		// stored keys being read at once
+
 enum TBTDeviceState
 {
 	BTDeviceStateResetPending,
-	BTDeviceStateWriteRAMPending,
-	BTDeviceStateLaunchRAMPending,
+	BTDeviceStateWriteRAMPending,		// minidriver and patch records
+	BTDeviceStateLaunchRAMPending,		// until the patched firmware answers
 	BTDeviceStateReadBDAddrPending,
+	BTDeviceStateReadBufferSizePending,
+	BTDeviceStateHostBufferSizePending,
+	BTDeviceStateHostFlowControlPending,
 	BTDeviceStateWriteClassOfDevicePending,
 	BTDeviceStateWriteLocalNamePending,
 	BTDeviceStateWriteScanEnabledPending,
@@ -97,12 +103,14 @@ public:
 
 	void Process (void);
 
-	void SetConnection (CBTConnection*);
+	// the connections whose stored link key is being read, oldest first
+	boolean PushLinkKeyRequest (CBTConnection*);	// FALSE if full
+	CBTConnection *PopLinkKeyRequest (void);	// 0 if none
 
 	inline void SetState (TBTDeviceState eState) {m_State = eState;}
 	inline bool CheckState (TBTDeviceState eState) {return (m_State == eState);}
 
-	void SetHCICommandPackets (unsigned);
+	void SetHCICommandPackets (unsigned nCommandPackets, u16 nOpCode);
 
 	u8*  GetBDAddr (void);
 
@@ -110,14 +118,20 @@ public:
 
 	boolean DeviceIsRunning (void) const;
 
-	bool SendHCICommand (const void*, unsigned);
+	// true if the command could not be queued, the template is defined
+	// in bthcilayer.h
+	template <typename TCommand, typename... TArgs>
+	bool SendHCICommand (TArgs... Args);
+	bool SendHCICommand (u16 nOpCode, const void *pParameters, u8 nLength);
 
 private:
 	CBTHCILayer *m_pHCILayer;
 	CBTQueue    *m_pEventQueue;
 	TBTCOD	     m_nClassOfDevice;
 	u8	     m_LocalName[BT_NAME_SIZE];
-	CBTConnection    *m_pConnection;
+	CBTConnection    *m_LinkKeyRequest[BT_LINK_KEY_REQUESTS];
+	unsigned	     m_nLinkKeyIn;
+	unsigned	     m_nLinkKeyOut;
 
 	TBTDeviceState m_State;
 
@@ -125,7 +139,7 @@ private:
 
 	u8 *m_pBuffer;
 
-	unsigned m_nFirmwareOffset;
+	CBTFirmwareLoader m_FirmwareLoader;
 
 	friend class CBTHCIEventCommandComplete;
 };
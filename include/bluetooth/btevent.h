@@ -227,8 +227,7 @@ PACKED;
 class CBTHCIEventNumberOfCompletedPackets : public CBTHCIEvent
 {
 	u8	NumberOfHandles;
-	u16	ConnectionHandle[1];
-	u16	HCNumOfCompletedPackets[1];
+	u8	Params[0];		// all handles, then all counts (u16 each)
 
 	void Process(void*, u16);
 	public:
@@ -321,6 +320,19 @@ class CBTHCIEventReadBDAddrComplete : public CBTHCIEventCommandComplete
 }
 PACKED;
 
+class CBTHCIEventReadBufferSizeComplete : public CBTHCIEventCommandComplete
+{
+	u16	ACLDataPacketLength;
+	u8	SynchronousDataPacketLength;
+	u16	TotalNumACLDataPackets;
+	u16	TotalNumSynchronousDataPackets;
+
+	public:
+	CBTHCIEventReadBufferSizeComplete();
+	friend class CBTHCIEventCommandComplete;
+}
+PACKED;
+
 class CBTHCIEventReadStoredLinkKeyComplete : public CBTHCIEventCommandComplete
 {
 	u16	MaxNumKeys;
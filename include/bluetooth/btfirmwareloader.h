@@ -0,0 +1,105 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth Firmware Loader Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_firmwareloader_h
+#define _bt_firmwareloader_h
+
+#include <bluetooth/bluetooth.h>
+#include <types.h>
+#include <stdlib.h>
+
+#define BT_FIRMWARE_RECORD_HEADER	3	// op code and parameter length
+#define BT_FIRMWARE_STALL_TIMEOUT	1000000	// us without a completion before giving up
+#define BT_FIRMWARE_RESET_TIMEOUT	50000	// us the patched firmware may take to answer
+#define BT_FIRMWARE_RESET_RETRIES	10
+
+class CBTHCILayer;
+
+//
+// Streams the HCD patch image to the controller. The image is indexed once,
+// then as many Write RAM records are kept in flight as the controller takes
+// commands. Launch RAM is sent when every record has completed, after that
+// a Reset is repeated until the patched firmware answers it.
+//
+class CBTFirmwareLoader
+{
+public:
+	CBTFirmwareLoader (CBTHCILayer *pHCILayer);
+	~CBTFirmwareLoader (void);
+
+	// indexes the records, FALSE if the image is malformed
+	boolean Initialize (void);
+
+	// sends Download Minidriver, FALSE if there is nothing to load
+	boolean Start (void);
+
+	// a loader command completed successfully, sends the next records,
+	// returns TRUE once Launch RAM completed and the Reset is sent
+	boolean CommandComplete (u16 nOpCode);
+
+	// call while loading, repeats the Reset and returns FALSE on a timeout
+	boolean Process (void);
+
+	unsigned GetRecords (void) const	{ return m_nRecords; }
+
+	void* operator new(size_t T) { return (void *)malloc(T); }
+	void operator delete (void *ptr) { free(ptr); }
+
+private:
+	void SendRecords (void);
+	void SendReset (void);
+
+	u16 GetOpCode (unsigned nRecord) const;
+
+private:
+	CBTHCILayer *m_pHCILayer;
+
+	const u8 *m_pImage;			// the patch built into the stack
+	unsigned m_nSize;
+
+	unsigned *m_pRecord;			// offset of each record
+	unsigned m_nRecords;
+
+	unsigned m_nNextRecord;			// to be sent
+	unsigned m_nInFlight;			// sent, not completed
+	boolean m_bLaunched;
+	unsigned m_nResets;			// sent since the launch
+
+	unsigned m_nLastTicks;			// last progress
+};
+
+#endif
@@ -0,0 +1,96 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth H4 Deframer Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_bth4deframer_h
+#define _bt_bth4deframer_h
+
+#include <bluetooth/bttransportlayer.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/btpacket.h>
+#include <types.h>
+
+// Splits an H4 (UART) byte stream into HCI packets. Input is taken in
+// spans of any size, header and payload runs are copied with memcpy.
+// Events and SCO data are delivered from an internal buffer, ACL data in
+// a packet from the pool which the data handler takes over. All state is
+// per instance.
+
+#define BT_H4_BUFFER_SIZE	(3 + 255)	// largest SCO packet, events are smaller
+class CBTH4Deframer
+{
+public:
+	CBTH4Deframer (void);
+	~CBTH4Deframer (void);
+
+	void RegisterHCIEventHandler (TBTHCIEventHandler *pHandler);
+	void RegisterHCIDataHandler (TBTHCIDataHandler *pHandler);
+	void RegisterHCISCOHandler (TBTHCISCOHandler *pHandler);	// optional
+
+	// consume nLength bytes, complete packets are delivered at once
+	void Parse (const u8 *pData, unsigned nLength);
+
+	// drop a partial packet and wait for the next packet type
+	void Reset (void);
+
+	unsigned GetDiscarded (void) const	{ return m_nDiscarded; }	// bytes
+	unsigned GetDropped (void) const	{ return m_nDropped; }		// packets
+
+private:
+	boolean BeginPacket (u8 nPacketType);
+	boolean BeginPayload (void);
+	void Deliver (void);
+
+private:
+	TBTHCIEventHandler *m_pEventHandler;
+	TBTHCIDataHandler *m_pDataHandler;
+	TBTHCISCOHandler *m_pSCOHandler;
+
+	unsigned m_nState;
+	u8 m_nPacketType;
+	unsigned m_nHeaderLength;
+	unsigned m_nPacketLength;		// header + payload
+	unsigned m_nReceived;
+
+	CBTPacket *m_pPacket;			// ACL destination
+	u8 *m_pBuffer;				// 0 while a payload is skipped
+	u8 m_Buffer[BT_H4_BUFFER_SIZE];
+
+	unsigned m_nDiscarded;
+	unsigned m_nDropped;
+};
+
+#endif
@@ -0,0 +1,86 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth Hash Index Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_bthashindex_h
+#define _bt_bthashindex_h
+
+#include <types.h>
+#include <stdlib.h>
+
+#define BT_HASH_INDEX_SIZE	16		// initial slots, must be a power of 2
+
+// Open addressing map from a key to a non-null pointer. Collisions probe
+// linearly, Remove shifts the following entries back so no tombstones pile
+// up. The table doubles when it gets 3/4 full, Insert may allocate and
+// must be called from task level.
+class CBTHashIndex
+{
+public:
+	CBTHashIndex (unsigned nInitialSize = BT_HASH_INDEX_SIZE);
+	~CBTHashIndex (void);
+
+	// replaces the value of an existing key, FALSE if out of memory
+	boolean Insert (u64 nKey, void *pValue);
+	// removes nKey if it maps to pValue (or to anything if pValue is 0)
+	void Remove (u64 nKey, const void *pValue = 0);
+	void *Lookup (u64 nKey) const;			// 0 if not found
+
+	unsigned GetCount (void) const		{ return m_nCount; }
+
+	static u64 BDAddrKey (const u8 *pBDAddr);
+
+	void* operator new(size_t T) { return (void *)malloc(T); }
+	void operator delete (void *ptr) { free(ptr); }
+
+private:
+	unsigned Hash (u64 nKey) const;
+	boolean Grow (void);
+
+private:
+	struct TBTHashSlot
+	{
+		u64	 nKey;
+		void	*pValue;			// 0 if the slot is free
+	};
+
+	TBTHashSlot *m_pSlots;
+	unsigned m_nSize;
+	unsigned m_nShift;				// 64 - log2 (m_nSize)
+	unsigned m_nCount;
+};
+
+#endif
@@ -40,14 +40,74 @@
 
 #include <bluetooth/bttransportlayer.h>
 //#include <usb/usbbluetooth.h>
+#include <sysconfig.h>
+#ifdef BT_HAVE_SIM
+#include <bluetooth/btsimtransport.h>
+#else
 #include <bluetooth/btuarttransport.h>
+#endif
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/btdevicemanager.h>
+#include <bluetooth/btcommand.h>
 #include <bluetooth/btqueue.h>
+#include <bluetooth/btpacket.h>
+#include <bluetooth/btstats.h>
 #include <types.h>
 
 #undef BTUSB
 
+// the transport registered as "ttyBT1"
+#ifdef BT_HAVE_SIM
+typedef CBTSimTransport TBTHCITransport;
+#else
+typedef CBTUARTTransport TBTHCITransport;
+#endif
+
+// queue depths (slots are sized to the packet class they carry)
+#define BT_HCI_COMMAND_QUEUE_SIZE	16	// a few links set up at once
+#define BT_HCI_DEVICE_EVENT_QUEUE_SIZE	16	// an answer per command in flight and a NOP
+#define BT_HCI_MAX_COMMAND_PACKETS	(BT_HCI_DEVICE_EVENT_QUEUE_SIZE - 1)
+#define BT_HCI_LINK_EVENT_QUEUE_SIZE	32
+#define BT_HCI_RX_DATA_QUEUE_SIZE	32	// also the fragments the controller may send ahead
+#define BT_HCI_TX_LINK_QUEUE_SIZE	8	// per ACL link
+
+#define BT_HCI_MAX_ACL_LINKS		7	// active slaves in a piconet
+#define BT_HCI_NO_HANDLE		0xFFFF
+
+#define BT_HCI_MAX_SCATTER		4	// list entries per SendData call
+
+#define BT_HCI_RX_DEFAULT_MTU		672	// L2CAP default until one is configured
+#define BT_HCI_RX_REASSEMBLY_TIMEOUT	2000000	// us a partial PDU may wait for a fragment
+#define BT_HCI_RX_ACL_LENGTH		(BT_MAX_DATA_SIZE - 4)	// largest fragment payload taken
+
+// One ACL connection as seen by the TX scheduler. The controller buffers
+// are shared by all links, nInFlight are those this link holds.
+// Received fragments are reassembled per link, so links may interleave.
+struct TBTACLLink
+{
+	TBTACLLink (void)
+	:	nHandle (BT_HCI_NO_HANDLE),
+		nInFlight (0),
+		TxQueue (BT_HCI_TX_LINK_QUEUE_SIZE, BT_MAX_DATA_SIZE),
+		pRxPacket (0),
+		nRxLength (0),
+		nRxLast (0),
+		nRxMTU (BT_HCI_RX_DEFAULT_MTU),
+		nRxCompleted (0)
+	{
+	}
+
+	volatile u16	nHandle;
+	unsigned	nInFlight;		// sent, completion not reported yet
+	CBTQueue	TxQueue;
+
+	CBTPacket	*pRxPacket;		// PDU being reassembled
+	unsigned	nRxLength;		// its expected length, 0 until known
+	unsigned	nRxLast;		// ticks at its last fragment
+	unsigned	nRxMTU;			// largest L2CAP payload accepted
+	unsigned	nRxCompleted;		// fragments taken, not reported yet
+};
+
 class CBTHCILayer
 {
 public:
@@ -60,53 +120,124 @@ public:
 
 	void Process (void);
 
-	void SendCommand (const void *pBuffer, unsigned nLength);
-	void SendData (const void *pBuffer, unsigned nLength);
+	// encodes a TBTHCICommand in place in the command queue, e.g.
+	// SendCommand<TBTHCIDisconnectCommand> (nHandle, nReason);
+	// returns FALSE if the queue is full
+	template <typename TCommand, typename... TArgs>
+	boolean SendCommand (TArgs... Args)
+	{
+		u8 *pSlot = (u8 *) m_CommandQueue.BeginEnqueue (TCommand::Length);
+		if (pSlot == 0) return FALSE;
+		m_CommandQueue.EndEnqueue (TCommand::Encode (pSlot, Args...));
+		return TRUE;
+	}
+	// a command whose parameters are known at run time only
+	boolean SendCommand (u16 nOpCode, const void *pParameters, u8 nLength);
+	void SendData (const void *pBuffer, unsigned nLength);	// one complete ACL packet
+	// gathers the list into ACL packets of at most GetACLDataLength() bytes,
+	// queues all of them or none and returns FALSE in the latter case
+	boolean SendData (u16 nConnectionHandle, const TBTScatter *pList, unsigned nEntries);
 
 	// pBuffer must have size BT_MAX_HCI_EVENT_SIZE
 	boolean ReceiveLinkEvent (void *pBuffer, unsigned *pResultLength);
-	// pBuffer must have size BT_MAX_DATA_SIZE
-	boolean ReceiveData (void *pBuffer, unsigned *pResultLength);
+	// caller owns the returned packet and must Release() it
+	boolean ReceiveData (CBTPacket **ppPacket);
+
+	// from Command Complete/Status, nOpCode is 0 if no command was answered
+	void SetCommandPackets (unsigned nCommandPackets, u16 nOpCode);
+	unsigned GetCommandPackets (void) const	{ return m_nCommandPackets; }
+	// the controller restarted, commands sent before are not answered
+	void ResetCommandPackets (void);
+
+	// from HCI Read Buffer Size, sizes the ACL credit pool
+	void SetBufferSize (unsigned nACLDataLength, unsigned nACLDataPackets);
+	unsigned GetACLDataLength (void) const	{ return m_nACLDataLength; }
+
+	// ACL data is queued per connection handle and sent round-robin,
+	// a link must be added before data is sent on it
+	boolean AddLink (u16 nConnectionHandle);
+	void RemoveLink (u16 nConnectionHandle);	// drops queued data, returns its credits
 
-	void SetCommandPackets (unsigned nCommandPackets);	// set commands allowed to be sent
-	void SetDataPackets (unsigned nDataPackets);	// set data allowed to be sent
+	// the controller sends no more fragments than the host reported as
+	// completed, set once it accepted Set Controller To Host Flow Control
+	void SetHostFlowControl (boolean bOn)	{ m_bHostFlowControl = bOn; }
+
+	// raises the largest L2CAP payload reassembled on a link
+	void SetReceiveMTU (u16 nConnectionHandle, unsigned nMTU);
+
+	// from Number Of Completed Packets
+	void CompleteDataPackets (u16 nConnectionHandle, unsigned nPackets);
+
+	unsigned GetDataPackets (void) const	{ return m_nDataPackets; }	// credits left
+	unsigned GetDataPacketsInFlight (u16 nConnectionHandle) const;
 
 	CBTDeviceManager *GetDeviceManager (void);
 
+	// fills in the queue fields of pStats
+	void GetStats (tBT_stats *pStats) const;
+
+	// events, fragments and partial PDUs lost on the way in, also
+	// without BT_HAVE_STATS
+	unsigned GetReceiveDrops (void) const;
+
 private:
 	void EventHandler (const void *pBuffer, unsigned nLength);
 	static void EventStub (const void *pBuffer, unsigned nLength);
-	void DataHandler (const void *pBuffer, unsigned nLength);
-	static void DataStub (const void *pBuffer, unsigned nLength);
+	void DataHandler (CBTPacket *pPacket);
+	static void DataStub (CBTPacket *pPacket);
+
+	TBTACLLink *GetLink (u16 nConnectionHandle);
+
+	// returns the PDU completed by the fragment or 0
+	CBTPacket *Reassemble (CBTPacket *pPacket);
+	boolean SizeReassembly (TBTACLLink *pLink);	// FALSE if the PDU was dropped
+	void DropReassembly (TBTACLLink *pLink);
+	void ExpireReassembly (void);
+	void ReportCompletedData (void);
 
 private:
 #ifdef BTUSB
 	CUSBBluetoothDevice *m_pHCITransportUSB;
 #endif
-	CBTUARTTransport *m_pHCITransportUART;
+	TBTHCITransport *m_pHCITransportUART;
 
 	CBTDeviceManager m_DeviceManager;
 
 	CBTQueue m_CommandQueue;
 	CBTQueue m_DeviceEventQueue;
-	CBTQueue m_LinkEventQueue;
-	CBTQueue m_RxDataQueue;
-	CBTQueue m_TxDataQueue;
+	CBTSPSCQueue m_LinkEventQueue;		// UART IRQ -> HCI task
+	CBTSPSCQueue m_RxDataQueue;		// UART IRQ -> HCI task, CBTPacket pointers to fragments
+
+	TBTACLLink m_Links[BT_HCI_MAX_ACL_LINKS];
+	unsigned m_nNextLink;			// served first by the next round
 
 	u8 *m_pEventBuffer;
 	unsigned m_nEventLength;
 	unsigned m_nEventFragmentOffset;
 
-	u8 *m_pDataBuffer;
-	unsigned m_nDataLength;
-	unsigned m_nDataFragmentOffset;
-
-	u8 *m_pBuffer;
+	unsigned m_nRxDropped;			// partial PDUs dropped
+	unsigned m_nRxTimeouts;			// of these timed out
+	unsigned m_nEventDrops;			// events the queues did not take
 
-	volatile unsigned m_nCommandPackets;		// commands allowed to be sent
+	volatile unsigned m_nCommandPackets;		// commands the controller takes
+	volatile unsigned m_nCommandsPending;		// sent, not yet answered
 	volatile unsigned m_nDataPackets;		// data allowed to be sent
+	unsigned m_nMaxDataPackets;			// controller ACL buffers
+	unsigned m_nACLDataLength;			// their size, without the header
+	boolean m_bHostFlowControl;			// fragments taken are reported
+
+#ifdef BT_HAVE_STATS
+	boolean m_bCommandTimed;		// a sent command awaits its credit
+	unsigned m_nCommandSent;		// when it was sent
+#endif
 
 	static CBTHCILayer *s_pThis;
 };
 
+template <typename TCommand, typename... TArgs>
+inline bool CBTDeviceManager::SendHCICommand (TArgs... Args)
+{
+	return !m_pHCILayer->SendCommand<TCommand> (Args...);
+}
+
 #endif
@@ -44,10 +44,23 @@
 #include <bluetooth/btqueue.h>
 #include <bluetooth/btdevice.h>
 #include <bluetooth/btl2cap.h>
+#include <bluetooth/bthashindex.h>
+#include <bluetooth/bthidreport.h>
+#include <bluetooth/btlatency.h>
 
 
 // Sizes
-#define MAX_HID_DEVICE 20
+#define BT_HIDP_MTU			48
+#define BT_HIDP_WAIT_SLICE		10000	// usec, a blocked Connect re-checks
+
+#define BT_HIDP_EVENT_QUEUE_SIZE	32	// user events buffered per device
+#define BT_HIDP_MAX_EVENT_SIZE		16	// largest posted UG event
+#ifdef BT_HAVE_LATENCY
+#define BT_HIDP_EVENT_SLOT_SIZE		(sizeof (unsigned) + BT_HIDP_MAX_EVENT_SIZE)	// receive time first
+#else
+#define BT_HIDP_EVENT_SLOT_SIZE		BT_HIDP_MAX_EVENT_SIZE
+#endif
+#define BT_HIDP_HELD_EVENTS		16	// events kept back while the queue is full
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -217,14 +230,17 @@ public:
 	u16 Connect (u16, u8*, u16);
 	u16 Disconnect (u16, u16);
 
+	// QoS asked for on the interrupt channel, 0 for other devices
+	TBTL2CAPFlowSpec *GetFlow (CBTDevice *);
+
 	u16 Send (u16, const void *pBuffer, u16);
 	u16 Receive (u16, const void *pBuffer, u16 *);
 
 private:
 	void Callback(const void *, unsigned);
-	void DataHandler(u16, u8*, u16);
+	void DataHandler(u16, CBTPacket*);
 
-	CBTDevice* m_DeviceTable[MAX_HID_DEVICE];
+	CBTHashIndex m_DevicesByCID;		// interrupt channel to device
 	CBTL2CAPLayer *m_pL2CAPLayer;
 
 	TBTL2CAPFlowSpec m_sFlowMouse;
@@ -257,6 +273,16 @@ typedef enum
 	BT_HID_DEVICE_W2_SEND_UNSUPPORTED_REQUEST
 } TBTHIDState;
 
+// an event which did not fit into the queue, with the motion before it
+struct TBTHIDHeldEvent
+{
+	int		nX;
+	int		nY;
+	int		nScroll;
+	unsigned	nLength;
+	u8		Slot[BT_HIDP_EVENT_SLOT_SIZE];
+};
+
 class CBTHIDDevice : public CBTDevice
 {
 protected:
@@ -266,8 +292,11 @@ public:
 	CBTHIDDevice(CBTHIDPLayer *pHIDPLayer, CBTConnection *pConnection);
 	~CBTHIDDevice(void);
 
-	// Connect the device
+	// Connect the device, the control and interrupt channels are set up
+	// in the stack task, so several devices can connect at once
 	u16 Connect (void);
+	boolean ConnectAsync (void);		// FALSE if it did not start
+	u16 WaitConnect (void);			// 0 once connected
 
 	// Disconnect the device
 	bool DisconnectInterruptChannel (void);
@@ -285,16 +314,63 @@ public:
 	// Receive event from event queue
 	bool ReceiveEvent (void *pBuffer, unsigned *pResultLength);
 
-	// Post event to event queue
+	// Post event to event queue, flushes the summed motion first. While
+	// the queue is full the event is held back and the motion stays
+	// summed, ReceiveEvent queues them again in order.
 	void PostEvent (const void *pBuffer, unsigned nLength);
 
+	// While coalescing, moves and scrolls are summed into one pending
+	// event, which ReceiveEvent returns once the queue is empty. Other
+	// events keep their order behind the motion before them. Without
+	// coalescing, motion is summed only while the queue is full.
+	void SetCoalescing (boolean bOn);
+	boolean IsCoalescing (void) const	{ return m_bCoalescing; }
+
 	// Set CID
 	void SetControlCID (u16 nCID);
 	void SetInterruptCID (u16 nCID);
 
+#ifdef BT_HAVE_LATENCY
+	// transport receive time of the report handed to Parser next
+	void SetRxTimestamp (unsigned nTicks)	{ m_nRxTimestamp = nTicks; }
+#endif
+
+	// most events queued at once (0 without BT_HAVE_STATS)
+	unsigned GetEventQueueHighWater (void) const	{ return m_EventQueue.GetHighWater (); }
+
+	// events lost, because the queue and the held events were full
+	unsigned GetEventDrops (void) const	{ return m_nEventDrops; }
+
+	// Reports are decoded with the boot protocol layout until the
+	// descriptor of the device is set, once it is connected
+	boolean SetReportDescriptor (const u8 *pDescriptor, unsigned nLength);
+
+	// the last input report decoded, FALSE if there was none yet
+	boolean GetInput (TBTHIDInput *pInput);
+
+	// input reports decoded so far
+	unsigned GetInputCount (void) const	{ return m_nInputSequence / 2; }
+
 	// Packet parser
 	virtual void Parser(u8*, u16);
 
+protected:
+	boolean DecodeReport (const u8 *pReport, u16 nLength, TBTHIDInput *pInput);
+	void PublishInput (const TBTHIDInput *pInput);
+
+	// posts a move and a scroll event, or adds to them while coalescing
+	void PostMotion (int nX, int nY, int nScroll);
+
+private:
+	unsigned MakeSlot (u8 *pSlot, const void *pBuffer, unsigned nLength);
+	boolean EnqueueEvent (const void *pBuffer, unsigned nLength);
+	boolean QueueMotion (int *pX, int *pY, int *pScroll);
+	boolean ReleaseEvents (void);
+	void HoldEvent (const void *pBuffer, unsigned nLength);
+
+	void ConnectStep (const TBTL2CAPResult *pResult);
+	static TBTL2CAPCompletion ConnectStub;
+
 private:
 	u16						m_nControlCID;
 	u16						m_nInterruptCID;
@@ -308,6 +384,26 @@ private:
 	TBTHIDPHandshakeParam	m_tReportStatus;
 	TBTHIDPProtocolMode		m_tProtocolMode;
 	CBTQueue 				m_EventQueue;
+	unsigned				m_nConnectStep;		// request under way
+	volatile boolean		m_bConnectDone;
+	void*					m_pConnectWaitTask;
+	CBTHIDReportDecoder		m_Decoder[2];		// the stack task may still use the other
+	volatile unsigned		m_nDecoder;
+	TBTHIDInput				m_Input;
+	volatile unsigned		m_nInputSequence;	// odd while m_Input is written
+	volatile boolean		m_bCoalescing;
+	volatile unsigned int	m_nMotionLock;		// pending motion and queue order
+	int						m_nPendingX;
+	int						m_nPendingY;
+	int						m_nPendingScroll;
+	TBTHIDHeldEvent			m_Held[BT_HIDP_HELD_EVENTS];
+	unsigned				m_nHeldIn;
+	unsigned				m_nHeldOut;
+	volatile unsigned		m_nEventDrops;
+#ifdef BT_HAVE_LATENCY
+	unsigned				m_nRxTimestamp;
+	unsigned				m_nPendingTimestamp;	// oldest report summed
+#endif
 };
 
 #endif
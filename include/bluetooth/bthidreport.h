@@ -0,0 +1,177 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth HID Report Descriptor Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_hidreport_h
+#define _bt_hidreport_h
+
+#include <types.h>
+#include <stdlib.h>
+
+#define BT_HID_MAX_FIELDS	64		// decoded fields of all input reports
+#define BT_HID_MAX_REPORTS	8		// input reports with fields
+#define BT_HID_MAX_REPORT_SIZE	64		// bytes of a report which are decoded
+#define BT_HID_MAX_USAGES	16		// usages and ranges of one main item
+#define BT_HID_MAX_PUSH		4		// nested Push items
+#define BT_HID_MAX_KEYS		6		// keyboard array entries
+
+// usage pages and the application usages of the top level collection
+#define BT_HID_PAGE_GENERIC_DESKTOP	0x01
+#define BT_HID_PAGE_KEYBOARD		0x07
+#define BT_HID_PAGE_BUTTON		0x09
+#define BT_HID_PAGE_CONSUMER		0x0C
+
+#define BT_HID_USAGE_MOUSE		0x02
+#define BT_HID_USAGE_JOYSTICK		0x04
+#define BT_HID_USAGE_GAMEPAD		0x05
+#define BT_HID_USAGE_KEYBOARD		0x06
+
+// where a decoded field goes, buttons and modifiers are bit masks
+typedef enum
+{
+	BTHIDSlotButtons,
+	BTHIDSlotX,
+	BTHIDSlotY,
+	BTHIDSlotWheel,
+	BTHIDSlotPan,
+	BTHIDSlotZ,
+	BTHIDSlotRx,
+	BTHIDSlotRy,
+	BTHIDSlotRz,
+	BTHIDSlotSlider,
+	BTHIDSlotDial,
+	BTHIDSlotHat,
+	BTHIDSlotModifiers,
+	BTHIDSlotKey0,
+	BTHIDSlots = BTHIDSlotKey0 + BT_HID_MAX_KEYS,
+	BTHIDSlotNone = 0xFF
+} TBTHIDSlot;
+
+#define BT_HID_SLOT_BIT(slot)	(1U << (slot))
+#define BT_HID_POINTER_SLOTS	(  BT_HID_SLOT_BIT (BTHIDSlotX) | BT_HID_SLOT_BIT (BTHIDSlotY) \
+				 | BT_HID_SLOT_BIT (BTHIDSlotWheel))
+
+// one decoded input report, slots the report does not carry are 0
+struct TBTHIDInput
+{
+	u8	nReportID;			// 0 without report IDs
+	u8	nApplication;			// BT_HID_USAGE_*, 0 if unknown
+	u32	nPresent;			// BT_HID_SLOT_BIT of the slots carried
+	int	Value[BTHIDSlots];
+};
+
+// A report descriptor is compiled once into a flat table of the fields
+// the input reports carry, grouped by report. Decode then runs the table
+// without looking at the descriptor again: every field costs one load,
+// a shift, a mask and a sign extension.
+class CBTHIDReportDecoder
+{
+public:
+	CBTHIDReportDecoder (void);
+	~CBTHIDReportDecoder (void);
+
+	// FALSE if the descriptor is malformed or has no fields we decode,
+	// fields beyond the limits above are left out
+	boolean Compile (const u8 *pDescriptor, unsigned nLength);
+
+	// FALSE for an unknown report ID or a short report
+	boolean Decode (const u8 *pReport, unsigned nLength, TBTHIDInput *pInput) const;
+
+	unsigned GetFieldCount (void) const	{ return m_nFields; }
+	unsigned GetReportCount (void) const	{ return m_nReports; }
+
+	// the keyboard (ID 1) and mouse (ID 2) reports of the boot protocol
+	static const u8 s_BootDescriptor[];
+	static const unsigned s_nBootDescriptorLength;
+
+	void* operator new(size_t T) { return (void *)malloc(T); }
+	void operator delete (void *ptr) { free(ptr); }
+
+private:
+	struct TBTHIDField
+	{
+		u16	nByte;			// first byte in the report
+		u8	nShift;			// bit in that byte
+		u8	nExtend;		// 32 - size, one more if unsigned
+		u32	nMask;
+		u8	nSlot;
+		u8	nSlotShift;		// bit of a button or modifier
+	};
+
+	struct TBTHIDReportLayout
+	{
+		u8	nID;
+		u8	nApplication;
+		u8	nFirst;			// in m_Field
+		u8	nFields;
+		u16	nBits;			// size, the report ID included
+		u16	nBytes;			// checked and decoded, at most BT_HID_MAX_REPORT_SIZE
+		u32	nPresent;
+	};
+
+	struct TBTHIDGlobal
+	{
+		u16	nPage;
+		int	nLogicalMinimum;
+		u32	nReportSize;
+		u32	nReportCount;
+		u8	nReportID;
+	};
+
+	struct TBTHIDUsageRange
+	{
+		u32	nMinimum;		// page in the upper half, 0 is the current page
+		u32	nMaximum;
+	};
+
+	boolean Parse (const u8 *pDescriptor, unsigned nLength, u8 *pFieldReport);
+	boolean AddInput (const TBTHIDGlobal *pGlobal, const TBTHIDUsageRange *pUsages,
+			  unsigned nUsages, u32 nFlags, u8 nApplication, u8 *pFieldReport);
+	TBTHIDReportLayout *GetLayout (u8 nID, u8 nApplication);
+	static u32 GetUsage (const TBTHIDUsageRange *pUsages, unsigned nUsages,
+			     unsigned nIndex, u16 nPage);
+	static u8 MapUsage (u32 nUsage, u8 *pSlotShift);
+
+private:
+	boolean m_bReportIDs;
+	u8 m_nReports;
+	u8 m_nFields;
+	u8 m_ReportIndex[256];		// report ID to layout + 1
+	TBTHIDReportLayout m_Report[BT_HID_MAX_REPORTS];
+	TBTHIDField m_Field[BT_HID_MAX_FIELDS];
+};
+
+#endif
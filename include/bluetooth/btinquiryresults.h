@@ -41,10 +41,12 @@
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/btevent.h>
 #include <bluetooth/btdevicemanager.h>
-#include <bluetooth/ptrarray.h>
+#include <bluetooth/btvector.h>
 #include <types.h>
 #include <stdlib.h>
 
+#define BT_INQUIRY_RESPONSES	16		// kept inline, more are allocated
+
 typedef struct sBTInquiryResponse
 {
 	u8	BDAddress[BT_BD_ADDR_SIZE];
@@ -72,7 +74,7 @@ public:
 	void operator delete (void *ptr) { free(ptr); }
 
 private:
-	CPtrArray m_Responses;
+	CBTVector<TBTInquiryResponse *, BT_INQUIRY_RESPONSES> m_Responses;
 };
 
 #endif
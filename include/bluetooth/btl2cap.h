@@ -44,6 +44,8 @@
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/btlogicallayer.h>
 #include <bluetooth/bttransportlayer.h>
+#include <bluetooth/btpacket.h>
+#include <bluetooth/btqueue.h>
 #include <stdlib.h>
 
 #define BT_L2CAP_MAX_PSM_SLOT		40
@@ -51,9 +53,18 @@
 #define BT_L2CAP_MIN_SIG_MTU_LEN	48
 #define BT_L2CAP_MIN_CNL_MTU_LEN	670
 #define BT_L2CAP_MAX_MTU_LEN		65535
+#define BT_L2CAP_CHANNELS		8	// kept inline, more are allocated
+#define BT_L2CAP_MAX_PENDING		16	// outstanding signalling requests
+#define BT_L2CAP_WAIT_SLICE		10000	// usec, blocked requests re-check
+#define BT_L2CAP_MAX_WAITERS		8	// tasks blocked in Read, Write or PollChannels
+#define BT_L2CAP_NO_REQUEST		0
+#define BT_L2CAP_TX_QUEUE_SIZE		32	// SDUs streamed per channel
+#define BT_L2CAP_RX_QUEUE_SIZE		4	// SDUs buffered per channel by default
+#define BT_L2CAP_DEFAULT_MTU		672
 
 typedef enum {
 	BT_L2CAP_CLOSED,
+	BT_L2CAP_W4_LP_CONNECT_CFM,		// the ACL link is set up first
 	BT_L2CAP_W4_L2CAP_CONNECT_RSP,
 	BT_L2CAP_W4_L2CA_CONNECT_RSP,
 	BT_L2CAP_CONFIG,
@@ -64,6 +75,33 @@ typedef enum {
 
 typedef void TBTL2CAPCmdHandler(void*, void*, u16);
 
+// called from the stack task with the number of SDUs handed to the link
+// queue since the last call, these complete in the order they were written
+typedef void TBTL2CAPWriteCompletion (u16 nCID, unsigned nSDUs, void *pParam);
+
+// Retransmission and Flow Control, the receive side of its sender
+struct SBTL2CAPRFC {
+	u8	Mode;
+#define BT_L2CAP_MODE_BASIC			0x00
+#define BT_L2CAP_MODE_ERTM			0x03
+#define BT_L2CAP_MODE_STREAMING		0x04
+	u8	TxWindow;			// I-frames it buffers, 1..63
+	u8	MaxTransmit;			// 0 retries forever
+	u16	RetransmissionTimeout;		// msec
+	u16	MonitorTimeout;			// msec
+	u16	MPS;				// largest I-frame payload
+}
+PACKED;
+typedef struct SBTL2CAPRFC TBTL2CAPRFC;
+
+// used for the fields of a registered channel mode left 0
+#define BT_L2CAP_ERTM_TX_WINDOW		16
+#define BT_L2CAP_ERTM_MAX_TRANSMIT	4
+#define BT_L2CAP_ERTM_RETRANS_TIMEOUT	2000	// msec
+#define BT_L2CAP_ERTM_MONITOR_TIMEOUT	12000	// msec
+
+class CBTL2CAPERTM;
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // L2CAP
@@ -84,6 +122,19 @@ class CBTL2CAPChannel
     bool Initiator;
 	TBTChannelState State;
 	CBTConnection*  Connection;
+	CBTQueue*	TxQueue;		// streamed SDUs, TBTScatter each
+	TBTScatter	TxSDU;			// dequeued, waits for link room
+	const void*	TxPurge;		// SDU a failed Write takes back
+	TBTL2CAPWriteCompletion* TxCallback;
+	void*		TxParam;
+	CBTQueue*	RxQueue;		// received SDUs, 0 until needed
+	u8		Mode;			// BT_L2CAP_MODE_*, fixed once open
+	boolean		ModeSet;		// LocalRFC registered or requested
+	TBTL2CAPRFC	LocalRFC;		// our receive side, Mode 0 for Basic
+	u8		LocalFCS;
+	TBTL2CAPRFC	RemoteRFC;		// from the remote's configure request
+	u8		RemoteFCS;
+	CBTL2CAPERTM*	ERTM;			// sequencing, 0 in Basic mode
 #define BT_L2CAP_DEFAULT_RTX	1000000	// 1sec
 #define BT_L2CAP_DEFAULT_ERTX	1000000	// 1sec
 	friend class CBTL2CAPLayer;
@@ -91,6 +142,7 @@ class CBTL2CAPChannel
 	public:
 	CBTL2CAPChannel(u16 nPSM, CBTConnection *pConnection);
 	CBTL2CAPChannel(u16 nPSM, CBTConnection *pConnection, u16 nCID);
+	~CBTL2CAPChannel(void);
 	static u16 GetCID(void);
 	inline CBTConnection* GetConnection(void) { return Connection; }
 	inline void SetInitiator(bool init) { Initiator = init; }
@@ -202,11 +254,15 @@ class CBTL2CAPOption
 #define BT_L2CAP_OPTION_MTU				0x01
 #define BT_L2CAP_OPTION_FLUSH_TIMEOUT	0x02
 #define BT_L2CAP_OPTION_QOS				0x03
+#define BT_L2CAP_OPTION_RFC				0x04
+#define BT_L2CAP_OPTION_FCS				0x05
 	u8	Length;
 
 	friend u16 ExtractMTU(u8*, u16);
 	friend TBTL2CAPFlowSpec* ExtractFlow(u8*, u16);
 	friend u16 ExtractFlushTO(u8*, u16);
+	friend TBTL2CAPRFC* ExtractRFC(u8*, u16);
+	friend u8 ExtractFCS(u8*, u16);
 }
 PACKED;
 
@@ -240,6 +296,28 @@ class CBTL2CAPQoS : public CBTL2CAPOption
 }
 PACKED;
 
+class CBTL2CAPRetransmission : public CBTL2CAPOption
+{
+#define BT_L2CAP_OPTION_RFC_LEN		0x0009
+	TBTL2CAPRFC	RFC;
+
+	friend TBTL2CAPRFC* ExtractRFC(u8*, u16);
+	friend u8* InsertRFC(u8*, const TBTL2CAPRFC*);
+}
+PACKED;
+
+class CBTL2CAPFrameCheck : public CBTL2CAPOption
+{
+#define BT_L2CAP_OPTION_FCS_LEN		0x0001
+	u8	FCS;
+#define BT_L2CAP_FCS_NONE			0x00
+#define BT_L2CAP_FCS_16				0x01
+
+	friend u8 ExtractFCS(u8*, u16);
+	friend u8* InsertFCS(u8*, u8);
+}
+PACKED;
+
 // L2CAP Signalling Commands
 
 class CBTL2CAPSignallingCommand
@@ -358,6 +436,8 @@ class CBTL2CAPConfigurationRequest : public CBTL2CAPSignallingCommand
 	u16 GetMTU(void);
 	TBTL2CAPFlowSpec* GetFlow(void);
 	u16 GetFlushTO(void);
+	TBTL2CAPRFC* GetRFC(void);
+	u8 GetFCS(void);
 
 	static void Handler(void*, void*, u16);
 	void Process(void*, u16);
@@ -382,6 +462,8 @@ class CBTL2CAPConfigurationResponse : public CBTL2CAPSignallingCommand
 	u16 GetMTU(void);
 	TBTL2CAPFlowSpec* GetFlow(void);
 	u16 GetFlushTO(void);
+	TBTL2CAPRFC* GetRFC(void);
+	u8 GetFCS(void);
 
 	static void Handler(void*, void*, u16);
 	void Process(void*, u16);
@@ -478,6 +560,10 @@ PACKED;
 // L2CA Events
 class CBTL2CAEvent
 {
+	public:
+	u8 GetIdentifier (void) const { return Identifier; }
+	u16 GetEvent (void) const { return Event; }
+
 	protected:
 	u8	Identifier;
 #define BT_EVENT_L2CA_CONNECT_IND		0x01
@@ -488,6 +574,7 @@ class CBTL2CAEvent
 #define BT_EVENT_L2CA_QOS_VIOLATION_IND	0x06
 	u16	Event;
 	friend class CBTHIDPLayer;
+	friend class CBTSDPLayer;
 }
 PACKED;
 
@@ -522,7 +609,14 @@ class CBTL2CAConfigInd : public CBTL2CAEvent
 	TBTL2CAPFlowSpec*	InFlow;
 	u16	InFlushTO;
 
+	public:
+	u16 GetCID (void) const { return CID; }
+	u16 GetOutMTU (void) const { return OutMTU; }
+	TBTL2CAPFlowSpec *GetInFlow (void) const { return InFlow; }
+	u16 GetInFlushTO (void) const { return InFlushTO; }
+
 	friend class CBTHIDPLayer;
+	friend class CBTSDPLayer;
 	friend class CBTL2CAPConfigurationRequest;
 }
 PACKED;
@@ -546,6 +640,7 @@ class CBTL2CADisconnectInd : public CBTL2CAEvent
 	u16	CID;
 
 	friend class CBTHIDPLayer;
+	friend class CBTSDPLayer;
 	friend class CBTL2CAPDisconnectionRequest;
 }
 PACKED;
@@ -559,59 +654,32 @@ class CBTL2CAQoSViolationInd : public CBTL2CAEvent
 }
 PACKED;
 
-class CBTL2CACommandRsp : public CBTL2CAEvent
-{
-	u16	Reason;
-
-	friend class CBTL2CAPLayer;
-}
-PACKED;
-
-class CBTL2CAConnectRsp : public CBTL2CAEvent
-{
-	u16	*DCID;
-	u16	*SCID;
-	u16	*Result;
-	u16	*Status;
-	TBTChannelState	*State;
-
-	friend class CBTL2CAPLayer;
-}
-PACKED;
-
-class CBTL2CAConfigRsp : public CBTL2CAEvent
-{
-	u16	SourceCID;
-	u16	Flags;
-	u16	Result;
-	u16	MTU;
-	TBTL2CAPFlowSpec*	Flow;
-	u16	FlushTO;
-
-	friend class CBTL2CAPLayer;
-}
-PACKED;
-
-class CBTL2CADisconnectRsp : public CBTL2CAEvent
+// result of an asynchronous request
+struct TBTL2CAPResult
 {
-	u16	DCID;
-	u16	SCID;
-
-	friend class CBTL2CAPLayer;
-}
-PACKED;
+	u16	nResult;
+	u16	nStatus;			// connect status or reject reason
+	u16	nCID;				// local CID
+	u16	nMTU;				// from the configure response
+	u16	nFlushTO;
+	boolean	bFlow;				// Flow is valid
+	TBTL2CAPFlowSpec Flow;
+};
 
-class CBTL2CADataRead : public CBTL2CAEvent
+// readiness of one channel, see PollChannels
+struct TBTL2CAPPollEntry
 {
-	u16	CID;
-	u16	Length;
-	u8*	InBuffer;
-	u16	Result;
-	u16	N;
+	u16	nCID;
+	u16	nEvents;			// requested
+	u16	nReady;				// returned
+#define BT_L2CAP_POLL_READ	0x0001		// an SDU is buffered
+#define BT_L2CAP_POLL_WRITE	0x0002		// WriteAsync has room
+#define BT_L2CAP_POLL_CLOSED	0x0004		// always reported
+};
 
-	friend class CBTL2CAPLayer;
-}
-PACKED;
+// called from the stack task, may run before the request call returns
+typedef void TBTL2CAPCompletion (unsigned hRequest, const TBTL2CAPResult *pResult,
+				 void *pParam);
 
 // L2CAP Layer
 class CBTSubSystem;
@@ -626,14 +694,50 @@ public:
 	void RegisterDataCallback(u16, TBTL2CAPDataCallback *);
 	void DeregisterDataCallback(u16);
 
+	// Asynchronous requests return a handle, BT_L2CAP_NO_REQUEST if the
+	// pending table is full. With a callback the request is freed after it
+	// returns, otherwise the result must be collected with Poll or
+	// WaitRequest. The blocking calls below are wrappers for these.
+	unsigned ConnectAsync(u16 nPSM, TBDAddr sBDAddr,
+		TBTL2CAPCompletion *pCallback = 0, void *pParam = 0);
+	unsigned ConfigureAsync(u16 nCID, u16 nInMTU, TBTL2CAPFlowSpec *sOutFlow,
+		u16 nOutFlushTO, TBTL2CAPCompletion *pCallback = 0, void *pParam = 0);
+	unsigned DisconnectAsync(u16 nCID,
+		TBTL2CAPCompletion *pCallback = 0, void *pParam = 0);
+	boolean Poll(unsigned hRequest, TBTL2CAPResult *pResult);	// TRUE once done
+	u16 WaitRequest(unsigned hRequest, TBTL2CAPResult *pResult = 0);
+
+	// expires requests without response and streams queued SDUs,
+	// called from the stack task
+	void Process(void);
+
 	u16 Connect(u16 PSM, TBDAddr BDAddr, u16*, u16*);
 	u16 ConnectResponse(TBDAddr, u8, u16, u16, u16);
 	u16 Configure(u16,u16,TBTL2CAPFlowSpec*,u16,u16,u16*,TBTL2CAPFlowSpec*,u16*, bool=true);
 	u16 ConfigureResponse(u8, u16, u16, u16, u16, u16, TBTL2CAPFlowSpec*);
 	u16 Disconnect(u16);
 	u16 DisconnectResponse(u8, u16);
-	u16 Write(u16, u16, u8*, u16*);
-	u16 Read(u16, u16, u8*, u16*);
+	// Retransmission and Flow Control asked for on channels of nPSM, the
+	// fields left 0 get defaults; without one the remote's mode is taken
+	// if it asks before our configure request
+	bool RegisterChannelMode(u16 nPSM, const TBTL2CAPRFC *pRFC,
+		u8 nFCS = BT_L2CAP_FCS_16);
+	u8 GetChannelMode(u16 nCID);
+	u16 Write(u16, u16, u8*, u16*);		// waits for link room, up to RTX
+	// queues the SDU without waiting, pSDU must stay valid until the write
+	// callback covered it; SDUs still queued are dropped on disconnect
+	u16 WriteAsync(u16 nCID, const void *pSDU, u16 nLength);
+	bool SetWriteCallback(u16 nCID, TBTL2CAPWriteCompletion *pCallback, void *pParam = 0);
+	// SDUs of channels whose PSM has no data callback are buffered per
+	// channel, a default ring is created on the first one. Reads return a
+	// whole SDU, the part beyond nLength is discarded.
+	bool SetReceiveQueue(u16 nCID, unsigned nDepth, u16 nMaxSDU = 0);	// 0 is the MTU
+	u16 TryRead(u16 nCID, u16 nLength, u8 *pBuffer, u16 *pN);
+	u16 Read(u16, u16, u8*, u16*, unsigned nTimeout = 0);	// usec, 0 is RTX
+	// waits until one entry is ready, returns how many are
+	unsigned PollChannels(TBTL2CAPPollEntry *pEntries, unsigned nEntries,
+		unsigned nTimeout);
+	unsigned GetReceiveDrops(u16 nCID);	// full ring or SDU above the limit
 	u16 GroupCreate(u16);
 	u16 GroupClose(u16);
 	u16 Ping(TBDAddr, u8*, u16, u8**, u16*);
@@ -641,38 +745,118 @@ public:
 	u16 DisableConnectionlessTraffic(u16);
 	u16 EnableConnectionlessTraffic(u16);
 	u16 GetPSM(u16);
-	CBTL2CAPChannel* GetChannel(u16,bool=false);
-	bool AddChannel(u16, u16);
+	CBTL2CAPChannel* GetChannel(u16);		// by local CID, 0 if not found
+	CBTL2CAPChannel* GetRemoteChannel(TBDAddr, u16);
+	CBTL2CAPChannel* AddChannel(u16, u16);	// on the link being received
 	bool DeleteChannel(u16);
 	CBTDevice* GetDevice(u16);
-	void SetCommandRsp(u8, u16);
+	// complete the pending request with this identifier, false if none
+	bool SetCommandRsp(u8, u16);
 	bool SetConnectRsp(u8, u16, u16, u16, u16);
-	bool SetConfigRsp(u8, u16, u16, u16, u16, u16, u8*);
-	void SetDisconnectRsp(u8, u16, u16);
+	bool SetConfigRsp(u8, u16, u16, u16, u16, u16, u8*, TBTL2CAPRFC* = 0);
+	// options of the remote's configure request, before it is indicated
+	void SetRemoteConfig(u16 nCID, u16 nMTU, const TBTL2CAPRFC *pRFC, u8 nFCS);
+	bool SetDisconnectRsp(u8, u16, u16);
 	void SignallingCallback(u16, void*, size_t);
 
 private:
 	void LPEventHandler (const void *pBuffer, unsigned nLength);
 	static void LPEventStub (const void *pBuffer, unsigned nLength);
-	void L2CAPEventHandler (const void *pBuffer, unsigned nLength);
-	static void L2CAPEventStub (const void *pBuffer, unsigned nLength);
-
-	CBTConnection		*m_pIncomingConnection;
-	CBTL2CACommandRsp	m_eCommandRsp;
-	CBTL2CAConnectRsp	m_eConnectRsp;
-	CBTL2CAConfigRsp	m_eConfigRsp;
-	CBTL2CADisconnectRsp	m_eDisconnectRsp;
-	CBTL2CADataRead		m_eDataRead;
+	void L2CAPEventHandler (CBTPacket *pPacket);
+	static void L2CAPEventStub (CBTPacket *pPacket);
+
+	// the channel list and its indexes are changed together
+	void InsertChannel (CBTL2CAPChannel *pChannel);
+	void IndexChannel (CBTL2CAPChannel *pChannel);
+	void RemoveChannel (CBTL2CAPChannel *pChannel);
+	// removes it and frees it when no blocked task waits on it any more
+	void CloseChannel (CBTL2CAPChannel *pChannel);
+	void FreeClosedChannels (void);
+	static u64 RemoteKey (CBTConnection *pConnection, u16 nRemoteCID);
+
+	bool SendSDU (CBTL2CAPChannel *pChannel, const TBTScatter *pSDU);
+	void DrainChannel (CBTL2CAPChannel *pChannel);
+	void PurgeWrite (u16 nCID, const void *pSDU);
+	static void PurgeChannel (CBTL2CAPChannel *pChannel);
+	bool IsWriting (CBTL2CAPChannel *pChannel);
+	CBTL2CAPChannel *WaitWrite (CBTL2CAPChannel *pChannel, unsigned nStartTicks);
+	void WaitChannel (u16 nCID, boolean bWrite, unsigned nMicros);
+	void WakeChannel (u16 nCID, boolean bWrite);
+	boolean IsReceiveBusy (CBTL2CAPChannel *pChannel);
+	static boolean FitsLink (CBTLogicalLayer *pLogicalLayer, u16 nLength);
+	// publishes the ring unless the channel has one, which wins
+	boolean AttachReceiveQueue (u16 nCID, CBTQueue *pQueue);
+	CBTL2CAPChannel *LookupChannel (u16 nCID);	// m_nChannelLock held
+	void ReceiveSDU (u16 nCID, const u8 *pSDU, unsigned nLength);
+
+	void SendConfigureRequest (CBTL2CAPChannel *pChannel, u8 nID, u16 nInMTU,
+				   TBTL2CAPFlowSpec *sOutFlow, u16 nOutFlushTO);
+	void InitChannelMode (CBTL2CAPChannel *pChannel);
+	void OpenChannel (CBTL2CAPChannel *pChannel);
+	void DeliverSDU (u16 nCID, CBTPacket *pPacket);
+	static void FailedChannelStub (unsigned hRequest, const TBTL2CAPResult *pResult,
+				       void *pParam);
+
+	struct TBTL2CAPRequest;
+	TBTL2CAPRequest *NewRequest (TBTL2CAPCompletion *pCallback, void *pParam);
+	TBTL2CAPRequest *FindRequest (unsigned hRequest);
+	void StartRequest (TBTL2CAPRequest *pRequest, u8 nCode, u8 nID,
+			   CBTL2CAPChannel *pChannel, unsigned nTimeout);
+	TBTL2CAPRequest *ClaimRequest (u8 nID, u8 nCode = 0);	// 0 is any code
+	void FailRequest (TBTL2CAPRequest *pRequest, u16 nResult);
+	void CompleteRequest (TBTL2CAPRequest *pRequest);
+	void FreeRequest (TBTL2CAPRequest *pRequest);
+	void SetupLink (TBTL2CAPRequest *pRequest);
+	void SendConnectRequest (TBTL2CAPRequest *pRequest,
+				 CBTL2CAPChannel *pChannel);
+
+	struct TBTL2CAPRequest
+	{
+		unsigned	 hRequest;	// BT_L2CAP_NO_REQUEST if free
+		u8		 nCode;		// expected response
+		volatile u8	 nIdentifier;	// 0 if not waiting for a response
+		volatile boolean bDone;		// result ready for Poll or WaitRequest
+		CBTL2CAPChannel	*pChannel;
+		unsigned	 nStartTicks;
+		unsigned	 nTimeout;	// usec, RTX or ERTX
+		TBTL2CAPCompletion *pCallback;
+		void		*pParam;
+		void		*pWaitTask;
+		TBTL2CAPResult	 Result;
+	};
+
+	TBTL2CAPRequest m_Requests[BT_L2CAP_MAX_PENDING];
+	unsigned m_nNextRequest;
+	unsigned int *m_SpinLock;
+	// the CID indexes change in the stack task, other tasks only find a
+	// channel and use it while holding this, it is taken before m_SpinLock
+	volatile unsigned int m_nChannelLock;
+
+	// each blocked task sleeps in its own slot, the channel may be
+	// deleted meanwhile
+	struct TBTL2CAPWaiter
+	{
+		boolean		 bUsed;
+		boolean		 bWrite;	// for room, else for an SDU
+		u16		 nCID;		// 0 for any (PollChannels)
+		void		*pTask;
+	};
+
+	TBTL2CAPWaiter m_Waiters[BT_L2CAP_MAX_WAITERS];
+	unsigned m_nNextDrain;			// channel streamed first
 
 	TBTL2CAPCallback* m_pL2CAPSignallingCallback[BT_L2CAP_MAX_PSM_SLOT];
 	TBTL2CAPDataCallback* m_pPSMSlot[BT_L2CAP_MAX_PSM_SLOT];
+	TBTL2CAPRFC m_PSMMode[BT_L2CAP_MAX_PSM_SLOT];	// Mode 0 if none registered
+	u8 m_PSMFCS[BT_L2CAP_MAX_PSM_SLOT];
 
 	CBTLogicalLayer *m_pLogicalLayer;
 	CBTSubSystem *m_pSubSystem;
 
-	CPtrArray m_Channels;
-
-	u8 *m_pEventBuffer;
+	CBTVector<CBTL2CAPChannel *, BT_L2CAP_CHANNELS> m_Channels;
+	CBTHashIndex m_ChannelsByCID;
+	CBTHashIndex m_ChannelsByRemoteCID;	// by link and remote CID
+	CBTVector<CBTL2CAPChannel *, BT_L2CAP_CHANNELS> m_Closed;	// to be freed
 
 	static CBTL2CAPLayer *s_pThis;
 };
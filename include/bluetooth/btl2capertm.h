@@ -0,0 +1,198 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth L2CAP Retransmission and Streaming Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_l2capertm_h
+#define _bt_l2capertm_h
+
+#include <types.h>
+#include <bluetooth/btl2cap.h>
+#include <bluetooth/btlogicallayer.h>
+#include <bluetooth/btpacket.h>
+#include <bluetooth/btqueue.h>
+#include <stdlib.h>
+
+#define BT_L2CAP_SEQ_MODULO		64
+#define BT_L2CAP_ERTM_MAX_WINDOW	63
+
+// Enhanced control field
+#define BT_L2CAP_CONTROL_SFRAME		0x0001
+#define BT_L2CAP_CONTROL_TXSEQ(c)	(((c) >> 1) & 0x3F)
+#define BT_L2CAP_CONTROL_SUPER(c)	(((c) >> 2) & 0x03)
+#define BT_L2CAP_CONTROL_POLL		0x0010
+#define BT_L2CAP_CONTROL_FINAL		0x0080
+#define BT_L2CAP_CONTROL_REQSEQ(c)	(((c) >> 8) & 0x3F)
+#define BT_L2CAP_CONTROL_SAR(c)		(((c) >> 14) & 0x03)
+#define BT_L2CAP_SUPER_RR		0x00
+#define BT_L2CAP_SUPER_REJ		0x01
+#define BT_L2CAP_SUPER_RNR		0x02
+#define BT_L2CAP_SUPER_SREJ		0x03
+#define BT_L2CAP_CONTROL_SAR_SHIFT	14
+#define BT_L2CAP_SAR_UNSEGMENTED	0x00
+#define BT_L2CAP_SAR_START		0x01	// carries the SDU length
+#define BT_L2CAP_SAR_END		0x02
+#define BT_L2CAP_SAR_CONTINUE		0x03
+
+#define BT_L2CAP_CONTROL_LEN		2
+#define BT_L2CAP_FCS_LEN		2
+#define BT_L2CAP_SDU_LENGTH_LEN		2
+
+//
+// Sequencing of one channel in Enhanced Retransmission or Streaming mode.
+// Sending is go-back-N with a poll when the retransmission timer expires,
+// REJ and SREJ from the remote are honoured. Frames received out of
+// sequence are discarded and recovered with a single REJ. SDUs larger
+// than the MPS are segmented, received ones reassembled into a packet from
+// the pool. All methods run in the stack task.
+//
+class CBTL2CAPERTM
+{
+public:
+	// pTx holds what the remote receives, pRx what we do, nRxMTU is the
+	// largest SDU reassembled
+	CBTL2CAPERTM (CBTLogicalLayer *pLogicalLayer, CBTConnection *pConnection,
+		      u16 nRemoteCID, const TBTL2CAPRFC *pTx, const TBTL2CAPRFC *pRx,
+		      boolean bFCS, u16 nRxMTU);
+	~CBTL2CAPERTM (void);
+
+	u8 GetMode (void) const			{ return m_nMode; }
+
+	// FALSE if the window or the link queue is full, try again later with
+	// the same SDU, the segments sent so far are not sent again
+	boolean Send (const TBTScatter *pSDU);
+
+	// checks a whole frame, returns the SDU completed by it or 0; this is
+	// pPacket cut to the payload, or a reassembled packet the caller
+	// releases
+	CBTPacket *Receive (CBTPacket *pPacket);
+
+	// from the configure response, msec, 0 keeps the current value
+	void SetTimeouts (u16 nRetransmission, u16 nMonitor);
+
+	// the SDU could not be delivered, in-sequence I-frames are dropped
+	// and the remote is told with RNR until this is cleared
+	void SetLocalBusy (boolean bBusy);
+
+	// timers and retransmissions, before new I-frames are sent
+	void Process (void);
+	// an acknowledgement not piggy-backed on an I-frame, after them
+	void SendPendingAck (void);
+
+	// MaxTransmit was exceeded, the channel must be disconnected
+	boolean HasFailed (void) const		{ return m_bFailed; }
+
+	unsigned GetRetransmissions (void) const { return m_nRetransmissions; }
+	unsigned GetFCSErrors (void) const	{ return m_nFCSErrors; }
+	unsigned GetFramesLost (void) const	{ return m_nFramesLost; }	// Streaming
+
+	void* operator new(size_t T) { return (void *)malloc(T); }
+	void operator delete (void *ptr) { free(ptr); }
+
+private:
+	boolean SendFrame (u16 nControl, const TBTScatter *pPayload = 0,
+			   unsigned nPieces = 0);
+	boolean SendIFrame (u8 nTxSeq, u8 nSAR, const TBTScatter *pPayload,
+			    unsigned nPieces);
+	boolean SendSegment (const TBTScatter *pSDU);
+	boolean Reassemble (CBTPacket *pPacket, u8 nSAR, unsigned nPayload,
+			    CBTPacket **ppSDU);
+	void DiscardSDU (void);
+	boolean SendSFrame (u8 nSuper, u16 nFlags);
+	boolean Retransmit (u8 nTxSeq);
+	boolean Acknowledge (u8 nReqSeq);
+	void Final (void);
+	boolean Poll (void);
+
+	unsigned GetSlot (u8 nTxSeq) const;	// retransmission buffer of an unacknowledged frame
+	unsigned GetUnacked (void) const;
+
+	static u8 SeqOffset (u8 nSeq, u8 nBase)	{ return (nSeq - nBase) & (BT_L2CAP_SEQ_MODULO-1); }
+	static u8 SeqNext (u8 nSeq)		{ return (nSeq + 1) & (BT_L2CAP_SEQ_MODULO-1); }
+
+private:
+	CBTLogicalLayer *m_pLogicalLayer;
+	CBTConnection	*m_pConnection;
+	u16		 m_nRemoteCID;
+	u8		 m_nMode;
+	boolean		 m_bFCS;
+
+	// transmit side
+	u8		 m_nTxWindow;
+	u8		 m_nMaxTransmit;
+	unsigned	 m_nRetransTimeout;	// usec
+	unsigned	 m_nMonitorTimeout;	// usec
+	unsigned	 m_nTxMPS;
+	u8		 m_nNextTxSeq;
+	u8		 m_nExpectedAckSeq;
+	boolean		 m_bRetransmit;		// go-back-N from here up to m_nNextTxSeq
+	u8		 m_nRetransmitSeq;
+	u64		 m_SRejPending;		// bit per TxSeq
+	boolean		 m_bRemoteBusy;
+	boolean		 m_bWaitFinal;		// polled, no new I-frames
+	unsigned	 m_nPolls;
+	boolean		 m_bRetransTimer;
+	unsigned	 m_nRetransStart;
+	boolean		 m_bMonitorTimer;
+	unsigned	 m_nMonitorStart;
+	boolean		 m_bFailed;
+
+	u8		*m_pTxFrames;		// payloads kept for retransmission
+	u16		 m_TxLength[BT_L2CAP_ERTM_MAX_WINDOW];
+	u8		 m_TxRetries[BT_L2CAP_ERTM_MAX_WINDOW];
+	u8		 m_TxSAR[BT_L2CAP_ERTM_MAX_WINDOW];
+	u8		 m_nTxHead;		// slot of m_nExpectedAckSeq
+	unsigned	 m_nTxOffset;		// of the SDU being segmented
+
+	// receive side
+	unsigned	 m_nRxMPS;
+	u8		 m_nRxWindow;
+	u8		 m_nExpectedTxSeq;
+	boolean		 m_bRejPending;
+	boolean		 m_bRejSent;		// one REJ per gap
+	boolean		 m_bLocalBusy;
+	boolean		 m_bRNRSent;		// only an S-frame ends it
+	boolean		 m_bAckPending;
+	boolean		 m_bFinalPending;	// answer a poll
+	u16		 m_nRxMTU;
+	CBTPacket	*m_pRxSDU;		// being reassembled
+	unsigned	 m_nRxSDULength;
+
+	unsigned	 m_nRetransmissions;
+	unsigned	 m_nFCSErrors;
+	unsigned	 m_nFramesLost;
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth Latency Probe Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_latency_h
+#define _bt_latency_h
+
+#include <sysconfig.h>
+#include <types.h>
+
+#define BT_LATENCY_SAMPLES	256		// per probe, the oldest are overwritten
+
+// Measured intervals, all in clock ticks (us)
+enum TBTLatencyProbe
+{
+	BTLatencyHIDReport,		// transport receive -> CBTHIDDevice::ReceiveEvent
+	BTLatencyL2CAPWrite,		// one CBTL2CAPLayer::Write call
+	BTLatencyL2CAPRead,		// one CBTL2CAPLayer::Read call
+	BTLatencyStartup,		// CBTSubSystem::Initialize -> device running
+	BTLatencyConnect,		// CBTSubSystem::Listen -> Accept returned a device
+	BTLatencyUnknown
+};
+
+struct TBTLatencySummary
+{
+	unsigned nSamples;		// recorded since Reset, may exceed the ring
+	unsigned nP50;
+	unsigned nP99;
+	unsigned nMax;
+	unsigned nTotal;		// sum of all samples
+	unsigned nBytes;		// payload moved, for throughput
+};
+
+// Fixed size sample rings per probe. The probes are compiled in with
+// BT_HAVE_LATENCY only, recording is safe from any task.
+class CBTLatency
+{
+public:
+	static void Record (TBTLatencyProbe Probe, unsigned nTicks, unsigned nBytes = 0);
+	static void RecordSince (TBTLatencyProbe Probe, unsigned nStartTicks, unsigned nBytes = 0);
+
+	// percentiles are taken over the samples still in the ring
+	static void GetSummary (TBTLatencyProbe Probe, TBTLatencySummary *pSummary);
+
+	// writes all probes as one JSON object, returns the string length
+	// (the output is truncated, but always terminated, if nSize is short)
+	static unsigned WriteJSON (char *pBuffer, unsigned nSize);
+
+	static void Reset (void);
+
+private:
+	static volatile u32 s_nSamples[BTLatencyUnknown];
+	static volatile u32 s_nMax[BTLatencyUnknown];
+	static volatile u32 s_nTotal[BTLatencyUnknown];
+	static volatile u32 s_nBytes[BTLatencyUnknown];
+	static u32 s_Ring[BTLatencyUnknown][BT_LATENCY_SAMPLES];
+};
+
+#endif
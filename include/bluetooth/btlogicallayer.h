@@ -41,10 +41,14 @@
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/bthcilayer.h>
 #include <bluetooth/btinquiryresults.h>
-#include <bluetooth/ptrarray.h>
+#include <bluetooth/btvector.h>
+#include <bluetooth/bthashindex.h>
 #include <bluetooth/btlayer.h>
 #include <types.h>
 
+#define BT_LOGICAL_CONNECTIONS	8		// kept inline, more are allocated
+#define BT_LOGICAL_WAIT_SLICE	10000	// usec, blocked commands re-check
+
 // LMP Connection State
 
 typedef enum {
@@ -85,6 +89,8 @@ class CBTConnection
 	u16		Interval;
 	volatile TBTConnectionState	ConnectionState;
 	CBTDevice* Device;
+	volatile boolean CommandDone;	// the event of a blocking command came
+	void	*CommandWaitTask;
 
 	friend class CBTLogicalLayer;
 	friend class CBTSubSystem;
@@ -111,13 +117,16 @@ public:
 
 	// Get params
 	const u8 *GetBDAddress (void) const;
+	u16 GetConnectionHandle (void) const;
 	const u8 *GetLinkKey (void) const;
 	const u8 *GetPIN (void) const;
 	CBTDevice *GetDevice (void) const;
-	const u8 GetPINSize (void) const;
-	inline const TBTMode GetMode (void) const {return Mode;}
+	u8 GetPINSize (void) const;
+	inline TBTMode GetMode (void) const {return Mode;}
+	inline TBTConnectionState GetState (void) const {return ConnectionState;}
 
-	// Set params
+	// Set params, the address and handle of a connection added to the
+	// logical layer must be changed there to keep its indexes in step
 	void SetBDAddress (u8*);
 	void SetClassOfDevice (u8*);
 	void SetRemoteName (u8*);
@@ -200,6 +209,8 @@ PACKED;
 
 class CBTL2CAPLayer;
 
+typedef CBTVector<CBTConnection *, BT_LOGICAL_CONNECTIONS> TBTConnections;
+
 class CBTLogicalLayer : public CBTLayer {
 public:
 	CBTLogicalLayer (CBTHCILayer *pHCILayer);
@@ -213,6 +224,9 @@ public:
 	bool Connect (CBTConnection*);
 	bool ConnectResponse (CBTConnection*, u8, char*);
 	bool Authenticate (CBTConnection*, char*);
+	// only send the command, the connection state tells when it is done
+	void ConnectAsync (CBTConnection*);
+	void AuthenticateAsync (CBTConnection*, char*);
 	bool Disconnect (CBTConnection*, u8);
 	bool GetInfo (CBTConnection*);
 	bool GetFeatures (CBTConnection*);
@@ -222,34 +236,54 @@ public:
 		return m_pInquiryResults;}
 	inline unsigned& GetNameRequestsPending (void) {
 		return m_nNameRequestsPending;}
-	inline CPtrArray& GetConnections (void) {
+	inline TBTConnections& GetConnections (void) {
 		return m_Connections;}
-	inline CBTConnection*& GetConnectionPtr (void) {
-		return m_pConnection;}
+	inline CBTConnection* GetRxConnection (void) {
+		return m_pRxConnection;}
 	inline CBTDeviceManager* GetDeviceManager (void) {
 		return m_pHCILayer->GetDeviceManager();}
-	inline void SetHCIDataPackets (unsigned nDataPackets) {
-		m_pHCILayer->SetDataPackets(nDataPackets);
+	inline void CompleteHCIDataPackets (u16 nHandle, unsigned nDataPackets) {
+		m_pHCILayer->CompleteDataPackets(nHandle, nDataPackets);
 		return;}
-	inline void SetConnectionPtr (CBTConnection* pConnection) {
-		m_pConnection = pConnection;}
+	inline void AddHCILink (u16 nHandle) {
+		m_pHCILayer->AddLink(nHandle);}
+	inline void RemoveHCILink (u16 nHandle) {
+		m_pHCILayer->RemoveLink(nHandle);}
+	inline unsigned GetHCIACLDataLength (void) const {
+		return m_pHCILayer->GetACLDataLength();}
+	inline void SetHCIReceiveMTU (CBTConnection* pConnection, unsigned nMTU) {
+		m_pHCILayer->SetReceiveMTU(pConnection->ConnectionHandle, nMTU);}
 
 	// send functions
 	bool SendACLData (CBTConnection*, void*, u16);
-	bool SendHCICommand (const void*, unsigned);
+	// fragments at the controller ACL size, true if it could not be queued
+	bool SendACLData (CBTConnection*, const TBTScatter*, unsigned);
+	// encodes a TBTHCICommand in place, true if it could not be queued
+	template <typename TCommand, typename... TArgs>
+	inline bool SendHCICommand (TArgs... Args) {
+		return !m_pHCILayer->SendCommand<TCommand> (Args...);}
 
 	void Process (void);
 
 	void ListDevices (void);
-	CBTConnection* GetConnection (u8*);
+	CBTConnection* GetConnection (u8*);		// 0 if not found
 	CBTConnection* GetConnection (u16);
+	void AddConnection (CBTConnection*);
+	void RemoveConnection (CBTConnection*);
+	void SetConnectionBDAddress (CBTConnection*, u8*);
+	void SetConnectionHandle (CBTConnection*, u16);
 	void SetConnectingFlag (bool);
+	void CompleteCommand (CBTConnection*);	// wakes a blocking command
 	void RegisterLayer (CBTL2CAPLayer *pL2CAPLayer);
 	void RegisterLPCallback (TBTL2CAPCallback *pHandler);
-	void RegisterL2CAPCallback (TBTL2CAPCallback *pHandler);
+	void RegisterL2CAPCallback (TBTL2CAPPacketCallback *pHandler);
 
 	TBTL2CAPCallback *m_pLPCallback;
-	TBTL2CAPCallback *m_pL2CAPCallback;
+	TBTL2CAPPacketCallback *m_pL2CAPCallback;	// takes over the packet
+
+private:
+	void StartCommand (CBTConnection*);
+	void WaitCommand (CBTConnection*);
 
 private:
 	CBTHCILayer *m_pHCILayer;
@@ -257,8 +291,10 @@ private:
 
 	CBTInquiryResults *m_pInquiryResults;
 
-	CPtrArray m_Connections;
-	CBTConnection *m_pConnection;
+	TBTConnections m_Connections;
+	CBTHashIndex m_ConnectionsByBDAddr;
+	CBTHashIndex m_ConnectionsByHandle;		// handles assigned so far
+	CBTConnection *m_pRxConnection;		// sent the ACL packet delivered
 
 	bool m_bConnecting;
 	unsigned m_nNameRequestsPending;
@@ -63,14 +63,6 @@ typedef enum
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-struct mouse_data {
-	signed char	x;
-	signed char y;
-	signed char w;
-}
-PACKED;
-typedef struct mouse_data TBTMouseData;
-
 class CBTMouse: public CBTHIDDevice
 {
 public:
@@ -0,0 +1,151 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth Packet Buffer Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_btpacket_h
+#define _bt_btpacket_h
+
+#include <bluetooth/bluetooth.h>
+#include <sysconfig.h>
+#include <types.h>
+#include <stdlib.h>
+
+#define BT_PACKET_HEADROOM	16	// room to push lower layer headers
+#define BT_PACKET_TAILROOM	4	// room for trailers (e.g. FCS)
+#define BT_PACKET_DATA_SIZE	(BT_PACKET_HEADROOM + BT_MAX_DATA_SIZE + BT_PACKET_TAILROOM)
+#define BT_PACKET_POOL_SIZE	48	// packets in the global pool
+#define BT_PACKET_LARGE_MEMORY	16384	// bytes for packets larger than the pooled ones,
+					// e.g. reassembled L2CAP SDUs
+
+// Layers counted by the copy statistics
+enum TBTCopyLayer
+{
+	BTCopyLayerTransport,
+	BTCopyLayerHCI,
+	BTCopyLayerLogical,
+	BTCopyLayerL2CAP,
+	BTCopyLayerHIDP,
+	BTCopyLayerUnknown
+};
+
+class CBTPacketPool;
+
+// A pooled buffer passed between layers by pointer. Each layer strips
+// (Pull) or prepends (Push) its header by moving the data offset, the
+// payload itself is never copied. The last Release returns it to the pool.
+class CBTPacket
+{
+public:
+	u8 *GetData (void) const		{ return (u8 *) m_Buffer + m_nOffset; }
+	unsigned GetLength (void) const		{ return m_nLength; }
+
+	unsigned GetHeadroom (void) const	{ return m_nOffset; }
+	unsigned GetTailroom (void) const	{ return m_nSize - m_nOffset - m_nLength; }
+
+	u8 *Push (unsigned nLength);		// prepend, returns new start of data
+	u8 *Pull (unsigned nLength);		// strip, returns new start of data
+	u8 *Put (unsigned nLength);		// append, returns start of new area
+	void Trim (unsigned nLength);		// cut data to nLength bytes
+
+	void AddRef (void);
+	void Release (void);
+
+#ifdef BT_HAVE_LATENCY
+	unsigned GetTimestamp (void) const	{ return m_nTimestamp; }	// at Alloc
+#endif
+
+private:
+	friend class CBTPacketPool;
+
+	CBTPacket *m_pNext;			// free list link
+	volatile u32 m_nRefCount;
+	u16 m_nOffset;
+	u16 m_nLength;
+	unsigned m_nSize;			// of m_Buffer, larger for AllocLarge()
+#ifdef BT_HAVE_LATENCY
+	unsigned m_nTimestamp;
+#endif
+	u8 m_Buffer[BT_PACKET_DATA_SIZE];	// must be last
+};
+
+class CBTPacketPool
+{
+public:
+	CBTPacketPool (unsigned nPackets = BT_PACKET_POOL_SIZE);
+	~CBTPacketPool (void);
+
+	// returns 0 if the pool is exhausted, safe to call from IRQ
+	CBTPacket *Alloc (void);
+	// packet with room for nDataSize bytes after the headroom, taken from
+	// the heap if the pooled ones are too small, task level only
+	// returns 0 if BT_PACKET_LARGE_MEMORY would be exceeded
+	CBTPacket *AllocLarge (unsigned nDataSize);
+
+	unsigned GetFreeCount (void) const	{ return m_nFree; }
+	unsigned GetAllocFailures (void) const	{ return m_nAllocFailures; }
+	unsigned GetLargeBytes (void) const	{ return m_nLargeBytes; }	// held by large packets
+
+	// account a payload copy to a layer
+	static void CountCopy (TBTCopyLayer Layer, unsigned nBytes);
+	static unsigned GetCopies (TBTCopyLayer Layer);
+	static unsigned GetCopyBytes (TBTCopyLayer Layer);
+	static void ResetCopies (void);
+
+	static CBTPacketPool *Get (void);
+
+	void* operator new(size_t T) { return (void *)malloc(T); }
+	void operator delete (void *ptr) { free(ptr); }
+
+private:
+	friend class CBTPacket;
+	void Free (CBTPacket *pPacket);
+
+private:
+	CBTPacket *m_pPackets;
+	CBTPacket *m_pFreeList;
+	volatile u32 m_nFree;
+	volatile u32 m_nAllocFailures;
+	volatile u32 m_nLargeBytes;
+
+	unsigned int * m_SpinLock;
+
+	static volatile u32 s_nCopies[BTCopyLayerUnknown];
+	static volatile u32 s_nCopyBytes[BTCopyLayerUnknown];
+
+	static CBTPacketPool *s_pThis;
+};
+
+#endif
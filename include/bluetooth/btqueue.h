@@ -38,31 +38,135 @@
 #ifndef _bt_btqueue_h
 #define _bt_btqueue_h
 
+#include <bluetooth/bluetooth.h>
+#include <sysconfig.h>
 #include <types.h>
+#include <stdlib.h>
+
+#define BT_QUEUE_DEFAULT_CAPACITY	16	// slots allocated when not specified
 
 struct TBTQueueEntry;
 
+// One piece of a packet, Enqueue gathers a list of them into a slot
+struct TBTScatter
+{
+	const void	*pData;
+	unsigned	 nLength;
+};
+
+// Bounded FIFO of fixed size slots, all allocated once at construction.
+// Enqueue never allocates: a packet is dropped (and counted) if the queue
+// is full or it does not fit in a slot.
 class CBTQueue
 {
 public:
-	CBTQueue (void);
+	CBTQueue (unsigned nCapacity = BT_QUEUE_DEFAULT_CAPACITY,
+		  unsigned nSlotSize = BT_MAX_DATA_SIZE);
 	~CBTQueue (void);
 
 	boolean IsEmpty (void) const;
 	
 	void Flush (void);
 	
-	void Enqueue (const void *pBuffer, unsigned nLength, void *pParam = 0);
+	// returns FALSE if the packet was dropped
+	boolean Enqueue (const void *pBuffer, unsigned nLength, void *pParam = 0);
+	boolean Enqueue (const TBTScatter *pList, unsigned nEntries, void *pParam = 0);
 
 	unsigned Dequeue (void *pBuffer, void **ppParam = 0);
+	// copies at most nSize bytes, the rest of the entry is discarded;
+	// returns the full entry length
+	unsigned Dequeue (void *pBuffer, unsigned nSize, void **ppParam);
+
+	// Enqueue in place: BeginEnqueue returns the next slot (0 if the queue
+	// is full or nLength does not fit) and keeps the queue locked until
+	// EndEnqueue publishes it, so the slot must be filled right away
+	void *BeginEnqueue (unsigned nLength);
+	void EndEnqueue (unsigned nLength, void *pParam = 0);
+
+	// Dequeue in place for a single consumer: Peek returns the oldest
+	// entry (0 if empty), which stays valid until Discard removes it
+	const void *Peek (unsigned *pLength, void **ppParam = 0) const;
+	void Discard (void);
+
+	unsigned GetCount (void) const		{ return m_nCount; }
+	unsigned GetFreeCount (void) const	{ return m_nCapacity - m_nCount; }
+	unsigned GetCapacity (void) const	{ return m_nCapacity; }
+	unsigned GetSlotSize (void) const	{ return m_nSlotSize; }
+
+	unsigned GetOverflows (void) const	{ return m_nOverflows; }	// enqueued while full
+	unsigned GetDrops (void) const		{ return m_nDrops; }		// larger than a slot
+	unsigned GetHighWater (void) const	{ return m_nHighWater; }	// 0 without BT_HAVE_STATS
+
+	void* operator new(size_t T) { return (void *)malloc(T); }
+	void operator delete (void *ptr) { free(ptr); }
+
+private:
+	TBTQueueEntry *GetEntry (unsigned nIndex) const;
 
 private:
 	volatile bool m_bInit;
+
+	u8 *m_pSlots;
+	unsigned m_nCapacity;
+	unsigned m_nSlotSize;
+	unsigned m_nEntrySize;
+
+	volatile u32 m_nHead;			// next slot to dequeue
+	volatile u32 m_nTail;			// next slot to enqueue
 	volatile u32 m_nCount;
-	volatile TBTQueueEntry *m_pFirst;
-	volatile TBTQueueEntry *m_pLast;
+
+	volatile u32 m_nOverflows;
+	volatile u32 m_nDrops;
+	volatile u32 m_nHighWater;		// most entries queued at once
 
 	unsigned int * m_SpinLock;
 };
 
+// Wait-free variant for exactly one producer (e.g. the UART IRQ) and one
+// consumer (the HCI task). Neither side masks interrupts or takes a lock,
+// the indices are published with release stores and read with acquire
+// loads. Enqueue must only be called by the producer, Dequeue and Flush
+// only by the consumer.
+class CBTSPSCQueue
+{
+public:
+	CBTSPSCQueue (unsigned nCapacity = BT_QUEUE_DEFAULT_CAPACITY,
+		      unsigned nSlotSize = BT_MAX_DATA_SIZE);
+	~CBTSPSCQueue (void);
+
+	boolean IsEmpty (void) const;
+
+	void Flush (void);
+
+	// returns FALSE if the packet was dropped
+	boolean Enqueue (const void *pBuffer, unsigned nLength, void *pParam = 0);
+
+	unsigned Dequeue (void *pBuffer, void **ppParam = 0);
+
+	unsigned GetCount (void) const;
+	unsigned GetCapacity (void) const	{ return m_nSize - 1; }
+	unsigned GetSlotSize (void) const	{ return m_nSlotSize; }
+
+	unsigned GetOverflows (void) const	{ return m_nOverflows; }
+	unsigned GetDrops (void) const		{ return m_nDrops; }
+	unsigned GetHighWater (void) const	{ return m_nHighWater; }
+
+private:
+	TBTQueueEntry *GetEntry (unsigned nIndex) const;
+	unsigned Next (unsigned nIndex) const	{ return nIndex+1 == m_nSize ? 0 : nIndex+1; }
+
+private:
+	u8 *m_pSlots;
+	unsigned m_nSize;			// capacity + 1, one slot stays empty
+	unsigned m_nSlotSize;
+	unsigned m_nEntrySize;
+
+	volatile u32 m_nHead;			// owned by the consumer
+	volatile u32 m_nTail;			// owned by the producer
+
+	volatile u32 m_nOverflows;		// producer side counters
+	volatile u32 m_nDrops;
+	volatile u32 m_nHighWater;
+};
+
 #endif
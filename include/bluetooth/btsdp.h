@@ -48,6 +48,34 @@
 
 // Sizes
 #define BT_SDP_UUID_SIZE	128
+#define BT_SDP_MTU		672		// asked for on the channel of a query
+#define BT_SDP_BUFFER_SIZE	1024		// attribute lists collected by a query
+#define BT_SDP_MAX_CONTINUATION	16
+#define BT_SDP_TIMEOUT		3000000		// usec to wait for each response
+
+// results of the queries
+#define BT_SDP_RESULT_SUCCESS		0x0000
+#define BT_SDP_RESULT_NO_CHANNEL	0x0001	// the remote refused or did not answer
+#define BT_SDP_RESULT_ERROR_RESPONSE	0x0002
+#define BT_SDP_RESULT_MALFORMED		0x0003
+#define BT_SDP_RESULT_NOT_FOUND		0x0004	// no such record or attribute
+#define BT_SDP_RESULT_TOO_LARGE		0x0005
+#define BT_SDP_RESULT_TIMEOUT		0xEEEE
+
+#define BT_SDP_UUID_HUMAN_INTERFACE_DEVICE	0x1124
+#define BT_SDP_ATTRIBUTE_HID_DESCRIPTOR_LIST	0x0206
+#define BT_SDP_HID_DESCRIPTOR_REPORT		0x22
+
+// data element types
+#define BT_SDP_DE_NIL		0
+#define BT_SDP_DE_UINT		1
+#define BT_SDP_DE_INT		2
+#define BT_SDP_DE_UUID		3
+#define BT_SDP_DE_TEXT		4
+#define BT_SDP_DE_BOOL		5
+#define BT_SDP_DE_SEQUENCE	6
+#define BT_SDP_DE_ALTERNATIVE	7
+#define BT_SDP_DE_URL		8
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -244,20 +272,31 @@ public:
 	CBTSDPLayer(CBTL2CAPLayer *pL2CAPLayer);
 	~CBTSDPLayer(void);
 
-private:
-	static void Callback (const void *pBuffer, unsigned nLength);
-	void DataHandler(u16, u8*, u16);
+	// Blocking queries from task level, one at a time. The value of
+	// nAttributeID in the first record of service class nUUID is copied
+	// as a data element, BT_SDP_RESULT_SUCCESS is returned.
+	u16 GetAttribute(TBDAddr BDAddr, u16 nUUID, u16 nAttributeID,
+		u8 *pBuffer, u16 nSize, u16 *pLength);
+	// the report descriptor out of the HID descriptor list
+	u16 GetHIDDescriptor(TBDAddr BDAddr, u8 *pBuffer, u16 nSize, u16 *pLength);
 
-	CBTL2CAPLayer *m_pL2CAPLayer;
+	// data of the element at pData, 0 if it runs beyond pEnd
+	static const u8 *GetElement(const u8 *pData, const u8 *pEnd,
+		u8 *pType, u32 *pLength);
 
-	CBTQueue m_RxPacketQueue;
+private:
+	void Callback (const void *pBuffer, unsigned nLength);
+	u16 Query(u16 nCID, u16 nUUID, u16 nAttributeID, unsigned *pListLength);
+	u16 FindAttribute(unsigned nListLength, u16 nAttributeID,
+		u8 *pBuffer, u16 nSize, u16 *pLength);
 
-	u8 *m_pBuffer;
+	CBTL2CAPLayer *m_pL2CAPLayer;
 
-	unsigned m_nRxPackets;		// packets allowed to be received
+	u8 *m_pBuffer;			// one response PDU
+	u8 *m_pAttributeLists;		// of all responses to a query
+	u16 m_nTransactionID;
 
 	static TBTL2CAPCallback EventStub;
-	static TBTL2CAPDataCallback DataStub;
 	static CBTSDPLayer *s_pThis;
 };
 
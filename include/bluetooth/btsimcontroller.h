@@ -0,0 +1,188 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Host Simulation Bluetooth Controller Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_simcontroller_h
+#define _bt_simcontroller_h
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/btsimpeer.h>
+#include <types.h>
+#include <stdlib.h>
+
+#define BT_SIM_MAX_PEERS	8
+#define BT_SIM_ACL_MTU		128		// peer data is fragmented to this size by default
+#define BT_SIM_FIRST_HANDLE	0x0040
+#define BT_SIM_INQUIRY_TIME	100000		// us, whatever length is requested
+#define BT_SIM_ACL_BUFFERS	8		// as reported by the BCM43430A1
+#define BT_SIM_ACL_LENGTH	1021
+#define BT_SIM_COMMAND_PACKETS	1		// commands taken at once
+
+struct TBTSimPacket;
+
+//
+// Software HCI controller for host builds. Commands and ACL data from the
+// host are answered at once, the resulting H4 stream is queued with a due
+// time and handed out by Read() like bytes arriving on the UART.
+//
+class CBTSimController
+{
+public:
+	CBTSimController (void);
+	~CBTSimController (void);
+
+	// the peers are not owned and must outlive the controller
+	boolean AddPeer (CBTSimPeer *pPeer);
+
+	void SetBDAddress (const u8 *pBDAddr);
+	void SetResponseDelay (unsigned nMicros);	// added to every packet
+	void SetInquiryTime (unsigned nMicros);
+
+	// reported by Read Buffer Size, set before the host is initialized
+	void SetACLBuffers (unsigned nPackets, unsigned nLength);
+	// time one ACL packet occupies the air, completions are serialized
+	void SetAirTime (unsigned nMicros);
+	// reported in Command Complete/Status, a slot is free again when the
+	// host has read the answer
+	void SetCommandPackets (unsigned nPackets);
+	// commands arriving this long after Launch RAM are lost
+	void SetRestartTime (unsigned nMicros);
+	// peer data is cut into fragments of 1 to nMaxFragment bytes, each due
+	// up to nJitter us from now but never before the last one of its link,
+	// so that the links interleave; 0 sends whole pieces again
+	void SetACLInterleave (unsigned nMaxFragment, unsigned nJitter);
+	// size of the pieces peer data is cut into, up to BT_SIM_ACL_LENGTH;
+	// never more than the host announced with Host Buffer Size
+	void SetACLFragment (unsigned nLength);
+
+	// the peer pages the host, which answers with Accept/Reject
+	void RequestConnection (CBTSimPeer *pPeer);
+
+	// host -> controller, complete packets without the H4 indicator
+	void ReceiveCommand (const u8 *pBuffer, unsigned nLength);
+	void ReceiveData (const u8 *pBuffer, unsigned nLength);
+
+	// controller -> host H4 stream, returns the number of bytes copied
+	unsigned Read (u8 *pBuffer, unsigned nSize);
+
+	// one L2CAP frame from a connected peer
+	void SendACL (CBTSimPeer *pPeer, const u8 *pFrame, unsigned nLength);
+
+	unsigned GetCommands (void) const;
+	unsigned GetFirmwareBytes (void) const;		// received by Write RAM
+	unsigned GetCommandOverruns (void) const;	// sent without a free slot
+	unsigned GetCommandsLost (void) const;		// sent while restarting
+
+	// ACL flow control as seen by the controller
+	unsigned GetACLPackets (void) const;		// accepted from the host
+	unsigned GetACLOverruns (void) const;		// sent without a free buffer
+	unsigned GetACLBuffersUsed (void) const;	// most held at once
+
+	// controller to host flow control
+	boolean IsHostFlowControl (void) const		{ return m_bHostFlowControl; }
+	unsigned GetHostACLLength (void) const		{ return m_nHostACLLength; }	// 0 if not announced
+	unsigned GetLargestACLToHost (void) const	{ return m_nLargestACLToHost; }
+
+	void* operator new(size_t T) { return (void *)malloc(T); }
+	void operator delete (void *ptr) { free(ptr); }
+
+private:
+	void Command (u16 nOpCode, const u8 *pParams, unsigned nLength);
+	void HostCompleted (const u8 *pParams, unsigned nLength);
+	void CommandComplete (u16 nOpCode, u8 nStatus,
+			      const void *pParams = 0, unsigned nLength = 0);
+	void CommandStatus (u16 nOpCode, u8 nStatus);
+	void Event (u8 nEventCode, const void *pParams, unsigned nLength,
+		    unsigned nDelay = 0);
+	void Queue (const u8 *pHeader, unsigned nHeaderLength,
+		    const void *pData, unsigned nLength, unsigned nDelay);
+	void QueueAt (const u8 *pHeader, unsigned nHeaderLength,
+		      const void *pData, unsigned nLength, unsigned nDue);
+
+	void Inquiry (void);
+	void ConnectionComplete (CBTSimPeer *pPeer, const u8 *pBDAddr, u8 nStatus);
+	void AuthenticationComplete (CBTSimPeer *pPeer, u8 nStatus);
+
+	CBTSimPeer *GetPeer (const u8 *pBDAddr) const;
+	CBTSimPeer *GetPeer (u16 nHandle) const;
+
+private:
+	CBTSimPeer *m_pPeer[BT_SIM_MAX_PEERS];
+	volatile unsigned m_nPeers;
+
+	u8 m_BDAddr[BT_BD_ADDR_SIZE];
+	unsigned m_nResponseDelay;
+	unsigned m_nInquiryTime;
+	u16 m_nNextHandle;
+
+	unsigned m_nACLBuffers;
+	unsigned m_nACLLength;
+	unsigned m_nACLFree;			// until the completion is read
+	unsigned m_nAirTime;
+	unsigned m_nAirBusy;			// last completion due
+
+	unsigned m_nFragment;
+	unsigned m_nMaxFragment;		// 0 if not interleaving
+	unsigned m_nJitter;
+	unsigned m_nRandom;
+	unsigned m_nLastDue[BT_SIM_MAX_PEERS];
+
+	unsigned m_nHostACLLength;		// from Host Buffer Size
+	unsigned m_nHostACLPackets;
+	unsigned m_nHostACLFree;		// until the host reports them completed
+	boolean m_bHostFlowControl;
+	unsigned m_nLargestACLToHost;
+
+	unsigned m_nCommandPackets;
+	unsigned m_nCommandsHeld;		// until the answer is read
+	unsigned m_nRestartTime;
+	boolean m_bRestarting;			// after Launch RAM
+	unsigned m_nRestartDue;
+
+	TBTSimPacket *m_pFirst;			// ordered by due time
+	unsigned m_nReadOffset;			// into m_pFirst
+	volatile unsigned int m_nLock;
+
+	unsigned m_nCommands;
+	unsigned m_nFirmwareBytes;
+	unsigned m_nCommandOverruns;
+	unsigned m_nCommandsLost;
+	unsigned m_nACLPackets;
+	unsigned m_nACLOverruns;
+	unsigned m_nACLBuffersUsed;
+};
+
+#endif
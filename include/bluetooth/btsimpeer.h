@@ -0,0 +1,327 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Host Simulation Bluetooth Peer Device Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_simpeer_h
+#define _bt_simpeer_h
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/btdevicemanager.h>
+#include <types.h>
+#include <stdlib.h>
+
+#define BT_SIM_MAX_CHANNELS	4
+#define BT_SIM_MAX_FRAME	1024		// largest L2CAP frame a peer reassembles
+#define BT_SIM_PEER_MTU		672
+#define BT_SIM_PEER_SDU_MTU	8192		// taken in ERTM and Streaming mode, segmented
+
+#define BT_SIM_ECHO_PSM		0x0025		// served by CBTSimEchoPeer
+
+#define BT_SIM_MAX_DESCRIPTOR	512		// HID report descriptor served over SDP
+#define BT_SIM_SDP_CHUNK	32		// attribute bytes per SDP response, to continue
+
+#define BT_SIM_ERTM_WINDOW	32		// I-frames the peer buffers
+#define BT_SIM_ERTM_MAX_TRANSMIT 16
+#define BT_SIM_ERTM_RETRANS	100		// msec, given to the host
+#define BT_SIM_ERTM_MONITOR	400		// msec, given to the host
+#define BT_SIM_ERTM_TIMEOUT	100000		// us, the peer's go-back-N timer
+
+class CBTSimController;
+
+enum TBTSimChannelState
+{
+	BTSimChannelClosed,
+	BTSimChannelConfig,
+	BTSimChannelOpen
+};
+
+struct TBTSimChannel
+{
+	TBTSimChannelState State;
+	u16	PSM;
+	u16	LocalCID;			// peer side
+	u16	RemoteCID;			// host side
+	boolean	OutConfigDone;			// host accepted our configuration
+	boolean	InConfigDone;			// we accepted the host's
+	u8	Mode;				// BT_L2CAP_MODE_*
+	u8	TxWindow;			// the host's receive window
+	u16	MPS;				// largest I-frame payload to the host
+};
+
+//
+// A remote device as seen through the simulated controller. The base class
+// speaks the L2CAP signalling channel, derived classes implement the
+// protocol on top of their channels.
+//
+class CBTSimPeer
+{
+public:
+	CBTSimPeer (const u8 *pBDAddr, TBTCOD ClassOfDevice, const char *pName);
+	virtual ~CBTSimPeer (void);
+
+	const u8 *GetBDAddress (void) const;
+	const u8 *GetClassOfDevice (void) const;
+	const char *GetName (void) const;
+
+	const char *GetPIN (void) const;
+	void SetPIN (const char *pPIN);
+
+	u16 GetConnectionHandle (void) const;		// 0 if not connected
+	boolean IsChannelOpen (u16 nPSM) const;
+
+	// signalling commands from the host are dropped, its requests time out
+	void SetIgnoreSignalling (boolean bIgnore);
+
+	// called by the controller
+	void Attach (CBTSimController *pController, u16 nHandle);
+	void Detach (void);
+	void ReceiveACL (u8 nBoundaryFlag, const u8 *pBuffer, unsigned nLength);
+	virtual void Poll (unsigned nNow);		// before each read by the host
+
+	void* operator new(size_t T) { return (void *)malloc(T); }
+	void operator delete (void *ptr) { free(ptr); }
+
+protected:
+	virtual boolean AcceptPSM (u16 nPSM);
+	virtual void ChannelOpened (u16 nPSM);
+	virtual void ChannelData (u16 nPSM, const u8 *pData, unsigned nLength);
+
+	// frames of channels in ERTM or Streaming mode, with the basic header
+	virtual void ChannelFrame (TBTSimChannel *pChannel, const u8 *pFrame,
+				   unsigned nLength);
+
+	// sends an SDU to the host on the open channel for nPSM
+	boolean SendChannel (u16 nPSM, const void *pData, unsigned nLength);
+	// sends a complete L2CAP frame
+	void SendFrame (const u8 *pFrame, unsigned nLength);
+
+	// proposed in our configuration requests, Basic mode by default
+	void SetChannelMode (u8 nMode);
+	TBTSimChannel *GetChannelByPSM (u16 nPSM) const;
+
+private:
+	void Receive (const u8 *pFrame, unsigned nLength);
+	void Signalling (const u8 *pCommand, unsigned nLength);
+	void SendSignal (u8 nCode, u8 nIdentifier, const u8 *pData, unsigned nLength);
+	void SendConfigRequest (TBTSimChannel *pChannel);
+	unsigned ConfigOptions (TBTSimChannel *pChannel, u8 *pOptions,
+				unsigned nLength, u16 *pResult);
+	void CheckOpen (TBTSimChannel *pChannel);
+	TBTSimChannel *GetChannel (u16 nLocalCID);
+
+private:
+	u8	m_BDAddr[BT_BD_ADDR_SIZE];
+	TBTCOD	m_ClassOfDevice;
+	char	m_Name[BT_NAME_SIZE];
+	char	m_PIN[BT_MAX_PIN_CODE_SIZE+1];
+
+	CBTSimController *m_pController;
+	volatile u16 m_nHandle;
+	u8	m_nIdentifier;
+	u16	m_nNextCID;
+	u8	m_nMode;
+	volatile boolean m_bIgnoreSignalling;
+
+	TBTSimChannel m_Channels[BT_SIM_MAX_CHANNELS];
+
+	u8	m_Frame[BT_SIM_MAX_FRAME];	// L2CAP reassembly
+	unsigned m_nFrameLength;
+};
+
+// HID device answering on the control and interrupt channels, and with
+// its report descriptor on SDP if it has one
+class CBTSimHIDPeer : public CBTSimPeer
+{
+public:
+	CBTSimHIDPeer (const u8 *pBDAddr, TBTCOD ClassOfDevice, const char *pName,
+		       const u8 *pDescriptor = 0, unsigned nDescriptorLength = 0);
+	~CBTSimHIDPeer (void);
+
+	unsigned GetReportsSent (void) const;
+
+	// 0 removes the SDP record, the host keeps the boot layout then
+	void SetReportDescriptor (const u8 *pDescriptor, unsigned nLength);
+
+	// sends an input report (without the HIDP header) on the interrupt channel
+	boolean SendInput (const u8 *pReport, unsigned nLength);
+
+protected:
+	boolean AcceptPSM (u16 nPSM);
+	void ChannelData (u16 nPSM, const u8 *pData, unsigned nLength);
+
+	// sends an input report on the interrupt channel
+	boolean SendReport (const u8 *pReport, unsigned nLength);
+
+private:
+	void ServiceDiscovery (const u8 *pRequest, unsigned nLength);
+
+private:
+	unsigned m_nReportsSent;
+
+	u8	 m_Descriptor[BT_SIM_MAX_DESCRIPTOR];
+	unsigned m_nDescriptorLength;
+};
+
+class CBTSimMouse : public CBTSimHIDPeer
+{
+public:
+	CBTSimMouse (const u8 *pBDAddr, const char *pName = "Simulated Mouse");
+	~CBTSimMouse (void);
+
+	// returns FALSE if the interrupt channel is not open
+	boolean Move (signed char nX, signed char nY, signed char nWheel = 0,
+		      u8 nButtons = 0);
+};
+
+class CBTSimKeyboard : public CBTSimHIDPeer
+{
+public:
+	CBTSimKeyboard (const u8 *pBDAddr, const char *pName = "Simulated Keyboard");
+	~CBTSimKeyboard (void);
+
+	// sends a key down and a key up report
+	boolean KeyPress (u8 nModifiers, u8 nKeyCode);
+};
+
+// echoes everything received on BT_SIM_ECHO_PSM
+class CBTSimEchoPeer : public CBTSimPeer
+{
+public:
+	CBTSimEchoPeer (const u8 *pBDAddr, const char *pName = "Simulated Echo");
+	~CBTSimEchoPeer (void);
+
+	unsigned GetBytesEchoed (void) const;
+
+protected:
+	boolean AcceptPSM (u16 nPSM);
+	void ChannelData (u16 nPSM, const u8 *pData, unsigned nLength);
+
+private:
+	unsigned m_nBytesEchoed;
+};
+
+// echoes on BT_SIM_ECHO_PSM in ERTM or Streaming mode, optionally losing
+// or corrupting I-frames in both directions; segmented SDUs come back in
+// the same segments
+class CBTSimERTMPeer : public CBTSimPeer
+{
+public:
+	// nMode is BT_L2CAP_MODE_ERTM or BT_L2CAP_MODE_STREAMING
+	CBTSimERTMPeer (const u8 *pBDAddr, u8 nMode,
+			const char *pName = "Simulated ERTM Echo");
+	~CBTSimERTMPeer (void);
+
+	void SetLoss (unsigned nPercent);
+	void SetCorruption (unsigned nPercent);
+	// a gap is asked for with SREJ per missing frame, the frames after it
+	// are kept meanwhile, otherwise with one REJ
+	void SetSelectiveReject (boolean bOn);
+
+	// sends a segment of its own, pData starts with the SDU length in a
+	// start segment; FALSE if no channel is open or the ring is full
+	boolean SendSegment (u8 nSAR, const u8 *pData, unsigned nLength);
+
+	void Poll (unsigned nNow);
+
+	unsigned GetBytesEchoed (void) const;
+	unsigned GetRetransmissions (void) const;
+	unsigned GetFramesLost (void) const;		// dropped or corrupted here
+	unsigned GetFCSErrors (void) const;		// from the host
+	unsigned GetSelectiveRejects (void) const;	// sent here
+	// S-frames from the host
+	unsigned GetRejects (void) const;
+	unsigned GetPolls (void) const;
+	unsigned GetBusyFrames (void) const;		// RNR
+
+protected:
+	boolean AcceptPSM (u16 nPSM);
+	void ChannelOpened (u16 nPSM);
+	void ChannelData (u16 nPSM, const u8 *pData, unsigned nLength);	// if refused
+	void ChannelFrame (TBTSimChannel *pChannel, const u8 *pFrame, unsigned nLength);
+
+private:
+	void Queue (u8 nSAR, const u8 *pData, unsigned nLength);
+	void Transmit (TBTSimChannel *pChannel, unsigned nNow);
+	void SendIFrame (TBTSimChannel *pChannel, u8 nTxSeq);
+	void SendSFrame (TBTSimChannel *pChannel, u16 nControl);
+	void Send (TBTSimChannel *pChannel, u16 nControl, const u8 *pData,
+		   unsigned nLength, boolean bIFrame);
+	void Acknowledge (u8 nReqSeq, unsigned nNow);
+	void Hold (TBTSimChannel *pChannel, u8 nTxSeq, u8 nSAR, const u8 *pData,
+		   unsigned nLength);
+	void Deliver (u8 nSAR, const u8 *pData, unsigned nLength);
+	boolean Chance (unsigned nPercent);
+
+private:
+	unsigned m_nLoss;
+	unsigned m_nCorruption;
+	unsigned m_nRandom;
+	boolean	 m_bSelectiveReject;
+
+	// the ring is indexed by TxSeq, frames up to m_nNextTxSeq are sent
+	u8	 m_TxFrame[64][BT_SIM_PEER_MTU];
+	u16	 m_TxLength[64];
+	u8	 m_TxSAR[64];
+	u8	 m_nExpectedAckSeq;
+	u8	 m_nNextTxSeq;
+	u8	 m_nTxTail;			// next free slot
+	unsigned m_nTxStart;			// last ack progress
+	boolean	 m_bRemoteBusy;
+
+	u8	 m_nExpectedTxSeq;
+	boolean	 m_bRejSent;
+	// frames after a gap, indexed by TxSeq like the transmit ring
+	u8	 m_RxFrame[64][BT_SIM_PEER_MTU];
+	u16	 m_RxLength[64];
+	u8	 m_RxSAR[64];
+	u64	 m_RxHeld;			// bit per TxSeq
+	u64	 m_SRejSent;
+	boolean	 m_bAckPending;
+	boolean	 m_bFinalPending;
+
+	unsigned m_nBytesEchoed;
+	unsigned m_nRetransmissions;
+	unsigned m_nFramesLost;
+	unsigned m_nFCSErrors;
+	unsigned m_nSelectiveRejects;
+	unsigned m_nRejects;
+	unsigned m_nPolls;
+	unsigned m_nBusyFrames;
+
+	volatile unsigned int m_nLock;
+};
+
+#endif
@@ -0,0 +1,89 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Host Simulation Bluetooth Transport Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_simtransport_h
+#define _bt_simtransport_h
+
+#include <bluetooth/device.h>
+#include <bluetooth/bttransportlayer.h>
+#include <bluetooth/bth4deframer.h>
+#include <bluetooth/btsimcontroller.h>
+#include <platform/bt_interrupt-system.h>
+#include <types.h>
+#include <stdlib.h>
+
+#define BT_SIM_RX_SPAN_SIZE	64		// bytes handed to the deframer at once
+#define BT_SIM_RX_BUDGET	1024		// bytes delivered per Process()
+
+//
+// Stands in for CBTUARTTransport on the host, it registers as "ttyBT1"
+// and feeds the H4 stream of a CBTSimController through the deframer.
+//
+class CBTSimTransport : public CDevice
+{
+public:
+	CBTSimTransport (TInterruptSystem *pInterruptSystem);
+	~CBTSimTransport (void);
+
+	boolean Initialize (unsigned nBaudrate = 115200);
+
+	boolean SendHCICommand (const void *pBuffer, unsigned nLength);
+	boolean SendHCIData (const void *pBuffer, unsigned nLength);
+
+	boolean IsTxReady (unsigned nLength) const;
+	boolean IsTxIdle (void) const;
+
+	// called from the HCI task, delivers the controller output
+	void Process (void);
+
+	void RegisterHCIEventHandler (TBTHCIEventHandler *pHandler);
+	void RegisterHCIDataHandler (TBTHCIDataHandler *pHandler);
+
+	CBTSimController *GetController (void);
+
+	const CBTH4Deframer *GetDeframer (void) const	{ return &m_Deframer; }
+	unsigned GetOverruns (void) const		{ return 0; }
+
+	void* operator new(size_t T) { return (void *)malloc(T); }
+	void operator delete (void *ptr) { free(ptr); }
+
+private:
+	CBTH4Deframer m_Deframer;
+	CBTSimController m_Controller;
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth Layer Statistics Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_stats_h
+#define _bt_stats_h
+
+#include <sysconfig.h>
+#include <platform/bt_cycles.h>
+#include <types.h>
+
+// Timed sections, in cycle counter units (or us, see HaveCycleCounter)
+enum TBTStatsTimer
+{
+	BTStatsRxDeframe,		// transport RX entry -> received bytes deframed
+	BTStatsHCIProcess,		// CBTHCILayer::Process without the device manager
+	BTStatsDeviceManagerProcess,	// CBTDeviceManager::Process
+	BTStatsLogicalProcess,		// CBTLogicalLayer::Process
+	BTStatsCommandRoundTrip,	// HCI command sent -> command credit returned
+	BTStatsUnknown
+};
+
+struct TBTStatsTimerSummary
+{
+	unsigned nCount;
+	unsigned nMax;
+	u64 nTotal;
+};
+
+// Per section count/total/max, compiled in with BT_HAVE_STATS only.
+// The call sites use the BT_STATS_* macros, which vanish otherwise.
+class CBTStats
+{
+public:
+	static void Initialize (void);		// enables the cycle counter
+
+	static unsigned Now (void)		{ return BT_GetCycleCount (); }
+	static void Record (TBTStatsTimer Timer, unsigned nStart);
+
+	static void GetTimer (TBTStatsTimer Timer, TBTStatsTimerSummary *pSummary);
+	static boolean HaveCycleCounter (void);
+
+	static void Reset (void);
+
+private:
+	static volatile u32 s_nCount[BTStatsUnknown];
+	static volatile u32 s_nMax[BTStatsUnknown];
+	static volatile u64 s_nTotal[BTStatsUnknown];
+};
+
+#ifdef BT_HAVE_STATS
+#define BT_STATS_START(name)		unsigned name = CBTStats::Now ()
+#define BT_STATS_RECORD(timer, name)	CBTStats::Record (timer, name)
+#else
+#define BT_STATS_START(name)		((void) 0)
+#define BT_STATS_RECORD(timer, name)	((void) 0)
+#endif
+
+#endif
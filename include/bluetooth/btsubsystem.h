@@ -43,12 +43,18 @@
 #include <platform/bt_interrupt-system.h>
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/btinquiryresults.h>
-#include <bluetooth/btuarttransport.h>
+#include <bluetooth/btpacket.h>
 #include <bluetooth/bthcilayer.h>
 #include <bluetooth/btlogicallayer.h>
 #include <bluetooth/btl2cap.h>
 #include <bluetooth/bthidp.h>
+#include <bluetooth/btsdp.h>
 #include <bluetooth/btdevice.h>
+#include <bluetooth/btlatency.h>
+#include <bluetooth/btstats.h>
+#include <bluetooth/btvector.h>
+
+#define BT_SUBSYSTEM_DEVICES	8		// kept inline, more are allocated
 
 class CBTSubSystem
 {
@@ -67,6 +73,10 @@ public:
 
 	CBTDevice* Accept (void *);	
 
+	// connects every HID device found by Listen at once, returns how many
+	// are connected afterwards
+	unsigned AcceptAll (void);
+
 	CBTDevice* GetDevice (CBTConnection *);	
 
 	CBTDevice* GetDevice (u16);	
@@ -77,20 +87,44 @@ public:
 	
 	boolean Status (void);
 
+	// returns FALSE and zeroes pStats without BT_HAVE_STATS
+	boolean GetStats (tBT_stats *pStats);
+
+	// received ACL data lost before it reached L2CAP, also counted
+	// without BT_HAVE_STATS
+	unsigned GetReceiveDrops (void);
+
+	// for protocols which open their own channels
+	CBTL2CAPLayer *GetL2CAPLayer (void);
+
 	void* operator new(size_t T) { return (void *)malloc(T); }
 	void operator delete (void *ptr) { free(ptr); }
 
+private:
+	void Run (void);
+	static void RunStub (void *pParam);
+
+	// asks the connected device for its report descriptor over SDP
+	void LoadReportDescriptor (CBTHIDDevice *pDevice);
+
 private:
 	TInterruptSystem *m_pInterruptSystem;
 
-	CBTUARTTransport *m_pUARTTransport;
+	TBTHCITransport *m_pUARTTransport;
 
+	CBTPacketPool	m_PacketPool;		// must be constructed before the layers
 	CBTHCILayer	m_HCILayer;
 	CBTLogicalLayer	m_LogicalLayer;
 	CBTL2CAPLayer	m_L2CAPLayer;
 	CBTHIDPLayer	m_HIDPLayer;
+	CBTSDPLayer	m_SDPLayer;
 
-	CPtrArray m_Devices;
+	CBTVector<CBTDevice *, BT_SUBSYSTEM_DEVICES> m_Devices;
+
+#ifdef BT_HAVE_LATENCY
+	unsigned m_nStartTicks;			// Initialize called
+	unsigned m_nListenTicks;		// last Listen called
+#endif
 };
 
 #endif
@@ -47,10 +47,14 @@ enum TBTTransportType
 	BTTransportTypeUnknown
 };
 
+class CBTPacket;
+
 typedef void TBTHCIEventHandler (const void *pBuffer, unsigned nLength);
-typedef void TBTHCIDataHandler (const void *pBuffer, unsigned nLength);
+typedef void TBTHCIDataHandler (CBTPacket *pPacket);	// handler owns the packet
+typedef void TBTHCISCOHandler (const void *pBuffer, unsigned nLength);
 typedef void TBTL2CAPCallback (const void *pBuffer, unsigned nLength);
-typedef void TBTL2CAPDataCallback (u16 , const void *pBuffer, unsigned nLength);
+typedef void TBTL2CAPPacketCallback (CBTPacket *pPacket);
+typedef void TBTL2CAPDataCallback (u16 , CBTPacket *pPacket);
 typedef void TBTHIDPCallback (u16, u8 *pBuffer, u16 nLength);
 typedef void TBTCallback (u8, void *, const void *, unsigned);
 
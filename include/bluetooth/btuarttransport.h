@@ -41,12 +41,26 @@
 #include <bluetooth/device.h>
 #include <bluetooth/bttransportlayer.h>
 #include <bluetooth/bluetooth.h>
+#include <bluetooth/btpacket.h>
 #include <bluetooth/gpiopin.h>
 #include <platform/rpi/rpi-interrupt-system.h>
+#include <sysconfig.h>
+#include <bluetooth/bth4deframer.h>
 #include <types.h>
+#ifdef BT_HAVE_UART_DMA
+#include <platform/bt_dma.h>
+#endif
 #include <stdlib.h>
 
-#define BT_UART_BUFFER_SIZE (BT_MAX_HCI_EVENT_SIZE)
+#define BT_UART_RX_SPAN_SIZE	32		// FIFO bytes handed to the deframer at once
+#define BT_UART_TX_RING_SIZE	1024		// must be a power of 2
+
+#ifdef BT_HAVE_UART_DMA
+#define BT_UART_DMA_RX_SIZE	1024		// circular DMA receive buffer, in characters
+#define BT_UART_DMA_TX_SIZE	256		// characters moved by one TX transfer
+#define BT_UART_DMA_RX_CHANNEL	4
+#define BT_UART_DMA_TX_CHANNEL	5
+#endif
 
 class CBTUARTTransport : public CDevice
 {
@@ -56,20 +70,43 @@ public:
 
 	boolean Initialize (unsigned nBaudrate = 115200);
 
+	// queue a packet for transmission, returns FALSE if the TX ring
+	// has no room for it (nothing is queued in that case)
 	boolean SendHCICommand (const void *pBuffer, unsigned nLength);
 	boolean SendHCIData (const void *pBuffer, unsigned nLength);
 
+	// TRUE if a packet of nLength bytes would be accepted now
+	boolean IsTxReady (unsigned nLength) const;
+	boolean IsTxIdle (void) const;
+
+	// called from the HCI task, drains the DMA buffers in DMA mode
+	void Process (void);
+
 	void RegisterHCIEventHandler (TBTHCIEventHandler *pHandler);
 	void RegisterHCIDataHandler (TBTHCIDataHandler *pHandler);
+
+	const CBTH4Deframer *GetDeframer (void) const	{ return &m_Deframer; }
+	unsigned GetOverruns (void) const		{ return m_nOverruns; }	// RX FIFO or DMA ring overruns
+	unsigned GetRxErrors (void) const		{ return m_nRxErrors; }	// characters with DR error bits
+
 	void* operator new(size_t T) { return (void *)malloc(T); }
 	void operator delete (void *ptr) { free(ptr); }
 
 private:
-	void Write (u8 nChar);
+	boolean Send (u8 nPacketType, const void *pBuffer, unsigned nLength);
+	unsigned GetTxFree (void) const;
+	void StartTx (void);
+	void FillTxFIFO (void);
 
 	void IRQHandler (void);
 	static void IRQStub (void *pParam);
 
+#ifdef BT_HAVE_UART_DMA
+	boolean InitializeDMA (void);
+	void ProcessDMARx (void);
+	void ProcessDMATx (void);
+#endif
+
 private:
 	CGPIOPin m_GPIO14;
 	CGPIOPin m_GPIO15;
@@ -79,15 +116,27 @@ private:
 	TInterruptSystem *m_pInterruptSystem;
 	boolean m_bIRQConnected;
 
-	TBTHCIEventHandler *m_pEventHandler;
-	TBTHCIDataHandler *m_pDataHandler;
+	CBTH4Deframer m_Deframer;
 
-	u8 m_RxBuffer[BT_UART_BUFFER_SIZE];
-	unsigned m_nRxState;
-	unsigned m_nRxParamLength;
-	u16 m_nRxACLDataLength;
-	unsigned m_nRxInPtr;
-	unsigned m_nRxOutPtr;
+	u8 m_TxRing[BT_UART_TX_RING_SIZE];
+	volatile u32 m_nTxInPtr;		// written by the task
+	volatile u32 m_nTxOutPtr;		// written by the TX IRQ
+	volatile u32 m_nIMSC;			// shadow of ARM_UART0_IMSC
+
+	volatile u32 m_nOverruns;
+	volatile u32 m_nRxErrors;
+
+#ifdef BT_HAVE_UART_DMA
+	// the engine moves whole DR words, one word per character
+	void *m_pDMAMemory;			// control blocks and both word buffers
+	rpi_dma_control_block_t *m_pDMARxCB;
+	rpi_dma_control_block_t *m_pDMATxCB;
+	u32 *m_pDMARxBuffer;
+	u32 *m_pDMATxBuffer;			// staging for the characters in flight
+	unsigned m_nDMARxOutPtr;		// in words
+	boolean m_bDMARxWrapPending;		// wrapped after CS_END was cleared
+	unsigned m_nDMATxLength;		// ring bytes owned by the TX DMA
+#endif
 };
 
 #endif
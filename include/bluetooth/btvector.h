@@ -0,0 +1,171 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth Vector Template
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_btvector_h
+#define _bt_btvector_h
+
+#include <types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Array of trivially copyable elements (normally pointers). The first N
+// elements live inside the object, beyond that the storage doubles on the
+// heap. With bGrow FALSE the capacity is fixed at N, Append fails instead
+// of allocating. Removing swaps the last element into the hole, so the
+// order is only kept by containers which never remove.
+template <typename T, unsigned N, bool bGrow = true>
+class CBTVector
+{
+public:
+	CBTVector (void)
+	:	m_pData (m_Inline),
+		m_nSize (N),
+		m_nCount (0)
+	{
+	}
+
+	~CBTVector (void)
+	{
+		if (m_pData != m_Inline) {
+			free (m_pData);
+		}
+	}
+
+	unsigned GetCount (void) const		{ return m_nCount; }
+
+	T &operator[] (unsigned nIndex)
+	{
+		assert (nIndex < m_nCount);
+		return m_pData[nIndex];
+	}
+
+	const T &operator[] (unsigned nIndex) const
+	{
+		assert (nIndex < m_nCount);
+		return m_pData[nIndex];
+	}
+
+	// FALSE if full (fixed capacity) or out of memory
+	boolean Append (const T &Item)
+	{
+		if (   m_nCount == m_nSize
+		    && !Grow ()) {
+			return FALSE;
+		}
+
+		m_pData[m_nCount++] = Item;
+
+		return TRUE;
+	}
+
+	// the last element takes the place of the removed one
+	void Remove (unsigned nIndex)
+	{
+		assert (nIndex < m_nCount);
+		m_pData[nIndex] = m_pData[--m_nCount];
+	}
+
+	// FALSE if Item is not in the vector
+	boolean RemoveItem (const T &Item)
+	{
+		int nIndex = Find (Item);
+		if (nIndex < 0) {
+			return FALSE;
+		}
+
+		Remove ((unsigned) nIndex);
+
+		return TRUE;
+	}
+
+	void RemoveLast (void)
+	{
+		assert (m_nCount > 0);
+		m_nCount--;
+	}
+
+	void Clear (void)			{ m_nCount = 0; }
+
+	int Find (const T &Item) const		// index or -1
+	{
+		for (unsigned i = 0; i < m_nCount; i++) {
+			if (m_pData[i] == Item) {
+				return (int) i;
+			}
+		}
+
+		return -1;
+	}
+
+	void* operator new(size_t nSize) { return (void *)malloc(nSize); }
+	void operator delete (void *ptr) { free(ptr); }
+
+private:
+	boolean Grow (void)
+	{
+		if (!bGrow) {
+			return FALSE;
+		}
+
+		unsigned nSize = m_nSize * 2;
+		T *pData = (T *) malloc (nSize * sizeof (T));
+		if (pData == 0) {
+			return FALSE;
+		}
+		memcpy (pData, m_pData, m_nCount * sizeof (T));
+
+		if (m_pData != m_Inline) {
+			free (m_pData);
+		}
+		m_pData = pData;
+		m_nSize = nSize;
+
+		return TRUE;
+	}
+
+	CBTVector (const CBTVector &);			// not copyable
+	CBTVector &operator= (const CBTVector &);
+
+private:
+	T *m_pData;				// m_Inline or heap
+	unsigned m_nSize;
+	unsigned m_nCount;
+	T m_Inline[N];
+};
+
+#endif
@@ -39,6 +39,7 @@
 #define _UG_EVENT_H
 
 #include "macros.h"
+#include <stdint.h>
 
 /* Specify platform-dependent integer types here */
 
@@ -40,6 +40,8 @@
 #include <sysconfig.h>
 #ifdef RPI
 #include <platform/rpi/rpi-interrupt-system.h>
+#elif defined BT_HAVE_SIM
+#include <platform/host/host-interrupt-system.h>
 #else
 #endif
 #endif
@@ -0,0 +1,79 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Host Simulation Interrupt System Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THE DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _host_interrupt_system_h
+#define _host_interrupt_system_h
+
+#include <types.h>
+
+//
+// There is no interrupt controller on the host, the simulated controller
+// is polled from the HCI task. The IRQ numbers are kept so that the
+// common code masking ARM_IRQ_UART compiles unchanged.
+//
+#define ARM_IRQ_UART		57
+#define IRQ_LINES		72
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+typedef void TIRQHandler (void *pParam);
+
+typedef struct TInterruptSystem
+{
+	TIRQHandler	*m_apIRQHandler[IRQ_LINES];
+	void		*m_pParam[IRQ_LINES];
+} TInterruptSystem;
+
+void InterruptSystem (TInterruptSystem *pThis);
+void _InterruptSystem (TInterruptSystem *pThis);
+
+int InterruptSystemInitialize (void);
+
+void InterruptSystemConnectIRQ (TInterruptSystem *pThis, unsigned nIRQ, TIRQHandler *pHandler, void *pParam);
+void InterruptSystemDisconnectIRQ (TInterruptSystem *pThis, unsigned nIRQ);
+
+void InterruptSystemEnableIRQ (unsigned nIRQ);
+void InterruptSystemDisableIRQ (unsigned nIRQ);
+
+TInterruptSystem *InterruptSystemGet (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
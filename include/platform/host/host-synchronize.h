@@ -0,0 +1,79 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Host Simulation Synchronization Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THE DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _host_synchronize_h
+#define _host_synchronize_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Execution levels
+//
+#define TASK_LEVEL              0
+#define IRQ_LEVEL               1
+#define FIQ_LEVEL               2
+
+//
+// Interrupt control (nothing to mask on the host)
+//
+#define EnableIRQs()		((void) 0)
+#define DisableIRQs()		((void) 0)
+#define	EnableInterrupts()	EnableIRQs()
+#define	DisableInterrupts()	DisableIRQs()
+
+#define EnableFIQs()		((void) 0)
+#define DisableFIQs()		((void) 0)
+
+//
+// Barriers
+//
+#define DataSyncBarrier()	__sync_synchronize ()
+#define DataMemBarrier() 	__sync_synchronize ()
+
+#define PeripheralEntry()	((void) 0)
+#define PeripheralExit()	((void) 0)
+#define InstructionSyncBarrier() __sync_synchronize ()
+#define InstructionMemBarrier()	__sync_synchronize ()
+
+#define CompilerBarrier()	__asm volatile ("" ::: "memory")
+
+#ifdef __cplusplus
+}
+#endif
+#endif
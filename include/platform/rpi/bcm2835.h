@@ -210,6 +210,7 @@ typedef struct {
 #define ARM_UART0_RIS		(ARM_UART0_BASE + 0x3C)
 #define ARM_UART0_MIS		(ARM_UART0_BASE + 0x40)
 #define ARM_UART0_ICR		(ARM_UART0_BASE + 0x44)
+#define ARM_UART0_DMACR		(ARM_UART0_BASE + 0x48)
 
 typedef struct {
 	__I uint32_t IRQ;			///< 0x00
@@ -0,0 +1,66 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Data Cache Maintenance Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THE DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef RPI_CACHE_H
+#define RPI_CACHE_H
+
+#include <types.h>
+
+//
+// Data cache maintenance by address for DMA buffers (ARMv7/v8 AArch32)
+//
+#define DMA_CACHE_LINE_SIZE	64
+
+static inline void CleanDataCacheRange (uintptr nAddress, u32 nLength)
+{
+	uintptr nEnd = nAddress + nLength;
+	for (nAddress &= ~(DMA_CACHE_LINE_SIZE-1); nAddress < nEnd; nAddress += DMA_CACHE_LINE_SIZE) {
+		asm volatile ("mcr p15, 0, %0, c7, c10, 1" : : "r" (nAddress) : "memory");	// DCCMVAC
+	}
+	asm volatile ("dsb" ::: "memory");
+}
+
+static inline void InvalidateDataCacheRange (uintptr nAddress, u32 nLength)
+{
+	uintptr nEnd = nAddress + nLength;
+	for (nAddress &= ~(DMA_CACHE_LINE_SIZE-1); nAddress < nEnd; nAddress += DMA_CACHE_LINE_SIZE) {
+		asm volatile ("mcr p15, 0, %0, c7, c6, 1" : : "r" (nAddress) : "memory");	// DCIMVAC
+	}
+	asm volatile ("dsb" ::: "memory");
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Cycle Counter Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef RPI_CYCLES_H
+#define RPI_CYCLES_H
+
+#include <types.h>
+
+//
+// CPU cycle counter, the stack runs privileged so no user access enable
+// is needed. Cortex-A7/A53 (RPi 2/3) have the ARMv7 PMU with PMCCNTR,
+// the ARM1176 (RPi 1/Zero) has its own CCNT in the system control block.
+//
+#define RPI_HAVE_CYCLE_COUNTER	1
+
+#if defined (__ARM_ARCH) && __ARM_ARCH >= 7
+
+static inline void RPI_EnableCycleCounter (void)
+{
+	u32 nPMCR;
+	asm volatile ("mrc p15, 0, %0, c9, c12, 0" : "=r" (nPMCR));
+	nPMCR |= 1 << 0;		// E: enable counters
+	nPMCR &= ~(1 << 3);		// D: count every cycle
+	asm volatile ("mcr p15, 0, %0, c9, c12, 0" : : "r" (nPMCR));
+	asm volatile ("mcr p15, 0, %0, c9, c12, 1" : : "r" (1U << 31));	// PMCNTENSET.C
+	asm volatile ("isb" ::: "memory");
+}
+
+static inline u32 RPI_GetCycleCount (void)
+{
+	u32 nCycles;
+	asm volatile ("mrc p15, 0, %0, c9, c13, 0" : "=r" (nCycles));
+	return nCycles;
+}
+
+#else
+
+static inline void RPI_EnableCycleCounter (void)
+{
+	u32 nPMNC;
+	asm volatile ("mrc p15, 0, %0, c15, c12, 0" : "=r" (nPMNC));
+	nPMNC |= 1 << 0;		// E: enable counters
+	nPMNC &= ~(1 << 3);		// D: count every cycle
+	asm volatile ("mcr p15, 0, %0, c15, c12, 0" : : "r" (nPMNC));
+}
+
+static inline u32 RPI_GetCycleCount (void)
+{
+	u32 nCycles;
+	asm volatile ("mrc p15, 0, %0, c15, c12, 1" : "=r" (nCycles));
+	return nCycles;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,104 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal System DMA Header
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THE DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef RPI_DMA_H
+#define RPI_DMA_H
+
+#include <platform/rpi/rpi-base.h>
+#include <types.h>
+
+//
+// DMA channel registers (BCM2835 ARM Peripherals, chapter 4)
+//
+#define ARM_DMA_BASE(chan)	(BCM2835_DMA0_BASE + (chan) * 0x100)
+
+#define ARM_DMA_CS(chan)	(ARM_DMA_BASE (chan) + 0x00)
+#define ARM_DMA_CONBLK_AD(chan)	(ARM_DMA_BASE (chan) + 0x04)
+#define ARM_DMA_TI(chan)	(ARM_DMA_BASE (chan) + 0x08)
+#define ARM_DMA_SOURCE_AD(chan)	(ARM_DMA_BASE (chan) + 0x0C)
+#define ARM_DMA_DEST_AD(chan)	(ARM_DMA_BASE (chan) + 0x10)
+#define ARM_DMA_TXFR_LEN(chan)	(ARM_DMA_BASE (chan) + 0x14)
+#define ARM_DMA_DEBUG(chan)	(ARM_DMA_BASE (chan) + 0x20)
+
+#define ARM_DMA_INT_STATUS	(BCM2835_DMA0_BASE + 0xFE0)
+#define ARM_DMA_ENABLE		(BCM2835_DMA0_BASE + 0xFF0)
+
+#define CS_RESET		(1 << 31)
+#define CS_ABORT		(1 << 30)
+#define CS_WAIT_FOR_OUTSTANDING_WRITES (1 << 28)
+#define CS_PANIC_PRIORITY_SHIFT	20
+#define CS_PRIORITY_SHIFT	16
+#define CS_ERROR		(1 << 8)
+#define CS_INT			(1 << 2)
+#define CS_END			(1 << 1)
+#define CS_ACTIVE		(1 << 0)
+
+#define TI_PERMAP_SHIFT		16
+#define TI_BURST_LENGTH_SHIFT	12
+#define TI_SRC_IGNORE		(1 << 11)
+#define TI_SRC_DREQ		(1 << 10)
+#define TI_SRC_WIDTH		(1 << 9)
+#define TI_SRC_INC		(1 << 8)
+#define TI_DEST_IGNORE		(1 << 7)
+#define TI_DEST_DREQ		(1 << 6)
+#define TI_DEST_WIDTH		(1 << 5)
+#define TI_DEST_INC		(1 << 4)
+#define TI_WAIT_RESP		(1 << 3)
+#define TI_TDMODE		(1 << 1)
+#define TI_INTEN		(1 << 0)
+
+#define DREQ_SOURCE_UART_TX	12
+#define DREQ_SOURCE_UART_RX	14
+
+// Bus address of a peripheral register (see BUS_ADDRESS for memory)
+#define BUS_PERIPHERAL_BASE	0x7E000000
+#define BUS_PERIPHERAL(addr)	((addr) - BCM2835_PERI_BASE + BUS_PERIPHERAL_BASE)
+
+#ifndef __ASSEMBLY__
+// control block, must be 32 byte aligned
+typedef struct {
+	rpi_reg_rw_t nTransferInformation;
+	rpi_reg_rw_t nSourceAddress;
+	rpi_reg_rw_t nDestinationAddress;
+	rpi_reg_rw_t nTransferLength;
+	rpi_reg_rw_t n2DModeStride;
+	rpi_reg_rw_t nNextControlBlockAddress;
+	rpi_reg_rw_t nReserved[2];
+} rpi_dma_control_block_t;
+#endif
+
+#endif
@@ -96,5 +96,9 @@
 #define INT_DCDM		(1 << 2)
 #define INT_CTSM		(1 << 1)
 
+#define DMACR_DMAONERR		(1 << 2)
+#define DMACR_TXDMAE		(1 << 1)
+#define DMACR_RXDMAE		(1 << 0)
+
 
 #endif
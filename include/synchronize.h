@@ -40,5 +40,7 @@
 #include <blueberry_config.h>
 #ifdef RPI
 #include <platform/rpi/rpi-synchronize.h>
+#elif defined BT_HAVE_SIM
+#include <platform/host/host-synchronize.h>
 #endif
 #endif /* _SYNCHRONIZE_H_ */
@@ -41,14 +41,14 @@ typedef unsigned short		u16;
 typedef unsigned int		u32;
 typedef unsigned long long	u64;
 
-typedef int			intptr;
-typedef unsigned int		uintptr;
+typedef __INTPTR_TYPE__		intptr;
+typedef __UINTPTR_TYPE__	uintptr;
 
 typedef int		boolean;
 #define FALSE		0
 #define TRUE		1
 
-typedef unsigned int	size_t;
-typedef int		ssize_t;
+typedef __SIZE_TYPE__		size_t;
+typedef __PTRDIFF_TYPE__	ssize_t;
 
 #endif
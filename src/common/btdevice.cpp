@@ -98,6 +98,11 @@ bool CBTDevice::IsConnecting (void)
 	return (m_tState == BT_DEVICE_CONNECTING);
 }
 
+bool CBTDevice::IsConnected (void)
+{
+	return (m_tState == BT_DEVICE_CONNECTED);
+}
+
 const u8* CBTDevice::GetBDAddress (void) const
 {
 	return m_pConnection->BDAddr;
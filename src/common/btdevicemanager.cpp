@@ -41,6 +41,7 @@
 #include <bluetooth/bcmvendor.h>
 #include <bluetooth/btcommand.h>
 #include <bluetooth/btevent.h>
+#include <bluetooth/btstats.h>
 #include <logger.h>
 #include <assert.h>
 #include <task.h>
@@ -57,9 +58,11 @@ CBTDeviceManager::CBTDeviceManager (
 :	m_pHCILayer (pHCILayer),
 	m_pEventQueue (pEventQueue),
 	m_nClassOfDevice (nClassOfDevice),
-	m_pConnection (NULL),
+	m_nLinkKeyIn (0),
+	m_nLinkKeyOut (0),
 	m_State (BTDeviceStateUnknown),
-	m_pBuffer (0)
+	m_pBuffer (0),
+	m_FirmwareLoader (pHCILayer)
 {
 	memset (m_LocalName, 0, sizeof m_LocalName);
 	strncpy ((char *) m_LocalName, pLocalName, sizeof m_LocalName);
@@ -82,27 +85,24 @@ boolean CBTDeviceManager::Initialize (void)
 	CBTHCIEventCommandStatus e2;
 	m_pBuffer = (u8 *)malloc(BT_MAX_HCI_EVENT_SIZE);
 	assert (m_pBuffer != 0);
-	CBTHCICommand Cmd(OP_CODE_RESET);
-	m_pHCILayer->SendCommand (&Cmd, sizeof Cmd);
+	if (!m_FirmwareLoader.Initialize ()) {
+		return FALSE;
+	}
+	m_pHCILayer->SendCommand<TBTHCIResetCommand> ();
 
 	m_State = BTDeviceStateResetPending;
 
 	return TRUE;
 }
 
-bool CBTDeviceManager::SendHCICommand(const void* pData, unsigned nLength)
+bool CBTDeviceManager::SendHCICommand(u16 nOpCode, const void *pParameters, u8 nLength)
 {
-	if (pData && nLength) {
-		m_pHCILayer->SendCommand (pData, nLength);
-		return false;
-	}
-
-	return true;
+	return !m_pHCILayer->SendCommand (nOpCode, pParameters, nLength);
 }
 
-void CBTDeviceManager::SetHCICommandPackets (unsigned nDataPackets) {
+void CBTDeviceManager::SetHCICommandPackets (unsigned nCommandPackets, u16 nOpCode) {
 
-	m_pHCILayer->SetCommandPackets(nDataPackets);
+	m_pHCILayer->SetCommandPackets(nCommandPackets, nOpCode);
 	return;
 }
 
@@ -112,17 +112,35 @@ void CBTDeviceManager::Process (void)
 	assert (m_pEventQueue != 0);
 	assert (m_pBuffer != 0);
 
+	BT_STATS_START (nStart);
+
 	unsigned nLength;
 	while ((nLength = m_pEventQueue->Dequeue (m_pBuffer)) > 0) {
 		assert (nLength >= sizeof (CBTHCIEvent));
 		CBTHCIEvent* pHeader = (CBTHCIEvent*) m_pBuffer;
 		pHeader->Process(this, nLength);
 	}
+
+	if (   (   m_State == BTDeviceStateWriteRAMPending
+		|| m_State == BTDeviceStateLaunchRAMPending)
+	    && !m_FirmwareLoader.Process ()) {
+		m_State = BTDeviceStateFailed;
+	}
+
+	BT_STATS_RECORD (BTStatsDeviceManagerProcess, nStart);
+}
+
+boolean CBTDeviceManager::PushLinkKeyRequest (CBTConnection* pConnection)
+{
+	if (m_nLinkKeyIn - m_nLinkKeyOut == BT_LINK_KEY_REQUESTS) return FALSE;
+	m_LinkKeyRequest[m_nLinkKeyIn++ % BT_LINK_KEY_REQUESTS] = pConnection;
+	return TRUE;
 }
 
-void CBTDeviceManager::SetConnection (CBTConnection* pConnection)
+CBTConnection *CBTDeviceManager::PopLinkKeyRequest (void)
 {
-	m_pConnection = pConnection;
+	if (m_nLinkKeyIn == m_nLinkKeyOut) return 0;
+	return m_LinkKeyRequest[m_nLinkKeyOut++ % BT_LINK_KEY_REQUESTS];
 }
 
 u8* CBTDeviceManager::GetBDAddr (void)
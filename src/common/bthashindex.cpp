@@ -0,0 +1,182 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth Hash Index Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/bthashindex.h>
+#include <bluetooth/bluetooth.h>
+#include <logger.h>
+#include <assert.h>
+#include <string.h>
+
+#define BT_HASH_MULTIPLIER	0x9E3779B97F4A7C15ULL	// 2^64 / golden ratio
+
+CBTHashIndex::CBTHashIndex (unsigned nInitialSize)
+:	m_pSlots (0),
+	m_nSize (nInitialSize),
+	m_nShift (64),
+	m_nCount (0)
+{
+	assert (m_nSize >= 2);
+	assert ((m_nSize & (m_nSize - 1)) == 0);
+
+	for (unsigned n = m_nSize; n > 1; n >>= 1) {
+		m_nShift--;
+	}
+
+	m_pSlots = (TBTHashSlot *) malloc (sizeof (TBTHashSlot) * m_nSize);
+	assert (m_pSlots != 0);
+	memset (m_pSlots, 0, sizeof (TBTHashSlot) * m_nSize);
+}
+
+CBTHashIndex::~CBTHashIndex (void)
+{
+	free (m_pSlots);
+	m_pSlots = 0;
+}
+
+boolean CBTHashIndex::Insert (u64 nKey, void *pValue)
+{
+	assert (pValue != 0);
+
+	if ((m_nCount + 1) * 4 > m_nSize * 3 && !Grow ()) {
+		LOG_DEBUG ("Hash index full\r\n");
+		return FALSE;
+	}
+
+	unsigned nMask = m_nSize - 1;
+	for (unsigned i = Hash (nKey); ; i = (i + 1) & nMask) {
+		TBTHashSlot *pSlot = &m_pSlots[i];
+		if (pSlot->pValue == 0) {
+			pSlot->nKey = nKey;
+			pSlot->pValue = pValue;
+			m_nCount++;
+
+			return TRUE;
+		}
+
+		if (pSlot->nKey == nKey) {
+			pSlot->pValue = pValue;
+
+			return TRUE;
+		}
+	}
+}
+
+void CBTHashIndex::Remove (u64 nKey, const void *pValue)
+{
+	unsigned nMask = m_nSize - 1;
+	unsigned i = Hash (nKey);
+	while (m_pSlots[i].pValue != 0 && m_pSlots[i].nKey != nKey) {
+		i = (i + 1) & nMask;
+	}
+
+	if (m_pSlots[i].pValue == 0) {
+		return;				// not found
+	}
+	if (pValue != 0 && m_pSlots[i].pValue != pValue) {
+		return;				// the key was taken over meanwhile
+	}
+
+	m_pSlots[i].pValue = 0;
+	m_nCount--;
+
+	// move back entries which would not be found across the new gap
+	for (unsigned j = (i + 1) & nMask; m_pSlots[j].pValue != 0; j = (j + 1) & nMask) {
+		unsigned k = Hash (m_pSlots[j].nKey);
+		boolean bStays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+		if (!bStays) {
+			m_pSlots[i] = m_pSlots[j];
+			m_pSlots[j].pValue = 0;
+			i = j;
+		}
+	}
+}
+
+void *CBTHashIndex::Lookup (u64 nKey) const
+{
+	unsigned nMask = m_nSize - 1;
+	for (unsigned i = Hash (nKey); m_pSlots[i].pValue != 0; i = (i + 1) & nMask) {
+		if (m_pSlots[i].nKey == nKey) {
+			return m_pSlots[i].pValue;
+		}
+	}
+
+	return 0;
+}
+
+u64 CBTHashIndex::BDAddrKey (const u8 *pBDAddr)
+{
+	assert (pBDAddr != 0);
+
+	u64 nKey = 0;
+	for (unsigned i = 0; i < BT_BD_ADDR_SIZE; i++) {
+		nKey |= (u64) pBDAddr[i] << (i * 8);
+	}
+
+	return nKey;
+}
+
+unsigned CBTHashIndex::Hash (u64 nKey) const
+{
+	return (unsigned) ((nKey * BT_HASH_MULTIPLIER) >> m_nShift);
+}
+
+boolean CBTHashIndex::Grow (void)
+{
+	TBTHashSlot *pNewSlots = (TBTHashSlot *) malloc (sizeof (TBTHashSlot) * m_nSize * 2);
+	if (pNewSlots == 0) {
+		return FALSE;
+	}
+	memset (pNewSlots, 0, sizeof (TBTHashSlot) * m_nSize * 2);
+
+	TBTHashSlot *pOldSlots = m_pSlots;
+	unsigned nOldSize = m_nSize;
+
+	m_pSlots = pNewSlots;
+	m_nSize *= 2;
+	m_nShift--;
+	m_nCount = 0;
+
+	for (unsigned i = 0; i < nOldSize; i++) {
+		if (pOldSlots[i].pValue != 0) {
+			Insert (pOldSlots[i].nKey, pOldSlots[i].pValue);
+		}
+	}
+
+	free (pOldSlots);
+
+	return TRUE;
+}
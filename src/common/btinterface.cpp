@@ -89,6 +89,14 @@ pBT_device_map BT_Listen(void *ptr, unsigned sec)
     return head;
 }
 
+bool BT_GetStats(void *ptr, pBT_stats pStats)
+{
+	// FALSE (and all zero) if the stack was built without BT_HAVE_STATS
+	CBTSubSystem *pBluetooth = (CBTSubSystem *)ptr;
+	if (!pBluetooth || !pStats) return false;
+	return pBluetooth->GetStats(pStats);
+}
+
 pBT_device_map BT_Check(void *ptr)
 {
     pBT_device_map head = NULL, tail = NULL, tmp = NULL;
@@ -131,7 +139,7 @@ pBT_device_descriptor BT_Accept(void *ptr, void *paddr)
     CBTDevice* pdevice = (CBTDevice *)pbluetooth->Accept(paddr);
 
     if (pdevice) {
-        LOG_DEBUG("Bluetooth device found 0x%08X\r\n", (int)pdevice);
+        LOG_DEBUG("Bluetooth device found 0x%08X\r\n", (unsigned) (uintptr) pdevice);
         pdesc = (pBT_device_descriptor)malloc(sizeof(tBT_device_descriptor));
         if (pdesc) {
             pdesc->device = pdevice;
@@ -149,6 +157,25 @@ bool BT_GetEvent(void *device, void *pBuffer, unsigned *pLength)
 	if (pDevice) flag = pDevice->ReceiveEvent(pBuffer, pLength);
 	return flag;
 }
+
+void BT_SetCoalescing(void *device, bool on)
+{
+	// sum moves and scrolls until BT_GetEvent, e.g. once per frame
+	CBTHIDDevice *pDevice = (CBTHIDDevice *)device;
+	if (pDevice) pDevice->SetCoalescing(on ? TRUE : FALSE);
+}
+
+unsigned BT_GetLatency(char *pBuffer, unsigned nSize)
+{
+	// JSON summary of the latency probes, empty if not compiled in
+	if (!pBuffer || !nSize) return 0;
+#ifdef BT_HAVE_LATENCY
+	return CBTLatency::WriteJSON(pBuffer, nSize);
+#else
+	pBuffer[0] = '\0';
+	return 0;
+#endif
+}
 #ifdef __cplusplus
 }
 #endif
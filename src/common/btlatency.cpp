@@ -0,0 +1,160 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth Latency Probe Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btlatency.h>
+
+#ifdef BT_HAVE_LATENCY
+
+#include <task.h>
+#include <assert.h>
+#include <stdio.h>
+
+static const char *ProbeName[BTLatencyUnknown] =
+{
+	"hid_report",
+	"l2cap_write",
+	"l2cap_read",
+	"startup",
+	"connect"
+};
+
+volatile u32 CBTLatency::s_nSamples[BTLatencyUnknown];
+volatile u32 CBTLatency::s_nMax[BTLatencyUnknown];
+volatile u32 CBTLatency::s_nTotal[BTLatencyUnknown];
+volatile u32 CBTLatency::s_nBytes[BTLatencyUnknown];
+u32 CBTLatency::s_Ring[BTLatencyUnknown][BT_LATENCY_SAMPLES];
+
+void CBTLatency::Record (TBTLatencyProbe Probe, unsigned nTicks, unsigned nBytes)
+{
+	assert (Probe < BTLatencyUnknown);
+
+	u32 nIndex = __atomic_fetch_add (&s_nSamples[Probe], 1, __ATOMIC_RELAXED);
+	s_Ring[Probe][nIndex % BT_LATENCY_SAMPLES] = nTicks;
+
+	u32 nMax = __atomic_load_n (&s_nMax[Probe], __ATOMIC_RELAXED);
+	while (   nTicks > nMax
+	       && !__atomic_compare_exchange_n (&s_nMax[Probe], &nMax, nTicks, TRUE,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		// nMax was reloaded
+	}
+
+	__atomic_add_fetch (&s_nTotal[Probe], nTicks, __ATOMIC_RELAXED);
+	__atomic_add_fetch (&s_nBytes[Probe], nBytes, __ATOMIC_RELAXED);
+}
+
+void CBTLatency::RecordSince (TBTLatencyProbe Probe, unsigned nStartTicks, unsigned nBytes)
+{
+	Record (Probe, getClockTicks () - nStartTicks, nBytes);
+}
+
+void CBTLatency::GetSummary (TBTLatencyProbe Probe, TBTLatencySummary *pSummary)
+{
+	assert (Probe < BTLatencyUnknown);
+	assert (pSummary != 0);
+
+	pSummary->nSamples = s_nSamples[Probe];
+	pSummary->nMax = s_nMax[Probe];
+	pSummary->nTotal = s_nTotal[Probe];
+	pSummary->nBytes = s_nBytes[Probe];
+	pSummary->nP50 = 0;
+	pSummary->nP99 = 0;
+
+	unsigned nCount = pSummary->nSamples;
+	if (nCount > BT_LATENCY_SAMPLES) {
+		nCount = BT_LATENCY_SAMPLES;
+	}
+	if (nCount == 0) {
+		return;
+	}
+
+	// insertion sort on a snapshot, the ring is small
+	u32 Sorted[BT_LATENCY_SAMPLES];
+	for (unsigned i = 0; i < nCount; i++) {
+		u32 nValue = s_Ring[Probe][i];
+		unsigned j = i;
+		for (; j > 0 && Sorted[j-1] > nValue; j--) {
+			Sorted[j] = Sorted[j-1];
+		}
+		Sorted[j] = nValue;
+	}
+
+	pSummary->nP50 = Sorted[(nCount-1) * 50 / 100];
+	pSummary->nP99 = Sorted[(nCount-1) * 99 / 100];
+}
+
+unsigned CBTLatency::WriteJSON (char *pBuffer, unsigned nSize)
+{
+	assert (pBuffer != 0);
+	assert (nSize > 0);
+
+	unsigned nLength = 0;
+	for (unsigned i = 0; i <= BTLatencyUnknown; i++) {
+		int nResult;
+		if (i < BTLatencyUnknown) {
+			TBTLatencySummary Summary;
+			GetSummary ((TBTLatencyProbe) i, &Summary);
+
+			nResult = snprintf (pBuffer+nLength, nSize-nLength,
+				"%s\"%s\":{\"samples\":%u,\"p50_us\":%u,\"p99_us\":%u,"
+				"\"max_us\":%u,\"total_us\":%u,\"bytes\":%u}",
+				i == 0 ? "{" : ",", ProbeName[i], Summary.nSamples,
+				Summary.nP50, Summary.nP99, Summary.nMax,
+				Summary.nTotal, Summary.nBytes);
+		} else {
+			nResult = snprintf (pBuffer+nLength, nSize-nLength, "}");
+		}
+
+		if (nResult < 0 || nLength + nResult >= nSize) {
+			return nSize - 1;		// truncated
+		}
+		nLength += nResult;
+	}
+
+	return nLength;
+}
+
+void CBTLatency::Reset (void)
+{
+	for (unsigned i = 0; i < BTLatencyUnknown; i++) {
+		s_nSamples[i] = 0;
+		s_nMax[i] = 0;
+		s_nTotal[i] = 0;
+		s_nBytes[i] = 0;
+	}
+}
+
+#endif
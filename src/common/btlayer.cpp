@@ -42,7 +42,8 @@
 #include <string.h>
 
 CBTLayer::CBTLayer ()
-:	m_pWaitTask (0)
+:	m_bState (FALSE),
+	m_pWaitTask (0)
 {
 }
 
@@ -0,0 +1,248 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth Packet Buffer Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btpacket.h>
+#include <platform/bt_interrupt-system.h>
+#include <mutex.h>
+#include <task.h>
+#include <assert.h>
+#include <stdlib.h>
+
+CBTPacketPool *CBTPacketPool::s_pThis = 0;
+
+volatile u32 CBTPacketPool::s_nCopies[BTCopyLayerUnknown];
+volatile u32 CBTPacketPool::s_nCopyBytes[BTCopyLayerUnknown];
+
+u8 *CBTPacket::Push (unsigned nLength)
+{
+	assert (nLength <= m_nOffset);
+	m_nOffset -= nLength;
+	m_nLength += nLength;
+
+	return GetData ();
+}
+
+u8 *CBTPacket::Pull (unsigned nLength)
+{
+	assert (nLength <= m_nLength);
+	m_nOffset += nLength;
+	m_nLength -= nLength;
+
+	return GetData ();
+}
+
+u8 *CBTPacket::Put (unsigned nLength)
+{
+	assert (nLength <= GetTailroom ());
+	u8 *pTail = GetData () + m_nLength;
+	m_nLength += nLength;
+
+	return pTail;
+}
+
+void CBTPacket::Trim (unsigned nLength)
+{
+	if (nLength < m_nLength) m_nLength = nLength;
+}
+
+void CBTPacket::AddRef (void)
+{
+	assert (m_nRefCount > 0);
+	__atomic_add_fetch (&m_nRefCount, 1, __ATOMIC_RELAXED);
+}
+
+void CBTPacket::Release (void)
+{
+	assert (m_nRefCount > 0);
+	if (__atomic_sub_fetch (&m_nRefCount, 1, __ATOMIC_ACQ_REL) == 0) {
+		assert (CBTPacketPool::Get () != 0);
+		CBTPacketPool::Get ()->Free (this);
+	}
+}
+
+CBTPacketPool::CBTPacketPool (unsigned nPackets)
+:	m_pPackets (0),
+	m_pFreeList (0),
+	m_nFree (0),
+	m_nAllocFailures (0),
+	m_nLargeBytes (0)
+{
+	assert (s_pThis == 0);
+	s_pThis = this;
+
+	m_SpinLock = get_mutex(MUTEX_BT);
+
+	m_pPackets = (CBTPacket *)malloc(sizeof(CBTPacket) * nPackets);
+	assert (m_pPackets != 0);
+	if (m_pPackets == 0) return;
+
+	for (unsigned i = 0; i < nPackets; i++) {
+		m_pPackets[i].m_nRefCount = 0;
+		m_pPackets[i].m_nSize = BT_PACKET_DATA_SIZE;
+		m_pPackets[i].m_pNext = m_pFreeList;
+		m_pFreeList = &m_pPackets[i];
+	}
+	m_nFree = nPackets;
+
+	ResetCopies ();
+}
+
+CBTPacketPool::~CBTPacketPool (void)
+{
+	free (m_pPackets);
+	m_pPackets = 0;
+	m_pFreeList = 0;
+
+	s_pThis = 0;
+}
+
+CBTPacket *CBTPacketPool::Alloc (void)
+{
+	InterruptSystemDisableIRQ(ARM_IRQ_UART);
+	spin_lock(m_SpinLock);
+
+	CBTPacket *pPacket = m_pFreeList;
+	if (pPacket != 0) {
+		m_pFreeList = pPacket->m_pNext;
+		m_nFree--;
+	} else {
+		m_nAllocFailures++;
+	}
+
+	spin_unlock(m_SpinLock);
+	InterruptSystemEnableIRQ(ARM_IRQ_UART);
+
+	if (pPacket != 0) {
+		pPacket->m_pNext = 0;
+		pPacket->m_nRefCount = 1;
+		pPacket->m_nOffset = BT_PACKET_HEADROOM;
+		pPacket->m_nLength = 0;
+#ifdef BT_HAVE_LATENCY
+		pPacket->m_nTimestamp = getClockTicks ();
+#endif
+	}
+
+	return pPacket;
+}
+
+CBTPacket *CBTPacketPool::AllocLarge (unsigned nDataSize)
+{
+	unsigned nSize = BT_PACKET_HEADROOM + nDataSize + BT_PACKET_TAILROOM;
+	if (nSize <= BT_PACKET_DATA_SIZE) {
+		return Alloc ();
+	}
+
+	if (m_nLargeBytes + nSize > BT_PACKET_LARGE_MEMORY) {
+		m_nAllocFailures++;
+		return 0;
+	}
+
+	// the buffer is the last member, it is extended beyond its declared size
+	CBTPacket *pPacket = (CBTPacket *) malloc (sizeof (CBTPacket) - BT_PACKET_DATA_SIZE + nSize);
+	if (pPacket == 0) {
+		m_nAllocFailures++;
+		return 0;
+	}
+	m_nLargeBytes += nSize;
+
+	pPacket->m_pNext = 0;
+	pPacket->m_nRefCount = 1;
+	pPacket->m_nOffset = BT_PACKET_HEADROOM;
+	pPacket->m_nLength = 0;
+	pPacket->m_nSize = nSize;
+#ifdef BT_HAVE_LATENCY
+	pPacket->m_nTimestamp = getClockTicks ();
+#endif
+
+	return pPacket;
+}
+
+void CBTPacketPool::Free (CBTPacket *pPacket)
+{
+	assert (pPacket != 0);
+	assert (pPacket->m_nRefCount == 0);
+
+	if (pPacket->m_nSize > BT_PACKET_DATA_SIZE) {
+		assert (m_nLargeBytes >= pPacket->m_nSize);
+		m_nLargeBytes -= pPacket->m_nSize;
+		free (pPacket);
+
+		return;
+	}
+
+	InterruptSystemDisableIRQ(ARM_IRQ_UART);
+	spin_lock(m_SpinLock);
+
+	pPacket->m_pNext = m_pFreeList;
+	m_pFreeList = pPacket;
+	m_nFree++;
+
+	spin_unlock(m_SpinLock);
+	InterruptSystemEnableIRQ(ARM_IRQ_UART);
+}
+
+void CBTPacketPool::CountCopy (TBTCopyLayer Layer, unsigned nBytes)
+{
+	assert (Layer < BTCopyLayerUnknown);
+	__atomic_add_fetch (&s_nCopies[Layer], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch (&s_nCopyBytes[Layer], nBytes, __ATOMIC_RELAXED);
+}
+
+unsigned CBTPacketPool::GetCopies (TBTCopyLayer Layer)
+{
+	assert (Layer < BTCopyLayerUnknown);
+	return s_nCopies[Layer];
+}
+
+unsigned CBTPacketPool::GetCopyBytes (TBTCopyLayer Layer)
+{
+	assert (Layer < BTCopyLayerUnknown);
+	return s_nCopyBytes[Layer];
+}
+
+void CBTPacketPool::ResetCopies (void)
+{
+	for (unsigned i = 0; i < BTCopyLayerUnknown; i++) {
+		s_nCopies[i] = 0;
+		s_nCopyBytes[i] = 0;
+	}
+}
+
+CBTPacketPool *CBTPacketPool::Get (void)
+{
+	return s_pThis;
+}
@@ -45,18 +45,40 @@
 
 struct TBTQueueEntry
 {
-	volatile TBTQueueEntry	*pPrev;
-	volatile TBTQueueEntry	*pNext;
 	unsigned		 nLength;
-	unsigned char		 Buffer[BT_MAX_DATA_SIZE];
 	void			*pParam;
 };
 
-CBTQueue::CBTQueue (void)
-:	m_pFirst (0),
-	m_pLast (0)
+// the slot data follows the word aligned entry header
+#define BT_QUEUE_ENTRY_DATA	((sizeof (TBTQueueEntry) + 3) & ~3)
+
+static inline unsigned char *EntryData (TBTQueueEntry *pEntry)
 {
-	m_nCount = 0;
+	return (unsigned char *) pEntry + BT_QUEUE_ENTRY_DATA;
+}
+
+CBTQueue::CBTQueue (unsigned nCapacity, unsigned nSlotSize)
+:	m_bInit (false),
+	m_pSlots (0),
+	m_nCapacity (nCapacity),
+	m_nSlotSize (nSlotSize),
+	m_nHead (0),
+	m_nTail (0),
+	m_nCount (0),
+	m_nOverflows (0),
+	m_nDrops (0),
+	m_nHighWater (0)
+{
+	assert (nCapacity > 0);
+	assert (nSlotSize > 0);
+
+	// keep every entry word aligned
+	m_nEntrySize = (BT_QUEUE_ENTRY_DATA + nSlotSize + 3) & ~3;
+
+	m_pSlots = (u8 *)malloc(m_nEntrySize * nCapacity);
+	assert (m_pSlots != 0);
+	if (m_pSlots == 0) return;
+
 	m_SpinLock = get_mutex(MUTEX_BT);
 	m_bInit = true;
 }
@@ -64,11 +86,15 @@ CBTQueue::CBTQueue (void)
 CBTQueue::~CBTQueue (void)
 {
 	Flush ();
+
+	m_bInit = false;
+	free (m_pSlots);
+	m_pSlots = 0;
 }
 
 boolean CBTQueue::IsEmpty (void) const
 {
-	return m_pFirst == 0 ? TRUE : FALSE;
+	return m_nCount == 0 ? TRUE : FALSE;
 }
 
 void CBTQueue::Flush (void)
@@ -76,100 +102,309 @@ void CBTQueue::Flush (void)
 	if (!m_bInit) return;	
 	InterruptSystemDisableIRQ(ARM_IRQ_UART);
 	spin_lock(m_SpinLock);
-	while (m_pFirst != 0) {
-
-		volatile TBTQueueEntry *pEntry = m_pFirst;
-		assert (pEntry != 0);
-
-		m_pFirst = pEntry->pNext;
-		if (m_pFirst != 0)
-			m_pFirst->pPrev = 0;
-		else {
-			assert (m_pLast == pEntry);
-			m_pLast = 0;
-		}
-
-		free( (void *)pEntry);
-	}
+	m_nHead = 0;
+	m_nTail = 0;
+	m_nCount = 0;
 	spin_unlock(m_SpinLock);
 	InterruptSystemEnableIRQ(ARM_IRQ_UART);
 }
 	
-void CBTQueue::Enqueue (const void *pBuffer, unsigned nLength, void *pParam)
+boolean CBTQueue::Enqueue (const void *pBuffer, unsigned nLength, void *pParam)
 {
-	if (!m_bInit) return;	
-	TBTQueueEntry *pEntry = (TBTQueueEntry *)malloc(sizeof(TBTQueueEntry));
-	assert (pEntry != 0);
+	assert (pBuffer != 0);
+
+	TBTScatter Entry = {pBuffer, nLength};
+
+	return Enqueue (&Entry, 1, pParam);
+}
+
+boolean CBTQueue::Enqueue (const TBTScatter *pList, unsigned nEntries, void *pParam)
+{
+	if (!m_bInit) return FALSE;
 
+	assert (pList != 0);
+
+	unsigned nLength = 0;
+	for (unsigned i = 0; i < nEntries; i++) {
+		assert (pList[i].pData != 0 || pList[i].nLength == 0);
+		nLength += pList[i].nLength;
+	}
 	assert (nLength > 0);
-	assert (nLength <= BT_MAX_DATA_SIZE);
-	pEntry->nLength = nLength;
 
-	assert (pBuffer != 0);
+	if (nLength > m_nSlotSize) {
+		m_nDrops++;
+		return FALSE;
+	}
 
-	if (pEntry) {
-		memcpy (pEntry->Buffer, pBuffer, nLength);
-		pEntry->pParam = pParam;
+	boolean bResult = FALSE;
 
-		InterruptSystemDisableIRQ(ARM_IRQ_UART);
-		spin_lock(m_SpinLock);
+	InterruptSystemDisableIRQ(ARM_IRQ_UART);
+	spin_lock(m_SpinLock);
 
-		pEntry->pPrev = m_pLast;
-		pEntry->pNext = 0;
+	if (m_nCount == m_nCapacity) {
+		m_nOverflows++;
+	} else {
+		TBTQueueEntry *pEntry = GetEntry (m_nTail);
 
-		if (m_pFirst == 0)
-			m_pFirst = pEntry;
-		else {
-			assert (m_pLast != 0);
-			assert (m_pLast->pNext == 0);
-			m_pLast->pNext = pEntry;
+		pEntry->nLength = nLength;
+		pEntry->pParam = pParam;
+
+		unsigned char *pTo = EntryData (pEntry);
+		for (unsigned i = 0; i < nEntries; i++) {
+			memcpy (pTo, pList[i].pData, pList[i].nLength);
+			pTo += pList[i].nLength;
 		}
-		m_pLast = pEntry;
 
-		spin_unlock(m_SpinLock);
-		InterruptSystemEnableIRQ(ARM_IRQ_UART);
+		if (++m_nTail == m_nCapacity) m_nTail = 0;
+		m_nCount++;
+#ifdef BT_HAVE_STATS
+		if (m_nCount > m_nHighWater) m_nHighWater = m_nCount;
+#endif
+		bResult = TRUE;
 	}
+
+	spin_unlock(m_SpinLock);
+	InterruptSystemEnableIRQ(ARM_IRQ_UART);
+
+	return bResult;
 }
 
 unsigned CBTQueue::Dequeue (void *pBuffer, void **ppParam)
+{
+	return Dequeue (pBuffer, m_nSlotSize, ppParam);
+}
+
+unsigned CBTQueue::Dequeue (void *pBuffer, unsigned nSize, void **ppParam)
 {
 	unsigned nResult = 0;
 
 	if (!m_bInit) return nResult;
-	if (!m_pFirst) return nResult;
+	if (m_nCount == 0) return nResult;
 	InterruptSystemDisableIRQ(ARM_IRQ_UART);
 	spin_lock(m_SpinLock);
-	if (m_pFirst != 0) {
-
-		volatile TBTQueueEntry *pEntry = m_pFirst;
-		assert (pEntry != 0);
+	if (m_nCount != 0) {
 
-		m_pFirst = pEntry->pNext;
-		if (m_pFirst != 0)
-			m_pFirst->pPrev = 0;
-		else {
-			assert (m_pLast == pEntry);
-			m_pLast = 0;
-		}
-
-		spin_unlock(m_SpinLock);
-		InterruptSystemEnableIRQ(ARM_IRQ_UART);
+		TBTQueueEntry *pEntry = GetEntry (m_nHead);
 
 		nResult = pEntry->nLength;
 		assert (nResult > 0);
-		assert (nResult <= BT_MAX_DATA_SIZE);
+		assert (nResult <= m_nSlotSize);
 
-		memcpy (pBuffer, (const void *) pEntry->Buffer, nResult);
+		memcpy (pBuffer, EntryData (pEntry), nResult < nSize ? nResult : nSize);
 
 		if (ppParam != 0) {
 			*ppParam = pEntry->pParam;
 		}
 
-		free( (void *)pEntry);
-	} else {
+		if (++m_nHead == m_nCapacity) m_nHead = 0;
+		m_nCount--;
+	}
+	spin_unlock(m_SpinLock);
+	InterruptSystemEnableIRQ(ARM_IRQ_UART);
+
+	return nResult;
+}
+
+void *CBTQueue::BeginEnqueue (unsigned nLength)
+{
+	if (!m_bInit) return 0;
+
+	assert (nLength > 0);
+	if (nLength > m_nSlotSize) {
+		m_nDrops++;
+		return 0;
+	}
+
+	InterruptSystemDisableIRQ(ARM_IRQ_UART);
+	spin_lock(m_SpinLock);
+
+	if (m_nCount == m_nCapacity) {
+		m_nOverflows++;
+
 		spin_unlock(m_SpinLock);
 		InterruptSystemEnableIRQ(ARM_IRQ_UART);
+
+		return 0;
 	}
 
+	return EntryData (GetEntry (m_nTail));
+}
+
+void CBTQueue::EndEnqueue (unsigned nLength, void *pParam)
+{
+	assert (nLength > 0);
+	assert (nLength <= m_nSlotSize);
+
+	TBTQueueEntry *pEntry = GetEntry (m_nTail);
+	pEntry->nLength = nLength;
+	pEntry->pParam = pParam;
+
+	if (++m_nTail == m_nCapacity) m_nTail = 0;
+	m_nCount++;
+#ifdef BT_HAVE_STATS
+	if (m_nCount > m_nHighWater) m_nHighWater = m_nCount;
+#endif
+
+	spin_unlock(m_SpinLock);
+	InterruptSystemEnableIRQ(ARM_IRQ_UART);
+}
+
+const void *CBTQueue::Peek (unsigned *pLength, void **ppParam) const
+{
+	assert (pLength != 0);
+
+	if (!m_bInit) return 0;
+	if (m_nCount == 0) return 0;
+
+	// producers only write behind the tail, the head entry is ours
+	InterruptSystemDisableIRQ(ARM_IRQ_UART);
+	spin_lock(m_SpinLock);
+	TBTQueueEntry *pEntry = m_nCount != 0 ? GetEntry (m_nHead) : 0;
+	spin_unlock(m_SpinLock);
+	InterruptSystemEnableIRQ(ARM_IRQ_UART);
+
+	if (pEntry == 0) return 0;
+
+	*pLength = pEntry->nLength;
+	if (ppParam != 0) {
+		*ppParam = pEntry->pParam;
+	}
+
+	return EntryData (pEntry);
+}
+
+void CBTQueue::Discard (void)
+{
+	if (!m_bInit) return;
+
+	InterruptSystemDisableIRQ(ARM_IRQ_UART);
+	spin_lock(m_SpinLock);
+	if (m_nCount != 0) {
+		if (++m_nHead == m_nCapacity) m_nHead = 0;
+		m_nCount--;
+	}
+	spin_unlock(m_SpinLock);
+	InterruptSystemEnableIRQ(ARM_IRQ_UART);
+}
+
+TBTQueueEntry *CBTQueue::GetEntry (unsigned nIndex) const
+{
+	assert (nIndex < m_nCapacity);
+	return (TBTQueueEntry *) (m_pSlots + nIndex * m_nEntrySize);
+}
+
+CBTSPSCQueue::CBTSPSCQueue (unsigned nCapacity, unsigned nSlotSize)
+:	m_pSlots (0),
+	m_nSize (nCapacity + 1),
+	m_nSlotSize (nSlotSize),
+	m_nHead (0),
+	m_nTail (0),
+	m_nOverflows (0),
+	m_nDrops (0),
+	m_nHighWater (0)
+{
+	assert (nCapacity > 0);
+	assert (nSlotSize > 0);
+
+	m_nEntrySize = (BT_QUEUE_ENTRY_DATA + nSlotSize + 3) & ~3;
+
+	m_pSlots = (u8 *)malloc(m_nEntrySize * m_nSize);
+	assert (m_pSlots != 0);
+	if (m_pSlots == 0) m_nSize = 0;
+}
+
+CBTSPSCQueue::~CBTSPSCQueue (void)
+{
+	free (m_pSlots);
+	m_pSlots = 0;
+	m_nSize = 0;
+}
+
+boolean CBTSPSCQueue::IsEmpty (void) const
+{
+	return __atomic_load_n (&m_nHead, __ATOMIC_RELAXED)
+		== __atomic_load_n (&m_nTail, __ATOMIC_ACQUIRE) ? TRUE : FALSE;
+}
+
+unsigned CBTSPSCQueue::GetCount (void) const
+{
+	unsigned nHead = __atomic_load_n (&m_nHead, __ATOMIC_ACQUIRE);
+	unsigned nTail = __atomic_load_n (&m_nTail, __ATOMIC_ACQUIRE);
+
+	return nTail >= nHead ? nTail - nHead : m_nSize - nHead + nTail;
+}
+
+void CBTSPSCQueue::Flush (void)
+{
+	if (m_nSize == 0) return;
+
+	__atomic_store_n (&m_nHead, __atomic_load_n (&m_nTail, __ATOMIC_ACQUIRE),
+			  __ATOMIC_RELEASE);
+}
+
+boolean CBTSPSCQueue::Enqueue (const void *pBuffer, unsigned nLength, void *pParam)
+{
+	if (m_nSize == 0) return FALSE;
+
+	assert (nLength > 0);
+	assert (pBuffer != 0);
+
+	if (nLength > m_nSlotSize) {
+		m_nDrops++;
+		return FALSE;
+	}
+
+	unsigned nTail = __atomic_load_n (&m_nTail, __ATOMIC_RELAXED);
+	unsigned nNext = Next (nTail);
+
+	// the consumer releases a slot only after it has copied it out
+	if (nNext == __atomic_load_n (&m_nHead, __ATOMIC_ACQUIRE)) {
+		m_nOverflows++;
+		return FALSE;
+	}
+
+	TBTQueueEntry *pEntry = GetEntry (nTail);
+	pEntry->nLength = nLength;
+	pEntry->pParam = pParam;
+	memcpy (EntryData (pEntry), pBuffer, nLength);
+
+	// publish the slot contents together with the new tail
+	__atomic_store_n (&m_nTail, nNext, __ATOMIC_RELEASE);
+
+#ifdef BT_HAVE_STATS
+	unsigned nCount = GetCount ();
+	if (nCount > m_nHighWater) m_nHighWater = nCount;
+#endif
+
+	return TRUE;
+}
+
+unsigned CBTSPSCQueue::Dequeue (void *pBuffer, void **ppParam)
+{
+	if (m_nSize == 0) return 0;
+
+	unsigned nHead = __atomic_load_n (&m_nHead, __ATOMIC_RELAXED);
+	if (nHead == __atomic_load_n (&m_nTail, __ATOMIC_ACQUIRE)) return 0;
+
+	TBTQueueEntry *pEntry = GetEntry (nHead);
+
+	unsigned nResult = pEntry->nLength;
+	assert (nResult > 0);
+	assert (nResult <= m_nSlotSize);
+
+	memcpy (pBuffer, EntryData (pEntry), nResult);
+
+	if (ppParam != 0) {
+		*ppParam = pEntry->pParam;
+	}
+
+	__atomic_store_n (&m_nHead, Next (nHead), __ATOMIC_RELEASE);
+
 	return nResult;
 }
+
+TBTQueueEntry *CBTSPSCQueue::GetEntry (unsigned nIndex) const
+{
+	assert (nIndex < m_nSize);
+	return (TBTQueueEntry *) (m_pSlots + nIndex * m_nEntrySize);
+}
@@ -0,0 +1,99 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth Layer Statistics Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btstats.h>
+
+#ifdef BT_HAVE_STATS
+
+#include <assert.h>
+
+volatile u32 CBTStats::s_nCount[BTStatsUnknown];
+volatile u32 CBTStats::s_nMax[BTStatsUnknown];
+volatile u64 CBTStats::s_nTotal[BTStatsUnknown];
+
+void CBTStats::Initialize (void)
+{
+	BT_EnableCycleCounter ();
+}
+
+void CBTStats::Record (TBTStatsTimer Timer, unsigned nStart)
+{
+	assert (Timer < BTStatsUnknown);
+
+	// modulo 2^32, valid as long as a section is shorter than one wrap
+	u32 nElapsed = (u32) Now () - (u32) nStart;
+
+	__atomic_add_fetch (&s_nCount[Timer], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch (&s_nTotal[Timer], nElapsed, __ATOMIC_RELAXED);
+
+	u32 nMax = __atomic_load_n (&s_nMax[Timer], __ATOMIC_RELAXED);
+	while (   nElapsed > nMax
+	       && !__atomic_compare_exchange_n (&s_nMax[Timer], &nMax, nElapsed, TRUE,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		// nMax was reloaded
+	}
+}
+
+void CBTStats::GetTimer (TBTStatsTimer Timer, TBTStatsTimerSummary *pSummary)
+{
+	assert (Timer < BTStatsUnknown);
+	assert (pSummary != 0);
+
+	pSummary->nCount = __atomic_load_n (&s_nCount[Timer], __ATOMIC_RELAXED);
+	pSummary->nMax = __atomic_load_n (&s_nMax[Timer], __ATOMIC_RELAXED);
+	pSummary->nTotal = __atomic_load_n (&s_nTotal[Timer], __ATOMIC_RELAXED);
+}
+
+boolean CBTStats::HaveCycleCounter (void)
+{
+#ifdef BT_HAVE_CYCLE_COUNTER
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+void CBTStats::Reset (void)
+{
+	for (unsigned i = 0; i < BTStatsUnknown; i++) {
+		s_nCount[i] = 0;
+		s_nMax[i] = 0;
+		s_nTotal[i] = 0;
+	}
+}
+
+#endif
@@ -41,16 +41,23 @@
 #include <bluetooth/btmouse.h>
 #include <logger.h>
 #include <assert.h>
+#include <string.h>
 #include <task.h>
 
 CBTSubSystem::CBTSubSystem (TInterruptSystem *pInterruptSystem, TBTCOD nClassOfDevice, const char *pLocalName)
 :	m_pInterruptSystem (pInterruptSystem),
 	m_pUARTTransport (0),
+	m_PacketPool (BT_PACKET_POOL_SIZE),
 	m_HCILayer (nClassOfDevice, pLocalName),
 	m_LogicalLayer (&m_HCILayer),
 	m_L2CAPLayer (&m_LogicalLayer, this),
-	m_HIDPLayer (&m_L2CAPLayer)
+	m_HIDPLayer (&m_L2CAPLayer),
+	m_SDPLayer (&m_L2CAPLayer)
 {
+#ifdef BT_HAVE_LATENCY
+	m_nStartTicks = 0;
+	m_nListenTicks = 0;
+#endif
 }
 
 CBTSubSystem::~CBTSubSystem (void)
@@ -61,14 +68,22 @@ CBTSubSystem::~CBTSubSystem (void)
 
 boolean CBTSubSystem::Initialize (void)
 {
+#ifdef BT_HAVE_LATENCY
+	m_nStartTicks = getClockTicks ();
+#endif
+#ifdef BT_HAVE_STATS
+	CBTStats::Initialize ();
+#endif
+
 	// if USB transport not available, UART still free and this is a RPi 3B or Zero W:
-	//	use UART transport
+	//	use UART transport, unless the application registered one already
 	if (   CDeviceNameService::Get ()->GetDevice ("ubt1", FALSE) == 0
-	    && CDeviceNameService::Get ()->GetDevice ("ttyS1", FALSE) == 0)
+	    && CDeviceNameService::Get ()->GetDevice ("ttyS1", FALSE) == 0
+	    && CDeviceNameService::Get ()->GetDevice ("ttyBT1", FALSE) == 0)
 	{
 		assert (m_pUARTTransport == 0);
 		assert (m_pInterruptSystem != 0);
-		m_pUARTTransport = new CBTUARTTransport (m_pInterruptSystem);
+		m_pUARTTransport = new TBTHCITransport (m_pInterruptSystem);
 		assert (m_pUARTTransport != 0);
 		if (!m_pUARTTransport->Initialize ()) {
 			return FALSE;
@@ -83,23 +98,49 @@ boolean CBTSubSystem::Initialize (void)
 		return FALSE;
 	}
 
+#ifdef BT_HAVE_SIM
+	// there is no fork on the host, the loop gets its own thread
+	if (execTask (RunStub, this) < 0) {
+		return FALSE;
+	}
+#else
 	int pid;
 	pid = forkTask(this);
 
 	if (!pid) {
-		lDevRun:
+		Run ();
+	}
+#endif
+
+	return TRUE;
+}
+
+void CBTSubSystem::Run (void)
+{
+	while (1) {
 		while (!m_HCILayer.GetDeviceManager ()->DeviceIsRunning ()) {
 			Process();
 		}
+#ifdef BT_HAVE_LATENCY
+		CBTLatency::RecordSince (BTLatencyStartup, m_nStartTicks);
+#endif
 		LOG_DEBUG("Device running\r\n");
 		while (m_HCILayer.GetDeviceManager ()->DeviceIsRunning ()) {
 			Process();
 		}
 		LOG_DEBUG("Device not running\r\n");
-		goto lDevRun;
+#ifdef BT_HAVE_LATENCY
+		m_nStartTicks = getClockTicks ();
+#endif
 	}
+}
 
-	return TRUE;
+void CBTSubSystem::RunStub (void *pParam)
+{
+	CBTSubSystem *pThis = (CBTSubSystem *) pParam;
+	assert (pThis != 0);
+
+	pThis->Run ();
 }
 
 void CBTSubSystem::Process (void)
@@ -107,10 +148,15 @@ void CBTSubSystem::Process (void)
 	m_HCILayer.Process ();
 
 	m_LogicalLayer.Process ();
+
+	m_L2CAPLayer.Process ();
 }
 
 CBTInquiryResults *CBTSubSystem::Listen (unsigned nSeconds)
 {
+#ifdef BT_HAVE_LATENCY
+	m_nListenTicks = getClockTicks ();
+#endif
 	CBTInquiryResults* inq = m_LogicalLayer.Inquiry (nSeconds);
 	m_LogicalLayer.ListDevices ();
 	return inq;
@@ -122,13 +168,16 @@ CBTDevice* CBTSubSystem::Accept (void *ptr)
 	u8 *paddr = (u8 *)ptr;
 	CBTDevice *pDevice = NULL;
 	CBTConnection *pConnection = NULL;
-	CPtrArray& m_Connections = m_LogicalLayer.GetConnections();
+	TBTConnections& Connections = m_LogicalLayer.GetConnections();
 
 	if (ptr) pConnection = m_LogicalLayer.GetConnection((u8 *)ptr);
 	else {
-		for (int i=0; i<m_Connections.GetCount(); i++) {
-			if(((CBTConnection*)m_Connections[i])->IsMouse()) {
-				pConnection = (CBTConnection *)m_Connections[i];
+		// the first HID device which is not connected yet
+		for (unsigned i=0; i<Connections.GetCount(); i++) {
+			CBTDevice *pConnected = GetDevice(Connections[i]);
+			if (Connections[i]->IsHID()
+			    && !(pConnected && pConnected->IsConnected())) {
+				pConnection = Connections[i];
 				break;
 			}
 		}
@@ -137,23 +186,74 @@ CBTDevice* CBTSubSystem::Accept (void *ptr)
 	assert(pDevice != 0);
 	if (pDevice) nResult = pDevice->Connect ();
 
+#ifdef BT_HAVE_LATENCY
+	if (pDevice && !nResult)
+		CBTLatency::RecordSince (BTLatencyConnect, m_nListenTicks);
+#endif
+	if (pDevice && !nResult && pConnection->IsHID())
+		LoadReportDescriptor((CBTHIDDevice *)pDevice);
+
 	return nResult ? NULL : (CBTDevice *)pDevice;
 }
 
+unsigned CBTSubSystem::AcceptAll (void)
+{
+	unsigned nConnected = 0;
+	TBTConnections& Connections = m_LogicalLayer.GetConnections();
+	CBTVector<CBTHIDDevice *, BT_SUBSYSTEM_DEVICES> Started;
+
+	// the link setup of all devices runs at once, then each is waited for
+	for (unsigned i=0; i<Connections.GetCount(); i++) {
+		if (!Connections[i]->IsHID()) continue;
+		CBTHIDDevice *pDevice = (CBTHIDDevice *)CreateDevice(Connections[i]);
+		if (pDevice && pDevice->ConnectAsync()) Started.Append(pDevice);
+		else if (pDevice && pDevice->IsConnected()) nConnected++;
+	}
+
+	for (unsigned i=0; i<Started.GetCount(); i++) {
+		if (Started[i]->WaitConnect()) continue;
+		nConnected++;
+#ifdef BT_HAVE_LATENCY
+		CBTLatency::RecordSince (BTLatencyConnect, m_nListenTicks);
+#endif
+	}
+
+	// the queries share the SDP layer, they run one after the other
+	for (unsigned i=0; i<Started.GetCount(); i++) {
+		if (Started[i]->IsConnected()) LoadReportDescriptor(Started[i]);
+	}
+
+	return nConnected;
+}
+
+void CBTSubSystem::LoadReportDescriptor (CBTHIDDevice *pDevice)
+{
+	u8 *pDescriptor = (u8 *) malloc (BT_SDP_BUFFER_SIZE);
+	if (!pDescriptor) return;
+
+	// without a usable one the boot protocol layout stays
+	u16 nLength = 0;
+	u16 nResult = m_SDPLayer.GetHIDDescriptor ((u8 *) pDevice->GetBDAddress (),
+		pDescriptor, BT_SDP_BUFFER_SIZE, &nLength);
+	if (   nResult != BT_SDP_RESULT_SUCCESS
+	    || !pDevice->SetReportDescriptor (pDescriptor, nLength))
+		LOG_DEBUG("No report descriptor (0x%04X), boot layout kept\r\n", nResult);
+
+	free (pDescriptor);
+}
+
 CBTDevice* CBTSubSystem::GetDevice (CBTConnection* pConnection)
 {
-	bool found = false;
-	CBTDevice* pDevice = NULL;
-	for (int i=0; i<m_Devices.GetCount() && !found; i++) {
-		pDevice = (CBTDevice *)m_Devices[i];
-		found = (pDevice->GetConnection() == pConnection);
+	for (unsigned i=0; i<m_Devices.GetCount(); i++) {
+		if (m_Devices[i]->GetConnection() == pConnection)
+			return m_Devices[i];
 	}
-	return pDevice;
+	return NULL;
 }
 
 CBTDevice* CBTSubSystem::GetDevice (u16 nIndex)
 {
-	return (CBTDevice *)m_Devices[nIndex];
+	return m_Devices[nIndex];
 }
 
 u16 CBTSubSystem::GetDeviceCount (void)
@@ -177,7 +277,7 @@ CBTDevice* CBTSubSystem::CreateDevice (CBTConnection *pConnection)
 			m_Devices.Append(pDevice);
 		}
 	}
-	LOG_DEBUG("Created device 0x%08X\r\n", (int)pDevice);
+	LOG_DEBUG("Created device 0x%08X\r\n", (unsigned) (uintptr) pDevice);
 	return pDevice;
 }
 
@@ -185,3 +285,62 @@ boolean CBTSubSystem::Status (void)
 {
 	return m_HCILayer.GetDeviceManager ()->DeviceIsRunning ();
 }
+
+unsigned CBTSubSystem::GetReceiveDrops (void)
+{
+	return m_HCILayer.GetReceiveDrops ();
+}
+
+CBTL2CAPLayer *CBTSubSystem::GetL2CAPLayer (void)
+{
+	return &m_L2CAPLayer;
+}
+
+boolean CBTSubSystem::GetStats (tBT_stats *pStats)
+{
+	assert (pStats != 0);
+	memset (pStats, 0, sizeof *pStats);
+
+#ifdef BT_HAVE_STATS
+	static const TBTStatsTimer Timers[] =
+	{
+		BTStatsRxDeframe, BTStatsHCIProcess, BTStatsDeviceManagerProcess,
+		BTStatsLogicalProcess, BTStatsCommandRoundTrip
+	};
+	tBT_stats_timer *pTimers[] =
+	{
+		&pStats->rx_deframe, &pStats->hci_process, &pStats->device_manager_process,
+		&pStats->logical_process, &pStats->command_round_trip
+	};
+	for (unsigned i = 0; i < sizeof Timers / sizeof Timers[0]; i++) {
+		TBTStatsTimerSummary Summary;
+		CBTStats::GetTimer (Timers[i], &Summary);
+		pTimers[i]->count = Summary.nCount;
+		pTimers[i]->max = Summary.nMax;
+		pTimers[i]->total = Summary.nTotal;
+	}
+	pStats->cycles = CBTStats::HaveCycleCounter () ? 1 : 0;
+
+	m_HCILayer.GetStats (pStats);
+
+	for (unsigned i = 0; i < m_Devices.GetCount (); i++) {
+		CBTDevice *pDevice = m_Devices[i];
+		if (pDevice->GetConnection () && pDevice->GetConnection ()->IsHID ()) {
+			unsigned nHigh = ((CBTHIDDevice *) pDevice)->GetEventQueueHighWater ();
+			if (nHigh > pStats->hid_event_queue_high)
+				pStats->hid_event_queue_high = nHigh;
+		}
+	}
+
+	if (m_pUARTTransport != 0) {
+		pStats->rx_overruns = m_pUARTTransport->GetOverruns ();
+		pStats->rx_discarded = m_pUARTTransport->GetDeframer ()->GetDiscarded ();
+		pStats->rx_dropped = m_pUARTTransport->GetDeframer ()->GetDropped ();
+	}
+	pStats->pool_failures = m_PacketPool.GetAllocFailures ();
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
@@ -0,0 +1,229 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth Firmware Loader
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btfirmwareloader.h>
+#include <bluetooth/bthcilayer.h>
+#include <bluetooth/bcmvendor.h>
+#include <bluetooth/btcommand.h>
+#include <logger.h>
+#include <assert.h>
+#include <task.h>
+#include <stdlib.h>
+
+static const u8 Firmware[] =
+{
+#if defined RPI || defined BT_HAVE_SIM	// the simulated controller takes the same patch
+	#include "platform/rpi/BCM43430A1.h"
+#else
+#endif
+};
+
+CBTFirmwareLoader::CBTFirmwareLoader (CBTHCILayer *pHCILayer)
+:	m_pHCILayer (pHCILayer),
+	m_pImage (Firmware),
+	m_nSize (sizeof Firmware),
+	m_pRecord (0),
+	m_nRecords (0),
+	m_nNextRecord (0),
+	m_nInFlight (0),
+	m_bLaunched (FALSE),
+	m_nResets (0),
+	m_nLastTicks (0)
+{
+}
+
+CBTFirmwareLoader::~CBTFirmwareLoader (void)
+{
+	free (m_pRecord);
+	m_pRecord = 0;
+
+	m_pHCILayer = 0;
+}
+
+boolean CBTFirmwareLoader::Initialize (void)
+{
+	assert (m_pRecord == 0);
+
+	// count first, the index is allocated once
+	unsigned nRecords = 0;
+	unsigned nOffset = 0;
+	while (nOffset + BT_FIRMWARE_RECORD_HEADER <= m_nSize) {
+		nOffset += BT_FIRMWARE_RECORD_HEADER + m_pImage[nOffset+2];
+		nRecords++;
+	}
+	if (nOffset != m_nSize) {
+		LOG_DEBUG ("Firmware image truncated in record %u\r\n", nRecords);
+		return FALSE;
+	}
+	if (nRecords == 0) {
+		return TRUE;			// nothing to load
+	}
+
+	m_pRecord = (unsigned *) malloc (nRecords * sizeof (unsigned));
+	assert (m_pRecord != 0);
+
+	nOffset = 0;
+	for (unsigned i = 0; i < nRecords; i++) {
+		m_pRecord[i] = nOffset;
+		nOffset += BT_FIRMWARE_RECORD_HEADER + m_pImage[nOffset+2];
+	}
+
+	// the controller restarts on Launch RAM, anything after it is lost
+	for (unsigned i = 0; i < nRecords; i++) {
+		if ((GetOpCode (i) == OP_CODE_LAUNCH_RAM) != (i == nRecords-1)) {
+			LOG_DEBUG ("Firmware image must end with Launch RAM\r\n");
+			free (m_pRecord);
+			m_pRecord = 0;
+			return FALSE;
+		}
+	}
+
+	m_nRecords = nRecords;
+
+	return TRUE;
+}
+
+boolean CBTFirmwareLoader::Start (void)
+{
+	assert (m_pHCILayer != 0);
+	if (m_nRecords == 0) {
+		return FALSE;
+	}
+
+	m_nNextRecord = 0;
+	m_nInFlight = 1;
+	m_bLaunched = FALSE;
+	m_nResets = 0;
+	m_nLastTicks = getClockTicks ();
+
+	// the records follow once the minidriver has answered
+	m_pHCILayer->SendCommand<TBTHCIDownloadMinidriverCommand> ();
+
+	return TRUE;
+}
+
+boolean CBTFirmwareLoader::CommandComplete (u16 nOpCode)
+{
+	if (m_nInFlight == 0 || m_bLaunched) {
+		return FALSE;			// not ours
+	}
+	m_nInFlight--;
+	m_nLastTicks = getClockTicks ();
+
+	if (nOpCode == OP_CODE_LAUNCH_RAM) {
+		LOG_DEBUG ("Firmware loaded (%u records)\r\n", m_nRecords);
+		m_bLaunched = TRUE;
+		SendReset ();
+
+		return TRUE;
+	}
+
+	SendRecords ();
+
+	return FALSE;
+}
+
+boolean CBTFirmwareLoader::Process (void)
+{
+	unsigned nElapsed = getClockTicks () - m_nLastTicks;
+
+	if (!m_bLaunched) {
+		// records refused by a full queue while none were in flight
+		// get no completion to send them
+		if (m_nInFlight == 0 && m_nNextRecord < m_nRecords) {
+			SendRecords ();
+		}
+		if (nElapsed < BT_FIRMWARE_STALL_TIMEOUT) {
+			return TRUE;
+		}
+		LOG_DEBUG ("Firmware record %u not completed\r\n", m_nNextRecord - m_nInFlight);
+
+		return FALSE;
+	}
+
+	if (nElapsed < BT_FIRMWARE_RESET_TIMEOUT) {
+		return TRUE;
+	}
+	if (m_nResets >= BT_FIRMWARE_RESET_RETRIES) {
+		LOG_DEBUG ("Patched firmware does not answer\r\n");
+
+		return FALSE;
+	}
+
+	// the controller was still restarting and lost the Reset
+	m_pHCILayer->ResetCommandPackets ();
+	SendReset ();
+
+	return TRUE;
+}
+
+void CBTFirmwareLoader::SendRecords (void)
+{
+	while (   m_nNextRecord < m_nRecords
+	       && m_nInFlight < m_pHCILayer->GetCommandPackets ()) {
+		// Launch RAM waits until every record is written
+		if (m_nNextRecord == m_nRecords-1 && m_nInFlight > 0) {
+			break;
+		}
+
+		const u8 *pRecord = m_pImage + m_pRecord[m_nNextRecord];
+		if (!m_pHCILayer->SendCommand (GetOpCode (m_nNextRecord),
+					       pRecord + BT_FIRMWARE_RECORD_HEADER,
+					       pRecord[2])) {
+			// queue full, retried on the next completion or by Process
+			break;
+		}
+
+		m_nNextRecord++;
+		m_nInFlight++;
+	}
+}
+
+void CBTFirmwareLoader::SendReset (void)
+{
+	// answered only once the patched firmware runs
+	m_pHCILayer->SendCommand<TBTHCIResetCommand> ();
+	m_nResets++;
+	m_nLastTicks = getClockTicks ();
+}
+
+u16 CBTFirmwareLoader::GetOpCode (unsigned nRecord) const
+{
+	const u8 *pRecord = m_pImage + m_pRecord[nRecord];
+
+	return pRecord[0] | pRecord[1] << 8;
+}
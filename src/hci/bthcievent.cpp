@@ -48,14 +48,6 @@
 #include <string.h>
 #include <stdlib.h>
 
-static const u8 Firmware[] =
-{
-#ifdef RPI
-	#include "platform/rpi/BCM43430A1.h"
-#else
-#endif
-};
-
 TBTLMPEventHandler* CBTHCIEvent::Handler[BT_EVENT_NUM_EVENTS] = {};
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -119,10 +111,10 @@ void CBTHCIEventInquiryComplete::Process(void *pLayer, u16 nLength)
 
 		for (unsigned nResponse = 0; nResponse < rInquiryResults->GetCount ();
 			nResponse++) {
-			CBTHCIRemoteNameRequestCommand Cmd(
-				(u8 *)rInquiryResults->GetBDAddress(nResponse),
-				rInquiryResults->GetPageScanRepetitionMode(nResponse));
-			pLogicalLayer->SendHCICommand (&Cmd, sizeof Cmd);
+			pLogicalLayer->SendHCICommand<TBTHCIRemoteNameRequestCommand> (
+				rInquiryResults->GetBDAddress(nResponse),
+				rInquiryResults->GetPageScanRepetitionMode(nResponse),
+				0, CLOCK_OFFSET_INVALID);
 		}
 	}
 }
@@ -162,7 +154,8 @@ void CBTHCIEventConnectionComplete::Process(void *pLayer, u16 nLength)
 {
 	assert (nLength >= sizeof (CBTHCIEventConnectionComplete));
 	CBTLogicalLayer *pLogicalLayer = (CBTLogicalLayer *) pLayer;
-	CBTConnection*& rConnection = pLogicalLayer->GetConnectionPtr();;
+	// several connections may be under way, the address tells which one
+	CBTConnection* rConnection = pLogicalLayer->GetConnection(BDAddr);
 	LOG_DEBUG("LMP connection complete status: 0x%02X\r\n", Status);
 	LOG_DEBUG("Connection handle: 0x%02X\r\n", ConnectionHandle);
 
@@ -170,15 +163,17 @@ void CBTHCIEventConnectionComplete::Process(void *pLayer, u16 nLength)
 		assert(rConnection != 0);
 
 		if (rConnection) {
-			rConnection->SetBDAddress(BDAddr);
-			rConnection->SetConnectionHandle(ConnectionHandle);
+			pLogicalLayer->SetConnectionBDAddress(rConnection, BDAddr);
+			pLogicalLayer->SetConnectionHandle(rConnection, ConnectionHandle);
 			rConnection->SetLinkType(LinkType);
 			rConnection->SetEncryptionMode(EncryptionMode);
 			rConnection->SetState(BTConnectionStateConnected);
 			rConnection->SetStatus(Status);
 		}
+		if (LinkType == LINK_TYPE_ACL_CONNECTION)
+			pLogicalLayer->AddHCILink(ConnectionHandle);
 
-		LOG_DEBUG("LMP: Connection pointer = 0x%08X\r\n", (int)rConnection);
+		LOG_DEBUG("LMP: Connection pointer = 0x%08X\r\n", (unsigned) (uintptr) rConnection);
 		LOG_DEBUG("Link type: 0x%02X\r\n", LinkType);
 		LOG_DEBUG("Encrypt mode: 0x%02X\r\n", EncryptionMode);
 		LOG_DEBUG ("BD address: %02X:%02X:%02X:%02X:%02X:%02X\r\n",
@@ -203,9 +198,8 @@ void CBTHCIEventConnectionComplete::Process(void *pLayer, u16 nLength)
 			pLogicalLayer->m_pLPCallback(&event, sizeof event);
 		}
 	}
-	rConnection = NULL;
 	pLogicalLayer->SetConnectingFlag(false);
-	pLogicalLayer->Set();
+	pLogicalLayer->CompleteCommand(rConnection);
 }
 
 CBTHCIEventConnectionRequest::CBTHCIEventConnectionRequest()
@@ -230,11 +224,10 @@ void CBTHCIEventConnectionRequest::Process(void *pLayer, u16 nLength)
 		pConnection->SetBDAddress((u8*)BDAddr);
 		pConnection->SetClassOfDevice((u8*)ClassOfDevice);
 		pConnection->SetLinkType(LinkType);
-		pLogicalLayer->GetConnections().Append(pConnection);
+		pLogicalLayer->AddConnection(pConnection);
 	}
 	if (pConnection) {
 		pConnection->SetState(BTConnectionStateConnecting);
-		pLogicalLayer->SetConnectionPtr(pConnection);
 		pLogicalLayer->SetConnectingFlag(true);
 		if (pLogicalLayer->m_pLPCallback) {
 			CBTLPConnectInd event;
@@ -260,16 +253,14 @@ void CBTHCIEventDisconnectionComplete::Process(void *pLayer, u16 nLength)
 	assert (nLength >= sizeof (CBTHCIEventDisconnectionComplete));
 	LOG_DEBUG("LMP disconnection complete status: 0x%02X\r\n", Status);
 	CBTLogicalLayer *pLogicalLayer = (CBTLogicalLayer *) pLayer;
-	CPtrArray& rConnections = pLogicalLayer->GetConnections();;
 
 	if (Status == BT_STATUS_SUCCESS) {
-		for (int i=0; i<rConnections.GetCount(); i++) {
-			CBTConnection *pConnection = (CBTConnection *)rConnections[i];
-			if(pConnection->HasConnectionHandle(ConnectionHandle)) {
-				pConnection->SetState(BTConnectionStateDisconnected);
-				pConnection->SetStatus(Status);
-				break;
-			}
+		pLogicalLayer->RemoveHCILink(ConnectionHandle);
+		CBTConnection *pConnection
+			= pLogicalLayer->GetConnection(ConnectionHandle);
+		if (pConnection) {
+			pConnection->SetState(BTConnectionStateDisconnected);
+			pConnection->SetStatus(Status);
 		}
 		if (pLogicalLayer->m_pLPCallback) {
 			CBTLPDisconnectInd event;
@@ -277,10 +268,13 @@ void CBTHCIEventDisconnectionComplete::Process(void *pLayer, u16 nLength)
 			event.Handle = ConnectionHandle;
 			pLogicalLayer->m_pLPCallback(&event, sizeof event);
 		}
-	} else if (pLogicalLayer->GetConnectionPtr()) {
-		CBTConnection*& m_pConnection = pLogicalLayer->GetConnectionPtr();
-		m_pConnection->SetState(BTConnectionStateDisconnectionFailed);
-		m_pConnection->SetStatus(Status);
+	} else {
+		CBTConnection *pConnection
+			= pLogicalLayer->GetConnection(ConnectionHandle);
+		if (pConnection) {
+			pConnection->SetState(BTConnectionStateDisconnectionFailed);
+			pConnection->SetStatus(Status);
+		}
 	}
 }
 
@@ -301,15 +295,15 @@ void CBTHCIEventAuthenticationComplete::Process(void *pLayer, u16 nLength)
 	assert (nLength >= sizeof (CBTHCIEventAuthenticationComplete));
 	LOG_DEBUG("LMP authentication complete status: 0x%02X\r\n", Status);
 	CBTLogicalLayer *pLogicalLayer = (CBTLogicalLayer *) pLayer;
-	CBTConnection*& m_pConnection = pLogicalLayer->GetConnectionPtr();
+	CBTConnection* pConnection = pLogicalLayer->GetConnection(ConnectionHandle);
+	if (!pConnection) return;
 
 	if (Status == BT_STATUS_SUCCESS) 
-		m_pConnection->SetState(BTConnectionStateAuthenticated);
+		pConnection->SetState(BTConnectionStateAuthenticated);
 	else
-		m_pConnection->SetState(BTConnectionStateAuthenticationFailed);
-	m_pConnection->SetStatus(Status);
-	pLogicalLayer->Set();
-
+		pConnection->SetState(BTConnectionStateAuthenticationFailed);
+	pConnection->SetStatus(Status);
+	pLogicalLayer->CompleteCommand(pConnection);
 }
 
 CBTHCIEventFlushOccurred::CBTHCIEventFlushOccurred()
@@ -367,9 +361,22 @@ void CBTHCIEventNumberOfCompletedPackets::Handler(
 void CBTHCIEventNumberOfCompletedPackets::Process(void *pLayer, u16 nLength)
 {
 	assert (nLength >= sizeof (CBTHCIEventNumberOfCompletedPackets));
-	LOG_DEBUG("LMP data pack sent = %d\r\n", HCNumOfCompletedPackets[0]);
 	CBTLogicalLayer *pLogicalLayer = (CBTLogicalLayer *) pLayer;
-	pLogicalLayer->SetHCIDataPackets(HCNumOfCompletedPackets[0]);
+
+	unsigned nHandles = NumberOfHandles;
+	if (nLength < sizeof (CBTHCIEventNumberOfCompletedPackets) + nHandles * 4) {
+		LOG_DEBUG("Number of completed packets event too short\r\n");
+		return;
+	}
+
+	for (unsigned i = 0; i < nHandles; i++) {
+		const u8 *pHandle = Params + i*2;
+		const u8 *pCount = Params + nHandles*2 + i*2;
+		u16 nHandle = (pHandle[0] | pHandle[1] << 8) & 0xFFF;
+		u16 nCount = pCount[0] | pCount[1] << 8;
+		LOG_DEBUG("LMP data pack sent = %d (handle 0x%03X)\r\n", nCount, nHandle);
+		pLogicalLayer->CompleteHCIDataPackets(nHandle, nCount);
+	}
 }
 
 CBTHCIEventModeChange::CBTHCIEventModeChange()
@@ -440,7 +447,8 @@ void CBTHCIEventReadRemoteSupportedFeaturesComplete::Process(
 	assert (nLength >= sizeof (CBTHCIEventReadRemoteSupportedFeaturesComplete));
 	LOG_DEBUG("LMP read remote supported features complete status: 0x%02X\r\n", Status);
 	CBTLogicalLayer *pLogicalLayer = (CBTLogicalLayer *) pLayer;
-	CBTConnection*& m_pConnection = pLogicalLayer->GetConnectionPtr();
+	CBTConnection* pConnection = pLogicalLayer->GetConnection(ConnectionHandle);
+	if (!pConnection) return;
 
 	if (Status == BT_STATUS_SUCCESS) {
 
@@ -450,8 +458,8 @@ void CBTHCIEventReadRemoteSupportedFeaturesComplete::Process(
 			(unsigned) LMPFeatures[3], (unsigned) LMPFeatures[2],
 			(unsigned) LMPFeatures[1], (unsigned) LMPFeatures[0]);
 	}
-	m_pConnection->SetStatus(Status);
-	pLogicalLayer->Set();
+	pConnection->SetStatus(Status);
+	pLogicalLayer->CompleteCommand(pConnection);
 }
 
 CBTHCIEventReadRemoteVersionInformationComplete::CBTHCIEventReadRemoteVersionInformationComplete()
@@ -473,19 +481,20 @@ void CBTHCIEventReadRemoteVersionInformationComplete::Process(
 	assert (nLength >= sizeof(CBTHCIEventReadRemoteVersionInformationComplete));
 	LOG_DEBUG("LMP read remote ver-info complete status: 0x%02X\r\n", Status);
 	CBTLogicalLayer *pLogicalLayer = (CBTLogicalLayer *) pLayer;
-	CBTConnection*& m_pConnection = pLogicalLayer->GetConnectionPtr();
+	CBTConnection* pConnection = pLogicalLayer->GetConnection(ConnectionHandle);
+	if (!pConnection) return;
 
 	if (Status == BT_STATUS_SUCCESS) {
 
-		m_pConnection->SetVersion(LMPVersion);
-		m_pConnection->SetManufacturer(ManufacturerName);
-		m_pConnection->SetSubversion(LMPSubversion);
+		pConnection->SetVersion(LMPVersion);
+		pConnection->SetManufacturer(ManufacturerName);
+		pConnection->SetSubversion(LMPSubversion);
 		LOG_DEBUG("LMP version: 0x%02X\r\n", LMPVersion);
 		LOG_DEBUG("Manufacturer name: 0x%04X\r\n", ManufacturerName);
 		LOG_DEBUG("LMP subversion: 0x%04X\r\n", LMPSubversion);
 	}
-	m_pConnection->SetStatus(Status);
-	pLogicalLayer->Set();
+	pConnection->SetStatus(Status);
+	pLogicalLayer->CompleteCommand(pConnection);
 }
 
 CBTHCIEventCommandComplete::CBTHCIEventCommandComplete()
@@ -503,12 +512,23 @@ void CBTHCIEventCommandComplete::Process(void *pLayer, u16 nLength)
 	assert (nLength >= sizeof (CBTHCIEventCommandComplete));
 	CBTDeviceManager *pDeviceManager = (CBTDeviceManager *)pLayer;
 
-	pDeviceManager->SetHCICommandPackets (NumHCICommandPackets);
+	pDeviceManager->SetHCICommandPackets (NumHCICommandPackets, CommandOpCode);
 
 	if (Status != BT_STATUS_SUCCESS) {
 		LOG_DEBUG ( "Command 0x%X failed (status 0x%X)\r\n",
 					(unsigned) CommandOpCode, (unsigned) Status);
 
+		// a controller without host flow control is used all the same
+		if (   pDeviceManager->CheckState(BTDeviceStateHostBufferSizePending)
+		    || pDeviceManager->CheckState(BTDeviceStateHostFlowControlPending)) {
+			pDeviceManager->SendHCICommand<TBTHCIWriteClassOfDeviceCommand> (
+				&pDeviceManager->m_nClassOfDevice);
+
+			pDeviceManager->SetState(BTDeviceStateWriteClassOfDevicePending);
+
+			return;
+		}
+
 		pDeviceManager->SetState(BTDeviceStateFailed);
 
 		return;
@@ -518,47 +538,30 @@ void CBTHCIEventCommandComplete::Process(void *pLayer, u16 nLength)
 
 		case OP_CODE_RESET:
 			if (pDeviceManager->CheckState(BTDeviceStateResetPending)) {
-
-			if (pDeviceManager->m_pHCILayer->GetTransportType ()
-				!= BTTransportTypeUART) {
-				goto NoFirmwareLoad;
+				if (   pDeviceManager->m_pHCILayer->GetTransportType ()
+					== BTTransportTypeUART
+				    && pDeviceManager->m_FirmwareLoader.Start ()) {
+					pDeviceManager->SetState(BTDeviceStateWriteRAMPending);
+					break;
+				}
+			} else if (!pDeviceManager->CheckState(BTDeviceStateLaunchRAMPending)) {
+				break;
 			}
-			CBTHCICommand Cmd(OP_CODE_DOWNLOAD_MINIDRIVER);
-			pDeviceManager->SendHCICommand (&Cmd, sizeof Cmd);
-			pDeviceManager->Sleep (50000);
 
-			pDeviceManager->m_nFirmwareOffset = 0;
-			pDeviceManager->SetState(BTDeviceStateWriteRAMPending);
-			} break;
+			// no patch to load or the patched firmware is running
+			pDeviceManager->SendHCICommand<TBTHCIReadBDAddrCommand> ();
+
+			pDeviceManager->SetState(BTDeviceStateReadBDAddrPending);
+			break;
 
 		case OP_CODE_DOWNLOAD_MINIDRIVER:
 		case OP_CODE_WRITE_RAM:
-			if (pDeviceManager->CheckState(BTDeviceStateWriteRAMPending)) {
-
-			assert (pDeviceManager->m_nFirmwareOffset+3 <= sizeof Firmware);
-			u16 nOpCode  = Firmware[pDeviceManager->m_nFirmwareOffset++];
-			    nOpCode |= Firmware[pDeviceManager->m_nFirmwareOffset++] << 8;
-			u8 nLength = Firmware[pDeviceManager->m_nFirmwareOffset++];
-
-			CBTHCIBcmVendorCommand Cmd(
-				nOpCode, nLength, (u8 *)Firmware,
-				&pDeviceManager->m_nFirmwareOffset);
-			pDeviceManager->SendHCICommand(&Cmd, sizeof(CBTHCICommand)+nLength);
-
-			if (nOpCode == OP_CODE_LAUNCH_RAM)
-				pDeviceManager->SetState(BTDeviceStateLaunchRAMPending);
-			} break;
-
 		case OP_CODE_LAUNCH_RAM:
-			if (pDeviceManager->CheckState(BTDeviceStateLaunchRAMPending)) {
-			pDeviceManager->Sleep (250000);
-
-		NoFirmwareLoad:
-			CBTHCICommand Cmd(OP_CODE_READ_BD_ADDR);
-			pDeviceManager->SendHCICommand (&Cmd, sizeof Cmd);
-
-			pDeviceManager->SetState(BTDeviceStateReadBDAddrPending);
-			} break;
+			if (   pDeviceManager->CheckState(BTDeviceStateWriteRAMPending)
+			    && pDeviceManager->m_FirmwareLoader.CommandComplete (CommandOpCode)) {
+				pDeviceManager->SetState(BTDeviceStateLaunchRAMPending);
+			}
+			break;
 
 		case OP_CODE_READ_BD_ADDR:
 			if (pDeviceManager->CheckState(BTDeviceStateReadBDAddrPending)) {
@@ -576,8 +579,44 @@ void CBTHCIEventCommandComplete::Process(void *pLayer, u16 nLength)
 				(unsigned) pDeviceManager->m_LocalBDAddr[1],
 				(unsigned) pDeviceManager->m_LocalBDAddr[0]);
 
-			CBTHCIWriteClassOfDeviceCommand Cmd(pDeviceManager->m_nClassOfDevice);
-			pDeviceManager->SendHCICommand (&Cmd, sizeof Cmd);
+			pDeviceManager->SendHCICommand<TBTHCIReadBufferSizeCommand> ();
+
+			pDeviceManager->SetState(BTDeviceStateReadBufferSizePending);
+			} break;
+
+		case OP_CODE_READ_BUFFER_SIZE:
+			if (pDeviceManager->CheckState(BTDeviceStateReadBufferSizePending)) {
+
+			assert (nLength >= sizeof (CBTHCIEventReadBufferSizeComplete));
+			CBTHCIEventReadBufferSizeComplete *pEvent
+				= (CBTHCIEventReadBufferSizeComplete *) this;
+			pDeviceManager->m_pHCILayer->SetBufferSize (
+				pEvent->ACLDataPacketLength, pEvent->TotalNumACLDataPackets);
+
+			// the controller must not send more or larger fragments
+			// than the receive queue takes
+			pDeviceManager->SendHCICommand<TBTHCIHostBufferSizeCommand> (
+				BT_HCI_RX_ACL_LENGTH, 0, BT_HCI_RX_DATA_QUEUE_SIZE, 0);
+
+			pDeviceManager->SetState(BTDeviceStateHostBufferSizePending);
+			} break;
+
+		case OP_CODE_HOST_BUFFER_SIZE:
+			if (pDeviceManager->CheckState(BTDeviceStateHostBufferSizePending)) {
+
+			pDeviceManager->SendHCICommand<TBTHCISetControllerToHostFlowControlCommand> (
+				FLOW_CONTROL_ACL);
+
+			pDeviceManager->SetState(BTDeviceStateHostFlowControlPending);
+			} break;
+
+		case OP_CODE_SET_CONTROLLER_TO_HOST_FLOW_CONTROL:
+			if (pDeviceManager->CheckState(BTDeviceStateHostFlowControlPending)) {
+
+			pDeviceManager->m_pHCILayer->SetHostFlowControl (TRUE);
+
+			pDeviceManager->SendHCICommand<TBTHCIWriteClassOfDeviceCommand> (
+				&pDeviceManager->m_nClassOfDevice);
 
 			pDeviceManager->SetState(BTDeviceStateWriteClassOfDevicePending);
 			} break;
@@ -587,18 +626,17 @@ void CBTHCIEventCommandComplete::Process(void *pLayer, u16 nLength)
 			assert (nLength >= sizeof (CBTHCIEventReadStoredLinkKeyComplete));
 			CBTHCIEventReadStoredLinkKeyComplete *pEvent
 				= (CBTHCIEventReadStoredLinkKeyComplete *) this;
+			// the reads complete in the order the requests came
+			CBTConnection *pConnection = pDeviceManager->PopLinkKeyRequest();
+			assert(pConnection != 0);
+			if (!pConnection) break;
 			if (pEvent->NumKeysRead) {
-				assert(pDeviceManager->m_pConnection != 0);
-				CBTHCILinkKeyRequestReplyCommand Cmd(
-					(u8*)pDeviceManager->m_pConnection->GetBDAddress(),
-					(u8*)pDeviceManager->m_pConnection->GetLinkKey());
-				pDeviceManager->SendHCICommand (&Cmd, sizeof Cmd);
+				pDeviceManager->SendHCICommand<TBTHCILinkKeyRequestReplyCommand> (
+					pConnection->GetBDAddress(), pConnection->GetLinkKey());
 			} else {
-				CBTHCILinkKeyRequestNegativeReplyCommand Cmd(
-					(u8*)pDeviceManager->m_pConnection->GetBDAddress());
-				pDeviceManager->SendHCICommand (&Cmd, sizeof Cmd);
+				pDeviceManager->SendHCICommand<TBTHCILinkKeyRequestNegativeReplyCommand> (
+					pConnection->GetBDAddress());
 			}
-			pDeviceManager->m_pConnection = NULL;
 
 			pDeviceManager->SetState(BTDeviceStateRunning);
 			} break;
@@ -615,8 +653,8 @@ void CBTHCIEventCommandComplete::Process(void *pLayer, u16 nLength)
 		case OP_CODE_WRITE_CLASS_OF_DEVICE:
 			if (pDeviceManager->CheckState(BTDeviceStateWriteClassOfDevicePending)) {
 
-			CBTHCIWriteLocalNameCommand Cmd(pDeviceManager->m_LocalName);
-			pDeviceManager->SendHCICommand (&Cmd, sizeof Cmd);
+			pDeviceManager->SendHCICommand<TBTHCIWriteLocalNameCommand> (
+				pDeviceManager->m_LocalName);
 
 			pDeviceManager->SetState(BTDeviceStateWriteLocalNamePending);
 			} break;
@@ -624,8 +662,8 @@ void CBTHCIEventCommandComplete::Process(void *pLayer, u16 nLength)
 		case OP_CODE_WRITE_LOCAL_NAME:
 			if (pDeviceManager->CheckState(BTDeviceStateWriteLocalNamePending)){
 
-			CBTHCIWriteScanEnableCommand Cmd(SCAN_ENABLE_BOTH_ENABLED);
-			pDeviceManager->SendHCICommand (&Cmd, sizeof Cmd);
+			pDeviceManager->SendHCICommand<TBTHCIWriteScanEnableCommand> (
+				SCAN_ENABLE_BOTH_ENABLED);
 
 			pDeviceManager->SetState(BTDeviceStateWriteScanEnabledPending);
 			} break;
@@ -656,7 +694,7 @@ void CBTHCIEventCommandStatus::Process(void *pLayer, u16 nLength)
 	assert (nLength >= sizeof (CBTHCIEventCommandStatus));
 	CBTDeviceManager *pDeviceManager = (CBTDeviceManager *)pLayer;
 
-	pDeviceManager->SetHCICommandPackets (NumHCICommandPackets);
+	pDeviceManager->SetHCICommandPackets (NumHCICommandPackets, CommandOpCode);
 }
 
 CBTHCIEventLinkKeyRequest::CBTHCIEventLinkKeyRequest()
@@ -673,12 +711,16 @@ void CBTHCIEventLinkKeyRequest::Process(void *pLayer, u16 nLength)
 {
 	assert (nLength >= sizeof (CBTHCIEventLinkKeyRequest));
 	CBTLogicalLayer *pLogicalLayer = (CBTLogicalLayer *) pLayer;
+	CBTConnection* pConnection = pLogicalLayer->GetConnection(BDAddr);
 
-	pLogicalLayer->GetDeviceManager()->SetConnection(
-		pLogicalLayer->GetConnectionPtr());
-	pLogicalLayer->GetConnectionPtr()->SetBDAddress(BDAddr);
-	CBTHCIReadStoredLinkKeyCommand Cmd(BDAddr);
-	pLogicalLayer->SendHCICommand (&Cmd, sizeof Cmd);
+	if (!pConnection
+	    || !pLogicalLayer->GetDeviceManager()->PushLinkKeyRequest(pConnection)) {
+		pLogicalLayer->SendHCICommand<TBTHCILinkKeyRequestNegativeReplyCommand> (
+			BDAddr);
+		return;
+	}
+	pLogicalLayer->SendHCICommand<TBTHCIReadStoredLinkKeyCommand> (
+		BDAddr, RETURN_LINK_KEY_FOR_SPECIFIED_BD_ADDR);
 }
 
 CBTHCIEventLinkKeyNotification::CBTHCIEventLinkKeyNotification()
@@ -696,12 +738,12 @@ void CBTHCIEventLinkKeyNotification::Process(void *pLayer, u16 nLength)
 	assert (nLength >= sizeof (CBTHCIEventLinkKeyNotification));
 	LOG_DEBUG("LMP Link Key Notification Event\r\n");
 	CBTLogicalLayer *pLogicalLayer = (CBTLogicalLayer *) pLayer;
-	CBTConnection*& m_pConnection = pLogicalLayer->GetConnectionPtr();
-	assert (m_pConnection != NULL);
-	if (m_pConnection) {
-		m_pConnection->SetLinkKey (LinkKey);
-		CBTHCIWriteStoredLinkKeyCommand Cmd(BDAddr, LinkKey);
-		pLogicalLayer->SendHCICommand (&Cmd, sizeof Cmd);
+	CBTConnection* pConnection = pLogicalLayer->GetConnection(BDAddr);
+	assert (pConnection != NULL);
+	if (pConnection) {
+		pConnection->SetLinkKey (LinkKey);
+		pLogicalLayer->SendHCICommand<TBTHCIWriteStoredLinkKeyCommand> (
+			1, BDAddr, LinkKey);
 	} else {
 		LOG_DEBUG("LMP Link Key Not Found\r\n");
 	}
@@ -721,12 +763,11 @@ void CBTHCIEventReturnLinkKeys::Process(void *pLayer, u16 nLength)
 {
 	assert (nLength >= sizeof (CBTHCIEventReturnLinkKeys));
 	CBTLogicalLayer *pLogicalLayer = (CBTLogicalLayer *) pLayer;
-	CBTConnection*& m_pConnection = pLogicalLayer->GetConnectionPtr();
 
 	LOG_DEBUG("LMP: Received %d Link Key\r\n", NumKeys);
 	if (NumKeys) {
-		assert(m_pConnection != NULL);
-		m_pConnection->SetLinkKey (LinkKey, true);
+		CBTConnection* pConnection = pLogicalLayer->GetConnection(BDAddr);
+		if (pConnection) pConnection->SetLinkKey (LinkKey, true);
 	} 
 }
 
@@ -744,12 +785,16 @@ void CBTHCIEventPINCodeRequest::Process(void *pLayer, u16 nLength)
 {
 	assert (nLength >= sizeof (CBTHCIEventPINCodeRequest));
 	CBTLogicalLayer *pLogicalLayer = (CBTLogicalLayer *) pLayer;
-	CBTConnection*& pConnection = pLogicalLayer->GetConnectionPtr();
+	CBTConnection* pConnection = pLogicalLayer->GetConnection(BDAddr);
 
 	LOG_DEBUG("LMP: Got a PIN Code request\r\n");
-	CBTHCIPINCodeRequestReplyCommand Cmd(
-		BDAddr, pConnection->GetPINSize(), (u8*)pConnection->GetPIN());
-	pLogicalLayer->SendHCICommand (&Cmd, sizeof Cmd);
+	if (!pConnection) {
+		pLogicalLayer->SendHCICommand<TBTHCIPINCodeRequestNegativeReplyCommand> (
+			BDAddr);
+		return;
+	}
+	pLogicalLayer->SendHCICommand<TBTHCIPINCodeRequestReplyCommand> (
+		BDAddr, pConnection->GetPINSize(), pConnection->GetPIN());
 }
 
 CBTHCIEventMaxSlotsChange::CBTHCIEventMaxSlotsChange()
@@ -766,11 +811,8 @@ void CBTHCIEventMaxSlotsChange::Process(void *pLayer, u16 nLength)
 {
 	assert (nLength >= sizeof (CBTHCIEventMaxSlotsChange));
 	CBTLogicalLayer *pLogicalLayer = (CBTLogicalLayer *) pLayer;
-	CPtrArray& rConnections = pLogicalLayer->GetConnections();
+	CBTConnection *pConnection = pLogicalLayer->GetConnection(ConnectionHandle);
 
-	for (int i=0; i<rConnections.GetCount(); i++) {
-		CBTConnection *pConnection = (CBTConnection *)rConnections[i];
-		if (pConnection && pConnection->HasConnectionHandle(ConnectionHandle))
-			pConnection->SetSlots(LMPMaxSlots);
-	}
+	if (pConnection)
+		pConnection->SetSlots(LMPMaxSlots);
 }
@@ -43,6 +43,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <task.h>
 
 static const char FromHCILayer[] = "bthci";
 
@@ -54,15 +55,27 @@ CBTHCILayer::CBTHCILayer (TBTCOD nClassOfDevice, const char *pLocalName)
 	m_pHCITransportUSB (0),
 #endif
 	m_DeviceManager (this, &m_DeviceEventQueue, nClassOfDevice, pLocalName),
+	m_CommandQueue (BT_HCI_COMMAND_QUEUE_SIZE, BT_MAX_HCI_COMMAND_SIZE),
+	m_DeviceEventQueue (BT_HCI_DEVICE_EVENT_QUEUE_SIZE, BT_MAX_HCI_EVENT_SIZE),
+	m_LinkEventQueue (BT_HCI_LINK_EVENT_QUEUE_SIZE, BT_MAX_HCI_EVENT_SIZE),
+	m_RxDataQueue (BT_HCI_RX_DATA_QUEUE_SIZE, sizeof (CBTPacket *)),
+	m_nNextLink (0),
 	m_pEventBuffer (0),
 	m_nEventLength (0),
 	m_nEventFragmentOffset (0),
-	m_pDataBuffer (0),
-	m_nDataLength (0),
-	m_nDataFragmentOffset (0),
-	m_pBuffer (0),
+	m_nRxDropped (0),
+	m_nRxTimeouts (0),
+	m_nEventDrops (0),
 	m_nCommandPackets (1),
-	m_nDataPackets (1)
+	m_nCommandsPending (0),
+	m_nDataPackets (1),			// until Read Buffer Size completes
+	m_nMaxDataPackets (1),
+	m_nACLDataLength (BT_MAX_DATA_SIZE - sizeof (CBTHCIACLData)),
+	m_bHostFlowControl (FALSE)
+#ifdef BT_HAVE_STATS
+	, m_bCommandTimed (FALSE),
+	m_nCommandSent (0)
+#endif
 {
 	assert (s_pThis == 0);
 	s_pThis = this;
@@ -75,14 +88,21 @@ CBTHCILayer::~CBTHCILayer (void)
 #endif
 	m_pHCITransportUART = 0;
 
-	free (m_pBuffer);
-	m_pBuffer = 0;
 
 	free (m_pEventBuffer);
 	m_pEventBuffer = 0;
 
-	free (m_pDataBuffer);
-	m_pDataBuffer = 0;
+	for (unsigned i = 0; i < BT_HCI_MAX_ACL_LINKS; i++) {
+		if (m_Links[i].pRxPacket != 0) {
+			m_Links[i].pRxPacket->Release ();
+			m_Links[i].pRxPacket = 0;
+		}
+	}
+
+	CBTPacket *pPacket;
+	while (m_RxDataQueue.Dequeue (&pPacket) > 0) {
+		pPacket->Release ();
+	}
 
 	s_pThis = 0;
 }
@@ -94,7 +114,7 @@ boolean CBTHCILayer::Initialize (void)
 		CDeviceNameService::Get ()->GetDevice ("ubt1", FALSE);
 	if (m_pHCITransportUSB == 0) {
 #endif
-		m_pHCITransportUART = (CBTUARTTransport *) 
+		m_pHCITransportUART = (TBTHCITransport *) 
 			CDeviceNameService::Get ()->GetDevice ("ttyBT1", FALSE);
 		if (m_pHCITransportUART == 0) {
 			LOG_DEBUG ("Bluetooth controller not found\r\n");
@@ -107,12 +127,6 @@ boolean CBTHCILayer::Initialize (void)
 	m_pEventBuffer = (u8 *)malloc(BT_MAX_HCI_EVENT_SIZE);
 	assert (m_pEventBuffer != 0);
 
-	m_pDataBuffer = (u8 *)malloc(BT_MAX_DATA_SIZE);
-	assert (m_pEventBuffer != 0);
-
-	m_pBuffer = (u8 *)malloc(BT_MAX_DATA_SIZE);
-	assert (m_pBuffer != 0);
-
 #if BTUSB
 	if (m_pHCITransportUSB != 0) {
 		m_pHCITransportUSB->RegisterHCIEventHandler (EventStub);
@@ -145,54 +159,194 @@ void CBTHCILayer::Process (void)
 #if BTUSB
 	assert (m_pHCITransportUSB != 0 || m_pHCITransportUART != 0);
 #endif
-	assert (m_pBuffer != 0);
+	BT_STATS_START (nStart);
 
 	unsigned nLength;
 
-	// Send command
-	while (   m_nCommandPackets > 0
-	       && (nLength = m_CommandQueue.Dequeue (m_pBuffer)) > 0) {
+	// buffers freed first, so the controller can fill them in this pass
+	if (m_bHostFlowControl) {
+		ReportCompletedData ();
+	}
+
+	m_pHCITransportUART->Process ();
+
+	// Send command (only take what the transport can take right now),
+	// the transport copies it from the queue slot it was encoded in
+	const void *pCommand;
+	while (   m_nCommandsPending < m_nCommandPackets
+	       && m_pHCITransportUART->IsTxReady (BT_MAX_HCI_COMMAND_SIZE)
+	       && (pCommand = m_CommandQueue.Peek (&nLength)) != 0) {
 #if BTUSB
-		if (  m_pHCITransportUSB != 0
-		    ? !m_pHCITransportUSB->SendHCICommand (m_pBuffer, nLength)
-		    : !m_pHCITransportUART->SendHCICommand (m_pBuffer, nLength))
+		boolean bSent =   m_pHCITransportUSB != 0
+				? m_pHCITransportUSB->SendHCICommand (pCommand, nLength)
+				: m_pHCITransportUART->SendHCICommand (pCommand, nLength);
 #else
-		if ( !m_pHCITransportUART->SendHCICommand (m_pBuffer, nLength))
+		boolean bSent = m_pHCITransportUART->SendHCICommand (pCommand, nLength);
 #endif
-		{
-			LOG_DEBUG ("HCI command dropped\r\n");
+		if (!bSent) {
+			// kept at the head, it goes out on a later pass
+			LOG_DEBUG ("HCI command refused\r\n");
 			break;
 		}
-		m_nCommandPackets--;
+		m_CommandQueue.Discard ();
+		m_nCommandsPending++;
+#ifdef BT_HAVE_STATS
+		// time the oldest outstanding command only
+		if (!m_bCommandTimed) {
+			m_nCommandSent = CBTStats::Now ();
+			m_bCommandTimed = TRUE;
+		}
+#endif
 	}
 
-	// Send Data
-	while (   m_nDataPackets > 0
-	       && (nLength = m_TxDataQueue.Dequeue (m_pBuffer)) > 0) {
+	// Send data, one packet per link in turn, so that a bulk channel
+	// cannot take all controller buffers from a HID link; the transport
+	// copies the fragment from its queue slot
+	const void *pData;
+	for (unsigned nIdle = 0;
+	        nIdle < BT_HCI_MAX_ACL_LINKS
+	     && m_nDataPackets > 0
+	     && m_pHCITransportUART->IsTxReady (BT_MAX_DATA_SIZE); ) {
+		TBTACLLink *pLink = &m_Links[m_nNextLink];
+		if (++m_nNextLink == BT_HCI_MAX_ACL_LINKS) m_nNextLink = 0;
+
+		if (   pLink->nHandle == BT_HCI_NO_HANDLE
+		    || (pData = pLink->TxQueue.Peek (&nLength)) == 0) {
+			nIdle++;
+			continue;
+		}
+		nIdle = 0;
 #if BTUSB
 		if (  m_pHCITransportUSB != 0
-		    ? !m_pHCITransportUSB->SendHCIData (m_pBuffer, nLength)
-		    : !m_pHCITransportUART->SendHCIData (m_pBuffer, nLength))
+		    ? !m_pHCITransportUSB->SendHCIData (pData, nLength)
+		    : !m_pHCITransportUART->SendHCIData (pData, nLength))
 #else
-		if ( !m_pHCITransportUART->SendHCIData (m_pBuffer, nLength))
+		if ( !m_pHCITransportUART->SendHCIData (pData, nLength))
 #endif
 		{
-			LOG_DEBUG ("HCI data dropped\r\n");
+			// kept at the head, it goes out on a later pass
+			LOG_DEBUG ("HCI data refused\r\n");
 			break;
 		}
+		pLink->TxQueue.Discard ();
 		m_nDataPackets--;
+		pLink->nInFlight++;
 	}
+	BT_STATS_RECORD (BTStatsHCIProcess, nStart);
+
 	m_DeviceManager.Process ();
 }
 
-void CBTHCILayer::SendCommand (const void *pBuffer, unsigned nLength)
+boolean CBTHCILayer::SendCommand (u16 nOpCode, const void *pParameters, u8 nLength)
 {
-	m_CommandQueue.Enqueue (pBuffer, nLength);
+	assert (pParameters != 0 || nLength == 0);
+
+	u8 *pSlot = (u8 *) m_CommandQueue.BeginEnqueue (BT_HCI_COMMAND_HEADER_SIZE + nLength);
+	if (pSlot == 0) return FALSE;
+
+	pSlot[0] = nOpCode & 0xFF;
+	pSlot[1] = nOpCode >> 8;
+	pSlot[2] = nLength;
+	memcpy (pSlot + BT_HCI_COMMAND_HEADER_SIZE, pParameters, nLength);
+
+	m_CommandQueue.EndEnqueue (BT_HCI_COMMAND_HEADER_SIZE + nLength);
+
+	return TRUE;
 }
 
 void CBTHCILayer::SendData (const void *pBuffer, unsigned nLength)
 {
-	m_TxDataQueue.Enqueue (pBuffer, nLength);
+	assert (pBuffer != 0);
+	assert (nLength >= sizeof (CBTHCIACLData));
+
+	const CBTHCIACLData *pHeader = (const CBTHCIACLData *) pBuffer;
+	if (pHeader->DataTotalLength > m_nACLDataLength) {
+		LOG_DEBUG ("ACL packet exceeds controller buffer (%u)\r\n", m_nACLDataLength);
+		return;
+	}
+
+	TBTACLLink *pLink = GetLink (pHeader->ConnectionHandle);
+	if (pLink == 0) {
+		LOG_DEBUG ("ACL data for unknown handle 0x%03X\r\n",
+			   (unsigned) pHeader->ConnectionHandle);
+		return;
+	}
+
+	pLink->TxQueue.Enqueue (pBuffer, nLength);
+}
+
+boolean CBTHCILayer::SendData (u16 nConnectionHandle, const TBTScatter *pList, unsigned nEntries)
+{
+	assert (pList != 0);
+	assert (nEntries > 0);
+	assert (nEntries <= BT_HCI_MAX_SCATTER);
+
+	TBTACLLink *pLink = GetLink (nConnectionHandle);
+	if (pLink == 0) {
+		LOG_DEBUG ("ACL data for unknown handle 0x%03X\r\n", (unsigned) nConnectionHandle);
+		return FALSE;
+	}
+
+	unsigned nTotal = 0;
+	for (unsigned i = 0; i < nEntries; i++) {
+		nTotal += pList[i].nLength;
+	}
+	assert (nTotal > 0);
+
+	assert (m_nACLDataLength > 0);
+	unsigned nFragments = (nTotal + m_nACLDataLength - 1) / m_nACLDataLength;
+	if (pLink->TxQueue.GetFreeCount () < nFragments) {
+		return FALSE;			// a partial PDU would confuse the peer
+	}
+
+	// each fragment is its header plus the spans of the list it covers,
+	// the queue copies them once into its slot
+	TBTScatter Fragment[1 + BT_HCI_MAX_SCATTER];
+	unsigned nEntry = 0;
+	unsigned nOffset = 0;			// into pList[nEntry]
+
+	for (unsigned i = 0; i < nFragments; i++) {
+		unsigned nLength = nTotal < m_nACLDataLength ? nTotal : m_nACLDataLength;
+		nTotal -= nLength;
+
+		CBTHCIACLData Header;
+		Header.ConnectionHandle = nConnectionHandle;
+		Header.PacketBoundaryFlag = i == 0 ? BT_FIRST_PACKET : BT_CONTINUING_FRAGMENT_PACKET;
+		Header.BroadcastFlag = BT_NO_BROADCAST;
+		Header.DataTotalLength = nLength;
+
+		Fragment[0].pData = &Header;
+		Fragment[0].nLength = sizeof Header;
+		unsigned nSpans = 1;
+
+		while (nLength > 0) {
+			assert (nEntry < nEntries);
+			unsigned nSpan = pList[nEntry].nLength - nOffset;
+			if (nSpan > nLength) {
+				nSpan = nLength;
+			}
+
+			if (nSpan > 0) {
+				assert (nSpans < 1 + BT_HCI_MAX_SCATTER);
+				Fragment[nSpans].pData = (const u8 *) pList[nEntry].pData + nOffset;
+				Fragment[nSpans].nLength = nSpan;
+				nSpans++;
+			}
+
+			nLength -= nSpan;
+			nOffset += nSpan;
+			if (nOffset == pList[nEntry].nLength) {
+				nEntry++;
+				nOffset = 0;
+			}
+		}
+
+		if (!pLink->TxQueue.Enqueue (Fragment, nSpans)) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
 }
 
 boolean CBTHCILayer::ReceiveLinkEvent (void *pBuffer, unsigned *pResultLength)
@@ -208,27 +362,181 @@ boolean CBTHCILayer::ReceiveLinkEvent (void *pBuffer, unsigned *pResultLength)
 	return FALSE;
 }
 
-boolean CBTHCILayer::ReceiveData (void *pBuffer, unsigned *pResultLength)
+boolean CBTHCILayer::ReceiveData (CBTPacket **ppPacket)
 {
-	unsigned nLength = m_RxDataQueue.Dequeue (pBuffer);
-	if (nLength > 0) {
-		assert (pResultLength != 0);
-		*pResultLength = nLength;
+	assert (ppPacket != 0);
+
+	CBTPacket *pPacket;
+	unsigned nLength;
+	while ((nLength = m_RxDataQueue.Dequeue (&pPacket)) > 0) {
+		assert (nLength == sizeof (CBTPacket *));
+		assert (pPacket != 0);
+
+		// the slot is free again for the controller
+		TBTACLLink *pLink = GetLink (((CBTHCIACLData *) pPacket->GetData ())->ConnectionHandle);
+		if (pLink != 0) {
+			pLink->nRxCompleted++;
+		}
+
+		*ppPacket = Reassemble (pPacket);
+		if (*ppPacket != 0) {
+			return TRUE;
+		}
+	}
+
+	// only with all fragments received taken, a slow task does not
+	// time out a PDU whose next fragment is already waiting
+	ExpireReassembly ();
+
+	return FALSE;
+}
+
+void CBTHCILayer::SetCommandPackets (unsigned nCommandPackets, u16 nOpCode)
+{
+	// an absolute count as of the event, the commands still pending are
+	// held against it; no more are sent than their answers find room
+	m_nCommandPackets =   nCommandPackets < BT_HCI_MAX_COMMAND_PACKETS
+			    ? nCommandPackets : BT_HCI_MAX_COMMAND_PACKETS;
+	if (nOpCode == 0 || m_nCommandsPending == 0) {
+		return;
+	}
+	m_nCommandsPending--;
+
+#ifdef BT_HAVE_STATS
+	if (m_bCommandTimed) {
+		CBTStats::Record (BTStatsCommandRoundTrip, m_nCommandSent);
+		m_bCommandTimed = FALSE;
+	}
+#endif
+}
+
+void CBTHCILayer::ResetCommandPackets (void)
+{
+	m_nCommandPackets = 1;
+	m_nCommandsPending = 0;
+
+#ifdef BT_HAVE_STATS
+	m_bCommandTimed = FALSE;
+#endif
+}
+
+void CBTHCILayer::SetBufferSize (unsigned nACLDataLength, unsigned nACLDataPackets)
+{
+	if (nACLDataPackets == 0) {
+		nACLDataPackets = 1;		// keep data moving, one at a time
+	}
+
+	unsigned nInFlight = 0;
+	for (unsigned i = 0; i < BT_HCI_MAX_ACL_LINKS; i++) {
+		nInFlight += m_Links[i].nInFlight;
+	}
+
+	m_nMaxDataPackets = nACLDataPackets;
+	m_nDataPackets = nACLDataPackets > nInFlight ? nACLDataPackets - nInFlight : 0;
+
+	// our own buffers limit the packet size too
+	if (nACLDataLength < BT_MAX_DATA_SIZE - sizeof (CBTHCIACLData)) {
+		m_nACLDataLength = nACLDataLength;
+	}
+
+	LOG_DEBUG ("ACL buffers: %u x %u bytes\r\n", nACLDataPackets, nACLDataLength);
+}
 
+boolean CBTHCILayer::AddLink (u16 nConnectionHandle)
+{
+	assert (nConnectionHandle != BT_HCI_NO_HANDLE);
+
+	if (GetLink (nConnectionHandle) != 0) {
 		return TRUE;
 	}
 
+	for (unsigned i = 0; i < BT_HCI_MAX_ACL_LINKS; i++) {
+		TBTACLLink *pLink = &m_Links[i];
+		if (pLink->nHandle == BT_HCI_NO_HANDLE) {
+			pLink->TxQueue.Flush ();
+			pLink->nInFlight = 0;
+			pLink->nRxMTU = BT_HCI_RX_DEFAULT_MTU;
+			pLink->nHandle = nConnectionHandle;
+
+			return TRUE;
+		}
+	}
+
+	LOG_DEBUG ("No ACL link free for handle 0x%03X\r\n", (unsigned) nConnectionHandle);
+
 	return FALSE;
 }
 
-void CBTHCILayer::SetCommandPackets (unsigned nCommandPackets)
+void CBTHCILayer::RemoveLink (u16 nConnectionHandle)
 {
-	m_nCommandPackets += nCommandPackets;
+	TBTACLLink *pLink = GetLink (nConnectionHandle);
+	if (pLink == 0) {
+		return;
+	}
+
+	// the controller flushes the packets of a closed link without
+	// reporting them as completed
+	m_nDataPackets += pLink->nInFlight;
+	pLink->nInFlight = 0;
+
+	pLink->nHandle = BT_HCI_NO_HANDLE;
+	pLink->TxQueue.Flush ();
+	pLink->nRxCompleted = 0;		// the controller frees them itself
+
+	if (pLink->pRxPacket != 0) {
+		pLink->pRxPacket->Release ();
+		pLink->pRxPacket = 0;
+	}
+}
+
+void CBTHCILayer::SetReceiveMTU (u16 nConnectionHandle, unsigned nMTU)
+{
+	// the channels of a link share its reassembly, the largest MTU wins
+	TBTACLLink *pLink = GetLink (nConnectionHandle);
+	if (pLink != 0 && nMTU > pLink->nRxMTU) {
+		pLink->nRxMTU = nMTU;
+	}
+}
+
+void CBTHCILayer::CompleteDataPackets (u16 nConnectionHandle, unsigned nPackets)
+{
+	// credits of a removed link were returned already
+	TBTACLLink *pLink = GetLink (nConnectionHandle);
+	if (pLink == 0) {
+		return;
+	}
+
+	if (nPackets > pLink->nInFlight) {
+		LOG_DEBUG ("Handle 0x%03X completed %u packets, %u sent\r\n",
+			   (unsigned) nConnectionHandle, nPackets, pLink->nInFlight);
+		nPackets = pLink->nInFlight;
+	}
+
+	pLink->nInFlight -= nPackets;
+	m_nDataPackets += nPackets;
+	assert (m_nDataPackets <= m_nMaxDataPackets);
 }
 
-void CBTHCILayer::SetDataPackets (unsigned nDataPackets)
+unsigned CBTHCILayer::GetDataPacketsInFlight (u16 nConnectionHandle) const
 {
-	m_nDataPackets += nDataPackets;
+	for (unsigned i = 0; i < BT_HCI_MAX_ACL_LINKS; i++) {
+		if (m_Links[i].nHandle == nConnectionHandle) {
+			return m_Links[i].nInFlight;
+		}
+	}
+
+	return 0;
+}
+
+TBTACLLink *CBTHCILayer::GetLink (u16 nConnectionHandle)
+{
+	for (unsigned i = 0; i < BT_HCI_MAX_ACL_LINKS; i++) {
+		if (m_Links[i].nHandle == nConnectionHandle) {
+			return &m_Links[i];
+		}
+	}
+
+	return 0;
 }
 
 CBTDeviceManager *CBTHCILayer::GetDeviceManager (void)
@@ -236,6 +544,42 @@ CBTDeviceManager *CBTHCILayer::GetDeviceManager (void)
 	return &m_DeviceManager;
 }
 
+unsigned CBTHCILayer::GetReceiveDrops (void) const
+{
+	return   m_RxDataQueue.GetOverflows () + m_RxDataQueue.GetDrops ()
+	       + m_nRxDropped + m_nEventDrops;
+}
+
+void CBTHCILayer::GetStats (tBT_stats *pStats) const
+{
+	assert (pStats != 0);
+
+	pStats->command_queue_high = m_CommandQueue.GetHighWater ();
+	pStats->device_event_queue_high = m_DeviceEventQueue.GetHighWater ();
+	pStats->link_event_queue_high = m_LinkEventQueue.GetHighWater ();
+	pStats->rx_data_queue_high = m_RxDataQueue.GetHighWater ();
+	pStats->rx_reassembly_dropped = m_nRxDropped;
+	pStats->rx_reassembly_timeouts = m_nRxTimeouts;
+
+	pStats->queue_overflows =   m_CommandQueue.GetOverflows ()
+				  + m_DeviceEventQueue.GetOverflows ()
+				  + m_LinkEventQueue.GetOverflows ()
+				  + m_RxDataQueue.GetOverflows ();
+	pStats->queue_drops =   m_CommandQueue.GetDrops ()
+			      + m_DeviceEventQueue.GetDrops ()
+			      + m_LinkEventQueue.GetDrops ()
+			      + m_RxDataQueue.GetDrops ();
+
+	for (unsigned i = 0; i < BT_HCI_MAX_ACL_LINKS; i++) {
+		const CBTQueue *pQueue = &m_Links[i].TxQueue;
+		if (pQueue->GetHighWater () > pStats->tx_data_queue_high) {
+			pStats->tx_data_queue_high = pQueue->GetHighWater ();
+		}
+		pStats->queue_overflows += pQueue->GetOverflows ();
+		pStats->queue_drops += pQueue->GetDrops ();
+	}
+}
+
 void CBTHCILayer::EventHandler (const void *pBuffer, unsigned nLength)
 {
 	assert (pBuffer != 0);
@@ -260,16 +604,21 @@ void CBTHCILayer::EventHandler (const void *pBuffer, unsigned nLength)
 	if (m_nEventFragmentOffset < m_nEventLength) return;
 
 	CBTHCIEvent *pHeader = (CBTHCIEvent *) m_pEventBuffer;
+	boolean bQueued;
 	switch (pHeader->EventCode) {
 	case BT_EVENT_CODE_COMMAND_COMPLETE:
 	case BT_EVENT_CODE_COMMAND_STATUS:
-		m_DeviceEventQueue.Enqueue (m_pEventBuffer, m_nEventLength);
+		bQueued = m_DeviceEventQueue.Enqueue (m_pEventBuffer, m_nEventLength);
 		break;
 
 	default:
-		m_LinkEventQueue.Enqueue (m_pEventBuffer, m_nEventLength);
+		bQueued = m_LinkEventQueue.Enqueue (m_pEventBuffer, m_nEventLength);
 		break;
 	}
+	if (!bQueued) {
+		m_nEventDrops++;
+		LOG_DEBUG ("HCI event 0x%02X dropped\r\n", (unsigned) pHeader->EventCode);
+	}
 
 	m_nEventLength = 0;
 	m_nEventFragmentOffset = 0;
@@ -281,55 +630,192 @@ void CBTHCILayer::EventStub (const void *pBuffer, unsigned nLength)
 	s_pThis->EventHandler (pBuffer, nLength);
 }
 
-void CBTHCILayer::DataHandler (const void *pBuffer, unsigned nLength)
+void CBTHCILayer::DataHandler (CBTPacket *pPacket)
 {
-	assert (pBuffer != 0);
-	assert (nLength > 0);
+	assert (pPacket != 0);
 
-	if (m_nDataFragmentOffset == 0) {
-		if (nLength < sizeof (CBTHCIACLData)) {
-			LOG_DEBUG ("Short data ignored\r\n");
-			return;
+	if (pPacket->GetLength () < sizeof (CBTHCIACLData)) {
+		LOG_DEBUG ("Short data ignored\r\n");
+		pPacket->Release ();
+		return;
+	}
+
+	// fragments are reassembled by the HCI task, large PDUs need the heap
+	if (!m_RxDataQueue.Enqueue (&pPacket, sizeof (CBTPacket *))) {
+		pPacket->Release ();
+	}
+}
+
+CBTPacket *CBTHCILayer::Reassemble (CBTPacket *pPacket)
+{
+	assert (pPacket != 0);
+
+	CBTHCIACLData *pHeader = (CBTHCIACLData *) pPacket->GetData ();
+	unsigned nFragment = pPacket->GetLength () - sizeof (CBTHCIACLData);
+	TBTACLLink *pLink = GetLink (pHeader->ConnectionHandle);
+
+	if (pHeader->PacketBoundaryFlag == BT_CONTINUING_FRAGMENT_PACKET) {
+		if (pLink == 0 || pLink->pRxPacket == 0) {
+			LOG_DEBUG ("Continuing fragment ignored\r\n");
+			pPacket->Release ();
+			return 0;
 		}
-		CBTHCIACLData *pHeader = (CBTHCIACLData *) pBuffer;
 
-		assert (m_nDataLength == 0);
-		assert (pHeader->DataTotalLength <= BT_MAX_DATA_SIZE);
-		m_nDataLength = sizeof (CBTHCIACLData) + pHeader->DataTotalLength;
+		CBTPacket *pPDU = pLink->pRxPacket;
+		if (nFragment > pPDU->GetTailroom ()) {
+			LOG_DEBUG ("Fragment exceeds PDU length\r\n");
+			DropReassembly (pLink);
+			pPacket->Release ();
+			return 0;
+		}
+
+		memcpy (pPDU->Put (nFragment), pHeader->Data, nFragment);
+		CBTPacketPool::CountCopy (BTCopyLayerHCI, nFragment);
+		pPacket->Release ();
+		pLink->nRxLast = getClockTicks ();
+	} else {
+		if (pLink != 0 && pLink->pRxPacket != 0) {
+			LOG_DEBUG ("Incomplete data dropped\r\n");
+			DropReassembly (pLink);
+		}
+
+		// a complete PDU is passed on as it is, whether its link is known or not,
+		// one too short for the L2CAP header is the start of a partial PDU
+		if (nFragment >= 4) {
+			unsigned nPayload = pHeader->Data[0] | (pHeader->Data[1] << 8);
+			if (nFragment >= 4 + nPayload) {
+				return pPacket;
+			}
+		}
+
+		if (pLink == 0) {
+			LOG_DEBUG ("Fragment for unknown handle 0x%03X\r\n",
+				   (unsigned) pHeader->ConnectionHandle);
+			m_nRxDropped++;
+			pPacket->Release ();
+			return 0;
+		}
+
+		pLink->pRxPacket = pPacket;
+		pLink->nRxLength = 0;
+		pLink->nRxLast = getClockTicks ();
 	}
 
-	assert (m_pDataBuffer != 0);
+	if (   !SizeReassembly (pLink)
+	    || pLink->nRxLength == 0
+	    || pLink->pRxPacket->GetLength () < pLink->nRxLength) {
+		return 0;
+	}
 
-	CBTHCIACLData *pHeader = (CBTHCIACLData *) m_pDataBuffer;
-	switch (pHeader->PacketBoundaryFlag) {
-	case BT_CONTINUING_FRAGMENT_PACKET:
-		memcpy (m_pDataBuffer + m_nDataFragmentOffset,
-			(u8*)pBuffer + sizeof(CBTHCIACLData),
-			nLength - sizeof(CBTHCIACLData));
-		m_nDataFragmentOffset += nLength - sizeof(CBTHCIACLData);
-		break;
+	pPacket = pLink->pRxPacket;
+	pLink->pRxPacket = 0;
 
-	case BT_FIRST_PACKET:
-		memcpy (m_pDataBuffer + m_nDataFragmentOffset, pBuffer, nLength);
-		m_nDataFragmentOffset += nLength;
-		break;
+	CBTHCIACLData *pFirst = (CBTHCIACLData *) pPacket->GetData ();
+	pFirst->DataTotalLength = pPacket->GetLength () - sizeof (CBTHCIACLData);
 
-	default:
-		memcpy (m_pDataBuffer + m_nDataFragmentOffset, pBuffer, nLength);
-		m_nDataFragmentOffset += nLength;
-		break;
+	return pPacket;
+}
+
+boolean CBTHCILayer::SizeReassembly (TBTACLLink *pLink)
+{
+	assert (pLink != 0);
+	CBTPacket *pPDU = pLink->pRxPacket;
+	assert (pPDU != 0);
+
+	// the L2CAP basic header tells the length of the whole PDU
+	if (   pLink->nRxLength != 0
+	    || pPDU->GetLength () < sizeof (CBTHCIACLData) + 4) {
+		return TRUE;
 	}
 
-	if (m_nDataFragmentOffset < m_nDataLength) return;
+	const u8 *pL2CAP = pPDU->GetData () + sizeof (CBTHCIACLData);
+	unsigned nPayload = pL2CAP[0] | (pL2CAP[1] << 8);
+	if (nPayload > pLink->nRxMTU) {
+		LOG_DEBUG ("PDU exceeds MTU (%u)\r\n", pLink->nRxMTU);
+		DropReassembly (pLink);
+		return FALSE;
+	}
+	pLink->nRxLength = sizeof (CBTHCIACLData) + 4 + nPayload;
+
+	// grow into a large packet, only the fragments so far are copied
+	if (   pPDU->GetLength () < pLink->nRxLength
+	    && pLink->nRxLength - pPDU->GetLength () > pPDU->GetTailroom ()) {
+		CBTPacket *pLarge = CBTPacketPool::Get ()->AllocLarge (pLink->nRxLength);
+		if (pLarge == 0) {
+			LOG_DEBUG ("No memory for PDU\r\n");
+			DropReassembly (pLink);
+			return FALSE;
+		}
 
-	m_RxDataQueue.Enqueue (m_pDataBuffer, m_nDataLength);
+		memcpy (pLarge->Put (pPDU->GetLength ()), pPDU->GetData (), pPDU->GetLength ());
+		CBTPacketPool::CountCopy (BTCopyLayerHCI, pPDU->GetLength ());
+		pPDU->Release ();
+		pLink->pRxPacket = pLarge;
+	}
+
+	return TRUE;
+}
 
-	m_nDataLength = 0;
-	m_nDataFragmentOffset = 0;
+void CBTHCILayer::DropReassembly (TBTACLLink *pLink)
+{
+	assert (pLink != 0);
+	assert (pLink->pRxPacket != 0);
+
+	pLink->pRxPacket->Release ();
+	pLink->pRxPacket = 0;
+
+	m_nRxDropped++;
+}
+
+void CBTHCILayer::ExpireReassembly (void)
+{
+	unsigned nNow = getClockTicks ();
+
+	for (unsigned i = 0; i < BT_HCI_MAX_ACL_LINKS; i++) {
+		TBTACLLink *pLink = &m_Links[i];
+		if (   pLink->pRxPacket != 0
+		    && nNow - pLink->nRxLast > BT_HCI_RX_REASSEMBLY_TIMEOUT) {
+			LOG_DEBUG ("Partial PDU on handle 0x%03X timed out\r\n",
+				   (unsigned) pLink->nHandle);
+			DropReassembly (pLink);
+			m_nRxTimeouts++;
+		}
+	}
+}
+
+// Host Number Of Completed Packets is sent without a command slot and is
+// not answered, a count the transport does not take now is sent later
+void CBTHCILayer::ReportCompletedData (void)
+{
+	for (unsigned i = 0; i < BT_HCI_MAX_ACL_LINKS; i++) {
+		TBTACLLink *pLink = &m_Links[i];
+		if (   pLink->nHandle == BT_HCI_NO_HANDLE
+		    || pLink->nRxCompleted == 0) {
+			continue;
+		}
+
+		u8 Command[TBTHCIHostNumberOfCompletedPacketsCommand::Length];
+		unsigned nLength = TBTHCIHostNumberOfCompletedPacketsCommand::Encode (
+					Command, 1, pLink->nHandle, pLink->nRxCompleted);
+		if (!m_pHCITransportUART->IsTxReady (nLength)) {
+			break;
+		}
+#if BTUSB
+		boolean bSent =   m_pHCITransportUSB != 0
+				? m_pHCITransportUSB->SendHCICommand (Command, nLength)
+				: m_pHCITransportUART->SendHCICommand (Command, nLength);
+#else
+		boolean bSent = m_pHCITransportUART->SendHCICommand (Command, nLength);
+#endif
+		if (!bSent) {
+			break;
+		}
+		pLink->nRxCompleted = 0;
+	}
 }
 
-void CBTHCILayer::DataStub (const void *pBuffer, unsigned nLength)
+void CBTHCILayer::DataStub (CBTPacket *pPacket)
 {
 	assert (s_pThis != 0);
-	s_pThis->DataHandler (pBuffer, nLength);
+	s_pThis->DataHandler (pPacket);
 }
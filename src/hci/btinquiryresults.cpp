@@ -47,8 +47,7 @@ CBTInquiryResults::CBTInquiryResults (void)
 CBTInquiryResults::~CBTInquiryResults (void)
 {
 	for (unsigned nResponse=0; nResponse<m_Responses.GetCount(); nResponse++) {
-		TBTInquiryResponse *pResponse = (TBTInquiryResponse *)
-			m_Responses[nResponse];
+		TBTInquiryResponse *pResponse = m_Responses[nResponse];
 		assert (pResponse != 0);
 
 		free(pResponse);
@@ -82,8 +81,7 @@ boolean CBTInquiryResults::SetRemoteName (
 	assert (pEvent != 0);
 
 	for (unsigned nResponse=0; nResponse<m_Responses.GetCount(); nResponse++) {
-		TBTInquiryResponse *pResponse = (TBTInquiryResponse *) 
-			m_Responses[nResponse];
+		TBTInquiryResponse *pResponse = m_Responses[nResponse];
 		assert (pResponse != 0);
 
 		if (memcmp (pResponse->BDAddress,pEvent->BDAddr,BT_BD_ADDR_SIZE) == 0) {
@@ -103,7 +101,7 @@ unsigned CBTInquiryResults::GetCount (void) const
 
 const u8 *CBTInquiryResults::GetBDAddress (unsigned nResponse) const
 {
-	TBTInquiryResponse *pResponse = (TBTInquiryResponse*)m_Responses[nResponse];
+	TBTInquiryResponse *pResponse = m_Responses[nResponse];
 	assert (pResponse != 0);
 
 	return pResponse->BDAddress;
@@ -111,7 +109,7 @@ const u8 *CBTInquiryResults::GetBDAddress (unsigned nResponse) const
 
 const u8 *CBTInquiryResults::GetClassOfDevice (unsigned nResponse) const
 {
-	TBTInquiryResponse *pResponse = (TBTInquiryResponse*)m_Responses[nResponse];
+	TBTInquiryResponse *pResponse = m_Responses[nResponse];
 	assert (pResponse != 0);
 
 	return (u8 *)&pResponse->ClassOfDevice;
@@ -119,7 +117,7 @@ const u8 *CBTInquiryResults::GetClassOfDevice (unsigned nResponse) const
 
 const u8 *CBTInquiryResults::GetRemoteName (unsigned nResponse) const
 {
-	TBTInquiryResponse *pResponse = (TBTInquiryResponse*)m_Responses[nResponse];
+	TBTInquiryResponse *pResponse = m_Responses[nResponse];
 	assert (pResponse != 0);
 
 	return pResponse->RemoteName;
@@ -127,7 +125,7 @@ const u8 *CBTInquiryResults::GetRemoteName (unsigned nResponse) const
 
 u8 CBTInquiryResults::GetPageScanRepetitionMode (unsigned nResponse) const
 {
-	TBTInquiryResponse *pResponse = (TBTInquiryResponse*)m_Responses[nResponse];
+	TBTInquiryResponse *pResponse = m_Responses[nResponse];
 	assert (pResponse != 0);
 
 	return pResponse->PageScanRepetitionMode;
@@ -136,8 +134,7 @@ u8 CBTInquiryResults::GetPageScanRepetitionMode (unsigned nResponse) const
 bool CBTInquiryResults::HasDevice (TBTCOD nClassOfDevice) const
 {
 	for (unsigned nResponse=0; nResponse<m_Responses.GetCount(); nResponse++) {
-		TBTInquiryResponse *pResponse = (TBTInquiryResponse *) 
-			m_Responses[nResponse];
+		TBTInquiryResponse *pResponse = m_Responses[nResponse];
 		assert (pResponse != 0);
 
 		if (pResponse->ClassOfDevice.MinorDeviceClass == 
@@ -41,7 +41,9 @@
 #include <bluetooth/btevent.h>
 #include <bluetooth/btdevice.h>
 #include <bluetooth/btdata.h>
+#include <bluetooth/btstats.h>
 #include <synchronize.h>
+#include <task.h>
 #include <logger.h>
 #include <assert.h>
 #include <string.h>
@@ -58,7 +60,16 @@ CBTConnection::CBTConnection(void)
 	memset(RemoteName, 0, sizeof(RemoteName));
 	memset((u8*)&ClassOfDevice, 0, sizeof(ClassOfDevice));
 	memset(BDAddr, 0, sizeof(BDAddr));
+	ConnectionHandle = BT_HCI_NO_HANDLE;
 	ConnectionState = BTConnectionStateDisconnected;
+	PageScanRepetitionMode = 0;
+	PINSize = 0;
+	LinkKeyValid = false;
+	Status = 0;
+	Role = ROLE_MASTER;
+	Device = 0;
+	CommandDone = TRUE;
+	CommandWaitTask = 0;
 }	
 
 bool CBTConnection::IsHID(void)
@@ -136,7 +147,12 @@ CBTDevice* CBTConnection::GetDevice (void) const
 	return Device;
 }
 
-const u8 CBTConnection::GetPINSize (void) const
+u16 CBTConnection::GetConnectionHandle (void) const
+{
+	return ConnectionHandle;
+}
+
+u8 CBTConnection::GetPINSize (void) const
 {
 	return PINSize;
 }
@@ -224,8 +240,14 @@ void CBTConnection::SetRole (u8 nRole)
 ////////////////////////////////////////////////////////////////////////////////
 
 CBTLogicalLayer::CBTLogicalLayer (CBTHCILayer *pHCILayer)
-:	m_pHCILayer (pHCILayer),
+:	m_pLPCallback (0),
+	m_pL2CAPCallback (0),
+	m_pHCILayer (pHCILayer),
+	m_pL2CAPLayer (0),
 	m_pInquiryResults (0),
+	m_pRxConnection (0),
+	m_bConnecting (false),
+	m_nNameRequestsPending (0),
 	m_pBuffer (0)
 {
 }
@@ -278,8 +300,8 @@ CBTInquiryResults *CBTLogicalLayer::Inquiry (unsigned nSeconds)
 	assert (m_pInquiryResults != 0);
 
 	Clear();
-	CBTHCIInquiryCommand Cmd(INQUIRY_LENGTH(nSeconds));
-	m_pHCILayer->SendCommand (&Cmd, sizeof Cmd);
+	m_pHCILayer->SendCommand<TBTHCIInquiryCommand> (INQUIRY_LAP_GIAC,
+		INQUIRY_LENGTH(nSeconds), INQUIRY_NUM_RESPONSES_UNLIMITED);
 
 	Wait ();
 
@@ -298,7 +320,7 @@ CBTInquiryResults *CBTLogicalLayer::Inquiry (unsigned nSeconds)
 				pConnection->SetRemoteName((u8*)pResult->GetRemoteName(i));
 				pConnection->PageScanRepetitionMode
 					= pResult->GetPageScanRepetitionMode(i);
-				m_Connections.Append(pConnection);
+				AddConnection(pConnection);
 			}
 		}
 	}
@@ -309,17 +331,22 @@ CBTInquiryResults *CBTLogicalLayer::Inquiry (unsigned nSeconds)
 bool CBTLogicalLayer::Connect(CBTConnection* pConnection)
 {
 	assert(pConnection != 0);
-	Clear();
-	CBTHCICreateConnectionCommand Cmd(
-		pConnection->BDAddr, pConnection->PageScanRepetitionMode);
-	m_pConnection = pConnection;
-	m_pHCILayer->SendCommand (&Cmd, sizeof Cmd);
-	m_pConnection->ConnectionState = BTConnectionStateConnecting;
-	Wait();
-	m_pConnection = NULL;
+	StartCommand(pConnection);
+	ConnectAsync(pConnection);
+	WaitCommand(pConnection);
 
 	return pConnection->Status;
 }
+
+void CBTLogicalLayer::ConnectAsync(CBTConnection* pConnection)
+{
+	assert(pConnection != 0);
+	pConnection->ConnectionState = BTConnectionStateConnecting;
+	m_pHCILayer->SendCommand<TBTHCICreateConnectionCommand> (
+		pConnection->BDAddr, PACKET_TYPE_DM1,
+		pConnection->PageScanRepetitionMode, MANDATORY_PAGE_SCAN_MODE,
+		CLOCK_OFFSET_INVALID, DISALLOW_ROLE_SWITCH);
+}
 // TBD
 bool CBTLogicalLayer::ConnectResponse(
 	CBTConnection* pConnection,
@@ -327,25 +354,21 @@ bool CBTLogicalLayer::ConnectResponse(
 	char *pPIN)
 {
 	assert(pConnection != 0);
-	m_pConnection = pConnection;
 	// Setup the PIN for authentication
 	pConnection->PINSize = strlen(pPIN);
     memset(pConnection->PIN, 0, sizeof(pConnection->PIN));
 	if (!nResponse) {
 		pConnection->Role = (pConnection->Role == ROLE_MASTER)
 			? ROLE_SLAVE : ROLE_MASTER;
-		CBTHCIAcceptConnectionRequestCommand Cmd(
-		(u8 *)pConnection->BDAddr, pConnection->Role);
-		m_pHCILayer->SendCommand (&Cmd, sizeof Cmd);
-		m_pConnection->ConnectionState = BTConnectionStateConnecting;
+		m_pHCILayer->SendCommand<TBTHCIAcceptConnectionRequestCommand> (
+			pConnection->BDAddr, pConnection->Role);
+		pConnection->ConnectionState = BTConnectionStateConnecting;
 	} else {
-		CBTHCIRejectConnectionRequestCommand Cmd(
-		(u8 *)pConnection->BDAddr, BT_ERROR_UNSUPPORTED_REMOTE_FEATURE);
-		m_pHCILayer->SendCommand (&Cmd, sizeof Cmd);
-		m_pConnection->ConnectionState = BTConnectionStateConnectionFailed;
-		m_Connections.Delete(m_pConnection);
+		m_pHCILayer->SendCommand<TBTHCIRejectConnectionRequestCommand> (
+			pConnection->BDAddr, BT_ERROR_UNSUPPORTED_REMOTE_FEATURE);
+		pConnection->ConnectionState = BTConnectionStateConnectionFailed;
+		RemoveConnection(pConnection);
 	}
-//	m_pConnection = NULL; TBD
 
 	return pConnection->Status;
 }
@@ -353,27 +376,30 @@ bool CBTLogicalLayer::ConnectResponse(
 bool CBTLogicalLayer::Authenticate(CBTConnection* pConnection, char* pPIN)
 {
 	assert(pConnection != 0);
-	Clear();
+	StartCommand(pConnection);
+	AuthenticateAsync(pConnection, pPIN);
+	WaitCommand(pConnection);
+
+	return pConnection->Status;
+}
+
+void CBTLogicalLayer::AuthenticateAsync(CBTConnection* pConnection, char* pPIN)
+{
+	assert(pConnection != 0);
 	pConnection->PINSize = strlen(pPIN);
     memset(pConnection->PIN, 0, sizeof(pConnection->PIN));
 	memcpy(pConnection->PIN, pPIN, strlen(pPIN));
-	CBTHCIAuthenticationRequestedCommand Cmd(pConnection->ConnectionHandle);
-	m_pConnection = pConnection;
-	m_pHCILayer->SendCommand (&Cmd, sizeof Cmd);
-	m_pConnection->ConnectionState = BTConnectionStateAuthenticating;
-	Wait();
-	m_pConnection = NULL;
-
-	return pConnection->Status;
+	pConnection->ConnectionState = BTConnectionStateAuthenticating;
+	m_pHCILayer->SendCommand<TBTHCIAuthenticationRequestedCommand> (
+		pConnection->ConnectionHandle);
 }
 
 bool CBTLogicalLayer::Disconnect(CBTConnection* pConnection, u8 nReason)
 {
 	assert(pConnection != 0);
-	CBTHCIDisconnectCommand Cmd(pConnection->ConnectionHandle, nReason);
-	m_pConnection = pConnection;
-	m_pHCILayer->SendCommand (&Cmd, sizeof Cmd);
-	m_pConnection->ConnectionState = BTConnectionStateDisconnecting;
+	pConnection->ConnectionState = BTConnectionStateDisconnecting;
+	m_pHCILayer->SendCommand<TBTHCIDisconnectCommand> (
+		pConnection->ConnectionHandle, nReason);
 
 	return pConnection->Status;
 }
@@ -381,12 +407,10 @@ bool CBTLogicalLayer::Disconnect(CBTConnection* pConnection, u8 nReason)
 bool CBTLogicalLayer::GetInfo(CBTConnection* pConnection)
 {
 	assert(pConnection != 0);
-	Clear();
-	CBTHCIReadRemoteVersionInformationCommand Cmd(pConnection->ConnectionHandle);
-	m_pConnection = pConnection;
-	m_pHCILayer->SendCommand (&Cmd, sizeof Cmd);
-	Wait();
-	m_pConnection = NULL;
+	StartCommand(pConnection);
+	m_pHCILayer->SendCommand<TBTHCIReadRemoteVersionInformationCommand> (
+		pConnection->ConnectionHandle);
+	WaitCommand(pConnection);
 
 	return pConnection->Status;
 }
@@ -394,12 +418,10 @@ bool CBTLogicalLayer::GetInfo(CBTConnection* pConnection)
 bool CBTLogicalLayer::GetFeatures(CBTConnection* pConnection)
 {
 	assert(pConnection != 0);
-	Clear();
-	CBTHCIReadRemoteSupportedFeaturesCommand Cmd(pConnection->ConnectionHandle);
-	m_pConnection = pConnection;
-	m_pHCILayer->SendCommand (&Cmd, sizeof Cmd);
-	Wait();
-	m_pConnection = NULL;
+	StartCommand(pConnection);
+	m_pHCILayer->SendCommand<TBTHCIReadRemoteSupportedFeaturesCommand> (
+		pConnection->ConnectionHandle);
+	WaitCommand(pConnection);
 
 	return pConnection->Status;
 }
@@ -407,24 +429,21 @@ bool CBTLogicalLayer::GetFeatures(CBTConnection* pConnection)
 bool CBTLogicalLayer::SendACLData(
 	CBTConnection* pConnection, void* pData, u16 nLength)
 {
-	assert(pConnection != 0);
-	CBTHCIACLData* Cmd = new(nLength) CBTHCIACLData(
-		pConnection->ConnectionHandle, (u8*)pData, nLength);
-	assert(Cmd != 0);
-	m_pHCILayer->SendData (Cmd, sizeof(CBTHCIACLData) + nLength);
-	free(Cmd);
+	TBTScatter Data = {pData, nLength};
 
-	return pConnection->Status;
+	return SendACLData(pConnection, &Data, 1);
 }
 
-bool CBTLogicalLayer::SendHCICommand(const void* pData, unsigned nLength)
+bool CBTLogicalLayer::SendACLData(
+	CBTConnection* pConnection, const TBTScatter* pList, unsigned nEntries)
 {
-	if (pData && nLength) {
-		m_pHCILayer->SendCommand (pData, nLength);
-		return false;
+	assert(pConnection != 0);
+	if (!m_pHCILayer->SendData (pConnection->ConnectionHandle, pList, nEntries)) {
+		return true;		// flow control, not an error
 	}
 
-	return true;
+	// a stale HCI status must not look like a full queue, callers retry
+	return false;
 }
 
 void CBTLogicalLayer::Process (void)
@@ -432,6 +451,8 @@ void CBTLogicalLayer::Process (void)
 	assert (m_pHCILayer != 0);
 	assert (m_pBuffer != 0);
 
+	BT_STATS_START (nStart);
+
 	unsigned nLength;
 	while (m_pHCILayer->ReceiveLinkEvent (m_pBuffer, &nLength))
 	{
@@ -440,29 +461,38 @@ void CBTLogicalLayer::Process (void)
 		LOG_DEBUG("LMP event: 0x%02X\r\n", pHeader->EventCode);
 		pHeader->Process(this, nLength);
 	}
-	while (m_pHCILayer->ReceiveData (m_pBuffer, &nLength))
+	CBTPacket *pPacket;
+	while (m_pHCILayer->ReceiveData (&pPacket))
 	{
-		assert (nLength >= sizeof (CBTHCIACLData));
-		CBTHCIACLData *pHeader = (CBTHCIACLData *) m_pBuffer;
+		assert (pPacket->GetLength () >= sizeof (CBTHCIACLData));
+		// the L2CAP layer asks which link an incoming channel is on
+		CBTHCIACLData *pHeader = (CBTHCIACLData *) pPacket->GetData ();
+		m_pRxConnection = GetConnection((u16) pHeader->ConnectionHandle);
+		pPacket->Pull (sizeof (CBTHCIACLData));
 		if (m_pL2CAPCallback)
-			m_pL2CAPCallback((const void *)pHeader->Data, nLength-4);
+			m_pL2CAPCallback(pPacket);
+		else
+			pPacket->Release ();
 	}
+	m_pRxConnection = 0;
+
+	BT_STATS_RECORD (BTStatsLogicalProcess, nStart);
 }
 
 void CBTLogicalLayer::ListDevices (void)
 {
 #if 0
-	for (int i=0; i<m_Connections.GetCount(); i++) {
-    const u8* rName = ((CBTConnection *)m_Connections[i])->RemoteName;
+	for (unsigned i=0; i<m_Connections.GetCount(); i++) {
+    const u8* rName = m_Connections[i]->RemoteName;
 	LOG_DEBUG("Remote Name = %s\r\n", (char *)rName);
-    const u8* bda = ((CBTConnection *)m_Connections[i])->BDAddr;
+    const u8* bda = m_Connections[i]->BDAddr;
 	LOG_DEBUG("BD Address = %02X:%02X:%02X:%02X:%02X:%02X\r\n", 
 		(unsigned) bda[5], (unsigned) bda[4], (unsigned) bda[3], 
 		(unsigned) bda[2], (unsigned) bda[1], (unsigned) bda[0]);
-    const u8* cod = ((CBTConnection *)m_Connections[i])->ClassOfDevice;
+    const u8* cod = m_Connections[i]->ClassOfDevice;
 	LOG_DEBUG("Class Of Device = 0x%02X%02X%02X\r\n", 
 		(unsigned) cod[2], (unsigned) cod[1], (unsigned) cod[0]);
-    u8 scan = ((CBTConnection *)m_Connections[i])->PageScanRepetitionMode;
+    u8 scan = m_Connections[i]->PageScanRepetitionMode;
 	LOG_DEBUG("Page Scan Rep Mode = 0x%02X\r\n", (unsigned) scan); 
 	}
 #endif	
@@ -471,24 +501,52 @@ void CBTLogicalLayer::ListDevices (void)
 
 CBTConnection* CBTLogicalLayer::GetConnection (u8* sBDAddr)
 {
-	bool found = false;
-	CBTConnection* pConnection = NULL;
-	for (int i=0; i<m_Connections.GetCount() && !found; i++) {
-		pConnection = (CBTConnection *)m_Connections[i];
-		found = pConnection->HasBDAddress(sBDAddr);
-	}
-	return pConnection;
+	return (CBTConnection *)m_ConnectionsByBDAddr.Lookup(
+		CBTHashIndex::BDAddrKey(sBDAddr));
 }
 
 CBTConnection* CBTLogicalLayer::GetConnection (u16 nConnHandle)
 {
-	bool found = false;
-	CBTConnection* pConnection = NULL;
-	for (int i=0; i<m_Connections.GetCount() && !found; i++) {
-		pConnection = (CBTConnection *)m_Connections[i];
-		found = pConnection->HasConnectionHandle(nConnHandle);
-	}
-	return pConnection;
+	return (CBTConnection *)m_ConnectionsByHandle.Lookup(nConnHandle);
+}
+
+void CBTLogicalLayer::AddConnection (CBTConnection* pConnection)
+{
+	assert(pConnection != 0);
+	m_Connections.Append(pConnection);
+	m_ConnectionsByBDAddr.Insert(
+		CBTHashIndex::BDAddrKey(pConnection->BDAddr), pConnection);
+	if (pConnection->ConnectionHandle != BT_HCI_NO_HANDLE)
+		m_ConnectionsByHandle.Insert(pConnection->ConnectionHandle, pConnection);
+}
+
+void CBTLogicalLayer::RemoveConnection (CBTConnection* pConnection)
+{
+	assert(pConnection != 0);
+	m_ConnectionsByBDAddr.Remove(
+		CBTHashIndex::BDAddrKey(pConnection->BDAddr), pConnection);
+	m_ConnectionsByHandle.Remove(pConnection->ConnectionHandle, pConnection);
+	m_Connections.RemoveItem(pConnection);
+}
+
+void CBTLogicalLayer::SetConnectionBDAddress (
+	CBTConnection* pConnection, u8* sBDAddr)
+{
+	assert(pConnection != 0);
+	m_ConnectionsByBDAddr.Remove(
+		CBTHashIndex::BDAddrKey(pConnection->BDAddr), pConnection);
+	pConnection->SetBDAddress(sBDAddr);
+	m_ConnectionsByBDAddr.Insert(
+		CBTHashIndex::BDAddrKey(pConnection->BDAddr), pConnection);
+}
+
+void CBTLogicalLayer::SetConnectionHandle (
+	CBTConnection* pConnection, u16 nConnHandle)
+{
+	assert(pConnection != 0);
+	m_ConnectionsByHandle.Remove(pConnection->ConnectionHandle, pConnection);
+	pConnection->SetConnectionHandle(nConnHandle);
+	m_ConnectionsByHandle.Insert(nConnHandle, pConnection);
 }
 
 void CBTLogicalLayer::SetConnectingFlag (bool flag)
@@ -496,6 +554,27 @@ void CBTLogicalLayer::SetConnectingFlag (bool flag)
 	m_bConnecting = flag;
 }
 
+void CBTLogicalLayer::StartCommand (CBTConnection* pConnection)
+{
+	pConnection->CommandDone = FALSE;
+	DataSyncBarrier();
+}
+
+void CBTLogicalLayer::WaitCommand (CBTConnection* pConnection)
+{
+	// each connection waits on its own, several can be set up at once
+	while (!pConnection->CommandDone)
+		sleepBlockedTask(&pConnection->CommandWaitTask, BT_LOGICAL_WAIT_SLICE);
+}
+
+void CBTLogicalLayer::CompleteCommand (CBTConnection* pConnection)
+{
+	if (!pConnection) return;
+	pConnection->CommandDone = TRUE;
+	DataSyncBarrier();
+	wakeTask(&pConnection->CommandWaitTask);
+}
+
 void CBTLogicalLayer::RegisterLayer (CBTL2CAPLayer *pL2CAP)
 {
 	m_pL2CAPLayer = pL2CAP;
@@ -508,7 +587,7 @@ void CBTLogicalLayer::RegisterLPCallback (TBTL2CAPCallback *pHandler)
 	assert (m_pLPCallback != 0);
 }
 
-void CBTLogicalLayer::RegisterL2CAPCallback (TBTL2CAPCallback *pHandler)
+void CBTLogicalLayer::RegisterL2CAPCallback (TBTL2CAPPacketCallback *pHandler)
 {
 	assert (m_pL2CAPCallback == 0);
 	m_pL2CAPCallback = pHandler;
@@ -37,17 +37,20 @@
 *******************************************************************************/
 #include <bluetooth/btdevice.h>
 #include <bluetooth/bthidp.h>
+#include <graphics/event.h>
 #include <logger.h>
 #include <assert.h>
 #include <synchronize.h>
+#include <mutex.h>
+#include <task.h>
 #include <stdlib.h>
 #include <string.h>
 
 CBTHIDPLayer *CBTHIDPLayer::s_pThis = 0;
 
 CBTHIDPLayer::CBTHIDPLayer (CBTL2CAPLayer *pL2CAPLayer)
-:	m_pBuffer (0),
-	m_pL2CAPLayer (pL2CAPLayer),
+:	m_pL2CAPLayer (pL2CAPLayer),
+	m_pBuffer (0),
 	m_nRxPackets (1)
 {
 	// Asign the static pointer
@@ -81,9 +84,6 @@ CBTHIDPLayer::CBTHIDPLayer (CBTL2CAPLayer *pL2CAPLayer)
 	m_sFlowJoystick.Latency = 10000;
 	m_sFlowJoystick.DelayVariation = 10000;
 
-	// Assign the HIDP Callbacks to NULL
-	for (int i=0; i<MAX_HID_DEVICE; i++) m_DeviceTable[i] = NULL;
-
 	// Register the L2CAP Callbacks
 	pL2CAPLayer->RegisterCallback(BT_PSM_HID_CONTROL, EventStub);
 	pL2CAPLayer->RegisterCallback(BT_PSM_HID_INTERRUPT, EventStub);
@@ -104,14 +104,14 @@ CBTHIDPLayer::~CBTHIDPLayer (void)
 
 void CBTHIDPLayer::RegisterCallback (u16 nCID, CBTDevice *pDevice)
 {
-	m_DeviceTable[nCID-BT_CID_DYNAMICALLY_ALLOCATED] = pDevice;
+	m_DevicesByCID.Insert(nCID, pDevice);
 	pDevice->SetState(BT_DEVICE_CONNECTED);
-	LOG_DEBUG("HIDP Callback registered [%d] 0x%08X\r\n", nCID, (int)(pDevice));
+	LOG_DEBUG("HIDP Callback registered [%d] 0x%08X\r\n", nCID, (unsigned) (uintptr) pDevice);
 }
 
 void CBTHIDPLayer::DeregisterCallback (u16 nCID)
 {
-	m_DeviceTable[nCID-BT_CID_DYNAMICALLY_ALLOCATED] = NULL;
+	m_DevicesByCID.Remove(nCID);
 	LOG_DEBUG("HIDP Callback deregistered\r\n");
 }
 
@@ -127,28 +127,26 @@ u16 CBTHIDPLayer::Connect (u16 nPSM, u8* sBDAddr, u16 nMTU)
 	if (m_pL2CAPLayer) {
 		nResult = m_pL2CAPLayer->Connect(nPSM, sBDAddr, &nCID, &nStatus);
 		if (!nResult) {
-			if (nPSM == BT_PSM_HID_INTERRUPT) {
-				CBTDevice* pDevice = m_pL2CAPLayer->GetDevice(nCID);
-				if (pDevice->IsMouse())
-					nResult = m_pL2CAPLayer->Configure(nCID, nMTU,
-						&m_sFlowMouse,0x0000,0,&nInMTU,&sOutFlow,&nOutFlushTO);
-				if (pDevice->IsKeyboard())
-					nResult = m_pL2CAPLayer->Configure(nCID, nMTU,
-						&m_sFlowKeyboard,0x0000,0,
-						&nInMTU,&sOutFlow,&nOutFlushTO);
-				if (pDevice->IsJoystick())
-					nResult = m_pL2CAPLayer->Configure(nCID, nMTU,
-						&m_sFlowJoystick,0x0000,0,
-						&nInMTU,&sOutFlow,&nOutFlushTO);
-			} else
-				nResult = m_pL2CAPLayer->Configure(nCID, nMTU, NULL, 0x0000,
-					0, &nInMTU, &sOutFlow, &nOutFlushTO);
+			TBTL2CAPFlowSpec *pFlow = NULL;
+			if (nPSM == BT_PSM_HID_INTERRUPT)
+				pFlow = GetFlow(m_pL2CAPLayer->GetDevice(nCID));
+			nResult = m_pL2CAPLayer->Configure(nCID, nMTU, pFlow, 0x0000,
+				0, &nInMTU, &sOutFlow, &nOutFlushTO);
 		}
 	}
 
 	return nCID;
 }
 
+TBTL2CAPFlowSpec *CBTHIDPLayer::GetFlow (CBTDevice *pDevice)
+{
+	if (pDevice->IsMouse()) return &m_sFlowMouse;
+	if (pDevice->IsKeyboard()) return &m_sFlowKeyboard;
+	if (pDevice->IsJoystick()) return &m_sFlowJoystick;
+
+	return NULL;
+}
+
 u16 CBTHIDPLayer::Disconnect (u16 nCID, u16 nReason)
 {
 	u16 nResult = 0;
@@ -190,7 +188,8 @@ void CBTHIDPLayer::Callback (const void *pBuffer, unsigned nLength)
 			LOG_DEBUG("HIDP: connect indication:PSM=%d\r\n",(int)pConnInd->PSM);
 			if (pConnInd->PSM == BT_PSM_HID_INTERRUPT) ;
 			CBTL2CAPChannel *pChannel
-				= m_pL2CAPLayer->GetChannel(pConnInd->CID, true);
+				= m_pL2CAPLayer->GetRemoteChannel(
+					pConnInd->BDAddr, pConnInd->CID);
 			if (pChannel) {
 				u16 nStatus = BT_L2CAP_STATUS_NO_FURTHER_INFORMATION;
 				m_pL2CAPLayer->ConnectResponse(
@@ -211,12 +210,8 @@ void CBTHIDPLayer::Callback (const void *pBuffer, unsigned nLength)
 			if (pConfigInd->PSM == BT_PSM_HID_INTERRUPT) {
 				CBTDevice* pDevice 
 					= m_pL2CAPLayer->GetDevice(pConfigInd->CID);
-				if (pDevice->IsMouse())
-					pConfigInd->InFlow = &m_sFlowMouse;
-				if (pDevice->IsKeyboard())
-					pConfigInd->InFlow = &m_sFlowKeyboard;
-				if (pDevice->IsJoystick())
-					pConfigInd->InFlow = &m_sFlowJoystick;
+				if (GetFlow(pDevice))
+					pConfigInd->InFlow = GetFlow(pDevice);
 			}
 			m_pL2CAPLayer->ConfigureResponse(
 				pConfigInd->Identifier, pConfigInd->CID, 0,
@@ -259,9 +254,11 @@ void CBTHIDPLayer::Callback (const void *pBuffer, unsigned nLength)
 	}
 }
 
-void CBTHIDPLayer::DataHandler (u16 nCID, u8 *pBuffer, u16 nLength)
+void CBTHIDPLayer::DataHandler (u16 nCID, CBTPacket *pPacket)
 {
-	CBTHIDPMessage *pMessage = (CBTHIDPMessage *)pBuffer;
+	if (pPacket->GetLength () < sizeof (CBTHIDPMessage)) return;
+
+	CBTHIDPMessage *pMessage = (CBTHIDPMessage *)pPacket->GetData ();
 	switch(pMessage->MessageType) {
 
 		case BT_HIDP_HANDSHAKE: {
@@ -283,10 +280,15 @@ void CBTHIDPLayer::DataHandler (u16 nCID, u8 *pBuffer, u16 nLength)
 			} break;
 
 		case BT_HIDP_DATA: {
-				CBTHIDPMessageData *pData = (CBTHIDPMessageData *)pBuffer;
-				if (m_DeviceTable[nCID])
-					m_DeviceTable[nCID]->Parser(
-						pData->ReportDataPayload, nLength-1);
+				// strip the transaction header, the report is parsed in place
+				pPacket->Pull (sizeof (CBTHIDPMessage));
+				CBTDevice *pDevice = (CBTDevice *) m_DevicesByCID.Lookup(nCID);
+				if (!pDevice) break;
+#ifdef BT_HAVE_LATENCY
+				((CBTHIDDevice *) pDevice)->SetRxTimestamp (
+					pPacket->GetTimestamp ());
+#endif
+				pDevice->Parser(pPacket->GetData (), pPacket->GetLength ());
 			} break;
 
 		default: break;
@@ -299,14 +301,13 @@ void CBTHIDPLayer::EventStub (const void *pBuffer, unsigned nLength)
 	s_pThis->Callback (pBuffer, nLength);
 }
 
-void CBTHIDPLayer::DataStub (u16 nCID, const void *pBuffer, unsigned nLength)
+void CBTHIDPLayer::DataStub (u16 nCID, CBTPacket *pPacket)
 {
 	assert (nCID >= BT_CID_DYNAMICALLY_ALLOCATED);
 	assert (s_pThis != 0);
 
 	if (nCID < BT_CID_DYNAMICALLY_ALLOCATED) return;
-	u16 nID = nCID - BT_CID_DYNAMICALLY_ALLOCATED;
-	s_pThis->DataHandler (nID, (u8 *)pBuffer, nLength);
+	s_pThis->DataHandler (nCID, pPacket);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -393,11 +394,31 @@ CBTHIDDevice::CBTHIDDevice(
 	CBTHIDPLayer *pHIDPLayer,
 	CBTConnection *pConnection)
 :	CBTDevice(pConnection),
-	m_EventQueue()
+	m_EventQueue(BT_HIDP_EVENT_QUEUE_SIZE, BT_HIDP_EVENT_SLOT_SIZE)
 {
 	m_pHIDPLayer = pHIDPLayer;
 	m_nControlCID = 0;
 	m_nInterruptCID = 0;
+	m_nConnectStep = 0;
+	m_bConnectDone = TRUE;
+	m_pConnectWaitTask = 0;
+	m_Decoder[0].Compile(CBTHIDReportDecoder::s_BootDescriptor,
+		CBTHIDReportDecoder::s_nBootDescriptorLength);
+	m_nDecoder = 0;
+	memset(&m_Input, 0, sizeof m_Input);
+	m_nInputSequence = 0;
+	m_bCoalescing = FALSE;
+	m_nMotionLock = 0;
+	m_nPendingX = 0;
+	m_nPendingY = 0;
+	m_nPendingScroll = 0;
+	m_nHeldIn = 0;
+	m_nHeldOut = 0;
+	m_nEventDrops = 0;
+#ifdef BT_HAVE_LATENCY
+	m_nRxTimestamp = getClockTicks ();
+	m_nPendingTimestamp = m_nRxTimestamp;
+#endif
 }
 
 CBTHIDDevice::~CBTHIDDevice(void)
@@ -423,25 +444,147 @@ void CBTHIDDevice::SetInterruptCID(u16 nCID)
 
 void CBTHIDDevice::Parser(u8* pBuffer, u16 nLen)
 {
-	LOG_DEBUG("HIDP: Parser\r\n");
+	TBTHIDInput Input;
+	if (DecodeReport(pBuffer, nLen, &Input)) PublishInput(&Input);
+}
+
+boolean CBTHIDDevice::SetReportDescriptor(const u8 *pDescriptor, unsigned nLength)
+{
+	// compiled aside and switched to, the stack task decodes meanwhile
+	unsigned nNext = m_nDecoder ^ 1;
+	if (!m_Decoder[nNext].Compile(pDescriptor, nLength)) return FALSE;
+
+	DataMemBarrier();
+	m_nDecoder = nNext;
+	LOG_DEBUG("HIDP: %u reports, %u fields decoded\r\n",
+		m_Decoder[nNext].GetReportCount(), m_Decoder[nNext].GetFieldCount());
+
+	return TRUE;
+}
+
+boolean CBTHIDDevice::DecodeReport(const u8 *pReport, u16 nLength, TBTHIDInput *pInput)
+{
+	return m_Decoder[m_nDecoder].Decode(pReport, nLength, pInput);
+}
+
+void CBTHIDDevice::PublishInput(const TBTHIDInput *pInput)
+{
+	// a sequence lock, GetInput retries while the count is odd or moved
+	m_nInputSequence++;
+	DataMemBarrier();
+	m_Input = *pInput;
+	DataMemBarrier();
+	m_nInputSequence++;
+}
+
+boolean CBTHIDDevice::GetInput(TBTHIDInput *pInput)
+{
+	assert (pInput != 0);
+
+	unsigned nSequence;
+	do {
+		while ((nSequence = m_nInputSequence) & 1);
+		DataMemBarrier();
+		*pInput = m_Input;
+		DataMemBarrier();
+	} while (m_nInputSequence != nSequence);
+
+	return nSequence != 0;
 }
 
 u16 CBTHIDDevice::Connect(void)
 {
-	u16 nCID = 0;
 	if (m_tState == BT_DEVICE_CONNECTED) return 0;
-	if (m_tState != BT_DEVICE_IDLE) return 1;
+	if (!ConnectAsync()) return 1;
+
+	return WaitConnect();
+}
+
+// the steps of the connection, each started by the completion of the last
+enum {
+	BTHIDConnectControl,
+	BTHIDConfigureControl,
+	BTHIDConnectInterrupt,
+	BTHIDConfigureInterrupt
+};
+
+boolean CBTHIDDevice::ConnectAsync(void)
+{
+	if (m_tState != BT_DEVICE_IDLE || !m_bConnectDone) return FALSE;
 	u8* sBDAddr = (u8 *)m_pConnection->GetBDAddress();
 
-	nCID = m_pHIDPLayer->Connect(BT_PSM_HID_CONTROL, sBDAddr, 48);
-	if (nCID) m_nControlCID = nCID;
-	LOG_DEBUG("Connect: CID = %d\r\n", nCID);
-	nCID = m_pHIDPLayer->Connect(BT_PSM_HID_INTERRUPT, sBDAddr, 48);
-	m_nInterruptCID = nCID;
-	LOG_DEBUG("Interrupt: CID = %d\r\n", nCID);
-	if (nCID) m_pHIDPLayer->RegisterCallback(nCID, this);
+	m_bConnectDone = FALSE;
+	m_nConnectStep = BTHIDConnectControl;
+	if (m_pHIDPLayer->m_pL2CAPLayer->ConnectAsync(BT_PSM_HID_CONTROL,
+		sBDAddr, ConnectStub, this) == BT_L2CAP_NO_REQUEST) {
+		m_bConnectDone = TRUE;
+		return FALSE;
+	}
+
+	return TRUE;
+}
 
-	return 0;
+u16 CBTHIDDevice::WaitConnect(void)
+{
+	while (!m_bConnectDone)
+		sleepBlockedTask(&m_pConnectWaitTask, BT_HIDP_WAIT_SLICE);
+
+	return m_tState == BT_DEVICE_CONNECTED ? 0 : 1;
+}
+
+void CBTHIDDevice::ConnectStub(
+	unsigned hRequest, const TBTL2CAPResult *pResult, void *pParam)
+{
+	CBTHIDDevice *pThis = (CBTHIDDevice *) pParam;
+	assert (pThis != 0);
+
+	pThis->ConnectStep (pResult);
+}
+
+void CBTHIDDevice::ConnectStep(const TBTL2CAPResult *pResult)
+{
+	CBTL2CAPLayer *pL2CAPLayer = m_pHIDPLayer->m_pL2CAPLayer;
+	u8* sBDAddr = (u8 *)m_pConnection->GetBDAddress();
+	unsigned hRequest = BT_L2CAP_NO_REQUEST;
+
+	// runs in the stack task, the next request must not block
+	if (pResult->nResult == BT_L2CAP_RESULT_SUCCESS) {
+		switch (m_nConnectStep++) {
+		case BTHIDConnectControl:
+			m_nControlCID = pResult->nCID;
+			LOG_DEBUG("Connect: CID = %d\r\n", m_nControlCID);
+			hRequest = pL2CAPLayer->ConfigureAsync(m_nControlCID,
+				BT_HIDP_MTU, NULL, 0x0000, ConnectStub, this);
+			break;
+
+		case BTHIDConfigureControl:
+			hRequest = pL2CAPLayer->ConnectAsync(BT_PSM_HID_INTERRUPT,
+				sBDAddr, ConnectStub, this);
+			break;
+
+		case BTHIDConnectInterrupt:
+			m_nInterruptCID = pResult->nCID;
+			LOG_DEBUG("Interrupt: CID = %d\r\n", m_nInterruptCID);
+			hRequest = pL2CAPLayer->ConfigureAsync(m_nInterruptCID,
+				BT_HIDP_MTU, m_pHIDPLayer->GetFlow(this), 0x0000,
+				ConnectStub, this);
+			break;
+
+		case BTHIDConfigureInterrupt:
+			m_pHIDPLayer->RegisterCallback(m_nInterruptCID, this);
+			break;
+		}
+	}
+
+	if (hRequest != BT_L2CAP_NO_REQUEST) return;	// next step under way
+
+	if (m_tState != BT_DEVICE_CONNECTED) {
+		LOG_DEBUG("HIDP: connect failed in step %u\r\n", m_nConnectStep);
+		SetState(BT_DEVICE_IDLE);
+	}
+	m_bConnectDone = TRUE;
+	DataSyncBarrier();
+	wakeTask(&m_pConnectWaitTask);
 }
 
 bool CBTHIDDevice::DisconnectInterruptChannel(void)
@@ -475,16 +618,81 @@ bool CBTHIDDevice::SendControlMessage(const u8* pBuffer, u16 nLength)
 	return false;
 }
 
+// UG events carry byte deltas
+static signed char ClampDelta (int nValue)
+{
+	return nValue < -127 ? -127 : nValue > 127 ? 127 : (signed char) nValue;
+}
+
+// Returns the summed motion as one event, a move before a scroll, and
+// subtracts it from the sums. Sums beyond a byte are returned in several
+// steps, nothing is cut.
+static boolean TakeDelta (int *pX, int *pY, int *pScroll, void *pBuffer, unsigned *pLength)
+{
+	if (*pX || *pY) {
+		signed char nX = ClampDelta(*pX);
+		signed char nY = ClampDelta(*pY);
+		*pX -= nX;
+		*pY -= nY;
+
+		UGMouseMoveEvent event(nX, nY);
+		memcpy (pBuffer, &event, sizeof event);
+		*pLength = sizeof event;
+
+		return TRUE;
+	}
+
+	if (*pScroll) {
+		signed char nScroll = ClampDelta(*pScroll);
+		*pScroll -= nScroll;
+
+		UGScrollEvent event(nScroll);
+		memcpy (pBuffer, &event, sizeof event);
+		*pLength = sizeof event;
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
 bool CBTHIDDevice::ReceiveEvent (void *pBuffer, unsigned *pResultLength)
 {
+	assert (pResultLength != 0);
 	unsigned nLength;
-	if (!m_EventQueue.IsEmpty()) {
-		nLength = m_EventQueue.Dequeue (pBuffer);
-		if (nLength > 0) {
-			assert (pResultLength != 0);
-			if (pResultLength) *pResultLength = nLength;
-			return TRUE;
-		}
+
+	// the held events come after everything queued and the pending
+	// motion after them, the producer only queues behind them with
+	// the lock held
+	spin_lock ((void *) &m_nMotionLock);
+	if (ReleaseEvents () && m_EventQueue.IsEmpty()) {
+		boolean bResult = TakeDelta (&m_nPendingX, &m_nPendingY, &m_nPendingScroll,
+					     pBuffer, &nLength);
+#ifdef BT_HAVE_LATENCY
+		if (bResult) CBTLatency::RecordSince (BTLatencyHIDReport, m_nPendingTimestamp);
+#endif
+		spin_unlock ((void *) &m_nMotionLock);
+
+		if (bResult && pResultLength) *pResultLength = nLength;
+		return bResult;
+	}
+	spin_unlock ((void *) &m_nMotionLock);
+
+#ifdef BT_HAVE_LATENCY
+	u8 Slot[BT_HIDP_EVENT_SLOT_SIZE];
+	nLength = m_EventQueue.Dequeue (Slot);
+	if (nLength > sizeof (unsigned)) {
+		unsigned nRxTimestamp;
+		memcpy (&nRxTimestamp, Slot, sizeof nRxTimestamp);
+		CBTLatency::RecordSince (BTLatencyHIDReport, nRxTimestamp);
+		nLength -= sizeof nRxTimestamp;
+		memcpy (pBuffer, Slot + sizeof nRxTimestamp, nLength);
+#else
+	nLength = m_EventQueue.Dequeue (pBuffer);
+	if (nLength > 0) {
+#endif
+		if (pResultLength) *pResultLength = nLength;
+		return TRUE;
 	}
 
 	return FALSE;
@@ -494,5 +702,134 @@ void CBTHIDDevice::PostEvent (const void *pBuffer, unsigned nLength)
 {
 	assert (pBuffer != 0);
 	assert (nLength > 0);
-	m_EventQueue.Enqueue (pBuffer, nLength);
+
+	spin_lock ((void *) &m_nMotionLock);
+	if (   !ReleaseEvents ()
+	    || !QueueMotion (&m_nPendingX, &m_nPendingY, &m_nPendingScroll)
+	    || !EnqueueEvent (pBuffer, nLength)) {
+		HoldEvent (pBuffer, nLength);
+	}
+	spin_unlock ((void *) &m_nMotionLock);
+}
+
+void CBTHIDDevice::SetCoalescing (boolean bOn)
+{
+	spin_lock ((void *) &m_nMotionLock);
+	if (!bOn && ReleaseEvents ()) {
+		QueueMotion (&m_nPendingX, &m_nPendingY, &m_nPendingScroll);
+	}
+	m_bCoalescing = bOn;
+	spin_unlock ((void *) &m_nMotionLock);
+}
+
+void CBTHIDDevice::PostMotion (int nX, int nY, int nScroll)
+{
+	spin_lock ((void *) &m_nMotionLock);
+#ifdef BT_HAVE_LATENCY
+	if (!m_nPendingX && !m_nPendingY && !m_nPendingScroll) {
+		m_nPendingTimestamp = m_nRxTimestamp;
+	}
+#endif
+	if (m_bCoalescing) {
+		m_nPendingX += nX;
+		m_nPendingY += nY;
+		m_nPendingScroll += nScroll;
+	} else {
+		// larger deltas of high resolution mice are cut
+		m_nPendingX += ClampDelta(nX);
+		m_nPendingY += ClampDelta(nY);
+		m_nPendingScroll += ClampDelta(nScroll);
+
+		if (ReleaseEvents ()) {
+			QueueMotion (&m_nPendingX, &m_nPendingY, &m_nPendingScroll);
+		}
+	}
+	spin_unlock ((void *) &m_nMotionLock);
+}
+
+unsigned CBTHIDDevice::MakeSlot (u8 *pSlot, const void *pBuffer, unsigned nLength)
+{
+	assert (nLength <= BT_HIDP_MAX_EVENT_SIZE);
+#ifdef BT_HAVE_LATENCY
+	memcpy (pSlot, &m_nRxTimestamp, sizeof m_nRxTimestamp);
+	memcpy (pSlot + sizeof m_nRxTimestamp, pBuffer, nLength);
+	return sizeof m_nRxTimestamp + nLength;
+#else
+	memcpy (pSlot, pBuffer, nLength);
+	return nLength;
+#endif
+}
+
+// FALSE if the queue is full
+boolean CBTHIDDevice::EnqueueEvent (const void *pBuffer, unsigned nLength)
+{
+#ifdef BT_HAVE_LATENCY
+	u8 Slot[BT_HIDP_EVENT_SLOT_SIZE];
+	unsigned nSlotLength = MakeSlot (Slot, pBuffer, nLength);
+	return m_EventQueue.Enqueue (Slot, nSlotLength);
+#else
+	return m_EventQueue.Enqueue (pBuffer, nLength);
+#endif
+}
+
+// Queues the summed motion, as much as fits. Returns FALSE if some is
+// left in the sums. Called with the motion lock held.
+boolean CBTHIDDevice::QueueMotion (int *pX, int *pY, int *pScroll)
+{
+	for (;;) {
+		u8 Event[BT_HIDP_MAX_EVENT_SIZE];
+		unsigned nLength;
+		int nX = *pX;
+		int nY = *pY;
+		int nScroll = *pScroll;
+		if (!TakeDelta (&nX, &nY, &nScroll, Event, &nLength)) {
+			return TRUE;
+		}
+
+		if (!EnqueueEvent (Event, nLength)) {
+			return FALSE;
+		}
+
+		*pX = nX;
+		*pY = nY;
+		*pScroll = nScroll;
+	}
+}
+
+// Queues the held events in order, as many as fit. Returns FALSE if
+// some are left. Called with the motion lock held.
+boolean CBTHIDDevice::ReleaseEvents (void)
+{
+	while (m_nHeldOut != m_nHeldIn) {
+		TBTHIDHeldEvent *pHeld = &m_Held[m_nHeldOut % BT_HIDP_HELD_EVENTS];
+		if (   !QueueMotion (&pHeld->nX, &pHeld->nY, &pHeld->nScroll)
+		    || !m_EventQueue.Enqueue (pHeld->Slot, pHeld->nLength)) {
+			return FALSE;
+		}
+
+		m_nHeldOut++;
+	}
+
+	return TRUE;
+}
+
+// Keeps an event which did not fit into the queue, together with the
+// pending motion before it. Called with the motion lock held.
+void CBTHIDDevice::HoldEvent (const void *pBuffer, unsigned nLength)
+{
+	if (m_nHeldIn - m_nHeldOut == BT_HIDP_HELD_EVENTS) {
+		// the motion stays pending
+		m_nEventDrops++;
+		return;
+	}
+
+	TBTHIDHeldEvent *pHeld = &m_Held[m_nHeldIn % BT_HIDP_HELD_EVENTS];
+	pHeld->nX = m_nPendingX;
+	pHeld->nY = m_nPendingY;
+	pHeld->nScroll = m_nPendingScroll;
+	pHeld->nLength = MakeSlot (pHeld->Slot, pBuffer, nLength);
+	m_nPendingX = 0;
+	m_nPendingY = 0;
+	m_nPendingScroll = 0;
+	m_nHeldIn++;
 }
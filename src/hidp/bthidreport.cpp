@@ -0,0 +1,436 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth HID Report Descriptor Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/bthidreport.h>
+#include <assert.h>
+#include <string.h>
+
+// item prefixes with the size bits cleared
+#define HID_ITEM_INPUT			0x80
+#define HID_ITEM_OUTPUT			0x90
+#define HID_ITEM_COLLECTION		0xA0
+#define HID_ITEM_FEATURE		0xB0
+#define HID_ITEM_END_COLLECTION		0xC0
+#define HID_ITEM_USAGE_PAGE		0x04
+#define HID_ITEM_LOGICAL_MINIMUM	0x14
+#define HID_ITEM_REPORT_SIZE		0x74
+#define HID_ITEM_REPORT_ID		0x84
+#define HID_ITEM_REPORT_COUNT		0x94
+#define HID_ITEM_PUSH			0xA4
+#define HID_ITEM_POP			0xB4
+#define HID_ITEM_USAGE			0x08
+#define HID_ITEM_USAGE_MINIMUM		0x18
+#define HID_ITEM_USAGE_MAXIMUM		0x28
+#define HID_ITEM_LONG			0xFE
+
+#define HID_ITEM_TYPE_MASK		0x0C
+#define HID_ITEM_TYPE_MAIN		0x00
+
+#define HID_INPUT_CONSTANT		0x01
+#define HID_INPUT_VARIABLE		0x02
+
+#define HID_COLLECTION_APPLICATION	0x01
+
+#define HID_USAGE_X			0x30
+#define HID_USAGE_WHEEL			0x38
+#define HID_USAGE_HAT_SWITCH		0x39
+#define HID_USAGE_LEFT_CONTROL		0xE0
+#define HID_USAGE_RIGHT_GUI		0xE7
+#define HID_USAGE_AC_PAN		0x0238
+
+const u8 CBTHIDReportDecoder::s_BootDescriptor[] =
+{
+	0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01,	// keyboard, ID 1
+	0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00,	// modifiers
+	0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+	0x95, 0x01, 0x75, 0x08, 0x81, 0x01,		// reserved
+	0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01,	// LEDs
+	0x29, 0x05, 0x91, 0x02, 0x95, 0x01, 0x75, 0x03,
+	0x91, 0x01,
+	0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65,	// keys
+	0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00,
+	0xC0,
+	0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x02,	// mouse, ID 2
+	0x09, 0x01, 0xA1, 0x00,
+	0x05, 0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00,	// buttons
+	0x25, 0x01, 0x95, 0x03, 0x75, 0x01, 0x81, 0x02,
+	0x95, 0x01, 0x75, 0x05, 0x81, 0x01,
+	0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x38,	// x, y, wheel
+	0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x03,
+	0x81, 0x06,
+	0xC0, 0xC0
+};
+
+const unsigned CBTHIDReportDecoder::s_nBootDescriptorLength = sizeof s_BootDescriptor;
+
+CBTHIDReportDecoder::CBTHIDReportDecoder (void)
+:	m_bReportIDs (FALSE),
+	m_nReports (0),
+	m_nFields (0)
+{
+	memset (m_ReportIndex, 0, sizeof m_ReportIndex);
+}
+
+CBTHIDReportDecoder::~CBTHIDReportDecoder (void)
+{
+}
+
+boolean CBTHIDReportDecoder::Compile (const u8 *pDescriptor, unsigned nLength)
+{
+	assert (pDescriptor != 0);
+
+	m_bReportIDs = FALSE;
+	m_nReports = 0;
+	m_nFields = 0;
+	memset (m_ReportIndex, 0, sizeof m_ReportIndex);
+
+	u8 FieldReport[BT_HID_MAX_FIELDS];
+	if (!Parse (pDescriptor, nLength, FieldReport)) {
+		m_nReports = 0;
+		m_nFields = 0;
+		memset (m_ReportIndex, 0, sizeof m_ReportIndex);
+
+		return FALSE;
+	}
+
+	// group the fields by report, Decode runs one range of them
+	TBTHIDField Fields[BT_HID_MAX_FIELDS];
+	memcpy (Fields, m_Field, m_nFields * sizeof Fields[0]);
+	unsigned nField = 0;
+	for (unsigned i = 0; i < m_nReports; i++) {
+		TBTHIDReportLayout *pLayout = &m_Report[i];
+		pLayout->nFirst = nField;
+		for (unsigned j = 0; j < m_nFields; j++) {
+			if (FieldReport[j] == i) m_Field[nField++] = Fields[j];
+		}
+		pLayout->nFields = nField - pLayout->nFirst;
+
+		pLayout->nBytes = (pLayout->nBits + 7) / 8;
+		if (pLayout->nBytes > BT_HID_MAX_REPORT_SIZE)
+			pLayout->nBytes = BT_HID_MAX_REPORT_SIZE;
+	}
+
+	return m_nFields > 0;
+}
+
+boolean CBTHIDReportDecoder::Decode (const u8 *pReport, unsigned nLength,
+				     TBTHIDInput *pInput) const
+{
+	assert (pReport != 0);
+	assert (pInput != 0);
+
+	if (nLength == 0) return FALSE;
+	u8 nID = m_bReportIDs ? pReport[0] : 0;
+	unsigned nIndex = m_ReportIndex[nID];
+	if (nIndex == 0) return FALSE;
+	const TBTHIDReportLayout *pLayout = &m_Report[nIndex-1];
+	if (nLength < pLayout->nBytes) return FALSE;
+
+	// every field loads 8 bytes, the copy pads the report with zeroes
+	u8 Report[BT_HID_MAX_REPORT_SIZE + sizeof (u64)];
+	memcpy (Report, pReport, pLayout->nBytes);
+	memset (Report + pLayout->nBytes, 0, sizeof (u64));
+
+	pInput->nReportID = nID;
+	pInput->nApplication = pLayout->nApplication;
+	pInput->nPresent = pLayout->nPresent;
+	memset (pInput->Value, 0, sizeof pInput->Value);
+
+	const TBTHIDField *pField = &m_Field[pLayout->nFirst];
+	for (unsigned i = pLayout->nFields; i > 0; i--, pField++) {
+		u64 nWord;
+		memcpy (&nWord, Report + pField->nByte, sizeof nWord);	// little endian as the report
+		u32 nRaw = (u32) (nWord >> pField->nShift) & pField->nMask;
+		int nValue = (int) (nRaw << pField->nExtend) >> pField->nExtend;
+		pInput->Value[pField->nSlot] |= (int) ((u32) nValue << pField->nSlotShift);
+	}
+
+	return TRUE;
+}
+
+boolean CBTHIDReportDecoder::Parse (const u8 *pDescriptor, unsigned nLength,
+				    u8 *pFieldReport)
+{
+	TBTHIDGlobal Global;
+	memset (&Global, 0, sizeof Global);
+	TBTHIDGlobal Stack[BT_HID_MAX_PUSH];
+	unsigned nPushed = 0;
+
+	TBTHIDUsageRange Usages[BT_HID_MAX_USAGES];
+	unsigned nUsages = 0;
+	boolean bRange = FALSE;			// last usage came from Usage Minimum
+
+	unsigned nDepth = 0;
+	u8 nApplication = 0;
+
+	const u8 *p = pDescriptor;
+	const u8 *pEnd = pDescriptor + nLength;
+	while (p < pEnd) {
+		u8 nPrefix = *p++;
+		if (nPrefix == HID_ITEM_LONG) {		// none are defined, skipped
+			if (pEnd - p < 2 || pEnd - p < 2 + p[0]) return FALSE;
+			p += 2 + p[0];
+			continue;
+		}
+
+		unsigned nSize = nPrefix & 3;
+		if (nSize == 3) nSize = 4;
+		if ((unsigned) (pEnd - p) < nSize) return FALSE;
+		u32 nData = 0;
+		for (unsigned i = 0; i < nSize; i++) nData |= (u32) p[i] << (8 * i);
+		int nSigned = nSize == 1 ? (signed char) nData : nSize == 2 ? (short) nData : (int) nData;
+		p += nSize;
+
+		switch (nPrefix & 0xFC) {
+		case HID_ITEM_INPUT:
+			if (!AddInput (&Global, Usages, nUsages, nData, nApplication, pFieldReport))
+				return FALSE;
+			break;
+
+		case HID_ITEM_OUTPUT:
+		case HID_ITEM_FEATURE:
+			break;
+
+		case HID_ITEM_COLLECTION:
+			if (   nDepth++ == 0
+			    && nData == HID_COLLECTION_APPLICATION
+			    && nUsages > 0) {
+				u32 nUsage = GetUsage (Usages, nUsages, 0, Global.nPage);
+				nApplication = nUsage >> 16 == BT_HID_PAGE_GENERIC_DESKTOP
+					     ? (u8) nUsage : 0;
+			}
+			break;
+
+		case HID_ITEM_END_COLLECTION:
+			if (nDepth > 0) nDepth--;
+			break;
+
+		case HID_ITEM_USAGE_PAGE:
+			Global.nPage = (u16) nData;
+			break;
+
+		case HID_ITEM_LOGICAL_MINIMUM:
+			Global.nLogicalMinimum = nSigned;
+			break;
+
+		case HID_ITEM_REPORT_SIZE:
+			Global.nReportSize = nData;
+			break;
+
+		case HID_ITEM_REPORT_ID:
+			if (nData == 0 || nData > 0xFF) return FALSE;
+			Global.nReportID = (u8) nData;
+			m_bReportIDs = TRUE;
+			break;
+
+		case HID_ITEM_REPORT_COUNT:
+			Global.nReportCount = nData;
+			break;
+
+		case HID_ITEM_PUSH:
+			if (nPushed == BT_HID_MAX_PUSH) return FALSE;
+			Stack[nPushed++] = Global;
+			break;
+
+		case HID_ITEM_POP:
+			if (nPushed == 0) return FALSE;
+			Global = Stack[--nPushed];
+			break;
+
+		case HID_ITEM_USAGE:
+		case HID_ITEM_USAGE_MINIMUM:
+			// usages without a page take the one current at the main item
+			if (nSize < 4) nData &= 0xFFFF;
+			if (nUsages < BT_HID_MAX_USAGES) {
+				Usages[nUsages].nMinimum = nData;
+				Usages[nUsages++].nMaximum = nData;
+			}
+			bRange = (nPrefix & 0xFC) == HID_ITEM_USAGE_MINIMUM;
+			break;
+
+		case HID_ITEM_USAGE_MAXIMUM:
+			if (nSize < 4) nData &= 0xFFFF;
+			if (bRange && nData >= Usages[nUsages-1].nMinimum)
+				Usages[nUsages-1].nMaximum = nData;
+			bRange = FALSE;
+			break;
+
+		default:
+			break;
+		}
+
+		// local items only last until the next main item
+		if ((nPrefix & HID_ITEM_TYPE_MASK) == HID_ITEM_TYPE_MAIN) {
+			nUsages = 0;
+			bRange = FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+boolean CBTHIDReportDecoder::AddInput (const TBTHIDGlobal *pGlobal,
+				       const TBTHIDUsageRange *pUsages, unsigned nUsages,
+				       u32 nFlags, u8 nApplication, u8 *pFieldReport)
+{
+	u32 nSize = pGlobal->nReportSize;
+	u32 nCount = pGlobal->nReportCount;
+	if (nSize > 32 || nCount > 0xFFFF) return FALSE;
+
+	TBTHIDReportLayout *pLayout = GetLayout (pGlobal->nReportID, nApplication);
+	if (pLayout == 0) return TRUE;		// too many reports, not decoded
+	if (pLayout->nBits + nSize * nCount > 0xFFFF) return FALSE;
+
+	boolean bSigned = pGlobal->nLogicalMinimum < 0;
+	boolean bKeys = GetUsage (pUsages, nUsages, 0, pGlobal->nPage) >> 16
+			== BT_HID_PAGE_KEYBOARD;
+
+	for (u32 i = 0; nSize > 0 && i < nCount && !(nFlags & HID_INPUT_CONSTANT); i++) {
+		u32 nOffset = pLayout->nBits + i * nSize;
+		if (   nOffset + nSize > BT_HID_MAX_REPORT_SIZE * 8
+		    || m_nFields == BT_HID_MAX_FIELDS) {
+			break;
+		}
+
+		u8 nSlot, nSlotShift = 0;
+		if (nFlags & HID_INPUT_VARIABLE)
+			nSlot = MapUsage (GetUsage (pUsages, nUsages, i, pGlobal->nPage), &nSlotShift);
+		else
+			nSlot = bKeys && i < BT_HID_MAX_KEYS ? (u8) (BTHIDSlotKey0 + i) : (u8) BTHIDSlotNone;
+
+		// a value slot is taken by the first field only, masks are ORed
+		if (   nSlot == BTHIDSlotNone
+		    || (   (pLayout->nPresent & BT_HID_SLOT_BIT (nSlot))
+			&& nSlot != BTHIDSlotButtons
+			&& nSlot != BTHIDSlotModifiers)) {
+			continue;
+		}
+
+		TBTHIDField *pField = &m_Field[m_nFields];
+		pField->nByte = nOffset / 8;
+		pField->nShift = nOffset % 8;
+		pField->nExtend = nSize == 32 ? 0 : 32 - nSize - (bSigned ? 0 : 1);
+		pField->nMask = nSize == 32 ? 0xFFFFFFFF : (1U << nSize) - 1;
+		pField->nSlot = nSlot;
+		pField->nSlotShift = nSlotShift;
+		pFieldReport[m_nFields++] = pLayout - m_Report;
+
+		pLayout->nPresent |= BT_HID_SLOT_BIT (nSlot);
+	}
+
+	pLayout->nBits += nSize * nCount;
+
+	return TRUE;
+}
+
+CBTHIDReportDecoder::TBTHIDReportLayout *CBTHIDReportDecoder::GetLayout (u8 nID, u8 nApplication)
+{
+	if (m_ReportIndex[nID] != 0) return &m_Report[m_ReportIndex[nID]-1];
+	if (m_nReports == BT_HID_MAX_REPORTS) return 0;
+
+	TBTHIDReportLayout *pLayout = &m_Report[m_nReports++];
+	memset (pLayout, 0, sizeof *pLayout);
+	pLayout->nID = nID;
+	pLayout->nApplication = nApplication;
+	pLayout->nBits = m_bReportIDs ? 8 : 0;
+	m_ReportIndex[nID] = m_nReports;
+
+	return pLayout;
+}
+
+u32 CBTHIDReportDecoder::GetUsage (const TBTHIDUsageRange *pUsages, unsigned nUsages,
+				   unsigned nIndex, u16 nPage)
+{
+	if (nUsages == 0) return (u32) nPage << 16;
+
+	// the last usage applies to the remaining fields
+	u32 nUsage = pUsages[nUsages-1].nMaximum;
+	for (unsigned i = 0; i < nUsages; i++) {
+		u32 nRange = pUsages[i].nMaximum - pUsages[i].nMinimum + 1;
+		if (nIndex < nRange) {
+			nUsage = pUsages[i].nMinimum + nIndex;
+			break;
+		}
+		nIndex -= nRange;
+	}
+
+	if (nUsage >> 16 == 0) nUsage |= (u32) nPage << 16;
+
+	return nUsage;
+}
+
+u8 CBTHIDReportDecoder::MapUsage (u32 nUsage, u8 *pSlotShift)
+{
+	u16 nPage = nUsage >> 16;
+	u16 nID = (u16) nUsage;
+
+	switch (nPage) {
+	case BT_HID_PAGE_GENERIC_DESKTOP: {
+		static const u8 Slots[] =
+		{
+			BTHIDSlotX, BTHIDSlotY, BTHIDSlotZ, BTHIDSlotRx, BTHIDSlotRy,
+			BTHIDSlotRz, BTHIDSlotSlider, BTHIDSlotDial, BTHIDSlotWheel,
+			BTHIDSlotHat
+		};
+		if (nID >= HID_USAGE_X && nID <= HID_USAGE_HAT_SWITCH)
+			return Slots[nID - HID_USAGE_X];
+		} break;
+
+	case BT_HID_PAGE_KEYBOARD:
+		if (nID >= HID_USAGE_LEFT_CONTROL && nID <= HID_USAGE_RIGHT_GUI) {
+			*pSlotShift = nID - HID_USAGE_LEFT_CONTROL;
+			return BTHIDSlotModifiers;
+		}
+		break;
+
+	case BT_HID_PAGE_BUTTON:
+		if (nID >= 1 && nID <= 32) {
+			*pSlotShift = nID - 1;
+			return BTHIDSlotButtons;
+		}
+		break;
+
+	case BT_HID_PAGE_CONSUMER:
+		if (nID == HID_USAGE_AC_PAN) return BTHIDSlotPan;
+		break;
+
+	default:
+		break;
+	}
+
+	return BTHIDSlotNone;
+}
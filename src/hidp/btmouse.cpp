@@ -68,22 +68,27 @@ CBTMouse::~CBTMouse(void)
 
 void CBTMouse::Parser(u8* pBuffer, u16 nLen)
 {
-	assert(pBuffer[0] == 0x02);
-	bool bLeftButton = (pBuffer[1] & 0x01) ? true : false;
-	bool bRightButton = (pBuffer[1] & 0x02) ? true : false;
-	bool bWheel = (pBuffer[1] & 0x04) ? true : false;
-	TBTMouseData *mData = (TBTMouseData *)(pBuffer+2);
-	m_nX += mData->x;
-	m_nY += mData->y;
-	m_nScroll += mData->w;
+	TBTHIDInput Input;
+	if (!DecodeReport(pBuffer, nLen, &Input)) return;
+	PublishInput(&Input);
+	if (!(Input.nPresent & BT_HID_POINTER_SLOTS)) return;	// e.g. consumer keys
+
+	bool bLeftButton = (Input.Value[BTHIDSlotButtons] & 0x01) ? true : false;
+	bool bRightButton = (Input.Value[BTHIDSlotButtons] & 0x02) ? true : false;
+	bool bWheel = (Input.Value[BTHIDSlotButtons] & 0x04) ? true : false;
+	int nX = Input.Value[BTHIDSlotX];
+	int nY = Input.Value[BTHIDSlotY];
+	int nW = Input.Value[BTHIDSlotWheel];
+	m_nX += nX;
+	m_nY += nY;
+	m_nScroll += nW;
 
 	if (bLeftButton) {
         if (!m_bLeftButton) m_nCount = 0;
         else {
             m_tState = BT_MOUSE_STATE_BUTTON_PRESSED;
             if (m_nCount++) {
-		        UGMouseMoveEvent event(mData->x, mData->y);
-		        PostEvent(&event, sizeof event);
+		        PostMotion(nX, nY, 0);
             } else {
 		        UGButtonPressEvent event(UG_MOUSE_LEFT);
 		        PostEvent(&event, sizeof event);
@@ -95,8 +100,7 @@ void CBTMouse::Parser(u8* pBuffer, u16 nLen)
         else {
             m_tState = BT_MOUSE_STATE_BUTTON_PRESSED;
             if (m_nCount++) {
-		        UGMouseMoveEvent event(mData->x, mData->y);
-		        PostEvent(&event, sizeof event);
+		        PostMotion(nX, nY, 0);
             } else {
 		        UGButtonPressEvent event(UG_MOUSE_RIGHT);
 		        PostEvent(&event, sizeof event);
@@ -108,12 +112,8 @@ void CBTMouse::Parser(u8* pBuffer, u16 nLen)
         m_tState = BT_MOUSE_STATE_WHEEL_PRESSED;
 		UGButtonPressEvent event(UG_MOUSE_WHEEL);
 		PostEvent(&event, sizeof event);
-	} else if (mData->x || mData->y) {
-		UGMouseMoveEvent event(mData->x, mData->y);
-		PostEvent(&event, sizeof event);
-	} else if (mData->w) {
-		UGScrollEvent event(mData->w);
-		PostEvent(&event, sizeof event);
+	} else if (nX || nY || nW) {
+		PostMotion(nX, nY, nW);
 	} else if (m_bLeftButton && !bLeftButton) {
         m_bLeftButton = false;
         m_tState = BT_MOUSE_STATE_NORMAL;
@@ -36,10 +36,14 @@
 ** 
 *******************************************************************************/
 #include <bluetooth/btl2cap.h>
+#include <bluetooth/btl2capertm.h>
 #include <bluetooth/btlogicallayer.h>
 #include <bluetooth/btdevice.h>
 #include <bluetooth/btsubsystem.h>
+#include <bluetooth/btlatency.h>
 #include <synchronize.h>
+#include <mutex.h>
+#include <task.h>
 #include <logger.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -55,10 +59,28 @@ CBTL2CAPChannel::CBTL2CAPChannel(u16 nPSM, CBTConnection *pConnection)
 {
 	CID = CBTL2CAPChannel::GetCID();
 	PSM = nPSM;
+	RemoteCID = 0;			// told by the connect response
+	Initiator = true;
 	Connection = pConnection;
 	State = BT_L2CAP_CLOSED;
+	MTU = BT_L2CAP_DEFAULT_MTU;
+	RemoteMTU = BT_L2CAP_DEFAULT_MTU;
 	RTX = BT_L2CAP_DEFAULT_RTX;
 	ERTX = BT_L2CAP_DEFAULT_ERTX;
+	TxQueue = new CBTQueue(BT_L2CAP_TX_QUEUE_SIZE, sizeof(TBTScatter));
+	TxSDU.pData = 0;
+	TxSDU.nLength = 0;
+	TxPurge = 0;
+	TxCallback = 0;
+	TxParam = 0;
+	RxQueue = 0;
+	Mode = BT_L2CAP_MODE_BASIC;
+	ModeSet = FALSE;
+	memset(&LocalRFC, 0, sizeof LocalRFC);
+	LocalFCS = BT_L2CAP_FCS_16;
+	memset(&RemoteRFC, 0, sizeof RemoteRFC);
+	RemoteFCS = BT_L2CAP_FCS_16;
+	ERTM = 0;
 }
 
 CBTL2CAPChannel::CBTL2CAPChannel(u16 nPSM, CBTConnection *pConnection, u16 nCID)
@@ -66,10 +88,37 @@ CBTL2CAPChannel::CBTL2CAPChannel(u16 nPSM, CBTConnection *pConnection, u16 nCID)
 	CID = 0;
 	PSM = nPSM;
 	RemoteCID = nCID;
+	Initiator = false;
 	Connection = pConnection;
 	State = BT_L2CAP_CLOSED;
+	MTU = BT_L2CAP_DEFAULT_MTU;
+	RemoteMTU = BT_L2CAP_DEFAULT_MTU;
 	RTX = BT_L2CAP_DEFAULT_RTX;
 	ERTX = BT_L2CAP_DEFAULT_ERTX;
+	TxQueue = new CBTQueue(BT_L2CAP_TX_QUEUE_SIZE, sizeof(TBTScatter));
+	TxSDU.pData = 0;
+	TxSDU.nLength = 0;
+	TxPurge = 0;
+	TxCallback = 0;
+	TxParam = 0;
+	RxQueue = 0;
+	Mode = BT_L2CAP_MODE_BASIC;
+	ModeSet = FALSE;
+	memset(&LocalRFC, 0, sizeof LocalRFC);
+	LocalFCS = BT_L2CAP_FCS_16;
+	memset(&RemoteRFC, 0, sizeof RemoteRFC);
+	RemoteFCS = BT_L2CAP_FCS_16;
+	ERTM = 0;
+}
+
+CBTL2CAPChannel::~CBTL2CAPChannel(void)
+{
+	delete TxQueue;
+	TxQueue = 0;
+	delete RxQueue;
+	RxQueue = 0;
+	delete ERTM;
+	ERTM = 0;
 }
 
 u16 CBTL2CAPChannel::GetCID(void)
@@ -195,6 +244,36 @@ u8* InsertFlushTO(u8* pOption, u16 nFlushTO)
 	return pOption;
 }
 
+u8* InsertRFC(u8* pOption, const TBTL2CAPRFC* pRFC)
+{
+	CBTL2CAPRetransmission *pRetransmission = (CBTL2CAPRetransmission *)pOption;
+
+	if (pRetransmission) {
+		pRetransmission->Type = BT_L2CAP_OPTION_RFC;
+		pRetransmission->Option = 0;
+		pRetransmission->Length = BT_L2CAP_OPTION_RFC_LEN;
+		pRetransmission->RFC = *pRFC;
+		pOption += sizeof(CBTL2CAPRetransmission);
+	}
+
+	return pOption;
+}
+
+u8* InsertFCS(u8* pOption, u8 nFCS)
+{
+	CBTL2CAPFrameCheck *pFrameCheck = (CBTL2CAPFrameCheck *)pOption;
+
+	if (pFrameCheck) {
+		pFrameCheck->Type = BT_L2CAP_OPTION_FCS;
+		pFrameCheck->Option = 0;
+		pFrameCheck->Length = BT_L2CAP_OPTION_FCS_LEN;
+		pFrameCheck->FCS = nFCS;
+		pOption += sizeof(CBTL2CAPFrameCheck);
+	}
+
+	return pOption;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // L2CAP Layer
@@ -210,18 +289,26 @@ CBTL2CAPLayer::CBTL2CAPLayer (
 {
 	assert (s_pThis == 0);
 	s_pThis = this;
-	m_pEventBuffer = (u8 *)malloc(BT_L2CAP_MIN_SIG_MTU_LEN);
-	assert (m_pEventBuffer != 0);
 
-	// Initialize connection pointer
-	m_pIncomingConnection = NULL;	// Keeps track of any incoming Connection
-	m_eConnectRsp.Identifier = 0;
+	// No signalling request pending
+	for (int i=0; i<BT_L2CAP_MAX_PENDING; i++) {
+		m_Requests[i].hRequest = BT_L2CAP_NO_REQUEST;
+		m_Requests[i].nIdentifier = 0;	// Process scans every slot
+	}
+	m_nNextRequest = BT_L2CAP_NO_REQUEST;
+	m_SpinLock = get_mutex(MUTEX_BT);
+	m_nChannelLock = 0;
+	memset(m_Waiters, 0, sizeof m_Waiters);
+	m_nNextDrain = 0;
 
 	// Assign the L2CAP Callbacks to NULL
 	for (int i=0; i<BT_L2CAP_MAX_PSM_SLOT; i++)
 		m_pL2CAPSignallingCallback[i] = NULL;
 	for (int i=0; i<BT_L2CAP_MAX_PSM_SLOT; i++)
 		m_pPSMSlot[i] = NULL;
+	memset(m_PSMMode, 0, sizeof m_PSMMode);
+	for (int i=0; i<BT_L2CAP_MAX_PSM_SLOT; i++)
+		m_PSMFCS[i] = BT_L2CAP_FCS_16;
 
 	// Register the Logical Layer Callbacks
 	pLogicalLayer->RegisterLayer(this);
@@ -241,12 +328,15 @@ CBTL2CAPLayer::CBTL2CAPLayer (
 
 CBTL2CAPLayer::~CBTL2CAPLayer (void)
 {
+	for (unsigned i = 0; i < m_Closed.GetCount(); i++)
+		delete m_Closed[i];
 	s_pThis = 0;
 }
 
 u8 CBTL2CAPLayer::GetID(void)
 {
 	static u8 id = 1;
+	if (id == 0) id = 1;		// 0 is not a valid identifier
 	return id++;
 }
 
@@ -267,43 +357,35 @@ void CBTL2CAPLayer::DeregisterDataCallback (u16 nPSM)
 	m_pPSMSlot[nPSM] = NULL;
 }
 
-u16 CBTL2CAPLayer::Connect (
+unsigned CBTL2CAPLayer::ConnectAsync (
 	u16 nPSM,
 	TBDAddr sBDAddr,
-	u16 *pLCID,
-	u16 *pStatus)
+	TBTL2CAPCompletion *pCallback,
+	void *pParam)
 {
 	bool connected = false,
-		 connecting = false,
-		 connect = false,
 		 found = false;
 	CBTL2CAPChannel *pChannel = NULL;
 	CBTConnection *pConnection = NULL;
-	u16 nResult = BT_L2CAP_RESULT_PSM_NOT_SUPPORTED;
-	CPtrArray& pConnections = m_pLogicalLayer->GetConnections();
+
+	TBTL2CAPRequest *pRequest = NewRequest(pCallback, pParam);
+	if (!pRequest) return BT_L2CAP_NO_REQUEST;
+	unsigned hRequest = pRequest->hRequest;
+	pRequest->Result.nResult = BT_L2CAP_RESULT_PSM_NOT_SUPPORTED;
 
 	LOG_DEBUG("L2CAP: CONNECT\r\n");
 	// Find the device descriptor to be connected
-	for (int i=0; i<pConnections.GetCount(); i++) {
-    	const u8* bda = ((CBTConnection *)pConnections[i])->GetBDAddress();
-		if (!memcmp(sBDAddr, bda, BT_BD_ADDR_SIZE)) {
-    		pConnection = (CBTConnection *)pConnections[i];
-			if (pConnection) {
-    			connected = pConnection->IsConnected()
-						|| pConnection->IsAuthenticated();
-    			connecting = pConnection->GetDevice()->IsConnecting();
-			}
-			break;
-		}
-	}
-	if (connecting) return nResult;
+	pConnection = m_pLogicalLayer->GetConnection(sBDAddr);
+	if (pConnection)
+		connected = pConnection->IsConnected()
+			|| pConnection->IsAuthenticated();
 
 	// If a device descriptor exists
 	if (pConnection) {
 
 		// Search for an existing channel
-		for (int i=0; i<m_Channels.GetCount(); i++) {
-			pChannel = (CBTL2CAPChannel *)m_Channels[i];
+		for (unsigned i=0; i<m_Channels.GetCount(); i++) {
+			pChannel = m_Channels[i];
 			if (pChannel->PSM == nPSM && pChannel->Connection == pConnection) {
 				found = true;
 				break;
@@ -314,50 +396,64 @@ u16 CBTL2CAPLayer::Connect (
 		if (!found) {
 			pChannel = new CBTL2CAPChannel(nPSM, pConnection);
 			assert(pChannel != 0);
+			InitChannelMode(pChannel);
+			InsertChannel(pChannel);
 		}
 
 		// Check if channel is already open
 		if (pChannel->IsOpen()) {
-			*pLCID = pChannel->CID;
-			*pStatus = BT_L2CAP_STATUS_NO_FURTHER_INFORMATION;
-			nResult = BT_L2CAP_RESULT_CONNECTION_SUCCESSFUL;
+			pRequest->Result.nCID = pChannel->CID;
+			pRequest->Result.nStatus = BT_L2CAP_STATUS_NO_FURTHER_INFORMATION;
+			pRequest->Result.nResult = BT_L2CAP_RESULT_CONNECTION_SUCCESSFUL;
 
-		} else if (!connected) {
-			// Connect the device if not connected
+		} else {
+			if (pConnection->GetDevice())
+				pConnection->GetDevice()->SetState(BT_DEVICE_CONNECTING);
 			pChannel->Initiator = true;
-			pChannel->State = BT_L2CAP_CLOSED;
-			pConnection->GetDevice()->SetState(BT_DEVICE_CONNECTING);
-			bool status = m_pLogicalLayer->Connect(pConnection);
-			if (!status)
-				status = m_pLogicalLayer->Authenticate(
-					pConnection, (char *)BT_DEFAULT_PIN);
-			if (status) {		// connection failed
-				// Close the created channel
-				pConnection->GetDevice()->SetState(BT_DEVICE_IDLE);
-				if (!found && pChannel) delete pChannel;
-			} else connect = true;
-		} else connect = true;
-	}
-
-	// Connect the channel
-	if (connect) {
-		LOG_DEBUG("L2CAP: Channel PSM = %d\r\n", (int)nPSM);
-		pConnection->GetDevice()->SetState(BT_DEVICE_CONNECTING);
-		m_Channels.Append(pChannel);
-		Clear();
-		pChannel->State = BT_L2CAP_W4_L2CAP_CONNECT_RSP;
-		u8 ID = GetID();
-		CBTL2CAPConnectionRequest cmd(ID, nPSM, pChannel->CID);
-		CBTL2CAPSignallingPacket pkt((u8*)&cmd, (sizeof cmd));
-		m_eConnectRsp.Identifier = ID;
-		m_eConnectRsp.SCID = pLCID;
-		m_eConnectRsp.DCID = &pChannel->RemoteCID;
-		m_eConnectRsp.Result = &nResult;
-		m_eConnectRsp.Status = pStatus;
-		m_eConnectRsp.State = &pChannel->State;
-		m_pLogicalLayer->SendACLData(pConnection, (void *)&pkt, (sizeof cmd)+4);
-		Wait();
-		m_eConnectRsp.Identifier = 0;
+
+			if (connected) {
+				// Connect the channel, the response completes the request
+				SendConnectRequest(pRequest, pChannel);
+				return hRequest;
+			}
+
+			// The baseband connection and the authentication go on in the
+			// stack task, any number of links may be set up at once. Only
+			// one caller pages a device, the others wait for its link.
+			bool start;
+			spin_lock(m_SpinLock);
+			start = pConnection->GetState() != BTConnectionStateConnecting
+				&& pConnection->GetState() != BTConnectionStateAuthenticating;
+			if (start) pConnection->SetState(BTConnectionStateConnecting);
+			spin_unlock(m_SpinLock);
+			if (start) m_pLogicalLayer->ConnectAsync(pConnection);
+
+			pChannel->State = BT_L2CAP_W4_LP_CONNECT_CFM;
+			DataMemBarrier();
+			pRequest->pChannel = pChannel;	// Process takes it from here
+			return hRequest;
+		}
+	}
+
+	CompleteRequest(pRequest);
+	return hRequest;
+}
+
+u16 CBTL2CAPLayer::Connect (
+	u16 nPSM,
+	TBDAddr sBDAddr,
+	u16 *pLCID,
+	u16 *pStatus)
+{
+	TBTL2CAPResult Result;
+	unsigned hRequest = ConnectAsync(nPSM, sBDAddr);
+	if (hRequest == BT_L2CAP_NO_REQUEST)
+		return BT_L2CAP_NO_RESOURCES_AVAILABLE;
+
+	u16 nResult = WaitRequest(hRequest, &Result);
+	if (nResult != BT_L2CAP_RESULT_PSM_NOT_SUPPORTED) {
+		*pLCID = Result.nCID;
+		*pStatus = Result.nStatus;
 	}
 
 	return nResult;
@@ -382,9 +478,10 @@ u16 CBTL2CAPLayer::ConnectResponse (
 	// If a connection descriptor exists
 	if (pConnection) {
 		// Search for an existing channel
-		for (int i=0; i<m_Channels.GetCount(); i++) {
-			pChannel = (CBTL2CAPChannel *)m_Channels[i];
-			if (pChannel->State == BT_L2CAP_W4_L2CA_CONNECT_RSP) {
+		for (unsigned i=0; i<m_Channels.GetCount(); i++) {
+			pChannel = m_Channels[i];
+			if (pChannel->State == BT_L2CAP_W4_L2CA_CONNECT_RSP
+			    && pChannel->Connection == pConnection) {
 				found = true;
 				break;
 			}
@@ -396,6 +493,7 @@ u16 CBTL2CAPLayer::ConnectResponse (
 			pChannel->State = BT_L2CAP_CONFIG;
 			pChannel->CID = nLCID;
 			pChannel->Connection = pConnection;
+			IndexChannel(pChannel);
 			CBTL2CAPConnectionResponse cmd(
 				nIdentifier, nLCID, pChannel->RemoteCID, nResponse, nStatus);
 			CBTL2CAPSignallingPacket pkt((u8*)&cmd, (sizeof cmd));
@@ -408,6 +506,38 @@ u16 CBTL2CAPLayer::ConnectResponse (
 	return nResult;
 }
 
+unsigned CBTL2CAPLayer::ConfigureAsync (
+	u16 nCID,
+	u16 nInMTU,
+	TBTL2CAPFlowSpec* sOutFlow,
+	u16 nOutFlushTO,
+	TBTL2CAPCompletion *pCallback,
+	void *pParam)
+{
+	CBTL2CAPChannel *pChannel = NULL;
+
+	TBTL2CAPRequest *pRequest = NewRequest(pCallback, pParam);
+	if (!pRequest) return BT_L2CAP_NO_REQUEST;
+	unsigned hRequest = pRequest->hRequest;
+	pRequest->Result.nResult = BT_L2CAP_RESULT_REJECTED;
+	pRequest->Result.nCID = nCID;
+
+	LOG_DEBUG("L2CAP: CONFIGURE\r\n");
+	// Search for an existing channel
+	pChannel = GetChannel(nCID);
+	if (pChannel && (pChannel->State == BT_L2CAP_CONFIG
+		|| pChannel->State == BT_L2CAP_OPEN)) {
+		u8 ID = GetID();
+		StartRequest(pRequest, BT_SIG_CONFIGURE_RESPONSE, ID,
+			pChannel, pChannel->RTX);
+		SendConfigureRequest(pChannel, ID, nInMTU, sOutFlow, nOutFlushTO);
+		return hRequest;
+	}
+
+	CompleteRequest(pRequest);
+	return hRequest;
+}
+
 u16 CBTL2CAPLayer::Configure (
 	u16 nCID,
 	u16 nInMTU,
@@ -419,59 +549,84 @@ u16 CBTL2CAPLayer::Configure (
 	u16 *pOutFlushTO,
 	bool blocking)
 {
-	u8 Config[32];
+	if (!blocking) {
+		LOG_DEBUG("L2CAP: CONFIGURE\r\n");
+		// the acceptor answers the configure request of the remote side,
+		// its response is reported as L2CA_CONFIG_CFM
+		CBTL2CAPChannel *pChannel = GetChannel(nCID);
+		if (!pChannel || (pChannel->State != BT_L2CAP_CONFIG
+			&& pChannel->State != BT_L2CAP_OPEN))
+			return BT_L2CAP_RESULT_REJECTED;
+		if (!pChannel->Initiator)
+			SendConfigureRequest(pChannel, GetID(), nInMTU, sOutFlow, nOutFlushTO);
+		return BT_L2CAP_RESULT_REJECTED;
+	}
+
+	TBTL2CAPResult Result;
+	unsigned hRequest = ConfigureAsync(nCID, nInMTU, sOutFlow, nOutFlushTO);
+	if (hRequest == BT_L2CAP_NO_REQUEST)
+		return BT_L2CAP_RESULT_REJECTED;
+
+	u16 nResult = WaitRequest(hRequest, &Result);
+	*pInMTU = Result.nMTU;
+	if (Result.bFlow)	// QoS is optional in the response
+		*pOutFlow = Result.Flow;
+	*pOutFlushTO = Result.nFlushTO;
+
+	return nResult;
+}
+
+void CBTL2CAPLayer::SendConfigureRequest (
+	CBTL2CAPChannel* pChannel,
+	u8 nID,
+	u16 nInMTU,
+	TBTL2CAPFlowSpec* sOutFlow,
+	u16 nOutFlushTO)
+{
+	u8 Config[BT_L2CAP_MAX_OPTION_LEN];
 	u16 nLength = 0;
-	bool found = false;
-	CBTL2CAPChannel *pChannel = NULL;
-	u16 nResult = BT_L2CAP_RESULT_REJECTED;
 
-	LOG_DEBUG("L2CAP: CONFIGURE\r\n");
-	// Search for an existing channel
-	for (int i=0; i<m_Channels.GetCount(); i++) {
-		pChannel = (CBTL2CAPChannel *)m_Channels[i];
-		if (pChannel->CID == nCID && (pChannel->State == BT_L2CAP_CONFIG
-			|| pChannel->State == BT_L2CAP_OPEN)) {
-			found = true;
-			break;
-		}
+	u8 *pConfig = Config;
+	if (nInMTU) {
+		pConfig = InsertMTU(pConfig, nInMTU);
+		nLength += sizeof(CBTL2CAPMTU);
+		// PDUs up to our MTU have to be reassembled
+		m_pLogicalLayer->SetHCIReceiveMTU(pChannel->Connection, nInMTU);
+		pChannel->MTU = nInMTU;
 	}
-	if (found) {
-		if (blocking) Clear();
-		u8 ID = GetID();
-		u8 *pConfig = Config;
-		if (nInMTU) {
-			pConfig = InsertMTU(pConfig, nInMTU);
-			nLength += sizeof(CBTL2CAPMTU);
-		}
-		if (nOutFlushTO) {
-			pConfig = InsertFlushTO(pConfig, nOutFlushTO);
-			nLength += sizeof(CBTL2CAPFlushTimeout);
-		}
-		if (sOutFlow) {
-			pConfig = InsertFlow(pConfig, sOutFlow);
-			nLength += sizeof(CBTL2CAPQoS);
-		}
-		if (blocking ^ pChannel->Initiator == 0) {
-			CBTL2CAPConfigurationRequest cmd(
-				ID, pChannel->RemoteCID, 0, (CBTL2CAPOption *)Config, nLength);
-			CBTL2CAPSignallingPacket pkt((u8*)&cmd, cmd.GetLength() );
-			m_pLogicalLayer->SendACLData(
-				pChannel->Connection, (void *)&pkt, cmd.GetLength() +4);
-		}
-		if (blocking) {
-			m_eConfigRsp.Identifier = ID;
-			Wait();
-			if (ID == m_eConfigRsp.Identifier) {
-				nResult = m_eConfigRsp.Result;
-				*pInMTU = m_eConfigRsp.MTU;
-				*pOutFlow = *m_eConfigRsp.Flow;
-				*pOutFlushTO = m_eConfigRsp.FlushTO;
-				if (!pChannel->Initiator && nResult == BT_L2CAP_RESULT_SUCCESS)
-					pChannel->State = BT_L2CAP_OPEN; //initiator stays in CONFIG
-			}
+	if (nOutFlushTO) {
+		pConfig = InsertFlushTO(pConfig, nOutFlushTO);
+		nLength += sizeof(CBTL2CAPFlushTimeout);
+	}
+	if (pChannel->LocalRFC.Mode != BT_L2CAP_MODE_BASIC) {
+		// the timeouts are told by the response
+		TBTL2CAPRFC *pRFC = &pChannel->LocalRFC;
+		if (!pRFC->MPS || pRFC->MPS > pChannel->MTU)
+			pRFC->MPS = pChannel->MTU;
+		pRFC->RetransmissionTimeout = 0;
+		pRFC->MonitorTimeout = 0;
+		pConfig = InsertRFC(pConfig, pRFC);
+		nLength += sizeof(CBTL2CAPRetransmission);
+		if (pChannel->LocalFCS == BT_L2CAP_FCS_NONE) {
+			pConfig = InsertFCS(pConfig, pChannel->LocalFCS);
+			nLength += sizeof(CBTL2CAPFrameCheck);
 		}
+		m_pLogicalLayer->SetHCIReceiveMTU(pChannel->Connection,
+			pRFC->MPS + BT_L2CAP_CONTROL_LEN + BT_L2CAP_FCS_LEN);
 	}
-	return nResult;
+	// a mode proposed later by the remote is refused, not taken
+	pChannel->ModeSet = TRUE;
+	// the command has to fit the minimum signalling MTU, QoS is optional
+	if (sOutFlow && nLength + sizeof(CBTL2CAPQoS)
+			<= BT_L2CAP_MIN_SIG_MTU_LEN - 8) {
+		pConfig = InsertFlow(pConfig, sOutFlow);
+		nLength += sizeof(CBTL2CAPQoS);
+	}
+	CBTL2CAPConfigurationRequest cmd(
+		nID, pChannel->RemoteCID, 0, (CBTL2CAPOption *)Config, nLength);
+	CBTL2CAPSignallingPacket pkt((u8*)&cmd, cmd.GetLength() );
+	m_pLogicalLayer->SendACLData(
+		pChannel->Connection, (void *)&pkt, cmd.GetLength() +4);
 }
 
 u16 CBTL2CAPLayer::ConfigureResponse (
@@ -483,21 +638,16 @@ u16 CBTL2CAPLayer::ConfigureResponse (
 	u16 nInFlushTO,
 	TBTL2CAPFlowSpec* sInFlow)
 {
-	u8 Config[32];
+	u8 Config[BT_L2CAP_MAX_OPTION_LEN];
 	u16 nLength = 0;
 	bool found = false;
 	CBTL2CAPChannel *pChannel = NULL;
 
 	LOG_DEBUG("L2CAP: CONFIGURE RESPONSE\r\n");
 	// Search for an existing channel
-	for (int i=0; i<m_Channels.GetCount(); i++) {
-		pChannel = (CBTL2CAPChannel *)m_Channels[i];
-		if (pChannel->CID == nLCID && (pChannel->State == BT_L2CAP_CONFIG
-			|| pChannel->State == BT_L2CAP_OPEN)) {
-			found = true;
-			break;
-		}
-	}
+	pChannel = GetChannel(nLCID);
+	found = pChannel && (pChannel->State == BT_L2CAP_CONFIG
+		|| pChannel->State == BT_L2CAP_OPEN);
 	if (found) {
 		u8 *pConfig = Config;
 		if (nOutMTU) {
@@ -508,7 +658,25 @@ u16 CBTL2CAPLayer::ConfigureResponse (
 			pConfig = InsertFlushTO(pConfig, nInFlushTO);
 			nLength += sizeof(CBTL2CAPFlushTimeout);
 		}
-		if (sInFlow) {
+		if (nResult == BT_L2CAP_RESULT_SUCCESS
+		    && pChannel->RemoteRFC.Mode != pChannel->LocalRFC.Mode) {
+			// both directions use one mode, the remote has to ask for ours
+			nResult = BT_L2CAP_RESULT_UNACCEPTABLE_PARAMETERS;
+			pConfig = InsertRFC(pConfig, &pChannel->LocalRFC);
+			nLength += sizeof(CBTL2CAPRetransmission);
+		} else if (pChannel->RemoteRFC.Mode != BT_L2CAP_MODE_BASIC) {
+			// accepted as asked, with the timeouts the remote has to use
+			TBTL2CAPRFC RFC = pChannel->RemoteRFC;
+			if (RFC.Mode == BT_L2CAP_MODE_ERTM) {
+				RFC.RetransmissionTimeout = BT_L2CAP_ERTM_RETRANS_TIMEOUT;
+				RFC.MonitorTimeout = BT_L2CAP_ERTM_MONITOR_TIMEOUT;
+			}
+			pConfig = InsertRFC(pConfig, &RFC);
+			nLength += sizeof(CBTL2CAPRetransmission);
+		}
+		// the command has to fit the minimum signalling MTU
+		if (sInFlow && nLength + sizeof(CBTL2CAPQoS)
+				<= BT_L2CAP_MIN_SIG_MTU_LEN - 10) {
 			pConfig = InsertFlow(pConfig, sInFlow);
 			nLength += sizeof(CBTL2CAPQoS);
 		}
@@ -519,45 +687,53 @@ u16 CBTL2CAPLayer::ConfigureResponse (
 		m_pLogicalLayer->SendACLData(
 			pChannel->Connection, (void *)&pkt, cmd.GetLength() + 4);
 		if (pChannel->Initiator && nResult == BT_L2CAP_RESULT_SUCCESS)
-			pChannel->State = BT_L2CAP_OPEN; //Acceptor stays in CONFIG
+			OpenChannel(pChannel); //Acceptor stays in CONFIG
 	}
 
 	return nResult;
 }
 
-u16 CBTL2CAPLayer::Disconnect (u16 nLCID)
+unsigned CBTL2CAPLayer::DisconnectAsync (
+	u16 nLCID,
+	TBTL2CAPCompletion *pCallback,
+	void *pParam)
 {
-	u16 nResult = BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED;
-	bool found = false;
 	CBTL2CAPChannel *pChannel = NULL;
 
+	TBTL2CAPRequest *pRequest = NewRequest(pCallback, pParam);
+	if (!pRequest) return BT_L2CAP_NO_REQUEST;
+	unsigned hRequest = pRequest->hRequest;
+	pRequest->Result.nResult = BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED;
+	pRequest->Result.nCID = nLCID;
+
 	LOG_DEBUG("L2CAP: DISCONNECT\r\n");
 	// Search for an existing channel
-	for (int i=0; i<m_Channels.GetCount(); i++) {
-		pChannel = (CBTL2CAPChannel *)m_Channels[i];
-		if (pChannel->CID == nLCID && (pChannel->State == BT_L2CAP_CONFIG
-			|| pChannel->State == BT_L2CAP_OPEN)) {
-			found = true;
-			break;
-		}
-	}
-	if (found) {
-		Clear();
+	pChannel = GetChannel(nLCID);
+	if (pChannel && (pChannel->State == BT_L2CAP_CONFIG
+		|| pChannel->State == BT_L2CAP_OPEN)) {
 		u8 nID = GetID();
 		pChannel->State = BT_L2CAP_W4_L2CAP_DISCONNECT_RSP;
 		CBTL2CAPDisconnectionRequest cmd(
 			nID, pChannel->RemoteCID, pChannel->CID);
 		CBTL2CAPSignallingPacket pkt((u8*)&cmd, cmd.GetLength());
+		StartRequest(pRequest, BT_SIG_DISCONNECTION_RESPONSE, nID,
+			pChannel, pChannel->RTX);
 		m_pLogicalLayer->SendACLData(
 			pChannel->Connection, (void *)&pkt, cmd.GetLength() + 4);
-		Wait(pChannel->RTX);
-		if (m_eDisconnectRsp.Identifier == nID) 
-			nResult = BT_L2CAP_RESULT_DISCONNECTION_SUCCESSFUL;
-		m_eDisconnectRsp.Identifier = 0;	// reset the id
-		pChannel->State = BT_L2CAP_CLOSED;	// mark it closed
-		m_Channels.Delete(pChannel);		// delete the channel
+		return hRequest;
 	}
-	return nResult;
+
+	CompleteRequest(pRequest);
+	return hRequest;
+}
+
+u16 CBTL2CAPLayer::Disconnect (u16 nLCID)
+{
+	unsigned hRequest = DisconnectAsync(nLCID);
+	if (hRequest == BT_L2CAP_NO_REQUEST)
+		return BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED;
+
+	return WaitRequest(hRequest);
 }
 
 u16 CBTL2CAPLayer::DisconnectResponse (u8 nID, u16 nLCID)
@@ -568,22 +744,15 @@ u16 CBTL2CAPLayer::DisconnectResponse (u8 nID, u16 nLCID)
 
 	LOG_DEBUG("L2CAP: DISCONNECT RESPONSE\r\n");
 	// Search for an existing channel
-	for (int i=0; i<m_Channels.GetCount(); i++) {
-		pChannel = (CBTL2CAPChannel *)m_Channels[i];
-		if (pChannel->CID == nLCID && 
-			pChannel->State == BT_L2CAP_W4_L2CA_DISCONNECT_RSP) {
-			found = true;
-			break;
-		}
-	}
+	pChannel = GetChannel(nLCID);
+	found = pChannel && pChannel->State == BT_L2CAP_W4_L2CA_DISCONNECT_RSP;
 	if (found) {
 		CBTL2CAPDisconnectionResponse cmd(
 			nID, pChannel->CID, pChannel->RemoteCID);
 		CBTL2CAPSignallingPacket pkt((u8*)&cmd, cmd.GetLength());
 		m_pLogicalLayer->SendACLData(
 			pChannel->Connection, (void *)&pkt, cmd.GetLength() + 4);
-		pChannel->State = BT_L2CAP_CLOSED;	// mark it closed
-		m_Channels.Delete(pChannel);		// delete the channel
+		CloseChannel(pChannel);
 		nResult = BT_L2CAP_RESULT_DISCONNECTION_SUCCESSFUL;
 	}
 	return nResult;
@@ -600,63 +769,445 @@ u16 CBTL2CAPLayer::Write (
 	CBTL2CAPChannel *pChannel = NULL;
 
 	LOG_DEBUG("L2CAP: WRITE\r\n");
+	unsigned nStartTicks = getClockTicks ();
 	// Search for an existing channel
-	for (int i=0; i<m_Channels.GetCount(); i++) {
-		pChannel = (CBTL2CAPChannel *)m_Channels[i];
-		if (pChannel->CID == nCID && (pChannel->State == BT_L2CAP_OPEN)) {
-			found = true;
-			break;
+	pChannel = GetChannel(nCID);
+	found = pChannel && pChannel->State == BT_L2CAP_OPEN;
+	if (found && pChannel->ERTM) {
+		if (nLength > pChannel->RemoteMTU) {
+			return BT_L2CAP_RESULT_REJECTED;
+		}
+		// the engine runs in the stack task and copies the SDU; until
+		// then the queue refers to pOutBuffer
+		while (pChannel->TxQueue->GetFreeCount() == 0) {
+			if (!(pChannel = WaitWrite(pChannel, nStartTicks))) {
+				return BT_L2CAP_RESULT_REJECTED;
+			}
+		}
+		TBTScatter SDU = {pOutBuffer, nLength};
+		if (!pChannel->TxQueue->Enqueue((const void *) &SDU, sizeof SDU)) {
+			return BT_L2CAP_RESULT_REJECTED;
+		}
+		while (IsWriting(pChannel)) {
+			if (!(pChannel = WaitWrite(pChannel, nStartTicks))) {
+				PurgeWrite(nCID, pOutBuffer);
+				return BT_L2CAP_RESULT_REJECTED;
+			}
 		}
-	}
-	if (found) {
-		Clear();
-		CBTL2CAPConnectionOrientedDataPacket pkt(
-			nLength, pChannel->RemoteCID, pOutBuffer);
-		m_pLogicalLayer->SendACLData(
-			pChannel->Connection, (void *)&pkt, nLength + 4);
-		Wait(pChannel->RTX);
 		nResult = BT_L2CAP_RESULT_SUCCESS;
+	} else if (found) {
+		if (!FitsLink(m_pLogicalLayer, nLength)) {
+			return BT_L2CAP_RESULT_REJECTED;
+		}
+		// streamed SDUs go first; the SDU is copied into the link queue,
+		// nothing refers to pOutBuffer once this returns
+		TBTScatter SDU = {pOutBuffer, nLength};
+		while (IsWriting(pChannel) || SendSDU(pChannel, &SDU)) {
+			if (!(pChannel = WaitWrite(pChannel, nStartTicks))) {
+				return BT_L2CAP_RESULT_REJECTED;
+			}
+		}
+		nResult = BT_L2CAP_RESULT_SUCCESS;
+#ifdef BT_HAVE_LATENCY
+		CBTLatency::RecordSince (BTLatencyL2CAPWrite, nStartTicks, nLength);
+#endif
 	}
 	return nResult;
 }
 
-u16 CBTL2CAPLayer::Read (
+u16 CBTL2CAPLayer::WriteAsync (u16 nCID, const void *pSDU, u16 nLength)
+{
+	CBTL2CAPChannel *pChannel = GetChannel(nCID);
+	if (!pChannel || pChannel->State != BT_L2CAP_OPEN) {
+		return BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED;
+	}
+	assert(pSDU != 0);
+	if (pChannel->ERTM ? nLength > pChannel->RemoteMTU
+			   : !FitsLink(m_pLogicalLayer, nLength)) {
+		return BT_L2CAP_RESULT_REJECTED;	// would never get room
+	}
+
+	TBTScatter SDU = {pSDU, nLength};
+	if (!pChannel->TxQueue->Enqueue((const void *) &SDU, sizeof SDU)) {
+		return BT_L2CAP_RESULT_REJECTED;	// channel queue full
+	}
+	return BT_L2CAP_RESULT_SUCCESS;
+}
+
+bool CBTL2CAPLayer::SetWriteCallback (
+	u16 nCID,
+	TBTL2CAPWriteCompletion *pCallback,
+	void *pParam)
+{
+	CBTL2CAPChannel *pChannel = GetChannel(nCID);
+	if (!pChannel) return false;
+
+	pChannel->TxParam = pParam;
+	pChannel->TxCallback = pCallback;
+	return true;
+}
+
+bool CBTL2CAPLayer::IsWriting (CBTL2CAPChannel *pChannel)
+{
+	if (!pChannel->TxQueue->IsEmpty()) return true;
+	// the head is dequeued into TxSDU, which is set once the queue is seen
+	// empty
+	DataMemBarrier();
+	return pChannel->TxSDU.pData != 0;
+}
+
+CBTL2CAPChannel *CBTL2CAPLayer::WaitWrite (CBTL2CAPChannel *pChannel, unsigned nStartTicks)
+{
+	if (   pChannel->State != BT_L2CAP_OPEN
+	    || getClockTicks() - nStartTicks >= pChannel->RTX) {
+		return 0;
+	}
+	// Process wakes us after each pass
+	u16 nCID = pChannel->CID;
+	WaitChannel(nCID, TRUE, BT_L2CAP_WAIT_SLICE);
+
+	// DeleteChannel may have freed it meanwhile
+	pChannel = GetChannel(nCID);
+	return pChannel && pChannel->State == BT_L2CAP_OPEN ? pChannel : 0;
+}
+
+void CBTL2CAPLayer::WaitChannel (u16 nCID, boolean bWrite, unsigned nMicros)
+{
+	TBTL2CAPWaiter *pWaiter = 0;
+	spin_lock(m_SpinLock);
+	for (unsigned i = 0; i < BT_L2CAP_MAX_WAITERS; i++) {
+		if (!m_Waiters[i].bUsed) {
+			pWaiter = &m_Waiters[i];
+			pWaiter->bUsed = TRUE;
+			pWaiter->bWrite = bWrite;
+			pWaiter->nCID = nCID;
+			break;
+		}
+	}
+	spin_unlock(m_SpinLock);
+
+	// without a slot the caller only polls
+	if (!pWaiter) {
+		sleepTask(nMicros);
+		return;
+	}
+
+	sleepBlockedTask(&pWaiter->pTask, nMicros);
+	pWaiter->bUsed = FALSE;
+}
+
+void CBTL2CAPLayer::WakeChannel (u16 nCID, boolean bWrite)
+{
+	for (unsigned i = 0; i < BT_L2CAP_MAX_WAITERS; i++) {
+		TBTL2CAPWaiter *pWaiter = &m_Waiters[i];
+		if (   pWaiter->bUsed
+		    && pWaiter->bWrite == bWrite
+		    && (!nCID || !pWaiter->nCID || pWaiter->nCID == nCID)
+		    && pWaiter->pTask) {
+			wakeTask(&pWaiter->pTask);
+		}
+	}
+}
+
+bool CBTL2CAPLayer::RegisterChannelMode (
+	u16 nPSM,
+	const TBTL2CAPRFC *pRFC,
+	u8 nFCS)
+{
+	assert(pRFC != 0);
+	if (   nPSM >= BT_L2CAP_MAX_PSM_SLOT
+	    || pRFC->TxWindow > BT_L2CAP_ERTM_MAX_WINDOW
+	    || (   pRFC->Mode != BT_L2CAP_MODE_BASIC
+		&& pRFC->Mode != BT_L2CAP_MODE_ERTM
+		&& pRFC->Mode != BT_L2CAP_MODE_STREAMING)) {
+		return false;
+	}
+
+	TBTL2CAPRFC *pMode = &m_PSMMode[nPSM];
+	*pMode = *pRFC;
+	if (pMode->Mode == BT_L2CAP_MODE_ERTM) {
+		if (!pMode->TxWindow) pMode->TxWindow = BT_L2CAP_ERTM_TX_WINDOW;
+		if (!pMode->MaxTransmit) pMode->MaxTransmit = BT_L2CAP_ERTM_MAX_TRANSMIT;
+	}
+	m_PSMFCS[nPSM] = nFCS;
+	return true;
+}
+
+u8 CBTL2CAPLayer::GetChannelMode (u16 nCID)
+{
+	CBTL2CAPChannel *pChannel = GetChannel(nCID);
+
+	return pChannel ? pChannel->Mode : BT_L2CAP_MODE_BASIC;
+}
+
+void CBTL2CAPLayer::InitChannelMode (CBTL2CAPChannel *pChannel)
+{
+	u16 nPSM = pChannel->PSM;
+	if (   nPSM < BT_L2CAP_MAX_PSM_SLOT
+	    && m_PSMMode[nPSM].Mode != BT_L2CAP_MODE_BASIC) {
+		pChannel->ModeSet = TRUE;
+		pChannel->LocalRFC = m_PSMMode[nPSM];
+		pChannel->LocalFCS = m_PSMFCS[nPSM];
+	}
+}
+
+void CBTL2CAPLayer::SetRemoteConfig (
+	u16 nCID,
+	u16 nMTU,
+	const TBTL2CAPRFC *pRFC,
+	u8 nFCS)
+{
+	CBTL2CAPChannel *pChannel = GetChannel(nCID);
+	if (!pChannel) return;
+
+	// largest SDU the remote takes, segmented by the engine
+	pChannel->RemoteMTU = nMTU ? nMTU : BT_L2CAP_DEFAULT_MTU;
+
+	// the timeouts of a request mean nothing, ours come with the response
+	u16 nRetransmission = pChannel->RemoteRFC.RetransmissionTimeout;
+	u16 nMonitor = pChannel->RemoteRFC.MonitorTimeout;
+	if (pRFC)		// points into the received packet
+		pChannel->RemoteRFC = *pRFC;
+	else
+		memset(&pChannel->RemoteRFC, 0, sizeof pChannel->RemoteRFC);
+	pChannel->RemoteRFC.RetransmissionTimeout = nRetransmission;
+	pChannel->RemoteRFC.MonitorTimeout = nMonitor;
+	pChannel->RemoteFCS = nFCS;
+
+	// without a mode of our own the remote's is taken
+	if (!pChannel->ModeSet && pChannel->State != BT_L2CAP_OPEN) {
+		memset(&pChannel->LocalRFC, 0, sizeof pChannel->LocalRFC);
+		pChannel->LocalRFC.Mode = pChannel->RemoteRFC.Mode;
+		if (pChannel->LocalRFC.Mode == BT_L2CAP_MODE_ERTM) {
+			pChannel->LocalRFC.TxWindow = BT_L2CAP_ERTM_TX_WINDOW;
+			pChannel->LocalRFC.MaxTransmit = BT_L2CAP_ERTM_MAX_TRANSMIT;
+		}
+	}
+}
+
+void CBTL2CAPLayer::OpenChannel (CBTL2CAPChannel *pChannel)
+{
+	if (pChannel->State == BT_L2CAP_OPEN) return;	// the mode stays
+
+	pChannel->Mode = pChannel->LocalRFC.Mode;
+	if (pChannel->Mode != BT_L2CAP_MODE_BASIC && !pChannel->ERTM) {
+		TBTL2CAPRFC Tx = pChannel->RemoteRFC;
+		TBTL2CAPRFC Rx = pChannel->LocalRFC;
+		if (!Rx.MPS) Rx.MPS = pChannel->MTU;
+		// an I-frame has to fit the link queue at once
+		unsigned nLinkMPS = m_pLogicalLayer->GetHCIACLDataLength()
+			* BT_HCI_TX_LINK_QUEUE_SIZE - sizeof(CBTL2CAPPacket)
+			- BT_L2CAP_CONTROL_LEN - BT_L2CAP_FCS_LEN;
+		if (!Tx.MPS || Tx.MPS > nLinkMPS) Tx.MPS = nLinkMPS;
+		// the FCS is only left out if both sides asked for that
+		boolean bFCS =    pChannel->LocalFCS != BT_L2CAP_FCS_NONE
+			       || pChannel->RemoteFCS != BT_L2CAP_FCS_NONE;
+		pChannel->ERTM = new CBTL2CAPERTM(m_pLogicalLayer,
+			pChannel->Connection, pChannel->RemoteCID, &Tx, &Rx, bFCS,
+			pChannel->MTU);
+		assert(pChannel->ERTM != 0);
+	}
+	// writers check the engine once they see the channel open
+	DataMemBarrier();
+	pChannel->State = BT_L2CAP_OPEN;
+}
+
+bool CBTL2CAPLayer::SetReceiveQueue (u16 nCID, unsigned nDepth, u16 nMaxSDU)
+{
+	assert(nDepth > 0);
+	u16 nMTU = 0;
+	spin_lock((void *) &m_nChannelLock);
+	CBTL2CAPChannel *pChannel = LookupChannel(nCID);
+	if (pChannel && !pChannel->RxQueue) nMTU = pChannel->MTU;
+	spin_unlock((void *) &m_nChannelLock);
+	if (!nMTU) return false;	// gone or too late to resize
+
+	return AttachReceiveQueue(nCID,
+		new CBTQueue(nDepth, nMaxSDU ? nMaxSDU : nMTU)) != FALSE;
+}
+
+u16 CBTL2CAPLayer::TryRead (
 	u16 nCID,
 	u16 nLength,
 	u8 *pBuffer,
 	u16 *pN)
 {
-	u16 nResult = BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED;
-	bool found = false;
-	CBTL2CAPChannel *pChannel = NULL;
+	// buffered SDUs stay readable until the channel is removed, which
+	// waits for the lock
+	unsigned nSDU = 0;
+	u16 nResult = BT_L2CAP_RESULT_REJECTED;
+	spin_lock((void *) &m_nChannelLock);
+	CBTL2CAPChannel *pChannel = LookupChannel(nCID);
+	if (pChannel && pChannel->RxQueue)
+		nSDU = pChannel->RxQueue->Dequeue(pBuffer, nLength, 0);
+	if (pChannel && pChannel->State == BT_L2CAP_OPEN)
+		nResult = BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED;
+	spin_unlock((void *) &m_nChannelLock);
+	if (nSDU == 0) return nResult;
+
+	if (nSDU > nLength) nSDU = nLength;
+	CBTPacketPool::CountCopy (BTCopyLayerL2CAP, nSDU);
+	if (pN) *pN = nSDU;
+	return BT_L2CAP_RESULT_SUCCESS;
+}
+
+u16 CBTL2CAPLayer::Read (
+	u16 nCID,
+	u16 nLength,
+	u8 *pBuffer,
+	u16 *pN,
+	unsigned nTimeout)
+{
+	u16 nResult = BT_L2CAP_RESULT_REJECTED;
 
 	LOG_DEBUG("L2CAP: READ\r\n");
-	// Search for an existing channel
-	for (int i=0; i<m_Channels.GetCount(); i++) {
-		pChannel = (CBTL2CAPChannel *)m_Channels[i];
-		if (pChannel->CID == nCID && (pChannel->State == BT_L2CAP_OPEN)) {
-			found = true;
-			break;
-		}
+	unsigned nStartTicks = getClockTicks ();
+	boolean bFound = FALSE;
+	boolean bQueue = FALSE;
+	u16 nMTU = 0;
+	spin_lock((void *) &m_nChannelLock);
+	CBTL2CAPChannel *pChannel = LookupChannel(nCID);
+	if (pChannel) {
+		bFound = TRUE;
+		bQueue = pChannel->RxQueue != 0;
+		nMTU = pChannel->MTU;
+		if (!nTimeout) nTimeout = pChannel->RTX;
 	}
-	if (found) {
-		Clear();
-		// Set up the read request
-		m_eDataRead.CID = nCID;
-		m_eDataRead.Length = nLength;
-		m_eDataRead.InBuffer = pBuffer;
-		m_eDataRead.Result = nResult;
-		m_eDataRead.N = 0;
-		Wait(pChannel->RTX);
-		// Reset the read request
-		m_eDataRead.CID = 0;
-		m_eDataRead.Length = 0;
-		m_eDataRead.InBuffer = 0;
-		nResult = m_eDataRead.Result;
+	spin_unlock((void *) &m_nChannelLock);
+	if (bFound) {
+		// a ring must exist for the SDUs to wait in, TryRead rejects
+		// if the channel went meanwhile
+		if (!bQueue)
+			AttachReceiveQueue(nCID, new CBTQueue(BT_L2CAP_RX_QUEUE_SIZE, nMTU));
+
+		while ((nResult = TryRead(nCID, nLength, pBuffer, pN))
+				== BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED) {
+			unsigned nElapsed = getClockTicks() - nStartTicks;
+			if (nElapsed >= nTimeout) break;
+			// an SDU wakes us, the slice only covers one arriving
+			// between the check and blocking
+			nElapsed = nTimeout - nElapsed;
+			WaitChannel(nCID, FALSE,
+				nElapsed < BT_L2CAP_WAIT_SLICE ? nElapsed : BT_L2CAP_WAIT_SLICE);
+		}
+#ifdef BT_HAVE_LATENCY
+		if (nResult == BT_L2CAP_RESULT_SUCCESS)
+			CBTLatency::RecordSince (BTLatencyL2CAPRead, nStartTicks, pN ? *pN : 0);
+#endif
 	}
 	return nResult;
 }
 
+unsigned CBTL2CAPLayer::PollChannels (
+	TBTL2CAPPollEntry *pEntries,
+	unsigned nEntries,
+	unsigned nTimeout)
+{
+	assert(pEntries != 0);
+	unsigned nStartTicks = getClockTicks();
+	while (1) {
+		unsigned nReady = 0;
+		spin_lock((void *) &m_nChannelLock);
+		for (unsigned i = 0; i < nEntries; i++) {
+			TBTL2CAPPollEntry *pEntry = &pEntries[i];
+			CBTL2CAPChannel *pChannel = LookupChannel(pEntry->nCID);
+			pEntry->nReady = 0;
+			if (!pChannel || pChannel->State != BT_L2CAP_OPEN)
+				pEntry->nReady |= BT_L2CAP_POLL_CLOSED;
+			if (pChannel && pChannel->RxQueue && !pChannel->RxQueue->IsEmpty())
+				pEntry->nReady |= BT_L2CAP_POLL_READ;
+			if (   pChannel && pChannel->State == BT_L2CAP_OPEN
+			    && pChannel->TxQueue->GetFreeCount() > 0)
+				pEntry->nReady |= BT_L2CAP_POLL_WRITE;
+			pEntry->nReady &= pEntry->nEvents | BT_L2CAP_POLL_CLOSED;
+			if (pEntry->nReady) nReady++;
+		}
+		spin_unlock((void *) &m_nChannelLock);
+
+		unsigned nElapsed = getClockTicks() - nStartTicks;
+		if (nReady || nElapsed >= nTimeout) return nReady;
+		nElapsed = nTimeout - nElapsed;
+		WaitChannel(0, FALSE,
+			nElapsed < BT_L2CAP_WAIT_SLICE ? nElapsed : BT_L2CAP_WAIT_SLICE);
+	}
+}
+
+unsigned CBTL2CAPLayer::GetReceiveDrops (u16 nCID)
+{
+	unsigned nDrops = 0;
+	spin_lock((void *) &m_nChannelLock);
+	CBTL2CAPChannel *pChannel = LookupChannel(nCID);
+	if (pChannel && pChannel->RxQueue)
+		nDrops = pChannel->RxQueue->GetOverflows() + pChannel->RxQueue->GetDrops();
+	spin_unlock((void *) &m_nChannelLock);
+
+	return nDrops;
+}
+
+boolean CBTL2CAPLayer::AttachReceiveQueue (u16 nCID, CBTQueue *pQueue)
+{
+	if (!pQueue) return FALSE;
+
+	// the reader and the stack task may get here together, the first
+	// ring published wins
+	spin_lock((void *) &m_nChannelLock);
+	CBTL2CAPChannel *pChannel = LookupChannel(nCID);
+	if (pChannel && !pChannel->RxQueue) {
+		pChannel->RxQueue = pQueue;
+		pQueue = 0;
+	}
+	spin_unlock((void *) &m_nChannelLock);
+	delete pQueue;
+
+	return pQueue == 0;
+}
+
+void CBTL2CAPLayer::ReceiveSDU (u16 nCID, const u8 *pSDU, unsigned nLength)
+{
+	CBTL2CAPChannel *pChannel = GetChannel(nCID);
+	if (!pChannel || nLength == 0) return;
+
+	// only the stack task removes the channel, it stays valid here
+	if (!pChannel->RxQueue)
+		AttachReceiveQueue(nCID, new CBTQueue(BT_L2CAP_RX_QUEUE_SIZE, pChannel->MTU));
+	CBTQueue *pQueue = pChannel->RxQueue;
+	if (!pQueue || !pQueue->Enqueue(pSDU, nLength)) {
+		LOG_DEBUG("L2CAP: SDU dropped on CID %u\r\n", (unsigned) nCID);
+		return;
+	}
+	CBTPacketPool::CountCopy (BTCopyLayerL2CAP, nLength);
+
+	WakeChannel(nCID, FALSE);
+}
+
+void CBTL2CAPLayer::DeliverSDU (u16 nCID, CBTPacket *pPacket)
+{
+	u16 nPSM = GetPSM(nCID);
+	if (nPSM < BT_L2CAP_MAX_PSM_SLOT && m_pPSMSlot[nPSM] != NULL) {
+		m_pPSMSlot[nPSM](nCID, pPacket);
+	} else {
+		ReceiveSDU(nCID, pPacket->GetData(), pPacket->GetLength());
+	}
+}
+
+boolean CBTL2CAPLayer::IsReceiveBusy (CBTL2CAPChannel *pChannel)
+{
+	// only the ring can fill up, a data callback takes every SDU
+	u16 nPSM = pChannel->PSM;
+	if (nPSM < BT_L2CAP_MAX_PSM_SLOT && m_pPSMSlot[nPSM] != NULL) return FALSE;
+
+	return pChannel->RxQueue && pChannel->RxQueue->GetFreeCount() == 0;
+}
+
+void CBTL2CAPLayer::FailedChannelStub (
+	unsigned hRequest,
+	const TBTL2CAPResult *pResult,
+	void *pParam)
+{
+	LOG_DEBUG("L2CAP: CID %u closed after retransmissions, result %u\r\n",
+		(unsigned) pResult->nCID, (unsigned) pResult->nResult);
+}
+
 u16 CBTL2CAPLayer::GroupCreate (u16 nPSM)
 {
 	u16 nCID = BT_L2CAP_RESULT_SUCCESS;
@@ -704,114 +1255,577 @@ u16 CBTL2CAPLayer::EnableConnectionlessTraffic (u16 nPSM)
 
 u16 CBTL2CAPLayer::GetPSM (u16 nCID)
 {
-	u16 nPSM = 0;
+	CBTL2CAPChannel* pChannel = GetChannel(nCID);
 
-	// Search for an existing channel
-	for (int i=0; i<m_Channels.GetCount(); i++) {
-		CBTL2CAPChannel* pChannel = (CBTL2CAPChannel *)m_Channels[i];
-		if (pChannel->CID == nCID) {
-			nPSM = pChannel->PSM;
-			break;
-		}
-	}
-	return nPSM;
+	return pChannel ? pChannel->PSM : 0;
 }
 
-CBTL2CAPChannel* CBTL2CAPLayer::GetChannel (u16 nCID, bool bRemote/* false */)
+CBTL2CAPChannel* CBTL2CAPLayer::GetChannel (u16 nCID)
 {
-	bool found = false;
-	CBTL2CAPChannel* pChannel = NULL;
+	// another task may see the index grow meanwhile
+	spin_lock((void *) &m_nChannelLock);
+	CBTL2CAPChannel *pChannel = LookupChannel(nCID);
+	spin_unlock((void *) &m_nChannelLock);
+
+	return pChannel;
+}
+
+CBTL2CAPChannel* CBTL2CAPLayer::LookupChannel (u16 nCID)
+{
+	return (CBTL2CAPChannel *)m_ChannelsByCID.Lookup(nCID);
+}
+
+CBTL2CAPChannel* CBTL2CAPLayer::GetRemoteChannel (TBDAddr sBDAddr, u16 nRemoteCID)
+{
+	CBTConnection* pConnection = m_pLogicalLayer->GetConnection(sBDAddr);
+	if (!pConnection) return NULL;
+
+	spin_lock((void *) &m_nChannelLock);
+	CBTL2CAPChannel *pChannel = (CBTL2CAPChannel *)m_ChannelsByRemoteCID.Lookup(
+		RemoteKey(pConnection, nRemoteCID));
+	spin_unlock((void *) &m_nChannelLock);
 
-	// Search for an existing channel
-	for (int i=0; i<m_Channels.GetCount() && !found; i++) {
-		pChannel = (CBTL2CAPChannel *)m_Channels[i];
-		if (bRemote) {
-			if (pChannel->RemoteCID == nCID) found = true;
-		} else {
-			if (pChannel->CID == nCID) found = true;
-		}
-	}
 	return pChannel;
 }
 
-bool CBTL2CAPLayer::AddChannel (u16 nPSM, u16 nCID)
+CBTL2CAPChannel* CBTL2CAPLayer::AddChannel (u16 nPSM, u16 nCID)
 {
+	// the request came in on the link whose ACL packet is being delivered
+	CBTConnection *pConnection = m_pLogicalLayer->GetRxConnection();
+	if (!pConnection) return NULL;
+
 	CBTL2CAPChannel *pChannel = new CBTL2CAPChannel(
-		nPSM, m_pIncomingConnection, nCID);
+		nPSM, pConnection, nCID);
 	assert(pChannel != 0);
 	if (pChannel) {
 		pChannel->SetInitiator(false);  // this is an acceptor channel
 		pChannel->SetState(BT_L2CAP_W4_L2CA_CONNECT_RSP);
-		m_Channels.Append(pChannel);
+		InitChannelMode(pChannel);
+		InsertChannel(pChannel);
 	}
-	return ((pChannel) ? true : false);
+	return pChannel;
 }
 
 bool CBTL2CAPLayer::DeleteChannel (u16 nCID)
 {
-	bool found = false;
-	CBTL2CAPChannel* pChannel = 0;
+	CBTL2CAPChannel* pChannel = GetChannel(nCID);
+	if (pChannel) {
+		// readers found it under the lock and are done once it is out
+		RemoveChannel(pChannel);
+		delete pChannel;
+	}
+	return pChannel != NULL;
+}
 
-	// Search for an existing channel
-	for (int i=0; i<m_Channels.GetCount() && !found; i++) {
-		pChannel = (CBTL2CAPChannel *)m_Channels[i];
-		if (pChannel->CID == nCID) found = true;
+CBTDevice* CBTL2CAPLayer::GetDevice (u16 nCID)
+{
+	CBTL2CAPChannel* pChannel = GetChannel(nCID);
+	assert(pChannel != 0);
+
+	return (CBTDevice *)pChannel->Connection->GetDevice();
+}
+
+void CBTL2CAPLayer::InsertChannel (CBTL2CAPChannel* pChannel)
+{
+	m_Channels.Append(pChannel);
+	IndexChannel(pChannel);
+}
+
+void CBTL2CAPLayer::IndexChannel (CBTL2CAPChannel* pChannel)
+{
+	assert(pChannel != 0);
+	// an acceptor channel gets its CID with the connect response and
+	// an initiator channel its remote CID from it
+	spin_lock((void *) &m_nChannelLock);
+	if (pChannel->CID)
+		m_ChannelsByCID.Insert(pChannel->CID, pChannel);
+	if (pChannel->RemoteCID && pChannel->Connection)
+		m_ChannelsByRemoteCID.Insert(
+			RemoteKey(pChannel->Connection, pChannel->RemoteCID), pChannel);
+	spin_unlock((void *) &m_nChannelLock);
+}
+
+void CBTL2CAPLayer::RemoveChannel (CBTL2CAPChannel* pChannel)
+{
+	assert(pChannel != 0);
+	spin_lock((void *) &m_nChannelLock);
+	m_ChannelsByCID.Remove(pChannel->CID, pChannel);
+	if (pChannel->Connection)
+		m_ChannelsByRemoteCID.Remove(
+			RemoteKey(pChannel->Connection, pChannel->RemoteCID), pChannel);
+	spin_unlock((void *) &m_nChannelLock);
+	m_Channels.RemoveItem(pChannel);
+	// pending requests only complete without it
+	for (unsigned i = 0; i < BT_L2CAP_MAX_PENDING; i++)
+		if (m_Requests[i].pChannel == pChannel)
+			m_Requests[i].pChannel = 0;
+	// blocked readers and writers find it gone
+	if (pChannel->CID) {
+		WakeChannel(pChannel->CID, FALSE);
+		WakeChannel(pChannel->CID, TRUE);
 	}
-	if (found) {
-		m_Channels.Delete(pChannel);
+}
+
+void CBTL2CAPLayer::CloseChannel (CBTL2CAPChannel* pChannel)
+{
+	pChannel->State = BT_L2CAP_CLOSED;
+	RemoveChannel(pChannel);
+
+	// the woken tasks may still hold it, Process frees it once they left
+	spin_lock((void *) &m_nChannelLock);
+	boolean bQueued = m_Closed.Append(pChannel);
+	spin_unlock((void *) &m_nChannelLock);
+	if (!bQueued)
+		LOG_DEBUG("L2CAP: CID %u not freed\r\n", (unsigned) pChannel->CID);
+}
+
+void CBTL2CAPLayer::FreeClosedChannels (void)
+{
+	for (;;) {
+		CBTL2CAPChannel *pChannel = 0;
+		spin_lock((void *) &m_nChannelLock);
+		spin_lock(m_SpinLock);
+		for (unsigned i = 0; i < m_Closed.GetCount() && !pChannel; i++) {
+			pChannel = m_Closed[i];
+			for (unsigned j = 0; j < BT_L2CAP_MAX_WAITERS; j++) {
+				if (   m_Waiters[j].bUsed && pChannel->CID
+				    && m_Waiters[j].nCID == pChannel->CID) {
+					pChannel = 0;
+					break;
+				}
+			}
+		}
+		spin_unlock(m_SpinLock);
+		if (pChannel) m_Closed.RemoveItem(pChannel);
+		spin_unlock((void *) &m_nChannelLock);
+
+		if (!pChannel) return;
 		delete pChannel;
 	}
-	return found;
 }
 
-CBTDevice* CBTL2CAPLayer::GetDevice (u16 nCID)
+u64 CBTL2CAPLayer::RemoteKey (CBTConnection* pConnection, u16 nRemoteCID)
 {
-	return (CBTDevice *)this->GetChannel(nCID)->Connection->GetDevice();
+	// remote CIDs are only unique per ACL link
+	return (u64) pConnection->GetConnectionHandle() << 16 | nRemoteCID;
 }
 
-void CBTL2CAPLayer::SetCommandRsp (u8 ID, u16 Reason)
+bool CBTL2CAPLayer::SetCommandRsp (u8 ID, u16 Reason)
 {
-	m_eCommandRsp.Identifier = ID;
-	m_eCommandRsp.Reason = Reason;
+	TBTL2CAPRequest *pRequest = ClaimRequest(ID);
+	if (!pRequest) return false;
+
+	pRequest->Result.nStatus = Reason;
+	FailRequest(pRequest, BT_L2CAP_RESULT_REJECTED);
+	return true;
 }
 
 bool CBTL2CAPLayer::SetConnectRsp (
 	u8 ID, u16 nDCID,u16 nSCID,u16 nResult,u16 nStatus)
 {
-	if (m_eConnectRsp.Identifier == ID) {
-		*m_eConnectRsp.DCID = nDCID;
-		*m_eConnectRsp.SCID = nSCID;
-		*m_eConnectRsp.Result = nResult;
-		*m_eConnectRsp.Status = nStatus;
-		*m_eConnectRsp.State = (nResult==BT_L2CAP_RESULT_CONNECTION_SUCCESSFUL)
+	if (nResult == BT_L2CAP_RESULT_CONNECTION_PENDING) {
+		// the final response follows within ERTX
+		for (unsigned i = 0; i < BT_L2CAP_MAX_PENDING; i++) {
+			TBTL2CAPRequest *pRequest = &m_Requests[i];
+			if (pRequest->nIdentifier == ID
+			    && pRequest->nCode == BT_SIG_CONNECTION_RESPONSE) {
+				pRequest->nStartTicks = getClockTicks();
+				if (pRequest->pChannel)
+					pRequest->nTimeout = pRequest->pChannel->ERTX;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	TBTL2CAPRequest *pRequest = ClaimRequest(ID, BT_SIG_CONNECTION_RESPONSE);
+	if (!pRequest) return false;
+
+	CBTL2CAPChannel *pChannel = pRequest->pChannel;
+	if (pChannel) {
+		pChannel->RemoteCID = nDCID;
+		pChannel->State = (nResult==BT_L2CAP_RESULT_CONNECTION_SUCCESSFUL)
 			? BT_L2CAP_CONFIG : BT_L2CAP_CLOSED;
-		Set();
-		return true;
+		IndexChannel(pChannel);		// the response told the remote CID
 	}
-	return false;
+	pRequest->Result.nResult = nResult;
+	pRequest->Result.nStatus = nStatus;
+	pRequest->Result.nCID = nSCID;
+	CompleteRequest(pRequest);
+	return true;
 }
 
 bool CBTL2CAPLayer::SetConfigRsp (
-	u8 ID, u16 nCID, u16 nFlags, u16 nResult, u16 nMTU, u16 nFlushTO, u8 *pFlow)
+	u8 ID, u16 nCID, u16 nFlags, u16 nResult, u16 nMTU, u16 nFlushTO, u8 *pFlow,
+	TBTL2CAPRFC *pRFC)
+{
+	TBTL2CAPRequest *pRequest = ClaimRequest(ID, BT_SIG_CONFIGURE_RESPONSE);
+	if (!pRequest) return false;
+
+	CBTL2CAPChannel *pChannel = pRequest->pChannel;
+	if (pChannel && pRFC && nResult == BT_L2CAP_RESULT_SUCCESS) {
+		// the timeouts we have to use come with the response
+		if (pRFC->RetransmissionTimeout)
+			pChannel->RemoteRFC.RetransmissionTimeout = pRFC->RetransmissionTimeout;
+		if (pRFC->MonitorTimeout)
+			pChannel->RemoteRFC.MonitorTimeout = pRFC->MonitorTimeout;
+		if (pChannel->ERTM)
+			pChannel->ERTM->SetTimeouts(pRFC->RetransmissionTimeout,
+				pRFC->MonitorTimeout);
+	}
+	if (pChannel && !pChannel->Initiator && nResult == BT_L2CAP_RESULT_SUCCESS)
+		OpenChannel(pChannel); //initiator stays in CONFIG
+	pRequest->Result.nResult = nResult;
+	pRequest->Result.nMTU = nMTU;
+	pRequest->Result.nFlushTO = nFlushTO;
+	if (pFlow) {		// points into the received packet
+		pRequest->Result.bFlow = TRUE;
+		memcpy(&pRequest->Result.Flow, pFlow, sizeof(TBTL2CAPFlowSpec));
+	}
+	CompleteRequest(pRequest);
+	return true;
+}
+
+bool CBTL2CAPLayer::SetDisconnectRsp (u8 ID, u16 DCID, u16 SCID)
+{
+	TBTL2CAPRequest *pRequest = ClaimRequest(ID, BT_SIG_DISCONNECTION_RESPONSE);
+	if (!pRequest) return false;
+
+	CBTL2CAPChannel *pChannel = pRequest->pChannel;
+	if (pChannel) CloseChannel(pChannel);
+	pRequest->Result.nResult = BT_L2CAP_RESULT_DISCONNECTION_SUCCESSFUL;
+	CompleteRequest(pRequest);
+	return true;
+}
+
+boolean CBTL2CAPLayer::Poll (unsigned hRequest, TBTL2CAPResult *pResult)
 {
-	if (m_eConfigRsp.Identifier == ID) {
-		m_eConfigRsp.SourceCID = nCID;
-		m_eConfigRsp.Flags = nFlags;
-		m_eConfigRsp.Result = nResult;
-		m_eConfigRsp.MTU = nMTU;
-		m_eConfigRsp.Flow = (TBTL2CAPFlowSpec *)pFlow;
-		m_eConfigRsp.FlushTO = nFlushTO;
-		Set();
-		return true;
+	TBTL2CAPRequest *pRequest = FindRequest(hRequest);
+	assert(pRequest != 0);
+	assert(pRequest->pCallback == 0);
+	if (!pRequest || !pRequest->bDone) return FALSE;
+
+	if (pResult) *pResult = pRequest->Result;
+	FreeRequest(pRequest);
+	return TRUE;
+}
+
+u16 CBTL2CAPLayer::WaitRequest (unsigned hRequest, TBTL2CAPResult *pResult)
+{
+	TBTL2CAPRequest *pRequest = FindRequest(hRequest);
+	assert(pRequest != 0);
+	assert(pRequest->pCallback == 0);
+
+	// Process expires the request, the slice only covers a completion
+	// between the check and blocking
+	while (!pRequest->bDone)
+		sleepBlockedTask(&pRequest->pWaitTask, BT_L2CAP_WAIT_SLICE);
+
+	u16 nResult = pRequest->Result.nResult;
+	if (pResult) *pResult = pRequest->Result;
+	FreeRequest(pRequest);
+	return nResult;
+}
+
+void CBTL2CAPLayer::Process (void)
+{
+	for (unsigned i = 0; i < BT_L2CAP_MAX_PENDING; i++) {
+		TBTL2CAPRequest *pRequest = &m_Requests[i];
+		u8 nID = pRequest->nIdentifier;
+		if (nID == 0) {
+			SetupLink(pRequest);
+			continue;
+		}
+
+		// the start time was written before the identifier, the clock
+		// must be read after it
+		DataMemBarrier();
+		if (getClockTicks() - pRequest->nStartTicks < pRequest->nTimeout)
+			continue;
+
+		pRequest = ClaimRequest(nID, pRequest->nCode);
+		if (!pRequest) continue;	// answered meanwhile
+
+		LOG_DEBUG("L2CAP: request 0x%02X timed out\r\n", (unsigned) nID);
+		FailRequest(pRequest, pRequest->nCode == BT_SIG_CONFIGURE_RESPONSE
+			? BT_L2CAP_RESULT_REJECTED : BT_L2CAP_RESULT_CONNECTION_TIMEOUT);
+	}
+
+	if (m_Closed.GetCount()) FreeClosedChannels();
+
+	// channels sharing a link take turns to fill its queue first
+	unsigned nChannels = m_Channels.GetCount();
+	if (m_nNextDrain >= nChannels) m_nNextDrain = 0;
+	for (unsigned i = 0; i < nChannels; i++) {
+		DrainChannel(m_Channels[(m_nNextDrain + i) % nChannels]);
+	}
+	m_nNextDrain++;
+
+	WakeChannel(0, TRUE);
+}
+
+bool CBTL2CAPLayer::SendSDU (CBTL2CAPChannel *pChannel, const TBTScatter *pSDU)
+{
+	if (pChannel->ERTM) {
+		return !pChannel->ERTM->Send(pSDU);
+	}
+
+	// the header and the SDU are gathered straight into the HCI queue
+	CBTL2CAPPacket Header(pSDU->nLength, pChannel->RemoteCID);
+	TBTScatter PDU[] = {{&Header, sizeof Header}, *pSDU};
+	return m_pLogicalLayer->SendACLData(pChannel->Connection, PDU, 2);
+}
+
+void CBTL2CAPLayer::DrainChannel (CBTL2CAPChannel *pChannel)
+{
+	if (pChannel->TxPurge) PurgeChannel(pChannel);
+	if (pChannel->State != BT_L2CAP_OPEN) return;
+
+	CBTL2CAPERTM *pERTM = pChannel->ERTM;
+	if (pERTM) {
+		// retransmissions are due before new I-frames
+		pERTM->SetLocalBusy(IsReceiveBusy(pChannel));
+		pERTM->Process();
+		if (pERTM->HasFailed()) {
+			LOG_DEBUG("L2CAP: CID %u gives up\r\n", (unsigned) pChannel->CID);
+			DisconnectAsync(pChannel->CID, FailedChannelStub, this);
+			return;
+		}
+	}
+
+	unsigned nWritten = 0;
+	while (pChannel->State == BT_L2CAP_OPEN) {
+		// an SDU is held here while the link queue has no room for it,
+		// IsWriting sees it before it leaves the queue
+		if (pChannel->TxSDU.pData == 0
+		    && !pChannel->TxQueue->Dequeue((void *) &pChannel->TxSDU)) break;
+		TBTScatter SDU = pChannel->TxSDU;
+		if (SendSDU(pChannel, &SDU)) break;
+
+		pChannel->TxSDU.pData = 0;
+		nWritten++;
+	}
+
+	if (pERTM) pERTM->SendPendingAck();
+
+	// one notice per pass covers the whole batch
+	if (nWritten && pChannel->TxCallback) {
+		(*pChannel->TxCallback)(pChannel->CID, nWritten, pChannel->TxParam);
+	}
+}
+
+void CBTL2CAPLayer::PurgeWrite (u16 nCID, const void *pSDU)
+{
+	// only the stack task takes SDUs off the queue, it drops this one on
+	// its next pass and the caller may not free it before
+	boolean bAsked = FALSE;
+	for (;;) {
+		CBTL2CAPChannel *pChannel = GetChannel(nCID);
+		if (!pChannel) return;		// the queue went with it
+		if (bAsked) {
+			if (!pChannel->TxPurge) return;
+		} else {
+			// one purge at a time per channel
+			spin_lock(m_SpinLock);
+			if (!pChannel->TxPurge) {
+				pChannel->TxPurge = pSDU;
+				bAsked = TRUE;
+			}
+			spin_unlock(m_SpinLock);
+		}
+		WaitChannel(nCID, TRUE, BT_L2CAP_WAIT_SLICE);
+	}
+}
+
+void CBTL2CAPLayer::PurgeChannel (CBTL2CAPChannel *pChannel)
+{
+	if (pChannel->TxSDU.pData == pChannel->TxPurge) {
+		pChannel->TxSDU.pData = 0;
+	}
+	// the other SDUs are queued again in turn
+	for (unsigned n = pChannel->TxQueue->GetCount(); n > 0; n--) {
+		TBTScatter SDU;
+		if (!pChannel->TxQueue->Dequeue((void *) &SDU)) break;
+		if (SDU.pData != pChannel->TxPurge) {
+			pChannel->TxQueue->Enqueue((const void *) &SDU, sizeof SDU);
+		}
+	}
+	DataMemBarrier();
+	pChannel->TxPurge = 0;
+}
+
+boolean CBTL2CAPLayer::FitsLink (CBTLogicalLayer *pLogicalLayer, u16 nLength)
+{
+	// all fragments of an SDU are queued at once or not at all
+	return   (unsigned) nLength + sizeof(CBTL2CAPPacket)
+	       <= pLogicalLayer->GetHCIACLDataLength() * BT_HCI_TX_LINK_QUEUE_SIZE
+	       ? TRUE : FALSE;
+}
+
+CBTL2CAPLayer::TBTL2CAPRequest *CBTL2CAPLayer::NewRequest (
+	TBTL2CAPCompletion *pCallback, void *pParam)
+{
+	TBTL2CAPRequest *pRequest = 0;
+
+	spin_lock(m_SpinLock);
+	for (unsigned i = 0; i < BT_L2CAP_MAX_PENDING; i++) {
+		if (m_Requests[i].hRequest == BT_L2CAP_NO_REQUEST) {
+			pRequest = &m_Requests[i];
+			if (++m_nNextRequest == BT_L2CAP_NO_REQUEST) m_nNextRequest++;
+			pRequest->hRequest = m_nNextRequest;
+			break;
+		}
 	}
-	return false;
+	spin_unlock(m_SpinLock);
+
+	if (pRequest) {
+		pRequest->nCode = 0;
+		pRequest->nIdentifier = 0;
+		pRequest->bDone = FALSE;
+		pRequest->pChannel = 0;
+		pRequest->pCallback = pCallback;
+		pRequest->pParam = pParam;
+		pRequest->pWaitTask = 0;
+		memset(&pRequest->Result, 0, sizeof pRequest->Result);
+	} else
+		LOG_DEBUG("L2CAP: no free request slot\r\n");
+
+	return pRequest;
 }
 
-void CBTL2CAPLayer::SetDisconnectRsp (u8 ID, u16 DCID, u16 SCID)
+CBTL2CAPLayer::TBTL2CAPRequest *CBTL2CAPLayer::FindRequest (unsigned hRequest)
 {
-	m_eDisconnectRsp.Identifier = ID;
-	m_eDisconnectRsp.DCID = DCID;
-	m_eDisconnectRsp.SCID = SCID;
+	for (unsigned i = 0; i < BT_L2CAP_MAX_PENDING; i++) {
+		if (   hRequest != BT_L2CAP_NO_REQUEST
+		    && m_Requests[i].hRequest == hRequest)
+			return &m_Requests[i];
+	}
+	return 0;
+}
+
+void CBTL2CAPLayer::StartRequest (
+	TBTL2CAPRequest *pRequest, u8 nCode, u8 nID,
+	CBTL2CAPChannel *pChannel, unsigned nTimeout)
+{
+	pRequest->nCode = nCode;
+	pRequest->pChannel = pChannel;
+	pRequest->nStartTicks = getClockTicks();
+	pRequest->nTimeout = nTimeout;
+	DataMemBarrier();
+	pRequest->nIdentifier = nID;	// visible to the responses from now on
+}
+
+CBTL2CAPLayer::TBTL2CAPRequest *CBTL2CAPLayer::ClaimRequest (u8 nID, u8 nCode)
+{
+	TBTL2CAPRequest *pRequest = 0;
+
+	// a response and the timeout may race, only one gets the request
+	spin_lock(m_SpinLock);
+	for (unsigned i = 0; i < BT_L2CAP_MAX_PENDING; i++) {
+		if (   m_Requests[i].nIdentifier == nID
+		    && (nCode == 0 || m_Requests[i].nCode == nCode)) {
+			pRequest = &m_Requests[i];
+			pRequest->nIdentifier = 0;
+			break;
+		}
+	}
+	spin_unlock(m_SpinLock);
+
+	return pRequest;
+}
+
+void CBTL2CAPLayer::FailRequest (TBTL2CAPRequest *pRequest, u16 nResult)
+{
+	CBTL2CAPChannel *pChannel = pRequest->pChannel;
+	if (pChannel) {
+		switch (pRequest->nCode) {
+		case BT_SIG_CONNECTION_RESPONSE:
+			pChannel->State = BT_L2CAP_CLOSED;
+			break;
+		case BT_SIG_DISCONNECTION_RESPONSE:
+			// the channel is gone on our side anyway
+			CloseChannel(pChannel);
+			if (nResult == BT_L2CAP_RESULT_CONNECTION_TIMEOUT)
+				nResult = BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED;
+			break;
+		}
+	}
+	pRequest->Result.nResult = nResult;
+	CompleteRequest(pRequest);
+}
+
+void CBTL2CAPLayer::CompleteRequest (TBTL2CAPRequest *pRequest)
+{
+	assert(pRequest->nIdentifier == 0);
+
+	if (pRequest->pCallback) {
+		(*pRequest->pCallback)(pRequest->hRequest, &pRequest->Result,
+			pRequest->pParam);
+		FreeRequest(pRequest);
+		return;
+	}
+
+	pRequest->bDone = TRUE;
+	DataSyncBarrier();
+	wakeTask(&pRequest->pWaitTask);
+}
+
+void CBTL2CAPLayer::FreeRequest (TBTL2CAPRequest *pRequest)
+{
+	spin_lock(m_SpinLock);
+	pRequest->pChannel = 0;		// free slots are skipped by SetupLink
+	pRequest->hRequest = BT_L2CAP_NO_REQUEST;
+	spin_unlock(m_SpinLock);
+}
+
+void CBTL2CAPLayer::SetupLink (TBTL2CAPRequest *pRequest)
+{
+	CBTL2CAPChannel *pChannel = pRequest->pChannel;
+	if (   !pChannel
+	    || pRequest->bDone
+	    || pChannel->State != BT_L2CAP_W4_LP_CONNECT_CFM)
+		return;
+
+	// the HCI events have moved the link on, each waits on its own
+	CBTConnection *pConnection = pChannel->Connection;
+	switch (pConnection->GetState()) {
+	case BTConnectionStateConnecting:
+	case BTConnectionStateAuthenticating:
+		return;
+
+	case BTConnectionStateConnected:
+		m_pLogicalLayer->AuthenticateAsync(
+			pConnection, (char *)BT_DEFAULT_PIN);
+		return;
+
+	case BTConnectionStateAuthenticated:
+		SendConnectRequest(pRequest, pChannel);
+		return;
+
+	default:
+		LOG_DEBUG("L2CAP: link to PSM %d failed\r\n", (int)pChannel->PSM);
+		pChannel->State = BT_L2CAP_CLOSED;
+		pRequest->pChannel = 0;
+		if (pConnection->GetDevice())
+			pConnection->GetDevice()->SetState(BT_DEVICE_IDLE);
+		CompleteRequest(pRequest);
+		return;
+	}
+}
+
+void CBTL2CAPLayer::SendConnectRequest (
+	TBTL2CAPRequest *pRequest, CBTL2CAPChannel *pChannel)
+{
+	LOG_DEBUG("L2CAP: Channel PSM = %d\r\n", (int)pChannel->PSM);
+	pChannel->State = BT_L2CAP_W4_L2CAP_CONNECT_RSP;
+	u8 ID = GetID();
+	CBTL2CAPConnectionRequest cmd(ID, pChannel->PSM, pChannel->CID);
+	CBTL2CAPSignallingPacket pkt((u8*)&cmd, (sizeof cmd));
+	pRequest->Result.nCID = pChannel->CID;
+	StartRequest(pRequest, BT_SIG_CONNECTION_RESPONSE, ID,
+		pChannel, pChannel->RTX);
+	m_pLogicalLayer->SendACLData(
+		pChannel->Connection, (void *)&pkt, (sizeof cmd)+4);
 }
 
 void CBTL2CAPLayer::SignallingCallback (u16 nPSM, void *cmd, size_t size)
@@ -852,7 +1866,6 @@ void CBTL2CAPLayer::LPEventHandler (const void *pBuffer, unsigned nLength)
 				= m_pLogicalLayer->GetConnection(
 					((CBTLPConnectInd *)pEvent)->BDAddr);
 			if (pConnection) {
-				m_pIncomingConnection = pConnection;
 				m_pSubSystem->CreateDevice(pConnection); 
 				pConnection->GetDevice()->SetState(BT_DEVICE_CONNECTING);
 				bool status = m_pLogicalLayer->ConnectResponse(
@@ -870,23 +1883,21 @@ void CBTL2CAPLayer::LPEventHandler (const void *pBuffer, unsigned nLength)
 	}
 }
 
-void CBTL2CAPLayer::L2CAPEventHandler (const void *pBuffer, unsigned nLength)
+void CBTL2CAPLayer::L2CAPEventHandler (CBTPacket *pBuffer)
 {
 	int index = 0;
 	CBTL2CAPSignallingCommand *pCommand;
 
 	assert (pBuffer != 0);
-	assert (nLength > 0);
+	unsigned nLength = pBuffer->GetLength ();
 
 	if (nLength < sizeof (CBTL2CAPPacket)) {
 		LOG_DEBUG ("L2CAPEventHandler: Short packet ignored\r\n");
 		return;
 	}
 
-	assert (m_pEventBuffer != 0);
-	memcpy (m_pEventBuffer, pBuffer, nLength);
-
-	CBTL2CAPPacket *pHeader = (CBTL2CAPPacket *) m_pEventBuffer;
+	// the packet is parsed in place, it is released by the caller
+	CBTL2CAPPacket *pHeader = (CBTL2CAPPacket *) pBuffer->GetData ();
 	switch (pHeader->GetCID()) {
 	case BT_CID_SIGNALLING_CHANNEL : {
 		CBTL2CAPSignallingPacket *pPacket = (CBTL2CAPSignallingPacket *)pHeader;
@@ -901,26 +1912,27 @@ void CBTL2CAPLayer::L2CAPEventHandler (const void *pBuffer, unsigned nLength)
 
 	default: {
 		CBTL2CAPPacket *pPacket = (CBTL2CAPPacket *)pHeader;
-		u16 nPSM = GetPSM(pPacket->ChannelID);
-		if (m_pPSMSlot[nPSM] != NULL)
-			m_pPSMSlot[nPSM](pPacket->ChannelID,pPacket->Data,pPacket->Length);
-		else {
-			// Check if there's a blocked read on this CID
-			if (pPacket->ChannelID == m_eDataRead.CID) {
-				u16 rLength = m_eDataRead.Length - m_eDataRead.N;
-				if (pPacket->Length < rLength) {
-					memcpy( m_eDataRead.InBuffer+m_eDataRead.N, 
-						pPacket->Data, pPacket->Length);
-					m_eDataRead.N += pPacket->Length;
-				} else {
-					memcpy( m_eDataRead.InBuffer+m_eDataRead.N, 
-						pPacket->Data, rLength);
-					m_eDataRead.N += rLength;
-					m_eDataRead.Result = BT_L2CAP_RESULT_SUCCESS;
-					Set();	// signal when done
-				}
+		u16 nCID = pPacket->ChannelID;
+		u16 nPayload = pPacket->Length;
+		if (nPayload > nLength - sizeof (CBTL2CAPPacket)) {
+			LOG_DEBUG ("L2CAPEventHandler: Truncated PDU ignored\r\n");
+			break;
+		}
+		CBTL2CAPChannel *pChannel = GetChannel(nCID);
+		if (pChannel && pChannel->ERTM) {
+			// the engine strips control and FCS from what it delivers,
+			// a reassembled SDU comes in a packet of its own
+			pChannel->ERTM->SetLocalBusy(IsReceiveBusy(pChannel));
+			CBTPacket *pSDU = pChannel->ERTM->Receive(pBuffer);
+			if (pSDU) {
+				DeliverSDU(nCID, pSDU);
+				if (pSDU != pBuffer) pSDU->Release();
 			}
+			break;
 		}
+		pBuffer->Pull (sizeof (CBTL2CAPPacket));
+		pBuffer->Trim (nPayload);
+		DeliverSDU(nCID, pBuffer);
 		} break;
 	}
 }
@@ -931,8 +1943,9 @@ void CBTL2CAPLayer::LPEventStub (const void *pBuffer, unsigned nLength)
 	s_pThis->LPEventHandler (pBuffer, nLength);
 }
 
-void CBTL2CAPLayer::L2CAPEventStub (const void *pBuffer, unsigned nLength)
+void CBTL2CAPLayer::L2CAPEventStub (CBTPacket *pPacket)
 {
 	assert (s_pThis != 0);
-	s_pThis->L2CAPEventHandler (pBuffer, nLength);
+	s_pThis->L2CAPEventHandler (pPacket);
+	pPacket->Release ();
 }
@@ -76,6 +76,12 @@ u16 ExtractMTU(u8* cOption, u16 nLength)
 					cOption += sizeof(CBTL2CAPQoS);
 					nLength -= sizeof(CBTL2CAPQoS);
 				} break;
+			default	: {
+					// not looked for here, skipped by its length
+					u16 nSize = sizeof(CBTL2CAPOption) + pOption->Length;
+					nLength = nSize < nLength ? nLength - nSize : 0;
+					cOption += nSize;
+				} break;
 		}
 	}
 	return nMTU;
@@ -101,6 +107,12 @@ TBTL2CAPFlowSpec* ExtractFlow(u8* cOption, u16 nLength)
 					nFlow = &pQoS->Flow;
 					nLength = 0;
 				} break;
+			default	: {
+					// not looked for here, skipped by its length
+					u16 nSize = sizeof(CBTL2CAPOption) + pOption->Length;
+					nLength = nSize < nLength ? nLength - nSize : 0;
+					cOption += nSize;
+				} break;
 		}
 	}
 	return nFlow;
@@ -127,11 +139,65 @@ u16 ExtractFlushTO(u8* cOption, u16 nLength)
 					cOption += sizeof(CBTL2CAPQoS);
 					nLength -= sizeof(CBTL2CAPQoS);
 				} break;
+			default	: {
+					// not looked for here, skipped by its length
+					u16 nSize = sizeof(CBTL2CAPOption) + pOption->Length;
+					nLength = nSize < nLength ? nLength - nSize : 0;
+					cOption += nSize;
+				} break;
 		}
 	}
 	return nFlushTimeout;
 }
 
+TBTL2CAPRFC* ExtractRFC(u8* cOption, u16 nLength)
+{
+	TBTL2CAPRFC* pRFC = NULL;
+
+	while (nLength) {
+		CBTL2CAPOption *pOption = (CBTL2CAPOption *)cOption;
+		switch(pOption->Type) {
+			case BT_L2CAP_OPTION_RFC	: {
+					CBTL2CAPRetransmission *pRetransmission
+						= (CBTL2CAPRetransmission *)cOption;
+					pRFC = &pRetransmission->RFC;
+					nLength = 0;
+				} break;
+			default	: {
+					// not looked for here, skipped by its length
+					u16 nSize = sizeof(CBTL2CAPOption) + pOption->Length;
+					nLength = nSize < nLength ? nLength - nSize : 0;
+					cOption += nSize;
+				} break;
+		}
+	}
+	return pRFC;
+}
+
+u8 ExtractFCS(u8* cOption, u16 nLength)
+{
+	u8 nFCS = BT_L2CAP_FCS_16;	// unless the option turns it off
+
+	while (nLength) {
+		CBTL2CAPOption *pOption = (CBTL2CAPOption *)cOption;
+		switch(pOption->Type) {
+			case BT_L2CAP_OPTION_FCS	: {
+					CBTL2CAPFrameCheck *pFrameCheck
+						= (CBTL2CAPFrameCheck *)cOption;
+					nFCS = pFrameCheck->FCS;
+					nLength = 0;
+				} break;
+			default	: {
+					// not looked for here, skipped by its length
+					u16 nSize = sizeof(CBTL2CAPOption) + pOption->Length;
+					nLength = nSize < nLength ? nLength - nSize : 0;
+					cOption += nSize;
+				} break;
+		}
+	}
+	return nFCS;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // L2CAP Signalling Commands
@@ -228,7 +294,6 @@ void CBTL2CAPSignallingCommandReject::Process(void *pLayer, u16 nLength)
 	CBTL2CAPLayer *pL2CAPLayer = (CBTL2CAPLayer *) pLayer;
 	LOG_DEBUG("CBTL2CAPSignallingCommandReject\r\n");
 	pL2CAPLayer->SetCommandRsp( Identifier, Reason);
-	pL2CAPLayer->Set();
 
 }
 
@@ -266,7 +331,10 @@ void CBTL2CAPConnectionRequest::Process(void *pLayer, u16 nLength)
 	ind.Event = BT_EVENT_L2CA_CONNECT_IND;
 	ind.CID = SourceCID;
 	ind.PSM = PSM;
-	pL2CAPLayer->AddChannel(PSM, SourceCID);
+	CBTL2CAPChannel *pChannel = pL2CAPLayer->AddChannel(PSM, SourceCID);
+	if (!pChannel) return;
+	memcpy(ind.BDAddr, pChannel->GetConnection()->GetBDAddress(),
+		BT_BD_ADDR_SIZE);
 	pL2CAPLayer->SignallingCallback(PSM, &ind,sizeof ind);
 }
 
@@ -361,6 +429,20 @@ u16 CBTL2CAPConfigurationRequest::GetFlushTO(void)
 	return ExtractFlushTO(Options, nLength);
 }
 
+TBTL2CAPRFC* CBTL2CAPConfigurationRequest::GetRFC(void)
+{
+	u16 nLength = Length - sizeof(DestinationCID) - sizeof(Flags);
+
+	return ExtractRFC(Options, nLength);
+}
+
+u8 CBTL2CAPConfigurationRequest::GetFCS(void)
+{
+	u16 nLength = Length - sizeof(DestinationCID) - sizeof(Flags);
+
+	return ExtractFCS(Options, nLength);
+}
+
 void CBTL2CAPConfigurationRequest::Handler(void *ptr,void *lptr,u16 nLength)
 {
 	((CBTL2CAPConfigurationRequest *)ptr)->Process(lptr, nLength);
@@ -380,6 +462,8 @@ void CBTL2CAPConfigurationRequest::Process(void *pLayer, u16 nLength)
 	ind.OutMTU = GetMTU();
 	ind.InFlow = GetFlow();
 	ind.InFlushTO = GetFlushTO();
+	// the mode is negotiated by the layer, the response carries it
+	pL2CAPLayer->SetRemoteConfig(ind.CID, ind.OutMTU, GetRFC(), GetFCS());
 	pL2CAPLayer->SignallingCallback(ind.PSM, &ind, sizeof ind);
 }
 
@@ -432,6 +516,20 @@ u16 CBTL2CAPConfigurationResponse::GetFlushTO(void)
 	return ExtractFlushTO(Config, nLength);
 }
 
+TBTL2CAPRFC* CBTL2CAPConfigurationResponse::GetRFC(void)
+{
+	u16 nLength = Length - sizeof(SourceCID) - sizeof(Flags) - sizeof(Result);
+
+	return ExtractRFC(Config, nLength);
+}
+
+u8 CBTL2CAPConfigurationResponse::GetFCS(void)
+{
+	u16 nLength = Length - sizeof(SourceCID) - sizeof(Flags) - sizeof(Result);
+
+	return ExtractFCS(Config, nLength);
+}
+
 void CBTL2CAPConfigurationResponse::Handler(void *ptr,void *lptr,u16 nLength)
 {
 	((CBTL2CAPConfigurationResponse *)ptr)->Process(lptr, nLength);
@@ -447,7 +545,7 @@ void CBTL2CAPConfigurationResponse::Process(void *pLayer, u16 nLength)
 	u16 nFlushTO = GetFlushTO();
 	u8* pFlow = (u8 *)GetFlow();
 	if (!pL2CAPLayer->SetConfigRsp(
-	Identifier, SourceCID, Flags,Result, nMTU, nFlushTO, pFlow)) {
+	Identifier, SourceCID, Flags,Result, nMTU, nFlushTO, pFlow, GetRFC())) {
 		CBTL2CAConfigCfm cfm;
 		cfm.Identifier = Identifier;
 		cfm.Event = BT_EVENT_L2CA_CONFIG_CFM;
@@ -532,7 +630,6 @@ void CBTL2CAPDisconnectionResponse::Process(void *pLayer, u16 nLength)
 
 	LOG_DEBUG("CBTL2CAPDisconnectionResponse\r\n");
 	pL2CAPLayer->SetDisconnectRsp(Identifier, DestinationCID, SourceCID);
-	pL2CAPLayer->Set();
 }
 
 CBTL2CAPEchoRequest::CBTL2CAPEchoRequest()
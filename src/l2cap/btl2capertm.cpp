@@ -0,0 +1,639 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth L2CAP Retransmission and Streaming Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btl2capertm.h>
+#include <bluetooth/btcrc.h>
+#include <task.h>
+#include <logger.h>
+#include <assert.h>
+#include <string.h>
+
+// basic header and enhanced control field of I- and S-frames
+struct TBTL2CAPFrameHeader
+{
+	u16	Length;
+	u16	ChannelID;
+	u16	Control;
+}
+PACKED;
+
+CBTL2CAPERTM::CBTL2CAPERTM (
+	CBTLogicalLayer *pLogicalLayer,
+	CBTConnection *pConnection,
+	u16 nRemoteCID,
+	const TBTL2CAPRFC *pTx,
+	const TBTL2CAPRFC *pRx,
+	boolean bFCS,
+	u16 nRxMTU)
+:	m_pLogicalLayer (pLogicalLayer),
+	m_pConnection (pConnection),
+	m_nRemoteCID (nRemoteCID),
+	m_nMode (pTx->Mode),
+	m_bFCS (bFCS),
+	m_nTxWindow (pTx->TxWindow),
+	m_nMaxTransmit (pTx->MaxTransmit),
+	m_nRetransTimeout (BT_L2CAP_ERTM_RETRANS_TIMEOUT * 1000),
+	m_nMonitorTimeout (BT_L2CAP_ERTM_MONITOR_TIMEOUT * 1000),
+	m_nTxMPS (pTx->MPS ? pTx->MPS : BT_L2CAP_DEFAULT_MTU),
+	m_nNextTxSeq (0),
+	m_nExpectedAckSeq (0),
+	m_bRetransmit (FALSE),
+	m_nRetransmitSeq (0),
+	m_SRejPending (0),
+	m_bRemoteBusy (FALSE),
+	m_bWaitFinal (FALSE),
+	m_nPolls (0),
+	m_bRetransTimer (FALSE),
+	m_nRetransStart (0),
+	m_bMonitorTimer (FALSE),
+	m_nMonitorStart (0),
+	m_bFailed (FALSE),
+	m_pTxFrames (0),
+	m_nTxHead (0),
+	m_nTxOffset (0),
+	m_nRxMPS (pRx->MPS ? pRx->MPS : BT_L2CAP_DEFAULT_MTU),
+	m_nRxWindow (pRx->TxWindow),
+	m_nExpectedTxSeq (0),
+	m_bRejPending (FALSE),
+	m_bRejSent (FALSE),
+	m_bLocalBusy (FALSE),
+	m_bRNRSent (FALSE),
+	m_bAckPending (FALSE),
+	m_bFinalPending (FALSE),
+	m_nRxMTU (nRxMTU),
+	m_pRxSDU (0),
+	m_nRxSDULength (0),
+	m_nRetransmissions (0),
+	m_nFCSErrors (0),
+	m_nFramesLost (0)
+{
+	assert (pLogicalLayer != 0);
+	assert (pConnection != 0);
+	assert (   m_nMode == BT_L2CAP_MODE_ERTM
+		|| m_nMode == BT_L2CAP_MODE_STREAMING);
+
+	if (m_nTxWindow == 0 || m_nTxWindow > BT_L2CAP_ERTM_MAX_WINDOW)
+		m_nTxWindow = BT_L2CAP_ERTM_MAX_WINDOW;
+	if (m_nRxWindow == 0 || m_nRxWindow > BT_L2CAP_ERTM_MAX_WINDOW)
+		m_nRxWindow = BT_L2CAP_ERTM_MAX_WINDOW;
+	SetTimeouts (pTx->RetransmissionTimeout, pTx->MonitorTimeout);
+
+	// Streaming mode never sends a frame twice
+	if (m_nMode == BT_L2CAP_MODE_ERTM) {
+		m_pTxFrames = (u8 *) malloc (m_nTxWindow * m_nTxMPS);
+		assert (m_pTxFrames != 0);
+	}
+}
+
+CBTL2CAPERTM::~CBTL2CAPERTM (void)
+{
+	DiscardSDU ();
+
+	free (m_pTxFrames);
+	m_pTxFrames = 0;
+}
+
+void CBTL2CAPERTM::SetTimeouts (u16 nRetransmission, u16 nMonitor)
+{
+	if (nRetransmission)
+		m_nRetransTimeout = nRetransmission * 1000;
+	if (nMonitor)
+		m_nMonitorTimeout = nMonitor * 1000;
+}
+
+void CBTL2CAPERTM::SetLocalBusy (boolean bBusy)
+{
+	if (bBusy == m_bLocalBusy)
+		return;
+
+	// RNR holds the remote, leaving the state asks again for the frames
+	// dropped meanwhile
+	m_bLocalBusy = bBusy;
+	m_bAckPending = TRUE;
+	if (!bBusy)
+		m_bRejPending = TRUE;
+}
+
+boolean CBTL2CAPERTM::Send (const TBTScatter *pSDU)
+{
+	assert (pSDU != 0);
+
+	do {
+		if (!SendSegment (pSDU))
+			return FALSE;
+	} while (m_nTxOffset != 0);
+
+	return TRUE;
+}
+
+CBTPacket *CBTL2CAPERTM::Receive (CBTPacket *pPacket)
+{
+	assert (pPacket != 0);
+	u8 *pData = pPacket->GetData ();
+	TBTL2CAPFrameHeader *pHeader = (TBTL2CAPFrameHeader *) pData;
+
+	// the caller checked the basic header against the packet
+	unsigned nTrailer = m_bFCS ? BT_L2CAP_FCS_LEN : 0;
+	if (   pPacket->GetLength () < sizeof (TBTL2CAPFrameHeader) + nTrailer
+	    || pHeader->Length < BT_L2CAP_CONTROL_LEN + nTrailer) {
+		LOG_DEBUG ("L2CAP: Short frame ignored\r\n");
+		return 0;
+	}
+	unsigned nPayload = pHeader->Length - BT_L2CAP_CONTROL_LEN - nTrailer;
+
+	if (m_bFCS) {
+		unsigned nFrame = sizeof (TBTL2CAPFrameHeader) + nPayload;
+		u16 nFCS = pData[nFrame] | pData[nFrame+1] << 8;
+		if (CBTCRC16::Update (0, pData, nFrame) != nFCS) {
+			m_nFCSErrors++;		// recovered like a lost frame
+			return 0;
+		}
+	}
+
+	u16 nControl = pHeader->Control;
+	u8 nSAR = BT_L2CAP_CONTROL_SAR (nControl);
+	if (!(nControl & BT_L2CAP_CONTROL_SFRAME) && nPayload > m_nRxMPS) {
+		LOG_DEBUG ("L2CAP: I-frame exceeds MPS\r\n");
+		return 0;
+	}
+
+	CBTPacket *pSDU = 0;
+	if (m_nMode == BT_L2CAP_MODE_STREAMING) {
+		if (nControl & BT_L2CAP_CONTROL_SFRAME)
+			return 0;
+
+		// whatever arrives is delivered, gaps are only counted and end
+		// the SDU they fell into
+		u8 nTxSeq = BT_L2CAP_CONTROL_TXSEQ (nControl);
+		u8 nLost = SeqOffset (nTxSeq, m_nExpectedTxSeq);
+		if (nLost) {
+			m_nFramesLost += nLost;
+			DiscardSDU ();
+		}
+		m_nExpectedTxSeq = SeqNext (nTxSeq);
+
+		if (!Reassemble (pPacket, nSAR, nPayload, &pSDU))
+			DiscardSDU ();
+	} else {
+		// a SREJ names the one frame to send again, it acknowledges
+		// those before it only with P or F set
+		u8 nReqSeq = BT_L2CAP_CONTROL_REQSEQ (nControl);
+		boolean bAcknowledges =
+			   !(nControl & BT_L2CAP_CONTROL_SFRAME)
+			|| BT_L2CAP_CONTROL_SUPER (nControl) != BT_L2CAP_SUPER_SREJ
+			|| (nControl & (BT_L2CAP_CONTROL_POLL | BT_L2CAP_CONTROL_FINAL))
+			? TRUE : FALSE;
+		if (bAcknowledges ? !Acknowledge (nReqSeq)
+				  : SeqOffset (nReqSeq, m_nExpectedAckSeq) > GetUnacked ()) {
+			LOG_DEBUG ("L2CAP: Invalid ReqSeq ignored\r\n");
+			return 0;
+		}
+
+		if (nControl & BT_L2CAP_CONTROL_SFRAME) {
+			u8 nSuper = BT_L2CAP_CONTROL_SUPER (nControl);
+			if (nControl & BT_L2CAP_CONTROL_POLL)
+				m_bFinalPending = TRUE;
+			m_bRemoteBusy = nSuper == BT_L2CAP_SUPER_RNR ? TRUE : FALSE;
+			switch (nSuper) {
+			case BT_L2CAP_SUPER_REJ:
+				// go back to the first frame not acknowledged
+				if (GetUnacked () > 0) {
+					m_bRetransmit = TRUE;
+					m_nRetransmitSeq = m_nExpectedAckSeq;
+				}
+				break;
+			case BT_L2CAP_SUPER_SREJ:
+				if (SeqOffset (nReqSeq, m_nExpectedAckSeq) < GetUnacked ())
+					m_SRejPending |= (u64) 1 << nReqSeq;
+				break;
+			}
+			if (nControl & BT_L2CAP_CONTROL_FINAL)
+				Final ();
+			return 0;
+		}
+
+		if (nControl & BT_L2CAP_CONTROL_FINAL)
+			Final ();
+
+		u8 nTxSeq = BT_L2CAP_CONTROL_TXSEQ (nControl);
+		if (nTxSeq != m_nExpectedTxSeq || m_bLocalBusy) {
+			if (   nTxSeq == m_nExpectedTxSeq
+			    || SeqOffset (m_nExpectedTxSeq, nTxSeq) <= m_nRxWindow) {
+				m_bAckPending = TRUE;	// busy or a duplicate
+			} else if (!m_bRejSent) {
+				m_bRejPending = TRUE;	// a gap, ask once
+			}
+			return 0;
+		}
+
+		// without a buffer for the SDU the frame is not taken, the
+		// remote sends it again
+		m_bAckPending = TRUE;
+		if (!Reassemble (pPacket, nSAR, nPayload, &pSDU))
+			return 0;
+		m_nExpectedTxSeq = SeqNext (nTxSeq);
+		m_bRejPending = FALSE;
+		m_bRejSent = FALSE;
+	}
+
+	return pSDU;
+}
+
+boolean CBTL2CAPERTM::Reassemble (CBTPacket *pPacket, u8 nSAR, unsigned nPayload,
+				  CBTPacket **ppSDU)
+{
+	*ppSDU = 0;
+	u8 *pPayload = pPacket->GetData () + sizeof (TBTL2CAPFrameHeader);
+
+	switch (nSAR) {
+	case BT_L2CAP_SAR_UNSEGMENTED:
+		if (m_pRxSDU != 0) {
+			LOG_DEBUG ("L2CAP: SDU not ended\r\n");
+			DiscardSDU ();
+		}
+		pPacket->Pull (sizeof (TBTL2CAPFrameHeader));
+		pPacket->Trim (nPayload);
+		*ppSDU = pPacket;
+		return TRUE;
+
+	case BT_L2CAP_SAR_START: {
+		if (m_pRxSDU != 0) {
+			LOG_DEBUG ("L2CAP: SDU not ended\r\n");
+			DiscardSDU ();
+		}
+		if (nPayload < BT_L2CAP_SDU_LENGTH_LEN)
+			return TRUE;
+		unsigned nSDULength = pPayload[0] | pPayload[1] << 8;
+		pPayload += BT_L2CAP_SDU_LENGTH_LEN;
+		nPayload -= BT_L2CAP_SDU_LENGTH_LEN;
+		if (nSDULength > m_nRxMTU || nSDULength <= nPayload) {
+			LOG_DEBUG ("L2CAP: Invalid SDU length %u\r\n", nSDULength);
+			return TRUE;
+		}
+
+		// pooled memory covers a few SDUs of the MTU at a time
+		m_pRxSDU = CBTPacketPool::Get ()->AllocLarge (nSDULength);
+		if (m_pRxSDU == 0)
+			return FALSE;
+		m_nRxSDULength = nSDULength;
+		} break;
+
+	default:
+		if (m_pRxSDU == 0)
+			return TRUE;		// its start was lost
+		break;
+	}
+
+	// only the end segment may complete the SDU
+	unsigned nLength = m_pRxSDU->GetLength () + nPayload;
+	if (   nLength > m_nRxSDULength
+	    || (nSAR == BT_L2CAP_SAR_END) != (nLength == m_nRxSDULength)) {
+		LOG_DEBUG ("L2CAP: SDU length mismatch\r\n");
+		DiscardSDU ();
+		return TRUE;
+	}
+
+	memcpy (m_pRxSDU->Put (nPayload), pPayload, nPayload);
+	CBTPacketPool::CountCopy (BTCopyLayerL2CAP, nPayload);
+
+	if (nSAR == BT_L2CAP_SAR_END) {
+		*ppSDU = m_pRxSDU;
+		m_pRxSDU = 0;
+	}
+	return TRUE;
+}
+
+void CBTL2CAPERTM::DiscardSDU (void)
+{
+	if (m_pRxSDU != 0) {
+		m_pRxSDU->Release ();
+		m_pRxSDU = 0;
+	}
+}
+
+void CBTL2CAPERTM::Process (void)
+{
+	if (m_nMode != BT_L2CAP_MODE_ERTM || m_bFailed)
+		return;
+
+	unsigned nNow = getClockTicks ();
+	if (m_bWaitFinal) {
+		if (m_bMonitorTimer && nNow - m_nMonitorStart >= m_nMonitorTimeout) {
+			if (m_nMaxTransmit && m_nPolls >= m_nMaxTransmit) {
+				LOG_DEBUG ("L2CAP: Poll not answered\r\n");
+				m_bFailed = TRUE;
+				return;
+			}
+			Poll ();
+		}
+		return;
+	}
+
+	// nothing acknowledged for too long, ask the remote where it is
+	if (m_bRetransTimer && nNow - m_nRetransStart >= m_nRetransTimeout) {
+		Poll ();
+		return;
+	}
+
+	if (m_bRemoteBusy)
+		return;
+
+	if (m_bRetransmit) {
+		while (m_nRetransmitSeq != m_nNextTxSeq) {
+			if (!Retransmit (m_nRetransmitSeq))
+				return;
+			m_nRetransmitSeq = SeqNext (m_nRetransmitSeq);
+		}
+		m_bRetransmit = FALSE;
+	}
+
+	for (u8 nSeq = m_nExpectedAckSeq;
+	     m_SRejPending && nSeq != m_nNextTxSeq;
+	     nSeq = SeqNext (nSeq)) {
+		u64 nBit = (u64) 1 << nSeq;
+		if (!(m_SRejPending & nBit))
+			continue;
+		if (!Retransmit (nSeq))
+			return;
+		m_SRejPending &= ~nBit;
+	}
+}
+
+void CBTL2CAPERTM::SendPendingAck (void)
+{
+	if (m_nMode != BT_L2CAP_MODE_ERTM)
+		return;
+
+	if (m_bRejPending && !m_bLocalBusy) {
+		if (SendSFrame (BT_L2CAP_SUPER_REJ, 0)) {
+			m_bRejPending = FALSE;
+			m_bRejSent = TRUE;
+		}
+		return;
+	}
+
+	if (m_bAckPending || m_bFinalPending)
+		SendSFrame (m_bLocalBusy ? BT_L2CAP_SUPER_RNR : BT_L2CAP_SUPER_RR, 0);
+}
+
+boolean CBTL2CAPERTM::SendFrame (u16 nControl, const TBTScatter *pPayload,
+				 unsigned nPieces)
+{
+	assert (nPieces <= 2);
+	unsigned nPayload = 0;
+	for (unsigned i = 0; i < nPieces; i++)
+		nPayload += pPayload[i].nLength;
+
+	TBTL2CAPFrameHeader Header;
+	Header.Length = BT_L2CAP_CONTROL_LEN + nPayload + (m_bFCS ? BT_L2CAP_FCS_LEN : 0);
+	Header.ChannelID = m_nRemoteCID;
+	Header.Control = nControl;
+
+	TBTScatter Frame[4];
+	unsigned nEntries = 0;
+	Frame[nEntries].pData = &Header;
+	Frame[nEntries++].nLength = sizeof Header;
+	for (unsigned i = 0; i < nPieces; i++)
+		Frame[nEntries++] = pPayload[i];
+
+	u8 FCS[BT_L2CAP_FCS_LEN];
+	if (m_bFCS) {
+		u16 nCRC = CBTCRC16::Update (0, &Header, sizeof Header);
+		for (unsigned i = 0; i < nPieces; i++)
+			nCRC = CBTCRC16::Update (nCRC, pPayload[i].pData, pPayload[i].nLength);
+		FCS[0] = (u8) nCRC;
+		FCS[1] = (u8) (nCRC >> 8);
+		Frame[nEntries].pData = FCS;
+		Frame[nEntries++].nLength = sizeof FCS;
+	}
+
+	// the frame is copied into the link queue or not queued at all
+	return m_pLogicalLayer->SendACLData (m_pConnection, Frame, nEntries) ? FALSE : TRUE;
+}
+
+boolean CBTL2CAPERTM::SendSegment (const TBTScatter *pSDU)
+{
+	// retransmissions go first, new frames only fit in the window
+	if (   m_nMode == BT_L2CAP_MODE_ERTM
+	    && (   m_bFailed || m_bWaitFinal || m_bRemoteBusy
+		|| m_bRetransmit || m_SRejPending
+		|| GetUnacked () >= m_nTxWindow))
+		return FALSE;
+
+	// the start segment gives the SDU length, the others fill the MPS
+	// until the end segment takes the rest
+	unsigned nLength = pSDU->nLength;
+	u8 SDULength[BT_L2CAP_SDU_LENGTH_LEN] = {(u8) nLength, (u8) (nLength >> 8)};
+	TBTScatter Piece[2];
+	unsigned nPieces = 0;
+	unsigned nChunk;
+	u8 nSAR;
+	if (m_nTxOffset == 0 && nLength <= m_nTxMPS) {
+		nSAR = BT_L2CAP_SAR_UNSEGMENTED;
+		nChunk = nLength;
+	} else if (m_nTxOffset == 0) {
+		nSAR = BT_L2CAP_SAR_START;
+		nChunk = m_nTxMPS - BT_L2CAP_SDU_LENGTH_LEN;
+		Piece[nPieces].pData = SDULength;
+		Piece[nPieces++].nLength = sizeof SDULength;
+	} else if (nLength - m_nTxOffset <= m_nTxMPS) {
+		nSAR = BT_L2CAP_SAR_END;
+		nChunk = nLength - m_nTxOffset;
+	} else {
+		nSAR = BT_L2CAP_SAR_CONTINUE;
+		nChunk = m_nTxMPS;
+	}
+	Piece[nPieces].pData = (const u8 *) pSDU->pData + m_nTxOffset;
+	Piece[nPieces++].nLength = nChunk;
+
+	if (m_nMode == BT_L2CAP_MODE_STREAMING) {
+		// straight from the caller's buffer
+		if (!SendIFrame (m_nNextTxSeq, nSAR, Piece, nPieces))
+			return FALSE;
+	} else {
+		// the segment is kept until acknowledged, the SDU is the
+		// caller's again once it is all sent
+		unsigned nSlot = GetSlot (m_nNextTxSeq);
+		u8 *pSlot = m_pTxFrames + nSlot * m_nTxMPS;
+		unsigned nSegment = 0;
+		for (unsigned i = 0; i < nPieces; i++) {
+			memcpy (pSlot + nSegment, Piece[i].pData, Piece[i].nLength);
+			nSegment += Piece[i].nLength;
+		}
+		TBTScatter Payload = {pSlot, nSegment};
+		if (!SendIFrame (m_nNextTxSeq, nSAR, &Payload, 1))
+			return FALSE;
+
+		m_TxLength[nSlot] = nSegment;
+		m_TxSAR[nSlot] = nSAR;
+		m_TxRetries[nSlot] = 1;
+	}
+	m_nNextTxSeq = SeqNext (m_nNextTxSeq);
+
+	m_nTxOffset += nChunk;
+	if (m_nTxOffset >= nLength)
+		m_nTxOffset = 0;
+	return TRUE;
+}
+
+boolean CBTL2CAPERTM::SendIFrame (u8 nTxSeq, u8 nSAR, const TBTScatter *pPayload,
+				  unsigned nPieces)
+{
+	u16 nControl = nTxSeq << 1 | nSAR << BT_L2CAP_CONTROL_SAR_SHIFT;
+	if (m_nMode == BT_L2CAP_MODE_ERTM) {
+		// acknowledgements ride along, unless only RNR may be sent
+		nControl |= m_nExpectedTxSeq << 8;
+		if (m_bFinalPending && !m_bLocalBusy)
+			nControl |= BT_L2CAP_CONTROL_FINAL;
+	}
+
+	if (!SendFrame (nControl, pPayload, nPieces))
+		return FALSE;
+
+	if (m_nMode == BT_L2CAP_MODE_ERTM) {
+		// an I-frame does not end the remote's view of us as busy
+		if (!m_bLocalBusy && !m_bRNRSent)
+			m_bAckPending = FALSE;
+		if (nControl & BT_L2CAP_CONTROL_FINAL)
+			m_bFinalPending = FALSE;
+		if (!m_bRetransTimer) {
+			m_bRetransTimer = TRUE;
+			m_nRetransStart = getClockTicks ();
+		}
+	}
+	return TRUE;
+}
+
+boolean CBTL2CAPERTM::SendSFrame (u8 nSuper, u16 nFlags)
+{
+	u16 nControl = BT_L2CAP_CONTROL_SFRAME | nSuper << 2 | m_nExpectedTxSeq << 8 | nFlags;
+	if (m_bFinalPending && !(nFlags & BT_L2CAP_CONTROL_POLL))
+		nControl |= BT_L2CAP_CONTROL_FINAL;
+
+	if (!SendFrame (nControl))
+		return FALSE;
+
+	if (nControl & BT_L2CAP_CONTROL_FINAL)
+		m_bFinalPending = FALSE;
+	m_bAckPending = FALSE;
+	m_bRNRSent = nSuper == BT_L2CAP_SUPER_RNR ? TRUE : FALSE;
+	return TRUE;
+}
+
+boolean CBTL2CAPERTM::Retransmit (u8 nTxSeq)
+{
+	unsigned nSlot = GetSlot (nTxSeq);
+	if (m_nMaxTransmit && m_TxRetries[nSlot] >= m_nMaxTransmit) {
+		LOG_DEBUG ("L2CAP: I-frame %u not acknowledged\r\n", (unsigned) nTxSeq);
+		m_bFailed = TRUE;
+		return FALSE;
+	}
+
+	TBTScatter Payload = {m_pTxFrames + nSlot * m_nTxMPS, m_TxLength[nSlot]};
+	if (!SendIFrame (nTxSeq, m_TxSAR[nSlot], &Payload, 1))
+		return FALSE;
+
+	m_TxRetries[nSlot]++;
+	m_nRetransmissions++;
+	return TRUE;
+}
+
+boolean CBTL2CAPERTM::Acknowledge (u8 nReqSeq)
+{
+	u8 nAcked = SeqOffset (nReqSeq, m_nExpectedAckSeq);
+	if (nAcked > GetUnacked ())
+		return FALSE;
+	if (nAcked == 0)
+		return TRUE;
+
+	if (m_bRetransmit && SeqOffset (m_nRetransmitSeq, m_nExpectedAckSeq) < nAcked)
+		m_nRetransmitSeq = nReqSeq;
+	for (u8 nSeq = m_nExpectedAckSeq; nSeq != nReqSeq; nSeq = SeqNext (nSeq))
+		m_SRejPending &= ~((u64) 1 << nSeq);
+
+	m_nTxHead = (m_nTxHead + nAcked) % m_nTxWindow;
+	m_nExpectedAckSeq = nReqSeq;
+	if (m_bRetransmit && m_nRetransmitSeq == m_nNextTxSeq)
+		m_bRetransmit = FALSE;
+
+	// the timer covers the oldest frame still unacknowledged
+	m_bRetransTimer = GetUnacked () > 0 && !m_bWaitFinal ? TRUE : FALSE;
+	m_nRetransStart = getClockTicks ();
+	return TRUE;
+}
+
+void CBTL2CAPERTM::Final (void)
+{
+	if (!m_bWaitFinal)
+		return;
+
+	// the poll is answered, what it left unacknowledged is sent again
+	m_bWaitFinal = FALSE;
+	m_bMonitorTimer = FALSE;
+	m_nPolls = 0;
+	if (GetUnacked () > 0) {
+		m_bRetransmit = TRUE;
+		m_nRetransmitSeq = m_nExpectedAckSeq;
+		m_bRetransTimer = TRUE;
+		m_nRetransStart = getClockTicks ();
+	}
+}
+
+boolean CBTL2CAPERTM::Poll (void)
+{
+	if (!SendSFrame (m_bLocalBusy ? BT_L2CAP_SUPER_RNR : BT_L2CAP_SUPER_RR,
+			 BT_L2CAP_CONTROL_POLL))
+		return FALSE;
+
+	m_bWaitFinal = TRUE;
+	m_bRetransTimer = FALSE;
+	m_bMonitorTimer = TRUE;
+	m_nMonitorStart = getClockTicks ();
+	m_nPolls++;
+	return TRUE;
+}
+
+unsigned CBTL2CAPERTM::GetSlot (u8 nTxSeq) const
+{
+	assert (m_pTxFrames != 0);
+	return (m_nTxHead + SeqOffset (nTxSeq, m_nExpectedAckSeq)) % m_nTxWindow;
+}
+
+unsigned CBTL2CAPERTM::GetUnacked (void) const
+{
+	return SeqOffset (m_nNextTxSeq, m_nExpectedAckSeq);
+}
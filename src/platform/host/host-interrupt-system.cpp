@@ -0,0 +1,85 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Host Simulation Interrupt System Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <platform/bt_interrupt-system.h>
+#include <assert.h>
+#include <string.h>
+
+static TInterruptSystem s_InterruptSystem;
+
+void InterruptSystem (TInterruptSystem *pThis)
+{
+	memset (pThis, 0, sizeof *pThis);
+}
+
+void _InterruptSystem (TInterruptSystem *)
+{
+}
+
+int InterruptSystemInitialize (void)
+{
+	InterruptSystem (&s_InterruptSystem);
+	return 1;
+}
+
+void InterruptSystemConnectIRQ (TInterruptSystem *pThis, unsigned nIRQ, TIRQHandler *pHandler, void *pParam)
+{
+	assert (nIRQ < IRQ_LINES);
+	pThis->m_apIRQHandler[nIRQ] = pHandler;
+	pThis->m_pParam[nIRQ] = pParam;
+}
+
+void InterruptSystemDisconnectIRQ (TInterruptSystem *pThis, unsigned nIRQ)
+{
+	assert (nIRQ < IRQ_LINES);
+	pThis->m_apIRQHandler[nIRQ] = 0;
+	pThis->m_pParam[nIRQ] = 0;
+}
+
+// nothing runs in interrupt context on the host
+void InterruptSystemEnableIRQ (unsigned)
+{
+}
+
+void InterruptSystemDisableIRQ (unsigned)
+{
+}
+
+TInterruptSystem *InterruptSystemGet (void)
+{
+	return &s_InterruptSystem;
+}
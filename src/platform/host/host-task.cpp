@@ -0,0 +1,262 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Host Simulation Task And Mutex Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <task.h>
+#include <mutex.h>
+#include <logger.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <time.h>
+#include <stdlib.h>
+
+//
+// The tasks of the bare metal kernel are mapped to POSIX threads. Blocked
+// tasks wait on a shared condition variable for their own wake flag, which
+// is enough for the handful of tasks the stack creates.
+//
+struct THostTask
+{
+	THostTask	*pNext;
+	int		nPID;
+	volatile bool	bWoken;
+};
+
+struct THostTaskStart
+{
+	void	(*pFunc) (void *);
+	void	*pParam;
+	THostTask *pTask;
+};
+
+#define HOST_MUTEXES	8
+
+static pthread_mutex_t s_Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_Wake = PTHREAD_COND_INITIALIZER;
+static THostTask *s_pTaskList = 0;
+static int s_nNextPID = 1;
+static __thread THostTask *s_pCurrent = 0;
+static unsigned int s_Mutex[HOST_MUTEXES];
+
+static THostTask *NewTask (void)
+{
+	THostTask *pTask = (THostTask *) malloc (sizeof (THostTask));
+	if (pTask == 0) return 0;
+
+	pthread_mutex_lock (&s_Lock);
+	pTask->nPID = s_nNextPID++;
+	pTask->bWoken = false;
+	pTask->pNext = s_pTaskList;
+	s_pTaskList = pTask;
+	pthread_mutex_unlock (&s_Lock);
+
+	return pTask;
+}
+
+static THostTask *CurrentTask (void)
+{
+	// threads not started through execTask() are registered on first use
+	if (s_pCurrent == 0) s_pCurrent = NewTask ();
+	return s_pCurrent;
+}
+
+static void *TaskEntry (void *pParam)
+{
+	THostTaskStart Start = *(THostTaskStart *) pParam;
+	free (pParam);
+
+	s_pCurrent = Start.pTask;
+	(*Start.pFunc) (Start.pParam);
+
+	return 0;
+}
+
+static void Deadline (struct timespec *pTime, uint32 usec)
+{
+	clock_gettime (CLOCK_REALTIME, pTime);
+	pTime->tv_sec += usec / 1000000;
+	pTime->tv_nsec += (usec % 1000000) * 1000;
+	if (pTime->tv_nsec >= 1000000000) {
+		pTime->tv_sec++;
+		pTime->tv_nsec -= 1000000000;
+	}
+}
+
+// waits for wakeTask() on *ptr, usec == 0 waits forever
+static void Block (void *ptr, uint32 usec)
+{
+	THostTask *pTask = CurrentTask ();
+	struct timespec Time;
+	if (usec) Deadline (&Time, usec);
+
+	pthread_mutex_lock (&s_Lock);
+	pTask->bWoken = false;
+	*(THostTask **) ptr = pTask;
+	while (!pTask->bWoken) {
+		if (!usec) pthread_cond_wait (&s_Wake, &s_Lock);
+		else if (pthread_cond_timedwait (&s_Wake, &s_Lock, &Time) == ETIMEDOUT)
+			break;
+	}
+	if (*(THostTask **) ptr == pTask) *(THostTask **) ptr = 0;
+	pthread_mutex_unlock (&s_Lock);
+}
+
+void initTasks (void)
+{
+	CurrentTask ();
+}
+
+void printTasks (void)
+{
+	pthread_mutex_lock (&s_Lock);
+	for (THostTask *pTask = s_pTaskList; pTask != 0; pTask = pTask->pNext)
+		LOG_DEBUG ("Task %d%s\r\n", pTask->nPID,
+			pTask == s_pCurrent ? " (current)" : "");
+	pthread_mutex_unlock (&s_Lock);
+}
+
+int execTask (void (*funcptr) (void *), void *funcblock)
+{
+	THostTaskStart *pStart = (THostTaskStart *) malloc (sizeof (THostTaskStart));
+	if (pStart == 0) return -1;
+	pStart->pFunc = funcptr;
+	pStart->pParam = funcblock;
+	pStart->pTask = NewTask ();
+	if (pStart->pTask == 0) {
+		free (pStart);
+		return -1;
+	}
+	int nPID = pStart->pTask->nPID;
+
+	pthread_t Thread;
+	if (pthread_create (&Thread, 0, TaskEntry, pStart) != 0) {
+		free (pStart);
+		return -1;
+	}
+	pthread_detach (Thread);
+
+	return nPID;
+}
+
+int forkTask (void *)
+{
+	// a thread cannot resume the caller's stack frame, use execTask()
+	LOG_DEBUG ("forkTask is not available on the host\r\n");
+	return -1;
+}
+
+void sleepTask (uint32 usec)
+{
+	struct timespec Time;
+	Time.tv_sec = usec / 1000000;
+	Time.tv_nsec = (usec % 1000000) * 1000;
+	while (nanosleep (&Time, &Time) != 0 && errno == EINTR);
+}
+
+bool yieldTask (void)
+{
+	return sched_yield () == 0;
+}
+
+void blockTask (void *ptr)
+{
+	Block (ptr, 0);
+}
+
+void sleepBlockedTask (void *ptr, uint32 usec)
+{
+	Block (ptr, usec ? usec : 1);
+}
+
+void wakeTask (void *ptr)
+{
+	pthread_mutex_lock (&s_Lock);
+	THostTask *pTask = *(THostTask **) ptr;
+	if (pTask != 0) {
+		pTask->bWoken = true;
+		*(THostTask **) ptr = 0;
+		pthread_cond_broadcast (&s_Wake);
+	}
+	pthread_mutex_unlock (&s_Lock);
+}
+
+void setTaskList (void *)
+{
+}
+
+void setCurrentTask (void)
+{
+	CurrentTask ();
+}
+
+void setTaskMutex (void)
+{
+}
+
+void *getIdleTask (void)
+{
+	return 0;
+}
+
+bool scheduleLockedTask (void *)
+{
+	return yieldTask ();
+}
+
+unsigned getClockTicks (void)
+{
+	// 1 MHz like the system timer of the Pi
+	struct timespec Time;
+	clock_gettime (CLOCK_MONOTONIC, &Time);
+	return (unsigned) (Time.tv_sec * 1000000 + Time.tv_nsec / 1000);
+}
+
+unsigned int *get_mutex (int nMutex)
+{
+	return &s_Mutex[nMutex % HOST_MUTEXES];
+}
+
+void spin_lock (void *mutex)
+{
+	while (__atomic_exchange_n ((unsigned int *) mutex, 1, __ATOMIC_ACQUIRE))
+		sched_yield ();
+}
+
+void spin_unlock (void *mutex)
+{
+	__atomic_store_n ((unsigned int *) mutex, 0, __ATOMIC_RELEASE);
+}
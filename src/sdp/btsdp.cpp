@@ -41,6 +41,7 @@
 #include <bluetooth/btsubsystem.h>
 #include <synchronize.h>
 #include <logger.h>
+#include <task.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
@@ -53,18 +54,25 @@ static const char FromSDPLayer[] = "btsdp";
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+#define PUT_BE16(p, v)	((p)[0] = (u8) ((v) >> 8), (p)[1] = (u8) (v))
+#define GET_BE16(p)	((u16) ((p)[0] << 8 | (p)[1]))
+
 CBTSDPLayer *CBTSDPLayer::s_pThis = 0;
 
 CBTSDPLayer::CBTSDPLayer (CBTL2CAPLayer *pL2CAPLayer)
-:	m_pL2CAPLayer (pL2CAPLayer)
+:	m_pL2CAPLayer (pL2CAPLayer),
+	m_nTransactionID (0)
 {
 	assert (s_pThis == 0);
 	s_pThis = this;
 
-	// Register the L2CAP Layer Callbacks
+	m_pBuffer = (u8 *) malloc (BT_SDP_MTU);
+	m_pAttributeLists = (u8 *) malloc (BT_SDP_BUFFER_SIZE);
+	assert (m_pBuffer != 0 && m_pAttributeLists != 0);
+
+	// Register the L2CAP Layer Callbacks, without a data callback the
+	// responses wait in the receive ring of the channel
 	pL2CAPLayer->RegisterCallback(BT_PSM_SERVICE_DISCOVERY_PROTOCOL, EventStub);
-	pL2CAPLayer->RegisterDataCallback(
-		BT_PSM_SERVICE_DISCOVERY_PROTOCOL, DataStub);
 
 	// Register the events
 	CBTSDPPDUHeader cmd1;
@@ -79,29 +87,249 @@ CBTSDPLayer::CBTSDPLayer (CBTL2CAPLayer *pL2CAPLayer)
 
 CBTSDPLayer::~CBTSDPLayer (void)
 {
+	free (m_pAttributeLists);
+	m_pAttributeLists = 0;
+	free (m_pBuffer);
+	m_pBuffer = 0;
+
 	s_pThis = 0;
 }
 
-void CBTSDPLayer::Callback (const void *pBuffer, unsigned nLength)
+u16 CBTSDPLayer::GetAttribute (
+	TBDAddr BDAddr,
+	u16 nUUID,
+	u16 nAttributeID,
+	u8 *pBuffer,
+	u16 nSize,
+	u16 *pLength)
 {
+	assert (pBuffer != 0);
+	assert (pLength != 0);
+
+	u16 nCID = 0, nStatus = 0;
+	if (m_pL2CAPLayer->Connect(BT_PSM_SERVICE_DISCOVERY_PROTOCOL, BDAddr,
+		&nCID, &nStatus) != BT_L2CAP_RESULT_CONNECTION_SUCCESSFUL)
+		return BT_SDP_RESULT_NO_CHANNEL;
+
+	u16 nInMTU, nOutFlushTO;
+	TBTL2CAPFlowSpec OutFlow;
+	u16 nResult = BT_SDP_RESULT_NO_CHANNEL;
+	if (m_pL2CAPLayer->Configure(nCID, BT_SDP_MTU, NULL, 0x0000, 0,
+		&nInMTU, &OutFlow, &nOutFlushTO) == BT_L2CAP_RESULT_SUCCESS) {
+		// the remote's configure request may still be on its way
+		unsigned nStartTicks = getClockTicks ();
+		CBTL2CAPChannel *pChannel;
+		while (   (pChannel = m_pL2CAPLayer->GetChannel(nCID)) != 0
+		       && !pChannel->IsOpen ()
+		       && getClockTicks () - nStartTicks < BT_SDP_TIMEOUT)
+			sleepTask (BT_L2CAP_WAIT_SLICE);
+
+		unsigned nListLength = 0;
+		if (pChannel && pChannel->IsOpen ())
+			nResult = Query(nCID, nUUID, nAttributeID, &nListLength);
+		if (nResult == BT_SDP_RESULT_SUCCESS)
+			nResult = FindAttribute(nListLength, nAttributeID,
+				pBuffer, nSize, pLength);
+	}
+
+	m_pL2CAPLayer->Disconnect(nCID);
+
+	return nResult;
 }
 
-void CBTSDPLayer::DataHandler (u16 nCID, u8 *pBuffer, u16 nLength)
+u16 CBTSDPLayer::GetHIDDescriptor (
+	TBDAddr BDAddr,
+	u8 *pBuffer,
+	u16 nSize,
+	u16 *pLength)
 {
+	u16 nLength;
+	u16 nResult = GetAttribute(BDAddr, BT_SDP_UUID_HUMAN_INTERFACE_DEVICE,
+		BT_SDP_ATTRIBUTE_HID_DESCRIPTOR_LIST, pBuffer, nSize, &nLength);
+	if (nResult != BT_SDP_RESULT_SUCCESS) return nResult;
+
+	// a sequence of sequences, each a descriptor type and the descriptor
+	u8 nType;
+	u32 nListLength, nEntryLength, nLength2;
+	const u8 *pList = GetElement(pBuffer, pBuffer + nLength, &nType, &nListLength);
+	if (!pList || nType != BT_SDP_DE_SEQUENCE) return BT_SDP_RESULT_MALFORMED;
+	const u8 *pListEnd = pList + nListLength;
+	for (const u8 *pEntry = pList; pEntry < pListEnd; pEntry += nEntryLength) {
+		pEntry = GetElement(pEntry, pListEnd, &nType, &nEntryLength);
+		if (!pEntry || nType != BT_SDP_DE_SEQUENCE) return BT_SDP_RESULT_MALFORMED;
+		const u8 *pEntryEnd = pEntry + nEntryLength;
+		const u8 *pKind = GetElement(pEntry, pEntryEnd, &nType, &nLength2);
+		if (!pKind || nType != BT_SDP_DE_UINT || nLength2 != 1)
+			return BT_SDP_RESULT_MALFORMED;
+		if (*pKind != BT_SDP_HID_DESCRIPTOR_REPORT) continue;
+
+		const u8 *pDescriptor = GetElement(pKind + 1, pEntryEnd, &nType, &nLength2);
+		if (!pDescriptor || nType != BT_SDP_DE_TEXT) return BT_SDP_RESULT_MALFORMED;
+		memmove (pBuffer, pDescriptor, nLength2);
+		*pLength = nLength2;
+
+		return BT_SDP_RESULT_SUCCESS;
+	}
+
+	return BT_SDP_RESULT_NOT_FOUND;
 }
 
-void CBTSDPLayer::EventStub (const void *pBuffer, unsigned nLength)
+u16 CBTSDPLayer::Query (u16 nCID, u16 nUUID, u16 nAttributeID, unsigned *pListLength)
 {
-	assert (s_pThis != 0);
-	s_pThis->Callback (pBuffer, nLength);
+	u8 Continuation[1+BT_SDP_MAX_CONTINUATION];
+	Continuation[0] = 0;
+	unsigned nListLength = 0;
+
+	// the attribute lists may come in several responses, each asking
+	// for the next with the continuation state of the last
+	do {
+		u8 Request[5+5+2+5+sizeof Continuation];
+		u16 nTransactionID = ++m_nTransactionID;
+		u8 *p = Request + 5;
+		*p++ = BT_SDP_DE_SEQUENCE << 3 | 5;		// service search pattern
+		*p++ = 3;
+		*p++ = BT_SDP_DE_UUID << 3 | 1;
+		PUT_BE16(p, nUUID); p += 2;
+		PUT_BE16(p, BT_SDP_MTU - 16); p += 2;		// maximum attribute byte count
+		*p++ = BT_SDP_DE_SEQUENCE << 3 | 5;		// attribute ID list
+		*p++ = 3;
+		*p++ = BT_SDP_DE_UINT << 3 | 1;
+		PUT_BE16(p, nAttributeID); p += 2;
+		memcpy (p, Continuation, 1 + Continuation[0]);
+		p += 1 + Continuation[0];
+		Request[0] = BT_SDP_PDU_SERVICE_SEARCH_ATTRIBUTE_REQUEST;
+		PUT_BE16(Request+1, nTransactionID);
+		PUT_BE16(Request+3, p - Request - 5);
+
+		if (m_pL2CAPLayer->Write(nCID, p - Request, Request, NULL)
+			!= BT_L2CAP_RESULT_SUCCESS)
+			return BT_SDP_RESULT_NO_CHANNEL;
+
+		u16 nLength;
+		u16 nResult = m_pL2CAPLayer->Read(nCID, BT_SDP_MTU, m_pBuffer, &nLength,
+			BT_SDP_TIMEOUT);
+		if (nResult == BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED)
+			return BT_SDP_RESULT_TIMEOUT;
+		if (nResult != BT_L2CAP_RESULT_SUCCESS) return BT_SDP_RESULT_NO_CHANNEL;
+
+		if (nLength < 5 || GET_BE16(m_pBuffer+1) != nTransactionID
+		    || GET_BE16(m_pBuffer+3) != nLength - 5)
+			return BT_SDP_RESULT_MALFORMED;
+		if (m_pBuffer[0] == BT_SDP_PDU_ERROR_RESPONSE)
+			return BT_SDP_RESULT_ERROR_RESPONSE;
+		if (m_pBuffer[0] != BT_SDP_PDU_SERVICE_SEARCH_ATTRIBUTE_RESPONSE
+		    || nLength < 5 + 2 + 1)
+			return BT_SDP_RESULT_MALFORMED;
+
+		u16 nCount = GET_BE16(m_pBuffer+5);
+		const u8 *pState = m_pBuffer + 7 + nCount;
+		if (   7 + nCount + 1 > nLength
+		    || *pState > BT_SDP_MAX_CONTINUATION
+		    || 7 + nCount + 1 + *pState != nLength)
+			return BT_SDP_RESULT_MALFORMED;
+		if (nListLength + nCount > BT_SDP_BUFFER_SIZE)
+			return BT_SDP_RESULT_TOO_LARGE;
+
+		memcpy (m_pAttributeLists + nListLength, m_pBuffer + 7, nCount);
+		nListLength += nCount;
+		memcpy (Continuation, pState, 1 + *pState);
+	} while (Continuation[0] != 0);
+
+	*pListLength = nListLength;
+
+	return BT_SDP_RESULT_SUCCESS;
 }
 
-void CBTSDPLayer::DataStub (u16 nCID, const void *pBuffer, unsigned nLength)
+u16 CBTSDPLayer::FindAttribute (
+	unsigned nListLength,
+	u16 nAttributeID,
+	u8 *pBuffer,
+	u16 nSize,
+	u16 *pLength)
 {
-	assert (nCID >= BT_CID_DYNAMICALLY_ALLOCATED);
-	assert (s_pThis != 0);
+	// a sequence of the records found, each a sequence of ID and value
+	u8 nType;
+	u32 nLength;
+	const u8 *pRecord = GetElement(m_pAttributeLists,
+		m_pAttributeLists + nListLength, &nType, &nLength);
+	if (!pRecord || nType != BT_SDP_DE_SEQUENCE) return BT_SDP_RESULT_MALFORMED;
+
+	const u8 *pEnd = pRecord + nLength;
+	for (; pRecord < pEnd; pRecord += nLength) {
+		pRecord = GetElement(pRecord, pEnd, &nType, &nLength);
+		if (!pRecord || nType != BT_SDP_DE_SEQUENCE) return BT_SDP_RESULT_MALFORMED;
+
+		const u8 *pRecordEnd = pRecord + nLength;
+		for (const u8 *p = pRecord; p < pRecordEnd; ) {
+			u32 nIDLength, nValueLength;
+			const u8 *pID = GetElement(p, pRecordEnd, &nType, &nIDLength);
+			if (!pID || nType != BT_SDP_DE_UINT || nIDLength != 2)
+				return BT_SDP_RESULT_MALFORMED;
+			const u8 *pValue = pID + nIDLength;
+			p = GetElement(pValue, pRecordEnd, &nType, &nValueLength);
+			if (!p) return BT_SDP_RESULT_MALFORMED;
+			p += nValueLength;
+			if (GET_BE16(pID) != nAttributeID) continue;
+
+			// the whole element, header included
+			if (p - pValue > nSize) return BT_SDP_RESULT_TOO_LARGE;
+			memcpy (pBuffer, pValue, p - pValue);
+			*pLength = p - pValue;
+
+			return BT_SDP_RESULT_SUCCESS;
+		}
+	}
+
+	return BT_SDP_RESULT_NOT_FOUND;
+}
+
+const u8 *CBTSDPLayer::GetElement (const u8 *pData, const u8 *pEnd, u8 *pType, u32 *pLength)
+{
+	if (pData >= pEnd) return 0;
+
+	u8 nDescriptor = *pData++;
+	*pType = nDescriptor >> 3;
+	unsigned nSizeIndex = nDescriptor & 7;
+	u32 nLength = 0;
+	if (nSizeIndex < 5) {
+		if (*pType != BT_SDP_DE_NIL) nLength = 1 << nSizeIndex;
+	} else {
+		// the size follows in 1, 2 or 4 bytes
+		unsigned nBytes = 1 << (nSizeIndex - 5);
+		if ((unsigned) (pEnd - pData) < nBytes) return 0;
+		while (nBytes--) nLength = nLength << 8 | *pData++;
+	}
+
+	if ((u32) (pEnd - pData) < nLength) return 0;
+	*pLength = nLength;
 
-	if (nCID < BT_CID_DYNAMICALLY_ALLOCATED) return;
-	u16 nID = nCID - BT_CID_DYNAMICALLY_ALLOCATED;
-	s_pThis->DataHandler (nID, (u8 *)pBuffer, nLength);
+	return pData;
+}
+
+void CBTSDPLayer::Callback (const void *pBuffer, unsigned nLength)
+{
+	CBTL2CAEvent *pEvent = (CBTL2CAEvent *) pBuffer;
+
+	switch (pEvent->Event) {
+		case BT_EVENT_L2CA_CONFIG_IND : {
+			CBTL2CAConfigInd *pConfigInd = (CBTL2CAConfigInd *)pEvent;
+			m_pL2CAPLayer->ConfigureResponse(
+				pConfigInd->Identifier, pConfigInd->CID, 0,
+				BT_L2CAP_RESULT_SUCCESS,
+				pConfigInd->OutMTU, pConfigInd->InFlushTO, pConfigInd->InFlow);
+			} break;
+		case BT_EVENT_L2CA_DISCONNECT_IND : {
+			CBTL2CADisconnectInd *pDisconnInd = (CBTL2CADisconnectInd *)pEvent;
+			m_pL2CAPLayer->DisconnectResponse(
+				pDisconnInd->Identifier, pDisconnInd->CID);
+			} break;
+		default:
+			break;
+	}
+}
+
+void CBTSDPLayer::EventStub (const void *pBuffer, unsigned nLength)
+{
+	assert (s_pThis != 0);
+	s_pThis->Callback (pBuffer, nLength);
 }
@@ -0,0 +1,837 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Host Simulation Bluetooth Controller Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btsimcontroller.h>
+#include <bluetooth/btcommand.h>
+#include <bluetooth/btevent.h>
+#include <bluetooth/btdata.h>
+#include <bluetooth/bterror.h>
+#include <mutex.h>
+#include <task.h>
+#include <logger.h>
+#include <assert.h>
+#include <string.h>
+
+struct TBTSimPacket
+{
+	TBTSimPacket	*pNext;
+	unsigned	nDue;			// in getClockTicks() units
+	unsigned	nLength;		// H4 indicator included
+	u8		Data[0];
+};
+
+#define PUT16(p, v)	((p)[0] = (u8) (v), (p)[1] = (u8) ((v) >> 8))
+#define GET16(p)	((u16) ((p)[0] | (p)[1] << 8))
+
+static const u8 DefaultBDAddr[BT_BD_ADDR_SIZE] = {0x01, 0x00, 0x00, 0x5A, 0x11, 0xB8};
+
+CBTSimController::CBTSimController (void)
+:	m_nPeers (0),
+	m_nResponseDelay (0),
+	m_nInquiryTime (BT_SIM_INQUIRY_TIME),
+	m_nNextHandle (BT_SIM_FIRST_HANDLE),
+	m_nACLBuffers (BT_SIM_ACL_BUFFERS),
+	m_nACLLength (BT_SIM_ACL_LENGTH),
+	m_nACLFree (BT_SIM_ACL_BUFFERS),
+	m_nAirTime (0),
+	m_nAirBusy (0),
+	m_nFragment (BT_SIM_ACL_MTU),
+	m_nMaxFragment (0),
+	m_nJitter (0),
+	m_nRandom (1),
+	m_nHostACLLength (0),
+	m_nHostACLPackets (0),
+	m_nHostACLFree (0),
+	m_bHostFlowControl (FALSE),
+	m_nLargestACLToHost (0),
+	m_nCommandPackets (BT_SIM_COMMAND_PACKETS),
+	m_nCommandsHeld (0),
+	m_nRestartTime (0),
+	m_bRestarting (FALSE),
+	m_nRestartDue (0),
+	m_pFirst (0),
+	m_nReadOffset (0),
+	m_nLock (0),
+	m_nCommands (0),
+	m_nFirmwareBytes (0),
+	m_nCommandOverruns (0),
+	m_nCommandsLost (0),
+	m_nACLPackets (0),
+	m_nACLOverruns (0),
+	m_nACLBuffersUsed (0)
+{
+	memcpy (m_BDAddr, DefaultBDAddr, BT_BD_ADDR_SIZE);
+}
+
+CBTSimController::~CBTSimController (void)
+{
+	while (m_pFirst != 0) {
+		TBTSimPacket *pPacket = m_pFirst;
+		m_pFirst = pPacket->pNext;
+		free (pPacket);
+	}
+
+	for (unsigned i = 0; i < m_nPeers; i++) {
+		m_pPeer[i]->Detach ();
+	}
+}
+
+boolean CBTSimController::AddPeer (CBTSimPeer *pPeer)
+{
+	assert (pPeer != 0);
+	if (m_nPeers >= BT_SIM_MAX_PEERS) {
+		return FALSE;
+	}
+
+	m_pPeer[m_nPeers] = pPeer;
+	__atomic_store_n (&m_nPeers, m_nPeers+1, __ATOMIC_RELEASE);
+
+	return TRUE;
+}
+
+void CBTSimController::SetBDAddress (const u8 *pBDAddr)
+{
+	memcpy (m_BDAddr, pBDAddr, BT_BD_ADDR_SIZE);
+}
+
+void CBTSimController::SetResponseDelay (unsigned nMicros)
+{
+	m_nResponseDelay = nMicros;
+}
+
+void CBTSimController::SetInquiryTime (unsigned nMicros)
+{
+	m_nInquiryTime = nMicros;
+}
+
+void CBTSimController::SetACLBuffers (unsigned nPackets, unsigned nLength)
+{
+	assert (nPackets > 0);
+	m_nACLBuffers = nPackets;
+	m_nACLFree = nPackets;
+	m_nACLLength = nLength;
+}
+
+void CBTSimController::SetAirTime (unsigned nMicros)
+{
+	m_nAirTime = nMicros;
+}
+
+void CBTSimController::SetCommandPackets (unsigned nPackets)
+{
+	assert (nPackets > 0 && nPackets <= 255);
+	m_nCommandPackets = nPackets;
+}
+
+void CBTSimController::SetRestartTime (unsigned nMicros)
+{
+	m_nRestartTime = nMicros;
+}
+
+void CBTSimController::SetACLInterleave (unsigned nMaxFragment, unsigned nJitter)
+{
+	assert (nMaxFragment <= BT_SIM_ACL_LENGTH);
+	m_nMaxFragment = nMaxFragment;
+	m_nJitter = nJitter;
+
+	unsigned nNow = getClockTicks ();
+	for (unsigned i = 0; i < BT_SIM_MAX_PEERS; i++) {
+		m_nLastDue[i] = nNow;
+	}
+}
+
+void CBTSimController::SetACLFragment (unsigned nLength)
+{
+	assert (nLength > 0 && nLength <= BT_SIM_ACL_LENGTH);
+	m_nFragment = nLength;
+}
+
+void CBTSimController::RequestConnection (CBTSimPeer *pPeer)
+{
+	assert (pPeer != 0);
+
+	u8 Params[BT_BD_ADDR_SIZE+BT_CLASS_SIZE+1];
+	memcpy (Params, pPeer->GetBDAddress (), BT_BD_ADDR_SIZE);
+	memcpy (Params+BT_BD_ADDR_SIZE, pPeer->GetClassOfDevice (), BT_CLASS_SIZE);
+	Params[BT_BD_ADDR_SIZE+BT_CLASS_SIZE] = LINK_TYPE_ACL_CONNECTION;
+	Event (BT_EVENT_CODE_CONNECTION_REQUEST, Params, sizeof Params);
+}
+
+void CBTSimController::ReceiveCommand (const u8 *pBuffer, unsigned nLength)
+{
+	assert (pBuffer != 0);
+	if (nLength < 3 || nLength < 3u + pBuffer[2]) {
+		LOG_DEBUG ("SIM: Short command ignored\r\n");
+		return;
+	}
+
+	// needs no command slot and is not answered
+	if (GET16 (pBuffer) == OP_CODE_HOST_NUMBER_OF_COMPLETED_PACKETS) {
+		HostCompleted (pBuffer+3, pBuffer[2]);
+		return;
+	}
+
+	if (m_bRestarting) {
+		if ((int) (getClockTicks () - m_nRestartDue) < 0) {
+			LOG_DEBUG ("SIM: Command lost while restarting\r\n");
+			m_nCommandsLost++;
+			return;
+		}
+		m_bRestarting = FALSE;
+	}
+
+	// a host which ignores Num_HCI_Command_Packets would overflow the slots
+	spin_lock ((void *) &m_nLock);
+	boolean bOverrun = m_nCommandsHeld >= m_nCommandPackets ? TRUE : FALSE;
+	if (bOverrun) {
+		m_nCommandOverruns++;
+	} else {
+		m_nCommandsHeld++;
+	}
+	spin_unlock ((void *) &m_nLock);
+
+	if (bOverrun) {
+		LOG_DEBUG ("SIM: Command without a free slot\r\n");
+		return;
+	}
+
+	m_nCommands++;
+	Command (GET16 (pBuffer), pBuffer+3, pBuffer[2]);
+}
+
+void CBTSimController::ReceiveData (const u8 *pBuffer, unsigned nLength)
+{
+	assert (pBuffer != 0);
+	if (nLength < 4 || nLength < 4u + GET16 (pBuffer+2)) {
+		LOG_DEBUG ("SIM: Short ACL packet ignored\r\n");
+		return;
+	}
+
+	u16 nHandle = GET16 (pBuffer) & 0xFFF;
+	u8 nBoundaryFlag = (pBuffer[1] >> 4) & 3;
+
+	if (GET16 (pBuffer+2) > m_nACLLength) {
+		LOG_DEBUG ("SIM: ACL packet exceeds buffer size\r\n");
+		m_nACLOverruns++;
+		return;
+	}
+
+	// a host which ignores the credits would overwrite a buffer in use
+	spin_lock ((void *) &m_nLock);
+	boolean bOverrun = m_nACLFree == 0 ? TRUE : FALSE;
+	if (bOverrun) {
+		m_nACLOverruns++;
+	} else {
+		m_nACLFree--;
+		if (m_nACLBuffers - m_nACLFree > m_nACLBuffersUsed) {
+			m_nACLBuffersUsed = m_nACLBuffers - m_nACLFree;
+		}
+	}
+	spin_unlock ((void *) &m_nLock);
+
+	if (bOverrun) {
+		LOG_DEBUG ("SIM: ACL packet without a free buffer\r\n");
+		return;
+	}
+	m_nACLPackets++;
+
+	CBTSimPeer *pPeer = GetPeer (nHandle);
+	if (pPeer != 0) {
+		pPeer->ReceiveACL (nBoundaryFlag, pBuffer+4, GET16 (pBuffer+2));
+	}
+
+	// the packet leaves the controller buffer once it is on the air, the
+	// buffer is free again when the host has read the completion
+	// the backlog is at most one air time per buffer, anything else is
+	// an idle link (or the initial value)
+	unsigned nNow = getClockTicks ();
+	unsigned nBacklog = m_nAirBusy - nNow;
+	if ((int) nBacklog < 0 || nBacklog > m_nACLBuffers * m_nAirTime) {
+		m_nAirBusy = nNow;
+	}
+	m_nAirBusy += m_nAirTime;
+
+	u8 Params[5];
+	Params[0] = 1;
+	PUT16 (Params+1, nHandle);
+	PUT16 (Params+3, 1);
+	Event (BT_EVENT_CODE_NUMBER_OF_COMPLETED_PACKETS, Params, sizeof Params,
+	       m_nAirBusy - nNow);
+}
+
+unsigned CBTSimController::Read (u8 *pBuffer, unsigned nSize)
+{
+	assert (pBuffer != 0);
+	unsigned nNow = getClockTicks ();
+	unsigned nResult = 0;
+
+	// peer timers run on the host's reads, the peers queue without the lock
+	for (unsigned i = 0; i < m_nPeers; i++) {
+		m_pPeer[i]->Poll (nNow);
+	}
+
+	spin_lock ((void *) &m_nLock);
+
+	while (   m_pFirst != 0
+	       && (int) (nNow - m_pFirst->nDue) >= 0
+	       && nResult < nSize) {
+		// a fragment goes out only into a free host buffer, it waits
+		// in front of anything queued behind it like on the UART
+		if (   m_nReadOffset == 0
+		    && m_pFirst->Data[0] == HCI_PACKET_ACL_DATA
+		    && m_bHostFlowControl) {
+			if (m_nHostACLFree == 0) {
+				break;
+			}
+			m_nHostACLFree--;
+		}
+
+		unsigned nCopy = m_pFirst->nLength - m_nReadOffset;
+		if (nCopy > nSize - nResult) {
+			nCopy = nSize - nResult;
+		}
+		memcpy (pBuffer+nResult, m_pFirst->Data+m_nReadOffset, nCopy);
+		nResult += nCopy;
+
+		m_nReadOffset += nCopy;
+		if (m_nReadOffset == m_pFirst->nLength) {
+			TBTSimPacket *pPacket = m_pFirst;
+			m_pFirst = pPacket->pNext;
+			m_nReadOffset = 0;
+
+			// indicator, code, length, number of handles, handles, counts
+			if (   pPacket->Data[0] == HCI_PACKET_EVENT
+			    && pPacket->Data[1] == BT_EVENT_CODE_NUMBER_OF_COMPLETED_PACKETS) {
+				unsigned nHandles = pPacket->Data[3];
+				for (unsigned i = 0; i < nHandles; i++) {
+					m_nACLFree += GET16 (pPacket->Data + 4 + nHandles*2 + i*2);
+				}
+			} else if (   pPacket->Data[0] == HCI_PACKET_EVENT
+				   && (   pPacket->Data[1] == BT_EVENT_CODE_COMMAND_COMPLETE
+				       || pPacket->Data[1] == BT_EVENT_CODE_COMMAND_STATUS)
+				   && m_nCommandsHeld > 0) {
+				m_nCommandsHeld--;
+			}
+			free (pPacket);
+		}
+	}
+
+	spin_unlock ((void *) &m_nLock);
+
+	return nResult;
+}
+
+void CBTSimController::SendACL (CBTSimPeer *pPeer, const u8 *pFrame, unsigned nLength)
+{
+	assert (pPeer != 0);
+	assert (pFrame != 0);
+
+	u16 nHandle = pPeer->GetConnectionHandle ();
+	if (nHandle == 0) {
+		return;
+	}
+
+	unsigned nPeer = 0;
+	while (nPeer < m_nPeers && m_pPeer[nPeer] != pPeer) {
+		nPeer++;
+	}
+	assert (nPeer < m_nPeers);
+
+	unsigned nMaxLength = m_nFragment;
+	if (m_nHostACLLength != 0 && nMaxLength > m_nHostACLLength) {
+		nMaxLength = m_nHostACLLength;
+	}
+
+	u8 nBoundaryFlag = BT_FIRST_PACKET;
+	do {
+		unsigned nFragment = nLength < nMaxLength ? nLength : nMaxLength;
+		unsigned nDue = getClockTicks () + m_nResponseDelay;
+
+		if (m_nMaxFragment != 0) {
+			spin_lock ((void *) &m_nLock);
+			m_nRandom = m_nRandom * 1103515245 + 12345;
+			unsigned nRandom = m_nRandom >> 8;
+			if (nFragment > 1 + nRandom % m_nMaxFragment) {
+				nFragment = 1 + nRandom % m_nMaxFragment;
+			}
+			nRandom >>= 8;
+
+			// the fragments of a link keep their order
+			if (m_nJitter != 0) {
+				nDue += nRandom % m_nJitter;
+			}
+			if ((int) (m_nLastDue[nPeer] - nDue) > 0) {
+				nDue = m_nLastDue[nPeer];
+			}
+			m_nLastDue[nPeer] = nDue;
+			spin_unlock ((void *) &m_nLock);
+		}
+
+		if (nFragment > m_nLargestACLToHost) {
+			m_nLargestACLToHost = nFragment;
+		}
+
+		u8 Header[5];
+		Header[0] = HCI_PACKET_ACL_DATA;
+		PUT16 (Header+1, nHandle | nBoundaryFlag << 12);
+		PUT16 (Header+3, nFragment);
+		QueueAt (Header, sizeof Header, pFrame, nFragment, nDue);
+
+		pFrame += nFragment;
+		nLength -= nFragment;
+		nBoundaryFlag = BT_CONTINUING_FRAGMENT_PACKET;
+	} while (nLength > 0);
+}
+
+unsigned CBTSimController::GetCommands (void) const
+{
+	return m_nCommands;
+}
+
+unsigned CBTSimController::GetFirmwareBytes (void) const
+{
+	return m_nFirmwareBytes;
+}
+
+unsigned CBTSimController::GetCommandOverruns (void) const
+{
+	return m_nCommandOverruns;
+}
+
+unsigned CBTSimController::GetCommandsLost (void) const
+{
+	return m_nCommandsLost;
+}
+
+unsigned CBTSimController::GetACLPackets (void) const
+{
+	return m_nACLPackets;
+}
+
+unsigned CBTSimController::GetACLOverruns (void) const
+{
+	return m_nACLOverruns;
+}
+
+unsigned CBTSimController::GetACLBuffersUsed (void) const
+{
+	return m_nACLBuffersUsed;
+}
+
+void CBTSimController::Command (u16 nOpCode, const u8 *pParams, unsigned nLength)
+{
+	CBTSimPeer *pPeer;
+	u8 Params[BT_BD_ADDR_SIZE+BT_MAX_LINK_KEY_SIZE+1];
+
+	switch (nOpCode) {
+
+	case OP_CODE_LAUNCH_RAM:
+		m_nRestartDue = getClockTicks () + m_nResponseDelay + m_nRestartTime;
+		m_bRestarting = TRUE;
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS);
+		break;
+
+	case OP_CODE_RESET:
+	case OP_CODE_DOWNLOAD_MINIDRIVER:
+	case OP_CODE_WRITE_CLASS_OF_DEVICE:
+	case OP_CODE_WRITE_LOCAL_NAME:
+	case OP_CODE_WRITE_SCAN_ENABLE:
+	case OP_CODE_INQUIRY_CANCEL:
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS);
+		break;
+
+	case OP_CODE_WRITE_RAM:
+		// 4 byte address, then the patch data
+		if (nLength > 4) {
+			m_nFirmwareBytes += nLength - 4;
+		}
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS);
+		break;
+
+	case OP_CODE_HOST_BUFFER_SIZE:
+		// ACL length, synchronous length, ACL packets, synchronous packets
+		if (nLength < 7 || GET16 (pParams) == 0 || GET16 (pParams+3) == 0) {
+			CommandComplete (nOpCode, BT_ERROR_INVALID_HCI_COMMAND_PARAMETERS);
+			break;
+		}
+		m_nHostACLLength = GET16 (pParams);
+		m_nHostACLPackets = GET16 (pParams+3);
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS);
+		break;
+
+	case OP_CODE_SET_CONTROLLER_TO_HOST_FLOW_CONTROL:
+		if (nLength < 1 || (pParams[0] != FLOW_CONTROL_OFF && m_nHostACLPackets == 0)) {
+			CommandComplete (nOpCode, BT_ERROR_INVALID_HCI_COMMAND_PARAMETERS);
+			break;
+		}
+		spin_lock ((void *) &m_nLock);
+		m_bHostFlowControl = pParams[0] & FLOW_CONTROL_ACL ? TRUE : FALSE;
+		m_nHostACLFree = m_nHostACLPackets;
+		spin_unlock ((void *) &m_nLock);
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS);
+		break;
+
+	case OP_CODE_READ_BD_ADDR:
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS, m_BDAddr, BT_BD_ADDR_SIZE);
+		break;
+
+	case OP_CODE_READ_BUFFER_SIZE:
+		PUT16 (Params, m_nACLLength);
+		Params[2] = 64;				// synchronous packet length
+		PUT16 (Params+3, m_nACLBuffers);
+		PUT16 (Params+5, 8);			// synchronous packets
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS, Params, 7);
+		break;
+
+	case OP_CODE_INQUIRY:
+		CommandStatus (nOpCode, BT_STATUS_SUCCESS);
+		Inquiry ();
+		break;
+
+	case OP_CODE_REMOTE_NAME_REQUEST: {
+		CommandStatus (nOpCode, BT_STATUS_SUCCESS);
+
+		u8 Name[1+BT_BD_ADDR_SIZE+BT_NAME_SIZE];
+		memset (Name, 0, sizeof Name);
+		memcpy (Name+1, pParams, BT_BD_ADDR_SIZE);
+		pPeer = GetPeer (pParams);
+		if (pPeer != 0) {
+			strncpy ((char *) Name+1+BT_BD_ADDR_SIZE, pPeer->GetName (),
+				 BT_NAME_SIZE);
+		} else {
+			Name[0] = BT_ERROR_PAGE_TIMEOUT;
+		}
+		Event (BT_EVENT_CODE_REMOTE_NAME_REQUEST_COMPLETE, Name, sizeof Name);
+		} break;
+
+	case OP_CODE_CREATE_CONNECTION:
+	case OP_CODE_ACCEPT_CONNECTION_REQUEST:
+		CommandStatus (nOpCode, BT_STATUS_SUCCESS);
+		pPeer = GetPeer (pParams);
+		ConnectionComplete (pPeer, pParams,
+			pPeer != 0 ? BT_STATUS_SUCCESS : BT_ERROR_PAGE_TIMEOUT);
+		break;
+
+	case OP_CODE_REJECT_CONNECTION_REQUEST:
+		CommandStatus (nOpCode, BT_STATUS_SUCCESS);
+		ConnectionComplete (0, pParams, pParams[BT_BD_ADDR_SIZE]);
+		break;
+
+	case OP_CODE_DISCONNECT: {
+		pPeer = GetPeer ((u16) (GET16 (pParams) & 0xFFF));
+		if (pPeer == 0) {
+			CommandStatus (nOpCode, BT_ERROR_NO_CONNECTION);
+			break;
+		}
+		CommandStatus (nOpCode, BT_STATUS_SUCCESS);
+
+		u8 Disconnected[4];
+		Disconnected[0] = BT_STATUS_SUCCESS;
+		PUT16 (Disconnected+1, pPeer->GetConnectionHandle ());
+		Disconnected[3] = BT_ERROR_CONNECTION_TERMINATED_BY_LOCAL_HOST;
+		pPeer->Detach ();
+		Event (BT_EVENT_CODE_DISCONNECTION_COMPLETE, Disconnected, sizeof Disconnected);
+		} break;
+
+	case OP_CODE_AUTHENTICATION_REQUESTED:
+		pPeer = GetPeer ((u16) (GET16 (pParams) & 0xFFF));
+		if (pPeer == 0) {
+			CommandStatus (nOpCode, BT_ERROR_NO_CONNECTION);
+			break;
+		}
+		CommandStatus (nOpCode, BT_STATUS_SUCCESS);
+		Event (BT_EVENT_CODE_LINK_KEY_REQUEST, pPeer->GetBDAddress (), BT_BD_ADDR_SIZE);
+		break;
+
+	case OP_CODE_READ_STORED_LINK_KEY:
+		// the simulated controller does not keep link keys
+		PUT16 (Params, 1);
+		PUT16 (Params+2, 0);
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS, Params, 4);
+		break;
+
+	case OP_CODE_WRITE_STORED_LINK_KEY:
+		Params[0] = pParams[0];
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS, Params, 1);
+		break;
+
+	case OP_CODE_LINK_KEY_REQUEST_REPLY:
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS, pParams, BT_BD_ADDR_SIZE);
+		AuthenticationComplete (GetPeer (pParams), BT_STATUS_SUCCESS);
+		break;
+
+	case OP_CODE_LINK_KEY_REQUEST_NEGATIVE_REPLY:
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS, pParams, BT_BD_ADDR_SIZE);
+		Event (BT_EVENT_CODE_PIN_CODE_REQUEST, pParams, BT_BD_ADDR_SIZE);
+		break;
+
+	case OP_CODE_PIN_CODE_REQUEST_REPLY: {
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS, pParams, BT_BD_ADDR_SIZE);
+
+		pPeer = GetPeer (pParams);
+		u8 nPINLength = pParams[BT_BD_ADDR_SIZE];
+		const char *pPIN = (const char *) pParams+BT_BD_ADDR_SIZE+1;
+		if (   pPeer == 0
+		    || nPINLength != strlen (pPeer->GetPIN ())
+		    || memcmp (pPIN, pPeer->GetPIN (), nPINLength) != 0) {
+			AuthenticationComplete (pPeer, BT_ERROR_AUTHENTICATION_FAILURE);
+			break;
+		}
+
+		// any key will do, the peer does not check it later
+		memcpy (Params, pParams, BT_BD_ADDR_SIZE);
+		for (unsigned i = 0; i < BT_MAX_LINK_KEY_SIZE; i++) {
+			Params[BT_BD_ADDR_SIZE+i] = pParams[i % BT_BD_ADDR_SIZE] ^ i;
+		}
+		Params[BT_BD_ADDR_SIZE+BT_MAX_LINK_KEY_SIZE] = 0;	// combination key
+		Event (BT_EVENT_CODE_LINK_KEY_NOTIFICATION, Params, sizeof Params);
+		AuthenticationComplete (pPeer, BT_STATUS_SUCCESS);
+		} break;
+
+	case OP_CODE_PIN_CODE_REQUEST_NEGATIVE_REPLY:
+		CommandComplete (nOpCode, BT_STATUS_SUCCESS, pParams, BT_BD_ADDR_SIZE);
+		AuthenticationComplete (GetPeer (pParams), BT_ERROR_KEY_MISSING);
+		break;
+
+	case OP_CODE_READ_REMOTE_VERSION_INFORMATION:
+	case OP_CODE_READ_REMOTE_SUPPORTED_FEATURES: {
+		pPeer = GetPeer ((u16) (GET16 (pParams) & 0xFFF));
+		if (pPeer == 0) {
+			CommandStatus (nOpCode, BT_ERROR_NO_CONNECTION);
+			break;
+		}
+		CommandStatus (nOpCode, BT_STATUS_SUCCESS);
+
+		u8 Info[3+BT_LMP_FEATURE_SIZE];
+		memset (Info, 0, sizeof Info);
+		PUT16 (Info+1, pPeer->GetConnectionHandle ());
+		if (nOpCode == OP_CODE_READ_REMOTE_VERSION_INFORMATION) {
+			Info[3] = 0x06;				// Bluetooth 4.0
+			PUT16 (Info+4, 0x000F);			// Broadcom
+			PUT16 (Info+6, 0x0001);
+			Event (BT_EVENT_CODE_READ_REMOTE_VERSION_INFORMATION_COMPLETE,
+			       Info, 8);
+		} else {
+			Info[3] = 0xFF;				// 3 and 5 slot packets, ...
+			Event (BT_EVENT_CODE_READ_REMOTE_SUPPORTED_FEATURES_COMPLETE,
+			       Info, sizeof Info);
+		}
+		} break;
+
+	default:
+		LOG_DEBUG ("SIM: Unknown command 0x%04X\r\n", (unsigned) nOpCode);
+		CommandComplete (nOpCode, BT_ERROR_UNKNOWN_HCI_COMMAND);
+		break;
+	}
+}
+
+void CBTSimController::HostCompleted (const u8 *pParams, unsigned nLength)
+{
+	// number of handles, the handles, then their counts
+	unsigned nHandles = nLength > 0 ? pParams[0] : 0;
+	if (nLength < 1 || nLength < 1 + nHandles*4) {
+		LOG_DEBUG ("SIM: Short completion ignored\r\n");
+		return;
+	}
+
+	spin_lock ((void *) &m_nLock);
+	for (unsigned i = 0; i < nHandles; i++) {
+		m_nHostACLFree += GET16 (pParams + 1 + nHandles*2 + i*2);
+	}
+	// what was read before flow control was on may be reported too
+	if (m_nHostACLFree > m_nHostACLPackets) {
+		m_nHostACLFree = m_nHostACLPackets;
+	}
+	spin_unlock ((void *) &m_nLock);
+}
+
+void CBTSimController::CommandComplete (u16 nOpCode, u8 nStatus,
+					const void *pParams, unsigned nLength)
+{
+	u8 Params[BT_MAX_HCI_EVENT_SIZE-2];
+	assert (4 + nLength <= sizeof Params);
+
+	Params[0] = m_nCommandPackets;
+	PUT16 (Params+1, nOpCode);
+	Params[3] = nStatus;
+	if (nLength > 0) {
+		memcpy (Params+4, pParams, nLength);
+	}
+	Event (BT_EVENT_CODE_COMMAND_COMPLETE, Params, 4 + nLength);
+}
+
+void CBTSimController::CommandStatus (u16 nOpCode, u8 nStatus)
+{
+	u8 Params[4];
+	Params[0] = nStatus;
+	Params[1] = m_nCommandPackets;
+	PUT16 (Params+2, nOpCode);
+	Event (BT_EVENT_CODE_COMMAND_STATUS, Params, sizeof Params);
+}
+
+void CBTSimController::Event (u8 nEventCode, const void *pParams, unsigned nLength,
+			      unsigned nDelay)
+{
+	assert (nLength <= 255);
+
+	u8 Header[3];
+	Header[0] = HCI_PACKET_EVENT;
+	Header[1] = nEventCode;
+	Header[2] = (u8) nLength;
+	Queue (Header, sizeof Header, pParams, nLength, m_nResponseDelay + nDelay);
+}
+
+void CBTSimController::Queue (const u8 *pHeader, unsigned nHeaderLength,
+			      const void *pData, unsigned nLength, unsigned nDelay)
+{
+	QueueAt (pHeader, nHeaderLength, pData, nLength, getClockTicks () + nDelay);
+}
+
+void CBTSimController::QueueAt (const u8 *pHeader, unsigned nHeaderLength,
+				const void *pData, unsigned nLength, unsigned nDue)
+{
+	TBTSimPacket *pPacket = (TBTSimPacket *)
+		malloc (sizeof (TBTSimPacket) + nHeaderLength + nLength);
+	assert (pPacket != 0);
+
+	pPacket->nDue = nDue;
+	pPacket->nLength = nHeaderLength + nLength;
+	memcpy (pPacket->Data, pHeader, nHeaderLength);
+	if (nLength > 0) {
+		memcpy (pPacket->Data+nHeaderLength, pData, nLength);
+	}
+
+	spin_lock ((void *) &m_nLock);
+
+	// keep the order of packets due at the same time, never pass the
+	// packet which is partially read
+	TBTSimPacket **ppLink = &m_pFirst;
+	if (*ppLink != 0 && m_nReadOffset > 0) {
+		ppLink = &(*ppLink)->pNext;
+	}
+	while (*ppLink != 0 && (int) (pPacket->nDue - (*ppLink)->nDue) >= 0) {
+		ppLink = &(*ppLink)->pNext;
+	}
+	pPacket->pNext = *ppLink;
+	*ppLink = pPacket;
+
+	spin_unlock ((void *) &m_nLock);
+}
+
+void CBTSimController::Inquiry (void)
+{
+	unsigned nPeers = __atomic_load_n (&m_nPeers, __ATOMIC_ACQUIRE);
+	unsigned nStep = m_nInquiryTime / (nPeers + 1);
+
+	for (unsigned i = 0; i < nPeers; i++) {
+		CBTSimPeer *pPeer = m_pPeer[i];
+		if (pPeer->GetConnectionHandle () != 0) {
+			continue;			// connected devices do not scan
+		}
+
+		// one response per event, the fields are arrays in the event
+		u8 Params[1+INQUIRY_RESP_SIZE];
+		memset (Params, 0, sizeof Params);
+		Params[0] = 1;
+		memcpy (Params+1, pPeer->GetBDAddress (), BT_BD_ADDR_SIZE);
+		Params[1+BT_BD_ADDR_SIZE] = 0x01;		// page scan R1
+		memcpy (Params+1+BT_BD_ADDR_SIZE+1+2, pPeer->GetClassOfDevice (),
+			BT_CLASS_SIZE);
+		Event (BT_EVENT_CODE_INQUIRY_RESULT, Params, sizeof Params, nStep * (i+1));
+	}
+
+	u8 nStatus = BT_STATUS_SUCCESS;
+	Event (BT_EVENT_CODE_INQUIRY_COMPLETE, &nStatus, 1, m_nInquiryTime);
+}
+
+void CBTSimController::ConnectionComplete (CBTSimPeer *pPeer, const u8 *pBDAddr, u8 nStatus)
+{
+	u8 Params[11];
+	memset (Params, 0, sizeof Params);
+
+	if (   nStatus == BT_STATUS_SUCCESS
+	    && pPeer->GetConnectionHandle () != 0) {
+		nStatus = BT_ERROR_ACL_CONNECTION_ALREADY_EXISTS;
+	}
+
+	if (nStatus == BT_STATUS_SUCCESS) {
+		u16 nHandle = m_nNextHandle++;
+		if (m_nNextHandle > 0xEFF) {
+			m_nNextHandle = BT_SIM_FIRST_HANDLE;
+		}
+		pPeer->Attach (this, nHandle);
+		PUT16 (Params+1, nHandle);
+	}
+
+	Params[0] = nStatus;
+	memcpy (Params+3, pBDAddr, BT_BD_ADDR_SIZE);
+	Params[9] = LINK_TYPE_ACL_CONNECTION;
+	Params[10] = ENCRYPTION_DISABLED;
+	Event (BT_EVENT_CODE_CONNECTION_COMPLETE, Params, sizeof Params);
+}
+
+void CBTSimController::AuthenticationComplete (CBTSimPeer *pPeer, u8 nStatus)
+{
+	u8 Params[3];
+	Params[0] = pPeer != 0 ? nStatus : BT_ERROR_NO_CONNECTION;
+	PUT16 (Params+1, pPeer != 0 ? pPeer->GetConnectionHandle () : 0);
+	Event (BT_EVENT_CODE_AUTHENTICATION_COMPLETE, Params, sizeof Params);
+}
+
+CBTSimPeer *CBTSimController::GetPeer (const u8 *pBDAddr) const
+{
+	unsigned nPeers = __atomic_load_n (&m_nPeers, __ATOMIC_ACQUIRE);
+	for (unsigned i = 0; i < nPeers; i++) {
+		if (memcmp (m_pPeer[i]->GetBDAddress (), pBDAddr, BT_BD_ADDR_SIZE) == 0) {
+			return m_pPeer[i];
+		}
+	}
+
+	return 0;
+}
+
+CBTSimPeer *CBTSimController::GetPeer (u16 nHandle) const
+{
+	unsigned nPeers = __atomic_load_n (&m_nPeers, __ATOMIC_ACQUIRE);
+	for (unsigned i = 0; i < nPeers; i++) {
+		if (m_pPeer[i]->GetConnectionHandle () == nHandle) {
+			return m_pPeer[i];
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,1271 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Host Simulation Bluetooth Peer Device Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btsimpeer.h>
+#include <bluetooth/btsimcontroller.h>
+#include <bluetooth/btdata.h>
+#include <bluetooth/btl2cap.h>
+#include <bluetooth/btl2capertm.h>
+#include <bluetooth/btcrc.h>
+#include <mutex.h>
+#include <task.h>
+#include <logger.h>
+#include <assert.h>
+#include <string.h>
+
+// L2CAP signalling codes
+#define SIG_COMMAND_REJECT		0x01
+#define SIG_CONNECTION_REQUEST		0x02
+#define SIG_CONNECTION_RESPONSE		0x03
+#define SIG_CONFIGURE_REQUEST		0x04
+#define SIG_CONFIGURE_RESPONSE		0x05
+#define SIG_DISCONNECTION_REQUEST	0x06
+#define SIG_DISCONNECTION_RESPONSE	0x07
+#define SIG_ECHO_REQUEST		0x08
+#define SIG_ECHO_RESPONSE		0x09
+#define SIG_INFORMATION_REQUEST		0x0A
+#define SIG_INFORMATION_RESPONSE	0x0B
+
+#define CONNECTION_SUCCESSFUL		0x0000
+#define CONNECTION_PSM_NOT_SUPPORTED	0x0002
+#define CONNECTION_NO_RESOURCES		0x0004
+
+#define CONFIGURATION_SUCCESSFUL	0x0000
+#define CONFIGURATION_UNACCEPTABLE	0x0001
+
+#define INFORMATION_NOT_SUPPORTED	0x0001
+
+#define HID_PSM_CONTROL			0x0011
+#define HID_PSM_INTERRUPT		0x0013
+
+// HIDP transaction header
+#define HIDP_HANDSHAKE			0x00
+#define HIDP_GET_REPORT			0x40
+#define HIDP_SET_REPORT			0x50
+#define HIDP_GET_PROTOCOL		0x60
+#define HIDP_SET_PROTOCOL		0x70
+#define HIDP_DATA_INPUT			0xA1
+
+#define HIDP_ERR_UNSUPPORTED_REQUEST	0x03
+
+#define MOUSE_REPORT_ID			0x02
+#define KEYBOARD_REPORT_ID		0x01
+
+#define SDP_PSM				0x0001
+#define SDP_ERROR_RESPONSE		0x01
+#define SDP_SEARCH_ATTRIBUTE_REQUEST	0x06
+#define SDP_SEARCH_ATTRIBUTE_RESPONSE	0x07
+#define SDP_INVALID_REQUEST_SYNTAX	0x0003
+#define SDP_INVALID_CONTINUATION	0x0005
+#define SDP_HID_DESCRIPTOR_LIST		0x0206
+#define SDP_SEQUENCE_16			0x36		// sequence, 2 byte size
+#define SDP_UINT_8			0x08
+#define SDP_UINT_16			0x09
+#define SDP_TEXT_16			0x26
+#define SDP_REPORT_DESCRIPTOR		0x22
+
+#define PUT16(p, v)	((p)[0] = (u8) (v), (p)[1] = (u8) ((v) >> 8))
+#define GET16(p)	((u16) ((p)[0] | (p)[1] << 8))
+#define PUT16BE(p, v)	((p)[0] = (u8) ((v) >> 8), (p)[1] = (u8) (v))
+#define GET16BE(p)	((u16) ((p)[0] << 8 | (p)[1]))
+
+// five buttons, x, y and wheel in the boot layout
+static const u8 MouseDescriptor[] =
+{
+	0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, MOUSE_REPORT_ID, 0x09, 0x01, 0xA1, 0x00,
+	0x05, 0x09, 0x19, 0x01, 0x29, 0x05, 0x15, 0x00, 0x25, 0x01, 0x95, 0x05,
+	0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x03, 0x81, 0x01,
+	0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x38, 0x15, 0x81, 0x25, 0x7F,
+	0x75, 0x08, 0x95, 0x03, 0x81, 0x06, 0xC0, 0xC0
+};
+
+static const u8 KeyboardDescriptor[] =
+{
+	0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, KEYBOARD_REPORT_ID,
+	0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01,
+	0x95, 0x08, 0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+	0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+	0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+	0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00,
+	0x29, 0x65, 0x81, 0x00, 0xC0
+};
+
+CBTSimPeer::CBTSimPeer (const u8 *pBDAddr, TBTCOD ClassOfDevice, const char *pName)
+:	m_ClassOfDevice (ClassOfDevice),
+	m_pController (0),
+	m_nHandle (0),
+	m_nIdentifier (0),
+	m_nNextCID (BT_CID_DYNAMICALLY_ALLOCATED),
+	m_nMode (BT_L2CAP_MODE_BASIC),
+	m_bIgnoreSignalling (FALSE),
+	m_nFrameLength (0)
+{
+	assert (pBDAddr != 0);
+	memcpy (m_BDAddr, pBDAddr, BT_BD_ADDR_SIZE);
+
+	assert (pName != 0);
+	strncpy (m_Name, pName, BT_NAME_SIZE);
+
+	strcpy (m_PIN, "0000");
+
+	memset (m_Channels, 0, sizeof m_Channels);
+}
+
+CBTSimPeer::~CBTSimPeer (void)
+{
+	m_pController = 0;
+}
+
+const u8 *CBTSimPeer::GetBDAddress (void) const
+{
+	return m_BDAddr;
+}
+
+const u8 *CBTSimPeer::GetClassOfDevice (void) const
+{
+	return (const u8 *) &m_ClassOfDevice;
+}
+
+const char *CBTSimPeer::GetName (void) const
+{
+	return m_Name;
+}
+
+const char *CBTSimPeer::GetPIN (void) const
+{
+	return m_PIN;
+}
+
+void CBTSimPeer::SetPIN (const char *pPIN)
+{
+	assert (pPIN != 0);
+	strncpy (m_PIN, pPIN, BT_MAX_PIN_CODE_SIZE);
+	m_PIN[BT_MAX_PIN_CODE_SIZE] = '\0';
+}
+
+u16 CBTSimPeer::GetConnectionHandle (void) const
+{
+	return m_nHandle;
+}
+
+boolean CBTSimPeer::IsChannelOpen (u16 nPSM) const
+{
+	return GetChannelByPSM (nPSM) != 0;
+}
+
+void CBTSimPeer::SetIgnoreSignalling (boolean bIgnore)
+{
+	m_bIgnoreSignalling = bIgnore;
+}
+
+void CBTSimPeer::Attach (CBTSimController *pController, u16 nHandle)
+{
+	assert (pController != 0);
+	assert (nHandle != 0);
+
+	m_pController = pController;
+	m_nFrameLength = 0;
+	memset (m_Channels, 0, sizeof m_Channels);
+	m_nHandle = nHandle;
+}
+
+void CBTSimPeer::Detach (void)
+{
+	m_nHandle = 0;
+	memset (m_Channels, 0, sizeof m_Channels);
+	m_nFrameLength = 0;
+}
+
+void CBTSimPeer::ReceiveACL (u8 nBoundaryFlag, const u8 *pBuffer, unsigned nLength)
+{
+	assert (pBuffer != 0);
+
+	if (nBoundaryFlag != BT_CONTINUING_FRAGMENT_PACKET) {
+		m_nFrameLength = 0;
+	} else if (m_nFrameLength == 0) {
+		LOG_DEBUG ("SIM: Continuing fragment without start\r\n");
+		return;
+	}
+
+	if (m_nFrameLength + nLength > BT_SIM_MAX_FRAME) {
+		LOG_DEBUG ("SIM: L2CAP frame too long\r\n");
+		m_nFrameLength = 0;
+		return;
+	}
+
+	memcpy (m_Frame+m_nFrameLength, pBuffer, nLength);
+	m_nFrameLength += nLength;
+
+	if (   m_nFrameLength >= 4
+	    && m_nFrameLength >= 4u + GET16 (m_Frame)) {
+		Receive (m_Frame, m_nFrameLength);
+		m_nFrameLength = 0;
+	}
+}
+
+void CBTSimPeer::Poll (unsigned)
+{
+}
+
+boolean CBTSimPeer::AcceptPSM (u16)
+{
+	return FALSE;
+}
+
+void CBTSimPeer::ChannelOpened (u16)
+{
+}
+
+void CBTSimPeer::ChannelData (u16, const u8 *, unsigned)
+{
+}
+
+void CBTSimPeer::ChannelFrame (TBTSimChannel *, const u8 *, unsigned)
+{
+}
+
+boolean CBTSimPeer::SendChannel (u16 nPSM, const void *pData, unsigned nLength)
+{
+	TBTSimChannel *pChannel = GetChannelByPSM (nPSM);
+	if (   pChannel == 0
+	    || m_pController == 0
+	    || nLength > BT_SIM_PEER_MTU) {
+		return FALSE;
+	}
+
+	u8 Frame[4+BT_SIM_PEER_MTU];
+	PUT16 (Frame, nLength);
+	PUT16 (Frame+2, pChannel->RemoteCID);
+	memcpy (Frame+4, pData, nLength);
+	m_pController->SendACL (this, Frame, 4 + nLength);
+
+	return TRUE;
+}
+
+void CBTSimPeer::SendFrame (const u8 *pFrame, unsigned nLength)
+{
+	if (m_pController != 0) {
+		m_pController->SendACL (this, pFrame, nLength);
+	}
+}
+
+void CBTSimPeer::SetChannelMode (u8 nMode)
+{
+	m_nMode = nMode;
+}
+
+void CBTSimPeer::Receive (const u8 *pFrame, unsigned nLength)
+{
+	unsigned nPayload = GET16 (pFrame);
+	u16 nCID = GET16 (pFrame+2);
+	if (nLength < 4 + nPayload) {
+		return;
+	}
+
+	if (nCID == BT_CID_SIGNALLING_CHANNEL) {
+		if (!m_bIgnoreSignalling) {
+			Signalling (pFrame+4, nPayload);
+		}
+		return;
+	}
+
+	TBTSimChannel *pChannel = GetChannel (nCID);
+	if (   pChannel == 0
+	    || pChannel->State != BTSimChannelOpen) {
+		LOG_DEBUG ("SIM: Data for unknown CID 0x%04X\r\n", (unsigned) nCID);
+		return;
+	}
+
+	if (pChannel->Mode != BT_L2CAP_MODE_BASIC) {
+		ChannelFrame (pChannel, pFrame, 4 + nPayload);
+		return;
+	}
+
+	ChannelData (pChannel->PSM, pFrame+4, nPayload);
+}
+
+void CBTSimPeer::Signalling (const u8 *pCommand, unsigned nLength)
+{
+	// one C-frame may carry several commands
+	while (nLength >= 4) {
+		u8 nCode = pCommand[0];
+		u8 nIdentifier = pCommand[1];
+		unsigned nDataLength = GET16 (pCommand+2);
+		const u8 *pData = pCommand+4;
+		if (4 + nDataLength > nLength) {
+			break;
+		}
+
+		u8 Response[8];
+		TBTSimChannel *pChannel;
+
+		switch (nCode) {
+		case SIG_CONNECTION_REQUEST: {
+			u16 nPSM = GET16 (pData);
+			u16 nSourceCID = GET16 (pData+2);
+			u16 nResult = CONNECTION_PSM_NOT_SUPPORTED;
+
+			pChannel = 0;
+			if (AcceptPSM (nPSM)) {
+				nResult = CONNECTION_NO_RESOURCES;
+				pChannel = GetChannel (BT_CID_NULL_IDENTIFIER);
+			}
+			if (pChannel != 0) {
+				pChannel->State = BTSimChannelConfig;
+				pChannel->PSM = nPSM;
+				pChannel->LocalCID = m_nNextCID++;
+				pChannel->RemoteCID = nSourceCID;
+				pChannel->OutConfigDone = FALSE;
+				pChannel->InConfigDone = FALSE;
+				pChannel->Mode = m_nMode;
+				pChannel->TxWindow = 0;
+				pChannel->MPS = BT_SIM_PEER_MTU;
+				nResult = CONNECTION_SUCCESSFUL;
+			}
+
+			PUT16 (Response, pChannel != 0 ? pChannel->LocalCID : 0);
+			PUT16 (Response+2, nSourceCID);
+			PUT16 (Response+4, nResult);
+			PUT16 (Response+6, 0);
+			SendSignal (SIG_CONNECTION_RESPONSE, nIdentifier, Response, 8);
+
+			if (pChannel != 0) {
+				SendConfigRequest (pChannel);
+			}
+			} break;
+
+		case SIG_CONFIGURE_REQUEST: {
+			// options are accepted as proposed, but for a mode we lack
+			pChannel = GetChannel (GET16 (pData));
+			if (   pChannel == 0
+			    || pChannel->State == BTSimChannelClosed) {
+				PUT16 (Response, 0x0002);	// invalid CID
+				SendSignal (SIG_COMMAND_REJECT, nIdentifier, Response, 2);
+				break;
+			}
+			// echo the accepted options like most devices do
+			u8 ConfigResponse[6+BT_L2CAP_MAX_OPTION_LEN];
+			unsigned nOptions = nDataLength - 4;
+			if (nOptions > BT_L2CAP_MAX_OPTION_LEN) {
+				nOptions = BT_L2CAP_MAX_OPTION_LEN;
+			}
+			memcpy (ConfigResponse+6, pData+4, nOptions);
+			u16 nConfigResult;
+			nOptions = ConfigOptions (pChannel, ConfigResponse+6, nOptions,
+						  &nConfigResult);
+			PUT16 (ConfigResponse, pChannel->RemoteCID);
+			PUT16 (ConfigResponse+2, 0);
+			PUT16 (ConfigResponse+4, nConfigResult);
+			SendSignal (SIG_CONFIGURE_RESPONSE, nIdentifier,
+				    ConfigResponse, 6 + nOptions);
+			if (nConfigResult == CONFIGURATION_SUCCESSFUL) {
+				pChannel->InConfigDone = TRUE;
+				CheckOpen (pChannel);
+			}
+			} break;
+
+		case SIG_CONFIGURE_RESPONSE:
+			pChannel = GetChannel (GET16 (pData));
+			if (   pChannel == 0
+			    || pChannel->State == BTSimChannelClosed) {
+				break;
+			}
+			if (GET16 (pData+4) == CONFIGURATION_SUCCESSFUL) {
+				pChannel->OutConfigDone = TRUE;
+				CheckOpen (pChannel);
+			} else if (GET16 (pData+4) == CONFIGURATION_UNACCEPTABLE) {
+				// the host wants another mode, ask again with it
+				for (unsigned i = 6; i + 3 <= nDataLength; i += 2 + pData[i+1]) {
+					if ((pData[i] & 0x7F) == BT_L2CAP_OPTION_RFC) {
+						pChannel->Mode = pData[i+2];
+						SendConfigRequest (pChannel);
+						break;
+					}
+				}
+			}
+			break;
+
+		case SIG_DISCONNECTION_REQUEST:
+			pChannel = GetChannel (GET16 (pData));
+			memcpy (Response, pData, 4);
+			SendSignal (SIG_DISCONNECTION_RESPONSE, nIdentifier, Response, 4);
+			if (   pChannel != 0
+			    && pChannel->State != BTSimChannelClosed) {
+				memset (pChannel, 0, sizeof *pChannel);
+			}
+			break;
+
+		case SIG_ECHO_REQUEST:
+			SendSignal (SIG_ECHO_RESPONSE, nIdentifier, pData, nDataLength);
+			break;
+
+		case SIG_INFORMATION_REQUEST:
+			memcpy (Response, pData, 2);
+			PUT16 (Response+2, INFORMATION_NOT_SUPPORTED);
+			SendSignal (SIG_INFORMATION_RESPONSE, nIdentifier, Response, 4);
+			break;
+
+		case SIG_COMMAND_REJECT:
+		case SIG_DISCONNECTION_RESPONSE:
+		case SIG_ECHO_RESPONSE:
+		case SIG_INFORMATION_RESPONSE:
+			break;
+
+		default:
+			PUT16 (Response, 0x0000);		// command not understood
+			SendSignal (SIG_COMMAND_REJECT, nIdentifier, Response, 2);
+			break;
+		}
+
+		pCommand += 4 + nDataLength;
+		nLength -= 4 + nDataLength;
+	}
+}
+
+void CBTSimPeer::SendSignal (u8 nCode, u8 nIdentifier, const u8 *pData, unsigned nLength)
+{
+	if (m_pController == 0) {
+		return;
+	}
+
+	u8 Frame[8+BT_L2CAP_MIN_SIG_MTU_LEN];
+	if (nLength > BT_L2CAP_MIN_SIG_MTU_LEN) {
+		nLength = BT_L2CAP_MIN_SIG_MTU_LEN;
+	}
+
+	PUT16 (Frame, 4 + nLength);
+	PUT16 (Frame+2, BT_CID_SIGNALLING_CHANNEL);
+	Frame[4] = nCode;
+	Frame[5] = nIdentifier;
+	PUT16 (Frame+6, nLength);
+	memcpy (Frame+8, pData, nLength);
+	m_pController->SendACL (this, Frame, 8 + nLength);
+}
+
+void CBTSimPeer::SendConfigRequest (TBTSimChannel *pChannel)
+{
+	u8 Request[8+2+BT_L2CAP_OPTION_RFC_LEN];
+	unsigned nLength = 8;
+	PUT16 (Request, pChannel->RemoteCID);
+	PUT16 (Request+2, 0);				// no continuation
+	Request[4] = BT_L2CAP_OPTION_MTU;
+	Request[5] = 2;
+	PUT16 (Request+6, pChannel->Mode != BT_L2CAP_MODE_BASIC
+			  ? BT_SIM_PEER_SDU_MTU : BT_SIM_PEER_MTU);
+
+	if (pChannel->Mode != BT_L2CAP_MODE_BASIC) {
+		u8 *pRFC = Request+8;
+		pRFC[0] = BT_L2CAP_OPTION_RFC;
+		pRFC[1] = BT_L2CAP_OPTION_RFC_LEN;
+		pRFC[2] = pChannel->Mode;
+		pRFC[3] = pChannel->Mode == BT_L2CAP_MODE_ERTM ? BT_SIM_ERTM_WINDOW : 0;
+		pRFC[4] = pChannel->Mode == BT_L2CAP_MODE_ERTM ? BT_SIM_ERTM_MAX_TRANSMIT : 0;
+		PUT16 (pRFC+5, 0);			// timeouts come with the response
+		PUT16 (pRFC+7, 0);
+		PUT16 (pRFC+9, BT_SIM_PEER_MTU);
+		nLength += 2+BT_L2CAP_OPTION_RFC_LEN;
+	}
+
+	if (++m_nIdentifier == 0) {
+		m_nIdentifier = 1;
+	}
+	SendSignal (SIG_CONFIGURE_REQUEST, m_nIdentifier, Request, nLength);
+}
+
+unsigned CBTSimPeer::ConfigOptions (
+	TBTSimChannel *pChannel,
+	u8 *pOptions,
+	unsigned nLength,
+	u16 *pResult)
+{
+	*pResult = CONFIGURATION_SUCCESSFUL;
+
+	for (unsigned i = 0; i + 2 <= nLength; i += 2 + pOptions[i+1]) {
+		u8 *pOption = pOptions+i;
+		if (   (pOption[0] & 0x7F) != BT_L2CAP_OPTION_RFC
+		    || pOption[1] < BT_L2CAP_OPTION_RFC_LEN
+		    || i + 2 + pOption[1] > nLength) {
+			continue;
+		}
+
+		u8 nMode = pOption[2];
+		if (   nMode != BT_L2CAP_MODE_BASIC
+		    && m_nMode == BT_L2CAP_MODE_BASIC) {
+			// only the refused option goes back, with what we support
+			pOption[2] = BT_L2CAP_MODE_BASIC;
+			memmove (pOptions, pOption, 2 + BT_L2CAP_OPTION_RFC_LEN);
+			*pResult = CONFIGURATION_UNACCEPTABLE;
+			return 2 + BT_L2CAP_OPTION_RFC_LEN;
+		}
+
+		// the host's receive side limits what we send
+		pChannel->Mode = nMode;
+		pChannel->TxWindow = pOption[3];
+		pChannel->MPS = GET16 (pOption+9);
+		if (pChannel->MPS == 0 || pChannel->MPS > BT_SIM_PEER_MTU) {
+			pChannel->MPS = BT_SIM_PEER_MTU;
+		}
+		if (nMode == BT_L2CAP_MODE_ERTM) {
+			PUT16 (pOption+5, BT_SIM_ERTM_RETRANS);
+			PUT16 (pOption+7, BT_SIM_ERTM_MONITOR);
+		}
+	}
+
+	return nLength;
+}
+
+void CBTSimPeer::CheckOpen (TBTSimChannel *pChannel)
+{
+	if (   pChannel->State == BTSimChannelConfig
+	    && pChannel->InConfigDone
+	    && pChannel->OutConfigDone) {
+		pChannel->State = BTSimChannelOpen;
+		ChannelOpened (pChannel->PSM);
+	}
+}
+
+TBTSimChannel *CBTSimPeer::GetChannel (u16 nLocalCID)
+{
+	for (unsigned i = 0; i < BT_SIM_MAX_CHANNELS; i++) {
+		if (m_Channels[i].LocalCID == nLocalCID) {
+			return &m_Channels[i];
+		}
+	}
+
+	return 0;
+}
+
+TBTSimChannel *CBTSimPeer::GetChannelByPSM (u16 nPSM) const
+{
+	for (unsigned i = 0; i < BT_SIM_MAX_CHANNELS; i++) {
+		if (   m_Channels[i].State == BTSimChannelOpen
+		    && m_Channels[i].PSM == nPSM) {
+			return (TBTSimChannel *) &m_Channels[i];
+		}
+	}
+
+	return 0;
+}
+
+CBTSimHIDPeer::CBTSimHIDPeer (const u8 *pBDAddr, TBTCOD ClassOfDevice, const char *pName,
+			      const u8 *pDescriptor, unsigned nDescriptorLength)
+:	CBTSimPeer (pBDAddr, ClassOfDevice, pName),
+	m_nReportsSent (0),
+	m_nDescriptorLength (0)
+{
+	SetReportDescriptor (pDescriptor, nDescriptorLength);
+}
+
+CBTSimHIDPeer::~CBTSimHIDPeer (void)
+{
+}
+
+unsigned CBTSimHIDPeer::GetReportsSent (void) const
+{
+	return m_nReportsSent;
+}
+
+void CBTSimHIDPeer::SetReportDescriptor (const u8 *pDescriptor, unsigned nLength)
+{
+	assert (nLength <= BT_SIM_MAX_DESCRIPTOR);
+
+	m_nDescriptorLength = pDescriptor != 0 ? nLength : 0;
+	if (m_nDescriptorLength > 0) {
+		memcpy (m_Descriptor, pDescriptor, nLength);
+	}
+}
+
+boolean CBTSimHIDPeer::SendInput (const u8 *pReport, unsigned nLength)
+{
+	u8 Report[1+BT_SIM_PEER_MTU];
+	if (nLength >= sizeof Report) {
+		return FALSE;
+	}
+
+	Report[0] = HIDP_DATA_INPUT;
+	memcpy (Report+1, pReport, nLength);
+
+	return SendReport (Report, 1+nLength);
+}
+
+boolean CBTSimHIDPeer::AcceptPSM (u16 nPSM)
+{
+	return    nPSM == HID_PSM_CONTROL
+	       || nPSM == HID_PSM_INTERRUPT
+	       || (nPSM == SDP_PSM && m_nDescriptorLength > 0);
+}
+
+void CBTSimHIDPeer::ChannelData (u16 nPSM, const u8 *pData, unsigned nLength)
+{
+	if (nPSM == SDP_PSM) {
+		ServiceDiscovery (pData, nLength);
+
+		return;
+	}
+
+	if (   nPSM != HID_PSM_CONTROL
+	    || nLength == 0) {
+		return;
+	}
+
+	u8 nResult;
+	switch (pData[0] & 0xF0) {
+	case HIDP_SET_REPORT:
+	case HIDP_SET_PROTOCOL:
+		nResult = HIDP_HANDSHAKE;		// successful
+		break;
+
+	case HIDP_GET_REPORT:
+	case HIDP_GET_PROTOCOL:
+		nResult = HIDP_HANDSHAKE | HIDP_ERR_UNSUPPORTED_REQUEST;
+		break;
+
+	default:
+		return;
+	}
+
+	SendChannel (HID_PSM_CONTROL, &nResult, 1);
+}
+
+// answers a service search attribute request with the HID descriptor list
+// of the only record, whatever was searched for, in chunks
+void CBTSimHIDPeer::ServiceDiscovery (const u8 *pRequest, unsigned nLength)
+{
+	u8 Response[5+2+BT_SIM_SDP_CHUNK+3];
+	u16 nError = SDP_INVALID_REQUEST_SYNTAX;
+
+	// search pattern, maximum attribute byte count, attribute ID list
+	// and the continuation state, where we keep the offset
+	const u8 *p = pRequest + 5;
+	const u8 *pEnd = pRequest + nLength;
+	unsigned nMaximum = 0;
+	unsigned nOffset = 0;
+	for (unsigned i = 0; i < 3 && nLength >= 5 && p < pEnd; i++) {
+		if (i == 1) {
+			if (pEnd - p < 2) {
+				break;
+			}
+			nMaximum = GET16BE (p);
+			p += 2;
+		} else if (*p == 0x35 && pEnd - p >= 2) {	// sequence, 1 byte size
+			p += 2 + p[1];
+		} else if (*p == SDP_SEQUENCE_16 && pEnd - p >= 3) {
+			p += 3 + GET16BE (p+1);
+		} else {
+			break;
+		}
+	}
+	if (   nLength >= 5
+	    && pRequest[0] == SDP_SEARCH_ATTRIBUTE_REQUEST
+	    && p < pEnd
+	    && pEnd - p == 1 + *p) {
+		nError = 0;
+		if (*p == 2) {
+			nOffset = GET16BE (p+1);
+		} else if (*p != 0) {
+			nError = SDP_INVALID_CONTINUATION;
+		}
+	}
+
+	// sequence of records { record { ID, sequence { sequence { type, text } } } }
+	u8 Lists[3+3+3+3+3+2+3+BT_SIM_MAX_DESCRIPTOR];
+	unsigned nEntry = 2 + 3 + m_nDescriptorLength;
+	unsigned nRecord = 3 + 3 + 3 + nEntry;
+	u8 *q = Lists;
+	*q++ = SDP_SEQUENCE_16; PUT16BE (q, 3 + nRecord); q += 2;
+	*q++ = SDP_SEQUENCE_16; PUT16BE (q, nRecord); q += 2;
+	*q++ = SDP_UINT_16; PUT16BE (q, SDP_HID_DESCRIPTOR_LIST); q += 2;
+	*q++ = SDP_SEQUENCE_16; PUT16BE (q, 3 + nEntry); q += 2;
+	*q++ = SDP_SEQUENCE_16; PUT16BE (q, nEntry); q += 2;
+	*q++ = SDP_UINT_8; *q++ = SDP_REPORT_DESCRIPTOR;
+	*q++ = SDP_TEXT_16; PUT16BE (q, m_nDescriptorLength); q += 2;
+	memcpy (q, m_Descriptor, m_nDescriptorLength);
+	q += m_nDescriptorLength;
+	unsigned nTotal = q - Lists;
+	if (nError == 0 && nOffset > nTotal) {
+		nError = SDP_INVALID_CONTINUATION;
+	}
+
+	memcpy (Response+1, pRequest+1, 2);		// transaction ID
+	if (nError != 0) {
+		Response[0] = SDP_ERROR_RESPONSE;
+		PUT16BE (Response+3, 2);
+		PUT16BE (Response+5, nError);
+		SendChannel (SDP_PSM, Response, 7);
+
+		return;
+	}
+
+	unsigned nCount = nTotal - nOffset;
+	if (nCount > nMaximum) {
+		nCount = nMaximum;
+	}
+	if (nCount > BT_SIM_SDP_CHUNK) {
+		nCount = BT_SIM_SDP_CHUNK;
+	}
+
+	Response[0] = SDP_SEARCH_ATTRIBUTE_RESPONSE;
+	PUT16BE (Response+5, nCount);
+	memcpy (Response+7, Lists + nOffset, nCount);
+	q = Response + 7 + nCount;
+	nOffset += nCount;
+	if (nOffset < nTotal) {
+		*q++ = 2;
+		PUT16BE (q, nOffset);
+		q += 2;
+	} else {
+		*q++ = 0;
+	}
+	PUT16BE (Response+3, q - Response - 5);
+
+	SendChannel (SDP_PSM, Response, q - Response);
+}
+
+boolean CBTSimHIDPeer::SendReport (const u8 *pReport, unsigned nLength)
+{
+	if (!SendChannel (HID_PSM_INTERRUPT, pReport, nLength)) {
+		return FALSE;
+	}
+
+	m_nReportsSent++;
+
+	return TRUE;
+}
+
+CBTSimMouse::CBTSimMouse (const u8 *pBDAddr, const char *pName)
+:	CBTSimHIDPeer (pBDAddr, BT_CLASS_MOUSE, pName,
+		       MouseDescriptor, sizeof MouseDescriptor)
+{
+}
+
+CBTSimMouse::~CBTSimMouse (void)
+{
+}
+
+boolean CBTSimMouse::Move (signed char nX, signed char nY, signed char nWheel, u8 nButtons)
+{
+	u8 Report[6];
+	Report[0] = HIDP_DATA_INPUT;
+	Report[1] = MOUSE_REPORT_ID;
+	Report[2] = nButtons;
+	Report[3] = (u8) nX;
+	Report[4] = (u8) nY;
+	Report[5] = (u8) nWheel;
+
+	return SendReport (Report, sizeof Report);
+}
+
+CBTSimKeyboard::CBTSimKeyboard (const u8 *pBDAddr, const char *pName)
+:	CBTSimHIDPeer (pBDAddr, BT_CLASS_KEYBOARD, pName,
+		       KeyboardDescriptor, sizeof KeyboardDescriptor)
+{
+}
+
+CBTSimKeyboard::~CBTSimKeyboard (void)
+{
+}
+
+boolean CBTSimKeyboard::KeyPress (u8 nModifiers, u8 nKeyCode)
+{
+	u8 Report[10];
+	memset (Report, 0, sizeof Report);
+	Report[0] = HIDP_DATA_INPUT;
+	Report[1] = KEYBOARD_REPORT_ID;
+	Report[2] = nModifiers;
+	Report[4] = nKeyCode;
+
+	if (!SendReport (Report, sizeof Report)) {
+		return FALSE;
+	}
+
+	Report[2] = 0;
+	Report[4] = 0;
+
+	return SendReport (Report, sizeof Report);
+}
+
+CBTSimEchoPeer::CBTSimEchoPeer (const u8 *pBDAddr, const char *pName)
+:	CBTSimPeer (pBDAddr, BT_CLASS_DESKTOP_COMPUTER, pName),
+	m_nBytesEchoed (0)
+{
+}
+
+CBTSimEchoPeer::~CBTSimEchoPeer (void)
+{
+}
+
+unsigned CBTSimEchoPeer::GetBytesEchoed (void) const
+{
+	return m_nBytesEchoed;
+}
+
+boolean CBTSimEchoPeer::AcceptPSM (u16 nPSM)
+{
+	return nPSM == BT_SIM_ECHO_PSM;
+}
+
+void CBTSimEchoPeer::ChannelData (u16 nPSM, const u8 *pData, unsigned nLength)
+{
+	if (SendChannel (nPSM, pData, nLength)) {
+		m_nBytesEchoed += nLength;
+	}
+}
+
+CBTSimERTMPeer::CBTSimERTMPeer (const u8 *pBDAddr, u8 nMode, const char *pName)
+:	CBTSimPeer (pBDAddr, BT_CLASS_DESKTOP_COMPUTER, pName),
+	m_nLoss (0),
+	m_nCorruption (0),
+	m_nRandom (1),
+	m_bSelectiveReject (FALSE),
+	m_nBytesEchoed (0),
+	m_nRetransmissions (0),
+	m_nFramesLost (0),
+	m_nFCSErrors (0),
+	m_nSelectiveRejects (0),
+	m_nRejects (0),
+	m_nPolls (0),
+	m_nBusyFrames (0),
+	m_nLock (0)
+{
+	SetChannelMode (nMode);
+	ChannelOpened (BT_SIM_ECHO_PSM);
+}
+
+CBTSimERTMPeer::~CBTSimERTMPeer (void)
+{
+}
+
+void CBTSimERTMPeer::SetLoss (unsigned nPercent)
+{
+	m_nLoss = nPercent;
+}
+
+void CBTSimERTMPeer::SetCorruption (unsigned nPercent)
+{
+	m_nCorruption = nPercent;
+}
+
+void CBTSimERTMPeer::SetSelectiveReject (boolean bOn)
+{
+	m_bSelectiveReject = bOn;
+}
+
+unsigned CBTSimERTMPeer::GetBytesEchoed (void) const
+{
+	return m_nBytesEchoed;
+}
+
+unsigned CBTSimERTMPeer::GetRetransmissions (void) const
+{
+	return m_nRetransmissions;
+}
+
+unsigned CBTSimERTMPeer::GetFramesLost (void) const
+{
+	return m_nFramesLost;
+}
+
+unsigned CBTSimERTMPeer::GetFCSErrors (void) const
+{
+	return m_nFCSErrors;
+}
+
+unsigned CBTSimERTMPeer::GetSelectiveRejects (void) const
+{
+	return m_nSelectiveRejects;
+}
+
+unsigned CBTSimERTMPeer::GetRejects (void) const
+{
+	return m_nRejects;
+}
+
+unsigned CBTSimERTMPeer::GetPolls (void) const
+{
+	return m_nPolls;
+}
+
+unsigned CBTSimERTMPeer::GetBusyFrames (void) const
+{
+	return m_nBusyFrames;
+}
+
+boolean CBTSimERTMPeer::AcceptPSM (u16 nPSM)
+{
+	return nPSM == BT_SIM_ECHO_PSM;
+}
+
+void CBTSimERTMPeer::ChannelOpened (u16)
+{
+	spin_lock ((void *) &m_nLock);
+	m_nExpectedAckSeq = 0;
+	m_nNextTxSeq = 0;
+	m_nTxTail = 0;
+	m_nTxStart = 0;
+	m_bRemoteBusy = FALSE;
+	m_nExpectedTxSeq = 0;
+	m_bRejSent = FALSE;
+	m_RxHeld = 0;
+	m_SRejSent = 0;
+	m_bAckPending = FALSE;
+	m_bFinalPending = FALSE;
+	spin_unlock ((void *) &m_nLock);
+}
+
+void CBTSimERTMPeer::ChannelData (u16 nPSM, const u8 *pData, unsigned nLength)
+{
+	if (SendChannel (nPSM, pData, nLength)) {
+		m_nBytesEchoed += nLength;
+	}
+}
+
+boolean CBTSimERTMPeer::SendSegment (u8 nSAR, const u8 *pData, unsigned nLength)
+{
+	TBTSimChannel *pChannel = GetChannelByPSM (BT_SIM_ECHO_PSM);
+	if (   pChannel == 0
+	    || nLength > pChannel->MPS) {
+		return FALSE;
+	}
+
+	spin_lock ((void *) &m_nLock);
+
+	boolean bQueued = ((m_nTxTail+1) & BT_L2CAP_ERTM_MAX_WINDOW) != m_nExpectedAckSeq;
+	if (bQueued) {
+		Queue (nSAR, pData, nLength);
+		Transmit (pChannel, getClockTicks ());
+	}
+
+	spin_unlock ((void *) &m_nLock);
+
+	return bQueued;
+}
+
+void CBTSimERTMPeer::Poll (unsigned nNow)
+{
+	TBTSimChannel *pChannel = GetChannelByPSM (BT_SIM_ECHO_PSM);
+	if (   pChannel == 0
+	    || pChannel->Mode != BT_L2CAP_MODE_ERTM) {
+		return;
+	}
+
+	spin_lock ((void *) &m_nLock);
+
+	// go back to the first frame not acknowledged in time
+	u8 nUnacked = (m_nNextTxSeq - m_nExpectedAckSeq) & BT_L2CAP_ERTM_MAX_WINDOW;
+	if (   nUnacked > 0
+	    && !m_bRemoteBusy
+	    && nNow - m_nTxStart >= BT_SIM_ERTM_TIMEOUT) {
+		m_nRetransmissions += nUnacked;
+		m_nNextTxSeq = m_nExpectedAckSeq;
+	}
+	Transmit (pChannel, nNow);
+
+	spin_unlock ((void *) &m_nLock);
+}
+
+void CBTSimERTMPeer::ChannelFrame (TBTSimChannel *pChannel, const u8 *pFrame, unsigned nLength)
+{
+	unsigned nOverhead = 4 + BT_L2CAP_CONTROL_LEN + BT_L2CAP_FCS_LEN;
+	if (   nLength < nOverhead
+	    || nLength > BT_SIM_MAX_FRAME) {
+		return;
+	}
+
+	u8 Frame[BT_SIM_MAX_FRAME];
+	memcpy (Frame, pFrame, nLength);
+	u16 nControl = GET16 (Frame+4);
+	boolean bIFrame = !(nControl & BT_L2CAP_CONTROL_SFRAME);
+
+	spin_lock ((void *) &m_nLock);
+
+	if (bIFrame && Chance (m_nLoss)) {
+		m_nFramesLost++;
+		spin_unlock ((void *) &m_nLock);
+		return;
+	}
+	if (bIFrame && Chance (m_nCorruption)) {
+		m_nFramesLost++;
+		Frame[4 + BT_L2CAP_CONTROL_LEN] ^= 0x01;	// caught by the FCS
+	}
+	if (CBTCRC16::Update (0, Frame, nLength-2) != GET16 (Frame+nLength-2)) {
+		m_nFCSErrors++;
+		spin_unlock ((void *) &m_nLock);
+		return;
+	}
+
+	unsigned nNow = getClockTicks ();
+	const u8 *pData = Frame + 4 + BT_L2CAP_CONTROL_LEN;
+	unsigned nData = nLength - nOverhead;
+	u8 nSAR = BT_L2CAP_CONTROL_SAR (nControl);
+
+	if (pChannel->Mode == BT_L2CAP_MODE_STREAMING) {
+		// missing frames are simply gone
+		if (bIFrame) {
+			Queue (nSAR, pData, nData);
+			Transmit (pChannel, nNow);
+		}
+		spin_unlock ((void *) &m_nLock);
+		return;
+	}
+
+	Acknowledge (BT_L2CAP_CONTROL_REQSEQ (nControl), nNow);
+
+	if (!bIFrame) {
+		switch (BT_L2CAP_CONTROL_SUPER (nControl)) {
+		case BT_L2CAP_SUPER_RNR:
+			m_nBusyFrames++;
+			m_bRemoteBusy = TRUE;
+			break;
+
+		case BT_L2CAP_SUPER_REJ:
+			m_nRejects++;
+			m_nRetransmissions += (m_nNextTxSeq - m_nExpectedAckSeq)
+					      & BT_L2CAP_ERTM_MAX_WINDOW;
+			m_nNextTxSeq = m_nExpectedAckSeq;
+			m_bRemoteBusy = FALSE;
+			break;
+
+		default:
+			m_bRemoteBusy = FALSE;
+			break;
+		}
+		if (nControl & BT_L2CAP_CONTROL_POLL) {
+			m_nPolls++;
+			m_bFinalPending = TRUE;
+		}
+	} else {
+		u8 nTxSeq = BT_L2CAP_CONTROL_TXSEQ (nControl);
+		u8 nOffset = (nTxSeq - m_nExpectedTxSeq) & BT_L2CAP_ERTM_MAX_WINDOW;
+		if (nOffset == 0) {
+			Deliver (nSAR, pData, nData);
+			m_bAckPending = TRUE;
+		} else if (nOffset >= BT_L2CAP_SEQ_MODULO - BT_SIM_ERTM_WINDOW) {
+			m_bAckPending = TRUE;			// seen before
+		} else if (m_bSelectiveReject) {
+			Hold (pChannel, nTxSeq, nSAR, pData, nData);
+		} else if (!m_bRejSent) {
+			m_bRejSent = TRUE;
+			SendSFrame (pChannel, BT_L2CAP_SUPER_REJ << 2);
+		}
+	}
+
+	Transmit (pChannel, nNow);
+
+	spin_unlock ((void *) &m_nLock);
+}
+
+void CBTSimERTMPeer::Deliver (u8 nSAR, const u8 *pData, unsigned nLength)
+{
+	// a full ring leaves the frame to the host's retransmission
+	if (((m_nTxTail+1) & BT_L2CAP_ERTM_MAX_WINDOW) == m_nExpectedAckSeq) {
+		return;
+	}
+	Queue (nSAR, pData, nLength);
+	m_RxHeld &= ~((u64) 1 << m_nExpectedTxSeq);
+	m_SRejSent &= ~((u64) 1 << m_nExpectedTxSeq);
+	m_nExpectedTxSeq = (m_nExpectedTxSeq+1) & BT_L2CAP_ERTM_MAX_WINDOW;
+	m_bRejSent = FALSE;
+
+	// the frames kept after the gap follow
+	while (   (m_RxHeld & (u64) 1 << m_nExpectedTxSeq)
+	       && ((m_nTxTail+1) & BT_L2CAP_ERTM_MAX_WINDOW) != m_nExpectedAckSeq) {
+		u8 nSeq = m_nExpectedTxSeq;
+		Queue (m_RxSAR[nSeq], m_RxFrame[nSeq], m_RxLength[nSeq]);
+		m_RxHeld &= ~((u64) 1 << nSeq);
+		m_SRejSent &= ~((u64) 1 << nSeq);
+		m_nExpectedTxSeq = (nSeq+1) & BT_L2CAP_ERTM_MAX_WINDOW;
+	}
+}
+
+void CBTSimERTMPeer::Hold (
+	TBTSimChannel *pChannel,
+	u8 nTxSeq,
+	u8 nSAR,
+	const u8 *pData,
+	unsigned nLength)
+{
+	if (nLength > BT_SIM_PEER_MTU) {
+		return;
+	}
+	memcpy (m_RxFrame[nTxSeq], pData, nLength);
+	m_RxLength[nTxSeq] = nLength;
+	m_RxSAR[nTxSeq] = nSAR;
+	m_RxHeld |= (u64) 1 << nTxSeq;
+
+	// once per missing frame, without F it acknowledges nothing
+	for (u8 nSeq = m_nExpectedTxSeq; nSeq != nTxSeq;
+	     nSeq = (nSeq+1) & BT_L2CAP_ERTM_MAX_WINDOW) {
+		u64 nBit = (u64) 1 << nSeq;
+		if ((m_RxHeld | m_SRejSent) & nBit) {
+			continue;
+		}
+		m_SRejSent |= nBit;
+		m_nSelectiveRejects++;
+		Send (pChannel, BT_L2CAP_CONTROL_SFRAME | BT_L2CAP_SUPER_SREJ << 2 | nSeq << 8,
+		      0, 0, FALSE);
+	}
+}
+
+void CBTSimERTMPeer::Queue (u8 nSAR, const u8 *pData, unsigned nLength)
+{
+	TBTSimChannel *pChannel = GetChannelByPSM (BT_SIM_ECHO_PSM);
+	if (   pChannel == 0
+	    || nLength > pChannel->MPS) {
+		return;
+	}
+
+	// the SDU length of a start segment is no SDU data
+	m_nBytesEchoed += nSAR == BT_L2CAP_SAR_START && nLength >= BT_L2CAP_SDU_LENGTH_LEN
+			  ? nLength - BT_L2CAP_SDU_LENGTH_LEN : nLength;
+
+	if (pChannel->Mode == BT_L2CAP_MODE_STREAMING) {
+		u16 nControl = m_nNextTxSeq << 1 | nSAR << BT_L2CAP_CONTROL_SAR_SHIFT;
+		m_nNextTxSeq = (m_nNextTxSeq+1) & BT_L2CAP_ERTM_MAX_WINDOW;
+		Send (pChannel, nControl, pData, nLength, TRUE);
+		return;
+	}
+
+	memcpy (m_TxFrame[m_nTxTail], pData, nLength);
+	m_TxLength[m_nTxTail] = nLength;
+	m_TxSAR[m_nTxTail] = nSAR;
+	m_nTxTail = (m_nTxTail+1) & BT_L2CAP_ERTM_MAX_WINDOW;
+}
+
+void CBTSimERTMPeer::Transmit (TBTSimChannel *pChannel, unsigned nNow)
+{
+	if (pChannel->Mode != BT_L2CAP_MODE_ERTM) {
+		return;
+	}
+
+	while (   !m_bRemoteBusy
+	       && m_nNextTxSeq != m_nTxTail
+	       && ((m_nNextTxSeq - m_nExpectedAckSeq) & BT_L2CAP_ERTM_MAX_WINDOW)
+			< pChannel->TxWindow) {
+		if (m_nNextTxSeq == m_nExpectedAckSeq) {
+			m_nTxStart = nNow;
+		}
+		SendIFrame (pChannel, m_nNextTxSeq);
+		m_nNextTxSeq = (m_nNextTxSeq+1) & BT_L2CAP_ERTM_MAX_WINDOW;
+	}
+
+	if (m_bAckPending || m_bFinalPending) {
+		SendSFrame (pChannel, BT_L2CAP_SUPER_RR << 2);
+	}
+}
+
+void CBTSimERTMPeer::SendIFrame (TBTSimChannel *pChannel, u8 nTxSeq)
+{
+	u16 nControl =    nTxSeq << 1 | m_nExpectedTxSeq << 8
+			| m_TxSAR[nTxSeq] << BT_L2CAP_CONTROL_SAR_SHIFT;
+	if (m_bFinalPending) {
+		nControl |= BT_L2CAP_CONTROL_FINAL;
+	}
+	m_bAckPending = FALSE;
+	m_bFinalPending = FALSE;
+
+	Send (pChannel, nControl, m_TxFrame[nTxSeq], m_TxLength[nTxSeq], TRUE);
+}
+
+void CBTSimERTMPeer::SendSFrame (TBTSimChannel *pChannel, u16 nControl)
+{
+	nControl |= BT_L2CAP_CONTROL_SFRAME | m_nExpectedTxSeq << 8;
+	if (m_bFinalPending) {
+		nControl |= BT_L2CAP_CONTROL_FINAL;
+	}
+	m_bAckPending = FALSE;
+	m_bFinalPending = FALSE;
+
+	Send (pChannel, nControl, 0, 0, FALSE);
+}
+
+void CBTSimERTMPeer::Send (
+	TBTSimChannel *pChannel,
+	u16 nControl,
+	const u8 *pData,
+	unsigned nLength,
+	boolean bIFrame)
+{
+	u8 Frame[4+BT_L2CAP_CONTROL_LEN+BT_SIM_PEER_MTU+BT_L2CAP_FCS_LEN];
+	unsigned nFrame = 4 + BT_L2CAP_CONTROL_LEN + nLength;
+	PUT16 (Frame, nFrame - 4 + BT_L2CAP_FCS_LEN);
+	PUT16 (Frame+2, pChannel->RemoteCID);
+	PUT16 (Frame+4, nControl);
+	if (nLength > 0) {
+		memcpy (Frame+6, pData, nLength);
+	}
+	PUT16 (Frame+nFrame, CBTCRC16::Update (0, Frame, nFrame));
+	nFrame += BT_L2CAP_FCS_LEN;
+
+	if (bIFrame && Chance (m_nLoss)) {
+		m_nFramesLost++;
+		return;
+	}
+	if (bIFrame && Chance (m_nCorruption)) {
+		m_nFramesLost++;
+		Frame[nFrame-1] ^= 0x80;
+	}
+
+	SendFrame (Frame, nFrame);
+}
+
+void CBTSimERTMPeer::Acknowledge (u8 nReqSeq, unsigned nNow)
+{
+	u8 nAcked = (nReqSeq - m_nExpectedAckSeq) & BT_L2CAP_ERTM_MAX_WINDOW;
+	u8 nSent = (m_nNextTxSeq - m_nExpectedAckSeq) & BT_L2CAP_ERTM_MAX_WINDOW;
+	u8 nQueued = (m_nTxTail - m_nExpectedAckSeq) & BT_L2CAP_ERTM_MAX_WINDOW;
+	// after a go back the frames past m_nNextTxSeq were sent before
+	if (nAcked == 0 || nAcked > nQueued) {
+		return;
+	}
+	if (nAcked > nSent) {
+		m_nNextTxSeq = nReqSeq;
+	}
+
+	m_nExpectedAckSeq = nReqSeq;
+	m_nTxStart = nNow;
+}
+
+boolean CBTSimERTMPeer::Chance (unsigned nPercent)
+{
+	if (nPercent == 0) {
+		return FALSE;
+	}
+
+	m_nRandom = m_nRandom * 1103515245 + 12345;
+
+	return (m_nRandom >> 16) % 100 < nPercent;
+}
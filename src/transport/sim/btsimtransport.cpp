@@ -0,0 +1,116 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Host Simulation Bluetooth Transport Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btsimtransport.h>
+#include <bluetooth/devicenameservice.h>
+#include <bluetooth/btstats.h>
+#include <assert.h>
+
+CBTSimTransport::CBTSimTransport (TInterruptSystem *)
+{
+}
+
+CBTSimTransport::~CBTSimTransport (void)
+{
+}
+
+boolean CBTSimTransport::Initialize (unsigned)
+{
+	CDeviceNameService::Get ()->AddDevice ("ttyBT1", this, FALSE);
+
+	return TRUE;
+}
+
+boolean CBTSimTransport::SendHCICommand (const void *pBuffer, unsigned nLength)
+{
+	assert (pBuffer != 0);
+	m_Controller.ReceiveCommand ((const u8 *) pBuffer, nLength);
+
+	return TRUE;
+}
+
+boolean CBTSimTransport::SendHCIData (const void *pBuffer, unsigned nLength)
+{
+	assert (pBuffer != 0);
+	m_Controller.ReceiveData ((const u8 *) pBuffer, nLength);
+
+	return TRUE;
+}
+
+boolean CBTSimTransport::IsTxReady (unsigned) const
+{
+	return TRUE;
+}
+
+boolean CBTSimTransport::IsTxIdle (void) const
+{
+	return TRUE;
+}
+
+void CBTSimTransport::Process (void)
+{
+	BT_STATS_START (nStart);
+
+	u8 Span[BT_SIM_RX_SPAN_SIZE];
+	unsigned nDelivered = 0;
+
+	unsigned nLength;
+	while (   nDelivered < BT_SIM_RX_BUDGET
+	       && (nLength = m_Controller.Read (Span, sizeof Span)) > 0) {
+		m_Deframer.Parse (Span, nLength);
+		nDelivered += nLength;
+	}
+
+	if (nDelivered > 0) {
+		BT_STATS_RECORD (BTStatsRxDeframe, nStart);
+	}
+}
+
+void CBTSimTransport::RegisterHCIEventHandler (TBTHCIEventHandler *pHandler)
+{
+	m_Deframer.RegisterHCIEventHandler (pHandler);
+}
+
+void CBTSimTransport::RegisterHCIDataHandler (TBTHCIDataHandler *pHandler)
+{
+	m_Deframer.RegisterHCIDataHandler (pHandler);
+}
+
+CBTSimController *CBTSimTransport::GetController (void)
+{
+	return &m_Controller;
+}
@@ -0,0 +1,284 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Raspberry Pi BareMetal Bluetooth H4 Deframer Routines
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/bth4deframer.h>
+#include <assert.h>
+#include <string.h>
+
+enum TBTH4State
+{
+	H4StatePacketType,
+	H4StateHeader,
+	H4StatePayload,
+	H4StateUnknown
+};
+
+#define H4_EVENT_HEADER_SIZE	2	// event code, parameter length
+#define H4_ACL_HEADER_SIZE	4	// handle and flags, data length
+#define H4_SCO_HEADER_SIZE	3	// handle and flags, data length
+
+CBTH4Deframer::CBTH4Deframer (void)
+:	m_pEventHandler (0),
+	m_pDataHandler (0),
+	m_pSCOHandler (0),
+	m_nState (H4StatePacketType),
+	m_nPacketType (0),
+	m_nHeaderLength (0),
+	m_nPacketLength (0),
+	m_nReceived (0),
+	m_pPacket (0),
+	m_pBuffer (0),
+	m_nDiscarded (0),
+	m_nDropped (0)
+{
+}
+
+CBTH4Deframer::~CBTH4Deframer (void)
+{
+	Reset ();
+
+	m_pEventHandler = 0;
+	m_pDataHandler = 0;
+	m_pSCOHandler = 0;
+}
+
+void CBTH4Deframer::RegisterHCIEventHandler (TBTHCIEventHandler *pHandler)
+{
+	assert (m_pEventHandler == 0);
+	m_pEventHandler = pHandler;
+	assert (m_pEventHandler != 0);
+}
+
+void CBTH4Deframer::RegisterHCIDataHandler (TBTHCIDataHandler *pHandler)
+{
+	assert (m_pDataHandler == 0);
+	m_pDataHandler = pHandler;
+	assert (m_pDataHandler != 0);
+}
+
+void CBTH4Deframer::RegisterHCISCOHandler (TBTHCISCOHandler *pHandler)
+{
+	assert (m_pSCOHandler == 0);
+	m_pSCOHandler = pHandler;
+	assert (m_pSCOHandler != 0);
+}
+
+void CBTH4Deframer::Reset (void)
+{
+	if (m_pPacket != 0) {
+		m_pPacket->Release ();
+		m_pPacket = 0;
+	}
+
+	m_pBuffer = 0;
+	m_nReceived = 0;
+	m_nState = H4StatePacketType;
+}
+
+void CBTH4Deframer::Parse (const u8 *pData, unsigned nLength)
+{
+	assert (pData != 0 || nLength == 0);
+
+	while (nLength > 0) {
+		switch (m_nState) {
+		case H4StatePacketType: {
+			u8 nPacketType = *pData++;
+			nLength--;
+
+			if (BeginPacket (nPacketType)) {
+				m_nState = H4StateHeader;
+			} else {
+				m_nDiscarded++;
+			}
+			} break;
+
+		case H4StateHeader: {
+			unsigned nCopy = m_nHeaderLength - m_nReceived;
+			if (nCopy > nLength) nCopy = nLength;
+
+			memcpy (m_pBuffer + m_nReceived, pData, nCopy);
+			m_nReceived += nCopy;
+			pData += nCopy;
+			nLength -= nCopy;
+
+			if (m_nReceived < m_nHeaderLength) break;
+
+			if (!BeginPayload ()) {
+				m_nDropped++;
+				Reset ();
+			} else if (m_nReceived == m_nPacketLength) {
+				Deliver ();
+			} else {
+				m_nState = H4StatePayload;
+			}
+			} break;
+
+		case H4StatePayload: {
+			unsigned nCopy = m_nPacketLength - m_nReceived;
+			if (nCopy > nLength) nCopy = nLength;
+
+			if (m_pBuffer != 0) {
+				memcpy (m_pBuffer + m_nReceived, pData, nCopy);
+			}
+			m_nReceived += nCopy;
+			pData += nCopy;
+			nLength -= nCopy;
+
+			if (m_nReceived == m_nPacketLength) {
+				Deliver ();
+			}
+			} break;
+
+		default:
+			assert (0);
+			Reset ();
+			break;
+		}
+	}
+}
+
+boolean CBTH4Deframer::BeginPacket (u8 nPacketType)
+{
+	m_nPacketType = nPacketType;
+	m_nReceived = 0;
+
+	switch (nPacketType) {
+	case HCI_PACKET_EVENT:
+		m_nHeaderLength = H4_EVENT_HEADER_SIZE;
+		m_pBuffer = m_Buffer;
+		return TRUE;
+
+	case HCI_PACKET_SYNCH_DATA:
+		m_nHeaderLength = H4_SCO_HEADER_SIZE;
+		m_pBuffer = m_Buffer;
+		return TRUE;
+
+	case HCI_PACKET_ACL_DATA:
+		// without a packet the header still goes to m_Buffer, so
+		// that the payload can be skipped
+		m_nHeaderLength = H4_ACL_HEADER_SIZE;
+		assert (m_pPacket == 0);
+		assert (CBTPacketPool::Get () != 0);
+		m_pPacket = CBTPacketPool::Get ()->Alloc ();
+		m_pBuffer = m_pPacket != 0 ? m_pPacket->GetData () : m_Buffer;
+		return TRUE;
+
+	default:
+		return FALSE;
+	}
+}
+
+boolean CBTH4Deframer::BeginPayload (void)
+{
+	unsigned nPayloadLength;
+
+	switch (m_nPacketType) {
+	case HCI_PACKET_EVENT:
+		nPayloadLength = m_pBuffer[1];
+		break;
+
+	case HCI_PACKET_SYNCH_DATA:
+		nPayloadLength = m_pBuffer[2];
+		if (m_pSCOHandler == 0) {
+			m_pBuffer = 0;		// nobody wants it, skip the payload
+		}
+		break;
+
+	case HCI_PACKET_ACL_DATA:
+		nPayloadLength = m_pBuffer[2] | (m_pBuffer[3] << 8);
+		if (nPayloadLength > BT_MAX_DATA_SIZE - H4_ACL_HEADER_SIZE) {
+			// too large for a packet, the payload is skipped like one
+			// without a packet, so the stream stays in sync
+			if (m_pPacket != 0) {
+				m_pPacket->Release ();
+				m_pPacket = 0;
+			}
+		}
+		if (m_pPacket == 0) {
+			m_pBuffer = 0;		// skip the payload, Deliver() counts the drop
+		}
+		break;
+
+	default:
+		return FALSE;
+	}
+
+	m_nPacketLength = m_nHeaderLength + nPayloadLength;
+
+	return TRUE;
+}
+
+void CBTH4Deframer::Deliver (void)
+{
+	switch (m_nPacketType) {
+	case HCI_PACKET_EVENT:
+		if (m_pEventHandler != 0) {
+			(*m_pEventHandler) (m_Buffer, m_nPacketLength);
+		}
+		break;
+
+	case HCI_PACKET_SYNCH_DATA:
+		if (m_pSCOHandler != 0) {
+			(*m_pSCOHandler) (m_Buffer, m_nPacketLength);
+		}
+		break;
+
+	case HCI_PACKET_ACL_DATA:
+		if (m_pPacket == 0) {
+			m_nDropped++;
+			break;
+		}
+
+		m_pPacket->Put (m_nPacketLength);
+		CBTPacketPool::CountCopy (BTCopyLayerTransport, m_nPacketLength);
+
+		if (m_pDataHandler != 0) {
+			(*m_pDataHandler) (m_pPacket);
+		} else {
+			m_pPacket->Release ();
+		}
+		m_pPacket = 0;
+		break;
+
+	default:
+		break;
+	}
+
+	m_pBuffer = 0;
+	m_nReceived = 0;
+	m_nState = H4StatePacketType;
+}
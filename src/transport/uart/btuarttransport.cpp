@@ -39,6 +39,7 @@
 #include <bluetooth/devicenameservice.h>
 #include <bluetooth/btevent.h>
 #include <bluetooth/btdata.h>
+#include <bluetooth/btstats.h>
 #include <memio.h>
 #include <platform/bt_clock.h>
 #include <platform/bt_uart.h>
@@ -47,27 +48,31 @@
 #include <assert.h>
 #include <string.h>
 
-enum TBTUARTRxState
-{
-	RxStateStart,
-	RxStateCommand,
-	RxStateACLData,
-	RxStateLength,
-	RxStateACLDataLength,
-	RxStateParam,
-	RxStateData,
-	RxStateUnknown
-};
-
 static const char FromBTUART[] = "btuart";
 
+#define DR_ERROR_MASK	(DR_OE_MASK | DR_BE_MASK | DR_PE_MASK | DR_FE_MASK)
+
 CBTUARTTransport::CBTUARTTransport (TInterruptSystem *pInterruptSystem)
 :	m_TxDPin (32, GPIOModeAlternateFunction3),
 	m_RxDPin (33, GPIOModeAlternateFunction3),
 	m_pInterruptSystem (pInterruptSystem),
 	m_bIRQConnected (FALSE),
-	m_pEventHandler (0),
-	m_nRxState (RxStateStart)
+	m_nTxInPtr (0),
+	m_nTxOutPtr (0),
+	m_nIMSC (0),
+	m_nOverruns (0),
+	m_nRxErrors (0)
+#ifdef BT_HAVE_UART_DMA
+	,
+	m_pDMAMemory (0),
+	m_pDMARxCB (0),
+	m_pDMATxCB (0),
+	m_pDMARxBuffer (0),
+	m_pDMATxBuffer (0),
+	m_nDMARxOutPtr (0),
+	m_bDMARxWrapPending (FALSE),
+	m_nDMATxLength (0)
+#endif
 {
 }
 
@@ -76,7 +81,14 @@ CBTUARTTransport::~CBTUARTTransport (void)
 	write32 (ARM_UART0_IMSC, 0);
 	write32 (ARM_UART0_CR, 0);
 
-	m_pEventHandler = 0;
+#ifdef BT_HAVE_UART_DMA
+	write32 (ARM_UART0_DMACR, 0);
+	write32 (ARM_DMA_CS (BT_UART_DMA_RX_CHANNEL), CS_RESET);
+	write32 (ARM_DMA_CS (BT_UART_DMA_TX_CHANNEL), CS_RESET);
+
+	free (m_pDMAMemory);
+	m_pDMAMemory = 0;
+#endif
 
 	if (m_bIRQConnected) {
 		assert (m_pInterruptSystem != 0);
@@ -99,8 +111,6 @@ boolean CBTUARTTransport::Initialize (unsigned nBaudrate)
 	unsigned nFractDiv = nFractDiv2 / 2 + nFractDiv2 % 2;
 	assert (nFractDiv <= 0x3F);
 
-	m_nRxInPtr = m_nRxOutPtr = 0;
-
 	assert (m_pInterruptSystem != 0);
 	InterruptSystemConnectIRQ(m_pInterruptSystem,ARM_IRQ_UART,IRQStub,this);
 
@@ -111,10 +121,24 @@ boolean CBTUARTTransport::Initialize (unsigned nBaudrate)
 	write32 (ARM_UART0_ICR,  0x7FF);
 	write32 (ARM_UART0_IBRD, nIntDiv);
 	write32 (ARM_UART0_FBRD, nFractDiv);
-	write32 (ARM_UART0_IFLS, IFLS_IFSEL_1_4 << IFLS_RXIFSEL_SHIFT);
+	write32 (ARM_UART0_IFLS,   IFLS_IFSEL_1_4 << IFLS_RXIFSEL_SHIFT
+				 | IFLS_IFSEL_1_4 << IFLS_TXIFSEL_SHIFT);
 	write32 (ARM_UART0_LCRH, LCRH_WLEN8_MASK | LCRH_FEN_MASK);		// 8N1
 	write32 (ARM_UART0_CR,   CR_UART_EN_MASK | CR_TXE_MASK | CR_RXE_MASK);
-	write32 (ARM_UART0_IMSC, INT_RX | INT_RT | INT_OE);
+
+	m_nTxInPtr = m_nTxOutPtr = 0;
+
+#ifdef BT_HAVE_UART_DMA
+	// the FIFOs are serviced by DMA, the IRQ only reports overruns
+	if (!InitializeDMA ()) {
+		return FALSE;
+	}
+	m_nIMSC = INT_OE;
+#else
+	// INT_TX is only enabled while the TX ring holds data
+	m_nIMSC = INT_RX | INT_RT | INT_OE;
+#endif
+	write32 (ARM_UART0_IMSC, m_nIMSC);
 
 
 	CDeviceNameService::Get ()->AddDevice ("ttyBT1", this, FALSE);
@@ -124,167 +148,347 @@ boolean CBTUARTTransport::Initialize (unsigned nBaudrate)
 
 boolean CBTUARTTransport::SendHCICommand (const void *pBuffer, unsigned nLength)
 {
-	u8 *pChar = (u8 *) pBuffer;
+	return Send (HCI_PACKET_COMMAND, pBuffer, nLength);
+}
 
-	Write (HCI_PACKET_COMMAND);
+boolean CBTUARTTransport::SendHCIData (const void *pBuffer, unsigned nLength)
+{
+	return Send (HCI_PACKET_ACL_DATA, pBuffer, nLength);
+}
 
-	assert (pChar != 0);
-	
-	while (nLength--) {
-		Write (*pChar++);
-	}
+boolean CBTUARTTransport::IsTxReady (unsigned nLength) const
+{
+	return GetTxFree () >= nLength + 1 ? TRUE : FALSE;
+}
 
+boolean CBTUARTTransport::IsTxIdle (void) const
+{
+	return __atomic_load_n (&m_nTxOutPtr, __ATOMIC_ACQUIRE) == m_nTxInPtr
+		&& (read32 (ARM_UART0_FR) & FR_BUSY_MASK) == 0 ? TRUE : FALSE;
+}
 
-	return TRUE;
+void CBTUARTTransport::Process (void)
+{
+#ifdef BT_HAVE_UART_DMA
+	ProcessDMARx ();
+	ProcessDMATx ();
+#endif
 }
 
-boolean CBTUARTTransport::SendHCIData (const void *pBuffer, unsigned nLength)
+void CBTUARTTransport::RegisterHCIEventHandler (TBTHCIEventHandler *pHandler)
 {
-	u8 *pChar = (u8 *) pBuffer;
+	m_Deframer.RegisterHCIEventHandler (pHandler);
+}
 
-	Write (HCI_PACKET_ACL_DATA);
+void CBTUARTTransport::RegisterHCIDataHandler (TBTHCIDataHandler *pHandler)
+{
+	m_Deframer.RegisterHCIDataHandler (pHandler);
+}
 
+boolean CBTUARTTransport::Send (u8 nPacketType, const void *pBuffer, unsigned nLength)
+{
+	const u8 *pChar = (const u8 *) pBuffer;
 	assert (pChar != 0);
-	
+
+	if (!IsTxReady (nLength)) {
+		return FALSE;
+	}
+
+	// the packet is copied as a whole before it is published to the IRQ
+	unsigned nInPtr = m_nTxInPtr;
+	m_TxRing[nInPtr++ & (BT_UART_TX_RING_SIZE-1)] = nPacketType;
 	while (nLength--) {
-		Write (*pChar++);
+		m_TxRing[nInPtr++ & (BT_UART_TX_RING_SIZE-1)] = *pChar++;
 	}
+	__atomic_store_n (&m_nTxInPtr, nInPtr, __ATOMIC_RELEASE);
 
+	StartTx ();
 
 	return TRUE;
 }
 
-void CBTUARTTransport::RegisterHCIEventHandler (TBTHCIEventHandler *pHandler)
+unsigned CBTUARTTransport::GetTxFree (void) const
 {
-	assert (m_pEventHandler == 0);
-	m_pEventHandler = pHandler;
-	assert (m_pEventHandler != 0);
+	unsigned nOutPtr = __atomic_load_n (&m_nTxOutPtr, __ATOMIC_ACQUIRE);
+
+	return BT_UART_TX_RING_SIZE - (m_nTxInPtr - nOutPtr);
 }
 
-void CBTUARTTransport::RegisterHCIDataHandler (TBTHCIDataHandler *pHandler)
+void CBTUARTTransport::StartTx (void)
 {
-	assert (m_pDataHandler == 0);
-	m_pDataHandler = pHandler;
-	assert (m_pDataHandler != 0);
+#ifdef BT_HAVE_UART_DMA
+	ProcessDMATx ();
+#else
+	// The TX interrupt fires when the FIFO level drops through the
+	// threshold, so an idle FIFO has to be primed here. The UART IRQ is
+	// masked meanwhile, as both sides move the out pointer.
+	InterruptSystemDisableIRQ(ARM_IRQ_UART);
+
+	FillTxFIFO ();
+
+	if (!(m_nIMSC & INT_TX) && m_nTxOutPtr != m_nTxInPtr) {
+		m_nIMSC |= INT_TX;
+		write32 (ARM_UART0_IMSC, m_nIMSC);
+	}
+
+	InterruptSystemEnableIRQ(ARM_IRQ_UART);
+#endif
 }
 
-void CBTUARTTransport::Write (u8 nChar)
+void CBTUARTTransport::FillTxFIFO (void)
 {
-	while (read32 (ARM_UART0_FR) & FR_TXFF_MASK) {
-		// do nothing
+	unsigned nInPtr = __atomic_load_n (&m_nTxInPtr, __ATOMIC_ACQUIRE);
+	unsigned nOutPtr = m_nTxOutPtr;
+
+	while (   nOutPtr != nInPtr
+	       && !(read32 (ARM_UART0_FR) & FR_TXFF_MASK)) {
+		write32 (ARM_UART0_DR, m_TxRing[nOutPtr++ & (BT_UART_TX_RING_SIZE-1)]);
 	}
-		
-	write32 (ARM_UART0_DR, nChar);
+
+	__atomic_store_n (&m_nTxOutPtr, nOutPtr, __ATOMIC_RELEASE);
 }
 
 void CBTUARTTransport::IRQHandler (void)
 {
-	static bool aclFlag = false;
+	BT_STATS_START (nStart);
 
 	volatile u32 nMIS = read32 (ARM_UART0_MIS);
 	if (nMIS & INT_OE) {
+		m_nOverruns++;
 		LOG_DEBUG ("Overrun error\r\n");
 	}
 
 	write32 (ARM_UART0_ICR, nMIS);
 
-	while (1) {
-		if (read32 (ARM_UART0_FR) & FR_RXFE_MASK) {
-			break;
+	if (nMIS & INT_TX) {
+		FillTxFIFO ();
+
+		if (m_nTxOutPtr == m_nTxInPtr) {
+			m_nIMSC &= ~INT_TX;
+			write32 (ARM_UART0_IMSC, m_nIMSC);
 		}
+	}
 
-		volatile u8 nData = read32 (ARM_UART0_DR) & 0xFF;
+	// drain the FIFO in spans, the deframer copies whole runs
+	u8 Span[BT_UART_RX_SPAN_SIZE];
+	unsigned nLength = 0;
+	boolean bReceived = FALSE;
 
-		switch (m_nRxState) {
-		case RxStateStart:
-			if (nData == HCI_PACKET_EVENT) {
-				m_nRxInPtr = 0;
-				m_nRxState = RxStateCommand;
-			} else if (nData == HCI_PACKET_ACL_DATA) {
-				m_nRxInPtr = 0;
-				m_nRxState = RxStateACLData;
-			}
-			break;
-
-		case RxStateCommand:
-			m_RxBuffer[m_nRxInPtr++] = nData;
-			m_nRxState = RxStateLength;
-			break;
-
-		case RxStateACLData:
-			m_nRxState = (m_nRxInPtr) ? RxStateACLDataLength : RxStateACLData;
-			m_RxBuffer[m_nRxInPtr++] = nData;
-			break;
-
-		case RxStateLength:
-			m_RxBuffer[m_nRxInPtr++] = nData;
-			if (nData > 0) {
-				m_nRxParamLength = nData;
-				m_nRxState = RxStateParam;
-			} else {
-				if (m_pEventHandler != 0) {
-					(*m_pEventHandler) (m_RxBuffer, m_nRxInPtr);
-				}
-
-				m_nRxState = RxStateStart;
-			}
-			break;
-
-		case RxStateACLDataLength:
-			m_RxBuffer[m_nRxInPtr++] = nData;
-			if (aclFlag) m_nRxACLDataLength |= (nData << 8);
-			else m_nRxACLDataLength = nData;
-			if (aclFlag) {
-				if (m_nRxACLDataLength > BT_MAX_DATA_SIZE-4) {
-					m_nRxInPtr = 0;
-					m_nRxState = RxStateStart;
-				} else if (m_nRxACLDataLength > 0) {
-					m_nRxParamLength = m_nRxACLDataLength;
-					m_nRxState = RxStateData;
-				} else {
-					if (m_pDataHandler != 0) {
-						(*m_pDataHandler) (m_RxBuffer, m_nRxInPtr);
-					}
-
-					m_nRxState = RxStateStart;
-				}
-			}
-			aclFlag = (aclFlag) ? false : true;
-			break;
+	while (!(read32 (ARM_UART0_FR) & FR_RXFE_MASK)) {
+		u32 nData = read32 (ARM_UART0_DR);
+		if (nData & DR_ERROR_MASK) {
+			m_nRxErrors++;
+		}
+		Span[nLength++] = nData & 0xFF;
+
+		if (nLength == sizeof Span) {
+			m_Deframer.Parse (Span, nLength);
+			nLength = 0;
+			bReceived = TRUE;
+		}
+	}
 
-		case RxStateParam:
-			m_RxBuffer[m_nRxInPtr++] = nData;
-			if (--m_nRxParamLength == 0) {
-				if (m_pEventHandler != 0) {
-					(*m_pEventHandler) (m_RxBuffer, m_nRxInPtr);
-				}
+	if (nLength > 0) {
+		m_Deframer.Parse (Span, nLength);
+		bReceived = TRUE;
+	}
 
-				m_nRxState = RxStateStart;
-			}
-			break;
+	// TX only interrupts are not accounted
+	if (bReceived) {
+		BT_STATS_RECORD (BTStatsRxDeframe, nStart);
+	}
+}
+
+void CBTUARTTransport::IRQStub (void *pParam)
+{
+	CBTUARTTransport *pThis = (CBTUARTTransport *) pParam;
+
+	if (pThis) pThis->IRQHandler ();
+}
+
+#ifdef BT_HAVE_UART_DMA
+
+boolean CBTUARTTransport::InitializeDMA (void)
+{
+	// two 32 byte aligned control blocks followed by the RX and the TX
+	// word buffers, which start on a cache line
+	unsigned nSize =   2 * sizeof (rpi_dma_control_block_t)
+			 + (BT_UART_DMA_RX_SIZE + BT_UART_DMA_TX_SIZE) * sizeof (u32);
+	m_pDMAMemory = malloc (nSize + 64);
+	if (m_pDMAMemory == 0) {
+		LOG_DEBUG ("BT UART: cannot allocate DMA buffer\r\n");
+		return FALSE;
+	}
 
-		case RxStateData:
-			m_RxBuffer[m_nRxInPtr++] = nData;
-			if (--m_nRxParamLength == 0) {
-				if (m_pDataHandler != 0) {
-					(*m_pDataHandler) (m_RxBuffer, m_nRxInPtr);
-				}
+	uintptr nAligned = ((uintptr) m_pDMAMemory + 63) & ~63;
+	m_pDMARxCB = (rpi_dma_control_block_t *) nAligned;
+	m_pDMATxCB = m_pDMARxCB + 1;
+	m_pDMARxBuffer = (u32 *) (m_pDMATxCB + 1);
+	m_pDMATxBuffer = m_pDMARxBuffer + BT_UART_DMA_RX_SIZE;
+	m_nDMARxOutPtr = 0;
+	m_bDMARxWrapPending = FALSE;
+	m_nDMATxLength = 0;
+
+	write32 (ARM_DMA_ENABLE,   read32 (ARM_DMA_ENABLE)
+				 | 1 << BT_UART_DMA_RX_CHANNEL
+				 | 1 << BT_UART_DMA_TX_CHANNEL);
+	write32 (ARM_DMA_CS (BT_UART_DMA_RX_CHANNEL), CS_RESET);
+	write32 (ARM_DMA_CS (BT_UART_DMA_TX_CHANNEL), CS_RESET);
+
+	// RX runs forever: the control block links to itself, so the
+	// engine wraps around the buffer and DEST_AD is the write pointer.
+	// Each DREQ moves one 32 bit DR read, with the error bits.
+	m_pDMARxCB->nTransferInformation =   DREQ_SOURCE_UART_RX << TI_PERMAP_SHIFT
+					   | TI_SRC_DREQ
+					   | TI_DEST_INC
+					   | TI_WAIT_RESP;
+	m_pDMARxCB->nSourceAddress = BUS_PERIPHERAL (ARM_UART0_DR);
+	m_pDMARxCB->nDestinationAddress = BUS_ADDRESS ((uintptr) m_pDMARxBuffer);
+	m_pDMARxCB->nTransferLength = BT_UART_DMA_RX_SIZE * sizeof (u32);
+	m_pDMARxCB->n2DModeStride = 0;
+	m_pDMARxCB->nNextControlBlockAddress = BUS_ADDRESS ((uintptr) m_pDMARxCB);
+	m_pDMARxCB->nReserved[0] = 0;
+	m_pDMARxCB->nReserved[1] = 0;
+
+	CleanDataCacheRange ((uintptr) m_pDMARxCB, sizeof *m_pDMARxCB);
+	InvalidateDataCacheRange ((uintptr) m_pDMARxBuffer, BT_UART_DMA_RX_SIZE * sizeof (u32));
+	DataSyncBarrier ();
+
+	write32 (ARM_UART0_DMACR, DMACR_RXDMAE | DMACR_TXDMAE);
+
+	write32 (ARM_DMA_CONBLK_AD (BT_UART_DMA_RX_CHANNEL), BUS_ADDRESS ((uintptr) m_pDMARxCB));
+	write32 (ARM_DMA_CS (BT_UART_DMA_RX_CHANNEL),   CS_WAIT_FOR_OUTSTANDING_WRITES
+						      | 8 << CS_PANIC_PRIORITY_SHIFT
+						      | 8 << CS_PRIORITY_SHIFT
+						      | CS_ACTIVE);
+
+	return TRUE;
+}
+
+void CBTUARTTransport::ProcessDMARx (void)
+{
+	assert (m_pDMARxBuffer != 0);
+
+	BT_STATS_START (nStart);
+
+	// Each lap sets CS_END, which is cleared before the write pointer is
+	// read. A lap ending in between shows as a pointer behind the read
+	// index, its CS_END is then seen on the next pass.
+	u32 nCS = read32 (ARM_DMA_CS (BT_UART_DMA_RX_CHANNEL));
+	if (nCS & CS_END) {
+		write32 (ARM_DMA_CS (BT_UART_DMA_RX_CHANNEL), nCS);
+	}
+	boolean bLapped = (nCS & CS_END) && !m_bDMARxWrapPending ? TRUE : FALSE;
+
+	u32 nDest = read32 (ARM_DMA_DEST_AD (BT_UART_DMA_RX_CHANNEL));
+	unsigned nInPtr = (nDest - BUS_ADDRESS ((uintptr) m_pDMARxBuffer)) / sizeof (u32);
+	if (nInPtr >= BT_UART_DMA_RX_SIZE) {
+		nInPtr = 0;		// control block is being reloaded
+	}
+
+	boolean bBehind = nInPtr < m_nDMARxOutPtr ? TRUE : FALSE;
+	m_bDMARxWrapPending = bBehind && !bLapped ? TRUE : FALSE;
+	if (bLapped && !bBehind) {
+		// the engine has passed the read index, the ring holds parts of
+		// two laps, so it is dropped and the deframer waits for the next
+		// packet type
+		m_nOverruns++;
+		LOG_DEBUG ("DMA RX overrun\r\n");
+		m_nDMARxOutPtr = nInPtr;
+		m_Deframer.Reset ();
+		return;
+	}
 
-				m_nRxState = RxStateStart;
+	if (m_nDMARxOutPtr == nInPtr) {
+		return;
+	}
+
+	// unpack the DR words, the deframer gets the characters in spans
+	u8 Span[BT_UART_RX_SPAN_SIZE];
+	unsigned nSpan = 0;
+
+	while (m_nDMARxOutPtr != nInPtr) {
+		unsigned nEnd = nInPtr > m_nDMARxOutPtr ? nInPtr : BT_UART_DMA_RX_SIZE;
+
+		InvalidateDataCacheRange ((uintptr) (m_pDMARxBuffer + m_nDMARxOutPtr),
+					  (nEnd - m_nDMARxOutPtr) * sizeof (u32));
+
+		for (; m_nDMARxOutPtr < nEnd; m_nDMARxOutPtr++) {
+			u32 nData = m_pDMARxBuffer[m_nDMARxOutPtr];
+			if (nData & DR_ERROR_MASK) {
+				m_nRxErrors++;
+			}
+			Span[nSpan++] = nData & 0xFF;
+
+			if (nSpan == sizeof Span) {
+				m_Deframer.Parse (Span, nSpan);
+				nSpan = 0;
 			}
-			break;
+		}
 
-		default:
-//			assert (0);
-			break;
+		if (m_nDMARxOutPtr == BT_UART_DMA_RX_SIZE) {
+			m_nDMARxOutPtr = 0;
 		}
 	}
 
+	if (nSpan > 0) {
+		m_Deframer.Parse (Span, nSpan);
+	}
+
+	BT_STATS_RECORD (BTStatsRxDeframe, nStart);
 }
 
-void CBTUARTTransport::IRQStub (void *pParam)
+void CBTUARTTransport::ProcessDMATx (void)
 {
-	CBTUARTTransport *pThis = (CBTUARTTransport *) pParam;
+	assert (m_pDMATxCB != 0);
 
-	if (pThis) pThis->IRQHandler ();
+	if (m_nDMATxLength > 0) {
+		if (read32 (ARM_DMA_CS (BT_UART_DMA_TX_CHANNEL)) & CS_ACTIVE) {
+			return;
+		}
+
+		write32 (ARM_DMA_CS (BT_UART_DMA_TX_CHANNEL), CS_END);
+		__atomic_store_n (&m_nTxOutPtr, m_nTxOutPtr + m_nDMATxLength, __ATOMIC_RELEASE);
+		m_nDMATxLength = 0;
+	}
+
+	unsigned nInPtr = __atomic_load_n (&m_nTxInPtr, __ATOMIC_ACQUIRE);
+	if (nInPtr == m_nTxOutPtr) {
+		return;
+	}
+
+	// DR takes one character per 32 bit write, so the ring is expanded
+	// into the word staging buffer
+	unsigned nLength = nInPtr - m_nTxOutPtr;
+	if (nLength > BT_UART_DMA_TX_SIZE) {
+		nLength = BT_UART_DMA_TX_SIZE;
+	}
+
+	for (unsigned i = 0; i < nLength; i++) {
+		m_pDMATxBuffer[i] = m_TxRing[(m_nTxOutPtr + i) & (BT_UART_TX_RING_SIZE-1)];
+	}
+
+	m_pDMATxCB->nTransferInformation =   DREQ_SOURCE_UART_TX << TI_PERMAP_SHIFT
+					   | TI_DEST_DREQ
+					   | TI_SRC_INC
+					   | TI_WAIT_RESP;
+	m_pDMATxCB->nSourceAddress = BUS_ADDRESS ((uintptr) m_pDMATxBuffer);
+	m_pDMATxCB->nDestinationAddress = BUS_PERIPHERAL (ARM_UART0_DR);
+	m_pDMATxCB->nTransferLength = nLength * sizeof (u32);
+	m_pDMATxCB->n2DModeStride = 0;
+	m_pDMATxCB->nNextControlBlockAddress = 0;
+
+	CleanDataCacheRange ((uintptr) m_pDMATxBuffer, nLength * sizeof (u32));
+	CleanDataCacheRange ((uintptr) m_pDMATxCB, sizeof *m_pDMATxCB);
+	DataSyncBarrier ();
+
+	m_nDMATxLength = nLength;
+
+	write32 (ARM_DMA_CONBLK_AD (BT_UART_DMA_TX_CHANNEL), BUS_ADDRESS ((uintptr) m_pDMATxCB));
+	write32 (ARM_DMA_CS (BT_UART_DMA_TX_CHANNEL),   CS_WAIT_FOR_OUTSTANDING_WRITES
+						      | 8 << CS_PANIC_PRIORITY_SHIFT
+						      | 8 << CS_PRIORITY_SHIFT
+						      | CS_ACTIVE);
 }
+
+#endif
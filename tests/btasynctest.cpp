@@ -0,0 +1,214 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Tests the asynchronous L2CAP requests
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+
+// channels to three echo peers are connected at once with callbacks,
+// configured with Poll and disconnected again; a peer which does not
+// answer lets the requests time out, and fills up the pending table
+
+#define ASYNC_PEERS		3
+#define ASYNC_SDU_SIZE		100
+#define ASYNC_RTX		BT_L2CAP_DEFAULT_RTX
+
+static volatile unsigned s_nDone = 0;
+static TBTL2CAPResult s_Results[ASYNC_PEERS];
+
+static void Done (unsigned, const TBTL2CAPResult *pResult, void *pParam)
+{
+	s_Results[(uintptr) pParam] = *pResult;
+	s_nDone++;
+}
+
+static boolean WaitDone (unsigned nCount)
+{
+	unsigned nStart = getClockTicks ();
+	while (s_nDone < nCount && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (1000);
+	}
+
+	return s_nDone == nCount;
+}
+
+// the closed channel is freed by the stack task
+static boolean WaitFreed (CBTL2CAPLayer *pL2CAP, u16 nCID)
+{
+	unsigned nStart = getClockTicks ();
+	while (pL2CAP->GetChannel (nCID) != 0 && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (1000);
+	}
+
+	return pL2CAP->GetChannel (nCID) == 0;
+}
+
+static void TestConnect (CBTL2CAPLayer *pL2CAP, CBTSimPeer **ppPeers, u16 *pCIDs)
+{
+	// the links are set up in parallel, the callbacks run in the stack task
+	s_nDone = 0;
+	for (unsigned i = 0; i < ASYNC_PEERS; i++) {
+		BT_CHECK (pL2CAP->ConnectAsync (BT_SIM_ECHO_PSM, (u8 *) ppPeers[i]->GetBDAddress (),
+						Done, (void *) (uintptr) i) != BT_L2CAP_NO_REQUEST);
+	}
+	BT_CHECK (WaitDone (ASYNC_PEERS));
+	for (unsigned i = 0; i < ASYNC_PEERS; i++) {
+		BT_CHECK (s_Results[i].nResult == BT_L2CAP_RESULT_CONNECTION_SUCCESSFUL);
+		pCIDs[i] = s_Results[i].nCID;
+		BT_CHECK (pCIDs[i] != 0 && (i == 0 || pCIDs[i] != pCIDs[i-1]));
+	}
+
+	// without a callback the results are collected
+	unsigned hRequests[ASYNC_PEERS];
+	for (unsigned i = 0; i < ASYNC_PEERS; i++) {
+		hRequests[i] = pL2CAP->ConfigureAsync (pCIDs[i], BT_SIM_PEER_MTU, 0, 0);
+		BT_CHECK (hRequests[i] != BT_L2CAP_NO_REQUEST);
+	}
+	unsigned nDone = 0;
+	unsigned nStart = getClockTicks ();
+	while (nDone < ASYNC_PEERS && getClockTicks () - nStart < TEST_TIMEOUT) {
+		for (unsigned i = 0; i < ASYNC_PEERS; i++) {
+			TBTL2CAPResult Result;
+			if (   hRequests[i] != BT_L2CAP_NO_REQUEST
+			    && pL2CAP->Poll (hRequests[i], &Result)) {
+				BT_CHECK (Result.nResult == BT_L2CAP_RESULT_SUCCESS);
+				hRequests[i] = BT_L2CAP_NO_REQUEST;
+				nDone++;
+			}
+		}
+		sleepTask (1000);
+	}
+	BT_CHECK (nDone == ASYNC_PEERS);
+
+	// open once the peers' requests were answered too
+	TBTL2CAPPollEntry Entries[ASYNC_PEERS];
+	for (unsigned i = 0; i < ASYNC_PEERS; i++) {
+		Entries[i].nCID = pCIDs[i];
+		Entries[i].nEvents = BT_L2CAP_POLL_WRITE;
+	}
+	nStart = getClockTicks ();
+	while (   pL2CAP->PollChannels (Entries, ASYNC_PEERS, TEST_TIMEOUT) < ASYNC_PEERS
+	       && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (1000);
+	}
+	for (unsigned i = 0; i < ASYNC_PEERS; i++) {
+		BT_CHECK (Entries[i].nReady == BT_L2CAP_POLL_WRITE);
+
+		u8 SDU[ASYNC_SDU_SIZE];
+		memset (SDU, i, sizeof SDU);
+		u16 nLength;
+		BT_CHECK (pL2CAP->Write (pCIDs[i], sizeof SDU, SDU, 0) == BT_L2CAP_RESULT_SUCCESS);
+		BT_CHECK (   pL2CAP->Read (pCIDs[i], sizeof SDU, SDU, &nLength, TEST_TIMEOUT)
+				== BT_L2CAP_RESULT_SUCCESS
+			  && nLength == sizeof SDU && SDU[0] == i);
+	}
+}
+
+static void TestTimeout (CBTL2CAPLayer *pL2CAP, CBTSimPeer *pPeer, u16 nCID)
+{
+	pPeer->SetIgnoreSignalling (TRUE);
+
+	unsigned nStart = getClockTicks ();
+	TBTL2CAPResult Result;
+	BT_CHECK (pL2CAP->WaitRequest (pL2CAP->ConfigureAsync (nCID, BT_SIM_PEER_MTU, 0, 0), &Result)
+		  == BT_L2CAP_RESULT_REJECTED);
+	BT_CHECK (getClockTicks () - nStart >= ASYNC_RTX);
+
+	// every slot of the table is taken, the next request is refused
+	unsigned hRequests[BT_L2CAP_MAX_PENDING];
+	for (unsigned i = 0; i < BT_L2CAP_MAX_PENDING; i++) {
+		hRequests[i] = pL2CAP->ConfigureAsync (nCID, BT_SIM_PEER_MTU, 0, 0);
+		BT_CHECK (hRequests[i] != BT_L2CAP_NO_REQUEST);
+	}
+	BT_CHECK (pL2CAP->ConfigureAsync (nCID, BT_SIM_PEER_MTU, 0, 0) == BT_L2CAP_NO_REQUEST);
+	BT_CHECK (pL2CAP->DisconnectAsync (nCID) == BT_L2CAP_NO_REQUEST);
+	for (unsigned i = 0; i < BT_L2CAP_MAX_PENDING; i++) {
+		if (hRequests[i] != BT_L2CAP_NO_REQUEST) {
+			BT_CHECK (pL2CAP->WaitRequest (hRequests[i]) == BT_L2CAP_RESULT_REJECTED);
+		}
+	}
+
+	// the slots are free again; a disconnect closes the channel here,
+	// even if it is not answered
+	unsigned hRequest = pL2CAP->DisconnectAsync (nCID);
+	BT_CHECK (hRequest != BT_L2CAP_NO_REQUEST);
+	if (hRequest != BT_L2CAP_NO_REQUEST) {
+		BT_CHECK (pL2CAP->WaitRequest (hRequest, &Result)
+			  == BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED);
+		BT_CHECK (Result.nCID == nCID);
+	}
+	BT_CHECK (WaitFreed (pL2CAP, nCID));
+
+	pPeer->SetIgnoreSignalling (FALSE);
+}
+
+static void TestDisconnect (CBTL2CAPLayer *pL2CAP, const u16 *pCIDs, unsigned nChannels)
+{
+	s_nDone = 0;
+	for (unsigned i = 0; i < nChannels; i++) {
+		BT_CHECK (pL2CAP->DisconnectAsync (pCIDs[i], Done, (void *) (uintptr) i)
+			  != BT_L2CAP_NO_REQUEST);
+	}
+	BT_CHECK (WaitDone (nChannels));
+	for (unsigned i = 0; i < nChannels; i++) {
+		BT_CHECK (s_Results[i].nResult == BT_L2CAP_RESULT_DISCONNECTION_SUCCESSFUL);
+		BT_CHECK (s_Results[i].nCID == pCIDs[i]);
+		BT_CHECK (WaitFreed (pL2CAP, pCIDs[i]));
+	}
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	CBTSimPeer *Peers[ASYNC_PEERS];
+	u8 BDAddr[BT_BD_ADDR_SIZE] = {0x00, 0x22, 0x33, 0x44, 0x55, 0x66};
+	for (unsigned i = 0; i < ASYNC_PEERS; i++) {
+		BDAddr[0] = 0x21 + i;
+		Peers[i] = new CBTSimEchoPeer (BDAddr);
+	}
+	CBTSubSystem *pBT = BTTestBoot (Peers, ASYNC_PEERS);
+	if (pBT == 0 || !BTTestAddDevices (pBT, Peers, ASYNC_PEERS)) {
+		return BT_TEST_RESULT ();
+	}
+	CBTL2CAPLayer *pL2CAP = BTTestRegisterPSM (pBT, BT_SIM_ECHO_PSM);
+
+	u16 CIDs[ASYNC_PEERS];
+	TestConnect (pL2CAP, Peers, CIDs);
+	TestTimeout (pL2CAP, Peers[0], CIDs[0]);
+	TestDisconnect (pL2CAP, CIDs + 1, ASYNC_PEERS - 1);
+
+	return BT_TEST_RESULT ();
+}
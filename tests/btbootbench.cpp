@@ -0,0 +1,84 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Times the stack startup with the patch download
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+#include <stdlib.h>
+
+// Boots the stack against the simulated controller, which takes the same
+// patch as the Pi's, and times Initialize until the controller is running.
+// The controller answers each command after the response delay and takes
+// as many at once as it has command slots, so run it with 1 and with more
+// slots to see the records pipelined. The last line is one JSON object
+// (the stack logs before it).
+//
+// usage: btbootbench [command slots [response delay us [restart us]]]
+
+#define BENCH_SLOTS		1
+#define BENCH_RESPONSE_DELAY	200	// us, about one UART round trip
+#define BENCH_RESTART_TIME	10000	// us after Launch RAM
+
+int main (int argc, char **argv)
+{
+	unsigned nSlots = argc > 1 ? atoi (argv[1]) : BENCH_SLOTS;
+	unsigned nDelay = argc > 2 ? atoi (argv[2]) : BENCH_RESPONSE_DELAY;
+	unsigned nRestart = argc > 3 ? atoi (argv[3]) : BENCH_RESTART_TIME;
+	if (nSlots == 0) {
+		nSlots = BENCH_SLOTS;
+	}
+
+	CBTSimController *pController = BTTestController ();
+	pController->SetCommandPackets (nSlots);
+	pController->SetResponseDelay (nDelay);
+	pController->SetRestartTime (nRestart);
+
+	unsigned nStart = getClockTicks ();
+	CBTSubSystem *pBT = BTTestBoot (0, 0);
+	unsigned nBoot = getClockTicks () - nStart;
+	if (pBT == 0) {
+		printf ("{\"error\":\"controller not running\"}\n");
+		return 1;
+	}
+
+	printf ("{\"command_slots\":%u,\"response_delay_us\":%u,\"restart_us\":%u,"
+		"\"boot_us\":%u,\"commands\":%u,\"firmware_bytes\":%u,"
+		"\"command_overruns\":%u,\"commands_lost\":%u}\n",
+		nSlots, nDelay, nRestart, nBoot,
+		pController->GetCommands (), pController->GetFirmwareBytes (),
+		pController->GetCommandOverruns (), pController->GetCommandsLost ());
+
+	return pController->GetCommandOverruns () == 0 ? 0 : 1;
+}
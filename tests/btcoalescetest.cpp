@@ -0,0 +1,227 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Replays a mouse session with and without event coalescing
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+#include <stdlib.h>
+
+// a scripted session of moves, drags, clicks and wheel bursts is replayed
+// once as it is and once coalesced, the events are read once per frame of
+// 16 reports; both have to add up to the motion sent and give the same
+// button edges in the same order, the coalesced one with far fewer events;
+// nothing may be lost
+
+#define SESSION_REPORTS		3900
+#define SESSION_FRAME		16	// reports per display frame
+#define SESSION_MAX_EDGES	SESSION_REPORTS
+
+static const u8 MouseAddr[BT_BD_ADDR_SIZE] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+struct TSessionReport
+{
+	signed char	nX;
+	signed char	nY;
+	signed char	nWheel;
+	u8		nButtons;
+};
+
+static TSessionReport s_Session[SESSION_REPORTS + 8];
+static unsigned s_nSessionLength = 0;
+
+static unsigned s_nSeed = 12345;
+
+static unsigned Random (unsigned nRange)
+{
+	s_nSeed = s_nSeed * 1103515245 + 12345;
+	return (s_nSeed >> 16) % nRange;
+}
+
+static void Record (signed char nX, signed char nY, signed char nWheel, u8 nButtons)
+{
+	TSessionReport *pReport = &s_Session[s_nSessionLength++];
+	pReport->nX = nX;
+	pReport->nY = nY;
+	pReport->nWheel = nWheel;
+	pReport->nButtons = nButtons;
+}
+
+static void MakeSession (void)
+{
+	while (s_nSessionLength < SESSION_REPORTS - 128) {
+		switch (Random (4)) {
+		case 0: {				// a fast move
+			unsigned n = 20 + Random (80);
+			for (unsigned i = 0; i < n; i++) {
+				Record (Random (61) - 30, Random (61) - 30, 0, 0);
+			}
+			} break;
+
+		case 1: {				// a drag with the left button
+			// CBTMouse takes the first two reports of a press as the
+			// press, the button goes down before the mouse moves
+			Record (0, 0, 0, 1);
+			Record (0, 0, 0, 1);
+			unsigned n = 3 + Random (30);
+			for (unsigned i = 0; i < n; i++) {
+				Record (Random (21) - 10, Random (21) - 10, 0, 1);
+			}
+			Record (0, 0, 0, 0);
+			} break;
+
+		case 2: {				// a wheel burst
+			unsigned n = 5 + Random (20);
+			for (unsigned i = 0; i < n; i++) {
+				Record (0, 0, Random (3) ? 1 : -1, 0);
+			}
+			} break;
+
+		default:				// a right click, then a jump
+			Record (0, 0, 0, 2);
+			Record (0, 0, 0, 2);
+			Record (0, 0, 0, 0);
+			Record (100, -100, 5, 0);
+			Record (120, 127, 0, 0);
+			break;
+		}
+	}
+}
+
+struct TSessionResult
+{
+	int		nX;
+	int		nY;
+	int		nWheel;
+	unsigned	nEvents;
+	unsigned	nEdges;
+	u16		Edges[SESSION_MAX_EDGES];	// type and button
+};
+
+static void Receive (CBTHIDDevice *pDevice, TSessionResult *pResult)
+{
+	u8 Buffer[BT_HIDP_MAX_EVENT_SIZE];
+	unsigned nLength;
+	while (pDevice->ReceiveEvent (Buffer, &nLength)) {
+		UGEvent *pEvent = (UGEvent *) Buffer;
+		BT_CHECK (pEvent->GetSource () == UG_MOUSE);
+		pResult->nEvents++;
+
+		switch (pEvent->GetType ()) {
+		case UG_MOUSE_MOVE:
+			pResult->nX += ((UGMouseMoveEvent *) Buffer)->GetX ();
+			pResult->nY += ((UGMouseMoveEvent *) Buffer)->GetY ();
+			break;
+
+		case UG_MOUSE_SCROLL:
+			pResult->nWheel += ((UGScrollEvent *) Buffer)->GetScroll ();
+			break;
+
+		default:
+			// press, release and click carry the button at one place
+			if (pResult->nEdges < SESSION_MAX_EDGES) {
+				pResult->Edges[pResult->nEdges++] =
+					pEvent->GetType () << 8 | ((UGButtonPressEvent *) Buffer)->GetButton ();
+			}
+			break;
+		}
+	}
+}
+
+static void Replay (CBTSimMouse *pMouse, CBTHIDDevice *pDevice, boolean bCoalescing,
+		    TSessionResult *pResult)
+{
+	memset (pResult, 0, sizeof *pResult);
+	pDevice->SetCoalescing (bCoalescing);
+
+	// a frame is read once the host decoded all of its reports, so the
+	// events of a frame do not depend on how the tasks are scheduled
+	unsigned nDecoded = pDevice->GetInputCount ();
+	for (unsigned i = 0; i < s_nSessionLength; i++) {
+		const TSessionReport *pReport = &s_Session[i];
+		unsigned nStart = getClockTicks ();
+		while (   !pMouse->Move (pReport->nX, pReport->nY, pReport->nWheel, pReport->nButtons)
+		       && getClockTicks () - nStart < TEST_TIMEOUT) {
+			sleepTask (100);
+		}
+		if (i % SESSION_FRAME == SESSION_FRAME - 1 || i == s_nSessionLength - 1) {
+			BT_CHECK (BTTestWaitInput (pDevice, nDecoded + i + 1));
+			Receive (pDevice, pResult);
+		}
+	}
+	BT_CHECK (pDevice->GetEventDrops () == 0);
+
+	printf ("%s: %u events, moved %d,%d, wheel %d, %u button edges\n",
+		bCoalescing ? "coalesced" : "direct", pResult->nEvents,
+		pResult->nX, pResult->nY, pResult->nWheel, pResult->nEdges);
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	MakeSession ();
+	int nX = 0, nY = 0, nWheel = 0;
+	for (unsigned i = 0; i < s_nSessionLength; i++) {
+		nX += s_Session[i].nX;
+		nY += s_Session[i].nY;
+		nWheel += s_Session[i].nWheel;
+	}
+
+	CBTSimMouse *pMouse = new CBTSimMouse (MouseAddr);
+	CBTSimPeer *pPeer = pMouse;
+	CBTSubSystem *pBT = BTTestBoot (&pPeer, 1);
+	if (pBT == 0 || BTTestAcceptAll (pBT, &pPeer, 1) != 1) {
+		return BT_TEST_RESULT ();
+	}
+	CBTHIDDevice *pDevice = BTTestGetDevice (pBT, pMouse);
+	BT_CHECK (pDevice != 0);
+	if (pDevice == 0) {
+		return BT_TEST_RESULT ();
+	}
+
+	static TSessionResult Direct, Coalesced;
+	Replay (pMouse, pDevice, FALSE, &Direct);
+	Replay (pMouse, pDevice, TRUE, &Coalesced);
+
+	BT_CHECK (pMouse->GetReportsSent () == 2 * s_nSessionLength);
+	BT_CHECK (Direct.nX == nX && Direct.nY == nY && Direct.nWheel == nWheel);
+	BT_CHECK (Coalesced.nX == nX && Coalesced.nY == nY && Coalesced.nWheel == nWheel);
+	BT_CHECK (Direct.nEdges > 0);
+	BT_CHECK (Coalesced.nEdges == Direct.nEdges);
+	BT_CHECK (memcmp (Coalesced.Edges, Direct.Edges, Direct.nEdges * sizeof Direct.Edges[0]) == 0);
+	BT_CHECK (Coalesced.nEvents < Direct.nEvents / 2);
+
+	return BT_TEST_RESULT ();
+}
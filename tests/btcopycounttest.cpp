@@ -0,0 +1,93 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Counts the payload copies a HID report costs on its way up the stack
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+#include <bluetooth/btpacket.h>
+
+// a single fragment report is read into a pooled packet once by the
+// transport, every layer above only moves the data offset
+
+static const u8 MouseAddr[BT_BD_ADDR_SIZE] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	CBTSimMouse *pMouse = new CBTSimMouse (MouseAddr);
+	CBTSimPeer *Peers[] = {pMouse};
+
+	CBTSubSystem *pBT = BTTestBoot (Peers, 1);
+	if (pBT == 0 || BTTestAcceptAll (pBT, Peers, 1) != 1) {
+		return BT_TEST_RESULT ();
+	}
+	CBTHIDDevice *pDevice = BTTestGetDevice (pBT, pMouse);
+	BT_CHECK (pDevice != 0);
+	if (pDevice == 0) {
+		return BT_TEST_RESULT ();
+	}
+
+	// let the connection setup traffic settle, it is not counted
+	sleepTask (100000);
+	CBTPacketPool::ResetCopies ();
+
+	const unsigned nReports = 100;
+	for (unsigned i = 0; i < nReports; i++) {
+		BT_CHECK (pMouse->Move (1, 1));
+		// one report per read, so none of them is coalesced
+		BT_CHECK (BTTestReceiveEvents (pDevice, 1, UG_MOUSE) == 1);
+	}
+
+	unsigned nCopies = 0;
+	for (unsigned i = BTCopyLayerTransport; i < BTCopyLayerUnknown; i++) {
+		nCopies += CBTPacketPool::GetCopies ((TBTCopyLayer) i);
+	}
+	printf ("%u reports, %u copies (transport %u, hci %u, logical %u, l2cap %u, hidp %u)\n",
+		nReports, nCopies,
+		CBTPacketPool::GetCopies (BTCopyLayerTransport),
+		CBTPacketPool::GetCopies (BTCopyLayerHCI),
+		CBTPacketPool::GetCopies (BTCopyLayerLogical),
+		CBTPacketPool::GetCopies (BTCopyLayerL2CAP),
+		CBTPacketPool::GetCopies (BTCopyLayerHIDP));
+
+	BT_CHECK (CBTPacketPool::GetCopies (BTCopyLayerTransport) == nReports);
+	BT_CHECK (nCopies == nReports);
+
+	// every packet went back to the pool
+	BT_CHECK (CBTPacketPool::Get ()->GetFreeCount () == BT_PACKET_POOL_SIZE);
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,164 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Measures the bytes per cycle of the slice-by-8 FCS
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btcrc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined (__x86_64__) || defined (__i386__)
+	#include <x86intrin.h>
+#endif
+
+// Runs CBTCRC16::Update over frames of typical sizes, one byte off
+// alignment like an I-frame payload, against the bytewise table loop it
+// replaced. Cycles are read from the TSC where there is one; elsewhere
+// only the time is given.
+
+#define BENCH_BYTES		(64 * 1024 * 1024)	// per frame size and method
+#define BENCH_MAX_FRAME		4096
+#define BENCH_REPEATS		3			// the best one counts
+
+static u16 s_ByteTable[256];
+static u8 s_Buffer[BENCH_MAX_FRAME + 1];
+
+static void InitByteTable (void)
+{
+	for (unsigned i = 0; i < 256; i++) {
+		u16 nCRC = i;
+		for (unsigned nBit = 0; nBit < 8; nBit++) {
+			nCRC = nCRC & 1 ? (nCRC >> 1) ^ 0xA001 : nCRC >> 1;
+		}
+		s_ByteTable[i] = nCRC;
+	}
+}
+
+static u16 UpdateBytewise (u16 nCRC, const u8 *p, unsigned nLength)
+{
+	while (nLength--) {
+		nCRC = (nCRC >> 8) ^ s_ByteTable[(nCRC ^ *p++) & 0xFF];
+	}
+
+	return nCRC;
+}
+
+static double Seconds (void)
+{
+	struct timespec Time;
+	clock_gettime (CLOCK_MONOTONIC, &Time);
+
+	return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+static u64 Cycles (void)
+{
+#if defined (__x86_64__) || defined (__i386__)
+	return __rdtsc ();
+#else
+	return 0;
+#endif
+}
+
+int main (void)
+{
+	static const unsigned Sizes[] = {16, 64, 256, 680, 1024, BENCH_MAX_FRAME};
+	unsigned nFailed = 0;
+
+	InitByteTable ();
+	srand (19);
+	for (unsigned i = 0; i < sizeof s_Buffer; i++) {
+		s_Buffer[i] = (u8) rand ();
+	}
+	const u8 *pFrame = s_Buffer + 1;
+
+	printf ("[\n");
+	for (unsigned s = 0; s < sizeof Sizes / sizeof Sizes[0]; s++) {
+		unsigned nSize = Sizes[s];
+		unsigned nFrames = BENCH_BYTES / nSize;
+
+		double fByteTime = 1e9, fSliceTime = 1e9;
+		u64 nByteCycles = ~(u64) 0, nSliceCycles = ~(u64) 0;
+		u16 nByteCRC = 0, nSliceCRC = 0;
+		for (unsigned n = 0; n < BENCH_REPEATS; n++) {
+			// the running CRC feeds the next frame, so frames do not overlap
+			double fStart = Seconds ();
+			u64 nStart = Cycles ();
+			for (unsigned i = 0; i < nFrames; i++) {
+				nByteCRC = UpdateBytewise (nByteCRC, pFrame, nSize);
+			}
+			u64 nCycles = Cycles () - nStart;
+			double fTime = Seconds () - fStart;
+			if (fTime < fByteTime) {
+				fByteTime = fTime;
+				nByteCycles = nCycles;
+			}
+
+			fStart = Seconds ();
+			nStart = Cycles ();
+			for (unsigned i = 0; i < nFrames; i++) {
+				nSliceCRC = CBTCRC16::Update (nSliceCRC, pFrame, nSize);
+			}
+			nCycles = Cycles () - nStart;
+			fTime = Seconds () - fStart;
+			if (fTime < fSliceTime) {
+				fSliceTime = fTime;
+				nSliceCycles = nCycles;
+			}
+		}
+
+		if (nByteCRC != nSliceCRC) {
+			nFailed++;
+		}
+
+		double fBytes = (double) nFrames * nSize;
+		printf (" {\"frame\": %u, \"bytewise_mbps\": %.0f, \"slice8_mbps\": %.0f",
+			nSize, fBytes / fByteTime / 1e6, fBytes / fSliceTime / 1e6);
+		if (nSliceCycles != 0) {
+			printf (", \"bytewise_bytes_per_cycle\": %.3f, \"slice8_bytes_per_cycle\": %.3f",
+				fBytes / nByteCycles, fBytes / nSliceCycles);
+		}
+		printf (", \"speedup\": %.2f}%s\n", fByteTime / fSliceTime,
+			s + 1 < sizeof Sizes / sizeof Sizes[0] ? "," : "");
+	}
+	printf ("]\n");
+
+	if (nFailed != 0) {
+		printf ("FAILED: %u frame sizes give a different FCS\n", nFailed);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,110 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Checks the L2CAP FCS against known values and a bitwise CRC
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btcrc.h>
+#include <bttest.h>
+#include <stdlib.h>
+
+// the slice-by-8 tables against the known check value and a plain bitwise
+// CRC, over every length and alignment the frames of a channel can have
+
+#define TEST_BUFFER		1024
+#define TEST_FRAMES		20000
+
+// one bit at a time, polynomial 0x8005 reflected
+static u16 BitwiseCRC (u16 nCRC, const u8 *pData, unsigned nLength)
+{
+	while (nLength--) {
+		nCRC ^= *pData++;
+		for (unsigned i = 0; i < 8; i++) {
+			nCRC = nCRC & 1 ? (nCRC >> 1) ^ 0xA001 : nCRC >> 1;
+		}
+	}
+	return nCRC;
+}
+
+int main (void)
+{
+	// the catalogue check value of this CRC (CRC-16/ARC)
+	static const u8 Check[] = "123456789";
+	BT_CHECK (CBTCRC16::Update (0, Check, 9) == 0xBB3D);
+	BT_CHECK (BitwiseCRC (0, Check, 9) == 0xBB3D);
+	BT_CHECK (CBTCRC16::Update (0, 0, 0) == 0);
+
+	static u8 Buffer[TEST_BUFFER + 8];
+	srand (1);
+	for (unsigned i = 0; i < sizeof Buffer; i++) {
+		Buffer[i] = (u8) rand ();
+	}
+
+	// every length up to a block and a half, from every alignment
+	for (unsigned nOffset = 0; nOffset < 8; nOffset++) {
+		for (unsigned nLength = 0; nLength <= 12; nLength++) {
+			BT_CHECK (   CBTCRC16::Update (0, Buffer + nOffset, nLength)
+				  == BitwiseCRC (0, Buffer + nOffset, nLength));
+		}
+	}
+
+	// random frames, computed in one go and in two parts
+	boolean bOK = TRUE;
+	for (unsigned i = 0; i < TEST_FRAMES && bOK; i++) {
+		unsigned nOffset = rand () % 8;
+		unsigned nLength = rand () % (TEST_BUFFER + 1);
+		unsigned nSplit = rand () % (nLength + 1);
+		const u8 *p = Buffer + nOffset;
+		u16 nInit = (u16) rand ();	// the result over an earlier part
+		u16 nExpected = BitwiseCRC (nInit, p, nLength);
+		u16 nWhole = CBTCRC16::Update (nInit, p, nLength);
+		u16 nParts = CBTCRC16::Update (CBTCRC16::Update (nInit, p, nSplit),
+					       p + nSplit, nLength - nSplit);
+		if (nWhole != nExpected || nParts != nExpected) {
+			printf ("mismatch at frame %u, length %u offset %u\n", i, nLength, nOffset);
+			bOK = FALSE;
+		}
+	}
+	BT_CHECK (bOK);
+
+	// a frame followed by its FCS, LSB first, leaves no remainder
+	u16 nFCS = CBTCRC16::Update (0, Buffer, 100);
+	Buffer[100] = (u8) nFCS;
+	Buffer[101] = (u8) (nFCS >> 8);
+	BT_CHECK (CBTCRC16::Update (0, Buffer, 102) == 0);
+
+	printf ("%u frames\n", TEST_FRAMES);
+
+	return BT_TEST_RESULT ();
+}
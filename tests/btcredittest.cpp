@@ -0,0 +1,105 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Checks the ACL credits the host keeps against the simulated controller's buffers
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+
+// the host may hold as many ACL packets in the controller as Read Buffer
+// Size reported, shared between all connections, and gets every one of
+// them back through Number Of Completed Packets
+
+#define CREDIT_BUFFERS		4
+#define CREDIT_MESSAGES		100	// per device
+#define CREDIT_LENGTH		200
+
+static const u8 MouseAddr[BT_BD_ADDR_SIZE] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+static const u8 KeyboardAddr[BT_BD_ADDR_SIZE] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x67};
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	CBTSimMouse *pMouse = new CBTSimMouse (MouseAddr);
+	CBTSimKeyboard *pKeyboard = new CBTSimKeyboard (KeyboardAddr);
+	CBTSimPeer *Peers[] = {pMouse, pKeyboard};
+
+	// Read Buffer Size reports fewer buffers than the default
+	CBTSimController *pController = BTTestController ();
+	pController->SetACLBuffers (CREDIT_BUFFERS, BT_SIM_ACL_LENGTH);
+
+	CBTSubSystem *pBT = BTTestBoot (Peers, 2);
+	if (pBT == 0 || BTTestAcceptAll (pBT, Peers, 2) != 2) {
+		return BT_TEST_RESULT ();
+	}
+	CBTHIDDevice *pDevices[] = {BTTestGetDevice (pBT, pMouse), BTTestGetDevice (pBT, pKeyboard)};
+	BT_CHECK (pDevices[0] != 0 && pDevices[1] != 0);
+	if (pDevices[0] == 0 || pDevices[1] == 0) {
+		return BT_TEST_RESULT ();
+	}
+
+	// slow completions, so the host runs out of credits long before the
+	// burst is through
+	sleepTask (100000);
+	pController->SetAirTime (250);
+	pController->SetResponseDelay (2000);
+	unsigned nBase = pController->GetACLPackets ();
+
+	u8 Message[CREDIT_LENGTH];
+	memset (Message, 0xA2, sizeof Message);
+	for (unsigned i = 0; i < CREDIT_MESSAGES; i++) {
+		for (unsigned j = 0; j < 2; j++) {
+			BT_CHECK (!pDevices[j]->SendInterruptMessage (Message, sizeof Message));
+		}
+	}
+
+	unsigned nStart = getClockTicks ();
+	while (   pController->GetACLPackets () - nBase < 2 * CREDIT_MESSAGES
+	       && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (1000);
+	}
+
+	printf ("%u packets, %u buffers used at most, %u overruns\n",
+		pController->GetACLPackets () - nBase,
+		pController->GetACLBuffersUsed (),
+		pController->GetACLOverruns ());
+
+	BT_CHECK (pController->GetACLPackets () - nBase == 2 * CREDIT_MESSAGES);
+	// never more than the controller has, but all of it
+	BT_CHECK (pController->GetACLOverruns () == 0);
+	BT_CHECK (pController->GetACLBuffersUsed () == CREDIT_BUFFERS);
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,255 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Model of the BCM2835 DMA engine for host tests
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btdmafake.h>
+#include <btpl011fake.h>
+#include <memio.h>
+#include <platform/bt_dma.h>
+#include <platform/bt_uart.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CS_STATUS_MASK	(CS_ACTIVE | CS_END | CS_INT | CS_ERROR)
+#define CS_COMMAND_MASK	(CS_RESET | CS_ABORT)
+
+#define BUS_PERIPHERAL_END	(BUS_PERIPHERAL_BASE + 0x1000000)
+
+CBCMDMAFake *CBCMDMAFake::s_pThis = 0;
+
+CBCMDMAFake::CBCMDMAFake (void)
+:	m_nEnable (0),
+	m_nWords (0),
+	m_nErrors (0)
+{
+	memset (m_Channel, 0, sizeof m_Channel);
+
+	assert (s_pThis == 0);
+	s_pThis = this;
+}
+
+CBCMDMAFake::~CBCMDMAFake (void)
+{
+	s_pThis = 0;
+}
+
+u32 CBCMDMAFake::Read (uintptr nAddress)
+{
+	if (nAddress == ARM_DMA_ENABLE) {
+		return m_nEnable;
+	}
+
+	unsigned nChannel = (nAddress - ARM_DMA_BASE (0)) / 0x100;
+	assert (nChannel < DMA_FAKE_CHANNELS);
+	const TChannel *pChannel = &m_Channel[nChannel];
+
+	switch (nAddress - ARM_DMA_BASE (nChannel)) {
+	case 0x00:	return pChannel->nCS;
+	case 0x04:	return pChannel->nConBlkAd;
+	case 0x08:	return pChannel->nTI;
+	case 0x0C:	return pChannel->nSourceAd;
+	case 0x10:	return pChannel->nDestAd;
+	case 0x14:	return pChannel->nTxfrLen;
+	case 0x1C:	return pChannel->nNextConBk;
+	case 0x20:	return 0;			// DEBUG
+
+	default:
+		printf ("dma: read of unknown register 0x%08lX\n", (unsigned long) nAddress);
+		m_nErrors++;
+		return 0;
+	}
+}
+
+void CBCMDMAFake::Write (uintptr nAddress, u32 nValue)
+{
+	if (nAddress == ARM_DMA_ENABLE) {
+		m_nEnable = nValue;
+		return;
+	}
+
+	unsigned nChannel = (nAddress - ARM_DMA_BASE (0)) / 0x100;
+	assert (nChannel < DMA_FAKE_CHANNELS);
+	TChannel *pChannel = &m_Channel[nChannel];
+
+	switch (nAddress - ARM_DMA_BASE (nChannel)) {
+	case 0x00:
+		if (nValue & CS_RESET) {
+			memset (pChannel, 0, sizeof *pChannel);
+			break;
+		}
+
+		// END and INT are write 1 to clear
+		pChannel->nCS &= ~(nValue & (CS_END | CS_INT));
+
+		if (nValue & CS_ACTIVE) {
+			if (!(pChannel->nCS & CS_ACTIVE) && pChannel->nConBlkAd != 0) {
+				LoadControlBlock (pChannel);
+			}
+			pChannel->nCS |= CS_ACTIVE;
+		} else {
+			pChannel->nCS &= ~CS_ACTIVE;		// pause
+		}
+
+		pChannel->nCS =   (pChannel->nCS & CS_STATUS_MASK)
+				| (nValue & ~(CS_STATUS_MASK | CS_COMMAND_MASK));
+		break;
+
+	case 0x04:
+		pChannel->nConBlkAd = nValue;
+		break;
+
+	case 0x20:					// DEBUG, error flags
+		break;
+
+	default:
+		printf ("dma: write of read-only or unknown register 0x%08lX\n", (unsigned long) nAddress);
+		m_nErrors++;
+		break;
+	}
+}
+
+unsigned CBCMDMAFake::Tick (unsigned nWords)
+{
+	unsigned nMoved = 0;
+
+	for (unsigned nChannel = 0; nChannel < DMA_FAKE_CHANNELS; nChannel++) {
+		TChannel *pChannel = &m_Channel[nChannel];
+
+		for (unsigned i = 0; i < nWords; i++) {
+			if (   !(pChannel->nCS & CS_ACTIVE)
+			    || !(m_nEnable & (1 << nChannel))
+			    || !DREQ (pChannel)) {
+				break;
+			}
+
+			Store (pChannel->nDestAd, Load (pChannel->nSourceAd));
+
+			if (pChannel->nTI & TI_SRC_INC)		pChannel->nSourceAd += 4;
+			if (pChannel->nTI & TI_DEST_INC)	pChannel->nDestAd += 4;
+			pChannel->nTxfrLen = pChannel->nTxfrLen > 4 ? pChannel->nTxfrLen - 4 : 0;
+			nMoved++;
+
+			if (pChannel->nTxfrLen > 0) {
+				continue;
+			}
+
+			pChannel->nCS |= CS_END;
+			if (pChannel->nTI & TI_INTEN) {
+				pChannel->nCS |= CS_INT;
+			}
+
+			if (pChannel->nNextConBk != 0) {
+				pChannel->nConBlkAd = pChannel->nNextConBk;
+				LoadControlBlock (pChannel);
+			} else {
+				pChannel->nConBlkAd = 0;
+				pChannel->nCS &= ~CS_ACTIVE;
+			}
+		}
+	}
+
+	m_nWords += nMoved;
+
+	return nMoved;
+}
+
+CBCMDMAFake *CBCMDMAFake::Get (void)
+{
+	return s_pThis;
+}
+
+void CBCMDMAFake::LoadControlBlock (TChannel *pChannel)
+{
+	assert ((pChannel->nConBlkAd & 31) == 0);
+	const rpi_dma_control_block_t *pCB =
+		(const rpi_dma_control_block_t *) DMAFakeHostAddress (pChannel->nConBlkAd);
+
+	pChannel->nTI = pCB->nTransferInformation;
+	pChannel->nSourceAd = pCB->nSourceAddress;
+	pChannel->nDestAd = pCB->nDestinationAddress;
+	pChannel->nTxfrLen = pCB->nTransferLength;
+	pChannel->nNextConBk = pCB->nNextControlBlockAddress;
+
+	if (pChannel->nTI & (TI_SRC_WIDTH | TI_DEST_WIDTH | TI_TDMODE)) {
+		printf ("dma: 128 bit and 2D transfers are not modelled\n");
+		m_nErrors++;
+	}
+}
+
+boolean CBCMDMAFake::DREQ (const TChannel *pChannel) const
+{
+	if (!(pChannel->nTI & (TI_SRC_DREQ | TI_DEST_DREQ))) {
+		return TRUE;				// unpaced
+	}
+
+	CPL011Fake *pUART = CPL011Fake::Get ();
+	if (pUART == 0) {
+		return FALSE;
+	}
+
+	switch ((pChannel->nTI >> TI_PERMAP_SHIFT) & 0x1F) {
+	case DREQ_SOURCE_UART_RX:
+		return (pUART->GetDMACR () & DMACR_RXDMAE) && pUART->GetRxLevel () > 0;
+
+	case DREQ_SOURCE_UART_TX:
+		return (pUART->GetDMACR () & DMACR_TXDMAE) && pUART->GetTxLevel () < PL011_FIFO_SIZE;
+
+	default:
+		return FALSE;
+	}
+}
+
+u32 CBCMDMAFake::Load (u32 nBusAddress)
+{
+	if (nBusAddress >= BUS_PERIPHERAL_BASE && nBusAddress < BUS_PERIPHERAL_END) {
+		return read32 (nBusAddress - BUS_PERIPHERAL_BASE + BCM2835_PERI_BASE);
+	}
+
+	assert ((nBusAddress & 3) == 0);
+	return *(u32 *) DMAFakeHostAddress (nBusAddress);
+}
+
+void CBCMDMAFake::Store (u32 nBusAddress, u32 nValue)
+{
+	if (nBusAddress >= BUS_PERIPHERAL_BASE && nBusAddress < BUS_PERIPHERAL_END) {
+		write32 (nBusAddress - BUS_PERIPHERAL_BASE + BCM2835_PERI_BASE, nValue);
+		return;
+	}
+
+	assert ((nBusAddress & 3) == 0);
+	*(u32 *) DMAFakeHostAddress (nBusAddress) = nValue;
+}
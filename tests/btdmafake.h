@@ -0,0 +1,97 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Model of the BCM2835 DMA engine for host tests
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_dmafake_h
+#define _bt_dmafake_h
+
+#include <types.h>
+
+#define DMA_FAKE_CHANNELS	16
+
+// Models the channel registers (CS, CONBLK_AD, TI, SOURCE_AD, DEST_AD,
+// TXFR_LEN) and ENABLE. Setting CS_ACTIVE loads the control block at
+// CONBLK_AD, a finished block chains to its NEXTCONBK or ends the
+// transfer. Like the real engine each DREQ paced transfer moves one
+// 32 bit word, peripheral addresses go through read32 / write32 and the
+// PL011 FIFO levels are the UART DREQ lines. 128 bit width, 2D mode
+// and bursts are not modelled.
+class CBCMDMAFake
+{
+public:
+	CBCMDMAFake (void);
+	~CBCMDMAFake (void);
+
+	// register accesses, called through read32 / write32
+	u32 Read (uintptr nAddress);
+	void Write (uintptr nAddress, u32 nValue);
+
+	// moves up to nWords words on every active channel, returns the total
+	unsigned Tick (unsigned nWords = 1);
+
+	unsigned GetWords (void) const		{ return m_nWords; }
+	unsigned GetErrors (void) const		{ return m_nErrors; }
+
+	static CBCMDMAFake *Get (void);
+
+private:
+	struct TChannel
+	{
+		u32 nCS;
+		u32 nConBlkAd;
+		u32 nTI;
+		u32 nSourceAd;
+		u32 nDestAd;
+		u32 nTxfrLen;
+		u32 nNextConBk;
+	};
+
+	void LoadControlBlock (TChannel *pChannel);
+	boolean DREQ (const TChannel *pChannel) const;
+	u32 Load (u32 nBusAddress);
+	void Store (u32 nBusAddress, u32 nValue);
+
+private:
+	TChannel m_Channel[DMA_FAKE_CHANNELS];
+	u32 m_nEnable;
+
+	unsigned m_nWords;
+	unsigned m_nErrors;
+
+	static CBCMDMAFake *s_pThis;
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Streams SDUs through the simulated echo peer and checks them
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+
+// several thousand SDUs go out with WriteAsync and come back through the
+// receive ring of the channel; each carries its number, so a lost,
+// doubled or reordered one shows
+
+#define ECHO_SDUS		5000
+#define ECHO_SDU_SIZE		600
+#define ECHO_BUFFERS		64		// reused once written
+#define ECHO_WINDOW		32		// SDUs queued and not yet echoed
+#define ECHO_RX_DEPTH		(2 * ECHO_WINDOW)
+
+static volatile unsigned s_nWritten = 0;
+
+static void Written (u16, unsigned nSDUs, void *)
+{
+	s_nWritten += nSDUs;
+}
+
+static void Fill (u8 *pSDU, unsigned nSDU)
+{
+	memcpy (pSDU, &nSDU, sizeof nSDU);
+	for (unsigned i = sizeof nSDU; i < ECHO_SDU_SIZE; i++) {
+		pSDU[i] = (u8) (nSDU + i);
+	}
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	u8 BDAddr[BT_BD_ADDR_SIZE] = {0x21, 0x22, 0x33, 0x44, 0x55, 0x66};
+	CBTSimEchoPeer *pEcho = new CBTSimEchoPeer (BDAddr);
+	CBTSimPeer *pPeer = pEcho;
+	CBTSubSystem *pBT = BTTestBoot (&pPeer, 1);
+	if (pBT == 0) {
+		return BT_TEST_RESULT ();
+	}
+	u16 nCID = BTTestOpenChannel (pBT, pEcho, BT_SIM_ECHO_PSM);
+	if (nCID == 0) {
+		return BT_TEST_RESULT ();
+	}
+	CBTL2CAPLayer *pL2CAP = pBT->GetL2CAPLayer ();
+	BT_CHECK (pL2CAP->SetReceiveQueue (nCID, ECHO_RX_DEPTH));
+	BT_CHECK (pL2CAP->SetWriteCallback (nCID, Written));
+
+	static u8 Buffers[ECHO_BUFFERS][ECHO_SDU_SIZE];
+	static u8 Echo[BT_SIM_PEER_MTU];
+	unsigned nQueued = 0;
+	unsigned nRead = 0;
+	unsigned nBad = 0;
+	unsigned nStart = getClockTicks ();
+	unsigned nLast = nStart;
+	while (nRead < ECHO_SDUS && getClockTicks () - nLast < TEST_TIMEOUT) {
+		// a buffer is free again once its write was reported
+		while (   nQueued < ECHO_SDUS
+		       && nQueued - nRead < ECHO_WINDOW
+		       && nQueued - s_nWritten < ECHO_BUFFERS) {
+			u8 *pSDU = Buffers[nQueued % ECHO_BUFFERS];
+			Fill (pSDU, nQueued);
+			if (pL2CAP->WriteAsync (nCID, pSDU, ECHO_SDU_SIZE) != BT_L2CAP_RESULT_SUCCESS) {
+				break;
+			}
+			nQueued++;
+		}
+
+		u16 nLength;
+		if (pL2CAP->Read (nCID, sizeof Echo, Echo, &nLength) != BT_L2CAP_RESULT_SUCCESS) {
+			continue;
+		}
+		u8 Expected[ECHO_SDU_SIZE];
+		Fill (Expected, nRead);
+		if (   nLength != ECHO_SDU_SIZE
+		    || memcmp (Echo, Expected, ECHO_SDU_SIZE) != 0) {
+			nBad++;
+		}
+		nRead++;
+		nLast = getClockTicks ();
+	}
+	unsigned nElapsed = getClockTicks () - nStart;
+
+	BT_CHECK (nRead == ECHO_SDUS);
+	BT_CHECK (nBad == 0);
+	BT_CHECK (s_nWritten == ECHO_SDUS);
+	BT_CHECK (pEcho->GetBytesEchoed () == ECHO_SDUS * ECHO_SDU_SIZE);
+
+	// the window keeps the ring from filling up
+	BT_CHECK (pL2CAP->GetReceiveDrops (nCID) == 0);
+	BT_CHECK (pBT->GetReceiveDrops () == 0);
+
+	if (nElapsed == 0) {
+		nElapsed = 1;
+	}
+	printf ("%u SDUs of %u bytes echoed in %u ms, %u SDUs/s, %u KB/s\n",
+		nRead, ECHO_SDU_SIZE, nElapsed / 1000,
+		(unsigned) ((u64) nRead * 1000000 / nElapsed),
+		(unsigned) ((u64) nRead * ECHO_SDU_SIZE * 1000000 / 1024 / nElapsed));
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,279 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Runs ERTM and Streaming channels against a lossy simulated peer
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+#include <bluetooth/btl2capertm.h>
+
+// the peer echoes in ERTM or Streaming mode and loses or corrupts I-frames
+// in both directions; ERTM has to deliver every SDU in order through REJ,
+// SREJ and polls, hold the peer with RNR while the ring is full and give
+// up after MaxTransmit, Streaming may only lose SDUs
+
+#define ERTM_SDUS		1000
+#define ERTM_SDU_SIZE		600
+#define ERTM_RX_DEPTH		4		// SDUs the ring takes
+#define ERTM_WINDOW		ERTM_RX_DEPTH	// SDUs queued and not yet read
+#define ERTM_BUSY_SDUS		16		// written while nothing is read
+#define ERTM_LOSS		10		// percent
+#define ERTM_CORRUPTION		5
+#define STREAM_SDUS		1000
+
+static u8 s_Buffers[ERTM_WINDOW + ERTM_BUSY_SDUS][ERTM_SDU_SIZE];
+
+static void Fill (u8 *pSDU, unsigned nSDU)
+{
+	memcpy (pSDU, &nSDU, sizeof nSDU);
+	for (unsigned i = sizeof nSDU; i < ERTM_SDU_SIZE; i++) {
+		pSDU[i] = (u8) (nSDU * 7 + i);
+	}
+}
+
+// the number an echoed SDU carries, or ~0 if it is not one of ours
+static unsigned Check (const u8 *pSDU, u16 nLength)
+{
+	unsigned nSDU;
+	memcpy (&nSDU, pSDU, sizeof nSDU);
+
+	u8 Expected[ERTM_SDU_SIZE];
+	Fill (Expected, nSDU);
+	if (   nLength != ERTM_SDU_SIZE
+	    || memcmp (pSDU, Expected, ERTM_SDU_SIZE) != 0) {
+		return ~0U;
+	}
+
+	return nSDU;
+}
+
+// writes nSDUs numbered from nFirst and reads them back, returns how many
+// came back in order
+static unsigned Exchange (CBTL2CAPLayer *pL2CAP, u16 nCID, unsigned nFirst, unsigned nSDUs)
+{
+	unsigned nQueued = 0;
+	unsigned nRead = 0;
+	while (nRead < nSDUs) {
+		// a buffer is reused once its SDU was read, it was written then
+		while (nQueued < nSDUs && nQueued - nRead < ERTM_WINDOW) {
+			u8 *pSDU = s_Buffers[nQueued % ERTM_WINDOW];
+			Fill (pSDU, nFirst + nQueued);
+			if (pL2CAP->WriteAsync (nCID, pSDU, ERTM_SDU_SIZE) != BT_L2CAP_RESULT_SUCCESS) {
+				break;
+			}
+			nQueued++;
+		}
+
+		u8 Echo[BT_SIM_PEER_MTU];
+		u16 nLength;
+		if (   pL2CAP->Read (nCID, sizeof Echo, Echo, &nLength, TEST_TIMEOUT)
+			!= BT_L2CAP_RESULT_SUCCESS
+		    || Check (Echo, nLength) != nFirst + nRead) {
+			break;
+		}
+		nRead++;
+	}
+
+	return nRead;
+}
+
+static void TestLoss (CBTL2CAPLayer *pL2CAP, u16 nCID, CBTSimERTMPeer *pPeer)
+{
+	// REJ both ways, the peer asks once per gap
+	pPeer->SetLoss (ERTM_LOSS);
+	pPeer->SetCorruption (ERTM_CORRUPTION);
+	BT_CHECK (Exchange (pL2CAP, nCID, 0, ERTM_SDUS) == ERTM_SDUS);
+	BT_CHECK (pPeer->GetFramesLost () > 0);
+	BT_CHECK (pPeer->GetFCSErrors () > 0);		// corrupted on the way in
+	BT_CHECK (pPeer->GetRejects () > 0);
+	BT_CHECK (pPeer->GetRetransmissions () > 0);
+	BT_CHECK (pPeer->GetSelectiveRejects () == 0);
+	printf ("REJ: lost %u fcs errors %u, host REJ %u polls %u, peer retransmitted %u\n",
+		pPeer->GetFramesLost (), pPeer->GetFCSErrors (), pPeer->GetRejects (),
+		pPeer->GetPolls (), pPeer->GetRetransmissions ());
+
+	// the host sends single frames again, a lost last frame is only
+	// noticed by the retransmission timer, which polls
+	pPeer->SetSelectiveReject (TRUE);
+	BT_CHECK (Exchange (pL2CAP, nCID, ERTM_SDUS, ERTM_SDUS) == ERTM_SDUS);
+	BT_CHECK (pPeer->GetSelectiveRejects () > 0);
+	BT_CHECK (pPeer->GetPolls () > 0);
+	printf ("SREJ: %u asked, host polls %u\n", pPeer->GetSelectiveRejects (),
+		pPeer->GetPolls ());
+	pPeer->SetSelectiveReject (FALSE);
+
+	pPeer->SetLoss (0);
+	pPeer->SetCorruption (0);
+	BT_CHECK (pL2CAP->GetReceiveDrops (nCID) == 0);
+}
+
+static void TestLocalBusy (CBTL2CAPLayer *pL2CAP, u16 nCID, CBTSimERTMPeer *pPeer)
+{
+	// the ring takes a few SDUs, the rest waits at the peer behind RNR
+	unsigned nBusy = pPeer->GetBusyFrames ();
+	for (unsigned i = 0; i < ERTM_BUSY_SDUS; i++) {
+		u8 *pSDU = s_Buffers[ERTM_WINDOW + i];
+		Fill (pSDU, 2 * ERTM_SDUS + i);
+		BT_CHECK (pL2CAP->WriteAsync (nCID, pSDU, ERTM_SDU_SIZE) == BT_L2CAP_RESULT_SUCCESS);
+	}
+
+	unsigned nStart = getClockTicks ();
+	while (   pPeer->GetBusyFrames () == nBusy
+	       && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (1000);
+	}
+	BT_CHECK (pPeer->GetBusyFrames () > nBusy);
+	sleepTask (100000);				// the peer keeps waiting
+
+	unsigned nRead = 0;
+	while (nRead < ERTM_BUSY_SDUS) {
+		u8 Echo[BT_SIM_PEER_MTU];
+		u16 nLength;
+		if (   pL2CAP->Read (nCID, sizeof Echo, Echo, &nLength, TEST_TIMEOUT)
+			!= BT_L2CAP_RESULT_SUCCESS
+		    || Check (Echo, nLength) != 2 * ERTM_SDUS + nRead) {
+			break;
+		}
+		nRead++;
+		sleepTask (1000);			// slower than the peer
+	}
+	BT_CHECK (nRead == ERTM_BUSY_SDUS);
+	BT_CHECK (pL2CAP->GetReceiveDrops (nCID) == 0);
+}
+
+static void TestMaxTransmit (CBTL2CAPLayer *pL2CAP, u16 nCID, CBTSimERTMPeer *pPeer)
+{
+	// nothing gets through, the polls are answered; after MaxTransmit
+	// the host disconnects and a reader is rejected
+	pPeer->SetLoss (100);
+	BT_CHECK (pL2CAP->WriteAsync (nCID, s_Buffers[0], ERTM_SDU_SIZE) == BT_L2CAP_RESULT_SUCCESS);
+
+	unsigned nStart = getClockTicks ();
+	u8 Echo[BT_SIM_PEER_MTU];
+	u16 nLength;
+	u16 nResult;
+	while (   (nResult = pL2CAP->TryRead (nCID, sizeof Echo, Echo, &nLength))
+			== BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED
+	       && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (10000);
+	}
+	BT_CHECK (nResult == BT_L2CAP_RESULT_REJECTED);
+	BT_CHECK (pPeer->GetPolls () > 0);
+	BT_CHECK (pL2CAP->WriteAsync (nCID, s_Buffers[0], ERTM_SDU_SIZE) != BT_L2CAP_RESULT_SUCCESS);
+	printf ("gave up after %u ms\n", (getClockTicks () - nStart) / 1000);
+}
+
+static void TestStreaming (CBTL2CAPLayer *pL2CAP, u16 nCID, CBTSimERTMPeer *pPeer)
+{
+	// what arrives has to be intact and in order, SDUs may be missing
+	pPeer->SetLoss (ERTM_LOSS);
+	pPeer->SetCorruption (ERTM_CORRUPTION);
+	BT_CHECK (pL2CAP->SetReceiveQueue (nCID, 2 * ERTM_WINDOW));
+
+	unsigned nQueued = 0;
+	unsigned nRead = 0;
+	unsigned nNext = 0;
+	unsigned nBad = 0;
+	unsigned nLast = getClockTicks ();
+	while (getClockTicks () - nLast < 200000) {	// quiet for a while
+		if (nQueued < STREAM_SDUS) {
+			u8 *pSDU = s_Buffers[nQueued % ERTM_WINDOW];
+			Fill (pSDU, nQueued);
+			if (pL2CAP->WriteAsync (nCID, pSDU, ERTM_SDU_SIZE) == BT_L2CAP_RESULT_SUCCESS) {
+				nQueued++;
+				nLast = getClockTicks ();
+			}
+		}
+		sleepTask (100);
+
+		u8 Echo[BT_SIM_PEER_MTU];
+		u16 nLength;
+		while (pL2CAP->TryRead (nCID, sizeof Echo, Echo, &nLength) == BT_L2CAP_RESULT_SUCCESS) {
+			unsigned nSDU = Check (Echo, nLength);
+			if (nSDU == ~0U || nSDU < nNext) {
+				nBad++;
+			} else {
+				nNext = nSDU + 1;
+			}
+			nRead++;
+			nLast = getClockTicks ();
+		}
+	}
+
+	BT_CHECK (nQueued == STREAM_SDUS);
+	BT_CHECK (nBad == 0);
+	BT_CHECK (nRead < STREAM_SDUS && nRead > STREAM_SDUS / 2);
+	BT_CHECK (pPeer->GetFramesLost () > 0);
+	printf ("Streaming: %u of %u SDUs arrived\n", nRead, nQueued);
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	u8 BDAddr[BT_BD_ADDR_SIZE] = {0x21, 0x22, 0x33, 0x44, 0x55, 0x66};
+	CBTSimERTMPeer *pERTM = new CBTSimERTMPeer (BDAddr, BT_L2CAP_MODE_ERTM);
+	BDAddr[0] = 0x31;
+	CBTSimERTMPeer *pStreaming = new CBTSimERTMPeer (BDAddr, BT_L2CAP_MODE_STREAMING);
+	CBTSimPeer *Peers[] = {pERTM, pStreaming};
+	CBTSubSystem *pBT = BTTestBoot (Peers, 2);
+	if (pBT == 0) {
+		return BT_TEST_RESULT ();
+	}
+	CBTL2CAPLayer *pL2CAP = pBT->GetL2CAPLayer ();
+
+	// the mode registered when a channel is connected is the one asked for
+	TBTL2CAPRFC RFC;
+	memset (&RFC, 0, sizeof RFC);
+	RFC.Mode = BT_L2CAP_MODE_ERTM;
+	u16 nCID = BTTestOpenChannel (pBT, pERTM, BT_SIM_ECHO_PSM, &RFC);
+	BT_CHECK (nCID != 0 && pL2CAP->GetChannelMode (nCID) == BT_L2CAP_MODE_ERTM);
+	if (nCID != 0) {
+		BT_CHECK (pL2CAP->SetReceiveQueue (nCID, ERTM_RX_DEPTH));
+		TestLoss (pL2CAP, nCID, pERTM);
+		TestLocalBusy (pL2CAP, nCID, pERTM);
+		TestMaxTransmit (pL2CAP, nCID, pERTM);
+	}
+
+	RFC.Mode = BT_L2CAP_MODE_STREAMING;
+	nCID = BTTestOpenChannel (pBT, pStreaming, BT_SIM_ECHO_PSM, &RFC);
+	BT_CHECK (nCID != 0 && pL2CAP->GetChannelMode (nCID) == BT_L2CAP_MODE_STREAMING);
+	if (nCID != 0) {
+		TestStreaming (pL2CAP, nCID, pStreaming);
+	}
+
+	BT_CHECK (pBT->GetReceiveDrops () == 0);
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,294 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Throughput of the H4 deframer against the former per-byte state machine
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/bth4deframer.h>
+#include <bluetooth/btpacket.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The per-byte machine is the UART IRQ receive path from before the
+// deframer, fed one character at a time as the FIFO was read. The
+// deframer gets BT_UART_RX_SPAN_SIZE spans as the IRQ hands them now.
+// The stream is typical HID host traffic: 14 byte interrupt reports,
+// Number Of Completed Packets events and a few full size ACL packets.
+
+#define BENCH_STREAM		(4 * 1024 * 1024)
+#define BENCH_ROUNDS		10
+#define BENCH_SPAN		32	// BT_UART_RX_SPAN_SIZE
+
+enum TRxState
+{
+	RxStateStart,
+	RxStateCommand,
+	RxStateLength,
+	RxStateParam,
+	RxStateACLData,
+	RxStateACLDataLength,
+	RxStateData
+};
+
+class CH4ByteParser
+{
+public:
+	CH4ByteParser (TBTHCIEventHandler *pEventHandler, TBTHCIDataHandler *pDataHandler)
+	:	m_pEventHandler (pEventHandler),
+		m_pDataHandler (pDataHandler),
+		m_nRxState (RxStateStart),
+		m_nRxInPtr (0),
+		m_nRxParamLength (0),
+		m_nRxACLDataLength (0),
+		m_pRxPacket (0),
+		m_pRxData (m_RxBuffer)
+	{
+	}
+
+	void Parse (u8 nData)
+	{
+		switch (m_nRxState) {
+		case RxStateStart:
+			if (nData == HCI_PACKET_EVENT) {
+				m_nRxInPtr = 0;
+				m_nRxState = RxStateCommand;
+			} else if (nData == HCI_PACKET_ACL_DATA) {
+				if (m_pRxPacket != 0) m_pRxPacket->Release ();
+				m_pRxPacket = CBTPacketPool::Get ()->Alloc ();
+				m_pRxData = m_pRxPacket != 0 ? m_pRxPacket->GetData () : m_RxBuffer;
+				m_nRxInPtr = 0;
+				m_nRxState = RxStateACLData;
+			}
+			break;
+
+		case RxStateCommand:
+			m_RxBuffer[m_nRxInPtr++] = nData;
+			m_nRxState = RxStateLength;
+			break;
+
+		case RxStateACLData:
+			m_nRxState = (m_nRxInPtr) ? RxStateACLDataLength : RxStateACLData;
+			m_pRxData[m_nRxInPtr++] = nData;
+			break;
+
+		case RxStateLength:
+			m_RxBuffer[m_nRxInPtr++] = nData;
+			if (nData > 0) {
+				m_nRxParamLength = nData;
+				m_nRxState = RxStateParam;
+			} else {
+				(*m_pEventHandler) (m_RxBuffer, m_nRxInPtr);
+				m_nRxState = RxStateStart;
+			}
+			break;
+
+		case RxStateACLDataLength:
+			m_pRxData[m_nRxInPtr++] = nData;
+			if (m_nRxInPtr == 3) {
+				m_nRxACLDataLength = nData;
+			} else {
+				m_nRxACLDataLength |= (nData << 8);
+				if (m_nRxACLDataLength > BT_MAX_DATA_SIZE-4) {
+					if (m_pRxPacket != 0) m_pRxPacket->Release ();
+					m_pRxPacket = 0;
+					m_nRxInPtr = 0;
+					m_nRxState = RxStateStart;
+				} else if (m_nRxACLDataLength > 0) {
+					m_nRxParamLength = m_nRxACLDataLength;
+					m_nRxState = RxStateData;
+				} else {
+					DeliverData ();
+					m_nRxState = RxStateStart;
+				}
+			}
+			break;
+
+		case RxStateParam:
+			m_RxBuffer[m_nRxInPtr++] = nData;
+			if (--m_nRxParamLength == 0) {
+				(*m_pEventHandler) (m_RxBuffer, m_nRxInPtr);
+				m_nRxState = RxStateStart;
+			}
+			break;
+
+		case RxStateData:
+			m_pRxData[m_nRxInPtr++] = nData;
+			if (--m_nRxParamLength == 0) {
+				DeliverData ();
+				m_nRxState = RxStateStart;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+private:
+	void DeliverData (void)
+	{
+		CBTPacket *pPacket = m_pRxPacket;
+		m_pRxPacket = 0;
+		if (pPacket == 0) {
+			return;
+		}
+
+		pPacket->Put (m_nRxInPtr);
+		CBTPacketPool::CountCopy (BTCopyLayerTransport, m_nRxInPtr);
+		(*m_pDataHandler) (pPacket);
+	}
+
+private:
+	TBTHCIEventHandler *m_pEventHandler;
+	TBTHCIDataHandler *m_pDataHandler;
+
+	volatile unsigned m_nRxState;
+	unsigned m_nRxInPtr;
+	unsigned m_nRxParamLength;
+	unsigned m_nRxACLDataLength;
+	CBTPacket *m_pRxPacket;
+	u8 *m_pRxData;
+	u8 m_RxBuffer[BT_MAX_DATA_SIZE];
+};
+
+static u8 s_Stream[BENCH_STREAM];
+static unsigned s_nStream = 0;
+static unsigned s_nPackets = 0;
+static unsigned s_nDelivered = 0;
+static unsigned s_nChecksum = 0;
+
+static void EventHandler (const void *pBuffer, unsigned nLength)
+{
+	s_nDelivered++;
+	s_nChecksum += ((const u8 *) pBuffer)[nLength-1];
+}
+
+static void DataHandler (CBTPacket *pPacket)
+{
+	s_nDelivered++;
+	s_nChecksum += pPacket->GetData ()[pPacket->GetLength ()-1];
+	pPacket->Release ();
+}
+
+static void Add (const u8 *pPacket, unsigned nLength)
+{
+	memcpy (s_Stream + s_nStream, pPacket, nLength);
+	s_nStream += nLength;
+	s_nPackets++;
+}
+
+static void BuildStream (void)
+{
+	u8 Report[] = {HCI_PACKET_ACL_DATA, 0x40, 0x20, 10, 0,
+		       6, 0, 0x41, 0x00, 0xA1, 0x02, 0x00, 0x03, 0xFE, 0x00};
+	u8 Completed[] = {HCI_PACKET_EVENT, 0x13, 5, 1, 0x40, 0x00, 1, 0};
+	u8 Large[5 + BT_MAX_DATA_SIZE - 4] = {HCI_PACKET_ACL_DATA, 0x41, 0x20,
+					      (BT_MAX_DATA_SIZE - 4) & 0xFF, 0};
+
+	srand (6);
+	for (unsigned i = 5; i < sizeof Large; i++) {
+		Large[i] = rand ();
+	}
+
+	while (s_nStream + sizeof Large <= sizeof s_Stream) {
+		Report[13] = rand ();
+		Add (Report, sizeof Report);
+
+		if (rand () % 8 == 0) {
+			Add (Completed, sizeof Completed);
+		}
+		if (rand () % 64 == 0) {
+			Add (Large, sizeof Large);
+		}
+	}
+}
+
+static double Seconds (void)
+{
+	struct timespec Time;
+	clock_gettime (CLOCK_MONOTONIC, &Time);
+
+	return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+int main (void)
+{
+	CBTPacketPool *pPool = new CBTPacketPool;
+	BuildStream ();
+
+	CH4ByteParser ByteParser (EventHandler, DataHandler);
+	s_nDelivered = s_nChecksum = 0;
+	double fStart = Seconds ();
+	for (unsigned nRound = 0; nRound < BENCH_ROUNDS; nRound++) {
+		for (unsigned i = 0; i < s_nStream; i++) {
+			ByteParser.Parse (s_Stream[i]);
+		}
+	}
+	double fByte = Seconds () - fStart;
+	unsigned nByteDelivered = s_nDelivered;
+	unsigned nByteChecksum = s_nChecksum;
+
+	CBTH4Deframer Deframer;
+	Deframer.RegisterHCIEventHandler (EventHandler);
+	Deframer.RegisterHCIDataHandler (DataHandler);
+	s_nDelivered = s_nChecksum = 0;
+	fStart = Seconds ();
+	for (unsigned nRound = 0; nRound < BENCH_ROUNDS; nRound++) {
+		for (unsigned i = 0; i < s_nStream; i += BENCH_SPAN) {
+			unsigned nSpan = s_nStream - i < BENCH_SPAN ? s_nStream - i : BENCH_SPAN;
+			Deframer.Parse (s_Stream + i, nSpan);
+		}
+	}
+	double fSpan = Seconds () - fStart;
+
+	double fMB = (double) s_nStream * BENCH_ROUNDS / (1024 * 1024);
+	printf ("{\"bytes\": %u, \"packets\": %u, \"rounds\": %u,\n"
+		" \"per_byte_mb_s\": %.1f, \"deframer_mb_s\": %.1f, \"speedup\": %.2f}\n",
+		s_nStream, s_nPackets, BENCH_ROUNDS, fMB / fByte, fMB / fSpan, fByte / fSpan);
+
+	delete pPool;
+
+	// both have to deliver the same packets
+	if (   nByteDelivered != s_nPackets * BENCH_ROUNDS
+	    || s_nDelivered != nByteDelivered
+	    || s_nChecksum != nByteChecksum) {
+		printf ("FAILED: %u / %u packets delivered\n", nByteDelivered, s_nDelivered);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,220 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Fuzz test of the H4 deframer
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/bth4deframer.h>
+#include <bluetooth/btpacket.h>
+#include <bttest.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Random H4 streams are parsed in random chunks. Valid packets have to be
+// delivered intact even when ACL packets longer than a pool packet sit in
+// between, those are skipped and counted. Random bytes must never deliver
+// a packet which contradicts its own header or leak a pool packet.
+
+#define TEST_STREAM	(1024 * 1024)
+
+static u8 s_Stream[TEST_STREAM];
+static unsigned s_nStream;
+static u8 s_Expected[TEST_STREAM];
+static unsigned s_nExpected;
+static u8 s_Received[TEST_STREAM];
+static unsigned s_nReceived;
+static unsigned s_nPackets;
+static unsigned s_nInvalid;		// delivered packets not matching their header
+
+static void EventHandler (const void *pBuffer, unsigned nLength)
+{
+	const u8 *pEvent = (const u8 *) pBuffer;
+	if (nLength < 2 || nLength != 2U + pEvent[1]) {
+		s_nInvalid++;
+	}
+
+	if (s_nReceived + nLength <= sizeof s_Received) {
+		memcpy (s_Received + s_nReceived, pBuffer, nLength);
+		s_nReceived += nLength;
+	}
+	s_nPackets++;
+}
+
+static void DataHandler (CBTPacket *pPacket)
+{
+	const u8 *pData = pPacket->GetData ();
+	unsigned nLength = pPacket->GetLength ();
+	if (   nLength < 4
+	    || nLength != 4U + (pData[2] | pData[3] << 8)
+	    || nLength > BT_MAX_DATA_SIZE) {
+		s_nInvalid++;
+	}
+
+	if (s_nReceived + nLength <= sizeof s_Received) {
+		memcpy (s_Received + s_nReceived, pData, nLength);
+		s_nReceived += nLength;
+	}
+	s_nPackets++;
+
+	pPacket->Release ();
+}
+
+static void Clear (void)
+{
+	s_nStream = s_nExpected = s_nReceived = s_nPackets = s_nInvalid = 0;
+}
+
+// appends a packet to the stream, returns TRUE if it should be delivered
+static boolean AddPacket (unsigned nMaxACL)
+{
+	u8 Packet[5 + 0xFFFF];
+	unsigned nLength;
+
+	if (rand () % 2) {
+		unsigned nParams = rand () % 256;
+		Packet[0] = HCI_PACKET_EVENT;
+		Packet[1] = rand ();
+		Packet[2] = nParams;
+		nLength = 3 + nParams;
+	} else {
+		unsigned nData = rand () % (nMaxACL + 1);
+		Packet[0] = HCI_PACKET_ACL_DATA;
+		Packet[1] = rand ();
+		Packet[2] = rand ();
+		Packet[3] = nData & 0xFF;
+		Packet[4] = nData >> 8;
+		nLength = 5 + nData;
+	}
+
+	for (unsigned i = Packet[0] == HCI_PACKET_EVENT ? 3 : 5; i < nLength; i++) {
+		Packet[i] = rand ();
+	}
+
+	assert (s_nStream + nLength <= sizeof s_Stream);
+	memcpy (s_Stream + s_nStream, Packet, nLength);
+	s_nStream += nLength;
+
+	if (nLength - 1 > BT_MAX_DATA_SIZE) {
+		return FALSE;
+	}
+
+	memcpy (s_Expected + s_nExpected, Packet + 1, nLength - 1);
+	s_nExpected += nLength - 1;
+
+	return TRUE;
+}
+
+static void Parse (CBTH4Deframer *pDeframer)
+{
+	for (unsigned nOffset = 0; nOffset < s_nStream; ) {
+		unsigned nChunk = rand () % 64;
+		if (nChunk > s_nStream - nOffset) {
+			nChunk = s_nStream - nOffset;
+		}
+
+		pDeframer->Parse (s_Stream + nOffset, nChunk);
+		nOffset += nChunk;
+	}
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	CBTPacketPool *pPool = new CBTPacketPool;
+
+	CBTH4Deframer Deframer;
+	Deframer.RegisterHCIEventHandler (EventHandler);
+	Deframer.RegisterHCIDataHandler (DataHandler);
+
+	srand (6);
+
+	// valid packets, some ACL ones longer than BT_MAX_DATA_SIZE
+	Clear ();
+	unsigned nDeliver = 0;
+	unsigned nOversized = 0;
+	while (s_nStream < TEST_STREAM - (5 + 2000)) {
+		if (AddPacket (rand () % 8 == 0 ? 2000 : BT_MAX_DATA_SIZE - 4)) {
+			nDeliver++;
+		} else {
+			nOversized++;
+		}
+	}
+	Parse (&Deframer);
+
+	BT_CHECK (nOversized > 0);
+	BT_CHECK (s_nPackets == nDeliver);
+	BT_CHECK (s_nReceived == s_nExpected);
+	BT_CHECK (memcmp (s_Received, s_Expected, s_nExpected) == 0);
+	BT_CHECK (Deframer.GetDropped () == nOversized);
+	BT_CHECK (Deframer.GetDiscarded () == 0);
+	BT_CHECK (s_nInvalid == 0);
+	BT_CHECK (pPool->GetFreeCount () == BT_PACKET_POOL_SIZE);
+	printf ("%u packets delivered, %u oversized skipped\n", nDeliver, nOversized);
+
+	// random bytes, including packet types, with random chunking
+	for (unsigned nRound = 0; nRound < 20; nRound++) {
+		Clear ();
+		unsigned nLength = rand () % TEST_STREAM;
+		for (unsigned i = 0; i < nLength; i++) {
+			// bias to packet type values, so that packets start often
+			s_Stream[i] = rand () % 4 == 0 ? 1 + rand () % 4 : rand ();
+		}
+		s_nStream = nLength;
+		Parse (&Deframer);
+
+		BT_CHECK (s_nInvalid == 0);
+
+		// a partial packet holds at most one pool packet
+		Deframer.Reset ();
+		BT_CHECK (pPool->GetFreeCount () == BT_PACKET_POOL_SIZE);
+	}
+
+	// after Reset a valid stream is in sync again
+	Clear ();
+	nDeliver = 0;
+	while (s_nStream < TEST_STREAM / 4) {
+		nDeliver += AddPacket (BT_MAX_DATA_SIZE - 4) ? 1 : 0;
+	}
+	Parse (&Deframer);
+	BT_CHECK (s_nPackets == nDeliver);
+	BT_CHECK (s_nReceived == s_nExpected);
+	BT_CHECK (memcmp (s_Received, s_Expected, s_nExpected) == 0);
+	BT_CHECK (pPool->GetFreeCount () == BT_PACKET_POOL_SIZE);
+
+	delete pPool;
+
+	return BT_TEST_RESULT ();
+}
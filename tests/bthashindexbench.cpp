@@ -0,0 +1,140 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Compares channel lookups by hash with the linear scan
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/bthashindex.h>
+#include <bluetooth/btvector.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Before the index, GetChannel walked the channel list and compared the
+// CID of each channel, once per received packet. The channels here are
+// allocated one by one like the real ones, the CIDs looked up are random
+// among those in use.
+
+#define BENCH_LOOKUPS		(4 * 1024 * 1024)
+#define BENCH_MAX_CHANNELS	64
+#define BENCH_FIRST_CID		0x0040
+
+struct TBenchChannel
+{
+	u16	CID;
+	u8	State[126];			// about the size of CBTL2CAPChannel
+};
+
+static u16 s_CIDs[BENCH_LOOKUPS];
+
+static TBenchChannel *Scan (CBTVector<TBenchChannel *, BENCH_MAX_CHANNELS> &Channels, u16 nCID)
+{
+	for (unsigned i = 0; i < Channels.GetCount (); i++) {
+		if (Channels[i]->CID == nCID) {
+			return Channels[i];
+		}
+	}
+
+	return 0;
+}
+
+static double Seconds (void)
+{
+	struct timespec Time;
+	clock_gettime (CLOCK_MONOTONIC, &Time);
+
+	return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+int main (void)
+{
+	static const unsigned Counts[] = {2, 4, 8, 16, 32, BENCH_MAX_CHANNELS};
+	unsigned nFailed = 0;
+
+	srand (13);
+	printf ("[\n");
+	for (unsigned c = 0; c < sizeof Counts / sizeof Counts[0]; c++) {
+		unsigned nChannels = Counts[c];
+		CBTVector<TBenchChannel *, BENCH_MAX_CHANNELS> Channels;
+		CBTHashIndex Index;
+		for (unsigned i = 0; i < nChannels; i++) {
+			TBenchChannel *pChannel = (TBenchChannel *) malloc (sizeof (TBenchChannel));
+			memset (pChannel, 0, sizeof *pChannel);
+			pChannel->CID = BENCH_FIRST_CID + i;
+			Channels.Append (pChannel);
+			Index.Insert (pChannel->CID, pChannel);
+		}
+		for (unsigned i = 0; i < BENCH_LOOKUPS; i++) {
+			s_CIDs[i] = BENCH_FIRST_CID + rand () % nChannels;
+		}
+
+		uintptr nScanSum = 0;
+		double fStart = Seconds ();
+		for (unsigned i = 0; i < BENCH_LOOKUPS; i++) {
+			nScanSum += (uintptr) Scan (Channels, s_CIDs[i]);
+		}
+		double fScan = Seconds () - fStart;
+
+		uintptr nHashSum = 0;
+		fStart = Seconds ();
+		for (unsigned i = 0; i < BENCH_LOOKUPS; i++) {
+			nHashSum += (uintptr) Index.Lookup (s_CIDs[i]);
+		}
+		double fHash = Seconds () - fStart;
+
+		// both have to find the same channels
+		if (nScanSum != nHashSum) {
+			nFailed++;
+		}
+
+		printf (" {\"channels\": %u, \"lookups\": %u, \"scan_ns\": %.2f, \"hash_ns\": %.2f,"
+			" \"speedup\": %.2f}%s\n",
+			nChannels, BENCH_LOOKUPS, fScan * 1e9 / BENCH_LOOKUPS,
+			fHash * 1e9 / BENCH_LOOKUPS, fScan / fHash,
+			c + 1 < sizeof Counts / sizeof Counts[0] ? "," : "");
+
+		for (unsigned i = 0; i < Channels.GetCount (); i++) {
+			free (Channels[i]);
+		}
+	}
+	printf ("]\n");
+
+	if (nFailed != 0) {
+		printf ("FAILED: %u lookups differ\n", nFailed);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Churns the hash index against a plain array model
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/bthashindex.h>
+#include <bluetooth/bluetooth.h>
+#include <bttest.h>
+#include <stdlib.h>
+
+// random insert, replace, remove and lookup on keys shaped like those the
+// stack uses, every result is compared with a plain array of the same keys;
+// the keys of one family differ in few bits, so they collide and removal
+// has to shift runs back across the end of the table
+
+#define TEST_KEYS		300
+#define TEST_OPERATIONS		2000000
+#define TEST_CYCLES		1000	// of the open/close churn
+
+static u64 s_Keys[TEST_KEYS];
+static void *s_Model[TEST_KEYS];	// 0 if the key is not in the index
+static unsigned s_nModelCount = 0;
+
+static void MakeKeys (void)
+{
+	for (unsigned i = 0; i < TEST_KEYS; i++) {
+		switch (i % 3) {
+		case 0: {				// connection handles
+			s_Keys[i] = 0x0040 + i;
+			} break;
+
+		case 1: {				// (handle, remote CID) pairs
+			s_Keys[i] = (u64) (0x0040 + i % 8) << 16 | (0x0040 + i);
+			} break;
+
+		default: {				// BD addresses of one vendor
+			u8 BDAddr[BT_BD_ADDR_SIZE] = {(u8) i, (u8) (i >> 8), 0x33, 0x44, 0x55, 0x66};
+			s_Keys[i] = CBTHashIndex::BDAddrKey (BDAddr);
+			} break;
+		}
+	}
+}
+
+static boolean Check (CBTHashIndex *pIndex)
+{
+	if (pIndex->GetCount () != s_nModelCount) {
+		return FALSE;
+	}
+
+	for (unsigned i = 0; i < TEST_KEYS; i++) {
+		if (pIndex->Lookup (s_Keys[i]) != s_Model[i]) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+int main (void)
+{
+	MakeKeys ();
+	srand (7);
+
+	CBTHashIndex Index;
+	boolean bOK = TRUE;
+	for (unsigned i = 0; i < TEST_OPERATIONS && bOK; i++) {
+		unsigned k = rand () % TEST_KEYS;
+		switch (rand () % 4) {
+		case 0: {
+			void *pValue = (void *) (uintptr) (1 + rand ());
+			BT_CHECK (Index.Insert (s_Keys[k], pValue));
+			if (s_Model[k] == 0) {
+				s_nModelCount++;
+			}
+			s_Model[k] = pValue;
+			} break;
+
+		case 1: {
+			Index.Remove (s_Keys[k]);
+			if (s_Model[k] != 0) {
+				s_nModelCount--;
+			}
+			s_Model[k] = 0;
+			} break;
+
+		case 2: {
+			// a stale owner must not remove a key taken over meanwhile
+			Index.Remove (s_Keys[k], (void *) (uintptr) 1);
+			if (s_Model[k] == (void *) (uintptr) 1) {
+				s_Model[k] = 0;
+				s_nModelCount--;
+			}
+			} break;
+
+		default:
+			break;
+		}
+
+		if (Index.Lookup (s_Keys[k]) != s_Model[k] || Index.GetCount () != s_nModelCount) {
+			printf ("mismatch at operation %u\n", i);
+			bOK = FALSE;
+		}
+		if (i % 1000 == 0 && !Check (&Index)) {
+			printf ("full check failed at operation %u\n", i);
+			bOK = FALSE;
+		}
+	}
+	BT_CHECK (bOK);
+	BT_CHECK (Check (&Index));
+
+	// channels opened and closed for a long time, a few stay open, the
+	// index must neither lose them nor fill up with the closed ones
+	CBTHashIndex Churn;
+	void *pStay = (void *) (uintptr) 0x1000;
+	for (unsigned i = 0; i < 8; i++) {
+		BT_CHECK (Churn.Insert (0x0040 + i, pStay));
+	}
+	for (unsigned i = 0; i < TEST_CYCLES; i++) {
+		for (unsigned j = 0; j < 32; j++) {
+			BT_CHECK (Churn.Insert (0x1000 + i * 32 + j, (void *) (uintptr) (i + 1)));
+		}
+		for (unsigned j = 0; j < 32; j++) {
+			Churn.Remove (0x1000 + i * 32 + j);
+		}
+		BT_CHECK (Churn.GetCount () == 8);
+	}
+	for (unsigned i = 0; i < 8; i++) {
+		BT_CHECK (Churn.Lookup (0x0040 + i) == pStay);
+	}
+	BT_CHECK (Churn.Lookup (0x1000) == 0);
+
+	printf ("%u operations, %u keys left\n", TEST_OPERATIONS, s_nModelCount);
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,221 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Fills the HID event queue without reading it
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+
+// the mouse sends while nothing is read: once the event queue is full the
+// motion is summed and the button edges are held back in order; reading
+// then has to give every edge with exactly the motion sent before it. When
+// more edges come than can be held, they are counted as lost, the motion
+// is still complete.
+
+#define FILL_MOVES	40		// more than the queue holds
+#define FILL_CLICKS	(BT_HIDP_HELD_EVENTS / 2)
+#define FLOOD_CLICKS	40
+#define MAX_EDGES	(2 * FLOOD_CLICKS)
+
+static const u8 MouseAddr[BT_BD_ADDR_SIZE] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+static CBTSimMouse *s_pMouse;
+static CBTHIDDevice *s_pDevice;
+static unsigned s_nSent = 0;
+
+struct TMotion
+{
+	int	nX;
+	int	nY;
+	int	nWheel;
+};
+
+struct TEventLog
+{
+	unsigned	nEdges;
+	u16		Edges[MAX_EDGES];		// type and button
+	TMotion		Motion[MAX_EDGES + 1];		// before each edge, and after the last
+};
+
+static TEventLog s_Expected;
+
+// one report at a time, the next goes once the host decoded this one, so
+// nothing is lost before the event queue
+static void Send (signed char nX, signed char nY, signed char nWheel, u8 nButtons)
+{
+	unsigned nStart = getClockTicks ();
+	while (   !s_pMouse->Move (nX, nY, nWheel, nButtons)
+	       && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (100);
+	}
+	s_nSent++;
+
+	while (   s_pDevice->GetInputCount () != s_nSent
+	       && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (100);
+	}
+	BT_CHECK (s_pDevice->GetInputCount () == s_nSent);
+
+	TMotion *pMotion = &s_Expected.Motion[s_Expected.nEdges];
+	pMotion->nX += nX;
+	pMotion->nY += nY;
+	pMotion->nWheel += nWheel;
+}
+
+static void SendEdge (unsigned nType)
+{
+	assert (s_Expected.nEdges < MAX_EDGES);
+	s_Expected.Edges[s_Expected.nEdges++] = nType << 8 | UG_MOUSE_RIGHT;
+}
+
+// CBTMouse takes the second report of a press as the press
+static void Click (void)
+{
+	Send (0, 0, 0, 2);
+	Send (0, 0, 0, 2);
+	SendEdge (UG_MOUSE_PRESS);
+	Send (0, 0, 0, 0);
+	SendEdge (UG_MOUSE_RELEASE);
+}
+
+static void Receive (TEventLog *pLog)
+{
+	memset (pLog, 0, sizeof *pLog);
+
+	u8 Buffer[BT_HIDP_MAX_EVENT_SIZE];
+	unsigned nLength;
+	while (s_pDevice->ReceiveEvent (Buffer, &nLength)) {
+		UGEvent *pEvent = (UGEvent *) Buffer;
+		TMotion *pMotion = &pLog->Motion[pLog->nEdges];
+		switch (pEvent->GetType ()) {
+		case UG_MOUSE_MOVE:
+			pMotion->nX += ((UGMouseMoveEvent *) Buffer)->GetX ();
+			pMotion->nY += ((UGMouseMoveEvent *) Buffer)->GetY ();
+			break;
+
+		case UG_MOUSE_SCROLL:
+			pMotion->nWheel += ((UGScrollEvent *) Buffer)->GetScroll ();
+			break;
+
+		default:
+			BT_CHECK (pLog->nEdges < MAX_EDGES);
+			if (pLog->nEdges < MAX_EDGES) {
+				pLog->Edges[pLog->nEdges++] =
+					pEvent->GetType () << 8 | ((UGButtonPressEvent *) Buffer)->GetButton ();
+			}
+			break;
+		}
+	}
+}
+
+static void TestFill (boolean bCoalescing)
+{
+	memset (&s_Expected, 0, sizeof s_Expected);
+	s_pDevice->SetCoalescing (bCoalescing);
+
+	for (unsigned i = 0; i < FILL_MOVES; i++) {
+		Send (3, -2, i % 4 == 0 ? 1 : 0, 0);
+	}
+	for (unsigned i = 0; i < FILL_CLICKS; i++) {
+		Click ();
+		for (unsigned j = 0; j < 5; j++) {
+			Send (100, -7 * j, j == 2 ? -1 : 0, 0);
+		}
+	}
+
+	static TEventLog Received;
+	Receive (&Received);
+
+	BT_CHECK (s_pDevice->GetEventDrops () == 0);
+	BT_CHECK (Received.nEdges == s_Expected.nEdges);
+	BT_CHECK (memcmp (Received.Edges, s_Expected.Edges,
+			  s_Expected.nEdges * sizeof s_Expected.Edges[0]) == 0);
+	BT_CHECK (memcmp (Received.Motion, s_Expected.Motion,
+			  (s_Expected.nEdges + 1) * sizeof s_Expected.Motion[0]) == 0);
+
+	printf ("%s: %u edges held and read in order\n",
+		bCoalescing ? "coalesced" : "direct", Received.nEdges);
+}
+
+static void TestFlood (void)
+{
+	memset (&s_Expected, 0, sizeof s_Expected);
+	s_pDevice->SetCoalescing (FALSE);
+
+	for (unsigned i = 0; i < FLOOD_CLICKS; i++) {
+		Click ();
+		Send (-50, 60, 1, 0);
+	}
+
+	static TEventLog Received;
+	Receive (&Received);
+
+	int nX = 0, nY = 0, nWheel = 0;
+	for (unsigned i = 0; i <= Received.nEdges; i++) {
+		nX += Received.Motion[i].nX;
+		nY += Received.Motion[i].nY;
+		nWheel += Received.Motion[i].nWheel;
+	}
+
+	unsigned nDrops = s_pDevice->GetEventDrops ();
+	BT_CHECK (nDrops > 0);
+	BT_CHECK (Received.nEdges + nDrops == s_Expected.nEdges);
+	BT_CHECK (nX == -50 * FLOOD_CLICKS && nY == 60 * FLOOD_CLICKS && nWheel == FLOOD_CLICKS);
+
+	printf ("flood: %u edges read, %u lost\n", Received.nEdges, nDrops);
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	s_pMouse = new CBTSimMouse (MouseAddr);
+	CBTSimPeer *pPeer = s_pMouse;
+	CBTSubSystem *pBT = BTTestBoot (&pPeer, 1);
+	if (pBT == 0 || BTTestAcceptAll (pBT, &pPeer, 1) != 1) {
+		return BT_TEST_RESULT ();
+	}
+	s_pDevice = BTTestGetDevice (pBT, s_pMouse);
+	BT_CHECK (s_pDevice != 0);
+	if (s_pDevice == 0) {
+		return BT_TEST_RESULT ();
+	}
+	s_nSent = s_pDevice->GetInputCount ();
+
+	TestFill (FALSE);
+	TestFill (TRUE);
+	TestFlood ();
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,258 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Decodes reports of a corpus of HID report descriptors
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/bthidreport.h>
+#include <bttest.h>
+#include <string.h>
+
+// descriptors as real devices send them, each compiled once and run
+// against known reports; the malformed ones have to be refused
+
+// 16 buttons, 12 bit X and Y, wheel and AC Pan (ID 2), consumer keys (ID 3)
+static const u8 PrecisionMouse[] =
+{
+	0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x02, 0x09, 0x01, 0xA1, 0x00,
+	0x05, 0x09, 0x19, 0x01, 0x29, 0x10, 0x15, 0x00, 0x25, 0x01, 0x95, 0x10,
+	0x75, 0x01, 0x81, 0x02,
+	0x05, 0x01, 0x16, 0x01, 0xF8, 0x26, 0xFF, 0x07, 0x75, 0x0C, 0x95, 0x02,
+	0x09, 0x30, 0x09, 0x31, 0x81, 0x06,
+	0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x01, 0x09, 0x38, 0x81, 0x06,
+	0x05, 0x0C, 0x0A, 0x38, 0x02, 0x95, 0x01, 0x81, 0x06,
+	0xC0, 0xC0,
+	0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x03, 0x75, 0x10, 0x95, 0x02,
+	0x15, 0x01, 0x26, 0xFF, 0x02, 0x19, 0x01, 0x2A, 0xFF, 0x02, 0x81, 0x00,
+	0xC0
+};
+
+// no report IDs: 16 buttons, a hat with a null state, X, Y, Z and Rz
+static const u8 Gamepad[] =
+{
+	0x05, 0x01, 0x09, 0x05, 0xA1, 0x01,
+	0x05, 0x09, 0x19, 0x01, 0x29, 0x10, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01,
+	0x95, 0x10, 0x81, 0x02,
+	0x05, 0x01, 0x09, 0x39, 0x15, 0x00, 0x25, 0x07, 0x35, 0x00, 0x46, 0x3B,
+	0x01, 0x65, 0x14, 0x75, 0x04, 0x95, 0x01, 0x81, 0x42,
+	0x75, 0x04, 0x95, 0x01, 0x81, 0x01,
+	0x09, 0x30, 0x09, 0x31, 0x09, 0x32, 0x09, 0x35, 0x15, 0x81, 0x25, 0x7F,
+	0x75, 0x08, 0x95, 0x04, 0x81, 0x02,
+	0xC0
+};
+
+// the keyboard of the HID specification, appendix B.1, without report IDs
+static const u8 Keyboard[] =
+{
+	0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7,
+	0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+	0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+	0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+	0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+	0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00,
+	0x29, 0x65, 0x81, 0x00,
+	0xC0
+};
+
+// a joystick (ID 5) whose signed axes are set up between Push and Pop, a
+// long item in front
+static const u8 Joystick[] =
+{
+	0xFE, 0x01, 0x00, 0xAA,
+	0x05, 0x01, 0x09, 0x04, 0xA1, 0x01, 0x85, 0x05,
+	0xA4, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x02, 0x09, 0x30, 0x09,
+	0x31, 0x81, 0x02, 0xB4,
+	0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x01, 0x09, 0x36, 0x81,
+	0x02,
+	0xC0
+};
+
+static const u8 Truncated[] = {0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x26, 0xFF};
+static const u8 PopWithoutPush[] = {0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0xB4, 0xC0};
+static const u8 ReportIDZero[] = {0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x00, 0xC0};
+static const u8 NoInputs[] =
+{
+	0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05,
+	0x75, 0x01, 0x95, 0x05, 0x91, 0x02, 0xC0
+};
+
+#define SLOT(slot)	BT_HID_SLOT_BIT (BTHIDSlot##slot)
+
+static void TestBoot (void)
+{
+	CBTHIDReportDecoder Decoder;
+	BT_CHECK (Decoder.Compile (CBTHIDReportDecoder::s_BootDescriptor,
+				   CBTHIDReportDecoder::s_nBootDescriptorLength));
+	BT_CHECK (Decoder.GetReportCount () == 2);
+
+	// left shift held, A and B down
+	static const u8 KeyReport[] = {0x01, 0x02, 0x00, 0x04, 0x05, 0x00, 0x00, 0x00, 0x00};
+	TBTHIDInput Input;
+	BT_CHECK (Decoder.Decode (KeyReport, sizeof KeyReport, &Input));
+	BT_CHECK (Input.nReportID == 1);
+	BT_CHECK (Input.nApplication == BT_HID_USAGE_KEYBOARD);
+	BT_CHECK (Input.nPresent == (SLOT (Modifiers) | SLOT (Key0) | SLOT (Key0) << 1 | SLOT (Key0) << 2
+				     | SLOT (Key0) << 3 | SLOT (Key0) << 4 | SLOT (Key0) << 5));
+	BT_CHECK (Input.Value[BTHIDSlotModifiers] == 0x02);
+	BT_CHECK (Input.Value[BTHIDSlotKey0] == 0x04);
+	BT_CHECK (Input.Value[BTHIDSlotKey0+1] == 0x05);
+	BT_CHECK (Input.Value[BTHIDSlotKey0+2] == 0);
+
+	// left and middle button, 16 right, 16 up, wheel down
+	static const u8 MouseReport[] = {0x02, 0x05, 0x10, 0xF0, 0xFF};
+	BT_CHECK (Decoder.Decode (MouseReport, sizeof MouseReport, &Input));
+	BT_CHECK (Input.nReportID == 2);
+	BT_CHECK (Input.nApplication == BT_HID_USAGE_MOUSE);
+	BT_CHECK (Input.nPresent == (SLOT (Buttons) | BT_HID_POINTER_SLOTS));
+	BT_CHECK (Input.Value[BTHIDSlotButtons] == 0x05);
+	BT_CHECK (Input.Value[BTHIDSlotX] == 16);
+	BT_CHECK (Input.Value[BTHIDSlotY] == -16);
+	BT_CHECK (Input.Value[BTHIDSlotWheel] == -1);
+
+	// the wheel byte is missing, and ID 3 is not described
+	BT_CHECK (!Decoder.Decode (MouseReport, sizeof MouseReport - 1, &Input));
+	static const u8 Unknown[] = {0x03, 0x00, 0x00, 0x00, 0x00};
+	BT_CHECK (!Decoder.Decode (Unknown, sizeof Unknown, &Input));
+}
+
+static void TestPrecisionMouse (void)
+{
+	CBTHIDReportDecoder Decoder;
+	BT_CHECK (Decoder.Compile (PrecisionMouse, sizeof PrecisionMouse));
+	BT_CHECK (Decoder.GetReportCount () == 2);
+
+	// buttons 1, 3 and 16, X 300 and Y -5 packed in 12 bits each
+	static const u8 Report[] = {0x02, 0x05, 0x80, 0x2C, 0xB1, 0xFF, 0x01, 0xFE};
+	TBTHIDInput Input;
+	BT_CHECK (Decoder.Decode (Report, sizeof Report, &Input));
+	BT_CHECK (Input.nApplication == BT_HID_USAGE_MOUSE);
+	BT_CHECK (Input.Value[BTHIDSlotButtons] == 0x8005);
+	BT_CHECK (Input.Value[BTHIDSlotX] == 300);
+	BT_CHECK (Input.Value[BTHIDSlotY] == -5);
+	BT_CHECK (Input.Value[BTHIDSlotWheel] == 1);
+	BT_CHECK (Input.Value[BTHIDSlotPan] == -2);
+
+	// the consumer keys are an array with nothing we decode
+	static const u8 Consumer[] = {0x03, 0xE9, 0x00, 0x00, 0x00};
+	BT_CHECK (Decoder.Decode (Consumer, sizeof Consumer, &Input));
+	BT_CHECK (Input.nReportID == 3);
+	BT_CHECK (Input.nPresent == 0);
+}
+
+static void TestGamepad (void)
+{
+	CBTHIDReportDecoder Decoder;
+	BT_CHECK (Decoder.Compile (Gamepad, sizeof Gamepad));
+	BT_CHECK (Decoder.GetReportCount () == 1);
+	BT_CHECK (Decoder.GetFieldCount () == 16 + 1 + 4);
+
+	// buttons 1 and 16, hat 3, X full right, Y nearly full up, Rz -1;
+	// the padding nibble must not show in the hat
+	static const u8 Report[] = {0x01, 0x80, 0xF3, 0x7F, 0x81, 0x00, 0xFF};
+	TBTHIDInput Input;
+	BT_CHECK (Decoder.Decode (Report, sizeof Report, &Input));
+	BT_CHECK (Input.nReportID == 0);
+	BT_CHECK (Input.nApplication == BT_HID_USAGE_GAMEPAD);
+	BT_CHECK (Input.nPresent == (  SLOT (Buttons) | SLOT (Hat) | SLOT (X) | SLOT (Y)
+				     | SLOT (Z) | SLOT (Rz)));
+	BT_CHECK (Input.Value[BTHIDSlotButtons] == 0x8001);
+	BT_CHECK (Input.Value[BTHIDSlotHat] == 3);
+	BT_CHECK (Input.Value[BTHIDSlotX] == 127);
+	BT_CHECK (Input.Value[BTHIDSlotY] == -127);
+	BT_CHECK (Input.Value[BTHIDSlotZ] == 0);
+	BT_CHECK (Input.Value[BTHIDSlotRz] == -1);
+
+	BT_CHECK (!Decoder.Decode (Report, sizeof Report - 1, &Input));
+}
+
+static void TestKeyboard (void)
+{
+	CBTHIDReportDecoder Decoder;
+	BT_CHECK (Decoder.Compile (Keyboard, sizeof Keyboard));
+
+	// left control and right GUI, 1 down
+	static const u8 Report[] = {0x81, 0x00, 0x1E, 0x00, 0x00, 0x00, 0x00, 0x00};
+	TBTHIDInput Input;
+	BT_CHECK (Decoder.Decode (Report, sizeof Report, &Input));
+	BT_CHECK (Input.nReportID == 0);
+	BT_CHECK (Input.nApplication == BT_HID_USAGE_KEYBOARD);
+	BT_CHECK (Input.Value[BTHIDSlotModifiers] == 0x81);
+	BT_CHECK (Input.Value[BTHIDSlotKey0] == 0x1E);
+	BT_CHECK (Input.Value[BTHIDSlotKey0+1] == 0);
+}
+
+static void TestJoystick (void)
+{
+	CBTHIDReportDecoder Decoder;
+	BT_CHECK (Decoder.Compile (Joystick, sizeof Joystick));
+
+	// the slider after Pop is unsigned again
+	static const u8 Report[] = {0x05, 0x80, 0x7F, 0xC8};
+	TBTHIDInput Input;
+	BT_CHECK (Decoder.Decode (Report, sizeof Report, &Input));
+	BT_CHECK (Input.nReportID == 5);
+	BT_CHECK (Input.nApplication == BT_HID_USAGE_JOYSTICK);
+	BT_CHECK (Input.Value[BTHIDSlotX] == -128);
+	BT_CHECK (Input.Value[BTHIDSlotY] == 127);
+	BT_CHECK (Input.Value[BTHIDSlotSlider] == 200);
+}
+
+static void TestMalformed (void)
+{
+	CBTHIDReportDecoder Decoder;
+	BT_CHECK (!Decoder.Compile (Truncated, sizeof Truncated));
+	BT_CHECK (!Decoder.Compile (PopWithoutPush, sizeof PopWithoutPush));
+	BT_CHECK (!Decoder.Compile (ReportIDZero, sizeof ReportIDZero));
+	BT_CHECK (!Decoder.Compile (NoInputs, sizeof NoInputs));
+
+	// a refused descriptor leaves nothing of the one compiled before
+	BT_CHECK (Decoder.Compile (Gamepad, sizeof Gamepad));
+	BT_CHECK (!Decoder.Compile (Truncated, sizeof Truncated));
+	BT_CHECK (Decoder.GetFieldCount () == 0);
+	static const u8 Report[] = {0x01, 0x80, 0xF3, 0x7F, 0x81, 0x00, 0xFF};
+	TBTHIDInput Input;
+	BT_CHECK (!Decoder.Decode (Report, sizeof Report, &Input));
+}
+
+int main (void)
+{
+	TestBoot ();
+	TestPrecisionMouse ();
+	TestGamepad ();
+	TestKeyboard ();
+	TestJoystick ();
+	TestMalformed ();
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,134 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    HID latency benchmark against the simulated controller
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+#include <bluetooth/btlatency.h>
+#include <stdlib.h>
+
+// Boots the stack, connects a simulated mouse and sends reports one at a
+// time, each one after the event of the previous has been read, so that
+// nothing queues or coalesces. The last line is one JSON object (the stack
+// logs before it): the report count, the end to end time from the mouse's
+// Move() to ReceiveEvent() as seen by the application, and the stack's own
+// probes (BT_GetLatency).
+//
+// usage: btlatencybench [reports [air time us]]
+
+#define BENCH_REPORTS	1000
+#define BENCH_POLL	20		// us between ReceiveEvent polls
+#define BENCH_JSON_SIZE	1024
+
+static const u8 MouseAddr[BT_BD_ADDR_SIZE] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+static int CompareTicks (const void *p1, const void *p2)
+{
+	unsigned n1 = *(const unsigned *) p1;
+	unsigned n2 = *(const unsigned *) p2;
+
+	return n1 < n2 ? -1 : n1 > n2 ? 1 : 0;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nReports = argc > 1 ? atoi (argv[1]) : BENCH_REPORTS;
+	unsigned nAirTime = argc > 2 ? atoi (argv[2]) : 0;
+	if (nReports == 0) {
+		nReports = BENCH_REPORTS;
+	}
+
+	CBTSimMouse *pMouse = new CBTSimMouse (MouseAddr);
+	CBTSimPeer *Peers[] = {pMouse};
+
+	CBTSimController *pController;
+	CBTSubSystem *pBT = BTTestBoot (Peers, 1, &pController);
+	if (pBT == 0) {
+		return 1;
+	}
+	pController->SetAirTime (nAirTime);
+
+	CBTInquiryResults *pResults = pBT->Listen (1);
+	delete pResults;
+	CBTHIDDevice *pDevice = (CBTHIDDevice *) pBT->Accept (0);
+	unsigned nStart = getClockTicks ();
+	while (   pDevice != 0 && !pMouse->IsChannelOpen (BT_PSM_HID_INTERRUPT)
+	       && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (1000);
+	}
+	if (pDevice == 0 || !pMouse->IsChannelOpen (BT_PSM_HID_INTERRUPT)) {
+		printf ("{\"error\":\"mouse not connected\"}\n");
+		return 1;
+	}
+
+	// let the connection setup settle, its traffic is not measured
+	sleepTask (100000);
+	while (BTTestReceiveEvents (pDevice, 1) != 0) {
+	}
+
+	unsigned *pTicks = new unsigned[nReports];
+	unsigned nLost = 0;
+	for (unsigned i = 0; i < nReports; i++) {
+		u8 Buffer[BT_HIDP_MAX_EVENT_SIZE];
+		unsigned nLength;
+
+		nStart = getClockTicks ();
+		pMouse->Move (1, -1);
+		while (   !pDevice->ReceiveEvent (Buffer, &nLength)
+		       && getClockTicks () - nStart < TEST_TIMEOUT) {
+			sleepTask (BENCH_POLL);
+		}
+		pTicks[i] = getClockTicks () - nStart;
+		if (pTicks[i] >= TEST_TIMEOUT) {
+			nLost++;
+		}
+	}
+
+	qsort (pTicks, nReports, sizeof pTicks[0], CompareTicks);
+
+	char Probes[BENCH_JSON_SIZE];
+	BT_GetLatency (Probes, sizeof Probes);
+
+	printf ("{\"reports\":%u,\"lost\":%u,\"air_time_us\":%u,"
+		"\"end_to_end\":{\"p50_us\":%u,\"p99_us\":%u,\"max_us\":%u},"
+		"\"probes\":%s}\n",
+		nReports, nLost, nAirTime,
+		pTicks[nReports / 2], pTicks[(nReports * 99) / 100], pTicks[nReports - 1],
+		Probes);
+
+	delete [] pTicks;
+
+	return nLost == 0 ? 0 : 1;
+}
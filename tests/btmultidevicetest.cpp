@@ -0,0 +1,176 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Streams reports from several HID devices at once
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+#include <bluetooth/bthidreport.h>
+
+// five mice and two keyboards connected at once, each sends a report every
+// round; the motion of every mouse has to arrive in full on its own
+// device, the keyboards only publish their state, their last key has to
+// show up
+
+#define MULTI_MICE		5
+#define MULTI_KEYBOARDS		2
+#define MULTI_PEERS		(MULTI_MICE + MULTI_KEYBOARDS)
+#define MULTI_ROUNDS		500
+
+#define KEYBOARD_REPORT_ID	0x01	// of the simulated keyboard's descriptor
+#define KEYBOARD_LAST_KEY	0x29	// Escape
+
+// motion may be coalesced, so it is summed up; key events are only read
+static void Receive (CBTHIDDevice **ppDevices, int *pX, int *pY)
+{
+	for (unsigned i = 0; i < MULTI_PEERS; i++) {
+		u8 Buffer[BT_HIDP_MAX_EVENT_SIZE];
+		unsigned nLength;
+		while (ppDevices[i]->ReceiveEvent (Buffer, &nLength)) {
+			UGEvent *pEvent = (UGEvent *) Buffer;
+			if (i >= MULTI_MICE) {
+				BT_CHECK (pEvent->GetSource () == UG_KEYBOARD);
+				continue;
+			}
+
+			BT_CHECK (pEvent->GetSource () == UG_MOUSE);
+			if (pEvent->GetType () == UG_MOUSE_MOVE) {
+				UGMouseMoveEvent *pMove = (UGMouseMoveEvent *) Buffer;
+				pX[i] += pMove->GetX ();
+				pY[i] += pMove->GetY ();
+			}
+		}
+	}
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	CBTSimMouse *pMice[MULTI_MICE];
+	CBTSimKeyboard *pKeyboards[MULTI_KEYBOARDS];
+	CBTSimPeer *Peers[MULTI_PEERS];
+	u8 BDAddr[BT_BD_ADDR_SIZE] = {0x00, 0x22, 0x33, 0x44, 0x55, 0x66};
+	for (unsigned i = 0; i < MULTI_MICE; i++) {
+		BDAddr[0] = 0x10 + i;
+		Peers[i] = pMice[i] = new CBTSimMouse (BDAddr);
+	}
+	for (unsigned i = 0; i < MULTI_KEYBOARDS; i++) {
+		BDAddr[0] = 0x40 + i;
+		Peers[MULTI_MICE + i] = pKeyboards[i] = new CBTSimKeyboard (BDAddr);
+	}
+
+	// the controller takes as many commands as are sent, their answers
+	// still have to find room while all devices are set up
+	BTTestController ()->SetCommandPackets (255);
+
+	CBTSubSystem *pBT = BTTestBoot (Peers, MULTI_PEERS);
+	if (pBT == 0 || BTTestAcceptAll (pBT, Peers, MULTI_PEERS) != MULTI_PEERS) {
+		return BT_TEST_RESULT ();
+	}
+	CBTHIDDevice *pDevices[MULTI_PEERS];
+	for (unsigned i = 0; i < MULTI_PEERS; i++) {
+		pDevices[i] = BTTestGetDevice (pBT, Peers[i]);
+		BT_CHECK (pDevices[i] != 0);
+		if (pDevices[i] == 0) {
+			return BT_TEST_RESULT ();
+		}
+	}
+	BT_CHECK (pBT->GetDeviceCount () == MULTI_PEERS);
+
+	BT_CHECK (pBT->GetReceiveDrops () == 0);
+	unsigned nInputs[MULTI_PEERS];
+	for (unsigned i = 0; i < MULTI_PEERS; i++) {
+		nInputs[i] = pDevices[i]->GetInputCount ();
+	}
+
+	// mouse i moves i+1 right and a changing step down, so motion that
+	// lands on the wrong device shows; each round goes out at once and is
+	// read once every device decoded its part
+	int nSentX[MULTI_MICE], nSentY[MULTI_MICE];
+	int nX[MULTI_MICE], nY[MULTI_MICE];
+	for (unsigned i = 0; i < MULTI_MICE; i++) {
+		nSentX[i] = nSentY[i] = nX[i] = nY[i] = 0;
+	}
+	unsigned nStart = getClockTicks ();
+	for (unsigned r = 0; r < MULTI_ROUNDS; r++) {
+		for (unsigned i = 0; i < MULTI_MICE; i++) {
+			int nStep = 1 + (r + i) % 5;
+			BT_CHECK (pMice[i]->Move ((signed char) (i + 1), (signed char) nStep));
+			nSentX[i] += i + 1;
+			nSentY[i] += nStep;
+			nInputs[i]++;
+		}
+		for (unsigned i = 0; i < MULTI_KEYBOARDS; i++) {
+			BT_CHECK (pKeyboards[i]->KeyPress (0, 0x04 + r % 26));	// press and release
+			nInputs[MULTI_MICE + i] += 2;
+		}
+		for (unsigned i = 0; i < MULTI_PEERS; i++) {
+			BT_CHECK (BTTestWaitInput (pDevices[i], nInputs[i]));
+		}
+		Receive (pDevices, nX, nY);
+	}
+	unsigned nElapsed = getClockTicks () - nStart;
+
+	// a key held down at the end
+	for (unsigned i = 0; i < MULTI_KEYBOARDS; i++) {
+		u8 Report[9] = {KEYBOARD_REPORT_ID, 0, 0, KEYBOARD_LAST_KEY};
+		BT_CHECK (pKeyboards[i]->SendInput (Report, sizeof Report));
+		BT_CHECK (BTTestWaitInput (pDevices[MULTI_MICE + i], ++nInputs[MULTI_MICE + i]));
+
+		TBTHIDInput Input;
+		BT_CHECK (pDevices[MULTI_MICE + i]->GetInput (&Input));
+		BT_CHECK (Input.Value[BTHIDSlotKey0] == KEYBOARD_LAST_KEY);
+	}
+
+	for (unsigned i = 0; i < MULTI_MICE; i++) {
+		printf ("mouse %u moved %d,%d of %d,%d\n", i, nX[i], nY[i], nSentX[i], nSentY[i]);
+		BT_CHECK (nX[i] == nSentX[i] && nY[i] == nSentY[i]);
+		BT_CHECK (pMice[i]->GetReportsSent () == MULTI_ROUNDS);
+	}
+	for (unsigned i = 0; i < MULTI_KEYBOARDS; i++) {
+		BT_CHECK (pKeyboards[i]->GetReportsSent () == 2 * MULTI_ROUNDS + 1);
+	}
+
+	// nothing may be lost on the way in or in front of the reader
+	BT_CHECK (pBT->GetReceiveDrops () == 0);
+	for (unsigned i = 0; i < MULTI_PEERS; i++) {
+		BT_CHECK (pDevices[i]->GetEventDrops () == 0);
+	}
+
+	printf ("%u devices, %u reports in %u ms\n", MULTI_PEERS,
+		MULTI_ROUNDS * (MULTI_MICE + 2 * MULTI_KEYBOARDS), nElapsed / 1000);
+
+	return BT_TEST_RESULT ();
+}
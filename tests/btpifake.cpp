@@ -0,0 +1,129 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Register dispatch and Pi platform stubs for tests which build the Pi drivers
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btpl011fake.h>
+#include <btdmafake.h>
+#include <memio.h>
+#include <bluetooth/gpiopin.h>
+#include <platform/bt_uart.h>
+#include <platform/bt_clock.h>
+#include <platform/bt_dma.h>
+#include <assert.h>
+#include <stdio.h>
+
+// accesses are routed to whichever register model is alive
+
+static boolean IsUART (uintptr nAddress)
+{
+	return    CPL011Fake::Get () != 0
+	       && nAddress >= ARM_UART0_BASE && nAddress < ARM_UART0_BASE + 0x100 ? TRUE : FALSE;
+}
+
+static boolean IsDMA (uintptr nAddress)
+{
+	return    CBCMDMAFake::Get () != 0
+	       && nAddress >= ARM_DMA_BASE (0) && nAddress <= ARM_DMA_ENABLE ? TRUE : FALSE;
+}
+
+u32 read32 (uintptr nAddress)
+{
+	if (IsUART (nAddress)) {
+		return CPL011Fake::Get ()->Read (nAddress - ARM_UART0_BASE);
+	}
+
+	if (IsDMA (nAddress)) {
+		return CBCMDMAFake::Get ()->Read (nAddress);
+	}
+
+	printf ("read32: no model at 0x%08lX\n", (unsigned long) nAddress);
+	return 0;
+}
+
+void write32 (uintptr nAddress, u32 nValue)
+{
+	if (IsUART (nAddress)) {
+		CPL011Fake::Get ()->Write (nAddress - ARM_UART0_BASE, nValue);
+		return;
+	}
+
+	if (IsDMA (nAddress)) {
+		CBCMDMAFake::Get ()->Write (nAddress, nValue);
+		return;
+	}
+
+	printf ("write32: no model at 0x%08lX\n", (unsigned long) nAddress);
+}
+
+// Bus addresses are offsets from a base below the first buffer seen, the
+// heap blocks handed to the engine lie within the 1 GB window.
+
+static uintptr s_nBusBase = 0;
+
+u32 DMAFakeBusAddress (uintptr nAddress)
+{
+	if (s_nBusBase == 0) {
+		s_nBusBase = (nAddress & ~0xFFFFF) - 0x10000000;
+	}
+
+	assert (nAddress - s_nBusBase < 0x40000000);
+	return GPU_UNCACHED_BASE | (u32) (nAddress - s_nBusBase);
+}
+
+void *DMAFakeHostAddress (u32 nBusAddress)
+{
+	assert (s_nBusBase != 0);
+	return (void *) (s_nBusBase + (nBusAddress & ~GPU_UNCACHED_BASE));
+}
+
+// the Pi platform pieces the transport links against
+
+unsigned RPI_GetUartClockRate (void)
+{
+	return 48000000;
+}
+
+CGPIOPin::CGPIOPin (void)
+{
+}
+
+CGPIOPin::CGPIOPin (unsigned, TGPIOMode, CGPIOManager *)
+{
+}
+
+CGPIOPin::~CGPIOPin (void)
+{
+}
@@ -0,0 +1,262 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Register level model of the PL011 UART for host tests
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btpl011fake.h>
+#include <platform/bt_uart.h>
+#include <platform/bt_interrupt-system.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PL011_MAX_IRQ_RUNS	100	// handler runs per Interrupt(), more is a stuck IRQ
+
+CPL011Fake *CPL011Fake::s_pThis = 0;
+
+CPL011Fake::CPL011Fake (void)
+:	m_nTxLevel (0),
+	m_nRxLevel (0),
+	m_nWireLength (0),
+	m_nRxWireIn (0),
+	m_nRxWireOut (0),
+	m_nIBRD (0),
+	m_nFBRD (0),
+	m_nLCRH (0),
+	m_nCR (0x300),			// reset value, TXE and RXE set
+	m_nIFLS (0x12),			// reset value, 1/2 each way
+	m_nIMSC (0),
+	m_nRIS (0),
+	m_nDMACR (0),
+	m_nTxOverflows (0),
+	m_nRxUnderflows (0),
+	m_nInterrupts (0),
+	m_bInIRQ (FALSE)
+{
+	assert (s_pThis == 0);
+	s_pThis = this;
+}
+
+CPL011Fake::~CPL011Fake (void)
+{
+	s_pThis = 0;
+}
+
+u32 CPL011Fake::Read (unsigned nOffset)
+{
+	switch (nOffset) {
+	case ARM_UART0_DR - ARM_UART0_BASE: {
+		if (m_nRxLevel == 0) {
+			m_nRxUnderflows++;
+			return 0;
+		}
+		u32 nValue = m_RxFIFO[0];
+		memmove (m_RxFIFO, m_RxFIFO+1, --m_nRxLevel * sizeof m_RxFIFO[0]);
+		UpdateRx ();
+		return nValue;
+		}
+
+	case ARM_UART0_FR - ARM_UART0_BASE: {
+		u32 nValue = 0;
+		if (m_nTxLevel == 0) nValue |= FR_TXFE_MASK;
+		if (m_nTxLevel == PL011_FIFO_SIZE) nValue |= FR_TXFF_MASK;
+		if (m_nRxLevel == 0) nValue |= FR_RXFE_MASK;
+		if (m_nRxLevel == PL011_FIFO_SIZE) nValue |= FR_RXFF_MASK;
+		if (m_nTxLevel > 0) nValue |= FR_BUSY_MASK;
+		return nValue;
+		}
+
+	case ARM_UART0_IBRD - ARM_UART0_BASE:	return m_nIBRD;
+	case ARM_UART0_FBRD - ARM_UART0_BASE:	return m_nFBRD;
+	case ARM_UART0_LCRH - ARM_UART0_BASE:	return m_nLCRH;
+	case ARM_UART0_CR - ARM_UART0_BASE:	return m_nCR;
+	case ARM_UART0_IFLS - ARM_UART0_BASE:	return m_nIFLS;
+	case ARM_UART0_IMSC - ARM_UART0_BASE:	return m_nIMSC;
+	case ARM_UART0_RIS - ARM_UART0_BASE:	return m_nRIS;
+	case ARM_UART0_MIS - ARM_UART0_BASE:	return m_nRIS & m_nIMSC;
+	case ARM_UART0_DMACR - ARM_UART0_BASE:	return m_nDMACR;
+
+	default:
+		printf ("pl011: read of unknown register 0x%02X\n", nOffset);
+		return 0;
+	}
+}
+
+void CPL011Fake::Write (unsigned nOffset, u32 nValue)
+{
+	switch (nOffset) {
+	case ARM_UART0_DR - ARM_UART0_BASE:
+		if (m_nTxLevel == PL011_FIFO_SIZE) {
+			m_nTxOverflows++;
+			break;
+		}
+		m_TxFIFO[m_nTxLevel++] = nValue & 0xFF;
+		// filling the FIFO above the trigger level clears the interrupt
+		if (m_nTxLevel > TxTrigger ()) {
+			m_nRIS &= ~INT_TX;
+		}
+		break;
+
+	case ARM_UART0_IBRD - ARM_UART0_BASE:	m_nIBRD = nValue;	break;
+	case ARM_UART0_FBRD - ARM_UART0_BASE:	m_nFBRD = nValue;	break;
+	case ARM_UART0_LCRH - ARM_UART0_BASE:	m_nLCRH = nValue;	break;
+	case ARM_UART0_CR - ARM_UART0_BASE:	m_nCR = nValue;		break;
+	case ARM_UART0_IFLS - ARM_UART0_BASE:	m_nIFLS = nValue;	break;
+	case ARM_UART0_IMSC - ARM_UART0_BASE:	m_nIMSC = nValue & 0x7FF; break;
+	case ARM_UART0_ICR - ARM_UART0_BASE:	m_nRIS &= ~nValue;	break;
+	case ARM_UART0_DMACR - ARM_UART0_BASE:	m_nDMACR = nValue;	break;
+
+	default:
+		printf ("pl011: write of unknown register 0x%02X\n", nOffset);
+		break;
+	}
+}
+
+unsigned CPL011Fake::Tick (unsigned nBytes)
+{
+	boolean bEnabled = m_nCR & CR_UART_EN_MASK ? TRUE : FALSE;
+
+	unsigned nSent = 0;
+	if (bEnabled && (m_nCR & CR_TXE_MASK)) {
+		while (nSent < nBytes && m_nTxLevel > 0) {
+			assert (m_nWireLength < PL011_WIRE_SIZE);
+			m_Wire[m_nWireLength++] = m_TxFIFO[0];
+			memmove (m_TxFIFO, m_TxFIFO+1, --m_nTxLevel);
+			nSent++;
+
+			// the TX interrupt is an edge, it fires when the level
+			// drops through the trigger level, not while it stays below
+			if (m_nTxLevel == TxTrigger ()) {
+				m_nRIS |= INT_TX;
+			}
+		}
+	}
+
+	if (bEnabled && (m_nCR & CR_RXE_MASK)) {
+		unsigned nReceived = 0;
+		while (nReceived < nBytes && m_nRxWireOut != m_nRxWireIn) {
+			u16 usData = m_RxWire[m_nRxWireOut++ % PL011_WIRE_SIZE];
+			nReceived++;
+
+			if (m_nRxLevel == PL011_FIFO_SIZE) {
+				m_nRIS |= INT_OE;	// the character is lost
+				continue;
+			}
+			m_RxFIFO[m_nRxLevel++] = usData;
+		}
+
+		// a FIFO below the trigger level times out once the line is idle
+		if (nReceived == 0 && m_nRxLevel > 0) {
+			m_nRIS |= INT_RT;
+		}
+		UpdateRx ();
+	}
+
+	Interrupt ();
+
+	return nSent;
+}
+
+void CPL011Fake::Receive (const void *pBuffer, unsigned nLength, u32 nErrors)
+{
+	const u8 *pByte = (const u8 *) pBuffer;
+
+	assert (m_nRxWireIn - m_nRxWireOut + nLength <= PL011_WIRE_SIZE);
+	while (nLength--) {
+		m_RxWire[m_nRxWireIn++ % PL011_WIRE_SIZE] = *pByte++ | nErrors;
+	}
+}
+
+void CPL011Fake::Interrupt (void)
+{
+	if (m_bInIRQ) {
+		return;
+	}
+
+	TInterruptSystem *pInterruptSystem = InterruptSystemGet ();
+	TIRQHandler *pHandler = pInterruptSystem->m_apIRQHandler[ARM_IRQ_UART];
+	if (pHandler == 0) {
+		return;
+	}
+
+	m_bInIRQ = TRUE;
+
+	unsigned nRuns = 0;
+	while ((m_nRIS & m_nIMSC) != 0) {
+		if (nRuns++ == PL011_MAX_IRQ_RUNS) {
+			printf ("pl011: interrupt 0x%03X stuck\n", (unsigned) (m_nRIS & m_nIMSC));
+			break;
+		}
+
+		(*pHandler) (pInterruptSystem->m_pParam[ARM_IRQ_UART]);
+		m_nInterrupts++;
+	}
+
+	m_bInIRQ = FALSE;
+}
+
+CPL011Fake *CPL011Fake::Get (void)
+{
+	return s_pThis;
+}
+
+unsigned CPL011Fake::TxTrigger (void) const
+{
+	static const unsigned Level[] = {2, 4, 8, 12, 14};
+
+	unsigned nSelect = (m_nIFLS & IFLS_TXIFSEL_MASK) >> IFLS_TXIFSEL_SHIFT;
+	return nSelect < 5 ? Level[nSelect] : 8;
+}
+
+unsigned CPL011Fake::RxTrigger (void) const
+{
+	static const unsigned Level[] = {2, 4, 8, 12, 14};
+
+	unsigned nSelect = (m_nIFLS & IFLS_RXIFSEL_MASK) >> IFLS_RXIFSEL_SHIFT;
+	return nSelect < 5 ? Level[nSelect] : 8;
+}
+
+void CPL011Fake::UpdateRx (void)
+{
+	if (m_nRxLevel >= RxTrigger ()) {
+		m_nRIS |= INT_RX;
+	} else {
+		m_nRIS &= ~INT_RX;
+	}
+
+	if (m_nRxLevel == 0) {
+		m_nRIS &= ~INT_RT;
+	}
+}
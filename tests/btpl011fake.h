@@ -0,0 +1,123 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Register level model of the PL011 UART for host tests
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_pl011fake_h
+#define _bt_pl011fake_h
+
+#include <types.h>
+
+#define PL011_FIFO_SIZE		16
+#define PL011_WIRE_SIZE		65536	// bytes captured from TX / queued for RX
+
+// Models the registers the transport uses: DR, FR, IBRD, FBRD, LCRH, CR,
+// IFLS, IMSC, RIS, MIS, ICR and DMACR. Time only advances in Tick(), which
+// shifts bytes between the FIFOs and the wire and then runs the connected
+// UART IRQ handler while an unmasked interrupt is pending, as the
+// interrupt controller would. The DMA model uses the same register
+// interface, the FIFO levels are its DREQ lines.
+class CPL011Fake
+{
+public:
+	CPL011Fake (void);
+	~CPL011Fake (void);
+
+	// register accesses, called through read32 / write32
+	u32 Read (unsigned nOffset);
+	void Write (unsigned nOffset, u32 nValue);
+
+	// moves up to nBytes each way, returns the bytes transmitted
+	unsigned Tick (unsigned nBytes = 1);
+
+	// queues characters on the RX wire, they enter the FIFO in Tick(),
+	// nErrors are DR error bits (e.g. DR_FE_MASK) reported with each
+	void Receive (const void *pBuffer, unsigned nLength, u32 nErrors = 0);
+
+	// runs the IRQ handler while an interrupt is pending, Tick() does it too
+	void Interrupt (void);
+
+	const u8 *GetTransmitted (void) const	{ return m_Wire; }
+	unsigned GetTransmittedLength (void) const { return m_nWireLength; }
+	void ClearTransmitted (void)		{ m_nWireLength = 0; }
+
+	unsigned GetTxLevel (void) const	{ return m_nTxLevel; }
+	unsigned GetRxLevel (void) const	{ return m_nRxLevel; }
+	u32 GetIMSC (void) const		{ return m_nIMSC; }
+	u32 GetCR (void) const			{ return m_nCR; }
+	u32 GetLCRH (void) const		{ return m_nLCRH; }
+	u32 GetDMACR (void) const		{ return m_nDMACR; }
+
+	unsigned GetTxOverflows (void) const	{ return m_nTxOverflows; }	// DR written while TXFF
+	unsigned GetRxUnderflows (void) const	{ return m_nRxUnderflows; }	// DR read while RXFE
+	unsigned GetInterrupts (void) const	{ return m_nInterrupts; }
+
+	static CPL011Fake *Get (void);
+
+private:
+	unsigned TxTrigger (void) const;
+	unsigned RxTrigger (void) const;
+	void UpdateRx (void);
+
+private:
+	u8 m_TxFIFO[PL011_FIFO_SIZE];
+	unsigned m_nTxLevel;
+	u16 m_RxFIFO[PL011_FIFO_SIZE];		// character and error bits
+	unsigned m_nRxLevel;
+
+	u8 m_Wire[PL011_WIRE_SIZE];
+	unsigned m_nWireLength;
+	u16 m_RxWire[PL011_WIRE_SIZE];
+	unsigned m_nRxWireIn;
+	unsigned m_nRxWireOut;
+
+	u32 m_nIBRD;
+	u32 m_nFBRD;
+	u32 m_nLCRH;
+	u32 m_nCR;
+	u32 m_nIFLS;
+	u32 m_nIMSC;
+	u32 m_nRIS;
+	u32 m_nDMACR;
+
+	unsigned m_nTxOverflows;
+	unsigned m_nRxUnderflows;
+	unsigned m_nInterrupts;
+	boolean m_bInIRQ;
+
+	static CPL011Fake *s_pThis;
+};
+
+#endif
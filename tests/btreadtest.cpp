@@ -0,0 +1,237 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Tests the reader calls of L2CAP channels
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+
+// TryRead, Read and PollChannels on a channel to the echo peer: what an
+// empty or a closed channel returns, how long a Read waits, which
+// readiness is reported, and that SDUs which do not fit into the ring are
+// counted
+
+#define READ_DEPTH		4		// SDUs the ring takes
+#define READ_SDUS		10		// written while nothing is read
+#define READ_SDU_SIZE		100
+#define READ_TIMEOUT		30000		// us
+#define READ_MAX_SDU		100		// of the second channel
+#define READ_UNKNOWN_CID	0x0999
+
+static void Fill (u8 *pSDU, unsigned nLength, unsigned nSeed)
+{
+	for (unsigned i = 0; i < nLength; i++) {
+		pSDU[i] = (u8) (nSeed * 13 + i);
+	}
+}
+
+static boolean IsSDU (const u8 *pSDU, u16 nLength, unsigned nExpected, unsigned nSeed)
+{
+	u8 Expected[BT_SIM_PEER_MTU];
+	Fill (Expected, nExpected, nSeed);
+
+	return nLength == nExpected && memcmp (pSDU, Expected, nExpected) == 0;
+}
+
+// waits until the channel dropped nDrops SDUs
+static boolean WaitDrops (CBTL2CAPLayer *pL2CAP, u16 nCID, unsigned nDrops)
+{
+	unsigned nStart = getClockTicks ();
+	while (   pL2CAP->GetReceiveDrops (nCID) < nDrops
+	       && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (1000);
+	}
+
+	return pL2CAP->GetReceiveDrops (nCID) == nDrops;
+}
+
+static void TestEmpty (CBTL2CAPLayer *pL2CAP, u16 nCID)
+{
+	u8 SDU[BT_SIM_PEER_MTU];
+	u16 nLength;
+	BT_CHECK (pL2CAP->TryRead (nCID, sizeof SDU, SDU, &nLength)
+		  == BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED);
+	BT_CHECK (pL2CAP->TryRead (READ_UNKNOWN_CID, sizeof SDU, SDU, &nLength)
+		  == BT_L2CAP_RESULT_REJECTED);
+
+	// the Read waits as long as asked, not more
+	unsigned nStart = getClockTicks ();
+	BT_CHECK (pL2CAP->Read (nCID, sizeof SDU, SDU, &nLength, READ_TIMEOUT)
+		  == BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED);
+	unsigned nElapsed = getClockTicks () - nStart;
+	BT_CHECK (nElapsed >= READ_TIMEOUT && nElapsed < 10 * READ_TIMEOUT);
+	BT_CHECK (pL2CAP->Read (READ_UNKNOWN_CID, sizeof SDU, SDU, &nLength, READ_TIMEOUT)
+		  == BT_L2CAP_RESULT_REJECTED);
+
+	// only the room to write is ready, an unknown channel is closed
+	TBTL2CAPPollEntry Entries[] = {
+		{nCID, BT_L2CAP_POLL_READ, 0},
+		{nCID, BT_L2CAP_POLL_READ | BT_L2CAP_POLL_WRITE, 0},
+		{READ_UNKNOWN_CID, BT_L2CAP_POLL_READ, 0}
+	};
+	nStart = getClockTicks ();
+	BT_CHECK (pL2CAP->PollChannels (Entries, 1, READ_TIMEOUT) == 0);
+	BT_CHECK (getClockTicks () - nStart >= READ_TIMEOUT);
+	BT_CHECK (Entries[0].nReady == 0);
+	BT_CHECK (pL2CAP->PollChannels (Entries, 3, READ_TIMEOUT) == 2);
+	BT_CHECK (Entries[0].nReady == 0);
+	BT_CHECK (Entries[1].nReady == BT_L2CAP_POLL_WRITE);
+	BT_CHECK (Entries[2].nReady == BT_L2CAP_POLL_CLOSED);
+}
+
+static void TestOverflow (CBTL2CAPLayer *pL2CAP, u16 nCID)
+{
+	// nobody reads, the ring keeps the first ones and counts the rest
+	u8 SDU[BT_SIM_PEER_MTU];
+	for (unsigned i = 0; i < READ_SDUS; i++) {
+		Fill (SDU, READ_SDU_SIZE, i);
+		BT_CHECK (pL2CAP->Write (nCID, READ_SDU_SIZE, SDU, 0) == BT_L2CAP_RESULT_SUCCESS);
+	}
+	BT_CHECK (WaitDrops (pL2CAP, nCID, READ_SDUS - READ_DEPTH));
+
+	TBTL2CAPPollEntry Entry = {nCID, BT_L2CAP_POLL_READ, 0};
+	BT_CHECK (pL2CAP->PollChannels (&Entry, 1, 0) == 1 && Entry.nReady == BT_L2CAP_POLL_READ);
+
+	u16 nLength;
+	for (unsigned i = 0; i < READ_DEPTH; i++) {
+		BT_CHECK (   pL2CAP->TryRead (nCID, sizeof SDU, SDU, &nLength) == BT_L2CAP_RESULT_SUCCESS
+			  && IsSDU (SDU, nLength, READ_SDU_SIZE, i));
+	}
+	BT_CHECK (pL2CAP->TryRead (nCID, sizeof SDU, SDU, &nLength)
+		  == BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED);
+	BT_CHECK (pL2CAP->PollChannels (&Entry, 1, 0) == 0);
+	BT_CHECK (pL2CAP->GetReceiveDrops (nCID) == READ_SDUS - READ_DEPTH);
+}
+
+static void TestReady (CBTL2CAPLayer *pL2CAP, u16 nCID)
+{
+	u8 SDU[BT_SIM_PEER_MTU];
+	u16 nLength;
+
+	// the echo ends a poll and a Read long before their timeout
+	Fill (SDU, READ_SDU_SIZE, 1);
+	BT_CHECK (pL2CAP->Write (nCID, READ_SDU_SIZE, SDU, 0) == BT_L2CAP_RESULT_SUCCESS);
+	TBTL2CAPPollEntry Entry = {nCID, BT_L2CAP_POLL_READ, 0};
+	BT_CHECK (pL2CAP->PollChannels (&Entry, 1, TEST_TIMEOUT) == 1);
+	BT_CHECK (Entry.nReady == BT_L2CAP_POLL_READ);
+	BT_CHECK (   pL2CAP->TryRead (nCID, sizeof SDU, SDU, &nLength) == BT_L2CAP_RESULT_SUCCESS
+		  && IsSDU (SDU, nLength, READ_SDU_SIZE, 1));
+
+	unsigned nStart = getClockTicks ();
+	Fill (SDU, READ_SDU_SIZE, 2);
+	BT_CHECK (pL2CAP->Write (nCID, READ_SDU_SIZE, SDU, 0) == BT_L2CAP_RESULT_SUCCESS);
+	BT_CHECK (   pL2CAP->Read (nCID, sizeof SDU, SDU, &nLength, TEST_TIMEOUT) == BT_L2CAP_RESULT_SUCCESS
+		  && IsSDU (SDU, nLength, READ_SDU_SIZE, 2));
+	BT_CHECK (getClockTicks () - nStart < TEST_TIMEOUT / 10);
+
+	// a short read takes the start of the SDU, the rest is gone
+	Fill (SDU, BT_SIM_PEER_MTU, 3);
+	BT_CHECK (pL2CAP->Write (nCID, BT_SIM_PEER_MTU, SDU, 0) == BT_L2CAP_RESULT_SUCCESS);
+	u8 Start[10];
+	BT_CHECK (   pL2CAP->Read (nCID, sizeof Start, Start, &nLength, TEST_TIMEOUT) == BT_L2CAP_RESULT_SUCCESS
+		  && IsSDU (Start, nLength, sizeof Start, 3));
+	BT_CHECK (pL2CAP->TryRead (nCID, sizeof SDU, SDU, &nLength)
+		  == BT_L2CAP_RESULT_DISCONNECTION_TIMEOUT_OCCURRED);
+}
+
+static void TestLimit (CBTL2CAPLayer *pL2CAP, u16 nCID)
+{
+	// SDUs above the limit of the ring are counted, not cut
+	BT_CHECK (pL2CAP->SetReceiveQueue (nCID, READ_DEPTH, READ_MAX_SDU));
+	BT_CHECK (!pL2CAP->SetReceiveQueue (nCID, READ_DEPTH));	// too late
+
+	u8 SDU[BT_SIM_PEER_MTU];
+	u16 nLength;
+	Fill (SDU, READ_MAX_SDU + 1, 4);
+	BT_CHECK (pL2CAP->Write (nCID, READ_MAX_SDU + 1, SDU, 0) == BT_L2CAP_RESULT_SUCCESS);
+	Fill (SDU, READ_MAX_SDU, 5);
+	BT_CHECK (pL2CAP->Write (nCID, READ_MAX_SDU, SDU, 0) == BT_L2CAP_RESULT_SUCCESS);
+	BT_CHECK (   pL2CAP->Read (nCID, sizeof SDU, SDU, &nLength, TEST_TIMEOUT) == BT_L2CAP_RESULT_SUCCESS
+		  && IsSDU (SDU, nLength, READ_MAX_SDU, 5));
+	BT_CHECK (pL2CAP->GetReceiveDrops (nCID) == 1);
+}
+
+static void TestClosed (CBTL2CAPLayer *pL2CAP, u16 nCID)
+{
+	// a reader does not wait for a closed channel
+	u8 SDU[BT_SIM_PEER_MTU];
+	u16 nLength;
+	Fill (SDU, READ_SDU_SIZE, 6);
+	BT_CHECK (pL2CAP->Write (nCID, READ_SDU_SIZE, SDU, 0) == BT_L2CAP_RESULT_SUCCESS);
+	TBTL2CAPPollEntry Entry = {nCID, BT_L2CAP_POLL_READ, 0};
+	BT_CHECK (pL2CAP->PollChannels (&Entry, 1, TEST_TIMEOUT) == 1);
+	BT_CHECK (pL2CAP->Disconnect (nCID) == BT_L2CAP_RESULT_SUCCESS);
+
+	BT_CHECK (   pL2CAP->PollChannels (&Entry, 1, TEST_TIMEOUT) == 1
+		  && Entry.nReady == BT_L2CAP_POLL_CLOSED);
+	unsigned nStart = getClockTicks ();
+	BT_CHECK (pL2CAP->Read (nCID, sizeof SDU, SDU, &nLength, TEST_TIMEOUT)
+		  == BT_L2CAP_RESULT_REJECTED);
+	BT_CHECK (getClockTicks () - nStart < TEST_TIMEOUT / 10);
+	BT_CHECK (pL2CAP->TryRead (nCID, sizeof SDU, SDU, &nLength) == BT_L2CAP_RESULT_REJECTED);
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	u8 BDAddr[BT_BD_ADDR_SIZE] = {0x21, 0x22, 0x33, 0x44, 0x55, 0x66};
+	CBTSimEchoPeer *pEcho = new CBTSimEchoPeer (BDAddr);
+	CBTSimPeer *pPeer = pEcho;
+	CBTSubSystem *pBT = BTTestBoot (&pPeer, 1);
+	if (pBT == 0) {
+		return BT_TEST_RESULT ();
+	}
+	CBTL2CAPLayer *pL2CAP = pBT->GetL2CAPLayer ();
+
+	u16 nCID = BTTestOpenChannel (pBT, pEcho, BT_SIM_ECHO_PSM);
+	if (nCID == 0) {
+		return BT_TEST_RESULT ();
+	}
+	BT_CHECK (pL2CAP->SetReceiveQueue (nCID, READ_DEPTH));
+	TestEmpty (pL2CAP, nCID);
+	TestOverflow (pL2CAP, nCID);
+	TestReady (pL2CAP, nCID);
+	TestClosed (pL2CAP, nCID);
+
+	// the peer echoes on its first channel of the PSM, so one at a time
+	nCID = BTTestOpenChannel (pBT, pEcho, BT_SIM_ECHO_PSM);
+	if (nCID != 0) {
+		TestLimit (pL2CAP, nCID);
+	}
+
+	BT_CHECK (pBT->GetReceiveDrops () == 0);
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,181 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Sends randomly interleaved ACL fragments of two links through the reassembly
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+
+// the simulated controller cuts the reports of two mice into fragments of
+// random size and interleaves the links at random; every fourth report is
+// padded beyond one pool packet, so reassembly has to grow it; then the
+// controller cuts large reports only where the host's Host Buffer Size
+// says; every motion has to arrive on the right device and nothing may be
+// dropped, neither a fragment nor a partial PDU, nor may one time out
+
+#define INTERLEAVE_REPORTS	200	// per mouse
+#define INTERLEAVE_FRAGMENT	64	// bytes at most
+#define INTERLEAVE_JITTER	2000	// us
+#define INTERLEAVE_LARGE	600	// bytes at most
+#define LARGE_REPORTS		50	// per mouse, cut by the controller only
+
+#define MOUSE_REPORT_ID		0x02	// of the simulated mouse's descriptor
+#define MOUSE_REPORT_SIZE	5	// with the ID
+
+static const u8 MouseAddr[2][BT_BD_ADDR_SIZE] =
+{
+	{0x11, 0x22, 0x33, 0x44, 0x55, 0x66},
+	{0x11, 0x22, 0x33, 0x44, 0x55, 0x67}
+};
+
+// motion may be coalesced, so it is summed up
+static void ReceiveMotion (CBTHIDDevice **ppDevices, int *pX, int *pY)
+{
+	for (unsigned i = 0; i < 2; i++) {
+		u8 Buffer[BT_HIDP_MAX_EVENT_SIZE];
+		unsigned nLength;
+		while (ppDevices[i]->ReceiveEvent (Buffer, &nLength)) {
+			UGEvent *pEvent = (UGEvent *) Buffer;
+			BT_CHECK (pEvent->GetSource () == UG_MOUSE);
+			if (pEvent->GetType () == UG_MOUSE_MOVE) {
+				UGMouseMoveEvent *pMove = (UGMouseMoveEvent *) Buffer;
+				pX[i] += pMove->GetX ();
+				pY[i] += pMove->GetY ();
+			}
+		}
+	}
+}
+
+// the first mouse only moves right, the second only down, each by a step
+// that changes with every report; all rounds go out at once, the host has
+// to hold the controller back with flow control
+static void SendRounds (CBTSimMouse **ppMice, CBTHIDDevice **ppDevices, unsigned nRounds,
+			boolean bLargeOnly, unsigned *pInputs, int *pSentX, int *pSentY)
+{
+	u8 Report[INTERLEAVE_LARGE];
+	memset (Report, 0xA5, sizeof Report);
+	for (unsigned i = 0; i < nRounds; i++) {
+		for (unsigned j = 0; j < 2; j++) {
+			int nStep = 1 + i % 7;
+			Report[0] = MOUSE_REPORT_ID;
+			Report[1] = 0;
+			Report[2] = j == 0 ? nStep : 0;
+			Report[3] = j == 0 ? 0 : nStep;
+			Report[4] = 0;
+			unsigned nLength;
+			if (bLargeOnly) {
+				nLength = INTERLEAVE_LARGE;
+			} else if (i % 4 == 3) {
+				nLength = BT_MAX_DATA_SIZE + rand () % (INTERLEAVE_LARGE-BT_MAX_DATA_SIZE+1);
+			} else {
+				nLength = MOUSE_REPORT_SIZE + rand () % BT_HIDP_MTU;
+			}
+			BT_CHECK (ppMice[j]->SendInput (Report, nLength));
+			if (j == 0) {
+				*pSentX += nStep;
+			} else {
+				*pSentY += nStep;
+			}
+			pInputs[j]++;
+		}
+	}
+
+	for (unsigned j = 0; j < 2; j++) {
+		BT_CHECK (BTTestWaitInput (ppDevices[j], pInputs[j]));
+	}
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	CBTSimMouse *pMice[2];
+	CBTSimPeer *Peers[2];
+	for (unsigned i = 0; i < 2; i++) {
+		Peers[i] = pMice[i] = new CBTSimMouse (MouseAddr[i]);
+	}
+
+	CBTSimController *pController;
+	CBTSubSystem *pBT = BTTestBoot (Peers, 2, &pController);
+	if (pBT == 0 || BTTestAcceptAll (pBT, Peers, 2) != 2) {
+		return BT_TEST_RESULT ();
+	}
+	CBTHIDDevice *pDevices[2];
+	for (unsigned i = 0; i < 2; i++) {
+		pDevices[i] = BTTestGetDevice (pBT, pMice[i]);
+		BT_CHECK (pDevices[i] != 0);
+		if (pDevices[i] == 0) {
+			return BT_TEST_RESULT ();
+		}
+	}
+
+	// the host announced what its receive queue takes
+	BT_CHECK (pController->IsHostFlowControl ());
+	BT_CHECK (pController->GetHostACLLength () == BT_HCI_RX_ACL_LENGTH);
+
+	unsigned nDropsBefore = pBT->GetReceiveDrops ();
+	unsigned nInputs[2];
+	for (unsigned i = 0; i < 2; i++) {
+		nInputs[i] = pDevices[i]->GetInputCount ();
+	}
+
+	int nSentX = 0, nSentY = 0;
+	int nX[2] = {0, 0}, nY[2] = {0, 0};
+
+	pController->SetACLInterleave (INTERLEAVE_FRAGMENT, INTERLEAVE_JITTER);
+	srand (1234);
+	SendRounds (pMice, pDevices, INTERLEAVE_REPORTS, FALSE, nInputs, &nSentX, &nSentY);
+	ReceiveMotion (pDevices, nX, nY);
+
+	// the controller would send whole baseband packets, they have to be
+	// cut to what the host takes
+	pController->SetACLInterleave (0, 0);
+	pController->SetACLFragment (BT_SIM_ACL_LENGTH);
+	SendRounds (pMice, pDevices, LARGE_REPORTS, TRUE, nInputs, &nSentX, &nSentY);
+	ReceiveMotion (pDevices, nX, nY);
+
+	unsigned nDrops = pBT->GetReceiveDrops () - nDropsBefore;
+	printf ("mouse 0 moved %d,%d of %d,0, mouse 1 moved %d,%d of 0,%d, %u dropped, "
+		"fragments up to %u bytes\n",
+		nX[0], nY[0], nSentX, nX[1], nY[1], nSentY, nDrops,
+		pController->GetLargestACLToHost ());
+
+	BT_CHECK (nX[0] == nSentX && nY[0] == 0);
+	BT_CHECK (nX[1] == 0 && nY[1] == nSentY);
+	BT_CHECK (nDrops == 0);
+	BT_CHECK (pController->GetLargestACLToHost () == BT_HCI_RX_ACL_LENGTH);
+	BT_CHECK (pMice[0]->GetReportsSent () == pMice[1]->GetReportsSent ());
+
+	return BT_TEST_RESULT ();
+}
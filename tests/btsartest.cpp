@@ -0,0 +1,219 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Tests segmentation and reassembly of SDUs on an ERTM channel
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+#include <bluetooth/btl2capertm.h>
+
+// SDUs above the MPS go out in start, continuation and end segments and
+// come back the same way, also while frames are lost; then the peer sends
+// broken segment sequences of its own, which have to be dropped without
+// taking the SDUs around them along
+
+#define SAR_MTU			8192
+#define SAR_SDUS		100
+#define SAR_LOSS		10		// percent
+#define SAR_SEGMENT		200		// of the injected SDUs
+#define SAR_MARKER		8		// unsegmented SDU after a broken one
+
+static const unsigned s_Sizes[] = {600, 1000, 3000, SAR_MTU};
+
+static void Fill (u8 *pSDU, unsigned nLength, unsigned nSeed)
+{
+	for (unsigned i = 0; i < nLength; i++) {
+		pSDU[i] = (u8) (nSeed * 13 + i + (i >> 8));
+	}
+}
+
+static boolean Expect (CBTL2CAPLayer *pL2CAP, u16 nCID, unsigned nLength, unsigned nSeed)
+{
+	static u8 SDU[SAR_MTU];
+	static u8 Expected[SAR_MTU];
+	u16 nRead;
+	if (pL2CAP->Read (nCID, sizeof SDU, SDU, &nRead, TEST_TIMEOUT) != BT_L2CAP_RESULT_SUCCESS) {
+		return FALSE;
+	}
+	Fill (Expected, nLength, nSeed);
+
+	return nRead == nLength && memcmp (SDU, Expected, nLength) == 0;
+}
+
+static void TestEcho (CBTL2CAPLayer *pL2CAP, u16 nCID, CBTSimERTMPeer *pPeer)
+{
+	static u8 SDU[SAR_MTU];
+	unsigned nGood = 0;
+	for (unsigned n = 0; n < SAR_SDUS; n++) {
+		unsigned nLength = s_Sizes[n % (sizeof s_Sizes / sizeof s_Sizes[0])];
+		Fill (SDU, nLength, n);
+		BT_CHECK (pL2CAP->Write (nCID, nLength, SDU, 0) == BT_L2CAP_RESULT_SUCCESS);
+		if (Expect (pL2CAP, nCID, nLength, n)) {
+			nGood++;
+		}
+		if (n == SAR_SDUS / 2) {
+			pPeer->SetLoss (SAR_LOSS);	// segments go again one by one
+		}
+	}
+	pPeer->SetLoss (0);
+
+	BT_CHECK (nGood == SAR_SDUS);
+	BT_CHECK (pPeer->GetRetransmissions () > 0);
+}
+
+// pData is nLength bytes of an SDU of nSDULength
+static void Start (CBTSimERTMPeer *pPeer, unsigned nSDULength, const u8 *pData, unsigned nLength)
+{
+	u8 Segment[BT_L2CAP_SDU_LENGTH_LEN + SAR_SEGMENT];
+	Segment[0] = (u8) nSDULength;
+	Segment[1] = (u8) (nSDULength >> 8);
+	memcpy (Segment + BT_L2CAP_SDU_LENGTH_LEN, pData, nLength);
+	BT_CHECK (pPeer->SendSegment (BT_L2CAP_SAR_START, Segment, BT_L2CAP_SDU_LENGTH_LEN + nLength));
+}
+
+// the segments of a whole SDU, the start announces nAnnounced bytes
+static void Segments (CBTSimERTMPeer *pPeer, const u8 *pSDU, unsigned nLength, unsigned nAnnounced)
+{
+	Start (pPeer, nAnnounced, pSDU, SAR_SEGMENT);
+	for (unsigned nOffset = SAR_SEGMENT; nOffset < nLength; nOffset += SAR_SEGMENT) {
+		unsigned nSegment = nLength - nOffset;
+		u8 nSAR = BT_L2CAP_SAR_END;
+		if (nSegment > SAR_SEGMENT) {
+			nSegment = SAR_SEGMENT;
+			nSAR = BT_L2CAP_SAR_CONTINUE;
+		}
+
+		// the peer's ring empties as the host acknowledges
+		unsigned nStart = getClockTicks ();
+		while (   !pPeer->SendSegment (nSAR, pSDU + nOffset, nSegment)
+		       && getClockTicks () - nStart < TEST_TIMEOUT) {
+			sleepTask (1000);
+		}
+	}
+}
+
+static void Marker (CBTSimERTMPeer *pPeer, unsigned nSeed)
+{
+	u8 SDU[SAR_MARKER];
+	Fill (SDU, sizeof SDU, nSeed);
+	BT_CHECK (pPeer->SendSegment (BT_L2CAP_SAR_UNSEGMENTED, SDU, sizeof SDU));
+}
+
+static void TestBroken (CBTL2CAPLayer *pL2CAP, u16 nCID, CBTSimERTMPeer *pPeer)
+{
+	static u8 SDU[2 * SAR_SEGMENT];
+	Fill (SDU, sizeof SDU, 1);
+	static u8 Large[SAR_MTU + 1];
+	Fill (Large, sizeof Large, 2);
+
+	// a whole one in three segments
+	Start (pPeer, sizeof SDU, SDU, SAR_SEGMENT);
+	BT_CHECK (pPeer->SendSegment (BT_L2CAP_SAR_CONTINUE, SDU + SAR_SEGMENT, SAR_SEGMENT / 2));
+	BT_CHECK (pPeer->SendSegment (BT_L2CAP_SAR_END, SDU + 3 * SAR_SEGMENT / 2, SAR_SEGMENT / 2));
+
+	// SDU length above the MTU, its segments add up to it
+	Segments (pPeer, Large, sizeof Large, sizeof Large);
+	Marker (pPeer, 2);
+
+	// SDU length not above the start segment
+	Start (pPeer, SAR_SEGMENT, SDU, SAR_SEGMENT);
+	BT_CHECK (pPeer->SendSegment (BT_L2CAP_SAR_END, SDU + SAR_SEGMENT, SAR_SEGMENT));
+	Marker (pPeer, 3);
+
+	// the start segment is missing
+	BT_CHECK (pPeer->SendSegment (BT_L2CAP_SAR_CONTINUE, SDU, SAR_SEGMENT));
+	BT_CHECK (pPeer->SendSegment (BT_L2CAP_SAR_END, SDU + SAR_SEGMENT, SAR_SEGMENT));
+	Marker (pPeer, 4);
+
+	// a start before the end, only the second SDU is whole
+	Fill (SDU, sizeof SDU, 5);
+	Start (pPeer, sizeof SDU, SDU, SAR_SEGMENT);
+	Start (pPeer, sizeof SDU, SDU, SAR_SEGMENT);
+	BT_CHECK (pPeer->SendSegment (BT_L2CAP_SAR_END, SDU + SAR_SEGMENT, SAR_SEGMENT));
+
+	// the end segment comes short
+	Start (pPeer, sizeof SDU, SDU, SAR_SEGMENT);
+	BT_CHECK (pPeer->SendSegment (BT_L2CAP_SAR_END, SDU + SAR_SEGMENT, SAR_SEGMENT / 2));
+	Marker (pPeer, 6);
+
+	// a continuation completes it, the end is one too many
+	Start (pPeer, sizeof SDU, SDU, SAR_SEGMENT);
+	BT_CHECK (pPeer->SendSegment (BT_L2CAP_SAR_CONTINUE, SDU + SAR_SEGMENT, SAR_SEGMENT));
+	BT_CHECK (pPeer->SendSegment (BT_L2CAP_SAR_END, SDU, SAR_SEGMENT / 2));
+	Marker (pPeer, 7);
+
+	BT_CHECK (Expect (pL2CAP, nCID, sizeof SDU, 1));
+	BT_CHECK (Expect (pL2CAP, nCID, SAR_MARKER, 2));
+	BT_CHECK (Expect (pL2CAP, nCID, SAR_MARKER, 3));
+	BT_CHECK (Expect (pL2CAP, nCID, SAR_MARKER, 4));
+	BT_CHECK (Expect (pL2CAP, nCID, sizeof SDU, 5));
+	BT_CHECK (Expect (pL2CAP, nCID, SAR_MARKER, 6));
+	BT_CHECK (Expect (pL2CAP, nCID, SAR_MARKER, 7));
+
+	// and nothing else
+	sleepTask (100000);
+	u16 nRead;
+	BT_CHECK (pL2CAP->TryRead (nCID, sizeof SDU, SDU, &nRead) != BT_L2CAP_RESULT_SUCCESS);
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	u8 BDAddr[BT_BD_ADDR_SIZE] = {0x21, 0x22, 0x33, 0x44, 0x55, 0x66};
+	CBTSimERTMPeer *pPeer = new CBTSimERTMPeer (BDAddr, BT_L2CAP_MODE_ERTM);
+	CBTSimPeer *pSimPeer = pPeer;
+	CBTSubSystem *pBT = BTTestBoot (&pSimPeer, 1);
+	if (pBT == 0) {
+		return BT_TEST_RESULT ();
+	}
+	CBTL2CAPLayer *pL2CAP = pBT->GetL2CAPLayer ();
+
+	TBTL2CAPRFC RFC;
+	memset (&RFC, 0, sizeof RFC);
+	RFC.Mode = BT_L2CAP_MODE_ERTM;
+	u16 nCID = BTTestOpenChannel (pBT, pPeer, BT_SIM_ECHO_PSM, &RFC, SAR_MTU);
+	if (nCID == 0) {
+		return BT_TEST_RESULT ();
+	}
+	BT_CHECK (pL2CAP->GetChannelMode (nCID) == BT_L2CAP_MODE_ERTM);
+
+	TestEcho (pL2CAP, nCID, pPeer);
+	TestBroken (pL2CAP, nCID, pPeer);
+
+	BT_CHECK (pL2CAP->GetReceiveDrops (nCID) == 0);
+	BT_CHECK (pBT->GetReceiveDrops () == 0);
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,138 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Two thread stress test of the single producer / single consumer queue
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btqueue.h>
+#include <bttest.h>
+#include <string.h>
+#include <stdint.h>
+#include <thread>
+
+// one thread enqueues sequence numbered packets of varying length as fast as
+// it can, the other dequeues concurrently, every packet has to arrive once,
+// in order and intact
+
+#define TEST_PACKETS	1000000
+#define TEST_CAPACITY	16
+#define TEST_SLOT_SIZE	64
+
+static void FillPacket (u8 *pBuffer, unsigned nSeq, unsigned nLength)
+{
+	memcpy (pBuffer, &nSeq, sizeof nSeq);
+	for (unsigned i = sizeof nSeq; i < nLength; i++)
+	{
+		pBuffer[i] = (u8) (nSeq * 31 + i);
+	}
+}
+
+static unsigned PacketLength (unsigned nSeq)
+{
+	return sizeof (unsigned) + nSeq % (TEST_SLOT_SIZE - sizeof (unsigned) + 1);
+}
+
+static void Producer (CBTSPSCQueue *pQueue)
+{
+	u8 Buffer[TEST_SLOT_SIZE];
+
+	for (unsigned nSeq = 0; nSeq < TEST_PACKETS; nSeq++)
+	{
+		unsigned nLength = PacketLength (nSeq);
+		FillPacket (Buffer, nSeq, nLength);
+
+		// a full queue is retried, the consumer catches up
+		while (!pQueue->Enqueue (Buffer, nLength, (void *) (uintptr_t) nSeq))
+		{
+			std::this_thread::yield ();
+		}
+	}
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	CBTSPSCQueue Queue (TEST_CAPACITY, TEST_SLOT_SIZE);
+	BT_CHECK (Queue.IsEmpty ());
+	BT_CHECK (Queue.GetCapacity () == TEST_CAPACITY);
+
+	// oversized packets are dropped and counted, not truncated
+	u8 Big[TEST_SLOT_SIZE+1] = {0};
+	BT_CHECK (!Queue.Enqueue (Big, sizeof Big));
+	BT_CHECK (Queue.GetDrops () == 1);
+	BT_CHECK (Queue.IsEmpty ());
+
+	std::thread Thread (Producer, &Queue);
+
+	u8 Buffer[TEST_SLOT_SIZE];
+	u8 Expected[TEST_SLOT_SIZE];
+	unsigned nErrors = 0;
+	unsigned nSeq = 0;
+	while (nSeq < TEST_PACKETS)
+	{
+		void *pParam;
+		unsigned nLength = Queue.Dequeue (Buffer, &pParam);
+		if (nLength == 0)
+		{
+			std::this_thread::yield ();
+			continue;
+		}
+
+		FillPacket (Expected, nSeq, PacketLength (nSeq));
+		if (   nLength != PacketLength (nSeq)
+		    || memcmp (Buffer, Expected, nLength) != 0
+		    || (uintptr_t) pParam != nSeq)
+		{
+			if (nErrors++ < 10)
+			{
+				printf ("packet %u corrupted or out of order\n", nSeq);
+			}
+		}
+
+		nSeq++;
+	}
+
+	Thread.join ();
+
+	BT_CHECK (nErrors == 0);
+	BT_CHECK (Queue.IsEmpty ());
+	BT_CHECK (Queue.GetCount () == 0);
+	BT_CHECK (Queue.Dequeue (Buffer) == 0);
+	BT_CHECK (Queue.GetDrops () == 1);
+
+	printf ("%u packets, %u overflows retried\n", nSeq, Queue.GetOverflows ());
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,136 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Checks the per-layer statistics of a running stack
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <btteststack.h>
+
+// Boots against one echo peer and sends SDUs through it; every timer and
+// high-water mark on that path has to have counted something, and more
+// traffic has to count more. Without BT_HAVE_STATS GetStats has to fail
+// and leave the structure all zero.
+
+#define STATS_SDUS		200
+#define STATS_SDU_SIZE		300
+
+static unsigned Echo (CBTL2CAPLayer *pL2CAP, u16 nCID, unsigned nSDUs)
+{
+	static u8 SDU[STATS_SDU_SIZE];
+	static u8 Echo[BT_SIM_PEER_MTU];
+	unsigned nEchoed = 0;
+
+	for (unsigned i = 0; i < nSDUs; i++) {
+		memset (SDU, i, sizeof SDU);
+		u16 nLength;
+		if (pL2CAP->Write (nCID, sizeof SDU, SDU, &nLength) != BT_L2CAP_RESULT_SUCCESS) {
+			break;
+		}
+
+		if (   pL2CAP->Read (nCID, sizeof Echo, Echo, &nLength) == BT_L2CAP_RESULT_SUCCESS
+		    && nLength == sizeof SDU
+		    && memcmp (Echo, SDU, sizeof SDU) == 0) {
+			nEchoed++;
+		}
+	}
+
+	return nEchoed;
+}
+
+#ifdef BT_HAVE_STATS
+static boolean Counted (const tBT_stats_timer &Timer)
+{
+	return Timer.count > 0 && Timer.max > 0 && Timer.total >= Timer.max;
+}
+#endif
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	u8 BDAddr[BT_BD_ADDR_SIZE] = {0x31, 0x22, 0x33, 0x44, 0x55, 0x66};
+	CBTSimEchoPeer *pEcho = new CBTSimEchoPeer (BDAddr);
+	CBTSimPeer *pPeer = pEcho;
+	CBTSubSystem *pBT = BTTestBoot (&pPeer, 1);
+	if (pBT == 0) {
+		return BT_TEST_RESULT ();
+	}
+	u16 nCID = BTTestOpenChannel (pBT, pEcho, BT_SIM_ECHO_PSM);
+	if (nCID == 0) {
+		return BT_TEST_RESULT ();
+	}
+	CBTL2CAPLayer *pL2CAP = pBT->GetL2CAPLayer ();
+	BT_CHECK (Echo (pL2CAP, nCID, STATS_SDUS) == STATS_SDUS);
+
+	tBT_stats Before;
+	memset (&Before, 0xFF, sizeof Before);
+	boolean bHaveStats = pBT->GetStats (&Before);
+
+#ifdef BT_HAVE_STATS
+	BT_CHECK (bHaveStats);
+
+	BT_CHECK (Counted (Before.rx_deframe));
+	BT_CHECK (Counted (Before.hci_process));
+	BT_CHECK (Counted (Before.logical_process));
+	BT_CHECK (Counted (Before.command_round_trip));
+
+	BT_CHECK (Before.command_queue_high > 0);
+	BT_CHECK (Before.rx_data_queue_high > 0);
+	BT_CHECK (Before.tx_data_queue_high > 0);
+
+	// nothing was lost on the way
+	BT_CHECK (Before.queue_overflows == 0);
+	BT_CHECK (Before.queue_drops == 0);
+	BT_CHECK (Before.pool_failures == 0);
+	BT_CHECK (Before.rx_reassembly_dropped == 0);
+
+	BT_CHECK (Echo (pL2CAP, nCID, STATS_SDUS) == STATS_SDUS);
+
+	tBT_stats After;
+	BT_CHECK (pBT->GetStats (&After));
+	BT_CHECK (After.rx_deframe.count >= Before.rx_deframe.count + STATS_SDUS);
+	BT_CHECK (After.hci_process.count > Before.hci_process.count);
+	BT_CHECK (After.logical_process.count > Before.logical_process.count);
+	BT_CHECK (After.rx_deframe.total > Before.rx_deframe.total);
+	BT_CHECK (After.rx_deframe.max >= Before.rx_deframe.max);
+	BT_CHECK (After.tx_data_queue_high >= Before.tx_data_queue_high);
+#else
+	BT_CHECK (!bHaveStats);
+
+	static const tBT_stats Zero = {};
+	BT_CHECK (memcmp (&Before, &Zero, sizeof Zero) == 0);
+#endif
+
+	return BT_TEST_RESULT ();
+}
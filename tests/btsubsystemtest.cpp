@@ -0,0 +1,130 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Blueberry End-To-End Test Against The Simulated Controller
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btsubsystem.h>
+#include <bluetooth/devicenameservice.h>
+#include <bluetooth/btsimtransport.h>
+#include <bluetooth/bthidp.h>
+#include <graphics/event.h>
+#include <task.h>
+#include <bttest.h>
+#include <string.h>
+
+// Initialize -> Listen -> Accept with a simulated mouse and keyboard in
+// range, then mouse reports have to arrive as events
+
+#define TEST_TIMEOUT	10000000	// us for any single step
+
+static const u8 MouseAddr[BT_BD_ADDR_SIZE] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+static const u8 KeyboardAddr[BT_BD_ADDR_SIZE] = {0x21, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	CBTSimMouse *pMouse = new CBTSimMouse (MouseAddr);
+	CBTSimKeyboard *pKeyboard = new CBTSimKeyboard (KeyboardAddr);
+
+	new CDeviceNameService;
+	CBTSubSystem *pBT = new CBTSubSystem (InterruptSystemGet ());
+
+	unsigned nStart = getClockTicks ();
+	BT_CHECK (pBT->Initialize ());
+
+	CBTSimTransport *pTransport =
+		(CBTSimTransport *) CDeviceNameService::Get ()->GetDevice ("ttyBT1", FALSE);
+	BT_CHECK (pTransport != 0);
+	if (pTransport == 0) {
+		return BT_TEST_RESULT ();
+	}
+	CBTSimController *pController = pTransport->GetController ();
+	BT_CHECK (pController->AddPeer (pMouse));
+	BT_CHECK (pController->AddPeer (pKeyboard));
+
+	while (!pBT->Status () && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (1000);
+	}
+	BT_CHECK (pBT->Status ());
+	unsigned nBoot = getClockTicks () - nStart;
+	BT_CHECK (pController->GetFirmwareBytes () > 0);
+
+	nStart = getClockTicks ();
+	CBTInquiryResults *pResults = pBT->Listen (1);
+	unsigned nListen = getClockTicks () - nStart;
+	BT_CHECK (pResults != 0);
+	BT_CHECK (pResults != 0 && pResults->GetCount () == 2);
+	delete pResults;
+
+	nStart = getClockTicks ();
+	CBTHIDDevice *pDevice = (CBTHIDDevice *) pBT->Accept (0);
+	BT_CHECK (pDevice != 0);
+	BT_CHECK (pMouse->GetConnectionHandle () != 0);
+	while (   !pMouse->IsChannelOpen (BT_PSM_HID_INTERRUPT)
+	       && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (1000);
+	}
+	unsigned nAccept = getClockTicks () - nStart;
+	BT_CHECK (pMouse->IsChannelOpen (BT_PSM_HID_INTERRUPT));
+	if (pDevice == 0) {
+		return BT_TEST_RESULT ();
+	}
+	BT_CHECK (memcmp (pDevice->GetBDAddress (), MouseAddr, BT_BD_ADDR_SIZE) == 0);
+
+	const unsigned nReports = 5;
+	for (unsigned i = 0; i < nReports; i++) {
+		BT_CHECK (pMouse->Move (3, -2));
+	}
+
+	unsigned nEvents = 0;
+	u8 Buffer[BT_HIDP_MAX_EVENT_SIZE];
+	unsigned nLength;
+	nStart = getClockTicks ();
+	while (nEvents < nReports && getClockTicks () - nStart < TEST_TIMEOUT) {
+		while (pDevice->ReceiveEvent (Buffer, &nLength)) {
+			BT_CHECK (((UGEvent *) Buffer)->GetSource () == UG_MOUSE);
+			nEvents++;
+		}
+		sleepTask (1000);
+	}
+	BT_CHECK (pMouse->GetReportsSent () == nReports);
+	BT_CHECK (nEvents == nReports);
+
+	printf ("boot %u us, listen %u us, accept %u us, %u events\n",
+		nBoot, nListen, nAccept, nEvents);
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,249 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Helpers to bring the stack up against the simulated controller
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#ifndef _bt_test_stack_h
+#define _bt_test_stack_h
+
+#include <bluetooth/btsubsystem.h>
+#include <bluetooth/devicenameservice.h>
+#include <bluetooth/btsimtransport.h>
+#include <bluetooth/bthidp.h>
+#include <graphics/event.h>
+#include <task.h>
+#include <bttest.h>
+#include <string.h>
+
+#define TEST_TIMEOUT	10000000	// us for any single step
+
+static CBTSimTransport *s_pTestTransport = 0;
+
+// the simulated controller, it exists before the stack, so that what the
+// host reads at startup can be set up first
+static inline CBTSimController *BTTestController (void)
+{
+	if (s_pTestTransport == 0) {
+		new CDeviceNameService;
+		s_pTestTransport = new CBTSimTransport (InterruptSystemGet ());
+		BT_CHECK (s_pTestTransport->Initialize ());
+	}
+
+	return s_pTestTransport->GetController ();
+}
+
+// initializes the stack and waits until the controller is running, the
+// peers are put in range before the first inquiry
+static inline CBTSubSystem *BTTestBoot (CBTSimPeer **ppPeers, unsigned nPeers,
+					CBTSimController **ppController = 0)
+{
+	CBTSimController *pController = BTTestController ();
+	for (unsigned i = 0; i < nPeers; i++) {
+		BT_CHECK (pController->AddPeer (ppPeers[i]));
+	}
+	if (ppController != 0) {
+		*ppController = pController;
+	}
+
+	// the stack picks up the transport registered above
+	CBTSubSystem *pBT = new CBTSubSystem (InterruptSystemGet ());
+
+	unsigned nStart = getClockTicks ();
+	BT_CHECK (pBT->Initialize ());
+
+	while (!pBT->Status () && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (1000);
+	}
+	BT_CHECK (pBT->Status ());
+
+	return pBT->Status () ? pBT : 0;
+}
+
+// runs an inquiry and connects all HID devices found, returns how many
+// have their interrupt channel open
+static inline unsigned BTTestAcceptAll (CBTSubSystem *pBT, CBTSimPeer **ppPeers, unsigned nPeers)
+{
+	CBTInquiryResults *pResults = pBT->Listen (1);
+	BT_CHECK (pResults != 0 && pResults->GetCount () == nPeers);
+	delete pResults;
+
+	BT_CHECK (pBT->AcceptAll () == nPeers);
+
+	unsigned nStart = getClockTicks ();
+	unsigned nOpen;
+	do {
+		nOpen = 0;
+		for (unsigned i = 0; i < nPeers; i++) {
+			if (ppPeers[i]->IsChannelOpen (BT_PSM_HID_INTERRUPT)) {
+				nOpen++;
+			}
+		}
+		if (nOpen < nPeers) {
+			sleepTask (1000);
+		}
+	} while (nOpen < nPeers && getClockTicks () - nStart < TEST_TIMEOUT);
+	BT_CHECK (nOpen == nPeers);
+
+	return nOpen;
+}
+
+// the stack side device of a connected peer
+static inline CBTHIDDevice *BTTestGetDevice (CBTSubSystem *pBT, CBTSimPeer *pPeer)
+{
+	for (u16 i = 0; i < pBT->GetDeviceCount (); i++) {
+		CBTDevice *pDevice = pBT->GetDevice (i);
+		if (   pDevice != 0
+		    && memcmp (pDevice->GetBDAddress (), pPeer->GetBDAddress (), BT_BD_ADDR_SIZE) == 0) {
+			return (CBTHIDDevice *) pDevice;
+		}
+	}
+
+	return 0;
+}
+
+// waits until the device decoded nCount input reports since it connected
+static inline boolean BTTestWaitInput (CBTHIDDevice *pDevice, unsigned nCount)
+{
+	unsigned nStart = getClockTicks ();
+	while (   pDevice->GetInputCount () < nCount
+	       && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (100);
+	}
+
+	return pDevice->GetInputCount () >= nCount;
+}
+
+// collects events until nExpected arrived, or nothing came in for a while
+static inline unsigned BTTestReceiveEvents (CBTHIDDevice *pDevice, unsigned nExpected,
+					    unsigned nSource = 0)
+{
+	unsigned nEvents = 0;
+	u8 Buffer[BT_HIDP_MAX_EVENT_SIZE];
+	unsigned nLength;
+	unsigned nLast = getClockTicks ();
+	while (nEvents < nExpected && getClockTicks () - nLast < TEST_TIMEOUT) {
+		while (pDevice->ReceiveEvent (Buffer, &nLength)) {
+			if (nSource != 0) {
+				BT_CHECK (((UGEvent *) Buffer)->GetSource () == nSource);
+			}
+			nEvents++;
+			nLast = getClockTicks ();
+		}
+		sleepTask (1000);
+	}
+
+	return nEvents;
+}
+
+static CBTL2CAPLayer *s_pTestL2CAP = 0;
+
+// accepts the configuration the peer asks for on a channel opened below
+static void BTTestChannelEvent (const void *pBuffer, unsigned)
+{
+	const CBTL2CAConfigInd *pInd = (const CBTL2CAConfigInd *) pBuffer;
+	if (pInd->GetEvent () == BT_EVENT_L2CA_CONFIG_IND) {
+		s_pTestL2CAP->ConfigureResponse (pInd->GetIdentifier (), pInd->GetCID (), 0, 0,
+						 pInd->GetOutMTU (), pInd->GetInFlushTO (),
+						 pInd->GetInFlow ());
+	}
+}
+
+// runs an inquiry and makes devices of the peers, their links are set up
+// by the first channel opened
+static inline boolean BTTestAddDevices (CBTSubSystem *pBT, CBTSimPeer **ppPeers, unsigned nPeers)
+{
+	CBTInquiryResults *pResults = pBT->Listen (1);
+	BT_CHECK (pResults != 0);
+	delete pResults;
+
+	unsigned nAdded = 0;
+	for (unsigned i = 0; i < nPeers; i++) {
+		if (pBT->Accept ((u8 *) ppPeers[i]->GetBDAddress ()) != 0) {
+			nAdded++;
+		}
+	}
+	BT_CHECK (nAdded == nPeers);
+
+	return nAdded == nPeers;
+}
+
+// channels to nPSM accept the configuration the peer asks for, in the
+// mode of pRFC if given
+static inline CBTL2CAPLayer *BTTestRegisterPSM (CBTSubSystem *pBT, u16 nPSM,
+						const TBTL2CAPRFC *pRFC = 0)
+{
+	s_pTestL2CAP = pBT->GetL2CAPLayer ();
+	s_pTestL2CAP->RegisterCallback (nPSM, BTTestChannelEvent);
+	if (pRFC != 0) {
+		BT_CHECK (s_pTestL2CAP->RegisterChannelMode (nPSM, pRFC));
+	}
+
+	return s_pTestL2CAP;
+}
+
+// connects the peer found by an inquiry and opens a channel to nPSM on it,
+// in the mode of pRFC if given, returns the local CID or 0
+static inline u16 BTTestOpenChannel (CBTSubSystem *pBT, CBTSimPeer *pPeer, u16 nPSM,
+				     const TBTL2CAPRFC *pRFC = 0,
+				     u16 nInMTU = BT_SIM_PEER_MTU)
+{
+	u8 *pBDAddr = (u8 *) pPeer->GetBDAddress ();
+	BTTestAddDevices (pBT, &pPeer, 1);
+	BTTestRegisterPSM (pBT, nPSM, pRFC);
+
+	u16 nCID = 0;
+	u16 nStatus = 0;
+	u16 nResult = s_pTestL2CAP->Connect (nPSM, pBDAddr, &nCID, &nStatus);
+	BT_CHECK (nResult == BT_L2CAP_RESULT_CONNECTION_SUCCESSFUL);
+	if (nResult != BT_L2CAP_RESULT_CONNECTION_SUCCESSFUL) {
+		return 0;
+	}
+
+	u16 nMTU, nFlushTO;
+	TBTL2CAPFlowSpec Flow;
+	BT_CHECK (s_pTestL2CAP->Configure (nCID, nInMTU, 0, 0, 0,
+					   &nMTU, &Flow, &nFlushTO) == 0);
+
+	unsigned nStart = getClockTicks ();
+	while (   !s_pTestL2CAP->GetChannel (nCID)->IsOpen ()
+	       && getClockTicks () - nStart < TEST_TIMEOUT) {
+		sleepTask (1000);
+	}
+	BT_CHECK (s_pTestL2CAP->GetChannel (nCID)->IsOpen ());
+
+	return nCID;
+}
+
+#endif
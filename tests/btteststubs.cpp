@@ -0,0 +1,60 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Blueberry Host Test Stubs
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <graphics/event.h>
+#include <bluetooth/btlogicallayer.h>
+
+// the GUI events come from the uGUI library on the Pi, the tests only read
+// back the fields the HID layer sets
+
+UGEvent::UGEvent (UG_EVENT t, UG_EVENT s) { Type = t; Source = s; }
+UGEvent::~UGEvent () {}
+UGMouseEvent::UGMouseEvent (UG_EVENT t) : UGEvent (t, UG_MOUSE) {}
+UGMouseEvent::~UGMouseEvent () {}
+UGMouseMoveEvent::UGMouseMoveEvent (UG_S8 x, UG_S8 y) : UGMouseEvent (UG_MOUSE_MOVE) { X = x; Y = y; }
+UGMouseMoveEvent::~UGMouseMoveEvent () {}
+UGButtonClickEvent::UGButtonClickEvent (UG_U8 b) : UGMouseEvent (UG_MOUSE_CLICK) { ButtonID = b; }
+UGButtonClickEvent::~UGButtonClickEvent () {}
+UGButtonPressEvent::UGButtonPressEvent (UG_U8 b) : UGMouseEvent (UG_MOUSE_PRESS) { ButtonID = b; }
+UGButtonPressEvent::~UGButtonPressEvent () {}
+UGButtonReleaseEvent::UGButtonReleaseEvent (UG_U8 b) : UGMouseEvent (UG_MOUSE_RELEASE) { ButtonID = b; }
+UGButtonReleaseEvent::~UGButtonReleaseEvent () {}
+UGScrollEvent::UGScrollEvent (UG_S8 v) : UGMouseEvent (UG_MOUSE_SCROLL) { S = v; }
+UGScrollEvent::~UGScrollEvent () {}
+
+// declared by the stack but supplied by the application
+bool CBTConnection::Disconnect (u8) { return false; }
@@ -0,0 +1,313 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Tests the UART transport's DMA mode against models of the PL011 and the DMA engine
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btuarttransport.h>
+#include <bluetooth/devicenameservice.h>
+#include <platform/bt_uart.h>
+#include <btpl011fake.h>
+#include <btdmafake.h>
+#include <bttest.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The engine moves 32 bit DR words. A random H4 stream, some characters
+// flagged with framing errors, is received while the line, the engine and
+// the transport's Process() run in random steps, so the deframer sees
+// random chunk boundaries and the RX ring wraps many times. Every packet
+// has to come out intact. Then random packets are sent, the wire has to
+// carry exactly their bytes. A Process() held off until the engine has
+// passed the read index has to be counted as an overrun, and the packets
+// after it must come out intact again.
+
+#define TEST_PACKETS	400
+#define TEST_STREAM	(TEST_PACKETS * (1 + BT_MAX_DATA_SIZE))
+
+static u8 s_Stream[TEST_STREAM];		// as sent by the controller
+static unsigned s_nStream = 0;
+static u8 s_Expected[TEST_STREAM];		// as the handlers should see it
+static unsigned s_nExpected = 0;
+static u8 s_Received[TEST_STREAM];
+static unsigned s_nReceived = 0;
+static unsigned s_nPackets = 0;
+
+static void EventHandler (const void *pBuffer, unsigned nLength)
+{
+	assert (s_nReceived + nLength <= sizeof s_Received);
+	memcpy (s_Received + s_nReceived, pBuffer, nLength);
+	s_nReceived += nLength;
+	s_nPackets++;
+}
+
+static void DataHandler (CBTPacket *pPacket)
+{
+	assert (s_nReceived + pPacket->GetLength () <= sizeof s_Received);
+	memcpy (s_Received + s_nReceived, pPacket->GetData (), pPacket->GetLength ());
+	s_nReceived += pPacket->GetLength ();
+	s_nPackets++;
+
+	pPacket->Release ();
+}
+
+static void AddPacket (void)
+{
+	u8 Packet[1 + BT_MAX_DATA_SIZE];
+	unsigned nLength;
+
+	if (rand () % 2) {
+		unsigned nParams = rand () % 256;
+		Packet[0] = HCI_PACKET_EVENT;
+		Packet[1] = 0x3E;
+		Packet[2] = nParams;
+		nLength = 3 + nParams;
+	} else {
+		unsigned nData = rand () % (BT_MAX_DATA_SIZE - 4 + 1);
+		Packet[0] = HCI_PACKET_ACL_DATA;
+		Packet[1] = 0x40;
+		Packet[2] = 0x20;
+		Packet[3] = nData & 0xFF;
+		Packet[4] = nData >> 8;
+		nLength = 5 + nData;
+	}
+
+	for (unsigned i = Packet[0] == HCI_PACKET_EVENT ? 3 : 5; i < nLength; i++) {
+		Packet[i] = rand ();
+	}
+
+	memcpy (s_Stream + s_nStream, Packet, nLength);
+	s_nStream += nLength;
+	memcpy (s_Expected + s_nExpected, Packet + 1, nLength - 1);
+	s_nExpected += nLength - 1;
+}
+
+// an event of nChars on the wire, packet type included
+static void AddEvent (unsigned nChars)
+{
+	assert (nChars >= 3 && nChars <= 3 + 255);
+	s_Stream[s_nStream] = HCI_PACKET_EVENT;
+	s_Stream[s_nStream+1] = 0x3E;
+	s_Stream[s_nStream+2] = nChars - 3;
+	for (unsigned i = 3; i < nChars; i++) {
+		s_Stream[s_nStream+i] = rand ();
+	}
+	memcpy (s_Expected + s_nExpected, s_Stream + s_nStream + 1, nChars - 1);
+	s_nStream += nChars;
+	s_nExpected += nChars - 1;
+}
+
+// runs the line and the engine until the wire is empty, Process() every
+// nInterval characters, 0 for never
+static void RunLine (unsigned nChars, unsigned nInterval,
+		     CBTUARTTransport *pTransport, CPL011Fake *pUART, CBCMDMAFake *pDMA)
+{
+	for (unsigned i = 0; i < nChars; i++) {
+		pUART->Tick (1);
+		pDMA->Tick (2);
+		if (nInterval != 0 && i % nInterval == nInterval - 1) {
+			pTransport->Process ();
+		}
+	}
+	if (nInterval != 0) {
+		pTransport->Process ();
+	}
+}
+
+static void TestReceive (CBTUARTTransport *pTransport, CPL011Fake *pUART, CBCMDMAFake *pDMA)
+{
+	for (unsigned i = 0; i < TEST_PACKETS; i++) {
+		AddPacket ();
+	}
+
+	// the character keeps its value, the error is only counted
+	unsigned nErrors = 0;
+	for (unsigned i = 0; i < s_nStream; i++) {
+		u32 nFlags = i % 97 == 0 ? DR_FE_MASK : 0;
+		pUART->Receive (s_Stream + i, 1, nFlags);
+		nErrors += nFlags ? 1 : 0;
+	}
+
+	unsigned nIdle = 0;
+	for (unsigned nStep = 0; nStep < 10*TEST_STREAM && s_nPackets < TEST_PACKETS; nStep++) {
+		// the engine keeps up with the line, one word or more per character
+		unsigned nChars = rand () % 24;
+		for (unsigned i = 0; i < nChars; i++) {
+			pUART->Tick (1);
+			pDMA->Tick (1 + rand () % 3);
+		}
+
+		if (rand () % 4 == 0 || ++nIdle == 10) {
+			pTransport->Process ();
+			nIdle = 0;
+		}
+	}
+
+	BT_CHECK (s_nPackets == TEST_PACKETS);
+	BT_CHECK (s_nReceived == s_nExpected);
+	BT_CHECK (memcmp (s_Received, s_Expected, s_nExpected) == 0);
+	BT_CHECK (pTransport->GetRxErrors () == nErrors);
+	BT_CHECK (pTransport->GetOverruns () == 0);
+	BT_CHECK (pTransport->GetDeframer ()->GetDiscarded () == 0);
+	BT_CHECK (pTransport->GetDeframer ()->GetDropped () == 0);
+	BT_CHECK (pUART->GetRxUnderflows () == 0);
+
+	printf ("received %u packets, %u characters, %u flagged\n", s_nPackets, s_nStream, nErrors);
+}
+
+static void TestOverrun (CBTUARTTransport *pTransport, CPL011Fake *pUART, CBCMDMAFake *pDMA)
+{
+	// each character took one word, the read index is where TestReceive
+	// left off
+	unsigned nReadIndex = s_nStream % BT_UART_DMA_RX_SIZE;
+
+	// one lap and half the way to the read index again, so the engine
+	// ends up beyond it, cut into whole events
+	s_nStream = s_nExpected = s_nReceived = s_nPackets = 0;
+	unsigned nLap = BT_UART_DMA_RX_SIZE + (BT_UART_DMA_RX_SIZE - nReadIndex) / 2;
+	while (s_nStream < nLap) {
+		unsigned nChars = nLap - s_nStream;
+		if (nChars > 3 + 255) {
+			nChars = nChars - (3 + 255) >= 3 ? 3 + 255 : nChars - 3;
+		}
+		AddEvent (nChars);
+	}
+	pUART->Receive (s_Stream, s_nStream);
+	RunLine (s_nStream, 0, pTransport, pUART, pDMA);
+
+	unsigned nOverruns = pTransport->GetOverruns ();
+	pTransport->Process ();
+	BT_CHECK (pTransport->GetOverruns () == nOverruns + 1);
+	BT_CHECK (s_nPackets == 0);
+
+	// the line was quiet at a packet boundary, what follows is in sync
+	s_nStream = s_nExpected = 0;
+	for (unsigned i = 0; i < 20; i++) {
+		AddEvent (3 + rand () % 256);
+	}
+	pUART->Receive (s_Stream, s_nStream);
+	RunLine (s_nStream, 64, pTransport, pUART, pDMA);
+
+	BT_CHECK (s_nPackets == 20);
+	BT_CHECK (s_nReceived == s_nExpected);
+	BT_CHECK (memcmp (s_Received, s_Expected, s_nExpected) == 0);
+	BT_CHECK (pTransport->GetOverruns () == nOverruns + 1);
+	BT_CHECK (pUART->GetRxUnderflows () == 0);
+
+	printf ("overrun after %u characters, read index %u\n", nLap, nReadIndex);
+}
+
+static void TestTransmit (CBTUARTTransport *pTransport, CPL011Fake *pUART, CBCMDMAFake *pDMA)
+{
+	pUART->ClearTransmitted ();
+	s_nExpected = 0;
+
+	unsigned nSent = 0;
+	for (unsigned nStep = 0; nStep < 20000; nStep++) {
+		if (nSent < TEST_PACKETS && rand () % 3 == 0) {
+			u8 Buffer[BT_MAX_DATA_SIZE];
+			unsigned nLength = 1 + rand () % BT_MAX_DATA_SIZE;
+			for (unsigned i = 0; i < nLength; i++) {
+				Buffer[i] = rand ();
+			}
+
+			u8 nType = rand () % 2 ? HCI_PACKET_COMMAND : HCI_PACKET_ACL_DATA;
+			boolean bReady = pTransport->IsTxReady (nLength);
+			boolean bSent = nType == HCI_PACKET_COMMAND
+				      ? pTransport->SendHCICommand (Buffer, nLength)
+				      : pTransport->SendHCIData (Buffer, nLength);
+			BT_CHECK (bSent == bReady);
+
+			if (bSent) {
+				s_Expected[s_nExpected++] = nType;
+				memcpy (s_Expected + s_nExpected, Buffer, nLength);
+				s_nExpected += nLength;
+				nSent++;
+			}
+		}
+
+		pDMA->Tick (rand () % 24);
+		pUART->Tick (rand () % 24);
+		if (rand () % 4 == 0) {
+			pTransport->Process ();
+		}
+
+		if (nSent == TEST_PACKETS && pTransport->IsTxIdle ()) {
+			break;
+		}
+	}
+
+	BT_CHECK (nSent == TEST_PACKETS);
+	BT_CHECK (pTransport->IsTxIdle ());
+	BT_CHECK (pUART->GetTransmittedLength () == s_nExpected);
+	BT_CHECK (memcmp (pUART->GetTransmitted (), s_Expected, s_nExpected) == 0);
+	BT_CHECK (pUART->GetTxOverflows () == 0);
+
+	printf ("sent %u packets, %u characters\n", nSent, s_nExpected);
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	new CDeviceNameService;
+	CBTPacketPool *pPool = new CBTPacketPool;
+	CPL011Fake *pUART = new CPL011Fake;
+	CBCMDMAFake *pDMA = new CBCMDMAFake;
+
+	CBTUARTTransport *pTransport = new CBTUARTTransport (InterruptSystemGet ());
+	BT_CHECK (pTransport->Initialize (115200));
+	pTransport->RegisterHCIEventHandler (EventHandler);
+	pTransport->RegisterHCIDataHandler (DataHandler);
+
+	// both directions are serviced by the engine, the IRQ only reports overruns
+	BT_CHECK (pUART->GetDMACR () == (DMACR_RXDMAE | DMACR_TXDMAE));
+	BT_CHECK (pUART->GetIMSC () == INT_OE);
+
+	srand (5);
+	TestReceive (pTransport, pUART, pDMA);
+	TestOverrun (pTransport, pUART, pDMA);
+	TestTransmit (pTransport, pUART, pDMA);
+
+	BT_CHECK (pDMA->GetErrors () == 0);
+	BT_CHECK (pPool->GetFreeCount () == BT_PACKET_POOL_SIZE);
+
+	delete pTransport;
+	delete pDMA;
+	delete pUART;
+	delete pPool;
+
+	return BT_TEST_RESULT ();
+}
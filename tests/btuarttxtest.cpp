@@ -0,0 +1,199 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Unit test of the UART transport's interrupt driven TX against a PL011 model
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btuarttransport.h>
+#include <bluetooth/devicenameservice.h>
+#include <platform/bt_uart.h>
+#include <btpl011fake.h>
+#include <bttest.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The transport runs unchanged against the register model. Every byte
+// accepted by SendHCICommand / SendHCIData has to reach the wire once and
+// in order, the FIFO must never be written while full and the TX interrupt
+// has to be masked again whenever the ring runs dry.
+
+static u8 s_Expected[PL011_WIRE_SIZE];
+static unsigned s_nExpected = 0;
+
+static u8 s_Event[BT_H4_BUFFER_SIZE];
+static unsigned s_nEventLength = 0;
+static unsigned s_nEvents = 0;
+
+static void EventHandler (const void *pBuffer, unsigned nLength)
+{
+	memcpy (s_Event, pBuffer, nLength);
+	s_nEventLength = nLength;
+	s_nEvents++;
+}
+
+static void DataHandler (CBTPacket *pPacket)
+{
+	pPacket->Release ();
+}
+
+static boolean Send (CBTUARTTransport *pTransport, u8 nType, unsigned nLength, unsigned nSeed)
+{
+	u8 Buffer[BT_MAX_DATA_SIZE];
+	assert (nLength <= sizeof Buffer);
+	for (unsigned i = 0; i < nLength; i++) {
+		Buffer[i] = (u8) (nSeed + i * 7);
+	}
+
+	boolean bReady = pTransport->IsTxReady (nLength);
+	boolean bResult = nType == HCI_PACKET_COMMAND
+			? pTransport->SendHCICommand (Buffer, nLength)
+			: pTransport->SendHCIData (Buffer, nLength);
+	BT_CHECK (bResult == bReady);
+
+	if (bResult) {
+		s_Expected[s_nExpected++] = nType;
+		memcpy (s_Expected + s_nExpected, Buffer, nLength);
+		s_nExpected += nLength;
+	}
+
+	return bResult;
+}
+
+// shifts until the ring and the FIFO are empty
+static void Drain (CPL011Fake *pUART, CBTUARTTransport *pTransport)
+{
+	for (unsigned i = 0; i < PL011_WIRE_SIZE && !pTransport->IsTxIdle (); i++) {
+		pUART->Tick ();
+	}
+	BT_CHECK (pTransport->IsTxIdle ());
+	BT_CHECK (pUART->GetTxLevel () == 0);
+}
+
+static boolean CheckWire (CPL011Fake *pUART)
+{
+	return    pUART->GetTransmittedLength () == s_nExpected
+	       && memcmp (pUART->GetTransmitted (), s_Expected, s_nExpected) == 0;
+}
+
+int main (void)
+{
+	setvbuf (stdout, 0, _IONBF, 0);
+
+	new CDeviceNameService;
+	CBTPacketPool *pPool = new CBTPacketPool;
+	CPL011Fake *pUART = new CPL011Fake;
+
+	CBTUARTTransport *pTransport = new CBTUARTTransport (InterruptSystemGet ());
+	BT_CHECK (pTransport->Initialize (115200));
+	pTransport->RegisterHCIEventHandler (EventHandler);
+	pTransport->RegisterHCIDataHandler (DataHandler);
+
+	// 8N1 with FIFOs, enabled, TX interrupt masked while there is nothing to send
+	BT_CHECK ((pUART->GetLCRH () & (LCRH_WLEN8_MASK | LCRH_FEN_MASK)) == (LCRH_WLEN8_MASK | LCRH_FEN_MASK));
+	BT_CHECK ((pUART->GetCR () & (CR_UART_EN_MASK | CR_TXE_MASK | CR_RXE_MASK))
+		  == (CR_UART_EN_MASK | CR_TXE_MASK | CR_RXE_MASK));
+	BT_CHECK ((pUART->GetIMSC () & (INT_RX | INT_RT)) == (INT_RX | INT_RT));
+	BT_CHECK (!(pUART->GetIMSC () & INT_TX));
+	BT_CHECK (pTransport->IsTxIdle ());
+
+	// a packet which fits into the FIFO is written directly, no interrupt needed
+	BT_CHECK (Send (pTransport, HCI_PACKET_COMMAND, 3, 1));
+	BT_CHECK (pUART->GetTxLevel () == 4);
+	BT_CHECK (!(pUART->GetIMSC () & INT_TX));
+	Drain (pUART, pTransport);
+	BT_CHECK (CheckWire (pUART));
+	BT_CHECK (pUART->GetInterrupts () == 0);
+
+	// a larger one primes the FIFO and is fed by the TX interrupt
+	BT_CHECK (Send (pTransport, HCI_PACKET_ACL_DATA, 250, 2));
+	BT_CHECK (pUART->GetTxLevel () == PL011_FIFO_SIZE);
+	BT_CHECK (pUART->GetIMSC () & INT_TX);
+	Drain (pUART, pTransport);
+	BT_CHECK (CheckWire (pUART));
+	BT_CHECK (pUART->GetInterrupts () > 0);
+	BT_CHECK (!(pUART->GetIMSC () & INT_TX));
+
+	// a full ring refuses a packet as a whole, nothing of it is sent
+	unsigned nQueued = 0;
+	while (Send (pTransport, HCI_PACKET_ACL_DATA, 100, 3 + nQueued)) {
+		nQueued++;
+	}
+	BT_CHECK (nQueued == (BT_UART_TX_RING_SIZE + PL011_FIFO_SIZE) / 101);
+	BT_CHECK (!pTransport->IsTxReady (100));
+	BT_CHECK (!Send (pTransport, HCI_PACKET_COMMAND, 100, 0));
+	Drain (pUART, pTransport);
+	BT_CHECK (CheckWire (pUART));
+
+	// random packets while the line runs at random speed
+	srand (1);
+	for (unsigned i = 0; i < 5000; i++) {
+		if (rand () % 3 == 0) {
+			u8 nType = rand () % 2 ? HCI_PACKET_COMMAND : HCI_PACKET_ACL_DATA;
+			Send (pTransport, nType, 1 + rand () % 200, i);
+		}
+		pUART->Tick (rand () % 8);
+
+		if (s_nExpected > PL011_WIRE_SIZE - 2*BT_UART_TX_RING_SIZE) {
+			Drain (pUART, pTransport);
+			BT_CHECK (CheckWire (pUART));
+			pUART->ClearTransmitted ();
+			s_nExpected = 0;
+		}
+	}
+	Drain (pUART, pTransport);
+	BT_CHECK (CheckWire (pUART));
+	BT_CHECK (!(pUART->GetIMSC () & INT_TX));
+	BT_CHECK (pUART->GetTxOverflows () == 0);
+
+	// the receive interrupt hands a Command Complete event to the deframer
+	static const u8 Event[] = {HCI_PACKET_EVENT, 0x0E, 0x04, 0x01, 0x03, 0x0C, 0x00};
+	pUART->Receive (Event, sizeof Event);
+	pUART->Tick (sizeof Event);
+	pUART->Tick (0);
+	BT_CHECK (s_nEvents == 1);
+	BT_CHECK (s_nEventLength == sizeof Event - 1);
+	BT_CHECK (memcmp (s_Event, Event + 1, sizeof Event - 1) == 0);
+	BT_CHECK (pUART->GetRxLevel () == 0);
+	BT_CHECK (pUART->GetRxUnderflows () == 0);
+	BT_CHECK (pTransport->GetOverruns () == 0);
+
+	printf ("%u interrupts\n", pUART->GetInterrupts ());
+
+	delete pTransport;
+	delete pUART;
+	delete pPool;
+
+	return BT_TEST_RESULT ();
+}
@@ -0,0 +1,217 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Compares CBTVector with the CPtrArray it replaced
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btvector.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Each round appends n pointers, iterates them and removes them all in a
+// scattered order, like connections and channels coming and going. The
+// old CPtrArray is kept here as it was: a heap array of 100 entries which
+// grows by 100, removal scans for the pointer and swaps the last one in.
+
+#define BENCH_ROUNDS		200000
+#define BENCH_REPEATS		5		// the best one counts
+#define BENCH_MAX_ITEMS		64
+#define BENCH_INLINE		8		// inline size of the connection vector
+
+class CBenchPtrArray
+{
+public:
+	CBenchPtrArray (unsigned nInitialSize = 100, unsigned nSizeIncrement = 100)
+	:	m_nReservedSize (nInitialSize),
+		m_nSizeIncrement (nSizeIncrement),
+		m_nUsedCount (0)
+	{
+		m_ppArray = (void **) malloc (sizeof (void *) * m_nReservedSize);
+	}
+
+	~CBenchPtrArray (void)
+	{
+		free (m_ppArray);
+	}
+
+	unsigned GetCount (void) const		{ return m_nUsedCount; }
+
+	void *operator[] (unsigned nIndex) const	{ return m_ppArray[nIndex]; }
+
+	unsigned Append (void *pPtr)
+	{
+		if (m_nUsedCount == m_nReservedSize) {
+			void **ppNewArray = (void **)
+				malloc (sizeof (void *) * (m_nReservedSize + m_nSizeIncrement));
+			memcpy (ppNewArray, m_ppArray, m_nReservedSize * sizeof (void *));
+			free (m_ppArray);
+			m_ppArray = ppNewArray;
+			m_nReservedSize += m_nSizeIncrement;
+		}
+
+		m_ppArray[m_nUsedCount] = pPtr;
+
+		return m_nUsedCount++;
+	}
+
+	unsigned Delete (void *pPtr)
+	{
+		for (unsigned i = 0; i < m_nUsedCount; i++) {
+			if (m_ppArray[i] == pPtr) {
+				m_ppArray[i] = m_ppArray[--m_nUsedCount];
+				break;
+			}
+		}
+
+		return m_nUsedCount;
+	}
+
+private:
+	unsigned  m_nReservedSize;
+	unsigned  m_nSizeIncrement;
+	unsigned  m_nUsedCount;
+	void	**m_ppArray;
+};
+
+static void *s_Items[BENCH_MAX_ITEMS];
+
+static double Seconds (void)
+{
+	struct timespec Time;
+	clock_gettime (CLOCK_MONOTONIC, &Time);
+
+	return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+static uintptr RoundPtrArray (unsigned nItems)
+{
+	uintptr nSum = 0;
+
+	CBenchPtrArray Array;
+	for (unsigned i = 0; i < nItems; i++) {
+		Array.Append (s_Items[i]);
+	}
+	for (unsigned i = 0; i < Array.GetCount (); i++) {
+		nSum += (uintptr) Array[i];
+	}
+	for (unsigned i = 0; i < nItems; i++) {
+		Array.Delete (s_Items[(i * 7) % nItems]);
+	}
+	nSum += Array.GetCount ();
+
+	return nSum;
+}
+
+static uintptr RoundVector (unsigned nItems)
+{
+	uintptr nSum = 0;
+
+	CBTVector<void *, BENCH_INLINE> Vector;
+	for (unsigned i = 0; i < nItems; i++) {
+		Vector.Append (s_Items[i]);
+	}
+	for (unsigned i = 0; i < Vector.GetCount (); i++) {
+		nSum += (uintptr) Vector[i];
+	}
+	for (unsigned i = 0; i < nItems; i++) {
+		Vector.RemoveItem (s_Items[(i * 7) % nItems]);
+	}
+	nSum += Vector.GetCount ();
+
+	return nSum;
+}
+
+int main (void)
+{
+	static const unsigned Counts[] = {4, 8, 16, 32, BENCH_MAX_ITEMS};
+	unsigned nFailed = 0;
+
+	for (unsigned i = 0; i < BENCH_MAX_ITEMS; i++) {
+		s_Items[i] = malloc (16);
+	}
+
+	printf ("[\n");
+	for (unsigned c = 0; c < sizeof Counts / sizeof Counts[0]; c++) {
+		unsigned nItems = Counts[c];
+
+		uintptr nPtrArraySum = 0;
+		uintptr nVectorSum = 0;
+		double fPtrArray = 1e9;
+		double fVector = 1e9;
+		for (unsigned n = 0; n < BENCH_REPEATS; n++) {
+			double fStart = Seconds ();
+			for (unsigned r = 0; r < BENCH_ROUNDS; r++) {
+				nPtrArraySum += RoundPtrArray (nItems);
+			}
+			double fTime = Seconds () - fStart;
+			if (fTime < fPtrArray) {
+				fPtrArray = fTime;
+			}
+
+			fStart = Seconds ();
+			for (unsigned r = 0; r < BENCH_ROUNDS; r++) {
+				nVectorSum += RoundVector (nItems);
+			}
+			fTime = Seconds () - fStart;
+			if (fTime < fVector) {
+				fVector = fTime;
+			}
+		}
+
+		// both have to see the same items and end up empty
+		if (nPtrArraySum != nVectorSum) {
+			nFailed++;
+		}
+
+		printf (" {\"items\": %u, \"rounds\": %u, \"ptrarray_ns\": %.1f, \"vector_ns\": %.1f,"
+			" \"speedup\": %.2f}%s\n",
+			nItems, BENCH_ROUNDS, fPtrArray * 1e9 / BENCH_ROUNDS,
+			fVector * 1e9 / BENCH_ROUNDS, fPtrArray / fVector,
+			c + 1 < sizeof Counts / sizeof Counts[0] ? "," : "");
+	}
+	printf ("]\n");
+
+	for (unsigned i = 0; i < BENCH_MAX_ITEMS; i++) {
+		free (s_Items[i]);
+	}
+
+	if (nFailed != 0) {
+		printf ("FAILED: %u item counts differ\n", nFailed);
+		return 1;
+	}
+
+	return 0;
+}
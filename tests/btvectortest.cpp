@@ -0,0 +1,164 @@
+/*******************************************************************************
+**             __                                            __
+**            /  \       ___    _       _      ___          /  \
+**           /    \     |   |  | |     / \    |   \        /    \
+**          /  /\  \    |  /   | |    /   \   |    \      /  /\  \
+**         /  /  \  \   |  \   | |   /  _  \  | |\  \    /  /  \  \
+**        /  /    \  \__|   \__| |__/  / \  \_| | \  \__/  /    \  \
+**       /  /      \______/\__________/   \_____|  \______/      \  \
+**      /  /  _  _                        _     ___    _        _ \  \
+**  ___/  /  |  | | |\/| |\/| | | |\ | | |   /\  |  | | | |\ | |_  \  \___
+**  \____/   |_ |_| |  | |  | |_| | \| | |_ /--\ |  | |_| | \|  _|  \____/
+**  
+** Company:        Ariana Communications OPC Private Limited
+** Copyright (C) 2020 Ariana Communications - www.ariana-communications.com
+**
+** Description:    Grows and shrinks CBTVector against a plain array model
+**
+** Dependencies:
+** 
+** Revision:
+** Revision 0.1 - File Created
+** Additional Comments:
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+** PLEASE REFER TO THE LICENSE INCLUDED IN THIS DISTRIBUTION.
+** 
+*******************************************************************************/
+#include <bluetooth/btvector.h>
+#include <bttest.h>
+#include <stdlib.h>
+#include <string.h>
+
+// random appends and removals, the contents are compared as a multiset
+// with a plain array after each step; the inline storage has to be used
+// up to N, and a fixed capacity vector must refuse to grow
+
+#define TEST_INLINE		4
+#define TEST_MAX		1000
+#define TEST_VALUES		64	// values repeat
+#define TEST_OPERATIONS		200000
+
+typedef CBTVector<unsigned, TEST_INLINE> TTestVector;
+
+static unsigned s_Model[TEST_VALUES];	// how often each value is in
+static unsigned s_nModelCount = 0;
+
+static boolean IsInline (const TTestVector *pVector)
+{
+	const u8 *pFirst = (const u8 *) &(*pVector)[0];
+
+	return    pFirst >= (const u8 *) pVector
+	       && pFirst < (const u8 *) (pVector + 1);
+}
+
+// same elements, the order is not kept by removal
+static boolean Check (const TTestVector *pVector)
+{
+	if (pVector->GetCount () != s_nModelCount) {
+		return FALSE;
+	}
+
+	unsigned Count[TEST_VALUES];
+	memset (Count, 0, sizeof Count);
+	for (unsigned i = 0; i < pVector->GetCount (); i++) {
+		Count[(*pVector)[i]]++;
+	}
+
+	return memcmp (Count, s_Model, sizeof Count) == 0;
+}
+
+int main (void)
+{
+	srand (11);
+
+	// growth keeps the elements in order, until something is removed
+	TTestVector Vector;
+	for (unsigned i = 0; i < TEST_MAX; i++) {
+		if (i == TEST_INLINE) {
+			BT_CHECK (IsInline (&Vector));
+		}
+		BT_CHECK (Vector.Append (i));
+	}
+	BT_CHECK (!IsInline (&Vector));
+	BT_CHECK (Vector.GetCount () == TEST_MAX);
+	for (unsigned i = 0; i < TEST_MAX; i++) {
+		BT_CHECK (Vector[i] == i);
+		BT_CHECK (Vector.Find (i) == (int) i);
+	}
+	BT_CHECK (Vector.Find (TEST_MAX) == -1);
+	Vector.Clear ();
+	BT_CHECK (Vector.GetCount () == 0);
+
+	// random churn, values repeat, so RemoveItem takes one of several
+	TTestVector Churn;
+	boolean bOK = TRUE;
+	for (unsigned i = 0; i < TEST_OPERATIONS && bOK; i++) {
+		unsigned nValue = rand () % TEST_VALUES;
+		switch (rand () % 4) {
+		case 0:
+		case 1:
+			if (s_nModelCount < TEST_MAX) {
+				BT_CHECK (Churn.Append (nValue));
+				s_Model[nValue]++;
+				s_nModelCount++;
+			}
+			break;
+
+		case 2: {
+			boolean bFound = s_Model[nValue] > 0;
+			BT_CHECK (Churn.RemoveItem (nValue) == bFound);
+			if (bFound) {
+				s_Model[nValue]--;
+				s_nModelCount--;
+			}
+			} break;
+
+		default:
+			if (s_nModelCount > 0) {
+				if (rand () & 1) {
+					unsigned nIndex = rand () % s_nModelCount;
+					s_Model[Churn[nIndex]]--;
+					Churn.Remove (nIndex);
+				} else {
+					s_Model[Churn[Churn.GetCount () - 1]]--;
+					Churn.RemoveLast ();
+				}
+				s_nModelCount--;
+			}
+			break;
+		}
+
+		if (!Check (&Churn)) {
+			printf ("mismatch at operation %u\n", i);
+			bOK = FALSE;
+		}
+	}
+	BT_CHECK (bOK);
+
+	// fixed capacity, never allocates
+	CBTVector<unsigned, TEST_INLINE, false> Fixed;
+	for (unsigned i = 0; i < TEST_INLINE; i++) {
+		BT_CHECK (Fixed.Append (i));
+	}
+	BT_CHECK (!Fixed.Append (TEST_INLINE));
+	BT_CHECK (Fixed.GetCount () == TEST_INLINE);
+	Fixed.Remove (0);
+	BT_CHECK (Fixed[0] == TEST_INLINE - 1);
+	BT_CHECK (Fixed.Append (TEST_INLINE));
+	BT_CHECK (!Fixed.Append (TEST_INLINE + 1));
+
+	printf ("%u operations, %u elements left\n", TEST_OPERATIONS, s_nModelCount);
+
+	return BT_TEST_RESULT ();
+}